@@ -67,6 +67,20 @@
 # define ABI_TYPE  uint32_t
 #endif
 
+/*
+ * An unaligned operation is emulated on the aligned host word around it,
+ * as far as the host can compare-and-swap it.  See atomic_rmw_widened().
+ */
+#if DATA_SIZE > 1 && DATA_SIZE < 16
+# define ATOMIC_WIDENED(OP, A, B, NEW)                               \
+    if (unlikely(addr & (DATA_SIZE - 1))) {                         \
+        return atomic_rmw_widened(env, addr, ATOMIC_WIDE_##OP, A, B, \
+                                  NEW, oi, retaddr);                \
+    }
+#else
+# define ATOMIC_WIDENED(OP, A, B, NEW)
+#endif
+
 /* Define host-endian atomic operations.  Note that END is used within
    the ATOMIC_NAME macro, and redefined below.  */
 #if DATA_SIZE == 1
@@ -81,10 +95,13 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
                               ABI_TYPE cmpv, ABI_TYPE newv,
                               MemOpIdx oi, uintptr_t retaddr)
 {
-    DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
-                                         DATA_SIZE, retaddr);
+    DATA_TYPE *haddr;
     DATA_TYPE ret;
 
+    ATOMIC_WIDENED(CMPXCHG, cmpv, newv, false)
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,
+                              NULL, retaddr);
+
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, cmpv, newv);
 #else
@@ -104,10 +121,13 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
 ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
                            MemOpIdx oi, uintptr_t retaddr)
 {
-    DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
-                                         DATA_SIZE, retaddr);
+    DATA_TYPE *haddr;
     DATA_TYPE ret;
 
+    ATOMIC_WIDENED(XCHG, val, 0, false)
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,
+                              NULL, retaddr);
+
     ret = qatomic_xchg__nocheck(haddr, val);
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr,
@@ -119,12 +139,14 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
     return ret;
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, OP, NEW)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
     DATA_TYPE *haddr, ret;                                          \
-    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
+    ATOMIC_WIDENED(OP, val, 0, NEW)                                 \
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,    \
+                              NULL, retaddr);                       \
     ret = qatomic_##X(haddr, val);                                  \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr,                                \
@@ -136,14 +158,14 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     return ret;                                                     \
 }
 
-GEN_ATOMIC_HELPER(fetch_add)
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(add_fetch)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_add, ADD, false)
+GEN_ATOMIC_HELPER(fetch_and, AND, false)
+GEN_ATOMIC_HELPER(fetch_or, OR, false)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, false)
+GEN_ATOMIC_HELPER(add_fetch, ADD, true)
+GEN_ATOMIC_HELPER(and_fetch, AND, true)
+GEN_ATOMIC_HELPER(or_fetch, OR, true)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, true)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -155,12 +177,14 @@ GEN_ATOMIC_HELPER(xor_fetch)
  * Trace this load + RMW loop as a single RMW op. This way, regardless
  * of CF_PARALLEL's value, we'll trace just a read and a write.
  */
-#define GEN_ATOMIC_HELPER_FN(X, FN, XDATA_TYPE, RET)                \
+#define GEN_ATOMIC_HELPER_FN(X, FN, XDATA_TYPE, RET, OP, NEW)       \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE xval, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
     XDATA_TYPE *haddr, cmp, old, new, val = xval;                   \
-    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
+    ATOMIC_WIDENED(OP, xval, 0, NEW)                                \
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,    \
+                              NULL, retaddr);                       \
     smp_mb();                                                       \
     cmp = qatomic_read__nocheck(haddr);                             \
     do {                                                            \
@@ -177,15 +201,15 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     return RET;                                                     \
 }
 
-GEN_ATOMIC_HELPER_FN(fetch_smin, MIN, SDATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(fetch_umin, MIN,  DATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(fetch_smax, MAX, SDATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(fetch_umax, MAX,  DATA_TYPE, old)
+GEN_ATOMIC_HELPER_FN(fetch_smin, MIN, SDATA_TYPE, old, SMIN, false)
+GEN_ATOMIC_HELPER_FN(fetch_umin, MIN,  DATA_TYPE, old, UMIN, false)
+GEN_ATOMIC_HELPER_FN(fetch_smax, MAX, SDATA_TYPE, old, SMAX, false)
+GEN_ATOMIC_HELPER_FN(fetch_umax, MAX,  DATA_TYPE, old, UMAX, false)
 
-GEN_ATOMIC_HELPER_FN(smin_fetch, MIN, SDATA_TYPE, new)
-GEN_ATOMIC_HELPER_FN(umin_fetch, MIN,  DATA_TYPE, new)
-GEN_ATOMIC_HELPER_FN(smax_fetch, MAX, SDATA_TYPE, new)
-GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new)
+GEN_ATOMIC_HELPER_FN(smin_fetch, MIN, SDATA_TYPE, new, SMIN, true)
+GEN_ATOMIC_HELPER_FN(umin_fetch, MIN,  DATA_TYPE, new, UMIN, true)
+GEN_ATOMIC_HELPER_FN(smax_fetch, MAX, SDATA_TYPE, new, SMAX, true)
+GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new, UMAX, true)
 
 #undef GEN_ATOMIC_HELPER_FN
 #endif /* DATA SIZE < 16 */
@@ -206,10 +230,13 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
                               ABI_TYPE cmpv, ABI_TYPE newv,
                               MemOpIdx oi, uintptr_t retaddr)
 {
-    DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
-                                         DATA_SIZE, retaddr);
+    DATA_TYPE *haddr;
     DATA_TYPE ret;
 
+    ATOMIC_WIDENED(CMPXCHG, cmpv, newv, false)
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,
+                              NULL, retaddr);
+
 #if DATA_SIZE == 16
     ret = atomic16_cmpxchg(haddr, BSWAP(cmpv), BSWAP(newv));
 #else
@@ -229,10 +256,13 @@ ABI_TYPE ATOMIC_NAME(cmpxchg)(CPUArchState *env, abi_ptr addr,
 ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
                            MemOpIdx oi, uintptr_t retaddr)
 {
-    DATA_TYPE *haddr = atomic_mmu_lookup(env_cpu(env), addr, oi,
-                                         DATA_SIZE, retaddr);
+    DATA_TYPE *haddr;
     ABI_TYPE ret;
 
+    ATOMIC_WIDENED(XCHG, val, 0, false)
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,
+                              NULL, retaddr);
+
     ret = qatomic_xchg__nocheck(haddr, BSWAP(val));
     ATOMIC_MMU_CLEANUP;
     atomic_trace_rmw_post(env, addr,
@@ -244,12 +274,14 @@ ABI_TYPE ATOMIC_NAME(xchg)(CPUArchState *env, abi_ptr addr, ABI_TYPE val,
     return BSWAP(ret);
 }
 
-#define GEN_ATOMIC_HELPER(X)                                        \
+#define GEN_ATOMIC_HELPER(X, OP, NEW)                               \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE val, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
     DATA_TYPE *haddr, ret;                                          \
-    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
+    ATOMIC_WIDENED(OP, val, 0, NEW)                                 \
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,    \
+                              NULL, retaddr);                       \
     ret = qatomic_##X(haddr, BSWAP(val));                           \
     ATOMIC_MMU_CLEANUP;                                             \
     atomic_trace_rmw_post(env, addr,                                \
@@ -261,12 +293,12 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     return BSWAP(ret);                                              \
 }
 
-GEN_ATOMIC_HELPER(fetch_and)
-GEN_ATOMIC_HELPER(fetch_or)
-GEN_ATOMIC_HELPER(fetch_xor)
-GEN_ATOMIC_HELPER(and_fetch)
-GEN_ATOMIC_HELPER(or_fetch)
-GEN_ATOMIC_HELPER(xor_fetch)
+GEN_ATOMIC_HELPER(fetch_and, AND, false)
+GEN_ATOMIC_HELPER(fetch_or, OR, false)
+GEN_ATOMIC_HELPER(fetch_xor, XOR, false)
+GEN_ATOMIC_HELPER(and_fetch, AND, true)
+GEN_ATOMIC_HELPER(or_fetch, OR, true)
+GEN_ATOMIC_HELPER(xor_fetch, XOR, true)
 
 #undef GEN_ATOMIC_HELPER
 
@@ -277,12 +309,14 @@ GEN_ATOMIC_HELPER(xor_fetch)
  * Trace this load + RMW loop as a single RMW op. This way, regardless
  * of CF_PARALLEL's value, we'll trace just a read and a write.
  */
-#define GEN_ATOMIC_HELPER_FN(X, FN, XDATA_TYPE, RET)                \
+#define GEN_ATOMIC_HELPER_FN(X, FN, XDATA_TYPE, RET, OP, NEW)       \
 ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
                         ABI_TYPE xval, MemOpIdx oi, uintptr_t retaddr) \
 {                                                                   \
     XDATA_TYPE *haddr, ldo, ldn, old, new, val = xval;              \
-    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE, retaddr);   \
+    ATOMIC_WIDENED(OP, xval, 0, NEW)                                \
+    haddr = atomic_mmu_lookup(env_cpu(env), addr, oi, DATA_SIZE,    \
+                              NULL, retaddr);                       \
     smp_mb();                                                       \
     ldn = qatomic_read__nocheck(haddr);                             \
     do {                                                            \
@@ -299,21 +333,21 @@ ABI_TYPE ATOMIC_NAME(X)(CPUArchState *env, abi_ptr addr,            \
     return RET;                                                     \
 }
 
-GEN_ATOMIC_HELPER_FN(fetch_smin, MIN, SDATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(fetch_umin, MIN,  DATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(fetch_smax, MAX, SDATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(fetch_umax, MAX,  DATA_TYPE, old)
+GEN_ATOMIC_HELPER_FN(fetch_smin, MIN, SDATA_TYPE, old, SMIN, false)
+GEN_ATOMIC_HELPER_FN(fetch_umin, MIN,  DATA_TYPE, old, UMIN, false)
+GEN_ATOMIC_HELPER_FN(fetch_smax, MAX, SDATA_TYPE, old, SMAX, false)
+GEN_ATOMIC_HELPER_FN(fetch_umax, MAX,  DATA_TYPE, old, UMAX, false)
 
-GEN_ATOMIC_HELPER_FN(smin_fetch, MIN, SDATA_TYPE, new)
-GEN_ATOMIC_HELPER_FN(umin_fetch, MIN,  DATA_TYPE, new)
-GEN_ATOMIC_HELPER_FN(smax_fetch, MAX, SDATA_TYPE, new)
-GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new)
+GEN_ATOMIC_HELPER_FN(smin_fetch, MIN, SDATA_TYPE, new, SMIN, true)
+GEN_ATOMIC_HELPER_FN(umin_fetch, MIN,  DATA_TYPE, new, UMIN, true)
+GEN_ATOMIC_HELPER_FN(smax_fetch, MAX, SDATA_TYPE, new, SMAX, true)
+GEN_ATOMIC_HELPER_FN(umax_fetch, MAX,  DATA_TYPE, new, UMAX, true)
 
 /* Note that for addition, we need to use a separate cmpxchg loop instead
    of bswaps for the reverse-host-endian helpers.  */
 #define ADD(X, Y)   (X + Y)
-GEN_ATOMIC_HELPER_FN(fetch_add, ADD, DATA_TYPE, old)
-GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new)
+GEN_ATOMIC_HELPER_FN(fetch_add, ADD, DATA_TYPE, old, ADD, false)
+GEN_ATOMIC_HELPER_FN(add_fetch, ADD, DATA_TYPE, new, ADD, true)
 #undef ADD
 
 #undef GEN_ATOMIC_HELPER_FN
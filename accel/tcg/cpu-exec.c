@@ -44,6 +44,8 @@
 #include "tb-internal.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "dirty-ring.h"
+#include "tb-profile.h"
 
 /* -icount align implementation. */
 
@@ -193,9 +195,9 @@ static bool tb_lookup_cmp(const void *p, const void *d)
     return false;
 }
 
-static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
-                                          uint64_t cs_base, uint32_t flags,
-                                          uint32_t cflags)
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags)
 {
     tb_page_addr_t phys_pc;
     struct tb_desc desc;
@@ -216,6 +218,81 @@ static TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
     return qht_lookup_custom(&tb_ctx.htable, &desc, h, tb_lookup_cmp);
 }
 
+/*
+ * Resize the jump cache of @cpu based on the miss rate seen over windows
+ * of TB_JMP_CACHE_WINDOW lookups per entry.  Much like the TLB in
+ * tlb_mmu_resize_locked(), grow quickly when the cache thrashes and
+ * shrink only once it is both rarely missed and mostly empty.
+ */
+#define TB_JMP_CACHE_WINDOW       4
+#define TB_JMP_CACHE_GROW_RATE    10
+#define TB_JMP_CACHE_SHRINK_RATE  1
+
+static CPUJumpCache *tb_jmp_cache_new(unsigned bits)
+{
+    CPUJumpCache *jc;
+
+    jc = g_malloc0(sizeof(*jc) + (sizeof(jc->array[0]) << bits));
+    jc->bits = bits;
+    return jc;
+}
+
+/*
+ * Account a jump cache miss, possibly replacing the cache with one of a
+ * different size.  Returns the cache that is now current for @cpu.
+ */
+static CPUJumpCache *tb_jmp_cache_miss(CPUState *cpu, CPUJumpCache *jc)
+{
+    CPUJumpCache *new_jc;
+    unsigned bits = jc->bits;
+    size_t lookups, misses;
+
+    qatomic_set(&jc->misses, jc->misses + 1);
+
+    lookups = jc->hits + jc->misses - jc->window_lookups;
+    if (lookups < ((size_t)TB_JMP_CACHE_WINDOW << bits)) {
+        return jc;
+    }
+    misses = jc->misses - jc->window_misses;
+    jc->window_lookups = jc->hits + jc->misses;
+    jc->window_misses = jc->misses;
+
+    if (misses * 100 > lookups * TB_JMP_CACHE_GROW_RATE) {
+        if (bits < TB_JMP_CACHE_MAX_BITS) {
+            bits++;
+        }
+    } else if (misses * 100 < lookups * TB_JMP_CACHE_SHRINK_RATE &&
+               bits > TB_JMP_CACHE_MIN_BITS) {
+        size_t used = 0;
+
+        for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
+            used += qatomic_read(&jc->array[i].tb) != NULL;
+        }
+        if (used < tb_jmp_cache_size(jc) / 4) {
+            bits--;
+        }
+    }
+
+    if (bits == jc->bits) {
+        return jc;
+    }
+
+    /*
+     * Start the new cache empty, as the TLB does on resize.  Entries that
+     * other threads invalidate in the old copy meanwhile are never seen
+     * again, and the old copy is freed once they have left it.
+     */
+    new_jc = tb_jmp_cache_new(bits);
+    new_jc->hits = jc->hits;
+    new_jc->misses = jc->misses;
+    new_jc->window_lookups = jc->window_lookups;
+    new_jc->window_misses = jc->window_misses;
+    qatomic_rcu_set(&cpu->tb_jmp_cache, new_jc);
+    g_free_rcu(jc, rcu);
+
+    return new_jc;
+}
+
 /**
  * tb_lookup:
  * @cpu: CPU that will execute the returned translation block
@@ -241,8 +318,8 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
     /* we should never be trying to look up an INVALID tb */
     tcg_debug_assert(!(cflags & CF_INVALID));
 
-    hash = tb_jmp_cache_hash_func(pc);
     jc = cpu->tb_jmp_cache;
+    hash = tb_jmp_cache_hash_func(pc, jc->bits);
 
     tb = qatomic_read(&jc->array[hash].tb);
     if (likely(tb &&
@@ -250,9 +327,13 @@ static inline TranslationBlock *tb_lookup(CPUState *cpu, vaddr pc,
                tb->cs_base == cs_base &&
                tb->flags == flags &&
                tb_cflags(tb) == cflags)) {
+        qatomic_set(&jc->hits, jc->hits + 1);
         goto hit;
     }
 
+    jc = tb_jmp_cache_miss(cpu, jc);
+    hash = tb_jmp_cache_hash_func(pc, jc->bits);
+
     tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
         return NULL;
@@ -407,8 +488,12 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
 
     tb = tb_lookup(cpu, pc, cs_base, flags, cflags);
     if (tb == NULL) {
+        qatomic_set(&cpu->tb_exit_stats.lookup_misses,
+                    cpu->tb_exit_stats.lookup_misses + 1);
         return tcg_code_gen_epilogue;
     }
+    qatomic_set(&cpu->tb_exit_stats.lookup_hits,
+                cpu->tb_exit_stats.lookup_hits + 1);
 
     if (qemu_loglevel_mask(CPU_LOG_TB_CPU | CPU_LOG_EXEC)) {
         log_cpu_exec(pc, cpu, tb);
@@ -417,6 +502,28 @@ const void *HELPER(lookup_tb_ptr)(CPUArchState *env)
     return tb->tc.ptr;
 }
 
+/**
+ * helper_tier_up: retranslate a hot TB with the optimizer
+ * @env: current cpu state
+ * @ptr: the TB, which was translated without the optimizer
+ *
+ * Called on entry to @ptr once it has used up its tier_up_budget.
+ * Invalidate it, so that the next lookup misses and tb_gen_code()
+ * retranslates it with the optimizer, and request an exit so that the
+ * TB is left through its exit request check before it executes any
+ * guest instruction.
+ */
+void HELPER(tier_up)(CPUArchState *env, void *ptr)
+{
+    CPUState *cpu = env_cpu(env);
+    TranslationBlock *tb = ptr;
+
+    trace_exec_tb_tier_up(tb, tb_page_addr0(tb));
+    cpu->tb_tier_up_addr = tb_page_addr0(tb);
+    tb_phys_invalidate(tb, -1);
+    qatomic_set(&cpu->neg.icount_decr.u16.high, -1);
+}
+
 /* Return the current PC from CPU, which may be cached in TB. */
 static vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
 {
@@ -440,6 +547,7 @@ static vaddr log_pc(CPUState *cpu, const TranslationBlock *tb)
 static inline TranslationBlock * QEMU_DISABLE_CFI
 cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
 {
+    CPUTBExitStats *stats = &cpu->tb_exit_stats;
     uintptr_t ret;
     TranslationBlock *last_tb;
     const void *tb_ptr = itb->tc.ptr;
@@ -465,6 +573,14 @@ cpu_tb_exec(CPUState *cpu, TranslationBlock *itb, int *tb_exit)
 
     trace_exec_tb_exit(last_tb, *tb_exit);
 
+    if (*tb_exit == TB_EXIT_REQUESTED) {
+        qatomic_set(&stats->requested, stats->requested + 1);
+    } else if (last_tb) {
+        qatomic_set(&stats->goto_tb, stats->goto_tb + 1);
+    } else {
+        qatomic_set(&stats->exit_tb, stats->exit_tb + 1);
+    }
+
     if (*tb_exit > TB_EXIT_IDX1) {
         /* We didn't start executing this TB (eg because the instruction
          * counter hit zero); we must restore the guest PC to the address
@@ -569,13 +685,18 @@ void cpu_exec_step_atomic(CPUState *cpu)
     int tb_exit;
 
     if (sigsetjmp(cpu->jmp_env, 0) == 0) {
-        start_exclusive();
+        start_exclusive_cause(EXCLUSIVE_CAUSE_STEP_ATOMIC);
         g_assert(cpu == current_cpu);
         g_assert(!cpu->running);
         cpu->running = true;
 
         cpu_get_tb_cpu_state(env, &pc, &cs_base, &flags);
 
+        /* Count the atomic operations that the host could not do in parallel */
+        qatomic_set(&tb_ctx.tb_step_atomic_count,
+                    tb_ctx.tb_step_atomic_count + 1);
+        trace_exec_step_atomic(pc);
+
         cflags = curr_cflags(cpu);
         /* Execute in a serial context. */
         cflags &= ~CF_PARALLEL;
@@ -797,6 +918,17 @@ static inline bool cpu_handle_interrupt(CPUState *cpu,
      */
     qatomic_set_mb(&cpu->neg.icount_decr.u16.high, 0);
 
+#ifndef CONFIG_USER_ONLY
+    if (unlikely(qatomic_read(&cpu->tcg_profile_pending))) {
+        vaddr pc;
+        uint64_t cs_base;
+        uint32_t flags;
+
+        cpu_get_tb_cpu_state(cpu_env(cpu), &pc, &cs_base, &flags);
+        tcg_profile_sample(cpu, pc, cpu_mmu_index(cpu, false));
+    }
+#endif
+
     if (unlikely(qatomic_read(&cpu->interrupt_request))) {
         int interrupt_request;
         bql_lock();
@@ -991,8 +1123,8 @@ cpu_exec_loop(CPUState *cpu, SyncClocks *sc)
                  * We add the TB in the virtual pc hash table
                  * for the fast lookup
                  */
-                h = tb_jmp_cache_hash_func(pc);
                 jc = cpu->tb_jmp_cache;
+                h = tb_jmp_cache_hash_func(pc, jc->bits);
                 jc->array[h].pc = pc;
                 qatomic_set(&jc->array[h].tb, tb);
             }
@@ -1078,10 +1210,11 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
         tcg_target_initialized = true;
     }
 
-    cpu->tb_jmp_cache = g_new0(CPUJumpCache, 1);
+    cpu->tb_jmp_cache = tb_jmp_cache_new(TB_JMP_CACHE_BITS);
     tlb_init(cpu);
 #ifndef CONFIG_USER_ONLY
     tcg_iommu_init_notifier_list(cpu);
+    tcg_dirty_ring_init(cpu);
 #endif /* !CONFIG_USER_ONLY */
     /* qemu_plugin_vcpu_init_hook delayed until cpu_index assigned. */
 
@@ -1092,6 +1225,7 @@ bool tcg_exec_realizefn(CPUState *cpu, Error **errp)
 void tcg_exec_unrealizefn(CPUState *cpu)
 {
 #ifndef CONFIG_USER_ONLY
+    tcg_dirty_ring_destroy(cpu);
     tcg_iommu_free_notifier_list(cpu);
 #endif /* !CONFIG_USER_ONLY */
 
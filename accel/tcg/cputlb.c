@@ -43,6 +43,9 @@
 #include "tb-internal.h"
 #include "internal-common.h"
 #include "internal-target.h"
+#include "dirty-ring.h"
+#include "tlb-sample.h"
+#include "tb-context.h"
 #ifdef CONFIG_PLUGIN
 #include "qemu/plugin-memory.h"
 #endif
@@ -145,15 +148,15 @@ static void tlb_window_reset(CPUTLBDesc *desc, int64_t ns,
 
 static void tb_jmp_cache_clear_page(CPUState *cpu, vaddr page_addr)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
     int i, i0;
 
     if (unlikely(!jc)) {
         return;
     }
 
-    i0 = tb_jmp_cache_hash_page(page_addr);
-    for (i = 0; i < TB_JMP_PAGE_SIZE; i++) {
+    i0 = tb_jmp_cache_hash_page(page_addr, jc->bits);
+    for (i = 0; i < TB_JMP_PAGE_SIZE(jc->bits); i++) {
         qatomic_set(&jc->array[i0 + i].tb, NULL);
     }
 }
@@ -273,14 +276,44 @@ static void tlb_mmu_resize_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
     }
 }
 
-static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast)
+static inline size_t tlb_vtlb_size(CPUState *cpu)
+{
+    return cpu->neg.tlb.c.vtlb_sets * CPU_VTLB_WAYS;
+}
+
+/*
+ * Return the index of the first victim tlb entry of the set for PAGE.
+ *
+ * victim_tlb_hit() swaps the main tlb entry of PAGE's index into PAGE's
+ * set.  That is the set of the swapped entry too only if the set index
+ * uses no more bits than the main tlb index, even with the smallest
+ * dynamic main tlb.
+ */
+QEMU_BUILD_BUG_ON(CPU_VTLB_MAX_SIZE / CPU_VTLB_WAYS >
+                  (1 << CPU_TLB_DYN_MIN_BITS));
+
+static inline size_t tlb_vtlb_set(CPUState *cpu, vaddr page)
+{
+    size_t set = (page >> TARGET_PAGE_BITS) & (cpu->neg.tlb.c.vtlb_sets - 1);
+
+    return set * CPU_VTLB_WAYS;
+}
+
+static void tlb_mmu_flush_locked(CPUTLBDesc *desc, CPUTLBDescFast *fast,
+                                 size_t vtlb_size)
 {
     desc->n_used_entries = 0;
     desc->large_page_addr = -1;
     desc->large_page_mask = -1;
-    desc->vindex = 0;
+    desc->vclock = 0;
     memset(fast->table, -1, sizeof_tlb(fast));
-    memset(desc->vtable, -1, sizeof(desc->vtable));
+    memset(desc->vtable, -1, vtlb_size * sizeof(desc->vtable[0]));
+    memset(desc->vlru, 0, vtlb_size * sizeof(desc->vlru[0]));
+    desc->lindex = 0;
+    for (int i = 0; i < CPU_LTLB_SIZE; i++) {
+        desc->ltlb[i].addr = -1;
+        desc->ltlb[i].mask = 0;
+    }
 }
 
 static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
@@ -290,10 +323,11 @@ static void tlb_flush_one_mmuidx_locked(CPUState *cpu, int mmu_idx,
     CPUTLBDescFast *fast = &cpu->neg.tlb.f[mmu_idx];
 
     tlb_mmu_resize_locked(desc, fast, now);
-    tlb_mmu_flush_locked(desc, fast);
+    tlb_mmu_flush_locked(desc, fast, tlb_vtlb_size(cpu));
 }
 
-static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
+static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now,
+                         size_t vtlb_size)
 {
     size_t n_entries = 1 << CPU_TLB_DYN_DEFAULT_BITS;
 
@@ -302,7 +336,10 @@ static void tlb_mmu_init(CPUTLBDesc *desc, CPUTLBDescFast *fast, int64_t now)
     fast->mask = (n_entries - 1) << CPU_TLB_ENTRY_BITS;
     fast->table = g_new(CPUTLBEntry, n_entries);
     desc->fulltlb = g_new(CPUTLBEntryFull, n_entries);
-    tlb_mmu_flush_locked(desc, fast);
+    desc->vtable = g_new(CPUTLBEntry, vtlb_size);
+    desc->vfulltlb = g_new(CPUTLBEntryFull, vtlb_size);
+    desc->vlru = g_new(uint32_t, vtlb_size);
+    tlb_mmu_flush_locked(desc, fast, vtlb_size);
 }
 
 static inline void tlb_n_used_entries_inc(CPUState *cpu, uintptr_t mmu_idx)
@@ -324,9 +361,11 @@ void tlb_init(CPUState *cpu)
 
     /* All tlbs are initialized flushed. */
     cpu->neg.tlb.c.dirty = 0;
+    cpu->neg.tlb.c.vtlb_sets = tcg_vtlb_size / CPU_VTLB_WAYS;
 
     for (i = 0; i < NB_MMU_MODES; i++) {
-        tlb_mmu_init(&cpu->neg.tlb.d[i], &cpu->neg.tlb.f[i], now);
+        tlb_mmu_init(&cpu->neg.tlb.d[i], &cpu->neg.tlb.f[i], now,
+                     tlb_vtlb_size(cpu));
     }
 }
 
@@ -341,7 +380,12 @@ void tlb_destroy(CPUState *cpu)
 
         g_free(fast->table);
         g_free(desc->fulltlb);
+        g_free(desc->vtable);
+        g_free(desc->vfulltlb);
+        g_free(desc->vlru);
     }
+    g_free(cpu->tlb_sample);
+    cpu->tlb_sample = NULL;
 }
 
 /* flush_all_helper: run fn across all cpus
@@ -457,6 +501,45 @@ static inline bool tlb_entry_is_empty(const CPUTLBEntry *te)
     return te->addr_read == -1 && te->addr_write == -1 && te->addr_code == -1;
 }
 
+/* Return the page of a tlb entry that is not empty.  */
+static inline vaddr tlb_entry_page(const CPUTLBEntry *te)
+{
+    uint64_t cmp = te->addr_read;
+
+    if (cmp == -1) {
+        cmp = te->addr_write;
+    }
+    if (cmp == -1) {
+        cmp = te->addr_code;
+    }
+    return cmp & TARGET_PAGE_MASK;
+}
+
+/*
+ * Pick the entry of the victim tlb to evict for PAGE: an empty way of its
+ * set if there is one, otherwise the least recently used.  The entry is
+ * marked as the most recently used.  Called with tlb_c.lock held.
+ */
+static size_t tlb_vtlb_victim(CPUState *cpu, CPUTLBDesc *desc, vaddr page)
+{
+    size_t set = tlb_vtlb_set(cpu, page);
+    size_t vidx = set;
+    uint32_t age = 0;
+
+    for (size_t k = set; k < set + CPU_VTLB_WAYS; k++) {
+        if (tlb_entry_is_empty(&desc->vtable[k])) {
+            vidx = k;
+            break;
+        }
+        if (desc->vclock - desc->vlru[k] >= age) {
+            age = desc->vclock - desc->vlru[k];
+            vidx = k;
+        }
+    }
+    desc->vlru[vidx] = ++desc->vclock;
+    return vidx;
+}
+
 /* Called with tlb_c.lock held */
 static bool tlb_flush_entry_mask_locked(CPUTLBEntry *tlb_entry,
                                         vaddr page,
@@ -480,10 +563,19 @@ static void tlb_flush_vtlb_page_mask_locked(CPUState *cpu, int mmu_idx,
                                             vaddr mask)
 {
     CPUTLBDesc *d = &cpu->neg.tlb.d[mmu_idx];
-    int k;
+    size_t k, n;
 
     assert_cpu_is_self(cpu);
-    for (k = 0; k < CPU_VTLB_SIZE; k++) {
+
+    /* Only a flush of one page can be confined to the set of that page.  */
+    if (mask == -1) {
+        k = tlb_vtlb_set(cpu, page);
+        n = k + CPU_VTLB_WAYS;
+    } else {
+        k = 0;
+        n = tlb_vtlb_size(cpu);
+    }
+    for (; k < n; k++) {
         if (tlb_flush_entry_mask_locked(&d->vtable[k], page, mask)) {
             tlb_n_used_entries_dec(cpu, mmu_idx);
         }
@@ -575,6 +667,15 @@ typedef struct {
     uint16_t idxmap;
 } TLBFlushPageByMMUIdxData;
 
+typedef struct {
+    vaddr addr;
+    vaddr len;
+    uint16_t idxmap;
+    uint16_t bits;
+} TLBFlushRangeData;
+
+static void tlb_flush_queue_pending(CPUState *cpu, TLBFlushRangeData d);
+
 /**
  * tlb_flush_page_by_mmuidx_async_2:
  * @cpu: cpu on which to flush
@@ -615,40 +716,39 @@ void tlb_flush_page_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
                                               vaddr addr,
                                               uint16_t idxmap)
 {
+    TLBFlushRangeData d;
+    CPUState *dst_cpu;
+
     tlb_debug("addr: %016" VADDR_PRIx " mmu_idx:%"PRIx16"\n", addr, idxmap);
 
     /* This should already be page aligned */
     addr &= TARGET_PAGE_MASK;
 
+    d.addr = addr;
+    d.len = TARGET_PAGE_SIZE;
+    d.idxmap = idxmap;
+    d.bits = TARGET_LONG_BITS;
+
+    CPU_FOREACH(dst_cpu) {
+        if (dst_cpu != src_cpu) {
+            tlb_flush_queue_pending(dst_cpu, d);
+        }
+    }
+
     /*
      * Allocate memory to hold addr+idxmap only when needed.
      * See tlb_flush_page_by_mmuidx for details.
      */
     if (idxmap < TARGET_PAGE_SIZE) {
-        flush_all_helper(src_cpu, tlb_flush_page_by_mmuidx_async_1,
-                         RUN_ON_CPU_TARGET_PTR(addr | idxmap));
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_1,
                               RUN_ON_CPU_TARGET_PTR(addr | idxmap));
     } else {
-        CPUState *dst_cpu;
-        TLBFlushPageByMMUIdxData *d;
-
-        /* Allocate a separate data block for each destination cpu.  */
-        CPU_FOREACH(dst_cpu) {
-            if (dst_cpu != src_cpu) {
-                d = g_new(TLBFlushPageByMMUIdxData, 1);
-                d->addr = addr;
-                d->idxmap = idxmap;
-                async_run_on_cpu(dst_cpu, tlb_flush_page_by_mmuidx_async_2,
-                                 RUN_ON_CPU_HOST_PTR(d));
-            }
-        }
+        TLBFlushPageByMMUIdxData *p = g_new(TLBFlushPageByMMUIdxData, 1);
 
-        d = g_new(TLBFlushPageByMMUIdxData, 1);
-        d->addr = addr;
-        d->idxmap = idxmap;
+        p->addr = addr;
+        p->idxmap = idxmap;
         async_safe_run_on_cpu(src_cpu, tlb_flush_page_by_mmuidx_async_2,
-                              RUN_ON_CPU_HOST_PTR(d));
+                              RUN_ON_CPU_HOST_PTR(p));
     }
 }
 
@@ -707,13 +807,6 @@ static void tlb_flush_range_locked(CPUState *cpu, int midx,
     }
 }
 
-typedef struct {
-    vaddr addr;
-    vaddr len;
-    uint16_t idxmap;
-    uint16_t bits;
-} TLBFlushRangeData;
-
 static void tlb_flush_range_by_mmuidx_async_0(CPUState *cpu,
                                               TLBFlushRangeData d)
 {
@@ -760,6 +853,113 @@ static void tlb_flush_range_by_mmuidx_async_1(CPUState *cpu,
     g_free(d);
 }
 
+/**
+ * tlb_flush_pending_async:
+ * @cpu: cpu on which to flush
+ * @data: unused
+ *
+ * Perform the page and range flushes that other cpus have batched
+ * for @cpu with tlb_flush_queue_pending, and which have not been
+ * escalated to a full flush of their mmu_idx.
+ */
+static void tlb_flush_pending_async(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    TLBFlushRangeData pending[CPU_TLB_PENDING_FLUSH_MAX];
+    uint16_t full;
+    unsigned i, n;
+
+    assert_cpu_is_self(cpu);
+
+    qemu_spin_lock(&c->lock);
+    n = c->pending_count;
+    for (i = 0; i < n; i++) {
+        pending[i].addr = c->pending[i].addr;
+        pending[i].len = c->pending[i].len;
+        pending[i].idxmap = c->pending[i].idxmap;
+        pending[i].bits = c->pending[i].bits;
+    }
+    full = c->pending_full;
+    c->pending_count = 0;
+    c->pending_full = 0;
+    c->pending_queued = false;
+    qemu_spin_unlock(&c->lock);
+
+    if (full) {
+        tlb_flush_by_mmuidx_async_work(cpu, RUN_ON_CPU_HOST_INT(full));
+    }
+    for (i = 0; i < n; i++) {
+        TLBFlushRangeData d = pending[i];
+
+        d.idxmap &= ~full;
+        if (!d.idxmap) {
+            continue;
+        }
+        if (d.bits >= TARGET_LONG_BITS && d.len <= TARGET_PAGE_SIZE) {
+            tlb_flush_page_by_mmuidx_async_0(cpu, d.addr, d.idxmap);
+        } else {
+            tlb_flush_range_by_mmuidx_async_0(cpu, d);
+        }
+    }
+}
+
+/**
+ * tlb_flush_queue_pending:
+ * @cpu: cpu on which to flush
+ * @d: the page or range to flush
+ *
+ * Batch a flush requested by another cpu.  Only one work item is
+ * queued on @cpu for all of the requests made before it runs, and
+ * the same page or range requested again is merged by idxmap.
+ * When there are too many requests to batch, flush their mmu_idx
+ * entirely instead, which is then cheaper than testing each one.
+ */
+static void tlb_flush_queue_pending(CPUState *cpu, TLBFlushRangeData d)
+{
+    CPUTLBCommon *c = &cpu->neg.tlb.c;
+    bool queue;
+    unsigned i, n;
+
+    qemu_spin_lock(&c->lock);
+    queue = !c->pending_queued;
+    if (queue) {
+        c->pending_queued = true;
+    } else {
+        qatomic_set(&c->batch_flush_count, c->batch_flush_count + 1);
+    }
+
+    d.idxmap &= ~c->pending_full;
+    n = c->pending_count;
+    for (i = 0; d.idxmap && i < n; i++) {
+        if (c->pending[i].addr == d.addr && c->pending[i].len == d.len &&
+            c->pending[i].bits == d.bits) {
+            c->pending[i].idxmap |= d.idxmap;
+            d.idxmap = 0;
+        }
+    }
+    if (!d.idxmap) {
+        /* Already pending. */
+    } else if (n < CPU_TLB_PENDING_FLUSH_MAX) {
+        c->pending[n].addr = d.addr;
+        c->pending[n].len = d.len;
+        c->pending[n].idxmap = d.idxmap;
+        c->pending[n].bits = d.bits;
+        c->pending_count = n + 1;
+    } else {
+        tlb_debug("forcing full flush of pending mmu_map:0x%x\n", d.idxmap);
+        for (i = 0; i < n; i++) {
+            c->pending_full |= c->pending[i].idxmap;
+        }
+        c->pending_full |= d.idxmap;
+        c->pending_count = 0;
+    }
+    qemu_spin_unlock(&c->lock);
+
+    if (queue) {
+        async_run_on_cpu(cpu, tlb_flush_pending_async, RUN_ON_CPU_NULL);
+    }
+}
+
 void tlb_flush_range_by_mmuidx(CPUState *cpu, vaddr addr,
                                vaddr len, uint16_t idxmap,
                                unsigned bits)
@@ -826,12 +1026,9 @@ void tlb_flush_range_by_mmuidx_all_cpus_synced(CPUState *src_cpu,
     d.idxmap = idxmap;
     d.bits = bits;
 
-    /* Allocate a separate data block for each destination cpu.  */
     CPU_FOREACH(dst_cpu) {
         if (dst_cpu != src_cpu) {
-            p = g_memdup(&d, sizeof(d));
-            async_run_on_cpu(dst_cpu, tlb_flush_range_by_mmuidx_async_1,
-                             RUN_ON_CPU_HOST_PTR(p));
+            tlb_flush_queue_pending(dst_cpu, d);
         }
     }
 
@@ -926,7 +1123,7 @@ void tlb_reset_dirty(CPUState *cpu, ram_addr_t start1, ram_addr_t length)
                                          start1, length);
         }
 
-        for (i = 0; i < CPU_VTLB_SIZE; i++) {
+        for (i = 0; i < tlb_vtlb_size(cpu); i++) {
             tlb_reset_dirty_range_locked(&cpu->neg.tlb.d[mmu_idx].vtable[i],
                                          start1, length);
         }
@@ -958,14 +1155,53 @@ static void tlb_set_dirty(CPUState *cpu, vaddr addr)
     }
 
     for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
-        int k;
-        for (k = 0; k < CPU_VTLB_SIZE; k++) {
+        size_t k, set = tlb_vtlb_set(cpu, addr);
+
+        for (k = set; k < set + CPU_VTLB_WAYS; k++) {
             tlb_set_dirty1_locked(&cpu->neg.tlb.d[mmu_idx].vtable[k], addr);
         }
     }
     qemu_spin_unlock(&cpu->neg.tlb.c.lock);
 }
 
+/*
+ * With a dirty granularity larger than a page, a notdirty write has marked
+ * the whole granule [START, START + LENGTH) dirty.  Assuming the guest maps
+ * the granule linearly around ADDR, drop TLB_NOTDIRTY from the entries of
+ * the neighbouring pages as well, so that they do not each trap once more.
+ */
+static void tlb_set_dirty_granule(CPUState *cpu, vaddr addr,
+                                  ram_addr_t ram_addr, ram_addr_t start,
+                                  ram_addr_t length)
+{
+    ram_addr_t offset;
+    int mmu_idx;
+
+    assert_cpu_is_self(cpu);
+
+    addr &= TARGET_PAGE_MASK;
+    ram_addr &= TARGET_PAGE_MASK;
+    qemu_spin_lock(&cpu->neg.tlb.c.lock);
+    for (offset = 0; offset < length; offset += TARGET_PAGE_SIZE) {
+        vaddr page = addr - (ram_addr - start) + offset;
+
+        if (page == addr ||
+            !cpu_physical_memory_get_dirty_flag(start + offset,
+                                                DIRTY_MEMORY_CODE)) {
+            continue;
+        }
+        for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+            uintptr_t index = tlb_index(cpu, mmu_idx, page);
+            CPUTLBEntryFull *full = &cpu->neg.tlb.d[mmu_idx].fulltlb[index];
+
+            if (page + full->xlat_section == start + offset) {
+                tlb_set_dirty1_locked(tlb_entry(cpu, mmu_idx, page), page);
+            }
+        }
+    }
+    qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+}
+
 /* Our TLB does not support large pages, so remember the area covered by
    large pages and trigger a full TLB flush if these are invalidated.  */
 static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
@@ -990,6 +1226,60 @@ static void tlb_add_large_page(CPUState *cpu, int mmu_idx,
     cpu->neg.tlb.d[mmu_idx].large_page_mask = lp_mask;
 }
 
+/*
+ * Remember a uniform large page, so that a miss on any of its pages can be
+ * refilled by tlb_refill_large_page().  The table is filled round-robin.
+ * The large page must already have been added to the large_page_addr/mask
+ * region by tlb_add_large_page().
+ */
+static void tlb_add_uniform_large_page(CPUState *cpu, int mmu_idx,
+                                       vaddr addr, const CPUTLBEntryFull *full)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    vaddr mask = -((vaddr)1 << full->lg_page_size);
+    vaddr base = addr & mask;
+    size_t i;
+
+    for (i = 0; i < CPU_LTLB_SIZE; i++) {
+        if (desc->ltlb[i].addr == base && desc->ltlb[i].mask == mask) {
+            break;
+        }
+    }
+    if (i == CPU_LTLB_SIZE) {
+        i = desc->lindex++ % CPU_LTLB_SIZE;
+    }
+
+    desc->ltlb[i].addr = base;
+    desc->ltlb[i].mask = mask;
+    desc->ltlb[i].full = *full;
+    desc->ltlb[i].full.phys_addr = (full->phys_addr & TARGET_PAGE_MASK)
+                                   - ((addr & TARGET_PAGE_MASK) - base);
+}
+
+/*
+ * Enter the page of ADDR in the tlb from a uniform large page that allows
+ * ACCESS_TYPE, instead of calling tlb_fill.  Return false if there is none.
+ */
+static bool tlb_refill_large_page(CPUState *cpu, int mmu_idx, vaddr addr,
+                                  MMUAccessType access_type)
+{
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+
+    for (size_t i = 0; i < CPU_LTLB_SIZE; i++) {
+        if ((addr & desc->ltlb[i].mask) == desc->ltlb[i].addr &&
+            ((desc->ltlb[i].full.prot >> access_type) & 1)) {
+            CPUTLBEntryFull full = desc->ltlb[i].full;
+            vaddr addr_page = addr & TARGET_PAGE_MASK;
+
+            full.phys_addr += addr_page - desc->ltlb[i].addr;
+            qatomic_set(&desc->ltlb_hit_count, desc->ltlb_hit_count + 1);
+            tlb_set_page_full(cpu, mmu_idx, addr_page, &full);
+            return true;
+        }
+    }
+    return false;
+}
+
 static inline void tlb_set_compare(CPUTLBEntryFull *full, CPUTLBEntry *ent,
                                    vaddr address, int flags,
                                    MMUAccessType access_type, bool enable)
@@ -1037,6 +1327,9 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
     } else {
         sz = (hwaddr)1 << full->lg_page_size;
         tlb_add_large_page(cpu, mmu_idx, addr, sz);
+        if (full->lg_page_uniform) {
+            tlb_add_uniform_large_page(cpu, mmu_idx, addr, full);
+        }
     }
     addr_page = addr & TARGET_PAGE_MASK;
     paddr_page = full->phys_addr & TARGET_PAGE_MASK;
@@ -1123,7 +1416,7 @@ void tlb_set_page_full(CPUState *cpu, int mmu_idx,
      * different page; otherwise just overwrite the stale data.
      */
     if (!tlb_hit_page_anyprot(te, addr_page) && !tlb_entry_is_empty(te)) {
-        unsigned vidx = desc->vindex++ % CPU_VTLB_SIZE;
+        size_t vidx = tlb_vtlb_victim(cpu, desc, tlb_entry_page(te));
         CPUTLBEntry *tv = &desc->vtable[vidx];
 
         /* Evict the old entry into the victim tlb.  */
@@ -1236,24 +1529,104 @@ static bool tlb_fill_align(CPUState *cpu, vaddr addr, MMUAccessType type,
 {
     const TCGCPUOps *ops = cpu->cc->tcg_ops;
     CPUTLBEntryFull full;
+    TLBSample *sample;
 
     if (ops->tlb_fill_align) {
         if (ops->tlb_fill_align(cpu, &full, addr, type, mmu_idx,
                                 memop, size, probe, ra)) {
             tlb_set_page_full(cpu, mmu_idx, addr, &full);
-            return true;
+            goto filled;
         }
     } else {
         /* Legacy behaviour is alignment before paging. */
         if (addr & ((1u << memop_alignment_bits(memop)) - 1)) {
             ops->do_unaligned_access(cpu, addr, type, mmu_idx, ra);
         }
-        if (ops->tlb_fill(cpu, addr, size, type, mmu_idx, probe, ra)) {
-            return true;
+        if (tlb_refill_large_page(cpu, mmu_idx, addr, type) ||
+            ops->tlb_fill(cpu, addr, size, type, mmu_idx, probe, ra)) {
+            goto filled;
         }
     }
     assert(probe);
     return false;
+
+ filled:
+    sample = qatomic_read(&cpu->tlb_sample);
+    if (unlikely(sample && sample->armed)) {
+        uintptr_t index = tlb_index(cpu, mmu_idx, addr);
+
+        tlb_sample_refill(cpu, addr & TARGET_PAGE_MASK,
+                          cpu->neg.tlb.d[mmu_idx].fulltlb[index].phys_addr,
+                          mmu_idx, type);
+    }
+    return true;
+}
+
+static uint64_t tlb_sample_random(TLBSample *s)
+{
+    /* xorshift64 */
+    s->seed ^= s->seed << 13;
+    s->seed ^= s->seed >> 7;
+    s->seed ^= s->seed << 17;
+    return s->seed;
+}
+
+void tlb_sample_evict(CPUState *cpu, unsigned int n)
+{
+    TLBSample *s = cpu->tlb_sample;
+    uint16_t dirty = cpu->neg.tlb.c.dirty;
+    unsigned int i;
+
+    assert_cpu_is_self(cpu);
+
+    /* Forget the entries of the last period that were not refilled */
+    s->armed = 0;
+    if (!dirty) {
+        return;
+    }
+
+    qemu_spin_lock(&cpu->neg.tlb.c.lock);
+    for (i = 0; i < n; i++) {
+        CPUTLBDescFast *fast;
+        CPUTLBEntry *entry;
+        uint64_t cmp;
+        vaddr page;
+        int mmu_idx, j;
+
+        /* Only the mmu_idx in use since their last flush have entries */
+        do {
+            mmu_idx = tlb_sample_random(s) % NB_MMU_MODES;
+        } while (!(dirty & (1 << mmu_idx)));
+
+        fast = &cpu->neg.tlb.f[mmu_idx];
+        entry = &fast->table[tlb_sample_random(s) & (tlb_n_entries(fast) - 1)];
+        for (j = 0; j < MMU_ACCESS_COUNT; j++) {
+            cmp = tlb_read_idx(entry, j);
+            if (!(cmp & TLB_INVALID_MASK)) {
+                break;
+            }
+        }
+        if (j == MMU_ACCESS_COUNT) {
+            continue;
+        }
+
+        page = cmp & TARGET_PAGE_MASK;
+        if (tlb_flush_entry_locked(entry, page)) {
+            tlb_n_used_entries_dec(cpu, mmu_idx);
+        }
+        /* Or the refill would be a victim TLB hit, not a fill */
+        tlb_flush_vtlb_page_locked(cpu, mmu_idx, page);
+
+        s->armed_pages[s->armed].page = page;
+        s->armed_pages[s->armed].mmu_idx = mmu_idx;
+        s->armed++;
+    }
+    qemu_spin_unlock(&cpu->neg.tlb.c.lock);
+
+    /* Make the next execution of a TB on code pages look the page up */
+    for (i = 0; i < s->armed; i++) {
+        tb_jmp_cache_clear_page(cpu, s->armed_pages[i].page);
+    }
 }
 
 static inline void cpu_unaligned_access(CPUState *cpu, vaddr addr,
@@ -1264,6 +1637,14 @@ static inline void cpu_unaligned_access(CPUState *cpu, vaddr addr,
                                           mmu_idx, retaddr);
 }
 
+/*
+ * Like BQL_LOCK_GUARD, but regions that opted into lockless dispatch
+ * with memory_region_enable_lockless_io() are accessed without the BQL.
+ */
+#define MMIO_BQL_LOCK_GUARD(mr)                                         \
+    g_autoptr(BQLLockAuto) _bql_lock_auto __attribute__((unused))       \
+        = (mr)->lockless_io ? NULL : bql_auto_lock(__FILE__, __LINE__)
+
 static MemoryRegionSection *
 io_prepare(hwaddr *out_offset, CPUState *cpu, hwaddr xlat,
            MemTxAttrs attrs, vaddr addr, uintptr_t retaddr)
@@ -1301,15 +1682,20 @@ static void io_failed(CPUState *cpu, CPUTLBEntryFull *full, vaddr addr,
 static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
                            MMUAccessType access_type, vaddr page)
 {
-    size_t vidx;
+    CPUTLBDesc *desc = &cpu->neg.tlb.d[mmu_idx];
+    size_t vidx, set = tlb_vtlb_set(cpu, page);
 
     assert_cpu_is_self(cpu);
-    for (vidx = 0; vidx < CPU_VTLB_SIZE; ++vidx) {
-        CPUTLBEntry *vtlb = &cpu->neg.tlb.d[mmu_idx].vtable[vidx];
+    for (vidx = set; vidx < set + CPU_VTLB_WAYS; ++vidx) {
+        CPUTLBEntry *vtlb = &desc->vtable[vidx];
         uint64_t cmp = tlb_read_idx(vtlb, access_type);
 
         if (cmp == page) {
-            /* Found entry in victim tlb, swap tlb and iotlb.  */
+            /*
+             * Found entry in victim tlb, swap tlb and iotlb.  The main tlb
+             * entry moved into this way was just in use, so it becomes the
+             * most recently used of the set.
+             */
             CPUTLBEntry tmptlb, *tlb = &cpu->neg.tlb.f[mmu_idx].table[index];
 
             qemu_spin_lock(&cpu->neg.tlb.c.lock);
@@ -1322,16 +1708,43 @@ static bool victim_tlb_hit(CPUState *cpu, size_t mmu_idx, size_t index,
             CPUTLBEntryFull *f2 = &cpu->neg.tlb.d[mmu_idx].vfulltlb[vidx];
             CPUTLBEntryFull tmpf;
             tmpf = *f1; *f1 = *f2; *f2 = tmpf;
+
+            desc->vlru[vidx] = ++desc->vclock;
+            qatomic_set(&desc->vtlb_hit_count, desc->vtlb_hit_count + 1);
             return true;
         }
     }
+    qatomic_set(&desc->vtlb_miss_count, desc->vtlb_miss_count + 1);
     return false;
 }
 
+/*
+ * Queue the pages of [START, START + LENGTH) on the dirty ring of CPU.
+ * Return false if the dirty bitmap must be updated directly instead.
+ */
+static bool notdirty_push_ring(CPUState *cpu, ram_addr_t start,
+                               ram_addr_t length)
+{
+    ram_addr_t addr = start & TARGET_PAGE_MASK;
+    ram_addr_t end = TARGET_PAGE_ALIGN(start + length);
+
+    if (!tcg_dirty_ring_push(cpu, addr)) {
+        return false;
+    }
+    while ((addr += TARGET_PAGE_SIZE) < end) {
+        tcg_dirty_ring_push(cpu, addr);
+    }
+    return true;
+}
+
 static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
                            CPUTLBEntryFull *full, uintptr_t retaddr)
 {
     ram_addr_t ram_addr = mem_vaddr + full->xlat_section;
+    ram_addr_t dirty_addr = ram_addr, dirty_len = size;
+    bool coarse = tcg_dirty_granularity > TARGET_PAGE_SIZE;
+    uint8_t clients = DIRTY_CLIENTS_NOCODE;
+    bool ringed;
 
     trace_memory_notdirty_write_access(mem_vaddr, ram_addr, size);
 
@@ -1339,17 +1752,37 @@ static void notdirty_write(CPUState *cpu, vaddr mem_vaddr, unsigned size,
         tb_invalidate_phys_range_fast(ram_addr, size, retaddr);
     }
 
+    /*
+     * With a coarse dirty granularity, dirty the whole granule at once:
+     * migration sends more pages, but the guest takes far fewer traps.
+     */
+    if (coarse) {
+        dirty_addr = cpu_physical_memory_dirty_granule(ram_addr,
+                                                       tcg_dirty_granularity,
+                                                       &dirty_len);
+    }
+
     /*
      * Set both VGA and migration bits for simplicity and to remove
-     * the notdirty callback faster.
+     * the notdirty callback faster.  With a dirty ring, the migration
+     * bits are only set when log sync harvests the ring.
      */
-    cpu_physical_memory_set_dirty_range(ram_addr, size, DIRTY_CLIENTS_NOCODE);
+    ringed = notdirty_push_ring(cpu, dirty_addr, dirty_len);
+    if (ringed) {
+        clients &= ~(1 << DIRTY_MEMORY_MIGRATION);
+    }
+    cpu_physical_memory_set_dirty_range(dirty_addr, dirty_len, clients);
 
     /* We remove the notdirty callback only if the code has been flushed. */
-    if (!cpu_physical_memory_is_clean(ram_addr)) {
+    if (ringed
+        ? cpu_physical_memory_get_dirty_flag(ram_addr, DIRTY_MEMORY_CODE)
+        : !cpu_physical_memory_is_clean(ram_addr)) {
         trace_memory_notdirty_set_dirty(mem_vaddr);
         tlb_set_dirty(cpu, mem_vaddr);
     }
+    if (coarse) {
+        tlb_set_dirty_granule(cpu, mem_vaddr, ram_addr, dirty_addr, dirty_len);
+    }
 }
 
 static int probe_access_internal(CPUState *cpu, vaddr addr,
@@ -1797,9 +2230,13 @@ static bool mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
 /*
  * Probe for an atomic operation.  Do not allow unaligned operations,
  * or io operations to proceed.  Return the host address.
+ *
+ * If @wsize is not NULL, an unaligned operation that fits within the
+ * naturally aligned host word of atomic_widen_size() bytes proceeds
+ * instead: return the host address of that word and its size in @wsize.
  */
 static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
-                               int size, uintptr_t retaddr)
+                               int size, int *wsize, uintptr_t retaddr)
 {
     uintptr_t mmu_idx = get_mmuidx(oi);
     MemOp mop = get_memop(oi);
@@ -1809,6 +2246,7 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     void *hostaddr;
     CPUTLBEntryFull *full;
     bool did_tlb_fill = false;
+    int widen = 0;
 
     tcg_debug_assert(mmu_idx < NB_MMU_MODES);
 
@@ -1859,10 +2297,15 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
         /*
          * We get here if guest alignment was not requested, or was not
          * enforced by cpu_unaligned_access or tlb_fill_align above.
-         * We might widen the access and emulate, but for now
-         * mark an exception and exit the cpu loop.
+         * Widen the access if the caller can emulate it on the aligned
+         * host word that contains it, or else mark an exception and
+         * exit the cpu loop.
          */
-        goto stop_the_world;
+        widen = wsize ? atomic_widen_size(addr, size) : 0;
+        if (!widen) {
+            qatomic_inc(&tb_ctx.tb_atomic_unaligned_count);
+            goto stop_the_world;
+        }
     }
 
     /* Collect tlb flags for read. */
@@ -1872,6 +2315,7 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     if (unlikely(tlb_addr & (TLB_MMIO | TLB_DISCARD_WRITE))) {
         /* There's really nothing that can be done to
            support this apart from stop-the-world.  */
+        qatomic_inc(&tb_ctx.tb_atomic_io_count);
         goto stop_the_world;
     }
 
@@ -1897,6 +2341,11 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
         }
     }
 
+    if (widen) {
+        /* The word is within the page, as it is smaller than a page */
+        *wsize = widen;
+        hostaddr = (void *)((uintptr_t)hostaddr & -(uintptr_t)widen);
+    }
     return hostaddr;
 
  stop_the_world:
@@ -1983,7 +2432,7 @@ static uint64_t do_ld_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
+    MMIO_BQL_LOCK_GUARD(mr);
     return int_ld_mmio_beN(cpu, full, ret_be, addr, size, mmu_idx,
                            type, ra, mr, mr_offset);
 }
@@ -2004,7 +2453,7 @@ static Int128 do_ld16_mmio_beN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
+    MMIO_BQL_LOCK_GUARD(mr);
     a = int_ld_mmio_beN(cpu, full, ret_be, addr, size - 8, mmu_idx,
                         MMU_DATA_LOAD, ra, mr, mr_offset);
     b = int_ld_mmio_beN(cpu, full, ret_be, addr + size - 8, 8, mmu_idx,
@@ -2524,7 +2973,7 @@ static uint64_t do_st_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
+    MMIO_BQL_LOCK_GUARD(mr);
     return int_st_mmio_leN(cpu, full, val_le, addr, size, mmu_idx,
                            ra, mr, mr_offset);
 }
@@ -2544,7 +2993,7 @@ static uint64_t do_st16_mmio_leN(CPUState *cpu, CPUTLBEntryFull *full,
     section = io_prepare(&mr_offset, cpu, full->xlat_section, attrs, addr, ra);
     mr = section->mr;
 
-    BQL_LOCK_GUARD();
+    MMIO_BQL_LOCK_GUARD(mr);
     int_st_mmio_leN(cpu, full, int128_getlo(val_le), addr, 8,
                     mmu_idx, ra, mr, mr_offset);
     return int_st_mmio_leN(cpu, full, int128_gethi(val_le), addr + 8,
@@ -0,0 +1,141 @@
+/*
+ * Per-vCPU dirty page rings for TCG
+ *
+ * Without a ring, the first write of each vCPU to a clean page sets the
+ * page's bit in the global migration bitmap, so vCPUs dirtying nearby
+ * pages keep bouncing the bitmap's cache lines between host cores.
+ * With "-accel tcg,dirty-ring-size=N", each vCPU instead appends the
+ * page to a private ring that memory_global_dirty_log_sync() harvests
+ * into the bitmap, much like the KVM dirty ring.  A vCPU whose ring
+ * fills up harvests it itself and is throttled by the dirty limit.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/thread.h"
+#include "exec/memory.h"
+#include "exec/ram_addr.h"
+#include "hw/core/cpu.h"
+#include "system/dirtylimit.h"
+#include "system/tcg.h"
+#include "dirty-ring.h"
+#include "trace.h"
+
+typedef struct TCGDirtyRing {
+    /* Serializes harvesting by the owner vCPU and by log sync. */
+    QemuSpin lock;
+    /* Set when the ring filled up, cleared once the vCPU was throttled. */
+    bool full;
+    uint32_t size;
+    /* Written only by the owner vCPU. */
+    uint32_t head;
+    /* Written only with @lock held. */
+    uint32_t tail;
+    ram_addr_t pages[];
+} TCGDirtyRing;
+
+void tcg_dirty_ring_init(CPUState *cpu)
+{
+    TCGDirtyRing *ring;
+
+    if (!tcg_dirty_ring_size) {
+        return;
+    }
+
+    ring = g_malloc0(sizeof(*ring) +
+                     tcg_dirty_ring_size * sizeof(ring->pages[0]));
+    qemu_spin_init(&ring->lock);
+    ring->size = tcg_dirty_ring_size;
+    cpu->tcg_dirty_ring = ring;
+}
+
+void tcg_dirty_ring_destroy(CPUState *cpu)
+{
+    g_free(cpu->tcg_dirty_ring);
+    cpu->tcg_dirty_ring = NULL;
+}
+
+/* Move the entries of the ring of @cpu into the migration bitmap. */
+static uint32_t tcg_dirty_ring_reap_one(CPUState *cpu)
+{
+    TCGDirtyRing *ring = cpu->tcg_dirty_ring;
+    uint32_t head, tail, count;
+
+    if (!ring) {
+        return 0;
+    }
+
+    qemu_spin_lock(&ring->lock);
+    head = qatomic_load_acquire(&ring->head);
+    for (tail = ring->tail; tail != head; tail++) {
+        cpu_physical_memory_set_dirty_range(ring->pages[tail % ring->size],
+                                            TARGET_PAGE_SIZE,
+                                            1 << DIRTY_MEMORY_MIGRATION);
+    }
+    count = head - ring->tail;
+    qatomic_store_release(&ring->tail, head);
+    cpu->dirty_pages += count;
+    qemu_spin_unlock(&ring->lock);
+
+    return count;
+}
+
+bool tcg_dirty_ring_push(CPUState *cpu, ram_addr_t addr)
+{
+    TCGDirtyRing *ring = cpu->tcg_dirty_ring;
+    uint32_t head;
+
+    if (!ring || !global_dirty_tracking) {
+        return false;
+    }
+
+    head = ring->head;
+    if (head - qatomic_load_acquire(&ring->tail) == ring->size) {
+        trace_tcg_dirty_ring_full(cpu->cpu_index);
+        tcg_dirty_ring_reap_one(cpu);
+        if (dirtylimit_in_service()) {
+            /* Sleep at the end of the TB, not with the TB state live. */
+            ring->full = true;
+            cpu_exit(cpu);
+        }
+    }
+
+    ring->pages[head % ring->size] = addr;
+    qatomic_store_release(&ring->head, head + 1);
+    return true;
+}
+
+void tcg_dirty_ring_throttle(CPUState *cpu)
+{
+    TCGDirtyRing *ring = cpu->tcg_dirty_ring;
+
+    if (ring && unlikely(ring->full)) {
+        ring->full = false;
+        dirtylimit_vcpu_execute(cpu);
+    }
+}
+
+static void tcg_dirty_ring_log_sync_global(MemoryListener *listener,
+                                           bool last_stage)
+{
+    CPUState *cpu;
+    uint64_t total = 0;
+
+    CPU_FOREACH(cpu) {
+        total += tcg_dirty_ring_reap_one(cpu);
+    }
+    trace_tcg_dirty_ring_reap(total, last_stage);
+}
+
+static MemoryListener tcg_dirty_ring_listener = {
+    .name = "tcg-dirty-ring",
+    .log_sync_global = tcg_dirty_ring_log_sync_global,
+    .priority = MEMORY_LISTENER_PRIORITY_ACCEL,
+};
+
+void tcg_dirty_ring_listener_register(void)
+{
+    memory_listener_register(&tcg_dirty_ring_listener, &address_space_memory);
+}
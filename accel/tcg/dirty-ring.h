@@ -0,0 +1,29 @@
+/*
+ * Per-vCPU dirty page rings for TCG
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_DIRTY_RING_H
+#define ACCEL_TCG_DIRTY_RING_H
+
+#include "exec/cpu-common.h"
+
+/* Allocate and free the dirty ring of @cpu, if "dirty-ring-size" is set. */
+void tcg_dirty_ring_init(CPUState *cpu);
+void tcg_dirty_ring_destroy(CPUState *cpu);
+
+/* Harvest the dirty rings of all vCPUs on memory_global_dirty_log_sync(). */
+void tcg_dirty_ring_listener_register(void);
+
+/*
+ * Record the guest RAM page at @addr as dirty for migration in the ring
+ * of @cpu.  Return false if the caller must update the dirty bitmap
+ * directly, because @cpu has no ring or dirty tracking is not active.
+ */
+bool tcg_dirty_ring_push(CPUState *cpu, ram_addr_t addr);
+
+/* Throttle @cpu outside of cpu_exec() if its ring filled up. */
+void tcg_dirty_ring_throttle(CPUState *cpu);
+
+#endif /* ACCEL_TCG_DIRTY_RING_H */
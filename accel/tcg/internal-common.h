@@ -11,12 +11,39 @@
 
 #include "exec/cpu-common.h"
 #include "exec/translation-block.h"
+#include "qemu/atomic128.h"
 
 extern int64_t max_delay;
 extern int64_t max_advance;
 
 extern bool one_insn_per_tb;
 
+/* Number of entries of each victim tlb, set by the vtlb-size property.  */
+extern unsigned tcg_vtlb_size;
+
+/*
+ * Executions after which a TB translated without the optimizer is
+ * retranslated with it, set by the x-tier-up-threshold property; 0 means
+ * that all TBs are translated with the optimizer right away.
+ */
+extern uint32_t tcg_tier_up_threshold;
+
+/*
+ * Host cpus the vcpu threads are pinned to, set by the vcpu-affinity
+ * property: vcpu N runs on tcg_vcpu_affinity[N % tcg_vcpu_affinity_len].
+ */
+extern uint16_t *tcg_vcpu_affinity;
+extern unsigned tcg_vcpu_affinity_len;
+
+/* How long an idle vcpu thread polls for a kick before sleeping.  */
+extern uint32_t tcg_halt_poll_ns;
+
+/*
+ * Size of the guest RAM range that the first write to a clean page marks
+ * dirty, set by the dirty-granularity property; 0 means a single page.
+ */
+extern uint64_t tcg_dirty_granularity;
+
 extern bool icount_align_option;
 
 /*
@@ -45,13 +72,37 @@ static inline bool cpu_plugin_mem_cbs_enabled(const CPUState *cpu)
 #endif
 }
 
+/*
+ * Return the size of the naturally aligned host word that contains the
+ * unaligned atomic access of @size bytes at @addr, if the host can
+ * compare-and-swap words of that size.  Return 0 otherwise.
+ */
+static inline int atomic_widen_size(vaddr addr, int size)
+{
+#ifdef CONFIG_ATOMIC64
+    if ((addr & 7) + size <= 8) {
+        return 8;
+    }
+#endif
+#if HAVE_CMPXCHG128
+    if ((addr & 15) + size <= 16) {
+        return 16;
+    }
+#endif
+    return 0;
+}
+
 TranslationBlock *tb_gen_code(CPUState *cpu, vaddr pc,
                               uint64_t cs_base, uint32_t flags,
                               int cflags);
+TranslationBlock *tb_htable_lookup(CPUState *cpu, vaddr pc,
+                                   uint64_t cs_base, uint32_t flags,
+                                   uint32_t cflags);
 void page_init(void);
 void tb_htable_init(void);
 void tb_reset_jump(TranslationBlock *tb, int n);
 TranslationBlock *tb_link_page(TranslationBlock *tb);
+void tb_reclaim(CPUState *cpu);
 void cpu_restore_state_from_tb(CPUState *cpu, TranslationBlock *tb,
                                uintptr_t host_pc);
 
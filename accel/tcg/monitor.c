@@ -12,12 +12,20 @@
 #include "qapi/error.h"
 #include "qapi/type-helpers.h"
 #include "qapi/qapi-commands-machine.h"
+#include "qapi/qapi-types-stats.h"
 #include "monitor/monitor.h"
+#include "monitor/hmp.h"
+#include "qobject/qdict.h"
+#include "hw/core/cpu.h"
 #include "system/cpu-timers.h"
+#include "system/stats.h"
 #include "system/tcg.h"
 #include "tcg/tcg.h"
 #include "internal-common.h"
 #include "tb-context.h"
+#include "tb-jmp-cache.h"
+#include "tb-profile.h"
+#include "tlb-sample.h"
 
 
 static void dump_drift_info(GString *buf)
@@ -90,6 +98,15 @@ static void print_qht_statistics(struct qht_stats hst, GString *buf)
                            "Histogram: %s\n",
                            qdist_avg(&hst.chain), hgram);
     g_free(hgram);
+
+    g_string_append_printf(buf, "TB hash contention  %zu lookup retries, "
+                           "%zu contended locks in %lu buckets\n",
+                           hst.lookup_retries, hst.lock_contended,
+                           qdist_sample_count(&hst.contention));
+    if (hst.resize_pending) {
+        g_string_append_printf(buf, "TB hash resize      %zu head buckets "
+                               "left to move\n", hst.resize_pending);
+    }
 }
 
 struct tb_tree_stats {
@@ -125,19 +142,41 @@ static gboolean tb_tree_stats_iter(gpointer key, gpointer value, gpointer data)
     return false;
 }
 
-static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide)
+static void tlb_flush_counts(size_t *pfull, size_t *ppart, size_t *pelide,
+                             size_t *pbatch)
 {
     CPUState *cpu;
-    size_t full = 0, part = 0, elide = 0;
+    size_t full = 0, part = 0, elide = 0, batch = 0;
 
     CPU_FOREACH(cpu) {
         full += qatomic_read(&cpu->neg.tlb.c.full_flush_count);
         part += qatomic_read(&cpu->neg.tlb.c.part_flush_count);
         elide += qatomic_read(&cpu->neg.tlb.c.elide_flush_count);
+        batch += qatomic_read(&cpu->neg.tlb.c.batch_flush_count);
     }
     *pfull = full;
     *ppart = part;
     *pelide = elide;
+    *pbatch = batch;
+}
+
+static void tlb_dump_vtlb_counts(GString *buf)
+{
+    for (int mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+        size_t hits = 0, misses = 0, large = 0;
+        CPUState *cpu;
+
+        CPU_FOREACH(cpu) {
+            hits += qatomic_read(&cpu->neg.tlb.d[mmu_idx].vtlb_hit_count);
+            misses += qatomic_read(&cpu->neg.tlb.d[mmu_idx].vtlb_miss_count);
+            large += qatomic_read(&cpu->neg.tlb.d[mmu_idx].ltlb_hit_count);
+        }
+        if (hits || misses) {
+            g_string_append_printf(buf, "Victim TLB mmu_idx %-2d "
+                                   "hits %zu misses %zu large page hits %zu\n",
+                                   mmu_idx, hits, misses, large);
+        }
+    }
 }
 
 static void tcg_dump_info(GString *buf)
@@ -149,7 +188,7 @@ static void dump_exec_info(GString *buf)
 {
     struct tb_tree_stats tst = {};
     struct qht_stats hst;
-    size_t nb_tbs, flush_full, flush_part, flush_elide;
+    size_t nb_tbs, flush_full, flush_part, flush_elide, flush_batch;
 
     tcg_tb_foreach(tb_tree_stats_iter, &tst);
     nb_tbs = tst.nb_tbs;
@@ -188,13 +227,29 @@ static void dump_exec_info(GString *buf)
     g_string_append_printf(buf, "\nStatistics:\n");
     g_string_append_printf(buf, "TB flush count      %u\n",
                            qatomic_read(&tb_ctx.tb_flush_count));
+    g_string_append_printf(buf, "TB reclaim requests on full buffer %u\n",
+                           qatomic_read(&tb_ctx.tb_flush_full_count));
+    g_string_append_printf(buf, "TB region reclaims  %u\n",
+                           qatomic_read(&tb_ctx.tb_reclaim_count));
     g_string_append_printf(buf, "TB invalidate count %u\n",
                            qatomic_read(&tb_ctx.tb_phys_invalidate_count));
-
-    tlb_flush_counts(&flush_full, &flush_part, &flush_elide);
+    g_string_append_printf(buf, "Serial atomic steps %u\n",
+                           qatomic_read(&tb_ctx.tb_step_atomic_count));
+    g_string_append_printf(buf, "Atomic fallbacks    unaligned %u, i/o %u, "
+                           "unsupported by host %u\n",
+                           qatomic_read(&tb_ctx.tb_atomic_unaligned_count),
+                           qatomic_read(&tb_ctx.tb_atomic_io_count),
+                           qatomic_read(&tb_ctx.tb_atomic_host_count));
+    exclusive_dump_stats(buf);
+    g_string_append_printf(buf, "TB duplicate translations %u\n",
+                           qatomic_read(&tb_ctx.tb_gen_dedup_count));
+
+    tlb_flush_counts(&flush_full, &flush_part, &flush_elide, &flush_batch);
     g_string_append_printf(buf, "TLB full flushes    %zu\n", flush_full);
     g_string_append_printf(buf, "TLB partial flushes %zu\n", flush_part);
     g_string_append_printf(buf, "TLB elided flushes  %zu\n", flush_elide);
+    g_string_append_printf(buf, "TLB batched flushes %zu\n", flush_batch);
+    tlb_dump_vtlb_counts(buf);
     tcg_dump_info(buf);
 }
 
@@ -214,6 +269,118 @@ HumanReadableText *qmp_x_query_jit(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+/* Like perf, avoid sampling in lockstep with periodic guest timers */
+#define TCG_PROFILE_DEFAULT_FREQUENCY 99
+
+void qmp_x_tcg_profile_start(bool has_frequency, uint32_t frequency,
+                             Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "TCG profiling is only available with accel=tcg");
+        return;
+    }
+
+    tcg_profile_start(has_frequency ? frequency : TCG_PROFILE_DEFAULT_FREQUENCY,
+                      errp);
+}
+
+void qmp_x_tcg_profile_stop(Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "TCG profiling is only available with accel=tcg");
+        return;
+    }
+
+    tcg_profile_stop();
+}
+
+HumanReadableText *qmp_x_query_tcg_profile(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TCG profiling is only available with accel=tcg");
+        return NULL;
+    }
+
+    tcg_profile_dump(buf);
+    return human_readable_text_from_str(buf);
+}
+
+void hmp_tcg_profile(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+    Error *err = NULL;
+
+    if (!op || !strcmp(op, "off")) {
+        qmp_x_tcg_profile_stop(&err);
+    } else if (!strcmp(op, "on")) {
+        qmp_x_tcg_profile_start(qdict_haskey(qdict, "frequency"),
+                                qdict_get_try_int(qdict, "frequency", 0),
+                                &err);
+    } else {
+        error_setg(&err, "unexpected option %s", op);
+    }
+    hmp_handle_error(mon, err);
+}
+
+#define TLB_SAMPLE_DEFAULT_FREQUENCY 100
+#define TLB_SAMPLE_DEFAULT_ENTRIES 8
+
+void qmp_x_tlb_sample_start(bool has_frequency, uint32_t frequency,
+                            bool has_entries, uint32_t entries, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB sampling is only available with accel=tcg");
+        return;
+    }
+
+    tlb_sample_start(has_frequency ? frequency : TLB_SAMPLE_DEFAULT_FREQUENCY,
+                     has_entries ? entries : TLB_SAMPLE_DEFAULT_ENTRIES, errp);
+}
+
+void qmp_x_tlb_sample_stop(Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB sampling is only available with accel=tcg");
+        return;
+    }
+
+    tlb_sample_stop();
+}
+
+HumanReadableText *qmp_x_query_tlb_sample(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    if (!tcg_enabled()) {
+        error_setg(errp, "TLB sampling is only available with accel=tcg");
+        return NULL;
+    }
+
+    tlb_sample_dump(buf);
+    return human_readable_text_from_str(buf);
+}
+
+void hmp_tlb_sample(Monitor *mon, const QDict *qdict)
+{
+    const char *op = qdict_get_try_str(qdict, "op");
+    Error *err = NULL;
+
+    if (!op || !strcmp(op, "off")) {
+        qmp_x_tlb_sample_stop(&err);
+    } else if (!strcmp(op, "on")) {
+        qmp_x_tlb_sample_start(qdict_haskey(qdict, "frequency"),
+                               qdict_get_try_int(qdict, "frequency", 0),
+                               qdict_haskey(qdict, "entries"),
+                               qdict_get_try_int(qdict, "entries", 0),
+                               &err);
+    } else {
+        error_setg(&err, "unexpected option %s", op);
+    }
+    hmp_handle_error(mon, err);
+}
+
 static void tcg_dump_op_count(GString *buf)
 {
     g_string_append_printf(buf, "[TCG profiler not compiled]\n");
@@ -234,10 +401,198 @@ HumanReadableText *qmp_x_query_opcount(Error **errp)
     return human_readable_text_from_str(buf);
 }
 
+#define TCG_STAT_JMP_CACHE_HITS     "jmp-cache-hits"
+#define TCG_STAT_JMP_CACHE_MISSES   "jmp-cache-misses"
+#define TCG_STAT_JMP_CACHE_ENTRIES  "jmp-cache-entries"
+#define TCG_STAT_EXIT_GOTO_TB       "exit-goto-tb"
+#define TCG_STAT_EXIT_TB            "exit-tb"
+#define TCG_STAT_EXIT_REQUESTED     "exit-requested"
+#define TCG_STAT_LOOKUP_HITS        "lookup-tb-ptr-hits"
+#define TCG_STAT_LOOKUP_MISSES      "lookup-tb-ptr-misses"
+#define TCG_STAT_IO_RECOMPILE       "io-recompiles"
+#define TCG_STAT_TB_FLUSHES         "tb-flushes"
+#define TCG_STAT_CODE_BUFFER_FULL   "code-buffer-full"
+#define TCG_STAT_REGION_RECLAIMS    "region-reclaims"
+#define TCG_STAT_TB_INVALIDATES     "tb-invalidates"
+#define TCG_STAT_TLB_VICTIM_HITS    "tlb-victim-hits"
+#define TCG_STAT_TLB_MISSES         "tlb-misses"
+#define TCG_STAT_TLB_LARGE_HITS     "tlb-large-page-hits"
+#define TCG_STAT_TLB_FULL_FLUSHES   "tlb-full-flushes"
+#define TCG_STAT_TLB_PART_FLUSHES   "tlb-partial-flushes"
+
+static StatsList *tcg_stats_add(StatsList *list, strList *names,
+                                const char *name, uint64_t val)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = val;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+static void tcg_stats_cb(StatsResultList **result, StatsTarget target,
+                         strList *names, strList *targets, Error **errp)
+{
+    CPUState *cs;
+    StatsList *list = NULL;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    switch (target) {
+    case STATS_TARGET_VM:
+        list = tcg_stats_add(list, names, TCG_STAT_TB_FLUSHES,
+                             qatomic_read(&tb_ctx.tb_flush_count));
+        list = tcg_stats_add(list, names, TCG_STAT_CODE_BUFFER_FULL,
+                             qatomic_read(&tb_ctx.tb_flush_full_count));
+        list = tcg_stats_add(list, names, TCG_STAT_REGION_RECLAIMS,
+                             qatomic_read(&tb_ctx.tb_reclaim_count));
+        list = tcg_stats_add(list, names, TCG_STAT_TB_INVALIDATES,
+                             qatomic_read(&tb_ctx.tb_phys_invalidate_count));
+        if (list) {
+            add_stats_entry(result, STATS_PROVIDER_TCG, NULL, list);
+        }
+        break;
+    case STATS_TARGET_VCPU:
+        RCU_READ_LOCK_GUARD();
+
+        CPU_FOREACH(cs) {
+            CPUJumpCache *jc = qatomic_rcu_read(&cs->tb_jmp_cache);
+            CPUTBExitStats *es = &cs->tb_exit_stats;
+            uint64_t vtlb_hits = 0, vtlb_misses = 0, ltlb_hits = 0;
+            int mmu_idx;
+
+            if (!jc ||
+                !apply_str_list_filter(cs->parent_obj.canonical_path,
+                                       targets)) {
+                continue;
+            }
+
+            /* Written by the vCPU only, summed up here */
+            for (mmu_idx = 0; mmu_idx < NB_MMU_MODES; mmu_idx++) {
+                CPUTLBDesc *desc = &cs->neg.tlb.d[mmu_idx];
+
+                vtlb_hits += qatomic_read(&desc->vtlb_hit_count);
+                vtlb_misses += qatomic_read(&desc->vtlb_miss_count);
+                ltlb_hits += qatomic_read(&desc->ltlb_hit_count);
+            }
+
+            list = NULL;
+            list = tcg_stats_add(list, names, TCG_STAT_JMP_CACHE_HITS,
+                                 qatomic_read(&jc->hits));
+            list = tcg_stats_add(list, names, TCG_STAT_JMP_CACHE_MISSES,
+                                 qatomic_read(&jc->misses));
+            list = tcg_stats_add(list, names, TCG_STAT_JMP_CACHE_ENTRIES,
+                                 tb_jmp_cache_size(jc));
+            list = tcg_stats_add(list, names, TCG_STAT_EXIT_GOTO_TB,
+                                 qatomic_read(&es->goto_tb));
+            list = tcg_stats_add(list, names, TCG_STAT_EXIT_TB,
+                                 qatomic_read(&es->exit_tb));
+            list = tcg_stats_add(list, names, TCG_STAT_EXIT_REQUESTED,
+                                 qatomic_read(&es->requested));
+            list = tcg_stats_add(list, names, TCG_STAT_LOOKUP_HITS,
+                                 qatomic_read(&es->lookup_hits));
+            list = tcg_stats_add(list, names, TCG_STAT_LOOKUP_MISSES,
+                                 qatomic_read(&es->lookup_misses));
+            list = tcg_stats_add(list, names, TCG_STAT_IO_RECOMPILE,
+                                 qatomic_read(&es->io_recompile));
+            list = tcg_stats_add(list, names, TCG_STAT_TLB_VICTIM_HITS,
+                                 vtlb_hits);
+            list = tcg_stats_add(list, names, TCG_STAT_TLB_MISSES,
+                                 vtlb_misses);
+            list = tcg_stats_add(list, names, TCG_STAT_TLB_LARGE_HITS,
+                                 ltlb_hits);
+            list = tcg_stats_add(list, names, TCG_STAT_TLB_FULL_FLUSHES,
+                                 qatomic_read(&cs->neg.tlb.c.full_flush_count));
+            list = tcg_stats_add(list, names, TCG_STAT_TLB_PART_FLUSHES,
+                                 qatomic_read(&cs->neg.tlb.c.part_flush_count));
+            if (list) {
+                add_stats_entry(result, STATS_PROVIDER_TCG,
+                                cs->parent_obj.canonical_path, list);
+            }
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static StatsSchemaValueList *tcg_schemas_add(StatsSchemaValueList *list,
+                                             const char *name,
+                                             StatsType type)
+{
+    StatsSchemaValueList *schema_entry = g_new0(StatsSchemaValueList, 1);
+
+    schema_entry->value = g_new0(StatsSchemaValue, 1);
+    schema_entry->value->type = type;
+    schema_entry->value->name = g_strdup(name);
+    schema_entry->next = list;
+
+    return schema_entry;
+}
+
+static void tcg_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    if (!tcg_enabled()) {
+        return;
+    }
+
+    list = tcg_schemas_add(list, TCG_STAT_TB_FLUSHES, STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_CODE_BUFFER_FULL,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_REGION_RECLAIMS,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_TB_INVALIDATES,
+                           STATS_TYPE_CUMULATIVE);
+    add_stats_schema(result, STATS_PROVIDER_TCG, STATS_TARGET_VM, list);
+
+    list = NULL;
+    list = tcg_schemas_add(list, TCG_STAT_JMP_CACHE_HITS,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_JMP_CACHE_MISSES,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_JMP_CACHE_ENTRIES,
+                           STATS_TYPE_INSTANT);
+    list = tcg_schemas_add(list, TCG_STAT_EXIT_GOTO_TB, STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_EXIT_TB, STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_EXIT_REQUESTED,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_LOOKUP_HITS, STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_LOOKUP_MISSES,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_IO_RECOMPILE,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_TLB_VICTIM_HITS,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_TLB_MISSES, STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_TLB_LARGE_HITS,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_TLB_FULL_FLUSHES,
+                           STATS_TYPE_CUMULATIVE);
+    list = tcg_schemas_add(list, TCG_STAT_TLB_PART_FLUSHES,
+                           STATS_TYPE_CUMULATIVE);
+    add_stats_schema(result, STATS_PROVIDER_TCG, STATS_TARGET_VCPU, list);
+}
+
 static void hmp_tcg_register(void)
 {
     monitor_register_hmp_info_hrt("jit", qmp_x_query_jit);
     monitor_register_hmp_info_hrt("opcount", qmp_x_query_opcount);
+    monitor_register_hmp_info_hrt("tcg-profile", qmp_x_query_tcg_profile);
+    monitor_register_hmp_info_hrt("tlb-sample", qmp_x_query_tlb_sample);
+    add_stats_callbacks(STATS_PROVIDER_TCG, tcg_stats_cb, tcg_schemas_cb);
 }
 
 type_init(hmp_tcg_register);
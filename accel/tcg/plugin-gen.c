@@ -221,6 +221,48 @@ static void gen_mem_cb(struct qemu_plugin_regular_cb *cb,
     tcg_temp_free_i32(cpu_index);
 }
 
+static void gen_mem_trace_cb(struct qemu_plugin_regular_cb *cb,
+                             qemu_plugin_meminfo_t meminfo, TCGv_i64 addr)
+{
+    struct qemu_plugin_mem_trace *trace = cb->userp;
+    qemu_plugin_u64 count = {
+        .score = trace->score,
+        .offset = offsetof(struct qemu_plugin_mem_trace_buf, count),
+    };
+    TCGv_ptr buf = gen_plugin_u64_ptr(count);
+    TCGv_ptr slot = tcg_temp_ebb_new_ptr();
+    TCGv_i64 val = tcg_temp_ebb_new_i64();
+    TCGv_i64 off = tcg_temp_ebb_new_i64();
+    TCGLabel *after_cb = gen_new_label();
+    intptr_t base = offsetof(struct qemu_plugin_mem_trace_buf, entries);
+
+    /* Append the access at entries[count] and bump count. */
+    tcg_gen_ld_i64(val, buf, 0);
+    tcg_gen_muli_i64(off, val, sizeof(qemu_plugin_mem_trace_entry));
+    tcg_gen_trunc_i64_ptr(slot, off);
+    tcg_gen_add_ptr(slot, slot, buf);
+    tcg_gen_st_i64(addr, slot,
+                   base + offsetof(qemu_plugin_mem_trace_entry, vaddr));
+    tcg_gen_st_i32(tcg_constant_i32(meminfo), slot,
+                   base + offsetof(qemu_plugin_mem_trace_entry, info));
+    tcg_gen_addi_i64(val, val, 1);
+    tcg_gen_st_i64(val, buf, 0);
+
+    /* Only leave generated code once the buffer is full. */
+    tcg_gen_brcondi_i64(TCG_COND_NE, val, trace->n_entries, after_cb);
+    TCGv_i32 cpu_index = gen_cpu_index();
+    tcg_gen_call2(cb->f.vcpu_udata, cb->info, NULL,
+                  tcgv_i32_temp(cpu_index),
+                  tcgv_ptr_temp(tcg_constant_ptr(cb->userp)));
+    tcg_temp_free_i32(cpu_index);
+    gen_set_label(after_cb);
+
+    tcg_temp_free_i64(off);
+    tcg_temp_free_i64(val);
+    tcg_temp_free_ptr(slot);
+    tcg_temp_free_ptr(buf);
+}
+
 static void inject_cb(struct qemu_plugin_dyn_cb *cb)
 
 {
@@ -252,6 +294,11 @@ static void inject_mem_cb(struct qemu_plugin_dyn_cb *cb,
             gen_mem_cb(&cb->regular, meminfo, addr);
         }
         break;
+    case PLUGIN_CB_MEM_TRACE:
+        if (rw & cb->regular.rw) {
+            gen_mem_trace_cb(&cb->regular, meminfo, addr);
+        }
+        break;
     case PLUGIN_CB_INLINE_ADD_U64:
     case PLUGIN_CB_INLINE_STORE_U64:
         if (rw & cb->inline_insn.rw) {
@@ -34,7 +34,15 @@ struct TBContext {
 
     /* statistics */
     unsigned tb_flush_count;
+    unsigned tb_flush_full_count;
+    unsigned tb_reclaim_count;
     unsigned tb_phys_invalidate_count;
+    unsigned tb_step_atomic_count;
+    /* atomic operations that had to take the serial atomic step path */
+    unsigned tb_atomic_unaligned_count;
+    unsigned tb_atomic_io_count;
+    unsigned tb_atomic_host_count;
+    unsigned tb_gen_dedup_count;
 };
 
 extern TBContext tb_ctx;
@@ -31,32 +31,34 @@
 /* Only the bottom TB_JMP_PAGE_BITS of the jump cache hash bits vary for
    addresses on the same page.  The top bits are the same.  This allows
    TLB invalidation to quickly clear a subset of the hash table.  */
-#define TB_JMP_PAGE_BITS (TB_JMP_CACHE_BITS / 2)
-#define TB_JMP_PAGE_SIZE (1 << TB_JMP_PAGE_BITS)
-#define TB_JMP_ADDR_MASK (TB_JMP_PAGE_SIZE - 1)
-#define TB_JMP_PAGE_MASK (TB_JMP_CACHE_SIZE - TB_JMP_PAGE_SIZE)
+#define TB_JMP_PAGE_BITS(bits) ((bits) / 2)
+#define TB_JMP_PAGE_SIZE(bits) (1 << TB_JMP_PAGE_BITS(bits))
+#define TB_JMP_ADDR_MASK(bits) (TB_JMP_PAGE_SIZE(bits) - 1)
+#define TB_JMP_PAGE_MASK(bits) ((1 << (bits)) - TB_JMP_PAGE_SIZE(bits))
 
-static inline unsigned int tb_jmp_cache_hash_page(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_page(vaddr pc, unsigned bits)
 {
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK;
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)));
+    return (tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)))
+           & TB_JMP_PAGE_MASK(bits);
 }
 
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(vaddr pc, unsigned bits)
 {
     vaddr tmp;
-    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS));
-    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS)) & TB_JMP_PAGE_MASK)
-           | (tmp & TB_JMP_ADDR_MASK));
+    tmp = pc ^ (pc >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)));
+    return (((tmp >> (TARGET_PAGE_BITS - TB_JMP_PAGE_BITS(bits)))
+             & TB_JMP_PAGE_MASK(bits))
+           | (tmp & TB_JMP_ADDR_MASK(bits)));
 }
 
 #else
 
 /* In user-mode we can get better hashing because we do not have a TLB */
-static inline unsigned int tb_jmp_cache_hash_func(vaddr pc)
+static inline unsigned int tb_jmp_cache_hash_func(vaddr pc, unsigned bits)
 {
-    return (pc ^ (pc >> TB_JMP_CACHE_BITS)) & (TB_JMP_CACHE_SIZE - 1);
+    return (pc ^ (pc >> bits)) & ((1 << bits) - 1);
 }
 
 #endif /* CONFIG_SOFTMMU */
@@ -71,6 +71,9 @@ static inline void tb_lock_page1(tb_page_addr_t p0, tb_page_addr_t p1)
 
 static inline void tb_unlock_page1(tb_page_addr_t p0, tb_page_addr_t p1) { }
 static inline void tb_unlock_pages(TranslationBlock *tb) { }
+
+/* Re-protect the pages of all TBs intersecting [@start, @last]. */
+void tb_protect_phys_range(tb_page_addr_t start, tb_page_addr_t last);
 #else
 void tb_lock_page0(tb_page_addr_t);
 void tb_lock_page1(tb_page_addr_t, tb_page_addr_t);
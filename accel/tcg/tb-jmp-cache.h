@@ -12,8 +12,15 @@
 #include "qemu/rcu.h"
 #include "exec/cpu-common.h"
 
+/*
+ * The cache starts at TB_JMP_CACHE_BITS and is resized by its vCPU between
+ * TB_JMP_CACHE_MIN_BITS and TB_JMP_CACHE_MAX_BITS depending on the miss
+ * rate; see tb_jmp_cache_miss().
+ */
 #define TB_JMP_CACHE_BITS 12
 #define TB_JMP_CACHE_SIZE (1 << TB_JMP_CACHE_BITS)
+#define TB_JMP_CACHE_MIN_BITS TB_JMP_CACHE_BITS
+#define TB_JMP_CACHE_MAX_BITS 16
 
 /*
  * Invalidated in parallel; all accesses to 'tb' must be atomic.
@@ -21,13 +28,28 @@
  * no need for qatomic_rcu_read() and pc is always consistent with a
  * non-NULL value of 'tb'.  Strictly speaking pc is only needed for
  * CF_PCREL, but it's used always for simplicity.
+ *
+ * The cache itself is replaced when it is resized, so other threads must
+ * fetch cpu->tb_jmp_cache with qatomic_rcu_read() under the RCU read lock
+ * and index it using its own @bits.  The counters are written only by the
+ * owning vCPU.
  */
 typedef struct CPUJumpCache {
     struct rcu_head rcu;
+    unsigned bits;
+    size_t hits;
+    size_t misses;
+    size_t window_lookups;
+    size_t window_misses;
     struct {
         TranslationBlock *tb;
         vaddr pc;
-    } array[TB_JMP_CACHE_SIZE];
+    } array[];
 } CPUJumpCache;
 
+static inline size_t tb_jmp_cache_size(const CPUJumpCache *jc)
+{
+    return (size_t)1 << jc->bits;
+}
+
 #endif /* ACCEL_TCG_TB_JMP_CACHE_H */
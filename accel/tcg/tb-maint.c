@@ -187,8 +187,19 @@ struct PageDesc {
     QemuSpin lock;
     /* list of TBs intersecting this ram page */
     uintptr_t first_tb;
+    /* writes to this page while it held code, reset when it holds none */
+    unsigned int code_write_count;
 };
 
+/*
+ * After this many writes to a page holding code, check whether a write
+ * actually overlaps a TB before gathering and locking all pages of all
+ * TBs on the page.  Guest JITs write data and new code next to code
+ * that is still in use, and would otherwise pay for the full page
+ * collection on every such store.
+ */
+#define SMC_PRECISE_THRESHOLD 16
+
 void page_table_config_init(void)
 {
     uint32_t v_l1_bits;
@@ -889,10 +900,11 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
             tcg_flush_jmp_cache(cpu);
         }
     } else {
-        uint32_t h = tb_jmp_cache_hash_func(tb->pc);
+        RCU_READ_LOCK_GUARD();
 
         CPU_FOREACH(cpu) {
-            CPUJumpCache *jc = cpu->tb_jmp_cache;
+            CPUJumpCache *jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
+            uint32_t h = tb_jmp_cache_hash_func(tb->pc, jc->bits);
 
             if (qatomic_read(&jc->array[h].tb) == tb) {
                 qatomic_set(&jc->array[h].tb, NULL);
@@ -901,6 +913,81 @@ static void tb_jmp_cache_inval_tb(TranslationBlock *tb)
     }
 }
 
+/*
+ * Drop @tb, whose code is about to be overwritten, from the hash table,
+ * the page lists and the jump lists.  Unlike tb_phys_invalidate, this
+ * also unlinks a TB that was not added to the hash table, and leaves
+ * the jump caches to the caller.
+ * Called from safe work, with mmap_lock held in user-mode.
+ */
+static gboolean tb_evict(gpointer key, gpointer value, gpointer data)
+{
+    TranslationBlock *tb = value;
+    uint32_t orig_cflags = tb_cflags(tb);
+    tb_page_addr_t phys_pc = tb_page_addr0(tb);
+
+    qatomic_set(&tb->cflags, orig_cflags | CF_INVALID);
+
+    if (phys_pc != -1) {
+        uint32_t h = tb_hash_func(phys_pc,
+                                  (orig_cflags & CF_PCREL ? 0 : tb->pc),
+                                  tb->flags, tb->cs_base, orig_cflags);
+
+        if (qht_remove(&tb_ctx.htable, tb, h)) {
+            tb_lock_pages(tb);
+            tb_remove(tb);
+            tb_unlock_pages(tb);
+        }
+    }
+
+    tb_remove_from_jmp_list(tb, 0);
+    tb_remove_from_jmp_list(tb, 1);
+    tb_jmp_unlink(tb);
+    return false;
+}
+
+/* reclaim the oldest regions of the code buffer, or flush it all */
+static void do_tb_reclaim(CPUState *cpu, run_on_cpu_data data)
+{
+    CPUState *cs;
+    bool reclaimed;
+
+    mmap_lock();
+    CPU_FOREACH(cs) {
+        tcg_flush_jmp_cache(cs);
+    }
+
+    qemu_thread_jit_write();
+    reclaimed = tcg_region_reclaim(tb_evict, NULL);
+    qemu_thread_jit_execute();
+    if (reclaimed) {
+        qatomic_inc(&tb_ctx.tb_reclaim_count);
+    }
+    mmap_unlock();
+
+    if (reclaimed) {
+        qemu_plugin_flush_cb();
+    } else {
+        unsigned tb_flush_count = qatomic_read(&tb_ctx.tb_flush_count);
+
+        do_tb_flush(cpu, RUN_ON_CPU_HOST_INT(tb_flush_count));
+    }
+}
+
+/*
+ * Make room in a full code buffer.  Only the oldest regions are
+ * discarded, so that recently translated code survives; when the
+ * buffer has a single region, this is a tb_flush.
+ */
+void tb_reclaim(CPUState *cpu)
+{
+    if (cpu_in_serial_context(cpu)) {
+        do_tb_reclaim(cpu, RUN_ON_CPU_NULL);
+    } else {
+        async_safe_run_on_cpu(cpu, do_tb_reclaim, RUN_ON_CPU_NULL);
+    }
+}
+
 /*
  * In user-mode, call with mmap_lock held.
  * In !user-mode, if @rm_from_page_list is set, call with the TB's pages'
@@ -1021,6 +1108,28 @@ void tb_invalidate_phys_range(tb_page_addr_t start, tb_page_addr_t last)
     }
 }
 
+/*
+ * Make the pages of all TBs which intersect with the target address range
+ * read-only again, after they were made writable by a guest mprotect.
+ * As with the initial protection of a TB's pages, the TBs are kept until
+ * the first write fault on each page reaches page_unprotect().
+ * Called with mmap_lock held for user-mode emulation.
+ */
+void tb_protect_phys_range(tb_page_addr_t start, tb_page_addr_t last)
+{
+    TranslationBlock *tb;
+    PageForEachNext n;
+
+    assert_memory_lock();
+
+    PAGE_FOR_EACH_TB(start, last, unused, tb, n) {
+        page_protect(tb_page_addr0(tb));
+        if (tb_page_addr1(tb) != -1) {
+            page_protect(tb_page_addr1(tb));
+        }
+    }
+}
+
 /*
  * Invalidate all TBs which intersect with the target address page @addr.
  * Called with mmap_lock held for user-mode emulation
@@ -1094,6 +1203,26 @@ bool tb_invalidate_phys_page_unwind(tb_page_addr_t addr, uintptr_t pc)
     return false;
 }
 #else
+/*
+ * Return true if the part on page @n of @tb intersects [@start, @last].
+ * NOTE: this is subtle as a TB may span two physical pages.
+ */
+static bool tb_page_range_overlaps(TranslationBlock *tb, int n,
+                                   tb_page_addr_t start, tb_page_addr_t last)
+{
+    tb_page_addr_t tb_start, tb_last;
+
+    tb_start = tb_page_addr0(tb);
+    tb_last = tb_start + tb->size - 1;
+    if (n == 0) {
+        tb_last = MIN(tb_last, tb_start | ~TARGET_PAGE_MASK);
+    } else {
+        tb_start = tb_page_addr1(tb);
+        tb_last = tb_start + (tb_last & ~TARGET_PAGE_MASK);
+    }
+    return !(tb_last < start || tb_start > last);
+}
+
 /*
  * @p must be non-NULL.
  * Call with all @pages locked.
@@ -1119,18 +1248,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
      * XXX: see if in some cases it could be faster to invalidate all the code
      */
     PAGE_FOR_EACH_TB(start, last, p, tb, n) {
-        tb_page_addr_t tb_start, tb_last;
-
-        /* NOTE: this is subtle as a TB may span two physical pages */
-        tb_start = tb_page_addr0(tb);
-        tb_last = tb_start + tb->size - 1;
-        if (n == 0) {
-            tb_last = MIN(tb_last, tb_start | ~TARGET_PAGE_MASK);
-        } else {
-            tb_start = tb_page_addr1(tb);
-            tb_last = tb_start + (tb_last & ~TARGET_PAGE_MASK);
-        }
-        if (!(tb_last < start || tb_start > last)) {
+        if (tb_page_range_overlaps(tb, n, start, last)) {
 #ifdef TARGET_HAS_PRECISE_SMC
             if (current_tb == tb &&
                 (tb_cflags(current_tb) & CF_COUNT_MASK) != 1) {
@@ -1151,6 +1269,7 @@ tb_invalidate_phys_page_range__locked(struct page_collection *pages,
 
     /* if no code remaining, no need to continue to use slow writes */
     if (!p->first_tb) {
+        qatomic_set(&p->code_write_count, 0);
         tlb_unprotect_code(start);
     }
 
@@ -1212,9 +1331,43 @@ static void tb_invalidate_phys_page_fast__locked(struct page_collection *pages,
     }
 
     assert_page_locked(p);
+    qatomic_set(&p->code_write_count, p->code_write_count + 1);
     tb_invalidate_phys_page_range__locked(pages, p, start, start + len - 1, ra);
 }
 
+/*
+ * Return true if [@start, @last] on a page with many code writes does
+ * not overlap any TB, so that the write can proceed without
+ * invalidating anything.
+ */
+static bool tb_page_write_misses_code(tb_page_addr_t start,
+                                      tb_page_addr_t last)
+{
+    PageDesc *p = page_find(start >> TARGET_PAGE_BITS);
+    TranslationBlock *tb;
+    PageForEachNext n;
+    bool miss = true;
+
+    if (!p || qatomic_read(&p->code_write_count) < SMC_PRECISE_THRESHOLD) {
+        return false;
+    }
+
+    page_lock(p);
+    PAGE_FOR_EACH_TB(start, last, p, tb, n) {
+        if (tb_page_range_overlaps(tb, n, start, last)) {
+            miss = false;
+            break;
+        }
+    }
+    /* Once the page holds no code, let the slow path drop the notdirty. */
+    if (!p->first_tb) {
+        miss = false;
+    }
+    page_unlock(p);
+
+    return miss;
+}
+
 /*
  * len must be <= 8 and start must be a multiple of len.
  * Called via softmmu_template.h when code areas are written to with
@@ -1226,6 +1379,10 @@ void tb_invalidate_phys_range_fast(ram_addr_t ram_addr,
 {
     struct page_collection *pages;
 
+    if (tb_page_write_misses_code(ram_addr, ram_addr + size - 1)) {
+        return;
+    }
+
     pages = page_collection_lock(ram_addr, ram_addr + size - 1);
     tb_invalidate_phys_page_fast__locked(pages, ram_addr, size, retaddr);
     page_collection_unlock(pages);
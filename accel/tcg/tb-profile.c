@@ -0,0 +1,179 @@
+/*
+ * Sampling profiler of the guest code executed by TCG
+ *
+ * A realtime timer periodically asks every running vCPU for a sample.
+ * The request is the "exit the TB" flag that cpu_exit() also sets, but
+ * without cpu->exit_request, so the vCPU only goes as far as
+ * cpu_handle_interrupt() before the next TB, records the guest PC and
+ * MMU index of that TB, and carries on.  Unlike a plugin callback on
+ * every TB execution, the cost is one TB exit per vCPU and sample, and
+ * nothing at all while the profiler is off.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/lockable.h"
+#include "qemu/timer.h"
+#include "qemu/xxhash.h"
+#include "qapi/error.h"
+#include "exec/replay-core.h"
+#include "hw/core/cpu.h"
+#include "system/runstate.h"
+#include "tb-profile.h"
+
+typedef struct TCGProfileEntry {
+    vaddr pc;
+    int mode;
+    uint64_t count;
+} TCGProfileEntry;
+
+static struct {
+    /* Protects @samples and @idle against the vCPU threads */
+    QemuMutex lock;
+    bool running;
+    /* Set of TCGProfileEntry, keyed on @pc and @mode */
+    GHashTable *samples;
+    uint64_t idle;
+    QEMUTimer *timer;
+    int64_t period_ns;
+} tcg_profile;
+
+static guint tcg_profile_hash(gconstpointer p)
+{
+    const TCGProfileEntry *e = p;
+
+    return qemu_xxhash4(e->pc, e->mode);
+}
+
+static gboolean tcg_profile_equal(gconstpointer a, gconstpointer b)
+{
+    const TCGProfileEntry *x = a, *y = b;
+
+    return x->pc == y->pc && x->mode == y->mode;
+}
+
+static void tcg_profile_tick(void *opaque)
+{
+    CPUState *cpu;
+
+    if (runstate_is_running()) {
+        CPU_FOREACH(cpu) {
+            if (cpu->halted) {
+                QEMU_LOCK_GUARD(&tcg_profile.lock);
+                tcg_profile.idle++;
+                continue;
+            }
+            qatomic_set(&cpu->tcg_profile_pending, true);
+            /* Ordered after @tcg_profile_pending, see cpu_handle_interrupt() */
+            qatomic_store_release(&cpu->neg.icount_decr.u16.high, -1);
+        }
+    }
+
+    timer_mod(tcg_profile.timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+              tcg_profile.period_ns);
+}
+
+bool tcg_profile_start(uint32_t frequency, Error **errp)
+{
+    if (!frequency || frequency > 100000) {
+        error_setg(errp, "frequency must be between 1 and 100000 Hz");
+        return false;
+    }
+    if (replay_mode != REPLAY_MODE_NONE) {
+        error_setg(errp, "TCG profiling is not supported with record/replay");
+        return false;
+    }
+
+    if (!tcg_profile.timer) {
+        qemu_mutex_init(&tcg_profile.lock);
+        tcg_profile.timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                         tcg_profile_tick, NULL);
+    }
+
+    WITH_QEMU_LOCK_GUARD(&tcg_profile.lock) {
+        if (tcg_profile.samples) {
+            g_hash_table_destroy(tcg_profile.samples);
+        }
+        tcg_profile.samples = g_hash_table_new_full(tcg_profile_hash,
+                                                    tcg_profile_equal,
+                                                    g_free, NULL);
+        tcg_profile.idle = 0;
+        tcg_profile.running = true;
+    }
+
+    tcg_profile.period_ns = NANOSECONDS_PER_SECOND / frequency;
+    timer_mod(tcg_profile.timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+              tcg_profile.period_ns);
+    return true;
+}
+
+void tcg_profile_stop(void)
+{
+    if (!tcg_profile.timer) {
+        return;
+    }
+
+    timer_del(tcg_profile.timer);
+    QEMU_LOCK_GUARD(&tcg_profile.lock);
+    tcg_profile.running = false;
+}
+
+void tcg_profile_sample(CPUState *cpu, vaddr pc, int mode)
+{
+    TCGProfileEntry key = { .pc = pc, .mode = mode };
+    TCGProfileEntry *e;
+
+    qatomic_set(&cpu->tcg_profile_pending, false);
+
+    QEMU_LOCK_GUARD(&tcg_profile.lock);
+    if (!tcg_profile.running) {
+        return;
+    }
+    e = g_hash_table_lookup(tcg_profile.samples, &key);
+    if (!e) {
+        e = g_memdup2(&key, sizeof(key));
+        g_hash_table_add(tcg_profile.samples, e);
+    }
+    e->count++;
+}
+
+static gint tcg_profile_compare(gconstpointer a, gconstpointer b)
+{
+    const TCGProfileEntry *x = *(TCGProfileEntry **)a;
+    const TCGProfileEntry *y = *(TCGProfileEntry **)b;
+
+    if (x->count != y->count) {
+        return x->count > y->count ? -1 : 1;
+    }
+    return x->pc < y->pc ? -1 : x->pc > y->pc;
+}
+
+void tcg_profile_dump(GString *buf)
+{
+    g_autoptr(GPtrArray) entries = NULL;
+    GHashTableIter iter;
+    TCGProfileEntry *e;
+    guint i;
+
+    if (!tcg_profile.timer) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&tcg_profile.lock);
+    entries = g_ptr_array_sized_new(g_hash_table_size(tcg_profile.samples));
+    g_hash_table_iter_init(&iter, tcg_profile.samples);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&e, NULL)) {
+        g_ptr_array_add(entries, e);
+    }
+    g_ptr_array_sort(entries, tcg_profile_compare);
+
+    for (i = 0; i < entries->len; i++) {
+        e = g_ptr_array_index(entries, i);
+        g_string_append_printf(buf, "mmu%d;0x%" VADDR_PRIx " %" PRIu64 "\n",
+                               e->mode, e->pc, e->count);
+    }
+    if (tcg_profile.idle) {
+        g_string_append_printf(buf, "idle %" PRIu64 "\n", tcg_profile.idle);
+    }
+}
@@ -0,0 +1,25 @@
+/*
+ * Sampling profiler of the guest code executed by TCG
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TB_PROFILE_H
+#define ACCEL_TCG_TB_PROFILE_H
+
+#include "exec/cpu-common.h"
+
+/* Start sampling all vCPUs @frequency times per second, dropping old data. */
+bool tcg_profile_start(uint32_t frequency, Error **errp);
+void tcg_profile_stop(void);
+
+/*
+ * Record that @cpu, sampled on request of the profiler, is about to
+ * execute the TB at guest @pc with MMU index @mode.
+ */
+void tcg_profile_sample(CPUState *cpu, vaddr pc, int mode);
+
+/* Append the samples to @buf as folded stacks, "mode;pc count" per line. */
+void tcg_profile_dump(GString *buf);
+
+#endif /* ACCEL_TCG_TB_PROFILE_H */
@@ -29,10 +29,14 @@
 #include "system/cpu-timers.h"
 #include "qemu/main-loop.h"
 #include "qemu/notify.h"
+#include "qemu/bitmap.h"
+#include "qemu/error-report.h"
 #include "qemu/guest-random.h"
+#include "qemu/timer.h"
 #include "hw/boards.h"
 #include "tcg/startup.h"
 #include "tcg-accel-ops.h"
+#include "internal-common.h"
 #include "tcg-accel-ops-mttcg.h"
 
 typedef struct MttcgForceRcuNotifier {
@@ -61,6 +65,30 @@ static void mttcg_force_rcu(Notifier *notify, void *data)
  * current CPUState for a given thread.
  */
 
+/*
+ * An idle vcpu normally sleeps on halt_cond and, once kicked, has to
+ * wait for the BQL before it can run again.  For IPI-heavy guests that
+ * round trip dominates, so first poll for a kick without holding the
+ * BQL, for at most halt-poll-ns.  Every kick goes through cpu_exit(),
+ * so exit_request is enough to tell that something changed; the state
+ * itself is re-checked by qemu_wait_io_event() under the BQL.
+ */
+static void mttcg_halt_poll(CPUState *cpu)
+{
+    int64_t deadline;
+
+    if (!tcg_halt_poll_ns || !cpu_thread_is_idle(cpu)) {
+        return;
+    }
+
+    bql_unlock();
+    deadline = get_clock() + tcg_halt_poll_ns;
+    while (!qatomic_read(&cpu->exit_request) && get_clock() < deadline) {
+        cpu_relax();
+    }
+    bql_lock();
+}
+
 static void *mttcg_cpu_thread_fn(void *arg)
 {
     MttcgForceRcuNotifier force_rcu;
@@ -114,6 +142,7 @@ static void *mttcg_cpu_thread_fn(void *arg)
         }
 
         qatomic_set_mb(&cpu->exit_request, 0);
+        mttcg_halt_poll(cpu);
         qemu_wait_io_event(cpu);
     } while (!cpu->unplug || cpu_can_run(cpu));
 
@@ -129,6 +158,32 @@ void mttcg_kick_vcpu_thread(CPUState *cpu)
     cpu_exit(cpu);
 }
 
+/*
+ * Pin the vcpu thread to its host cpu, if the vcpu-affinity property
+ * asked for it.  Keeping a vcpu on one core keeps its TLB and the hot
+ * parts of the code buffer in that core's caches.
+ */
+static void mttcg_set_vcpu_affinity(CPUState *cpu)
+{
+    unsigned long *bitmap;
+    unsigned host_cpu;
+    int ret;
+
+    if (!tcg_vcpu_affinity_len) {
+        return;
+    }
+
+    host_cpu = tcg_vcpu_affinity[cpu->cpu_index % tcg_vcpu_affinity_len];
+    bitmap = bitmap_new(host_cpu + 1);
+    set_bit(host_cpu, bitmap);
+    ret = qemu_thread_set_affinity(cpu->thread, bitmap, host_cpu + 1);
+    if (ret) {
+        warn_report("Could not pin vCPU %d to host CPU %u: %s",
+                    cpu->cpu_index, host_cpu, strerror(abs(ret)));
+    }
+    g_free(bitmap);
+}
+
 void mttcg_start_vcpu_thread(CPUState *cpu)
 {
     char thread_name[VCPU_THREAD_NAME_SIZE];
@@ -142,4 +197,5 @@ void mttcg_start_vcpu_thread(CPUState *cpu)
 
     qemu_thread_create(cpu->thread, thread_name, mttcg_cpu_thread_fn,
                        cpu, QEMU_THREAD_JOINABLE);
+    mttcg_set_vcpu_affinity(cpu);
 }
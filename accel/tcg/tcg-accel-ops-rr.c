@@ -56,7 +56,9 @@ void rr_kick_vcpu_thread(CPUState *unused)
  * scheduled.
  *
  * The timer is removed if all vCPUs are idle and restarted again once
- * idleness is complete.
+ * idleness is complete.  While only one vCPU has anything to run the
+ * timer keeps ticking but does not kick, as there is nobody to switch
+ * to; waking another vCPU up makes it kick again on the next tick.
  */
 
 static QEMUTimer *rr_kick_vcpu_timer;
@@ -81,10 +83,26 @@ static void rr_kick_next_cpu(void)
     } while (cpu != qatomic_read(&rr_current_cpu));
 }
 
+/* Return true if more than one vCPU is running or has work to do. */
+static bool rr_cpus_contended(void)
+{
+    CPUState *cpu;
+    int runnable = 0;
+
+    CPU_FOREACH(cpu) {
+        if ((!cpu->halted || cpu_has_work(cpu)) && ++runnable > 1) {
+            return true;
+        }
+    }
+    return false;
+}
+
 static void rr_kick_thread(void *opaque)
 {
     timer_mod(rr_kick_vcpu_timer, rr_next_kick_time());
-    rr_kick_next_cpu();
+    if (rr_cpus_contended()) {
+        rr_kick_next_cpu();
+    }
 }
 
 static void rr_start_kick_timer(void)
@@ -251,7 +269,14 @@ static void *rr_cpu_thread_fn(void *arg)
             qemu_clock_enable(QEMU_CLOCK_VIRTUAL,
                               (cpu->singlestep_enabled & SSTEP_NOTIMER) == 0);
 
-            if (cpu_can_run(cpu)) {
+            if (!icount_enabled() && cpu_can_run(cpu) &&
+                cpu->halted && !cpu_has_work(cpu)) {
+                /*
+                 * cpu_exec() would return EXCP_HALTED straight away; skip
+                 * it, and the BQL round trip around it, for idle vCPUs.
+                 * With icount the run still has to account the budget.
+                 */
+            } else if (cpu_can_run(cpu)) {
                 int r;
 
                 bql_unlock();
@@ -45,6 +45,7 @@
 #include "tcg-accel-ops-mttcg.h"
 #include "tcg-accel-ops-rr.h"
 #include "tcg-accel-ops-icount.h"
+#include "dirty-ring.h"
 
 /* common functionality among all TCG variants */
 
@@ -79,6 +80,7 @@ int tcg_cpu_exec(CPUState *cpu)
     cpu_exec_start(cpu);
     ret = cpu_exec(cpu);
     cpu_exec_end(cpu);
+    tcg_dirty_ring_throttle(cpu);
     return ret;
 }
 
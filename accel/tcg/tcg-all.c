@@ -33,13 +33,17 @@
 #include "qemu/accel.h"
 #include "qemu/atomic.h"
 #include "qapi/qapi-builtin-visit.h"
+#include "qemu/timer.h"
 #include "qemu/units.h"
+#include "qemu/host-utils.h"
+#include "hw/core/cpu.h"
 #if defined(CONFIG_USER_ONLY)
 #include "hw/qdev-core.h"
 #else
 #include "hw/boards.h"
 #endif
 #include "internal-common.h"
+#include "dirty-ring.h"
 #include "cpu-param.h"
 
 
@@ -102,6 +106,15 @@ static void tcg_accel_instance_init(Object *obj)
 
 bool mttcg_enabled;
 bool one_insn_per_tb;
+uint32_t tcg_tier_up_threshold;
+#ifndef CONFIG_USER_ONLY
+unsigned tcg_vtlb_size = CPU_VTLB_DEFAULT_SIZE;
+uint16_t *tcg_vcpu_affinity;
+unsigned tcg_vcpu_affinity_len;
+uint32_t tcg_halt_poll_ns;
+uint64_t tcg_dirty_granularity;
+uint32_t tcg_dirty_ring_size;
+#endif
 
 static int tcg_init_machine(MachineState *ms)
 {
@@ -129,6 +142,10 @@ static int tcg_init_machine(MachineState *ms)
 
 #ifdef CONFIG_USER_ONLY
     qdev_create_fake_machine();
+#else
+    if (tcg_dirty_ring_size) {
+        tcg_dirty_ring_listener_register();
+    }
 #endif
 
     return 0;
@@ -186,6 +203,190 @@ static void tcg_set_tb_size(Object *obj, Visitor *v,
     s->tb_size = value;
 }
 
+#ifndef CONFIG_USER_ONLY
+static void tcg_get_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    uint32_t value = tcg_vtlb_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_vtlb_size(Object *obj, Visitor *v,
+                              const char *name, void *opaque,
+                              Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    if (!is_power_of_2(value) ||
+        value < CPU_VTLB_WAYS || value > CPU_VTLB_MAX_SIZE) {
+        error_setg(errp, "vtlb-size must be a power of 2 between %d and %d",
+                   CPU_VTLB_WAYS, CPU_VTLB_MAX_SIZE);
+        return;
+    }
+
+    tcg_vtlb_size = value;
+}
+
+static void tcg_get_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    uint32_t value = tcg_halt_poll_ns;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_halt_poll_ns(Object *obj, Visitor *v,
+                                 const char *name, void *opaque,
+                                 Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value > 10 * SCALE_MS) {
+        error_setg(errp, "halt-poll-ns must be at most %" PRId64,
+                   (int64_t)(10 * SCALE_MS));
+        return;
+    }
+
+    tcg_halt_poll_ns = value;
+}
+
+static void tcg_get_tier_up_threshold(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    uint32_t value = tcg_tier_up_threshold;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_tier_up_threshold(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value > INT32_MAX) {
+        error_setg(errp, "x-tier-up-threshold must be at most %d",
+                   INT32_MAX);
+        return;
+    }
+
+    tcg_tier_up_threshold = value;
+}
+
+static void tcg_get_dirty_granularity(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    uint64_t value = tcg_dirty_granularity;
+
+    visit_type_size(v, name, &value, errp);
+}
+
+static void tcg_set_dirty_granularity(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    uint64_t value;
+
+    if (!visit_type_size(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value && (!is_power_of_2(value) || value > 2 * MiB)) {
+        error_setg(errp, "dirty-granularity must be 0 or a power of 2 "
+                   "no larger than 2M");
+        return;
+    }
+
+    tcg_dirty_granularity = value;
+}
+
+static void tcg_get_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    uint32_t value = tcg_dirty_ring_size;
+
+    visit_type_uint32(v, name, &value, errp);
+}
+
+static void tcg_set_dirty_ring_size(Object *obj, Visitor *v,
+                                    const char *name, void *opaque,
+                                    Error **errp)
+{
+    uint32_t value;
+
+    if (!visit_type_uint32(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value && !is_power_of_2(value)) {
+        error_setg(errp, "dirty-ring-size must be a power of two.");
+        return;
+    }
+
+    tcg_dirty_ring_size = value;
+}
+
+static void tcg_get_vcpu_affinity(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    uint16List *host_cpus = NULL;
+    uint16List **tail = &host_cpus;
+
+    for (unsigned i = 0; i < tcg_vcpu_affinity_len; i++) {
+        QAPI_LIST_APPEND(tail, tcg_vcpu_affinity[i]);
+    }
+
+    visit_type_uint16List(v, name, &host_cpus, errp);
+    qapi_free_uint16List(host_cpus);
+}
+
+static void tcg_set_vcpu_affinity(Object *obj, Visitor *v,
+                                  const char *name, void *opaque,
+                                  Error **errp)
+{
+    uint16List *l, *host_cpus = NULL;
+    unsigned n = 0;
+
+    if (!visit_type_uint16List(v, name, &host_cpus, errp)) {
+        return;
+    }
+
+    g_free(tcg_vcpu_affinity);
+    tcg_vcpu_affinity = NULL;
+    for (l = host_cpus; l; l = l->next) {
+        n++;
+    }
+    if (n) {
+        tcg_vcpu_affinity = g_new(uint16_t, n);
+        n = 0;
+        for (l = host_cpus; l; l = l->next) {
+            tcg_vcpu_affinity[n++] = l->value;
+        }
+    }
+    tcg_vcpu_affinity_len = n;
+    qapi_free_uint16List(host_cpus);
+}
+#endif
+
 static bool tcg_get_splitwx(Object *obj, Error **errp)
 {
     TCGState *s = TCG_STATE(obj);
@@ -247,6 +448,45 @@ static void tcg_accel_class_init(ObjectClass *oc, void *data)
     object_class_property_set_description(oc, "tb-size",
         "TCG translation block cache size");
 
+#ifndef CONFIG_USER_ONLY
+    object_class_property_add(oc, "vtlb-size", "int",
+        tcg_get_vtlb_size, tcg_set_vtlb_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vtlb-size",
+        "Number of entries of each victim TLB");
+
+    object_class_property_add(oc, "vcpu-affinity", "int",
+        tcg_get_vcpu_affinity, tcg_set_vcpu_affinity,
+        NULL, NULL);
+    object_class_property_set_description(oc, "vcpu-affinity",
+        "Host CPUs to pin the vCPU threads to, one per vCPU in order");
+
+    object_class_property_add(oc, "halt-poll-ns", "int",
+        tcg_get_halt_poll_ns, tcg_set_halt_poll_ns,
+        NULL, NULL);
+    object_class_property_set_description(oc, "halt-poll-ns",
+        "Time an idle vCPU thread polls for a wakeup before sleeping");
+
+    object_class_property_add(oc, "x-tier-up-threshold", "int",
+        tcg_get_tier_up_threshold, tcg_set_tier_up_threshold,
+        NULL, NULL);
+    object_class_property_set_description(oc, "x-tier-up-threshold",
+        "Executions after which a TB is retranslated with the optimizer");
+
+    object_class_property_add(oc, "dirty-granularity", "size",
+        tcg_get_dirty_granularity, tcg_set_dirty_granularity,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-granularity",
+        "Size of the guest RAM range dirtied by one write during dirty "
+        "tracking");
+
+    object_class_property_add(oc, "dirty-ring-size", "uint32",
+        tcg_get_dirty_ring_size, tcg_set_dirty_ring_size,
+        NULL, NULL);
+    object_class_property_set_description(oc, "dirty-ring-size",
+        "Size of the per-vCPU dirty page ring buffer (number of entries)");
+#endif
+
     object_class_property_add_bool(oc, "split-wx",
         tcg_get_splitwx, tcg_set_splitwx);
     object_class_property_set_description(oc, "split-wx",
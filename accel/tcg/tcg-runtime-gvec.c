@@ -21,6 +21,9 @@
 #include "qemu/host-utils.h"
 #include "exec/helper-proto-common.h"
 #include "tcg/tcg-gvec-desc.h"
+#if defined(CONFIG_AVX2_OPT) || defined(CONFIG_AVX512BW_OPT)
+#include "host/cpuinfo.h"
+#endif
 
 
 static inline void clear_high(void *d, intptr_t oprsz, uint32_t desc)
@@ -35,47 +38,156 @@ static inline void clear_high(void *d, intptr_t oprsz, uint32_t desc)
     }
 }
 
+/*
+ * The plain lane-wise binary operations are by far the most common
+ * out-of-line expansions.  Instantiate their loops once per host ISA
+ * level and pick the widest one the running host supports at startup,
+ * in the same way as util/bufferiszero.c.
+ */
+typedef void gvec_accel_fn(void *d, void *a, void *b, intptr_t oprsz);
+
+#define GVEC_ACCEL_OPS(X)        \
+    X(add8,  uint8_t,  x + y)    \
+    X(add16, uint16_t, x + y)    \
+    X(add32, uint32_t, x + y)    \
+    X(add64, uint64_t, x + y)    \
+    X(sub8,  uint8_t,  x - y)    \
+    X(sub16, uint16_t, x - y)    \
+    X(sub32, uint32_t, x - y)    \
+    X(sub64, uint64_t, x - y)    \
+    X(mul8,  uint8_t,  x * y)    \
+    X(mul16, uint16_t, x * y)    \
+    X(mul32, uint32_t, x * y)    \
+    X(mul64, uint64_t, x * y)    \
+    X(and,   uint64_t, x & y)    \
+    X(or,    uint64_t, x | y)    \
+    X(xor,   uint64_t, x ^ y)    \
+    X(andc,  uint64_t, x & ~y)   \
+    X(orc,   uint64_t, x | ~y)   \
+    X(nand,  uint64_t, ~(x & y)) \
+    X(nor,   uint64_t, ~(x | y)) \
+    X(eqv,   uint64_t, ~(x ^ y))
+
+enum {
+#define GVEC_ACCEL_ENUM(NAME, TYPE, EXPR)  GVEC_ACCEL_##NAME,
+    GVEC_ACCEL_OPS(GVEC_ACCEL_ENUM)
+#undef GVEC_ACCEL_ENUM
+    GVEC_ACCEL_NB
+};
+
+/*
+ * Process VSZ bytes at a time, then finish with single lanes.  The
+ * operands are only guaranteed to be 8-byte aligned, so go through
+ * memcpy and let the compiler pick unaligned vector moves.
+ */
+#define GVEC_ACCEL_FN(SUFFIX, ATTR, VSZ, NAME, TYPE, EXPR)              \
+static void ATTR gvec_##NAME##_##SUFFIX(void *d, void *a, void *b,     \
+                                        intptr_t oprsz)                 \
+{                                                                       \
+    typedef TYPE vtype __attribute__((vector_size(VSZ)));              \
+    intptr_t i = 0;                                                     \
+                                                                        \
+    for (; i + VSZ <= oprsz; i += VSZ) {                                \
+        vtype x, y;                                                     \
+                                                                        \
+        memcpy(&x, a + i, VSZ);                                         \
+        memcpy(&y, b + i, VSZ);                                         \
+        x = EXPR;                                                       \
+        memcpy(d + i, &x, VSZ);                                         \
+    }                                                                   \
+    for (; i < oprsz; i += sizeof(TYPE)) {                              \
+        TYPE x = *(TYPE *)(a + i);                                      \
+        TYPE y = *(TYPE *)(b + i);                                      \
+                                                                        \
+        *(TYPE *)(d + i) = EXPR;                                        \
+    }                                                                   \
+}
+
+#define GVEC_ACCEL_INT(NAME, TYPE, EXPR) \
+    GVEC_ACCEL_FN(int, , 16, NAME, TYPE, EXPR)
+#define GVEC_ACCEL_ENTRY_INT(NAME, TYPE, EXPR)  gvec_##NAME##_int,
+
+GVEC_ACCEL_OPS(GVEC_ACCEL_INT)
+
+static gvec_accel_fn * const gvec_accel_int[GVEC_ACCEL_NB] = {
+    GVEC_ACCEL_OPS(GVEC_ACCEL_ENTRY_INT)
+};
+
+#ifdef CONFIG_AVX2_OPT
+#define GVEC_ACCEL_AVX2(NAME, TYPE, EXPR) \
+    GVEC_ACCEL_FN(avx2, __attribute__((target("avx2"))), 32, NAME, TYPE, EXPR)
+#define GVEC_ACCEL_ENTRY_AVX2(NAME, TYPE, EXPR)  gvec_##NAME##_avx2,
+
+GVEC_ACCEL_OPS(GVEC_ACCEL_AVX2)
+
+static gvec_accel_fn * const gvec_accel_avx2[GVEC_ACCEL_NB] = {
+    GVEC_ACCEL_OPS(GVEC_ACCEL_ENTRY_AVX2)
+};
+#endif
+
+#ifdef CONFIG_AVX512BW_OPT
+#define GVEC_ACCEL_AVX512(NAME, TYPE, EXPR) \
+    GVEC_ACCEL_FN(avx512, __attribute__((target("avx512bw"))), 64, \
+                  NAME, TYPE, EXPR)
+#define GVEC_ACCEL_ENTRY_AVX512(NAME, TYPE, EXPR)  gvec_##NAME##_avx512,
+
+GVEC_ACCEL_OPS(GVEC_ACCEL_AVX512)
+
+static gvec_accel_fn * const gvec_accel_avx512[GVEC_ACCEL_NB] = {
+    GVEC_ACCEL_OPS(GVEC_ACCEL_ENTRY_AVX512)
+};
+#endif
+
+static gvec_accel_fn * const *gvec_accel = gvec_accel_int;
+
+static void __attribute__((constructor)) init_gvec_accel(void)
+{
+#if defined(CONFIG_AVX2_OPT) || defined(CONFIG_AVX512BW_OPT)
+    unsigned info = cpuinfo_init();
+
+#ifdef CONFIG_AVX512BW_OPT
+    if ((info & CPUINFO_AVX512F) && (info & CPUINFO_AVX512BW)) {
+        gvec_accel = gvec_accel_avx512;
+        return;
+    }
+#endif
+#ifdef CONFIG_AVX2_OPT
+    if (info & CPUINFO_AVX2) {
+        gvec_accel = gvec_accel_avx2;
+    }
+#endif
+#endif
+}
+
 void HELPER(gvec_add8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        *(uint8_t *)(d + i) = *(uint8_t *)(a + i) + *(uint8_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_add8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_add16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        *(uint16_t *)(d + i) = *(uint16_t *)(a + i) + *(uint16_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_add16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_add32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) + *(uint32_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_add32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_add64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) + *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_add64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
@@ -126,44 +238,32 @@ void HELPER(gvec_adds64)(void *d, void *a, uint64_t b, uint32_t desc)
 void HELPER(gvec_sub8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        *(uint8_t *)(d + i) = *(uint8_t *)(a + i) - *(uint8_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_sub8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sub16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        *(uint16_t *)(d + i) = *(uint16_t *)(a + i) - *(uint16_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_sub16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sub32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) - *(uint32_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_sub32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_sub64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) - *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_sub64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
@@ -214,44 +314,32 @@ void HELPER(gvec_subs64)(void *d, void *a, uint64_t b, uint32_t desc)
 void HELPER(gvec_mul8)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint8_t)) {
-        *(uint8_t *)(d + i) = *(uint8_t *)(a + i) * *(uint8_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_mul8](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_mul16)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint16_t)) {
-        *(uint16_t *)(d + i) = *(uint16_t *)(a + i) * *(uint16_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_mul16](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_mul32)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint32_t)) {
-        *(uint32_t *)(d + i) = *(uint32_t *)(a + i) * *(uint32_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_mul32](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_mul64)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) * *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_mul64](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
@@ -453,88 +541,64 @@ void HELPER(gvec_not)(void *d, void *a, uint32_t desc)
 void HELPER(gvec_and)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) & *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_and](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_or)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) | *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_or](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_xor)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) ^ *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_xor](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_andc)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) &~ *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_andc](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_orc)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = *(uint64_t *)(a + i) |~ *(uint64_t *)(b + i);
-    }
+    gvec_accel[GVEC_ACCEL_orc](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_nand)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = ~(*(uint64_t *)(a + i) & *(uint64_t *)(b + i));
-    }
+    gvec_accel[GVEC_ACCEL_nand](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_nor)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = ~(*(uint64_t *)(a + i) | *(uint64_t *)(b + i));
-    }
+    gvec_accel[GVEC_ACCEL_nor](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
 void HELPER(gvec_eqv)(void *d, void *a, void *b, uint32_t desc)
 {
     intptr_t oprsz = simd_oprsz(desc);
-    intptr_t i;
 
-    for (i = 0; i < oprsz; i += sizeof(uint64_t)) {
-        *(uint64_t *)(d + i) = ~(*(uint64_t *)(a + i) ^ *(uint64_t *)(b + i));
-    }
+    gvec_accel[GVEC_ACCEL_eqv](d, a, b, oprsz);
     clear_high(d, oprsz, desc);
 }
 
@@ -26,6 +26,7 @@
 #include "exec/cpu-common.h"
 #include "exec/helper-proto-common.h"
 #include "accel/tcg/getpc.h"
+#include "tb-context.h"
 
 #define HELPER_H  "accel/tcg/tcg-runtime.h"
 #include "exec/helper-info.c.inc"
@@ -146,5 +147,6 @@ uint64_t HELPER(ctpop_i64)(uint64_t arg)
 
 void HELPER(exit_atomic)(CPUArchState *env)
 {
+    qatomic_inc(&tb_ctx.tb_atomic_host_count);
     cpu_loop_exit_atomic(env_cpu(env), GETPC());
 }
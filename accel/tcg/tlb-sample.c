@@ -0,0 +1,248 @@
+/*
+ * Sampling of guest page accesses through TLB refills
+ *
+ * Instead of instrumenting every memory access like the hotpages and
+ * hwprofile plugins, a realtime timer periodically asks each running
+ * vCPU to evict a few random entries from its TLB.  The next access to
+ * an evicted page refills it, and the refill, with its virtual and
+ * physical page, MMU index and access type, is pushed to a ring of the
+ * vCPU.  The timer harvests the rings into a heatmap of guest physical
+ * pages, which doubles as a sampled estimate of the guest working set:
+ * a page that is refilled soon after its eviction is in active use.
+ *
+ * The cost is a handful of TLB misses per vCPU and period, and one
+ * test of cpu->tlb_sample per TLB fill while the sampler was ever on.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "hw/core/cpu.h"
+#include "system/runstate.h"
+#include "tlb-sample.h"
+#include "trace.h"
+
+typedef struct TLBSamplePage {
+    /* Also the key, see g_int64_hash() */
+    hwaddr paddr;
+    uint64_t count[MMU_INST_FETCH + 1];
+    /* vCPUs with a cpu_index below 64 that accessed the page */
+    uint64_t vcpus;
+} TLBSamplePage;
+
+/* All of it is protected by the BQL */
+static struct {
+    bool running;
+    uint32_t entries;
+    int64_t period_ns;
+    QEMUTimer *timer;
+    /* Set of TLBSamplePage, keyed on @paddr */
+    GHashTable *pages;
+    uint64_t refills;
+    uint64_t dropped;
+} tlb_sample;
+
+void tlb_sample_refill(CPUState *cpu, vaddr addr, hwaddr paddr, int mmu_idx,
+                       MMUAccessType access_type)
+{
+    TLBSample *s = cpu->tlb_sample;
+    uint32_t head = s->head;
+    unsigned int i;
+
+    for (i = 0; i < s->armed; i++) {
+        if (s->armed_pages[i].page == addr &&
+            s->armed_pages[i].mmu_idx == mmu_idx) {
+            break;
+        }
+    }
+    if (i == s->armed) {
+        return;
+    }
+    s->armed_pages[i] = s->armed_pages[--s->armed];
+
+    trace_tlb_sample_refill(cpu->cpu_index, addr, paddr, mmu_idx,
+                            access_type);
+    if (head - qatomic_load_acquire(&s->tail) == TLB_SAMPLE_RING_SIZE) {
+        qatomic_set(&s->dropped, s->dropped + 1);
+        return;
+    }
+    s->ring[head % TLB_SAMPLE_RING_SIZE] = (TLBSampleEvent) {
+        .addr = addr,
+        .paddr = paddr,
+        .mmu_idx = mmu_idx,
+        .access_type = access_type,
+    };
+    qatomic_store_release(&s->head, head + 1);
+}
+
+static void tlb_sample_harvest(void)
+{
+    CPUState *cpu;
+
+    CPU_FOREACH(cpu) {
+        TLBSample *s = cpu->tlb_sample;
+        uint32_t head, tail;
+
+        if (!s) {
+            continue;
+        }
+
+        head = qatomic_load_acquire(&s->head);
+        for (tail = s->tail; tail != head; tail++) {
+            TLBSampleEvent *e = &s->ring[tail % TLB_SAMPLE_RING_SIZE];
+            TLBSamplePage *p = g_hash_table_lookup(tlb_sample.pages,
+                                                   &e->paddr);
+
+            if (!p) {
+                p = g_new0(TLBSamplePage, 1);
+                p->paddr = e->paddr;
+                g_hash_table_add(tlb_sample.pages, p);
+            }
+            p->count[e->access_type]++;
+            if (cpu->cpu_index < 64) {
+                p->vcpus |= 1ULL << cpu->cpu_index;
+            }
+        }
+        tlb_sample.refills += head - s->tail;
+        qatomic_store_release(&s->tail, head);
+
+        tlb_sample.dropped += qatomic_read(&s->dropped);
+        qatomic_set(&s->dropped, 0);
+    }
+}
+
+static void tlb_sample_work(CPUState *cpu, run_on_cpu_data data)
+{
+    qatomic_set(&cpu->tlb_sample->pending, false);
+    tlb_sample_evict(cpu, data.host_int);
+}
+
+static void tlb_sample_tick(void *opaque)
+{
+    CPUState *cpu;
+
+    tlb_sample_harvest();
+
+    if (runstate_is_running()) {
+        CPU_FOREACH(cpu) {
+            TLBSample *s = cpu->tlb_sample;
+
+            if (!s) {
+                s = g_new0(TLBSample, 1);
+                s->seed = 0x9e3779b97f4a7c15ULL * (cpu->cpu_index + 1);
+                qatomic_set(&cpu->tlb_sample, s);
+            }
+            /* A halted vCPU has no accesses to sample */
+            if (cpu->halted || qatomic_read(&s->pending)) {
+                continue;
+            }
+            qatomic_set(&s->pending, true);
+            async_run_on_cpu(cpu, tlb_sample_work,
+                             RUN_ON_CPU_HOST_INT(tlb_sample.entries));
+        }
+    }
+
+    timer_mod(tlb_sample.timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+              tlb_sample.period_ns);
+}
+
+bool tlb_sample_start(uint32_t frequency, uint32_t entries, Error **errp)
+{
+    CPUState *cpu;
+
+    if (!frequency || frequency > 1000) {
+        error_setg(errp, "frequency must be between 1 and 1000 Hz");
+        return false;
+    }
+    if (!entries || entries > TLB_SAMPLE_MAX_ENTRIES) {
+        error_setg(errp, "entries must be between 1 and %d",
+                   TLB_SAMPLE_MAX_ENTRIES);
+        return false;
+    }
+
+    if (!tlb_sample.timer) {
+        tlb_sample.timer = timer_new_ns(QEMU_CLOCK_REALTIME,
+                                        tlb_sample_tick, NULL);
+    }
+    if (tlb_sample.pages) {
+        g_hash_table_destroy(tlb_sample.pages);
+    }
+    tlb_sample.pages = g_hash_table_new_full(g_int64_hash, g_int64_equal,
+                                             g_free, NULL);
+    tlb_sample.refills = 0;
+    tlb_sample.dropped = 0;
+
+    /* Drop what the vCPUs recorded since the last run stopped */
+    CPU_FOREACH(cpu) {
+        TLBSample *s = cpu->tlb_sample;
+
+        if (s) {
+            qatomic_store_release(&s->tail, qatomic_load_acquire(&s->head));
+            qatomic_set(&s->dropped, 0);
+        }
+    }
+
+    tlb_sample.running = true;
+    tlb_sample.entries = entries;
+    tlb_sample.period_ns = NANOSECONDS_PER_SECOND / frequency;
+    timer_mod(tlb_sample.timer, qemu_clock_get_ns(QEMU_CLOCK_REALTIME) +
+              tlb_sample.period_ns);
+    return true;
+}
+
+void tlb_sample_stop(void)
+{
+    if (!tlb_sample.running) {
+        return;
+    }
+
+    timer_del(tlb_sample.timer);
+    tlb_sample_harvest();
+    tlb_sample.running = false;
+}
+
+static gint tlb_sample_compare(gconstpointer a, gconstpointer b)
+{
+    const TLBSamplePage *x = *(TLBSamplePage **)a;
+    const TLBSamplePage *y = *(TLBSamplePage **)b;
+
+    return x->paddr < y->paddr ? -1 : x->paddr > y->paddr;
+}
+
+void tlb_sample_dump(GString *buf)
+{
+    g_autoptr(GPtrArray) pages = NULL;
+    GHashTableIter iter;
+    TLBSamplePage *p;
+    guint i;
+
+    if (!tlb_sample.pages) {
+        return;
+    }
+
+    if (tlb_sample.running) {
+        tlb_sample_harvest();
+    }
+
+    pages = g_ptr_array_sized_new(g_hash_table_size(tlb_sample.pages));
+    g_hash_table_iter_init(&iter, tlb_sample.pages);
+    while (g_hash_table_iter_next(&iter, (gpointer *)&p, NULL)) {
+        g_ptr_array_add(pages, p);
+    }
+    g_ptr_array_sort(pages, tlb_sample_compare);
+
+    g_string_append_printf(buf, "%" PRIu64 " refills of %u pages, "
+                           "%" PRIu64 " dropped\n", tlb_sample.refills,
+                           pages->len, tlb_sample.dropped);
+    for (i = 0; i < pages->len; i++) {
+        p = g_ptr_array_index(pages, i);
+        g_string_append_printf(buf, "0x%" HWADDR_PRIx " load %" PRIu64
+                               " store %" PRIu64 " fetch %" PRIu64
+                               " vcpus 0x%" PRIx64 "\n", p->paddr,
+                               p->count[MMU_DATA_LOAD],
+                               p->count[MMU_DATA_STORE],
+                               p->count[MMU_INST_FETCH], p->vcpus);
+    }
+}
@@ -0,0 +1,69 @@
+/*
+ * Sampling of guest page accesses through TLB refills
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef ACCEL_TCG_TLB_SAMPLE_H
+#define ACCEL_TCG_TLB_SAMPLE_H
+
+#include "exec/cpu-common.h"
+#include "exec/hwaddr.h"
+
+/* Most TLB entries evicted per vCPU and sampling period */
+#define TLB_SAMPLE_MAX_ENTRIES 64
+/* Refills recorded per vCPU between two harvests, a power of 2 */
+#define TLB_SAMPLE_RING_SIZE 1024
+
+typedef struct TLBSampleEvent {
+    vaddr addr;
+    hwaddr paddr;
+    uint8_t mmu_idx;
+    uint8_t access_type;
+} TLBSampleEvent;
+
+typedef struct TLBSample {
+    /* Set by the sampler timer, cleared by the vCPU once it evicted */
+    bool pending;
+
+    /* Owned by the vCPU thread */
+    uint64_t seed;
+    unsigned int armed;
+    struct {
+        vaddr page;
+        int mmu_idx;
+    } armed_pages[TLB_SAMPLE_MAX_ENTRIES];
+
+    /* Written only by the vCPU thread */
+    uint32_t head;
+    uint64_t dropped;
+    /* Written only by the harvester, with the BQL held */
+    uint32_t tail;
+    TLBSampleEvent ring[TLB_SAMPLE_RING_SIZE];
+} TLBSample;
+
+/*
+ * Start evicting @entries random TLB entries of each running vCPU
+ * @frequency times per second, dropping the heatmap of a previous run.
+ */
+bool tlb_sample_start(uint32_t frequency, uint32_t entries, Error **errp);
+void tlb_sample_stop(void);
+
+/* Append the heatmap to @buf, one line per sampled guest physical page. */
+void tlb_sample_dump(GString *buf);
+
+/*
+ * Evict up to @n random entries from the TLB of @cpu, and remember
+ * them in @cpu->tlb_sample so that their refill is recorded.  Must be
+ * called by the vCPU thread.  Implemented in cputlb.c.
+ */
+void tlb_sample_evict(CPUState *cpu, unsigned int n);
+
+/*
+ * Called after each TLB refill of @cpu while it has a TLBSample: record
+ * the refill if the sampler evicted the page.
+ */
+void tlb_sample_refill(CPUState *cpu, vaddr addr, hwaddr paddr, int mmu_idx,
+                       MMUAccessType access_type);
+
+#endif /* ACCEL_TCG_TLB_SAMPLE_H */
@@ -319,10 +319,11 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     assert_no_pages_locked();
     tb = tcg_tb_alloc(tcg_ctx);
     if (unlikely(!tb)) {
-        /* flush must be done */
-        tb_flush(cpu);
+        /* room must be made */
+        qatomic_inc(&tb_ctx.tb_flush_full_count);
+        tb_reclaim(cpu);
         mmap_unlock();
-        /* Make the execution loop process the flush as soon as possible.  */
+        /* Make the execution loop process the reclaim as soon as possible. */
         cpu->exception_index = EXCP_INTERRUPT;
         cpu_loop_exit(cpu);
     }
@@ -335,6 +336,21 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     tb->cs_base = cs_base;
     tb->flags = flags;
     tb->cflags = cflags;
+    tb->tier_up_budget = 0;
+    /*
+     * With tiered translation, TBs are first translated quickly without
+     * the optimizer, and retranslated with it by helper_tier_up() once
+     * they have run tcg_tier_up_threshold times.  TBs that cannot take
+     * the exit request at their start are always optimized.
+     */
+    if (tcg_tier_up_threshold && phys_pc != -1 &&
+        !(cflags & (CF_NOIRQ | CF_USE_ICOUNT))) {
+        if (cpu->tb_tier_up_addr == phys_pc) {
+            cpu->tb_tier_up_addr = -1;
+        } else {
+            tb->tier_up_budget = tcg_tier_up_threshold;
+        }
+    }
     tb_set_page_addr0(tb, phys_pc);
     tb_set_page_addr1(tb, -1);
     if (phys_pc != -1) {
@@ -342,6 +358,25 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
     }
 
     tcg_ctx->gen_tb = tb;
+
+    /*
+     * Translation holds the lock on page0 throughout, so vCPUs that miss
+     * on the same block are serialised here.  Once we own the lock, look
+     * again: if another vCPU has linked the block in the meantime, reuse
+     * it instead of translating it a second time only for tb_link_page()
+     * to throw ours away.
+     */
+    if (phys_pc != -1) {
+        existing_tb = tb_htable_lookup(cpu, pc, cs_base, flags, cflags);
+        if (unlikely(existing_tb)) {
+            tb_unlock_pages(tb);
+            tcg_ctx->gen_tb = NULL;
+            qatomic_set(&tcg_ctx->code_gen_ptr, (void *)tb);
+            qatomic_inc(&tb_ctx.tb_gen_dedup_count);
+            return existing_tb;
+        }
+    }
+
     tcg_ctx->addr_type = TARGET_LONG_BITS == 32 ? TCG_TYPE_I32 : TCG_TYPE_I64;
 #ifdef CONFIG_SOFTMMU
     tcg_ctx->page_bits = TARGET_PAGE_BITS;
@@ -430,6 +465,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         goto buffer_overflow;
     }
     tb->tc.size = gen_code_size;
+    trace_translate_block_done(tb, tb->icount, gen_code_size, search_size);
 
     /*
      * For CF_PCREL, attribute all executions of the generated code
@@ -570,6 +606,7 @@ TranslationBlock *tb_gen_code(CPUState *cpu,
         orig_aligned -= ROUND_UP(sizeof(*tb), qemu_icache_linesize);
         qatomic_set(&tcg_ctx->code_gen_ptr, (void *)orig_aligned);
         tcg_tb_remove(tb);
+        qatomic_inc(&tb_ctx.tb_gen_dedup_count);
         return existing_tb;
     }
     return tb;
@@ -623,6 +660,8 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
                   (void *)retaddr);
     }
     cpu_restore_state_from_tb(cpu, tb, retaddr);
+    qatomic_set(&cpu->tb_exit_stats.io_recompile,
+                cpu->tb_exit_stats.io_recompile + 1);
 
     /*
      * Some guests must re-execute the branch when re-executing a delay
@@ -665,14 +704,17 @@ void cpu_io_recompile(CPUState *cpu, uintptr_t retaddr)
  */
 void tcg_flush_jmp_cache(CPUState *cpu)
 {
-    CPUJumpCache *jc = cpu->tb_jmp_cache;
+    CPUJumpCache *jc;
+
+    RCU_READ_LOCK_GUARD();
+    jc = qatomic_rcu_read(&cpu->tb_jmp_cache);
 
     /* During early initialization, the cache may not yet be allocated. */
     if (unlikely(jc == NULL)) {
         return;
     }
 
-    for (int i = 0; i < TB_JMP_CACHE_SIZE; i++) {
+    for (size_t i = 0; i < tb_jmp_cache_size(jc); i++) {
         qatomic_set(&jc->array[i].tb, NULL);
     }
 }
@@ -46,6 +46,25 @@ static TCGOp *gen_tb_start(DisasContextBase *db, uint32_t cflags)
     TCGv_i32 count = NULL;
     TCGOp *icount_start_insn = NULL;
 
+    /*
+     * Count the executions of a first tier TB.  helper_tier_up() requests
+     * an exit, which the check against icount_decr.u32 below then takes.
+     */
+    if (db->tb->tier_up_budget) {
+        TCGv_ptr tb_ptr = tcg_constant_ptr(db->tb);
+        TCGv_i32 budget = tcg_temp_new_i32();
+        TCGLabel *cold = gen_new_label();
+
+        tcg_gen_ld_i32(budget, tb_ptr,
+                       offsetof(TranslationBlock, tier_up_budget));
+        tcg_gen_subi_i32(budget, budget, 1);
+        tcg_gen_st_i32(budget, tb_ptr,
+                       offsetof(TranslationBlock, tier_up_budget));
+        tcg_gen_brcondi_i32(TCG_COND_NE, budget, 0, cold);
+        gen_helper_tier_up(tcg_env, tb_ptr);
+        gen_set_label(cold);
+    }
+
     if ((cflags & CF_USE_ICOUNT) || !(cflags & CF_NOIRQ)) {
         count = tcg_temp_new_i32();
         tcg_gen_ld_i32(count, tcg_env,
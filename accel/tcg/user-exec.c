@@ -38,6 +38,7 @@
 #include "internal-common.h"
 #include "internal-target.h"
 #include "tb-internal.h"
+#include "tb-context.h"
 
 __thread uintptr_t helper_retaddr;
 
@@ -375,12 +376,11 @@ static bool pageflags_set_clear(target_ulong start, target_ulong last,
     merge_flags = (p_flags & ~clear_flags) | set_flags;
 
     /*
-     * Need to flush if an overlapping executable region
-     * removes exec, or adds write.
+     * Need to flush if an overlapping executable region removes exec.
+     * Adding write is handled by page_set_flags, which write-protects
+     * the pages that still hold translations instead.
      */
-    if ((p_flags & PAGE_EXEC)
-        && (!(merge_flags & PAGE_EXEC)
-            || (merge_flags & ~p_flags & PAGE_WRITE))) {
+    if ((p_flags & PAGE_EXEC) && !(merge_flags & PAGE_EXEC)) {
         inval_tb = true;
     }
 
@@ -527,7 +527,39 @@ void page_set_flags(target_ulong start, target_ulong last, int flags)
     }
     if (inval_tb) {
         tb_invalidate_phys_range(start, last);
+    } else if (flags & PAGE_WRITE) {
+        /*
+         * JITs make their code cache writable over and over, but only
+         * patch a few pages each time.  Rather than dropping all of the
+         * translations, let the write faults invalidate the pages that
+         * are actually modified.
+         */
+        tb_protect_phys_range(start, last);
+    }
+}
+
+int page_set_host_writable(target_ulong start, target_ulong last,
+                           int host_prot)
+{
+    int host_page_size = qemu_real_host_page_size();
+    PageFlagsNode *p;
+
+    assert_memory_lock();
+    for (p = pageflags_find(start, last); p;
+         p = pageflags_next(p, start, last)) {
+        target_ulong s, l;
+
+        /* page_protect() clears PAGE_WRITE for whole host pages. */
+        if (!(p->flags & PAGE_WRITE)) {
+            continue;
+        }
+        s = MAX(p->itree.start, start) & -host_page_size;
+        l = MIN(p->itree.last, last) | (host_page_size - 1);
+        if (mprotect(g2h_untagged(s), l - s + 1, host_prot) != 0) {
+            return -1;
+        }
     }
+    return 0;
 }
 
 bool page_check_range(target_ulong start, target_ulong len, int flags)
@@ -615,6 +647,21 @@ bool page_check_range_empty(target_ulong start, target_ulong last)
     return pageflags_find(start, last) == NULL;
 }
 
+bool page_check_range_any(target_ulong start, target_ulong last, int flags)
+{
+    PageFlagsNode *p;
+
+    assert(last >= start);
+    assert_memory_lock();
+    for (p = pageflags_find(start, last); p;
+         p = pageflags_next(p, start, last)) {
+        if (p->flags & flags) {
+            return true;
+        }
+    }
+    return false;
+}
+
 target_ulong page_find_range_empty(target_ulong min, target_ulong max,
                                    target_ulong len, target_ulong align)
 {
@@ -1315,9 +1362,13 @@ uint64_t cpu_ldq_code_mmu(CPUArchState *env, abi_ptr addr,
 
 /*
  * Do not allow unaligned operations to proceed.  Return the host address.
+ *
+ * If @wsize is not NULL, an unaligned operation that fits within the
+ * naturally aligned host word of atomic_widen_size() bytes proceeds
+ * instead: return the host address of that word and its size in @wsize.
  */
 static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
-                               int size, uintptr_t retaddr)
+                               int size, int *wsize, uintptr_t retaddr)
 {
     MemOp mop = get_memop(oi);
     int a_bits = memop_alignment_bits(mop);
@@ -1328,9 +1379,16 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
         cpu_loop_exit_sigbus(cpu, addr, MMU_DATA_STORE, retaddr);
     }
 
-    /* Enforce qemu required alignment.  */
+    /* Enforce qemu required alignment, or widen the access.  */
     if (unlikely(addr & (size - 1))) {
-        cpu_loop_exit_atomic(cpu, retaddr);
+        int widen = wsize ? atomic_widen_size(addr, size) : 0;
+
+        if (!widen) {
+            qatomic_inc(&tb_ctx.tb_atomic_unaligned_count);
+            cpu_loop_exit_atomic(cpu, retaddr);
+        }
+        *wsize = widen;
+        addr &= -(vaddr)widen;
     }
 
     ret = g2h(cpu, addr);
@@ -1338,8 +1396,6 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     return ret;
 }
 
-#include "atomic_common.c.inc"
-
 /*
  * First set of functions passes in OI and RETADDR.
  * This makes them callable from other helpers.
@@ -1349,6 +1405,8 @@ static void *atomic_mmu_lookup(CPUState *cpu, vaddr addr, MemOpIdx oi,
     glue(glue(glue(cpu_atomic_ ## X, SUFFIX), END), _mmu)
 #define ATOMIC_MMU_CLEANUP do { clear_helper_retaddr(); } while (0)
 
+#include "atomic_common.c.inc"
+
 #define DATA_SIZE 1
 #include "atomic_template.h"
 
@@ -221,6 +221,74 @@ static void host_memory_backend_set_dump(Object *obj, bool value, Error **errp)
     backend->dump = value;
 }
 
+/*
+ * Without an explicit prealloc-context, create the preallocation threads on
+ * the CPUs of the host nodes the memory is bound to, so that pages are
+ * zeroed by CPUs local to them.  Having a context also allows preallocation
+ * to run asynchronously.  Return NULL if no such context can be created.
+ */
+static ThreadContext *
+host_memory_backend_auto_prealloc_context(HostMemoryBackend *backend)
+{
+#ifdef CONFIG_NUMA
+    g_autoptr(GString) nodes = g_string_new(NULL);
+    Error *local_err = NULL;
+    unsigned long node;
+    Object *tc;
+
+    if (backend->policy == HOST_MEM_POLICY_DEFAULT) {
+        return NULL;
+    }
+
+    node = find_first_bit(backend->host_nodes, MAX_NODES);
+    while (node < MAX_NODES) {
+        g_string_append_printf(nodes, "%s%lu", nodes->len ? "," : "", node);
+        node = find_next_bit(backend->host_nodes, MAX_NODES, node + 1);
+    }
+    if (!nodes->len) {
+        return NULL;
+    }
+
+    tc = object_new(TYPE_THREAD_CONTEXT);
+    object_property_add_child(OBJECT(backend), "prealloc-context-auto", tc);
+    object_unref(tc);
+    if (!object_property_parse(tc, "node-affinity", nodes->str, &local_err) ||
+        !user_creatable_complete(USER_CREATABLE(tc), &local_err)) {
+        /* E.g. memory-only nodes; fall back to threads without affinity */
+        error_free(local_err);
+        object_unparent(tc);
+        return NULL;
+    }
+    return THREAD_CONTEXT(tc);
+#else
+    return NULL;
+#endif
+}
+
+static bool host_memory_backend_prealloc(HostMemoryBackend *backend,
+                                         bool async, Error **errp)
+{
+    int fd = memory_region_get_fd(&backend->mr);
+    void *ptr = memory_region_get_ram_ptr(&backend->mr);
+    uint64_t sz = memory_region_size(&backend->mr);
+    ThreadContext *tc = backend->prealloc_context;
+    ThreadContext *auto_tc = NULL;
+    bool ret;
+
+    if (!tc) {
+        tc = auto_tc = host_memory_backend_auto_prealloc_context(backend);
+    }
+
+    ret = qemu_prealloc_mem(fd, ptr, sz, backend->prealloc_threads, tc,
+                            async, errp);
+
+    /* The threads are created by now, they keep the affinity of the context */
+    if (auto_tc) {
+        object_unparent(OBJECT(auto_tc));
+    }
+    return ret;
+}
+
 static bool host_memory_backend_get_prealloc(Object *obj, Error **errp)
 {
     HostMemoryBackend *backend = MEMORY_BACKEND(obj);
@@ -244,12 +312,7 @@ static void host_memory_backend_set_prealloc(Object *obj, bool value,
     }
 
     if (value && !backend->prealloc) {
-        int fd = memory_region_get_fd(&backend->mr);
-        void *ptr = memory_region_get_ram_ptr(&backend->mr);
-        uint64_t sz = memory_region_size(&backend->mr);
-
-        if (!qemu_prealloc_mem(fd, ptr, sz, backend->prealloc_threads,
-                               backend->prealloc_context, false, errp)) {
+        if (!host_memory_backend_prealloc(backend, false, errp)) {
             return;
         }
         backend->prealloc = true;
@@ -422,11 +485,8 @@ host_memory_backend_memory_complete(UserCreatable *uc, Error **errp)
      * This is necessary to guarantee memory is allocated with
      * specified NUMA policy in place.
      */
-    if (backend->prealloc && !qemu_prealloc_mem(memory_region_get_fd(&backend->mr),
-                                                ptr, sz,
-                                                backend->prealloc_threads,
-                                                backend->prealloc_context,
-                                                async, errp)) {
+    if (backend->prealloc && !host_memory_backend_prealloc(backend, async,
+                                                           errp)) {
         return;
     }
 }
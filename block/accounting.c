@@ -278,6 +278,20 @@ void block_acct_merge_done(BlockAcctStats *stats, enum BlockAcctType type,
     qemu_mutex_unlock(&stats->lock);
 }
 
+/* The clock that block accounting uses for latencies */
+int64_t block_acct_clock_ns(void)
+{
+    return qemu_clock_get_ns(clock_type);
+}
+
+void block_log2_histogram_account(BlockLog2Histogram *hist,
+                                  int64_t latency_ns)
+{
+    unsigned bin = latency_ns > 0 ? 64 - clz64(latency_ns) : 0;
+
+    stat64_add(&hist->bins[MIN(bin, BLOCK_LOG2_HISTOGRAM_NBINS - 1)], 1);
+}
+
 int64_t block_acct_idle_time_ns(BlockAcctStats *stats)
 {
     return qemu_clock_get_ns(clock_type) - stats->last_access_time_ns;
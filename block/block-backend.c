@@ -1633,6 +1633,73 @@ static void coroutine_fn blk_aio_write_entry(void *opaque)
     blk_aio_complete(acb);
 }
 
+/*
+ * Try to complete a read or write without creating a coroutine, if the
+ * drivers below @blk can do it without waiting.  Return NULL if the request
+ * must go through blk_aio_prwv() instead.
+ */
+static BlockAIOCB *blk_aio_prwv_nowait(BlockBackend *blk, int64_t offset,
+                                       QEMUIOVector *qiov, bool is_write,
+                                       BdrvRequestFlags flags,
+                                       BlockCompletionFunc *cb, void *opaque)
+{
+    BlkAioEmAIOCB *acb;
+    BlockDriverState *bs;
+    int ret;
+
+    if (flags || offset < 0 ||
+        blk->public.throttle_group_member.throttle_state ||
+        (is_write && !blk->enable_write_cache)) {
+        return NULL;
+    }
+
+    /*
+     * Once blk->in_flight is raised and the BlockBackend is not quiesced,
+     * a drained section, and with it any graph change, waits for us.  This
+     * is what stands in for the graph reader lock below.
+     */
+    blk_inc_in_flight(blk);
+    if (qatomic_read(&blk->quiesce_counter)) {
+        goto fallback;
+    }
+
+    bs = blk_bs(blk);
+    if (!bs || blk_dev_is_tray_open(blk)) {
+        goto fallback;
+    }
+
+    assume_graph_lock();
+    if (is_write) {
+        ret = bdrv_try_pwritev_nowait(blk->root, offset, qiov->size, qiov);
+    } else {
+        ret = bdrv_try_preadv_nowait(blk->root, offset, qiov->size, qiov);
+    }
+    if (ret == -EAGAIN) {
+        goto fallback;
+    }
+
+    trace_blk_aio_prwv_nowait(blk, bs, offset, qiov->size, is_write, ret);
+
+    acb = blk_aio_get(&blk_aio_em_aiocb_info, blk, cb, opaque);
+    acb->rwco = (BlkRwCo) {
+        .blk    = blk,
+        .offset = offset,
+        .iobuf  = qiov,
+        .ret    = ret,
+    };
+    acb->bytes = qiov->size;
+    acb->has_returned = true;
+
+    /* Like blk_aio_prwv(), never call @cb before returning */
+    replay_bh_schedule_oneshot_event(qemu_get_current_aio_context(),
+                                     blk_aio_complete_bh, acb);
+    return &acb->common;
+
+fallback:
+    blk_dec_in_flight(blk);
+    return NULL;
+}
+
 BlockAIOCB *blk_aio_pwrite_zeroes(BlockBackend *blk, int64_t offset,
                                   int64_t bytes, BdrvRequestFlags flags,
                                   BlockCompletionFunc *cb, void *opaque)
@@ -1707,8 +1774,14 @@ BlockAIOCB *blk_aio_preadv(BlockBackend *blk, int64_t offset,
                            QEMUIOVector *qiov, BdrvRequestFlags flags,
                            BlockCompletionFunc *cb, void *opaque)
 {
+    BlockAIOCB *acb;
     IO_CODE();
+
     assert((uint64_t)qiov->size <= INT64_MAX);
+    acb = blk_aio_prwv_nowait(blk, offset, qiov, false, flags, cb, opaque);
+    if (acb) {
+        return acb;
+    }
     return blk_aio_prwv(blk, offset, qiov->size, qiov,
                         blk_aio_read_entry, flags, cb, opaque);
 }
@@ -1717,8 +1790,14 @@ BlockAIOCB *blk_aio_pwritev(BlockBackend *blk, int64_t offset,
                             QEMUIOVector *qiov, BdrvRequestFlags flags,
                             BlockCompletionFunc *cb, void *opaque)
 {
+    BlockAIOCB *acb;
     IO_CODE();
+
     assert((uint64_t)qiov->size <= INT64_MAX);
+    acb = blk_aio_prwv_nowait(blk, offset, qiov, true, flags, cb, opaque);
+    if (acb) {
+        return acb;
+    }
     return blk_aio_prwv(blk, offset, qiov->size, qiov,
                         blk_aio_write_entry, flags, cb, opaque);
 }
@@ -36,6 +36,14 @@
 #define BLOCK_COPY_SLICE_TIME 100000000ULL /* ns */
 #define BLOCK_COPY_CLUSTER_SIZE_DEFAULT (1 << 16)
 
+/*
+ * Adaptive calls back off once the copy time per MiB exceeds the best
+ * average seen so far by this factor (in percent), and probe for more
+ * throughput while it stays below the second one.
+ */
+#define BLOCK_COPY_ADAPT_BACKOFF_PCT 200
+#define BLOCK_COPY_ADAPT_PROBE_PCT 125
+
 typedef enum {
     COPY_READ_WRITE_CLUSTER,
     COPY_READ_WRITE,
@@ -53,6 +61,8 @@ typedef struct BlockCopyCallState {
     int64_t bytes;
     int max_workers;
     int64_t max_chunk;
+    /* Adapt workers and chunk size below the maximums, see block_copy_adapt */
+    bool adaptive;
     bool ignore_ratelimit;
     BlockCopyAsyncCallbackFunc cb;
     void *cb_opaque;
@@ -140,6 +150,17 @@ typedef struct BlockCopyState {
     bool discard_source;
     BlockReqList reqs;
     QLIST_HEAD(, BlockCopyCallState) calls;
+    /*
+     * State of block_copy_adapt() for adaptive calls.  Kept here rather than
+     * in the call state so that a retried call starts where the last one
+     * left off.  @adapt_workers and @adapt_chunk are also read atomically
+     * without lock by block_copy_get_adaptive_limits().
+     */
+    int adapt_workers;
+    int64_t adapt_chunk;
+    int64_t adapt_avg_ns_per_mib;
+    int64_t adapt_best_ns_per_mib;
+    int adapt_samples;
     /*
      * skip_unallocated:
      *
@@ -194,6 +215,9 @@ block_copy_task_create(BlockCopyState *s, BlockCopyCallState *call_state,
 
     QEMU_LOCK_GUARD(&s->lock);
     max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), call_state->max_chunk);
+    if (call_state->adaptive) {
+        max_chunk = MIN_NON_ZERO(max_chunk, s->adapt_chunk);
+    }
     if (!bdrv_dirty_bitmap_next_dirty_area(s->copy_bitmap,
                                            offset, offset + bytes,
                                            max_chunk, &offset, &bytes))
@@ -431,6 +455,8 @@ BlockCopyState *block_copy_state_new(BdrvChild *source, BdrvChild *target,
         .len = bdrv_dirty_bitmap_size(copy_bitmap),
         .write_flags = (is_fleecing ? BDRV_REQ_SERIALISING : 0),
         .mem = shres_create(BLOCK_COPY_MAX_MEM),
+        /* Adaptive calls start with one worker and grow from there */
+        .adapt_workers = 1,
         .max_transfer = QEMU_ALIGN_DOWN(
                                     block_copy_max_transfer(source, target),
                                     cluster_size),
@@ -578,12 +604,68 @@ block_copy_do_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
     return ret;
 }
 
+/*
+ * Called with lock held after a task of an adaptive call copied @bytes in
+ * @ns nanoseconds.
+ *
+ * The copy time per MiB grows when the source or target saturate, and when
+ * guest I/O competes with the copy.  Once per round of as many tasks as may
+ * run in parallel, halve the number of workers and the chunk size while its
+ * average is far above the best one seen, and probe for more throughput,
+ * first with bigger chunks and then with more workers, while it is close.
+ */
+static void block_copy_adapt(BlockCopyState *s, BlockCopyCallState *cs,
+                             int64_t bytes, int64_t ns)
+{
+    int64_t ns_per_mib = ns * MiB / bytes;
+    int64_t max_chunk = MIN_NON_ZERO(block_copy_chunk_size(s), cs->max_chunk);
+    int workers = s->adapt_workers;
+    int64_t chunk = MIN_NON_ZERO(s->adapt_chunk, max_chunk);
+
+    s->adapt_avg_ns_per_mib = s->adapt_avg_ns_per_mib ?
+        (s->adapt_avg_ns_per_mib * 7 + ns_per_mib) / 8 : ns_per_mib;
+
+    if (++s->adapt_samples < workers) {
+        return;
+    }
+    s->adapt_samples = 0;
+
+    if (!s->adapt_best_ns_per_mib ||
+        s->adapt_avg_ns_per_mib < s->adapt_best_ns_per_mib) {
+        s->adapt_best_ns_per_mib = s->adapt_avg_ns_per_mib;
+    } else {
+        /* Forget the best time slowly, the backends may have changed */
+        s->adapt_best_ns_per_mib +=
+            (s->adapt_avg_ns_per_mib - s->adapt_best_ns_per_mib) / 16;
+    }
+
+    if (s->adapt_avg_ns_per_mib * 100 >
+        s->adapt_best_ns_per_mib * BLOCK_COPY_ADAPT_BACKOFF_PCT) {
+        workers = MAX(workers / 2, 1);
+        chunk = MAX(QEMU_ALIGN_DOWN(chunk / 2, s->cluster_size),
+                    s->cluster_size);
+    } else if (s->adapt_avg_ns_per_mib * 100 <
+               s->adapt_best_ns_per_mib * BLOCK_COPY_ADAPT_PROBE_PCT) {
+        if (chunk < max_chunk) {
+            chunk = MIN(chunk * 2, max_chunk);
+        } else if (workers < cs->max_workers) {
+            workers++;
+        }
+    }
+
+    trace_block_copy_adapt(s, s->adapt_avg_ns_per_mib,
+                           s->adapt_best_ns_per_mib, workers, chunk);
+    qatomic_set(&s->adapt_workers, workers);
+    qatomic_set(&s->adapt_chunk, chunk);
+}
+
 static coroutine_fn int block_copy_task_entry(AioTask *task)
 {
     BlockCopyTask *t = container_of(task, BlockCopyTask, task);
     BlockCopyState *s = t->s;
     bool error_is_read = false;
     BlockCopyMethod method = t->method;
+    int64_t start_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
     int ret = -1;
 
     WITH_GRAPH_RDLOCK_GUARD() {
@@ -604,6 +686,14 @@ static coroutine_fn int block_copy_task_entry(AioTask *task)
         } else if (s->progress) {
             progress_work_done(s->progress, t->req.bytes);
         }
+
+        /* Zero writes say nothing about the load of the backends */
+        if (ret == 0 && t->call_state->adaptive &&
+            t->method != COPY_WRITE_ZEROES) {
+            block_copy_adapt(s, t->call_state, t->req.bytes,
+                             qemu_clock_get_ns(QEMU_CLOCK_REALTIME) -
+                             start_ns);
+        }
     }
     co_put_to_shres(s->mem, t->req.bytes);
     block_copy_task_end(t, ret);
@@ -824,6 +914,11 @@ block_copy_dirty_clusters(BlockCopyCallState *call_state)
         if (!aio && bytes) {
             aio = aio_task_pool_new(call_state->max_workers);
         }
+        if (aio && call_state->adaptive) {
+            aio_task_pool_set_max_busy_tasks(aio,
+                    MIN(qatomic_read(&s->adapt_workers),
+                        call_state->max_workers));
+        }
 
         ret = block_copy_task_run(aio, task);
         if (ret < 0) {
@@ -972,6 +1067,7 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t start, int64_t bytes,
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque)
 {
@@ -983,6 +1079,7 @@ BlockCopyCallState *block_copy_async(BlockCopyState *s,
         .bytes = bytes,
         .max_workers = max_workers,
         .max_chunk = max_chunk,
+        .adaptive = adaptive,
         .cb = cb,
         .cb_opaque = cb_opaque,
 
@@ -1057,6 +1154,13 @@ int64_t block_copy_cluster_size(BlockCopyState *s)
     return s->cluster_size;
 }
 
+void block_copy_get_adaptive_limits(BlockCopyState *s, int *workers,
+                                    int64_t *chunk)
+{
+    *workers = qatomic_read(&s->adapt_workers);
+    *chunk = qatomic_read(&s->adapt_chunk);
+}
+
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip)
 {
     qatomic_set(&s->skip_unallocated, skip);
@@ -22,6 +22,7 @@
 
 #include "block/block_int.h"
 #include "block/qdict.h"
+#include "block/thread-pool.h"
 #include "system/block-backend.h"
 #include "crypto/block.h"
 #include "qapi/opts-visitor.h"
@@ -466,6 +467,96 @@ static int block_crypto_reopen_prepare(BDRVReopenState *state,
  */
 #define BLOCK_CRYPTO_MAX_IO_SIZE (1024 * 1024)
 
+/*
+ * Larger buffers are split into slices of this size that are encrypted
+ * or decrypted in parallel on the thread pool.  Below that, handing the
+ * work to another thread costs more than the cipher itself.
+ */
+#define BLOCK_CRYPTO_SLICE_SIZE (64 * 1024)
+
+typedef int BlockCryptoEncDecFunc(QCryptoBlock *block, uint64_t offset,
+                                  uint8_t *buf, size_t len, Error **errp);
+
+typedef struct BlockCryptoEncDec {
+    QCryptoBlock *block;
+    BlockCryptoEncDecFunc *func;
+    Coroutine *co;
+    unsigned int in_flight;
+    int ret;
+} BlockCryptoEncDec;
+
+typedef struct BlockCryptoEncDecSlice {
+    BlockCryptoEncDec *encdec;
+    uint64_t offset;
+    uint8_t *buf;
+    size_t len;
+} BlockCryptoEncDecSlice;
+
+static int block_crypto_encdec_pool_func(void *opaque)
+{
+    BlockCryptoEncDecSlice *slice = opaque;
+    BlockCryptoEncDec *encdec = slice->encdec;
+
+    return encdec->func(encdec->block, slice->offset, slice->buf, slice->len,
+                        NULL);
+}
+
+static void block_crypto_encdec_cb(void *opaque, int ret)
+{
+    BlockCryptoEncDecSlice *slice = opaque;
+    BlockCryptoEncDec *encdec = slice->encdec;
+
+    if (ret < 0) {
+        encdec->ret = -EIO;
+    }
+    if (--encdec->in_flight == 0) {
+        aio_co_wake(encdec->co);
+    }
+}
+
+/*
+ * Encrypt or decrypt @len bytes of @buf, starting at guest offset
+ * @offset, with @func.  The sectors are independent of each other, so a
+ * large buffer is processed in slices on several pool threads at once.
+ */
+static int coroutine_fn
+block_crypto_co_encdec(QCryptoBlock *block, uint64_t offset, uint8_t *buf,
+                       size_t len, BlockCryptoEncDecFunc *func)
+{
+    BlockCryptoEncDec encdec = {
+        .block = block,
+        .func = func,
+        .co = qemu_coroutine_self(),
+    };
+    BlockCryptoEncDecSlice slices[BLOCK_CRYPTO_MAX_IO_SIZE /
+                                  BLOCK_CRYPTO_SLICE_SIZE];
+    size_t done;
+    int i;
+
+    assert(len <= BLOCK_CRYPTO_MAX_IO_SIZE);
+    if (len <= BLOCK_CRYPTO_SLICE_SIZE) {
+        return func(block, offset, buf, len, NULL) < 0 ? -EIO : 0;
+    }
+
+    for (i = 0, done = 0; done < len; i++, done += BLOCK_CRYPTO_SLICE_SIZE) {
+        slices[i] = (BlockCryptoEncDecSlice) {
+            .encdec = &encdec,
+            .offset = offset + done,
+            .buf = buf + done,
+            .len = MIN(len - done, BLOCK_CRYPTO_SLICE_SIZE),
+        };
+        encdec.in_flight++;
+        thread_pool_submit_aio(block_crypto_encdec_pool_func, &slices[i],
+                               block_crypto_encdec_cb, &slices[i]);
+    }
+
+    /* The completion callbacks run in this AioContext */
+    qemu_coroutine_yield();
+    assert(encdec.in_flight == 0);
+
+    return encdec.ret;
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
                        QEMUIOVector *qiov, BdrvRequestFlags flags)
@@ -508,9 +599,10 @@ block_crypto_co_preadv(BlockDriverState *bs, int64_t offset, int64_t bytes,
             goto cleanup;
         }
 
-        if (qcrypto_block_decrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(crypto->block, offset + bytes_done,
+                                     cipher_data, cur_bytes,
+                                     qcrypto_block_decrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -565,9 +657,10 @@ block_crypto_co_pwritev(BlockDriverState *bs, int64_t offset, int64_t bytes,
 
         qemu_iovec_to_buf(qiov, bytes_done, cipher_data, cur_bytes);
 
-        if (qcrypto_block_encrypt(crypto->block, offset + bytes_done,
-                                  cipher_data, cur_bytes, NULL) < 0) {
-            ret = -EIO;
+        ret = block_crypto_co_encdec(crypto->block, offset + bytes_done,
+                                     cipher_data, cur_bytes,
+                                     qcrypto_block_encrypt);
+        if (ret < 0) {
             goto cleanup;
         }
 
@@ -28,7 +28,9 @@
 #include "qapi/error.h"
 #include "qapi/qapi-commands-block.h"
 #include "qemu/main-loop.h"
+#include "qemu/coroutine.h"
 #include "system/block-backend.h"
+#include "system/iothread.h"
 
 #include <fuse.h>
 #include <fuse_lowlevel.h>
@@ -49,10 +51,17 @@ typedef struct FuseExport {
     BlockExport common;
 
     struct fuse_session *fuse_session;
-    struct fuse_buf fuse_buf;
     unsigned int in_flight; /* atomic */
     bool mounted, fd_handler_set_up;
 
+    /*
+     * The AioContexts of the "iothreads" option, if any, with a reference
+     * held to each IOThread in @iothreads
+     */
+    IOThread **iothreads;
+    AioContext **iothread_ctxs;
+    size_t nr_iothread_ctxs;
+
     char *mountpoint;
     bool writable;
     bool growable;
@@ -64,6 +73,12 @@ typedef struct FuseExport {
     gid_t st_gid;
 } FuseExport;
 
+/* A request read from the FUSE session, processed in its own coroutine */
+typedef struct FuseRequest {
+    FuseExport *exp;
+    struct fuse_buf buf;
+} FuseRequest;
+
 static GHashTable *exports;
 static const struct fuse_lowlevel_ops fuse_ops;
 
@@ -79,14 +94,32 @@ static void read_from_fuse_export(void *opaque);
 static bool is_regular_file(const char *path, Error **errp);
 
 
+/**
+ * Start or stop monitoring the FUSE session FD in all AioContexts that
+ * process requests.
+ */
+static void fuse_export_set_fd_handlers(FuseExport *exp, bool enable)
+{
+    IOHandler *handler = enable ? read_from_fuse_export : NULL;
+    int fd = fuse_session_fd(exp->fuse_session);
+    size_t i;
+
+    if (!exp->nr_iothread_ctxs) {
+        aio_set_fd_handler(exp->common.ctx, fd, handler, NULL, NULL, NULL,
+                           enable ? exp : NULL);
+    }
+    for (i = 0; i < exp->nr_iothread_ctxs; i++) {
+        aio_set_fd_handler(exp->iothread_ctxs[i], fd, handler, NULL, NULL,
+                           NULL, enable ? exp : NULL);
+    }
+    exp->fd_handler_set_up = enable;
+}
+
 static void fuse_export_drained_begin(void *opaque)
 {
     FuseExport *exp = opaque;
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session),
-                       NULL, NULL, NULL, NULL, NULL);
-    exp->fd_handler_set_up = false;
+    fuse_export_set_fd_handlers(exp, false);
 }
 
 static void fuse_export_drained_end(void *opaque)
@@ -96,10 +129,7 @@ static void fuse_export_drained_end(void *opaque)
     /* Refresh AioContext in case it changed */
     exp->common.ctx = blk_get_aio_context(exp->common.blk);
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session),
-                       read_from_fuse_export, NULL, NULL, NULL, exp);
-    exp->fd_handler_set_up = true;
+    fuse_export_set_fd_handlers(exp, true);
 }
 
 static bool fuse_export_drained_poll(void *opaque)
@@ -115,16 +145,54 @@ static const BlockDevOps fuse_export_blk_dev_ops = {
     .drained_poll  = fuse_export_drained_poll,
 };
 
+static void fuse_export_free_iothreads(FuseExport *exp)
+{
+    size_t i;
+
+    for (i = 0; i < exp->nr_iothread_ctxs; i++) {
+        if (exp->iothreads[i]) {
+            object_unref(OBJECT(exp->iothreads[i]));
+        }
+    }
+    g_free(exp->iothreads);
+    g_free(exp->iothread_ctxs);
+    exp->iothreads = NULL;
+    exp->iothread_ctxs = NULL;
+    exp->nr_iothread_ctxs = 0;
+}
+
 static int fuse_export_create(BlockExport *blk_exp,
                               BlockExportOptions *blk_exp_args,
                               Error **errp)
 {
     FuseExport *exp = container_of(blk_exp, FuseExport, common);
     BlockExportOptionsFuse *args = &blk_exp_args->u.fuse;
+    strList *iothreads;
+    size_t i;
     int ret;
 
     assert(blk_exp_args->type == BLOCK_EXPORT_TYPE_FUSE);
 
+    for (iothreads = args->iothreads; iothreads; iothreads = iothreads->next) {
+        exp->nr_iothread_ctxs++;
+    }
+    exp->iothreads = g_new0(IOThread *, exp->nr_iothread_ctxs);
+    exp->iothread_ctxs = g_new0(AioContext *, exp->nr_iothread_ctxs);
+    for (i = 0, iothreads = args->iothreads; iothreads;
+         i++, iothreads = iothreads->next)
+    {
+        IOThread *iothread = iothread_by_id(iothreads->value);
+
+        if (!iothread) {
+            error_setg(errp, "iothread \"%s\" not found", iothreads->value);
+            fuse_export_free_iothreads(exp);
+            return -EINVAL;
+        }
+        object_ref(OBJECT(iothread));
+        exp->iothreads[i] = iothread;
+        exp->iothread_ctxs[i] = iothread_get_aio_context(iothread);
+    }
+
     /* For growable and writable exports, take the RESIZE permission */
     if (args->growable || blk_exp_args->writable) {
         uint64_t blk_perm, blk_shared_perm;
@@ -134,6 +202,7 @@ static int fuse_export_create(BlockExport *blk_exp,
         ret = blk_set_perm(exp->common.blk, blk_perm | BLK_PERM_RESIZE,
                            blk_shared_perm, errp);
         if (ret < 0) {
+            fuse_export_free_iothreads(exp);
             return ret;
         }
     }
@@ -269,10 +338,19 @@ static int setup_fuse_export(FuseExport *exp, const char *mountpoint,
 
     g_hash_table_insert(exports, g_strdup(mountpoint), NULL);
 
-    aio_set_fd_handler(exp->common.ctx,
-                       fuse_session_fd(exp->fuse_session),
-                       read_from_fuse_export, NULL, NULL, NULL, exp);
-    exp->fd_handler_set_up = true;
+    /*
+     * Several threads may be woken up for the same request, the ones that
+     * lose the race must not block
+     */
+    if (!g_unix_set_fd_nonblocking(fuse_session_fd(exp->fuse_session), true,
+                                   NULL)) {
+        ret = -errno;
+        error_setg_errno(errp, -ret, "Failed to make FUSE session FD "
+                         "non-blocking");
+        goto fail;
+    }
+
+    fuse_export_set_fd_handlers(exp, true);
 
     return 0;
 
@@ -281,6 +359,32 @@ fail:
     return ret;
 }
 
+static void fuse_export_dec_in_flight(FuseExport *exp)
+{
+    if (qatomic_fetch_dec(&exp->in_flight) == 1) {
+        aio_wait_kick(); /* wake AIO_WAIT_WHILE() */
+    }
+
+    blk_exp_unref(&exp->common);
+}
+
+/**
+ * Let libfuse call the request handlers.  They may yield while doing I/O,
+ * so that the next requests can be read in the meantime.
+ */
+static void coroutine_fn fuse_co_process_request(void *opaque)
+{
+    FuseRequest *fuse_req = opaque;
+    FuseExport *exp = fuse_req->exp;
+
+    fuse_session_process_buf(exp->fuse_session, &fuse_req->buf);
+
+    free(fuse_req->buf.mem);
+    g_free(fuse_req);
+
+    fuse_export_dec_in_flight(exp);
+}
+
 /**
  * Callback to be invoked when the FUSE session FD can be read from.
  * (This is basically the FUSE event loop.)
@@ -288,27 +392,31 @@ fail:
 static void read_from_fuse_export(void *opaque)
 {
     FuseExport *exp = opaque;
+    FuseRequest *fuse_req;
+    Coroutine *co;
     int ret;
 
     blk_exp_ref(&exp->common);
 
     qatomic_inc(&exp->in_flight);
 
+    /* Every request needs its own buffer, libfuse allocates it */
+    fuse_req = g_new0(FuseRequest, 1);
+    fuse_req->exp = exp;
+
     do {
-        ret = fuse_session_receive_buf(exp->fuse_session, &exp->fuse_buf);
+        ret = fuse_session_receive_buf(exp->fuse_session, &fuse_req->buf);
     } while (ret == -EINTR);
-    if (ret < 0) {
-        goto out;
-    }
-
-    fuse_session_process_buf(exp->fuse_session, &exp->fuse_buf);
-
-out:
-    if (qatomic_fetch_dec(&exp->in_flight) == 1) {
-        aio_wait_kick(); /* wake AIO_WAIT_WHILE() */
+    if (ret <= 0) {
+        /* -EAGAIN if another thread got the request */
+        free(fuse_req->buf.mem);
+        g_free(fuse_req);
+        fuse_export_dec_in_flight(exp);
+        return;
     }
 
-    blk_exp_unref(&exp->common);
+    co = qemu_coroutine_create(fuse_co_process_request, fuse_req);
+    qemu_coroutine_enter(co);
 }
 
 static void fuse_export_shutdown(BlockExport *blk_exp)
@@ -319,10 +427,7 @@ static void fuse_export_shutdown(BlockExport *blk_exp)
         fuse_session_exit(exp->fuse_session);
 
         if (exp->fd_handler_set_up) {
-            aio_set_fd_handler(exp->common.ctx,
-                               fuse_session_fd(exp->fuse_session),
-                               NULL, NULL, NULL, NULL, NULL);
-            exp->fd_handler_set_up = false;
+            fuse_export_set_fd_handlers(exp, false);
         }
     }
 
@@ -347,7 +452,7 @@ static void fuse_export_delete(BlockExport *blk_exp)
         fuse_session_destroy(exp->fuse_session);
     }
 
-    free(exp->fuse_buf.mem);
+    fuse_export_free_iothreads(exp);
     g_free(exp->mountpoint);
 }
 
@@ -403,8 +508,8 @@ static void fuse_lookup(fuse_req_t req, fuse_ino_t parent, const char *name)
 /**
  * Let clients get file attributes (i.e., stat() the file).
  */
-static void fuse_getattr(fuse_req_t req, fuse_ino_t inode,
-                         struct fuse_file_info *fi)
+static void coroutine_fn fuse_getattr(fuse_req_t req, fuse_ino_t inode,
+                                      struct fuse_file_info *fi)
 {
     struct stat statbuf;
     int64_t length, allocated_blocks;
@@ -417,7 +522,10 @@ static void fuse_getattr(fuse_req_t req, fuse_ino_t inode,
         return;
     }
 
-    allocated_blocks = bdrv_get_allocated_file_size(blk_bs(exp->common.blk));
+    WITH_GRAPH_RDLOCK_GUARD() {
+        allocated_blocks =
+            bdrv_co_get_allocated_file_size(blk_bs(exp->common.blk));
+    }
     if (allocated_blocks <= 0) {
         allocated_blocks = DIV_ROUND_UP(length, 512);
     } else {
@@ -458,8 +566,11 @@ static int fuse_do_truncate(const FuseExport *exp, int64_t size,
 
     if (add_resize_perm) {
 
-        if (!qemu_in_main_thread()) {
-            /* Changing permissions like below only works in the main thread */
+        if (!qemu_in_main_thread() || qemu_in_coroutine()) {
+            /*
+             * Changing permissions like below only works in the main thread,
+             * outside of coroutines
+             */
             return -EPERM;
         }
 
@@ -493,8 +604,9 @@ static int fuse_do_truncate(const FuseExport *exp, int64_t size,
  * without allow_other cannot be given a different UID or GID, and
  * they cannot be given non-owner access.
  */
-static void fuse_setattr(fuse_req_t req, fuse_ino_t inode, struct stat *statbuf,
-                         int to_set, struct fuse_file_info *fi)
+static void coroutine_fn fuse_setattr(fuse_req_t req, fuse_ino_t inode,
+                                      struct stat *statbuf, int to_set,
+                                      struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
     int supported_attrs;
@@ -796,8 +908,9 @@ static void fuse_flush(fuse_req_t req, fuse_ino_t inode,
 /**
  * Let clients inquire allocation status.
  */
-static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
-                       int whence, struct fuse_file_info *fi)
+static void coroutine_fn fuse_lseek(fuse_req_t req, fuse_ino_t inode,
+                                    off_t offset, int whence,
+                                    struct fuse_file_info *fi)
 {
     FuseExport *exp = fuse_req_userdata(req);
 
@@ -810,8 +923,11 @@ static void fuse_lseek(fuse_req_t req, fuse_ino_t inode, off_t offset,
         int64_t pnum;
         int ret;
 
-        ret = bdrv_block_status_above(blk_bs(exp->common.blk), NULL,
-                                      offset, INT64_MAX, &pnum, NULL, NULL);
+        WITH_GRAPH_RDLOCK_GUARD() {
+            ret = bdrv_co_block_status_above(blk_bs(exp->common.blk), NULL,
+                                             offset, INT64_MAX, &pnum, NULL,
+                                             NULL);
+        }
         if (ret < 0) {
             fuse_reply_err(req, -ret);
             return;
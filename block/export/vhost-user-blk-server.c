@@ -18,6 +18,7 @@
 #include "vhost-user-blk-server.h"
 #include "qapi/error.h"
 #include "qom/object_interfaces.h"
+#include "system/iothread.h"
 #include "util/block-helpers.h"
 #include "virtio-blk-handler.h"
 
@@ -38,8 +39,28 @@ typedef struct {
     VirtioBlkHandler handler;
     QIOChannelSocket *sioc;
     struct virtio_blk_config blkcfg;
+    /* The "iothreads" option, with a reference held to each IOThread */
+    IOThread **queue_iothreads;
+    AioContext **queue_ctxs;
+    unsigned int nr_queue_ctxs;
 } VuBlkExport;
 
+static void vu_blk_exp_free_queue_ctxs(VuBlkExport *vexp)
+{
+    unsigned int i;
+
+    for (i = 0; i < vexp->nr_queue_ctxs; i++) {
+        if (vexp->queue_iothreads[i]) {
+            object_unref(OBJECT(vexp->queue_iothreads[i]));
+        }
+    }
+    g_free(vexp->queue_iothreads);
+    g_free(vexp->queue_ctxs);
+    vexp->queue_iothreads = NULL;
+    vexp->queue_ctxs = NULL;
+    vexp->nr_queue_ctxs = 0;
+}
+
 static void vu_blk_req_complete(VuBlkReq *req, size_t in_len)
 {
     VuDev *vu_dev = &req->server->vu_dev;
@@ -321,6 +342,8 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
     BlockExportOptionsVhostUserBlk *vu_opts = &opts->u.vhost_user_blk;
     uint64_t logical_block_size;
     uint16_t num_queues = VHOST_USER_BLK_NUM_QUEUES_DEFAULT;
+    strList *iothreads;
+    unsigned int i;
 
     vexp->blkcfg.wce = 0;
 
@@ -340,6 +363,27 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         error_setg(errp, "num-queues must be greater than 0");
         return -EINVAL;
     }
+
+    for (iothreads = vu_opts->iothreads; iothreads;
+         iothreads = iothreads->next) {
+        vexp->nr_queue_ctxs++;
+    }
+    vexp->queue_iothreads = g_new0(IOThread *, vexp->nr_queue_ctxs);
+    vexp->queue_ctxs = g_new0(AioContext *, vexp->nr_queue_ctxs);
+    for (i = 0, iothreads = vu_opts->iothreads; iothreads;
+         i++, iothreads = iothreads->next) {
+        IOThread *iothread = iothread_by_id(iothreads->value);
+
+        if (!iothread) {
+            error_setg(errp, "iothread \"%s\" not found", iothreads->value);
+            vu_blk_exp_free_queue_ctxs(vexp);
+            return -EINVAL;
+        }
+        object_ref(OBJECT(iothread));
+        vexp->queue_iothreads[i] = iothread;
+        vexp->queue_ctxs[i] = iothread_get_aio_context(iothread);
+    }
+
     vexp->handler.blk = exp->blk;
     vexp->handler.serial = g_strdup("vhost_user_blk");
     vexp->handler.logical_block_size = logical_block_size;
@@ -358,8 +402,12 @@ static int vu_blk_exp_create(BlockExport *exp, BlockExportOptions *opts,
         blk_remove_aio_context_notifier(exp->blk, blk_aio_attached,
                                         blk_aio_detach, vexp);
         g_free(vexp->handler.serial);
+        vu_blk_exp_free_queue_ctxs(vexp);
         return -EADDRNOTAVAIL;
     }
+    vhost_user_server_set_queue_aio_contexts(&vexp->vu_server,
+                                             vexp->queue_ctxs,
+                                             vexp->nr_queue_ctxs);
 
     return 0;
 }
@@ -371,6 +419,7 @@ static void vu_blk_exp_delete(BlockExport *exp)
     blk_remove_aio_context_notifier(exp->blk, blk_aio_attached, blk_aio_detach,
                                     vexp);
     g_free(vexp->handler.serial);
+    vu_blk_exp_free_queue_ctxs(vexp);
 }
 
 const BlockExportDriver blk_exp_vhost_user_blk = {
@@ -32,6 +32,7 @@
 #include "qemu/option.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "qemu/bswap.h"
 #include "trace.h"
 #include "block/thread-pool.h"
 #include "qemu/iov.h"
@@ -77,6 +78,9 @@
 #include <linux/hdreg.h>
 #include <linux/magic.h>
 #include <scsi/sg.h>
+#ifdef HAVE_IO_URING_NVME_CMD
+#include <linux/nvme_ioctl.h>
+#endif
 #ifdef __s390__
 #include <asm/dasd.h>
 #endif
@@ -161,6 +165,14 @@ typedef struct BDRVRawState {
     bool use_linux_aio:1;
     bool has_laio_fdsync:1;
     bool use_linux_io_uring:1;
+#ifdef HAVE_IO_URING_NVME_CMD
+    /* NVMe generic character device, I/O is passed through as NVMe commands */
+    bool use_nvme_cmd:1;
+    uint32_t nvme_nsid;
+    unsigned int nvme_lba_shift;
+    uint64_t nvme_max_transfer;
+    int64_t nvme_size;
+#endif
     int page_cache_inconsistent; /* errno from fdatasync failure */
     bool has_fallocate;
     bool needs_alignment;
@@ -1490,6 +1502,19 @@ static void raw_refresh_limits(BlockDriverState *bs, Error **errp)
     BDRVRawState *s = bs->opaque;
     struct stat st;
 
+#ifdef HAVE_IO_URING_NVME_CMD
+    /* O_DIRECT does not apply, and reads for probing would fail */
+    if (s->use_nvme_cmd) {
+        s->needs_alignment = false;
+        s->buf_align = 1;
+        bs->bl.request_alignment = 1 << s->nvme_lba_shift;
+        bs->bl.max_transfer = s->nvme_max_transfer;
+        bs->bl.min_mem_alignment = s->buf_align;
+        bs->bl.opt_mem_alignment = qemu_real_host_page_size();
+        return;
+    }
+#endif
+
     s->needs_alignment = raw_needs_alignment(bs);
     raw_probe_alignment(bs, s->fd, errp);
 
@@ -1551,6 +1576,13 @@ static int hdev_probe_blocksizes(BlockDriverState *bs, BlockSizes *bsz)
     BDRVRawState *s = bs->opaque;
     int ret;
 
+#ifdef HAVE_IO_URING_NVME_CMD
+    if (s->use_nvme_cmd) {
+        bsz->log = bsz->phys = 1 << s->nvme_lba_shift;
+        return 0;
+    }
+#endif
+
     /* If DASD or zoned devices, get blocksizes */
     if (check_for_dasd(s->fd) < 0) {
         /* zoned devices are not DASD */
@@ -2463,6 +2495,20 @@ static inline bool raw_check_linux_io_uring(BDRVRawState *s)
 }
 #endif
 
+#ifdef HAVE_IO_URING_NVME_CMD
+static inline bool raw_check_linux_io_uring_cmd(BDRVRawState *s)
+{
+    Error *local_err = NULL;
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    if (unlikely(!aio_setup_linux_io_uring_cmd(ctx, &local_err))) {
+        error_reportf_err(local_err, "Unable to pass through NVMe commands: ");
+        return false;
+    }
+    return true;
+}
+#endif
+
 #ifdef CONFIG_LINUX_AIO
 static inline bool raw_check_linux_aio(BDRVRawState *s)
 {
@@ -2512,6 +2558,21 @@ static int coroutine_fn raw_co_prw(BlockDriverState *bs, int64_t *offset_ptr,
      * pool read/write code which emulates this for us if we
      * set QEMU_AIO_MISALIGNED.
      */
+#ifdef HAVE_IO_URING_NVME_CMD
+    /* The kernel bounces misaligned buffers of passthrough commands */
+    if (s->use_nvme_cmd) {
+        assert(qiov->size == bytes);
+        if (!raw_check_linux_io_uring_cmd(s)) {
+            ret = -EIO;
+            goto out;
+        }
+        ret = luring_co_submit_nvme_cmd(bs, s->fd, s->nvme_nsid,
+                                        s->nvme_lba_shift, offset, qiov,
+                                        type, flags);
+        goto out;
+    }
+#endif
+
     if (s->needs_alignment && !bdrv_qiov_is_aligned(bs, qiov)) {
         type |= QEMU_AIO_MISALIGNED;
 #ifdef CONFIG_LINUX_IO_URING
@@ -2611,6 +2672,16 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
         .aio_type       = QEMU_AIO_FLUSH,
     };
 
+#ifdef HAVE_IO_URING_NVME_CMD
+    if (s->use_nvme_cmd) {
+        if (!raw_check_linux_io_uring_cmd(s)) {
+            return -EIO;
+        }
+        return luring_co_submit_nvme_cmd(bs, s->fd, s->nvme_nsid,
+                                         s->nvme_lba_shift, 0, NULL,
+                                         QEMU_AIO_FLUSH, 0);
+    }
+#endif
 #ifdef CONFIG_LINUX_IO_URING
     if (raw_check_linux_io_uring(s)) {
         return luring_co_submit(bs, s->fd, 0, NULL, QEMU_AIO_FLUSH, 0);
@@ -2624,6 +2695,17 @@ static int coroutine_fn raw_co_flush_to_disk(BlockDriverState *bs)
     return raw_thread_pool_submit(handle_aiocb_flush, &acb);
 }
 
+/* Close @fd after it was used for I/O on @s */
+static void raw_close_fd(BDRVRawState *s, int fd)
+{
+#ifdef CONFIG_LINUX_IO_URING
+    if (s->use_linux_io_uring) {
+        luring_fd_closed(fd);
+    }
+#endif
+    qemu_close(fd);
+}
+
 static void raw_close(BlockDriverState *bs)
 {
     BDRVRawState *s = bs->opaque;
@@ -2632,7 +2714,7 @@ static void raw_close(BlockDriverState *bs)
 #if defined(CONFIG_BLKZONED)
         g_free(bs->wps);
 #endif
-        qemu_close(s->fd);
+        raw_close_fd(s, s->fd);
         s->fd = -1;
     }
 }
@@ -2865,6 +2947,13 @@ static int64_t raw_getlength(BlockDriverState *bs)
         return ret;
     }
 
+#ifdef HAVE_IO_URING_NVME_CMD
+    /* NVMe generic character devices cannot be seeked */
+    if (s->use_nvme_cmd) {
+        return s->nvme_size;
+    }
+#endif
+
     size = lseek(s->fd, 0, SEEK_END);
     if (size < 0) {
         return -errno;
@@ -3822,7 +3911,7 @@ static void raw_set_perm(BlockDriverState *bs, uint64_t perm, uint64_t shared)
     /* For reopen, we have already switched to the new fd (.bdrv_set_perm is
      * called after .bdrv_reopen_commit) */
     if (s->perm_change_fd && s->fd != s->perm_change_fd) {
-        qemu_close(s->fd);
+        raw_close_fd(s, s->fd);
         s->fd = s->perm_change_fd;
         s->open_flags = s->perm_change_flags;
     }
@@ -4106,6 +4195,109 @@ static bool hdev_is_sg(BlockDriverState *bs)
     return false;
 }
 
+#ifdef HAVE_IO_URING_NVME_CMD
+#define NVME_ADM_CMD_IDENTIFY   0x06
+#define NVME_ID_CNS_NS          0x00
+#define NVME_ID_CNS_CTRL        0x01
+#define NVME_IDENTIFY_DATA_SIZE 4096
+
+/* Number of logical blocks field of read/write commands, 0's based */
+#define NVME_MAX_NLB            (1 << 16)
+
+static int hdev_nvme_identify(int fd, uint32_t nsid, uint32_t cns, void *buf)
+{
+    struct nvme_admin_cmd cmd = {
+        .opcode = NVME_ADM_CMD_IDENTIFY,
+        .nsid = nsid,
+        .addr = (uintptr_t)buf,
+        .data_len = NVME_IDENTIFY_DATA_SIZE,
+        .cdw10 = cns,
+    };
+    int ret;
+
+    ret = ioctl(fd, NVME_IOCTL_ADMIN_CMD, &cmd);
+    if (ret < 0) {
+        return -errno;
+    }
+    /* Positive values are NVMe status codes */
+    return ret ? -EIO : 0;
+}
+
+/*
+ * Set up NVMe command passthrough if @bs is an NVMe generic character
+ * device (/dev/ngXnY).  These bypass the block layer of the host kernel,
+ * but cannot be accessed with read() and write().
+ */
+static int hdev_open_nvme_generic(BlockDriverState *bs, Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+    g_autofree uint8_t *id = g_malloc0(NVME_IDENTIFY_DATA_SIZE);
+    struct stat st;
+    uint8_t flbas, mdts, *lbaf;
+    int nsid, ret;
+
+    if (fstat(s->fd, &st) < 0 || !S_ISCHR(st.st_mode)) {
+        return 0;
+    }
+
+    /* Fails for SCSI generic devices and NVMe controller devices */
+    nsid = ioctl(s->fd, NVME_IOCTL_ID);
+    if (nsid <= 0) {
+        return 0;
+    }
+
+    if (!s->use_linux_io_uring) {
+        error_setg(errp, "NVMe generic character devices require "
+                   "aio=io_uring");
+        return -EINVAL;
+    }
+
+    ret = hdev_nvme_identify(s->fd, nsid, NVME_ID_CNS_NS, id);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "Failed to identify NVMe namespace %d",
+                         nsid);
+        return ret;
+    }
+
+    /* Current LBA format, with the upper bits for more than 16 formats */
+    flbas = id[26];
+    lbaf = &id[128 + 4 * ((flbas & 0xf) | ((flbas >> 5) & 0x3) << 4)];
+    if (lduw_le_p(lbaf)) {
+        error_setg(errp, "NVMe namespaces with metadata are not supported");
+        return -ENOTSUP;
+    }
+    if (lbaf[2] < BDRV_SECTOR_BITS || lbaf[2] > 16) {
+        error_setg(errp, "Unsupported NVMe logical block size 2^%u",
+                   lbaf[2]);
+        return -ENOTSUP;
+    }
+
+    s->nvme_nsid = nsid;
+    s->nvme_lba_shift = lbaf[2];
+    s->nvme_size = ldq_le_p(&id[0]) << s->nvme_lba_shift;
+    s->nvme_max_transfer = MIN((uint64_t)NVME_MAX_NLB << s->nvme_lba_shift,
+                               QEMU_ALIGN_DOWN(BDRV_REQUEST_MAX_BYTES,
+                                               1 << s->nvme_lba_shift));
+
+    /* MDTS in units of the minimum page size, assume 4k */
+    ret = hdev_nvme_identify(s->fd, 0, NVME_ID_CNS_CTRL, id);
+    mdts = ret < 0 ? 0 : id[77];
+    if (mdts && mdts < 20) {
+        s->nvme_max_transfer = MIN(s->nvme_max_transfer, 4096ULL << mdts);
+    }
+
+    /* Neither BLKDISCARD nor fallocate() work on the character device */
+    s->has_discard = false;
+    s->has_write_zeroes = false;
+    bs->supported_zero_flags = 0;
+    bs->supported_write_flags = BDRV_REQ_FUA;
+    s->use_nvme_cmd = true;
+    trace_file_hdev_open_nvme_generic(bs, nsid, 1 << s->nvme_lba_shift,
+                                      s->nvme_max_transfer);
+    return 0;
+}
+#endif
+
 static int hdev_open(BlockDriverState *bs, QDict *options, int flags,
                      Error **errp)
 {
@@ -4188,6 +4380,14 @@ hdev_open_Mac_error:
         return ret;
     }
 
+#ifdef HAVE_IO_URING_NVME_CMD
+    ret = hdev_open_nvme_generic(bs, errp);
+    if (ret < 0) {
+        raw_close(bs);
+        return ret;
+    }
+#endif
+
     /* Since this does ioctl the device must be already opened */
     bs->sg = hdev_is_sg(bs);
 
@@ -4470,7 +4670,7 @@ static int cdrom_reopen(BlockDriverState *bs)
      * FreeBSD seems to not notice sometimes...
      */
     if (s->fd >= 0)
-        qemu_close(s->fd);
+        raw_close_fd(s, s->fd);
     fd = qemu_open(bs->filename, s->open_flags, NULL);
     if (fd < 0) {
         s->fd = -1;
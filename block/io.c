@@ -2317,6 +2317,92 @@ out:
     return ret;
 }
 
+/*
+ * Can a request skip padding, fragmentation and request tracking and go
+ * straight to the driver?  Anything unusual is left to the coroutine path.
+ */
+static bool GRAPH_RDLOCK
+bdrv_nowait_request_ok(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                       QEMUIOVector *qiov)
+{
+    BlockDriver *drv = bs->drv;
+    int64_t align = bs->bl.request_alignment;
+    int64_t max_transfer;
+
+    if (!drv || drv->bdrv_co_is_inserted || bs->bl.has_variable_length) {
+        return false;
+    }
+    if (bs->open_flags & (BDRV_O_NO_IO | BDRV_O_INACTIVE)) {
+        return false;
+    }
+    if (!bytes || bdrv_check_request32(offset, bytes, qiov, 0) < 0) {
+        return false;
+    }
+    if (!QEMU_IS_ALIGNED(offset, align) || !QEMU_IS_ALIGNED(bytes, align)) {
+        return false;
+    }
+
+    max_transfer = QEMU_ALIGN_DOWN(MIN_NON_ZERO(bs->bl.max_transfer, INT_MAX),
+                                   align);
+    if (bytes > max_transfer ||
+        offset + bytes > bs->total_sectors * BDRV_SECTOR_SIZE) {
+        return false;
+    }
+
+    return !qatomic_read(&bs->serialising_in_flight);
+}
+
+int bdrv_try_preadv_nowait(BdrvChild *child, int64_t offset, int64_t bytes,
+                           QEMUIOVector *qiov)
+{
+    BlockDriverState *bs = child->bs;
+    int ret;
+    IO_CODE();
+
+    if (!bdrv_nowait_request_ok(bs, offset, bytes, qiov) ||
+        !bs->drv->bdrv_preadv_nowait || qatomic_read(&bs->copy_on_read)) {
+        return -EAGAIN;
+    }
+
+    trace_bdrv_try_preadv_nowait(bs, offset, bytes);
+
+    bdrv_inc_in_flight(bs);
+    ret = bs->drv->bdrv_preadv_nowait(bs, offset, bytes, qiov);
+    bdrv_dec_in_flight(bs);
+
+    return ret;
+}
+
+int bdrv_try_pwritev_nowait(BdrvChild *child, int64_t offset, int64_t bytes,
+                            QEMUIOVector *qiov)
+{
+    BlockDriverState *bs = child->bs;
+    int ret;
+    IO_CODE();
+
+    if (!bdrv_nowait_request_ok(bs, offset, bytes, qiov) ||
+        !bs->drv->bdrv_pwritev_nowait || bdrv_is_read_only(bs) ||
+        !(child->perm & BLK_PERM_WRITE) || bdrv_has_readonly_bitmaps(bs) ||
+        bs->detect_zeroes != BLOCKDEV_DETECT_ZEROES_OPTIONS_OFF) {
+        return -EAGAIN;
+    }
+
+    trace_bdrv_try_pwritev_nowait(bs, offset, bytes);
+
+    bdrv_inc_in_flight(bs);
+    bdrv_write_threshold_check_write(bs, offset, bytes);
+    ret = bs->drv->bdrv_pwritev_nowait(bs, offset, bytes, qiov);
+    if (ret != -EAGAIN) {
+        /* Same bookkeeping as bdrv_co_write_req_finish(), minus resizing */
+        qatomic_inc(&bs->write_gen);
+        stat64_max(&bs->wr_highest_offset, offset + bytes);
+        bdrv_set_dirty(bs, offset, bytes);
+    }
+    bdrv_dec_in_flight(bs);
+
+    return ret;
+}
+
 int coroutine_fn bdrv_co_pwrite_zeroes(BdrvChild *child, int64_t offset,
                                        int64_t bytes, BdrvRequestFlags flags)
 {
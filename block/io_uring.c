@@ -16,6 +16,10 @@
 #include "block/raw-aio.h"
 #include "qemu/coroutine.h"
 #include "qemu/defer-call.h"
+#include "qemu/lockable.h"
+#ifdef HAVE_IO_URING_NVME_CMD
+#include <linux/nvme_ioctl.h>
+#endif
 #include "qapi/error.h"
 #include "system/block-backend.h"
 #include "trace.h"
@@ -26,12 +30,28 @@
 /* io_uring ring size */
 #define MAX_ENTRIES 128
 
+/* Number of file descriptors each ring can use as fixed files */
+#define MAX_FIXED_FILES 64
+
+/* NVMe I/O command set opcodes */
+#define NVME_CMD_FLUSH  0x00
+#define NVME_CMD_WRITE  0x01
+#define NVME_CMD_READ   0x02
+
+/* Force Unit Access bit in CDW12 of NVMe read/write commands */
+#define NVME_RW_FUA     (1u << 30)
+
 typedef struct LuringAIOCB {
     Coroutine *co;
-    struct io_uring_sqe sqeq;
+    union {
+        struct io_uring_sqe sqeq;
+        /* IORING_OP_URING_CMD carries its command in a 128 byte sqe */
+        uint8_t sqeq128[128];
+    };
     ssize_t ret;
     QEMUIOVector *qiov;
     bool is_read;
+    bool is_uring_cmd;
     QSIMPLEQ_ENTRY(LuringAIOCB) next;
 
     /*
@@ -54,12 +74,35 @@ struct LuringState {
 
     struct io_uring ring;
 
+    /* The ring has 128 byte sqes and 32 byte cqes for IORING_OP_URING_CMD */
+    bool has_uring_cmd;
+
     /* No locking required, only accessed from AioContext home thread */
     LuringQueue io_q;
 
     QEMUBH *completion_bh;
+
+    /*
+     * File descriptors registered with the ring, indexed by fixed file slot,
+     * or -1 for free slots.  Slots are filled in by the AioContext home
+     * thread and cleared by luring_fd_closed(), see there.
+     */
+    bool has_fixed_files;
+    unsigned int nr_fixed_files;
+    int fixed_files[MAX_FIXED_FILES];
+    QLIST_ENTRY(LuringState) next;
 };
 
+/* All rings with fixed files, protected by luring_rings_lock */
+static QLIST_HEAD(, LuringState) luring_rings =
+    QLIST_HEAD_INITIALIZER(luring_rings);
+static QemuMutex luring_rings_lock;
+
+static void __attribute__((__constructor__)) luring_rings_lock_init(void)
+{
+    qemu_mutex_init(&luring_rings_lock);
+}
+
 /**
  * luring_resubmit:
  *
@@ -165,6 +208,12 @@ static void luring_process_completions(LuringState *s)
         /* total_read is non-zero only for resubmitted read requests */
         total_bytes = ret + luringcb->total_read;
 
+        if (luringcb->is_uring_cmd && ret >= 0) {
+            /* Positive values are NVMe status codes */
+            ret = ret ? -EIO : 0;
+            goto end;
+        }
+
         if (ret < 0) {
             /*
              * Only writev/readv/fsync requests on regular files or host block
@@ -243,7 +292,11 @@ static int ioq_submit(LuringState *s)
                 break;
             }
             /* Prep sqe for submission */
-            *sqes = luringcb->sqeq;
+            if (luringcb->is_uring_cmd) {
+                memcpy(sqes, luringcb->sqeq128, sizeof(luringcb->sqeq128));
+            } else {
+                *sqes = luringcb->sqeq;
+            }
             QSIMPLEQ_REMOVE_HEAD(&s->io_q.submit_queue, next);
         }
         ret = io_uring_submit(&s->ring);
@@ -323,6 +376,117 @@ static void luring_deferred_fn(void *opaque)
     }
 }
 
+/**
+ * luring_fixed_file:
+ * @s: AIO state
+ * @fd: file descriptor for I/O
+ *
+ * Returns the fixed file slot of @fd in the ring, registering @fd if it has
+ * none yet, or -1 if @fd must be passed to the kernel as a plain file
+ * descriptor.  Fixed files save the kernel from looking up and referencing
+ * the file on every request.
+ */
+static int luring_fixed_file(LuringState *s, int fd)
+{
+    unsigned int i;
+    int free_slot = -1;
+
+    if (!s->has_fixed_files) {
+        return -1;
+    }
+
+    for (i = 0; i < s->nr_fixed_files; i++) {
+        int slot_fd = qatomic_read(&s->fixed_files[i]);
+
+        if (slot_fd == fd) {
+            return i;
+        }
+        if (slot_fd == -1 && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+
+    if (free_slot == -1) {
+        if (s->nr_fixed_files == MAX_FIXED_FILES) {
+            return -1;
+        }
+        free_slot = s->nr_fixed_files;
+    }
+
+    if (io_uring_register_files_update(&s->ring, free_slot, &fd, 1) != 1) {
+        return -1;
+    }
+    trace_luring_register_fixed_file(s, fd, free_slot);
+    qatomic_set(&s->fixed_files[free_slot], fd);
+    if (free_slot == s->nr_fixed_files) {
+        qatomic_set(&s->nr_fixed_files, s->nr_fixed_files + 1);
+    }
+    return free_slot;
+}
+
+void luring_fd_closed(int fd)
+{
+    LuringState *s;
+
+    QEMU_LOCK_GUARD(&luring_rings_lock);
+    QLIST_FOREACH(s, &luring_rings, next) {
+        unsigned int i, nr = qatomic_read(&s->nr_fixed_files);
+
+        for (i = 0; i < nr; i++) {
+            int unused = -1;
+
+            if (qatomic_read(&s->fixed_files[i]) != fd) {
+                continue;
+            }
+
+            /*
+             * Only the home thread fills in slots, and it only reuses this
+             * one after seeing -1, i.e. after the kernel dropped the file.
+             */
+            io_uring_register_files_update(&s->ring, i, &unused, 1);
+            trace_luring_unregister_fixed_file(s, fd, i);
+            qatomic_set(&s->fixed_files[i], -1);
+        }
+    }
+}
+
+/**
+ * luring_queue:
+ * @fd: file descriptor for I/O
+ * @luringcb: AIO control block with a prepared sqe
+ * @s: AIO state
+ *
+ * Adds the request to the pending queue and kicks submission
+ *
+ */
+static int luring_queue(int fd, LuringAIOCB *luringcb, LuringState *s)
+{
+    struct io_uring_sqe *sqes = &luringcb->sqeq;
+    int ret, slot;
+
+    /* Resubmissions reuse the sqe and thus keep the fixed file slot */
+    slot = luring_fixed_file(s, fd);
+    if (slot >= 0) {
+        sqes->fd = slot;
+        sqes->flags |= IOSQE_FIXED_FILE;
+    }
+
+    QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
+    s->io_q.in_queue++;
+    trace_luring_do_submit(s, s->io_q.blocked, s->io_q.in_queue,
+                           s->io_q.in_flight);
+    if (!s->io_q.blocked) {
+        if (s->io_q.in_flight + s->io_q.in_queue >= MAX_ENTRIES) {
+            ret = ioq_submit(s);
+            trace_luring_do_submit_done(s, ret);
+            return ret;
+        }
+
+        defer_call(luring_deferred_fn, s);
+    }
+    return 0;
+}
+
 /**
  * luring_do_submit:
  * @fd: file descriptor for I/O
@@ -337,7 +501,6 @@ static void luring_deferred_fn(void *opaque)
 static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
                             uint64_t offset, int type, BdrvRequestFlags flags)
 {
-    int ret;
     struct io_uring_sqe *sqes = &luringcb->sqeq;
 
     switch (type) {
@@ -372,20 +535,7 @@ static int luring_do_submit(int fd, LuringAIOCB *luringcb, LuringState *s,
     }
     io_uring_sqe_set_data(sqes, luringcb);
 
-    QSIMPLEQ_INSERT_TAIL(&s->io_q.submit_queue, luringcb, next);
-    s->io_q.in_queue++;
-    trace_luring_do_submit(s, s->io_q.blocked, s->io_q.in_queue,
-                           s->io_q.in_flight);
-    if (!s->io_q.blocked) {
-        if (s->io_q.in_flight + s->io_q.in_queue >= MAX_ENTRIES) {
-            ret = ioq_submit(s);
-            trace_luring_do_submit_done(s, ret);
-            return ret;
-        }
-
-        defer_call(luring_deferred_fn, s);
-    }
-    return 0;
+    return luring_queue(fd, luringcb, s);
 }
 
 int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
@@ -415,6 +565,74 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
     return luringcb.ret;
 }
 
+#ifdef HAVE_IO_URING_NVME_CMD
+int coroutine_fn luring_co_submit_nvme_cmd(BlockDriverState *bs, int fd,
+                                           uint32_t nsid,
+                                           unsigned int lba_shift,
+                                           uint64_t offset, QEMUIOVector *qiov,
+                                           int type, BdrvRequestFlags flags)
+{
+    int ret;
+    AioContext *ctx = qemu_get_current_aio_context();
+    LuringState *s = aio_get_linux_io_uring_cmd(ctx);
+    LuringAIOCB luringcb = {
+        .co             = qemu_coroutine_self(),
+        .ret            = -EINPROGRESS,
+        .qiov           = qiov,
+        .is_read        = (type == QEMU_AIO_READ),
+        .is_uring_cmd   = true,
+    };
+    struct io_uring_sqe *sqes = &luringcb.sqeq;
+    struct nvme_uring_cmd *cmd = (struct nvme_uring_cmd *)sqes->cmd;
+    uint64_t slba = offset >> lba_shift;
+
+    assert(s->has_uring_cmd);
+    trace_luring_co_submit(bs, s, &luringcb, fd, offset, qiov ? qiov->size : 0,
+                           type);
+
+    /* All command fields that are not filled in below must be zero */
+    memset(luringcb.sqeq128, 0, sizeof(luringcb.sqeq128));
+    io_uring_prep_rw(IORING_OP_URING_CMD, sqes, fd, NULL, 0, 0);
+    io_uring_sqe_set_data(sqes, &luringcb);
+    sqes->cmd_op = NVME_URING_CMD_IO_VEC;
+    cmd->nsid = nsid;
+
+    switch (type) {
+    case QEMU_AIO_WRITE:
+    case QEMU_AIO_READ:
+        assert(QEMU_IS_ALIGNED(offset | qiov->size, 1 << lba_shift));
+        cmd->opcode = type == QEMU_AIO_READ ? NVME_CMD_READ : NVME_CMD_WRITE;
+        cmd->addr = (uintptr_t)qiov->iov;
+        cmd->data_len = qiov->niov;
+        cmd->cdw10 = slba;
+        cmd->cdw11 = slba >> 32;
+        /* Number of logical blocks, 0's based */
+        cmd->cdw12 = (qiov->size >> lba_shift) - 1;
+        if (flags & BDRV_REQ_FUA) {
+            cmd->cdw12 |= NVME_RW_FUA;
+        }
+        break;
+    case QEMU_AIO_FLUSH:
+        cmd->opcode = NVME_CMD_FLUSH;
+        break;
+    default:
+        fprintf(stderr, "%s: invalid AIO request type, aborting 0x%x.\n",
+                        __func__, type);
+        abort();
+    }
+
+    ret = luring_queue(fd, &luringcb, s);
+    if (ret < 0) {
+        return ret;
+    }
+
+    if (luringcb.ret == -EINPROGRESS) {
+        qemu_coroutine_yield();
+    }
+    return luringcb.ret;
+}
+#endif
+
 void luring_detach_aio_context(LuringState *s, AioContext *old_context)
 {
     aio_set_fd_handler(old_context, s->ring.ring_fd,
@@ -432,28 +650,57 @@ void luring_attach_aio_context(LuringState *s, AioContext *new_context)
                        qemu_luring_poll_cb, qemu_luring_poll_ready, s);
 }
 
-LuringState *luring_init(Error **errp)
+LuringState *luring_init(bool uring_cmd, Error **errp)
 {
     int rc;
+    unsigned flags = 0;
     LuringState *s = g_new0(LuringState, 1);
     struct io_uring *ring = &s->ring;
 
     trace_luring_init_state(s, sizeof(*s));
 
-    rc = io_uring_queue_init(MAX_ENTRIES, ring, 0);
+#ifdef HAVE_IO_URING_NVME_CMD
+    /*
+     * Big sqes and cqes double the size of the ring, so only the rings
+     * that pass through NVMe commands use them.
+     */
+    if (uring_cmd) {
+        flags = IORING_SETUP_SQE128 | IORING_SETUP_CQE32;
+    }
+#else
+    assert(!uring_cmd);
+#endif
+    rc = io_uring_queue_init(MAX_ENTRIES, ring, flags);
     if (rc < 0) {
         error_setg_errno(errp, -rc, "failed to init linux io_uring ring");
         g_free(s);
         return NULL;
     }
+    s->has_uring_cmd = uring_cmd;
 
     ioq_init(&s->io_q);
+
+#ifdef HAVE_IO_URING_REGISTER_FILES_SPARSE
+    /* Not fatal, requests just keep using plain file descriptors */
+    if (io_uring_register_files_sparse(ring, MAX_FIXED_FILES) == 0) {
+        s->has_fixed_files = true;
+        WITH_QEMU_LOCK_GUARD(&luring_rings_lock) {
+            QLIST_INSERT_HEAD(&luring_rings, s, next);
+        }
+    }
+#endif
+
     return s;
 
 }
 
 void luring_cleanup(LuringState *s)
 {
+    if (s->has_fixed_files) {
+        WITH_QEMU_LOCK_GUARD(&luring_rings_lock) {
+            QLIST_REMOVE(s, next);
+        }
+    }
     io_uring_queue_exit(&s->ring);
     trace_luring_cleanup_state(s);
     g_free(s);
@@ -86,6 +86,14 @@ typedef struct MirrorBlockJob {
     QTAILQ_HEAD(, MirrorOp) ops_in_flight;
     int ret;
     bool unmap;
+    /*
+     * Try copy offloading (e.g. copy_file_range() or reflinks when source
+     * and target are on the same filesystem) before copying through
+     * s->buf, if requested with x-copy-range.  Cleared once offloading
+     * turns out not to work.
+     */
+    bool copy_range;
+    bool copy_range_worked;
     int target_cluster_size;
     int max_iov;
     bool initial_zeroing_ongoing;
@@ -336,6 +344,56 @@ mirror_wait_for_free_in_flight_slot(MirrorBlockJob *s)
     abort();
 }
 
+/*
+ * Copy @op with bdrv_co_copy_range() without going through s->buf.  Returns
+ * false if the caller must copy it the normal way instead.
+ */
+static bool coroutine_fn mirror_co_copy_range(MirrorOp *op)
+{
+    MirrorBlockJob *s = op->s;
+    int64_t done, bytes;
+    int ret = 0;
+
+    s->in_flight++;
+    s->bytes_in_flight += op->bytes;
+    op->is_in_flight = true;
+    trace_mirror_one_iteration(s, op->offset, op->bytes);
+
+    WITH_GRAPH_RDLOCK_GUARD() {
+        BdrvChild *source = s->mirror_top_bs->backing;
+        BdrvChild *target = blk_root(s->target);
+        /* bdrv_co_copy_range() does not split requests at max_transfer */
+        int64_t max_bytes =
+            MIN_NON_ZERO(INT_MAX, MIN_NON_ZERO(source->bs->bl.max_transfer,
+                                               target->bs->bl.max_transfer));
+
+        for (done = 0; done < op->bytes && ret >= 0; done += bytes) {
+            bytes = MIN(op->bytes - done, max_bytes);
+            ret = bdrv_co_copy_range(source, op->offset + done,
+                                     target, op->offset + done, bytes, 0, 0);
+        }
+    }
+    if (ret >= 0) {
+        s->copy_range_worked = true;
+        mirror_write_complete(op, ret);
+        return true;
+    }
+
+    /*
+     * Once offloading worked, -ENOTSUP only means that this range cannot be
+     * offloaded, e.g. because it is compressed in the source.
+     */
+    trace_mirror_copy_range_fail(s, op->offset, ret);
+    if (!s->copy_range_worked || ret != -ENOTSUP) {
+        s->copy_range = false;
+    }
+
+    s->in_flight--;
+    s->bytes_in_flight -= op->bytes;
+    op->is_in_flight = false;
+    return false;
+}
+
 /* Perform a mirror copy operation.
  *
  * *op->bytes_handled is set to the number of bytes copied after and
@@ -374,6 +432,10 @@ static void coroutine_fn mirror_co_read(void *opaque)
     assert(QEMU_IS_ALIGNED(op->bytes, BDRV_SECTOR_SIZE));
     nb_chunks = DIV_ROUND_UP(op->bytes, s->granularity);
 
+    if (s->copy_range && mirror_co_copy_range(op)) {
+        return;
+    }
+
     while (s->buf_free_count < nb_chunks) {
         trace_mirror_yield_in_flight(s, op->offset, s->in_flight);
         mirror_wait_for_free_in_flight_slot(s);
@@ -1722,7 +1784,7 @@ static BlockJob *mirror_start_job(
                              bool is_none_mode, BlockDriverState *base,
                              bool auto_complete, const char *filter_node_name,
                              bool is_mirror, MirrorCopyMode copy_mode,
-                             bool base_ro,
+                             bool copy_range, bool base_ro,
                              Error **errp)
 {
     MirrorBlockJob *s;
@@ -1887,6 +1949,7 @@ static BlockJob *mirror_start_job(
     s->granularity = granularity;
     s->buf_size = ROUND_UP(buf_size, granularity);
     s->unmap = unmap;
+    s->copy_range = copy_range;
     if (auto_complete) {
         s->should_complete = true;
     }
@@ -2013,7 +2076,7 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                   BlockdevOnError on_source_error,
                   BlockdevOnError on_target_error,
                   bool unmap, const char *filter_node_name,
-                  MirrorCopyMode copy_mode, Error **errp)
+                  MirrorCopyMode copy_mode, bool copy_range, Error **errp)
 {
     bool is_none_mode;
     BlockDriverState *base;
@@ -2036,7 +2099,8 @@ void mirror_start(const char *job_id, BlockDriverState *bs,
                      speed, granularity, buf_size, backing_mode, zero_target,
                      on_source_error, on_target_error, unmap, NULL, NULL,
                      &mirror_job_driver, is_none_mode, base, false,
-                     filter_node_name, true, copy_mode, false, errp);
+                     filter_node_name, true, copy_mode, copy_range, false,
+                     errp);
 }
 
 BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
@@ -2065,7 +2129,7 @@ BlockJob *commit_active_start(const char *job_id, BlockDriverState *bs,
                      on_error, on_error, true, cb, opaque,
                      &commit_active_job_driver, false, base, auto_complete,
                      filter_node_name, false, MIRROR_COPY_MODE_BACKGROUND,
-                     base_read_only, errp);
+                     false, base_read_only, errp);
     if (!job) {
         goto error_restore_flags;
     }
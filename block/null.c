@@ -138,6 +138,28 @@ static coroutine_fn int null_co_pwritev(BlockDriverState *bs,
     return null_co_common(bs);
 }
 
+static int null_preadv_nowait(BlockDriverState *bs, int64_t offset,
+                              int64_t bytes, QEMUIOVector *qiov)
+{
+    BDRVNullState *s = bs->opaque;
+
+    if (s->latency_ns) {
+        return -EAGAIN;
+    }
+    if (s->read_zeroes) {
+        qemu_iovec_memset(qiov, 0, 0, bytes);
+    }
+    return 0;
+}
+
+static int null_pwritev_nowait(BlockDriverState *bs, int64_t offset,
+                               int64_t bytes, QEMUIOVector *qiov)
+{
+    BDRVNullState *s = bs->opaque;
+
+    return s->latency_ns ? -EAGAIN : 0;
+}
+
 static coroutine_fn int null_co_flush(BlockDriverState *bs)
 {
     return null_co_common(bs);
@@ -290,6 +312,8 @@ static BlockDriver bdrv_null_co = {
 
     .bdrv_co_preadv         = null_co_preadv,
     .bdrv_co_pwritev        = null_co_pwritev,
+    .bdrv_preadv_nowait     = null_preadv_nowait,
+    .bdrv_pwritev_nowait    = null_pwritev_nowait,
     .bdrv_co_flush_to_disk  = null_co_flush,
     .bdrv_reopen_prepare    = null_reopen_prepare,
 
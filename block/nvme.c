@@ -110,6 +110,8 @@ struct BDRVNVMeState {
      */
     NVMeQueuePair **queues;
     unsigned queue_count;
+    /* I/O queue pair that new requests go to, see nvme_get_ioq() */
+    unsigned cur_ioq;
     size_t page_size;
     /* How many uint32_t elements does each doorbell entry take. */
     size_t doorbell_scale;
@@ -143,6 +145,7 @@ struct BDRVNVMeState {
 
 #define NVME_BLOCK_OPT_DEVICE "device"
 #define NVME_BLOCK_OPT_NAMESPACE "namespace"
+#define NVME_BLOCK_OPT_QUEUES "queues"
 
 static void nvme_process_completion_bh(void *opaque);
 
@@ -160,6 +163,11 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_NUMBER,
             .help = "NVMe namespace",
         },
+        {
+            .name = NVME_BLOCK_OPT_QUEUES,
+            .type = QEMU_OPT_NUMBER,
+            .help = "Number of I/O queue pairs",
+        },
         { /* end of list */ }
     },
 };
@@ -480,6 +488,33 @@ static void nvme_trace_command(const NvmeCmd *cmd)
     }
 }
 
+/*
+ * Pick the I/O queue pair for a new request.  Requests stick to one queue
+ * pair until it runs out of free requests, so that a burst of submissions
+ * still rings a single doorbell, and only then spill over to the next one.
+ */
+static NVMeQueuePair *nvme_get_ioq(BDRVNVMeState *s)
+{
+    unsigned nr_ioqs = s->queue_count - 1;
+
+    assert(s->queue_count > 1);
+    for (unsigned i = 0; i < nr_ioqs; i++) {
+        NVMeQueuePair *q = s->queues[INDEX_IO(s->cur_ioq)];
+
+        /*
+         * q->lock isn't needed because requests are only allocated and
+         * completed in the event loop thread.
+         */
+        if (q->free_req_head != -1) {
+            return q;
+        }
+        s->cur_ioq = (s->cur_ioq + 1) % nr_ioqs;
+    }
+
+    /* All queue pairs are full, wait for a free request on this one */
+    return s->queues[INDEX_IO(s->cur_ioq)];
+}
+
 static void nvme_deferred_fn(void *opaque)
 {
     NVMeQueuePair *q = opaque;
@@ -630,6 +665,11 @@ static void nvme_poll_queue(NVMeQueuePair *q)
     const size_t cqe_offset = q->cq.head * NVME_CQ_ENTRY_BYTES;
     NvmeCqe *cqe = (NvmeCqe *)&q->cq.queue[cqe_offset];
 
+    /* No completion can be pending without outstanding commands */
+    if (!q->inflight) {
+        return;
+    }
+
     trace_nvme_poll_queue(q->s, q->index);
     /*
      * Do an early check for completions. q->lock isn't needed because
@@ -723,9 +763,12 @@ static bool nvme_poll_cb(void *opaque)
 
         /*
          * q->lock isn't needed because nvme_process_completion() only runs in
-         * the event loop thread and cannot race with itself.
+         * the event loop thread and cannot race with itself.  Idle queue
+         * pairs are skipped, so polling costs scale with the queue pairs
+         * that have commands outstanding.
          */
-        if ((le16_to_cpu(cqe->status) & 0x1) != q->cq_phase) {
+        if (q->inflight &&
+            (le16_to_cpu(cqe->status) & 0x1) != q->cq_phase) {
             return true;
         }
     }
@@ -740,8 +783,26 @@ static void nvme_poll_ready(EventNotifier *e)
     nvme_poll_queues(s);
 }
 
+/*
+ * Ask the controller for @n I/O queue pairs.  Failure is not fatal, queue
+ * creation then shows how many the controller grants.
+ */
+static void nvme_set_number_of_queues(BlockDriverState *bs, unsigned n)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_SET_FEATURES,
+        .cdw10 = cpu_to_le32(NVME_NUMBER_OF_QUEUES),
+        /* 0's based number of completion and submission queues */
+        .cdw11 = cpu_to_le32(((n - 1) << 16) | (n - 1)),
+    };
+
+    if (nvme_admin_cmd_sync(bs, &cmd)) {
+        trace_nvme_set_number_of_queues_failed(bs->opaque, n);
+    }
+}
+
 static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
-                     Error **errp)
+                     unsigned queues, Error **errp)
 {
     BDRVNVMeState *s = bs->opaque;
     NVMeQueuePair *q;
@@ -801,6 +862,13 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
 
     s->page_size = 1u << (12 + NVME_CAP_MPSMIN(cap));
     s->doorbell_scale = (4 << NVME_CAP_DSTRD(cap)) / sizeof(uint32_t);
+    if ((queues + 1) * s->doorbell_scale * sizeof(*s->doorbells) >
+        NVME_DOORBELL_SIZE) {
+        error_setg(errp, "Too many I/O queue pairs for the doorbell stride "
+                   "of the device");
+        ret = -EINVAL;
+        goto out;
+    }
     bs->bl.opt_mem_alignment = s->page_size;
     bs->bl.request_alignment = s->page_size;
     timeout_ms = MIN(500 * NVME_CAP_TO(cap), 30000);
@@ -881,8 +949,21 @@ static int nvme_init(BlockDriverState *bs, const char *device, int namespace,
     }
 
     /* Set up command queues. */
+    if (queues > 1) {
+        nvme_set_number_of_queues(bs, queues);
+    }
     if (!nvme_add_io_queue(bs, errp)) {
         ret = -EIO;
+        goto out;
+    }
+    while (s->queue_count <= queues) {
+        Error *local_err = NULL;
+
+        if (!nvme_add_io_queue(bs, &local_err)) {
+            warn_reportf_err(local_err, "Using %u of %u NVMe I/O queue "
+                             "pairs: ", s->queue_count - 1, queues);
+            break;
+        }
     }
 out:
     if (regs) {
@@ -973,6 +1054,7 @@ static int nvme_open(BlockDriverState *bs, QDict *options, int flags,
     const char *device;
     QemuOpts *opts;
     int namespace;
+    uint64_t queues;
     int ret;
     BDRVNVMeState *s = bs->opaque;
 
@@ -988,7 +1070,14 @@ static int nvme_open(BlockDriverState *bs, QDict *options, int flags,
     }
 
     namespace = qemu_opt_get_number(opts, NVME_BLOCK_OPT_NAMESPACE, 1);
-    ret = nvme_init(bs, device, namespace, errp);
+    queues = qemu_opt_get_number(opts, NVME_BLOCK_OPT_QUEUES, 1);
+    if (queues < 1 || queues > UINT16_MAX) {
+        error_setg(errp, "'" NVME_BLOCK_OPT_QUEUES "' must be between 1 "
+                   "and %u", UINT16_MAX);
+        qemu_opts_del(opts);
+        return -EINVAL;
+    }
+    ret = nvme_init(bs, device, namespace, queues, errp);
     qemu_opts_del(opts);
     if (ret) {
         goto fail;
@@ -1188,7 +1277,7 @@ static coroutine_fn int nvme_co_prw_aligned(BlockDriverState *bs,
 {
     int r;
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_ioq(s);
     NVMeRequest *req;
 
     uint32_t cdw12 = (((bytes >> s->blkshift) - 1) & 0xFFFF) |
@@ -1309,7 +1398,7 @@ static coroutine_fn int nvme_co_pwritev(BlockDriverState *bs,
 static coroutine_fn int nvme_co_flush(BlockDriverState *bs)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_ioq(s);
     NVMeRequest *req;
     NvmeCmd cmd = {
         .opcode = NVME_CMD_FLUSH,
@@ -1340,7 +1429,7 @@ static coroutine_fn int nvme_co_pwrite_zeroes(BlockDriverState *bs,
                                               BdrvRequestFlags flags)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_ioq(s);
     NVMeRequest *req;
     uint32_t cdw12;
 
@@ -1403,7 +1492,7 @@ static int coroutine_fn nvme_co_pdiscard(BlockDriverState *bs,
                                          int64_t bytes)
 {
     BDRVNVMeState *s = bs->opaque;
-    NVMeQueuePair *ioq = s->queues[INDEX_IO(0)];
+    NVMeQueuePair *ioq = nvme_get_ioq(s);
     NVMeRequest *req;
     QEMU_AUTO_VFREE NvmeDsmRange *buf = NULL;
     QEMUIOVector local_qiov;
@@ -857,6 +857,9 @@ qcow2_alloc_compressed_cluster_offset(BlockDriverState *bs, uint64_t offset,
         return cluster_offset;
     }
 
+    /* The new data may reuse the space of freed compressed clusters */
+    qcow2_decompressed_cache_invalidate(bs);
+
     nb_csectors =
         (cluster_offset + compressed_size - 1) / QCOW2_COMPRESSED_SECTOR_SIZE -
         (cluster_offset / QCOW2_COMPRESSED_SECTOR_SIZE);
@@ -1992,6 +1995,78 @@ discard_in_l2_slice(BlockDriverState *bs, uint64_t offset, uint64_t nb_clusters,
     return nb_clusters;
 }
 
+/*
+ * Discard @nb_subclusters subclusters of the cluster at @offset, which must
+ * not cover the whole cluster, by updating only its L2 bitmap.  Like
+ * discard_in_l2_slice(), the subclusters read back as zeroes unless
+ * @full_discard is true, in which case they fall through to the backing
+ * file.  Their data is discarded in the data file if discard passthrough
+ * is enabled for @type.
+ */
+static int GRAPH_RDLOCK
+discard_l2_subclusters(BlockDriverState *bs, uint64_t offset,
+                       unsigned nb_subclusters, enum qcow2_discard_type type,
+                       bool full_discard)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t *l2_slice;
+    uint64_t l2_entry, old_l2_bitmap, l2_bitmap;
+    QCow2ClusterType cluster_type;
+    int l2_index, ret, sc = offset_to_sc_index(s, offset);
+    uint64_t alloc_range = QCOW_OFLAG_SUB_ALLOC_RANGE(sc, sc + nb_subclusters);
+    uint64_t zero_range = QCOW_OFLAG_SUB_ZERO_RANGE(sc, sc + nb_subclusters);
+
+    /* For full clusters use discard_in_l2_slice() instead */
+    assert(nb_subclusters > 0 && nb_subclusters < s->subclusters_per_cluster);
+    assert(sc + nb_subclusters <= s->subclusters_per_cluster);
+    assert(offset_into_subcluster(s, offset) == 0);
+
+    ret = get_cluster_table(bs, offset, &l2_slice, &l2_index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    l2_entry = get_l2_entry(s, l2_slice, l2_index);
+    cluster_type = qcow2_get_cluster_type(bs, l2_entry);
+    switch (cluster_type) {
+    case QCOW2_CLUSTER_COMPRESSED:
+        ret = -ENOTSUP; /* We cannot partially discard compressed clusters */
+        goto out;
+    case QCOW2_CLUSTER_NORMAL:
+    case QCOW2_CLUSTER_UNALLOCATED:
+        break;
+    default:
+        g_assert_not_reached();
+    }
+
+    old_l2_bitmap = l2_bitmap = get_l2_bitmap(s, l2_slice, l2_index);
+
+    l2_bitmap &= ~alloc_range;
+    if (full_discard) {
+        l2_bitmap &= ~zero_range;
+    } else if (bs->backing || (old_l2_bitmap & alloc_range)) {
+        l2_bitmap |= zero_range;
+    }
+
+    if (old_l2_bitmap != l2_bitmap) {
+        set_l2_bitmap(s, l2_slice, l2_index, l2_bitmap);
+        qcow2_cache_entry_mark_dirty(s->l2_table_cache, l2_slice);
+    }
+
+    if (cluster_type == QCOW2_CLUSTER_NORMAL &&
+        (old_l2_bitmap & alloc_range) && s->discard_passthrough[type]) {
+        bdrv_pdiscard(s->data_file, (l2_entry & L2E_OFFSET_MASK) +
+                      (uint64_t) sc * s->subcluster_size,
+                      (uint64_t) nb_subclusters * s->subcluster_size);
+    }
+
+    ret = 0;
+out:
+    qcow2_cache_put(s->l2_table_cache, (void **) &l2_slice);
+
+    return ret;
+}
+
 int qcow2_cluster_discard(BlockDriverState *bs, uint64_t offset,
                           uint64_t bytes, enum qcow2_discard_type type,
                           bool full_discard)
@@ -1999,18 +2074,44 @@ int qcow2_cluster_discard(BlockDriverState *bs, uint64_t offset,
     BDRVQcow2State *s = bs->opaque;
     uint64_t end_offset = offset + bytes;
     uint64_t nb_clusters;
+    unsigned head, tail;
     int64_t cleared;
     int ret;
 
-    /* Caller must pass aligned values, except at image end */
-    assert(QEMU_IS_ALIGNED(offset, s->cluster_size));
-    assert(QEMU_IS_ALIGNED(end_offset, s->cluster_size) ||
-           end_offset == bs->total_sectors << BDRV_SECTOR_BITS);
+    /*
+     * Caller must pass aligned values, except at image end.  With
+     * subclusters, partial clusters can be discarded as well.
+     */
+    if (has_subclusters(s)) {
+        assert(offset_into_subcluster(s, offset) == 0);
+        assert(offset_into_subcluster(s, end_offset) == 0 ||
+               end_offset == bs->total_sectors << BDRV_SECTOR_BITS);
+    } else {
+        assert(QEMU_IS_ALIGNED(offset, s->cluster_size));
+        assert(QEMU_IS_ALIGNED(end_offset, s->cluster_size) ||
+               end_offset == bs->total_sectors << BDRV_SECTOR_BITS);
+    }
+
+    head = MIN(end_offset, ROUND_UP(offset, s->cluster_size)) - offset;
+    offset += head;
 
-    nb_clusters = size_to_clusters(s, bytes);
+    tail = (end_offset >= bs->total_sectors << BDRV_SECTOR_BITS) ? 0 :
+        end_offset - MAX(offset, start_of_cluster(s, end_offset));
+    end_offset -= tail;
 
     s->cache_discards = true;
 
+    if (head) {
+        ret = discard_l2_subclusters(bs, offset - head,
+                                     size_to_subclusters(s, head), type,
+                                     full_discard);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    nb_clusters = size_to_clusters(s, end_offset - offset);
+
     /* Each L2 slice is handled by its own loop iteration */
     while (nb_clusters > 0) {
         cleared = discard_in_l2_slice(bs, offset, nb_clusters, type,
@@ -2024,6 +2125,15 @@ int qcow2_cluster_discard(BlockDriverState *bs, uint64_t offset,
         offset += (cleared * s->cluster_size);
     }
 
+    if (tail) {
+        ret = discard_l2_subclusters(bs, end_offset,
+                                     size_to_subclusters(s, tail), type,
+                                     full_discard);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
     ret = 0;
 fail:
     s->cache_discards = false;
@@ -964,13 +964,73 @@ int qcow2_update_cluster_refcount(BlockDriverState *bs,
 
 
 
+/*
+ * Return how many of the @nb_clusters clusters starting at @cluster_index
+ * are free before the first one that is in use, or < 0 on error.  Each
+ * refcount block is looked up once for all the clusters it describes.
+ */
+static int64_t GRAPH_RDLOCK
+count_free_clusters(BlockDriverState *bs, uint64_t cluster_index,
+                    uint64_t nb_clusters)
+{
+    BDRVQcow2State *s = bs->opaque;
+    uint64_t i = 0;
+
+    while (i < nb_clusters) {
+        uint64_t index = cluster_index + i;
+        uint64_t refcount_table_index = index >> s->refcount_block_bits;
+        uint64_t block_index = index & (s->refcount_block_size - 1);
+        uint64_t n = MIN(nb_clusters - i,
+                         s->refcount_block_size - block_index);
+        int64_t refcount_block_offset;
+        void *refcount_block;
+        int ret;
+
+        if (refcount_table_index >= s->refcount_table_size) {
+            return nb_clusters;
+        }
+        refcount_block_offset =
+            s->refcount_table[refcount_table_index] & REFT_OFFSET_MASK;
+        if (!refcount_block_offset) {
+            i += n;
+            continue;
+        }
+
+        if (offset_into_cluster(s, refcount_block_offset)) {
+            qcow2_signal_corruption(bs, true, -1, -1, "Refblock offset %#"
+                                    PRIx64 " unaligned (reftable index: %#"
+                                    PRIx64 ")", refcount_block_offset,
+                                    refcount_table_index);
+            return -EIO;
+        }
+
+        ret = qcow2_cache_get(bs, s->refcount_block_cache,
+                              refcount_block_offset, &refcount_block);
+        if (ret < 0) {
+            return ret;
+        }
+        for (; n > 0; n--, block_index++, i++) {
+            if (s->get_refcount(refcount_block, block_index) != 0) {
+                break;
+            }
+        }
+        qcow2_cache_put(s->refcount_block_cache, &refcount_block);
+
+        if (n > 0) {
+            break;
+        }
+    }
+
+    return i;
+}
+
 /* return < 0 if error */
 static int64_t GRAPH_RDLOCK
 alloc_clusters_noref(BlockDriverState *bs, uint64_t size, uint64_t max)
 {
     BDRVQcow2State *s = bs->opaque;
-    uint64_t i, nb_clusters, refcount;
-    int ret;
+    uint64_t i, nb_clusters;
+    int64_t n;
 
     /* We can't allocate clusters if they may still be queued for discard. */
     if (s->cache_discards) {
@@ -978,15 +1038,19 @@ alloc_clusters_noref(BlockDriverState *bs, uint64_t size, uint64_t max)
     }
 
     nb_clusters = size_to_clusters(s, size);
-retry:
-    for(i = 0; i < nb_clusters; i++) {
-        uint64_t next_cluster_index = s->free_cluster_index++;
-        ret = qcow2_get_refcount(bs, next_cluster_index, &refcount);
+    i = 0;
+    while (i < nb_clusters) {
+        n = count_free_clusters(bs, s->free_cluster_index, nb_clusters - i);
+        if (n < 0) {
+            return n;
+        }
+        s->free_cluster_index += n;
+        i += n;
 
-        if (ret < 0) {
-            return ret;
-        } else if (refcount != 0) {
-            goto retry;
+        if (i < nb_clusters) {
+            /* Skip the cluster in use and start over behind it */
+            s->free_cluster_index++;
+            i = 0;
         }
     }
 
@@ -1032,8 +1096,7 @@ int64_t coroutine_fn qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offs
                                              int64_t nb_clusters)
 {
     BDRVQcow2State *s = bs->opaque;
-    uint64_t cluster_index, refcount;
-    uint64_t i;
+    int64_t i;
     int ret;
 
     assert(nb_clusters >= 0);
@@ -1043,14 +1106,9 @@ int64_t coroutine_fn qcow2_alloc_clusters_at(BlockDriverState *bs, uint64_t offs
 
     do {
         /* Check how many clusters there are free */
-        cluster_index = offset >> s->cluster_bits;
-        for(i = 0; i < nb_clusters; i++) {
-            ret = qcow2_get_refcount(bs, cluster_index++, &refcount);
-            if (ret < 0) {
-                return ret;
-            } else if (refcount != 0) {
-                break;
-            }
+        i = count_free_clusters(bs, offset >> s->cluster_bits, nb_clusters);
+        if (i < 0) {
+            return i;
         }
 
         /* And then allocate them */
@@ -2828,6 +2828,7 @@ qcow2_do_close(BlockDriverState *bs, bool close_data_file)
         bdrv_graph_rdlock_main_loop();
     }
 
+    qcow2_decompressed_cache_invalidate(bs);
     qcow2_refcount_close(bs);
     qcow2_free_snapshots(bs);
 }
@@ -4127,11 +4128,27 @@ qcow2_co_pdiscard(BlockDriverState *bs, int64_t offset, int64_t bytes)
     }
 
     if (!QEMU_IS_ALIGNED(offset | bytes, s->cluster_size)) {
+        uint64_t end_offset = offset + bytes;
+
         assert(bytes < s->cluster_size);
-        /* Ignore partial clusters, except for the special case of the
-         * complete partial cluster at the end of an unaligned file */
-        if (!QEMU_IS_ALIGNED(offset, s->cluster_size) ||
-            offset + bytes != bs->total_sectors * BDRV_SECTOR_SIZE) {
+        if (has_subclusters(s)) {
+            /*
+             * Discard the whole subclusters in the range by updating just
+             * the L2 bitmap, and ignore the partial ones at either end,
+             * except for the partial subcluster at the end of the image.
+             */
+            if (end_offset != bs->total_sectors * BDRV_SECTOR_SIZE) {
+                end_offset = QEMU_ALIGN_DOWN(end_offset, s->subcluster_size);
+            }
+            offset = QEMU_ALIGN_UP(offset, s->subcluster_size);
+            if (end_offset <= offset) {
+                return -ENOTSUP;
+            }
+            bytes = end_offset - offset;
+        } else if (!QEMU_IS_ALIGNED(offset, s->cluster_size) ||
+                   end_offset != bs->total_sectors * BDRV_SECTOR_SIZE) {
+            /* Ignore partial clusters, except for the special case of the
+             * complete partial cluster at the end of an unaligned file */
             return -ENOTSUP;
         }
     }
@@ -4818,6 +4835,61 @@ qcow2_co_pwritev_compressed_part(BlockDriverState *bs,
     return ret;
 }
 
+/*
+ * Drop all decompressed clusters.  Must be called whenever the space of a
+ * compressed cluster may be reused for other compressed data.
+ */
+void qcow2_decompressed_cache_invalidate(BlockDriverState *bs)
+{
+    BDRVQcow2State *s = bs->opaque;
+    int i;
+
+    for (i = 0; i < QCOW2_DECOMPRESSED_CACHE_SIZE; i++) {
+        qemu_vfree(s->decompressed[i].buf);
+        s->decompressed[i].buf = NULL;
+        s->decompressed[i].coffset = 0;
+    }
+    s->decompressed_generation++;
+}
+
+static Qcow2DecompressedCluster *
+qcow2_decompressed_cache_find(BDRVQcow2State *s, uint64_t coffset)
+{
+    int i;
+
+    for (i = 0; i < QCOW2_DECOMPRESSED_CACHE_SIZE; i++) {
+        if (s->decompressed[i].coffset == coffset) {
+            s->decompressed[i].lru_counter = ++s->decompressed_lru_counter;
+            return &s->decompressed[i];
+        }
+    }
+    return NULL;
+}
+
+/* Take ownership of @buf, which holds the cluster compressed at @coffset */
+static void qcow2_decompressed_cache_add(BDRVQcow2State *s, uint64_t coffset,
+                                         void *buf)
+{
+    Qcow2DecompressedCluster *victim = &s->decompressed[0];
+    int i;
+
+    for (i = 1; i < QCOW2_DECOMPRESSED_CACHE_SIZE; i++) {
+        if (s->decompressed[i].lru_counter < victim->lru_counter) {
+            victim = &s->decompressed[i];
+        }
+    }
+
+    qemu_vfree(victim->buf);
+    victim->buf = buf;
+    victim->coffset = coffset;
+    victim->lru_counter = ++s->decompressed_lru_counter;
+}
+
+/*
+ * Guest reads are often smaller than a cluster, so keep the last few
+ * decompressed clusters around instead of decompressing the same cluster
+ * again for each part of a sequential read.
+ */
 static int coroutine_fn GRAPH_RDLOCK
 qcow2_co_preadv_compressed(BlockDriverState *bs,
                            uint64_t l2_entry,
@@ -4828,12 +4900,24 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 {
     BDRVQcow2State *s = bs->opaque;
     int ret = 0, csize;
-    uint64_t coffset;
+    uint64_t coffset, generation;
     uint8_t *buf, *out_buf;
     int offset_in_cluster = offset_into_cluster(s, offset);
+    Qcow2DecompressedCluster *cached;
 
     qcow2_parse_compressed_l2_entry(bs, l2_entry, &coffset, &csize);
 
+    qemu_co_mutex_lock(&s->lock);
+    cached = qcow2_decompressed_cache_find(s, coffset);
+    if (cached) {
+        qemu_iovec_from_buf(qiov, qiov_offset,
+                            (uint8_t *)cached->buf + offset_in_cluster, bytes);
+        qemu_co_mutex_unlock(&s->lock);
+        return 0;
+    }
+    generation = s->decompressed_generation;
+    qemu_co_mutex_unlock(&s->lock);
+
     buf = g_try_malloc(csize);
     if (!buf) {
         return -ENOMEM;
@@ -4854,6 +4938,14 @@ qcow2_co_preadv_compressed(BlockDriverState *bs,
 
     qemu_iovec_from_buf(qiov, qiov_offset, out_buf + offset_in_cluster, bytes);
 
+    qemu_co_mutex_lock(&s->lock);
+    if (generation == s->decompressed_generation &&
+        !qcow2_decompressed_cache_find(s, coffset)) {
+        qcow2_decompressed_cache_add(s, coffset, out_buf);
+        out_buf = NULL;
+    }
+    qemu_co_mutex_unlock(&s->lock);
+
 fail:
     qemu_vfree(out_buf);
     g_free(buf);
@@ -324,6 +324,15 @@ typedef struct Qcow2BitmapHeaderExt {
 
 #define QCOW2_MAX_THREADS 4
 
+/* Number of decompressed clusters kept by qcow2_co_preadv_compressed() */
+#define QCOW2_DECOMPRESSED_CACHE_SIZE 8
+
+typedef struct Qcow2DecompressedCluster {
+    uint64_t coffset;   /* host offset of the compressed data, 0 if unused */
+    uint64_t lru_counter;
+    void *buf;
+} Qcow2DecompressedCluster;
+
 typedef struct BDRVQcow2State {
     int cluster_bits;
     int cluster_size;
@@ -411,6 +420,11 @@ typedef struct BDRVQcow2State {
     CoQueue thread_task_queue;
     int nb_threads;
 
+    /* Protected by lock */
+    Qcow2DecompressedCluster decompressed[QCOW2_DECOMPRESSED_CACHE_SIZE];
+    uint64_t decompressed_lru_counter;
+    uint64_t decompressed_generation;
+
     BdrvChild *data_file;
 
     bool metadata_preallocation_checked;
@@ -1058,6 +1072,8 @@ bool qcow2_supports_persistent_dirty_bitmap(BlockDriverState *bs);
 uint64_t qcow2_get_persistent_dirty_bitmap_size(BlockDriverState *bs,
                                                 uint32_t cluster_size);
 
+void qcow2_decompressed_cache_invalidate(BlockDriverState *bs);
+
 ssize_t coroutine_fn
 qcow2_co_compress(BlockDriverState *bs, void *dest, size_t dest_size,
                   const void *src, size_t src_size);
@@ -282,6 +282,32 @@ fail:
     return ret;
 }
 
+static int GRAPH_RDLOCK
+raw_preadv_nowait(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                  QEMUIOVector *qiov)
+{
+    if (raw_adjust_offset(bs, &offset, bytes, false)) {
+        /* Let raw_co_preadv() report the error */
+        return -EAGAIN;
+    }
+
+    return bdrv_try_preadv_nowait(bs->file, offset, bytes, qiov);
+}
+
+static int GRAPH_RDLOCK
+raw_pwritev_nowait(BlockDriverState *bs, int64_t offset, int64_t bytes,
+                   QEMUIOVector *qiov)
+{
+    if (bs->probed && offset < BLOCK_PROBE_BUF_SIZE) {
+        return -EAGAIN;
+    }
+    if (raw_adjust_offset(bs, &offset, bytes, true)) {
+        return -EAGAIN;
+    }
+
+    return bdrv_try_pwritev_nowait(bs->file, offset, bytes, qiov);
+}
+
 static int coroutine_fn GRAPH_RDLOCK
 raw_co_block_status(BlockDriverState *bs, bool want_zero, int64_t offset,
                     int64_t bytes, int64_t *pnum, int64_t *map,
@@ -648,6 +674,8 @@ BlockDriver bdrv_raw = {
     .bdrv_co_create_opts  = &raw_co_create_opts,
     .bdrv_co_preadv       = &raw_co_preadv,
     .bdrv_co_pwritev      = &raw_co_pwritev,
+    .bdrv_preadv_nowait   = &raw_preadv_nowait,
+    .bdrv_pwritev_nowait  = &raw_pwritev_nowait,
     .bdrv_co_pwrite_zeroes = &raw_co_pwrite_zeroes,
     .bdrv_co_pdiscard     = &raw_co_pdiscard,
     .bdrv_co_zone_report  = &raw_co_zone_report,
@@ -39,6 +39,9 @@ static void throttle_group_obj_init(Object *obj);
 static void throttle_group_obj_complete(UserCreatable *obj, Error **errp);
 static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
 
+/* How much of the group's limits a member may reserve at once, in ns */
+#define THROTTLE_GROUP_CREDIT_NS (10 * SCALE_MS)
+
 /* The ThrottleGroup structure (with its ThrottleState) is shared
  * among different ThrottleGroupMembers and it's independent from
  * AioContext, so in order to use it from different threads it needs
@@ -62,6 +65,12 @@ static void timer_cb(ThrottleGroupMember *tgm, ThrottleDirection direction);
  * blk_set_aio_context()). Therefore in this file a thread will
  * access some other ThrottleGroupMember's timers only after verifying that
  * that ThrottleGroupMember has throttled requests in the queue.
+ *
+ * To keep members in different AioContexts from contending on the lock,
+ * a member that is not being throttled reserves a few milliseconds' worth
+ * of the group's limits as its 'credit'.  Its following requests consume
+ * that credit with atomic operations and only take the lock once it is
+ * used up or expired, or as soon as any request in the group has to wait.
  */
 struct ThrottleGroup {
     Object parent_obj;
@@ -350,6 +359,112 @@ static void coroutine_mixed_fn schedule_next_request(ThrottleGroupMember *tgm,
     }
 }
 
+/* Give back the unused credit of a ThrottleGroupMember to the group.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_return_credit(ThrottleGroupMember *tgm,
+                                         ThrottleDirection direction)
+{
+    intptr_t bytes, ops;
+
+    /* Zero the ops first, so that no new request can consume bytes */
+    ops = qatomic_xchg(&tgm->credit[direction].ops, 0);
+    bytes = qatomic_xchg(&tgm->credit[direction].bytes, 0);
+    if (ops > 0 && bytes > 0) {
+        throttle_unreserve(tgm->throttle_state, direction, bytes, ops);
+    }
+}
+
+/* Replace the credit of a ThrottleGroupMember with a new reservation from
+ * the group's limits.  Nothing is reserved while requests wait in the group,
+ * so that they keep being served in round-robin order.
+ *
+ * This assumes that tg->lock is held.
+ *
+ * @tgm:       the ThrottleGroupMember
+ * @direction: the ThrottleDirection
+ */
+static void throttle_group_renew_credit(ThrottleGroupMember *tgm,
+                                        ThrottleDirection direction)
+{
+    ThrottleState *ts = tgm->throttle_state;
+    ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    intptr_t bytes, ops;
+
+    throttle_group_return_credit(tgm, direction);
+
+    if (tg->any_timer_armed[direction] || tgm->pending_reqs[direction] ||
+        qatomic_read(&tgm->io_limits_disabled)) {
+        return;
+    }
+    if (!throttle_reserve(ts, tg->clock_type, direction,
+                          THROTTLE_GROUP_CREDIT_NS, &bytes, &ops)) {
+        return;
+    }
+
+    qatomic_set_i64(&tgm->credit[direction].expire_ns,
+                    qemu_clock_get_ns(tg->clock_type) +
+                    THROTTLE_GROUP_CREDIT_NS);
+    qatomic_set(&tgm->credit[direction].bytes, bytes);
+    /* Pairs with qatomic_read() in throttle_group_consume_credit() */
+    qatomic_store_release(&tgm->credit[direction].ops, ops);
+}
+
+/* Try to let an I/O request through on the credit of its
+ * ThrottleGroupMember, without taking tg->lock.
+ *
+ * @tgm:       the current ThrottleGroupMember
+ * @bytes:     the number of bytes for this I/O
+ * @direction: the ThrottleDirection
+ * @ret:       whether the request could be accounted to the credit
+ */
+static bool throttle_group_consume_credit(ThrottleGroupMember *tgm,
+                                          int64_t bytes,
+                                          ThrottleDirection direction)
+{
+    ThrottleGroup *tg = container_of(tgm->throttle_state, ThrottleGroup, ts);
+    intptr_t *credit_ops = &tgm->credit[direction].ops;
+    intptr_t *credit_bytes = &tgm->credit[direction].bytes;
+    intptr_t old, seen;
+
+    /* Waiting requests go first */
+    if (qatomic_read(&tgm->pending_reqs[direction]) ||
+        qatomic_read(&tg->any_timer_armed[direction])) {
+        return false;
+    }
+
+    old = qatomic_load_acquire(credit_ops);
+    do {
+        if (old <= 0) {
+            return false;
+        }
+        seen = old;
+        old = qatomic_cmpxchg(credit_ops, seen, seen - 1);
+    } while (old != seen);
+
+    if (qemu_clock_get_ns(tg->clock_type) >=
+        qatomic_read_i64(&tgm->credit[direction].expire_ns)) {
+        qatomic_inc(credit_ops);
+        return false;
+    }
+
+    old = qatomic_read(credit_bytes);
+    do {
+        if (old < bytes) {
+            qatomic_inc(credit_ops);
+            return false;
+        }
+        seen = old;
+        old = qatomic_cmpxchg(credit_bytes, seen, seen - bytes);
+    } while (old != seen);
+
+    return true;
+}
+
 /* Check if an I/O request needs to be throttled, wait and set a timer
  * if necessary, and schedule the next request using a round robin
  * algorithm.
@@ -369,6 +484,10 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     assert(bytes >= 0);
     assert(direction < THROTTLE_MAX);
 
+    if (throttle_group_consume_credit(tgm, bytes, direction)) {
+        return;
+    }
+
     qemu_mutex_lock(&tg->lock);
 
     /* First we check if this I/O has to be throttled. */
@@ -377,14 +496,14 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
 
     /* Wait if there's a timer set or queued requests of this type */
     if (must_wait || tgm->pending_reqs[direction]) {
-        tgm->pending_reqs[direction]++;
+        qatomic_inc(&tgm->pending_reqs[direction]);
         qemu_mutex_unlock(&tg->lock);
         qemu_co_mutex_lock(&tgm->throttled_reqs_lock);
         qemu_co_queue_wait(&tgm->throttled_reqs[direction],
                            &tgm->throttled_reqs_lock);
         qemu_co_mutex_unlock(&tgm->throttled_reqs_lock);
         qemu_mutex_lock(&tg->lock);
-        tgm->pending_reqs[direction]--;
+        qatomic_dec(&tgm->pending_reqs[direction]);
     }
 
     /* The I/O will be executed, so do the accounting */
@@ -393,6 +512,9 @@ void coroutine_fn throttle_group_co_io_limits_intercept(ThrottleGroupMember *tgm
     /* Schedule the next request */
     schedule_next_request(tgm, direction);
 
+    /* Let the next requests of this member skip the lock if possible */
+    throttle_group_renew_credit(tgm, direction);
+
     qemu_mutex_unlock(&tg->lock);
 }
 
@@ -476,7 +598,16 @@ void throttle_group_config(ThrottleGroupMember *tgm, ThrottleConfig *cfg)
 {
     ThrottleState *ts = tgm->throttle_state;
     ThrottleGroup *tg = container_of(ts, ThrottleGroup, ts);
+    ThrottleGroupMember *iter;
+    ThrottleDirection dir;
+
     qemu_mutex_lock(&tg->lock);
+    /* Credit was reserved from the old limits, so drop it */
+    QLIST_FOREACH(iter, &tg->head, round_robin) {
+        for (dir = THROTTLE_READ; dir < THROTTLE_MAX; dir++) {
+            throttle_group_return_credit(iter, dir);
+        }
+    }
     throttle_config(ts, tg->clock_type, cfg);
     qemu_mutex_unlock(&tg->lock);
 
@@ -602,6 +733,7 @@ void throttle_group_unregister_tgm(ThrottleGroupMember *tgm)
             assert(tgm->pending_reqs[dir] == 0);
             assert(qemu_co_queue_empty(&tgm->throttled_reqs[dir]));
             assert(!timer_pending(tgm->throttle_timers.timers[dir]));
+            throttle_group_return_credit(tgm, dir);
             if (tg->tokens[dir] == tgm) {
                 token = throttle_group_next_tgm(tgm);
                 /* Take care of the case where this is the last tgm in the group */
@@ -648,6 +780,7 @@ void throttle_group_detach_aio_context(ThrottleGroupMember *tgm)
                 tg->any_timer_armed[dir] = false;
                 schedule_next_request(tgm, dir);
             }
+            throttle_group_return_credit(tgm, dir);
         }
     }
 
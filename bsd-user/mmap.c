@@ -65,7 +65,9 @@ void mmap_fork_end(int child)
 int target_mprotect(abi_ulong start, abi_ulong len, int prot)
 {
     abi_ulong end, host_start, host_end, addr;
-    int prot1, ret;
+    abi_ulong starts[3], lasts[3];
+    int prot1, ret, prots[3], nranges = 0;
+    int wmask;
 
     qemu_log_mask(CPU_LOG_PAGE, "mprotect: start=0x" TARGET_ABI_FMT_lx
                   " len=0x" TARGET_ABI_FMT_lx " prot=%c%c%c\n", start, len,
@@ -85,6 +87,17 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
     mmap_lock();
     host_start = start & qemu_host_page_mask;
     host_end = HOST_PAGE_ALIGN(end);
+
+    /*
+     * page_set_flags() keeps pages with translated code read-only when
+     * they become writable, so that the first write still faults into
+     * page_unprotect().  Until it has done so, do not let other threads
+     * write to pages that may hold translations.
+     */
+    wmask = (prot & PROT_WRITE) &&
+            page_check_range_any(host_start, host_end - 1, PAGE_EXEC) ?
+            ~PROT_WRITE : ~0;
+
     if (start > host_start) {
         /* handle host page containing start */
         prot1 = prot;
@@ -98,9 +111,12 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
             end = host_end;
         }
         ret = mprotect(g2h_untagged(host_start),
-                       qemu_host_page_size, prot1 & PAGE_RWX);
+                       qemu_host_page_size, prot1 & PAGE_RWX & wmask);
         if (ret != 0)
             goto error;
+        starts[nranges] = host_start;
+        lasts[nranges] = host_start + qemu_host_page_size - 1;
+        prots[nranges++] = prot1 & PAGE_RWX;
         host_start += qemu_host_page_size;
     }
     if (end < host_end) {
@@ -109,19 +125,34 @@ int target_mprotect(abi_ulong start, abi_ulong len, int prot)
             prot1 |= page_get_flags(addr);
         }
         ret = mprotect(g2h_untagged(host_end - qemu_host_page_size),
-                       qemu_host_page_size, prot1 & PAGE_RWX);
+                       qemu_host_page_size, prot1 & PAGE_RWX & wmask);
         if (ret != 0)
             goto error;
+        starts[nranges] = host_end - qemu_host_page_size;
+        lasts[nranges] = host_end - 1;
+        prots[nranges++] = prot1 & PAGE_RWX;
         host_end -= qemu_host_page_size;
     }
 
     /* handle the pages in the middle */
     if (host_start < host_end) {
-        ret = mprotect(g2h_untagged(host_start), host_end - host_start, prot);
+        ret = mprotect(g2h_untagged(host_start), host_end - host_start,
+                       prot & wmask);
         if (ret != 0)
             goto error;
+        starts[nranges] = host_start;
+        lasts[nranges] = host_end - 1;
+        prots[nranges++] = prot;
     }
     page_set_flags(start, start + len - 1, prot | PAGE_VALID);
+
+    for (int i = 0; i < nranges && wmask != ~0; i++) {
+        if (prots[i] & PROT_WRITE) {
+            ret = page_set_host_writable(starts[i], lasts[i], prots[i]);
+            if (ret != 0)
+                goto error;
+        }
+    }
     mmap_unlock();
     return 0;
 error:
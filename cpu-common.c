@@ -22,18 +22,34 @@
 #include "exec/cpu-common.h"
 #include "hw/core/cpu.h"
 #include "qemu/lockable.h"
+#include "qemu/stats64.h"
+#include "qemu/timer.h"
 #include "trace/trace-root.h"
 
 QemuMutex qemu_cpu_list_lock;
-static QemuCond exclusive_cond;
-static QemuCond exclusive_resume;
+static QemuEvent exclusive_done;
+static QemuEvent exclusive_resume;
 static QemuCond qemu_work_cond;
 
-/* >= 1 if a thread is inside start_exclusive/end_exclusive.  Written
- * under qemu_cpu_list_lock, read with atomic operations.
+/* >= 1 if a thread is inside start_exclusive/end_exclusive.  Only the
+ * thread that moved it from 0 to 1 may write it, except for the
+ * decrements of the CPUs that it waits for; read with atomic operations.
  */
 static int pending_cpus;
 
+static const char *const exclusive_cause_names[EXCLUSIVE_CAUSE__MAX] = {
+    [EXCLUSIVE_CAUSE_OTHER] = "other",
+    [EXCLUSIVE_CAUSE_STEP_ATOMIC] = "atomic step",
+    [EXCLUSIVE_CAUSE_SAFE_WORK] = "safe work",
+};
+
+static struct {
+    Stat64 count;
+    /* Time spent waiting for the other CPUs to stop, in ns */
+    Stat64 wait_ns;
+    Stat64 max_wait_ns;
+} exclusive_stats[EXCLUSIVE_CAUSE__MAX];
+
 void qemu_init_cpu_list(void)
 {
     /* This is needed because qemu_init_cpu_list is also called by the
@@ -41,8 +57,8 @@ void qemu_init_cpu_list(void)
     pending_cpus = 0;
 
     qemu_mutex_init(&qemu_cpu_list_lock);
-    qemu_cond_init(&exclusive_cond);
-    qemu_cond_init(&exclusive_resume);
+    qemu_event_init(&exclusive_done, false);
+    qemu_event_init(&exclusive_resume, true);
     qemu_cond_init(&qemu_work_cond);
 }
 
@@ -177,21 +193,33 @@ void async_run_on_cpu(CPUState *cpu, run_on_cpu_func func, run_on_cpu_data data)
     queue_work_on_cpu(cpu, wi);
 }
 
-/* Wait for pending exclusive operations to complete.  The CPU list lock
-   must be held.  */
+/* Wait for pending exclusive operations to complete.  */
 static inline void exclusive_idle(void)
 {
-    while (pending_cpus) {
-        qemu_cond_wait(&exclusive_resume, &qemu_cpu_list_lock);
+    while (qatomic_read(&pending_cpus)) {
+        qemu_event_wait(&exclusive_resume);
+    }
+}
+
+/*
+ * Called once cpu->running is false: if start_exclusive is waiting for
+ * @cpu, uncount it.  Both the CPU and start_exclusive can notice that it
+ * stopped; whoever clears has_waiter does the uncounting.
+ */
+static void exclusive_release(CPUState *cpu)
+{
+    if (qatomic_xchg(&cpu->has_waiter, false) &&
+        qatomic_fetch_dec(&pending_cpus) == 2) {
+        qemu_event_set(&exclusive_done);
     }
 }
 
 /* Start an exclusive operation.
    Must only be called from outside cpu_exec.  */
-void start_exclusive(void)
+void start_exclusive_cause(ExclusiveCause cause)
 {
     CPUState *other_cpu;
-    int running_cpus;
+    int64_t start, wait_ns;
 
     /* Ensure we are not running, or start_exclusive will be blocked. */
     g_assert(!current_cpu->running);
@@ -201,34 +229,59 @@ void start_exclusive(void)
         return;
     }
 
-    qemu_mutex_lock(&qemu_cpu_list_lock);
-    exclusive_idle();
-
-    /* Make all other cpus stop executing.  */
-    qatomic_set(&pending_cpus, 1);
+    start = get_clock();
+    do {
+        exclusive_idle();
+    } while (qatomic_cmpxchg(&pending_cpus, 0, 1) != 0);
+    qemu_event_reset(&exclusive_resume);
 
     /* Write pending_cpus before reading other_cpu->running.  */
     smp_mb();
-    running_cpus = 0;
-    CPU_FOREACH(other_cpu) {
-        if (qatomic_read(&other_cpu->running)) {
-            other_cpu->has_waiter = true;
-            running_cpus++;
-            qemu_cpu_kick(other_cpu);
+    WITH_QEMU_LOCK_GUARD(&qemu_cpu_list_lock) {
+        CPU_FOREACH(other_cpu) {
+            if (!qatomic_read(&other_cpu->running)) {
+                continue;
+            }
+
+            /* Count the CPU before it can see has_waiter and uncount it */
+            qatomic_inc(&pending_cpus);
+            qatomic_set(&other_cpu->has_waiter, true);
+
+            /*
+             * Write has_waiter before reading other_cpu->running: if the
+             * CPU stopped in the meantime, it may have missed has_waiter.
+             */
+            smp_mb();
+            if (!qatomic_read(&other_cpu->running)) {
+                exclusive_release(other_cpu);
+            } else {
+                qemu_cpu_kick(other_cpu);
+            }
         }
     }
 
-    qatomic_set(&pending_cpus, running_cpus + 1);
-    while (pending_cpus > 1) {
-        qemu_cond_wait(&exclusive_cond, &qemu_cpu_list_lock);
+    for (;;) {
+        qemu_event_reset(&exclusive_done);
+        if (qatomic_read(&pending_cpus) == 1) {
+            break;
+        }
+        qemu_event_wait(&exclusive_done);
     }
 
-    /* Can release mutex, no one will enter another exclusive
-     * section until end_exclusive resets pending_cpus to 0.
+    /* No one will enter another exclusive section until end_exclusive
+     * resets pending_cpus to 0.
      */
-    qemu_mutex_unlock(&qemu_cpu_list_lock);
-
     current_cpu->exclusive_context_count = 1;
+
+    wait_ns = get_clock() - start;
+    stat64_inc(&exclusive_stats[cause].count);
+    stat64_add(&exclusive_stats[cause].wait_ns, wait_ns);
+    stat64_max(&exclusive_stats[cause].max_wait_ns, wait_ns);
+}
+
+void start_exclusive(void)
+{
+    start_exclusive_cause(EXCLUSIVE_CAUSE_OTHER);
 }
 
 /* Finish an exclusive operation.  */
@@ -239,49 +292,43 @@ void end_exclusive(void)
         return;
     }
 
-    qemu_mutex_lock(&qemu_cpu_list_lock);
-    qatomic_set(&pending_cpus, 0);
-    qemu_cond_broadcast(&exclusive_resume);
-    qemu_mutex_unlock(&qemu_cpu_list_lock);
+    qatomic_store_release(&pending_cpus, 0);
+    qemu_event_set(&exclusive_resume);
 }
 
 /* Wait for exclusive ops to finish, and begin cpu execution.  */
 void cpu_exec_start(CPUState *cpu)
 {
-    qatomic_set(&cpu->running, true);
-
-    /* Write cpu->running before reading pending_cpus.  */
-    smp_mb();
-
-    /* 1. start_exclusive saw cpu->running == true and pending_cpus >= 1.
-     * After taking the lock we'll see cpu->has_waiter == true and run---not
-     * for long because start_exclusive kicked us.  cpu_exec_end will
-     * decrement pending_cpus and signal the waiter.
-     *
-     * 2. start_exclusive saw cpu->running == false but pending_cpus >= 1.
-     * This includes the case when an exclusive item is running now.
-     * Then we'll see cpu->has_waiter == false and wait for the item to
-     * complete.
-     *
-     * 3. pending_cpus == 0.  Then start_exclusive is definitely going to
-     * see cpu->running == true, and it will kick the CPU.
-     */
-    if (unlikely(qatomic_read(&pending_cpus))) {
-        QEMU_LOCK_GUARD(&qemu_cpu_list_lock);
-        if (!cpu->has_waiter) {
-            /* Not counted in pending_cpus, let the exclusive item
-             * run.  Since we have the lock, just set cpu->running to true
-             * while holding it; no need to check pending_cpus again.
-             */
-            qatomic_set(&cpu->running, false);
-            exclusive_idle();
-            /* Now pending_cpus is zero.  */
-            qatomic_set(&cpu->running, true);
-        } else {
-            /* Counted in pending_cpus, go ahead and release the
-             * waiter at cpu_exec_end.
-             */
+    for (;;) {
+        qatomic_set(&cpu->running, true);
+
+        /* Write cpu->running before reading pending_cpus.  */
+        smp_mb();
+
+        /* 1. start_exclusive saw cpu->running == true and pending_cpus >= 1.
+         * We'll see cpu->has_waiter == true and run---not for long because
+         * start_exclusive kicked us.  cpu_exec_end will decrement
+         * pending_cpus and signal the waiter.
+         *
+         * 2. start_exclusive saw cpu->running == false but pending_cpus >= 1.
+         * This includes the case when an exclusive item is running now.
+         * Then we'll see cpu->has_waiter == false and wait for the item to
+         * complete.  start_exclusive may still set has_waiter after that,
+         * in which case it is released like by cpu_exec_end.
+         *
+         * 3. pending_cpus == 0.  Then start_exclusive is definitely going to
+         * see cpu->running == true, and it will kick the CPU.
+         */
+        if (likely(!qatomic_read(&pending_cpus)) ||
+            qatomic_read(&cpu->has_waiter)) {
+            return;
         }
+
+        /* Not counted in pending_cpus, let the exclusive item run.  */
+        qatomic_set(&cpu->running, false);
+        smp_mb();
+        exclusive_release(cpu);
+        exclusive_idle();
     }
 }
 
@@ -290,12 +337,13 @@ void cpu_exec_end(CPUState *cpu)
 {
     qatomic_set(&cpu->running, false);
 
-    /* Write cpu->running before reading pending_cpus.  */
+    /* Write cpu->running before reading pending_cpus and has_waiter.  */
     smp_mb();
 
     /* 1. start_exclusive saw cpu->running == true.  Then it will increment
-     * pending_cpus and wait for exclusive_cond.  After taking the lock
-     * we'll see cpu->has_waiter == true.
+     * pending_cpus, set has_waiter and wait for exclusive_done.  If we do
+     * not see has_waiter == true here, it sees cpu->running == false and
+     * releases itself.
      *
      * 2. start_exclusive saw cpu->running == false but here pending_cpus >= 1.
      * This includes the case when an exclusive item started after setting
@@ -309,14 +357,25 @@ void cpu_exec_end(CPUState *cpu)
      * next cpu_exec_start.
      */
     if (unlikely(qatomic_read(&pending_cpus))) {
-        QEMU_LOCK_GUARD(&qemu_cpu_list_lock);
-        if (cpu->has_waiter) {
-            cpu->has_waiter = false;
-            qatomic_set(&pending_cpus, pending_cpus - 1);
-            if (pending_cpus == 1) {
-                qemu_cond_signal(&exclusive_cond);
-            }
+        exclusive_release(cpu);
+    }
+}
+
+void exclusive_dump_stats(GString *buf)
+{
+    int i;
+
+    for (i = 0; i < EXCLUSIVE_CAUSE__MAX; i++) {
+        uint64_t count = stat64_get(&exclusive_stats[i].count);
+
+        if (!count) {
+            continue;
         }
+        g_string_append_printf(buf, "Exclusive sections (%s) %" PRIu64
+                               ", stop avg %" PRIu64 " ns max %" PRIu64
+                               " ns\n", exclusive_cause_names[i], count,
+                               stat64_get(&exclusive_stats[i].wait_ns) / count,
+                               stat64_get(&exclusive_stats[i].max_wait_ns));
     }
 }
 
@@ -366,7 +425,7 @@ void process_queued_cpu_work(CPUState *cpu)
              * neither CPU can proceed.
              */
             bql_unlock();
-            start_exclusive();
+            start_exclusive_cause(EXCLUSIVE_CAUSE_SAFE_WORK);
             wi->func(cpu, wi->data);
             end_exclusive();
             bql_lock();
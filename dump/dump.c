@@ -527,6 +527,19 @@ static void write_data(DumpState *s, void *buf, int length, Error **errp)
     }
 }
 
+/*
+ * Leave a hole of @length bytes in the vmcore.  The file system does not
+ * allocate it, and it reads back as zeroes.
+ */
+static void skip_data(DumpState *s, int length, Error **errp)
+{
+    if (lseek(s->fd, length, SEEK_CUR) < 0) {
+        error_setg_errno(errp, errno, "dump: failed to save memory");
+    } else {
+        s->written_size += length;
+    }
+}
+
 /* write the memory to vmcore. 1 page per I/O. */
 static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
                          int64_t size, Error **errp)
@@ -535,8 +548,13 @@ static void write_memory(DumpState *s, GuestPhysBlock *block, ram_addr_t start,
     int64_t i;
 
     for (i = 0; i < size / s->dump_info.page_size; i++) {
-        write_data(s, block->host_addr + start + i * s->dump_info.page_size,
-                   s->dump_info.page_size, errp);
+        uint8_t *page = block->host_addr + start + i * s->dump_info.page_size;
+
+        if (s->sparse && buffer_is_zero(page, s->dump_info.page_size)) {
+            skip_data(s, s->dump_info.page_size, errp);
+        } else {
+            write_data(s, page, s->dump_info.page_size, errp);
+        }
         if (*errp) {
             return;
         }
@@ -798,10 +816,25 @@ static void dump_end(DumpState *s, Error **errp)
     write_elf_sections(s, errp);
 }
 
+/*
+ * Zero pages can be left as holes only when writing to a file that
+ * starts out empty; a pipe or socket cannot seek, and an existing file
+ * would keep its old contents in the holes.
+ */
+static bool dump_can_be_sparse(DumpState *s)
+{
+    struct stat st;
+
+    return fstat(s->fd, &st) == 0 && S_ISREG(st.st_mode) &&
+           st.st_size == 0 && lseek(s->fd, 0, SEEK_CUR) == 0;
+}
+
 static void create_vmcore(DumpState *s, Error **errp)
 {
     ERRP_GUARD();
 
+    s->sparse = dump_can_be_sparse(s);
+
     dump_begin(s, errp);
     if (*errp) {
         return;
@@ -815,6 +848,14 @@ static void create_vmcore(DumpState *s, Error **errp)
 
     /* Write the section data */
     dump_end(s, errp);
+    if (*errp) {
+        return;
+    }
+
+    /* The dump may end in a hole, which does not extend the file. */
+    if (s->sparse && ftruncate(s->fd, lseek(s->fd, 0, SEEK_CUR)) < 0) {
+        error_setg_errno(errp, errno, "dump: failed to save memory");
+    }
 }
 
 static int write_start_flat_header(DumpState *s)
@@ -1470,21 +1511,199 @@ static size_t get_len_buf_out(size_t page_size, uint32_t flag_compress)
     return 0;
 }
 
+/*
+ * Number of pages compressed together by the compression threads,
+ * before the results are written out in order.
+ */
+#define DUMP_COMPRESS_BATCH_PAGES 1024
+#define DUMP_COMPRESS_MAX_THREADS 8
+
+typedef struct DumpPageSlot {
+    uint8_t *buf;               /* page contents, guest RAM or @copy */
+    uint8_t *copy;              /* for pages that are not contiguous */
+    uint8_t *out;               /* compressed data */
+    uint32_t flags;             /* DUMP_DH_COMPRESSED_*, or 0 if plain */
+    size_t size;                /* size of the page data, 0 if zero page */
+} DumpPageSlot;
+
+typedef struct DumpCompressThread DumpCompressThread;
+
+typedef struct DumpCompressPool {
+    DumpState *state;
+    DumpPageSlot *slots;
+    size_t nr_slots;            /* number of used slots in this batch */
+    size_t len_buf_out;
+    int nr_threads;
+    DumpCompressThread *threads;
+    QemuSemaphore done;
+    bool quit;
+} DumpCompressPool;
+
+struct DumpCompressThread {
+    DumpCompressPool *pool;
+    QemuThread thread;
+    QemuSemaphore start;
+    int index;
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+};
+
+/*
+ * Compress one page with the format selected by s->flag_compress.
+ * When compression fails to work, we fall back to save in plaintext.
+ */
+static void dump_compress_page(DumpCompressThread *t, DumpPageSlot *slot)
+{
+    DumpState *s = t->pool->state;
+    size_t page_size = s->dump_info.page_size;
+    size_t size_out = t->pool->len_buf_out;
+
+    if (buffer_is_zero(slot->buf, page_size)) {
+        slot->size = 0;
+        return;
+    }
+
+    if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
+        (compress2(slot->out, (uLongf *)&size_out, slot->buf,
+                   page_size, Z_BEST_SPEED) == Z_OK) &&
+        (size_out < page_size)) {
+        slot->flags = DUMP_DH_COMPRESSED_ZLIB;
+        slot->size = size_out;
+#ifdef CONFIG_LZO
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
+               (lzo1x_1_compress(slot->buf, page_size, slot->out,
+                                 (lzo_uint *)&size_out,
+                                 t->wrkmem) == LZO_E_OK) &&
+               (size_out < page_size)) {
+        slot->flags = DUMP_DH_COMPRESSED_LZO;
+        slot->size = size_out;
+#endif
+#ifdef CONFIG_SNAPPY
+    } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
+               (snappy_compress((char *)slot->buf, page_size,
+                                (char *)slot->out, &size_out) == SNAPPY_OK) &&
+               (size_out < page_size)) {
+        slot->flags = DUMP_DH_COMPRESSED_SNAPPY;
+        slot->size = size_out;
+#endif
+    } else {
+        slot->flags = 0;
+        slot->size = page_size;
+    }
+}
+
+/* Compress every nr_threads-th slot of the batch, starting at t->index. */
+static void dump_compress_slots(DumpCompressThread *t)
+{
+    DumpCompressPool *pool = t->pool;
+
+    for (size_t i = t->index; i < pool->nr_slots; i += pool->nr_threads) {
+        dump_compress_page(t, &pool->slots[i]);
+    }
+}
+
+static void *dump_compress_thread(void *opaque)
+{
+    DumpCompressThread *t = opaque;
+    DumpCompressPool *pool = t->pool;
+
+    while (true) {
+        qemu_sem_wait(&t->start);
+        if (pool->quit) {
+            break;
+        }
+        dump_compress_slots(t);
+        qemu_sem_post(&pool->done);
+    }
+    return NULL;
+}
+
+static void dump_compress_pool_init(DumpCompressPool *pool, DumpState *s,
+                                    size_t len_buf_out)
+{
+    size_t page_size = s->dump_info.page_size;
+
+    pool->state = s;
+    pool->len_buf_out = len_buf_out;
+    pool->nr_slots = 0;
+    pool->quit = false;
+    pool->slots = g_new0(DumpPageSlot, DUMP_COMPRESS_BATCH_PAGES);
+    for (size_t i = 0; i < DUMP_COMPRESS_BATCH_PAGES; i++) {
+        pool->slots[i].copy = g_malloc(page_size);
+        pool->slots[i].out = g_malloc(len_buf_out);
+    }
+
+    /* Thread 0 is the dump thread itself. */
+    pool->nr_threads = MIN(g_get_num_processors(), DUMP_COMPRESS_MAX_THREADS);
+    pool->threads = g_new0(DumpCompressThread, pool->nr_threads);
+    qemu_sem_init(&pool->done, 0);
+    for (int i = 0; i < pool->nr_threads; i++) {
+        DumpCompressThread *t = &pool->threads[i];
+
+        t->pool = pool;
+        t->index = i;
+#ifdef CONFIG_LZO
+        t->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+#endif
+        if (i) {
+            qemu_sem_init(&t->start, 0);
+            qemu_thread_create(&t->thread, "dump_compress",
+                               dump_compress_thread, t,
+                               QEMU_THREAD_JOINABLE);
+        }
+    }
+}
+
+/* Compress all pages of the current batch. */
+static void dump_compress_pool_run(DumpCompressPool *pool)
+{
+    for (int i = 1; i < pool->nr_threads; i++) {
+        qemu_sem_post(&pool->threads[i].start);
+    }
+    dump_compress_slots(&pool->threads[0]);
+    for (int i = 1; i < pool->nr_threads; i++) {
+        qemu_sem_wait(&pool->done);
+    }
+}
+
+static void dump_compress_pool_destroy(DumpCompressPool *pool)
+{
+    pool->quit = true;
+    for (int i = 0; i < pool->nr_threads; i++) {
+        DumpCompressThread *t = &pool->threads[i];
+
+        if (i) {
+            qemu_sem_post(&t->start);
+            qemu_thread_join(&t->thread);
+            qemu_sem_destroy(&t->start);
+        }
+#ifdef CONFIG_LZO
+        g_free(t->wrkmem);
+#endif
+    }
+    qemu_sem_destroy(&pool->done);
+    g_free(pool->threads);
+
+    for (size_t i = 0; i < DUMP_COMPRESS_BATCH_PAGES; i++) {
+        g_free(pool->slots[i].copy);
+        g_free(pool->slots[i].out);
+    }
+    g_free(pool->slots);
+}
+
 static void write_dump_pages(DumpState *s, Error **errp)
 {
     int ret = 0;
     DataCache page_desc, page_data;
-    size_t len_buf_out, size_out;
-#ifdef CONFIG_LZO
-    lzo_bytep wrkmem = NULL;
-#endif
-    uint8_t *buf_out = NULL;
+    size_t len_buf_out;
+    DumpCompressPool pool;
     off_t offset_desc, offset_data;
     PageDescriptor pd, pd_zero;
     uint8_t *buf;
     GuestPhysBlock *block_iter = NULL;
     uint64_t pfn_iter;
-    g_autofree uint8_t *page = NULL;
+    bool more = true;
 
     /* get offset of page_desc and page_data in dump file */
     offset_desc = s->offset_page;
@@ -1497,11 +1716,7 @@ static void write_dump_pages(DumpState *s, Error **errp)
     len_buf_out = get_len_buf_out(s->dump_info.page_size, s->flag_compress);
     assert(len_buf_out != 0);
 
-#ifdef CONFIG_LZO
-    wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
-#endif
-
-    buf_out = g_malloc(len_buf_out);
+    dump_compress_pool_init(&pool, s, len_buf_out);
 
     /*
      * init zero page's page_desc and page_data, because every zero page
@@ -1520,103 +1735,64 @@ static void write_dump_pages(DumpState *s, Error **errp)
     }
 
     offset_data += s->dump_info.page_size;
-    page = g_malloc(s->dump_info.page_size);
 
     /*
      * dump memory to vmcore page by page. zero page will all be resided in the
-     * first page of page section
+     * first page of page section.  Pages are gathered in batches that are
+     * compressed in parallel, then written out in order, so the output is
+     * the same as if the pages were compressed one at a time.
      */
-    for (buf = page; get_next_page(&block_iter, &pfn_iter, &buf, s); buf = page) {
-        /* check zero page */
-        if (buffer_is_zero(buf, s->dump_info.page_size)) {
-            ret = write_cache(&page_desc, &pd_zero, sizeof(PageDescriptor),
-                              false);
-            if (ret < 0) {
-                error_setg(errp, "dump: failed to write page desc");
-                goto out;
+    while (more) {
+        pool.nr_slots = 0;
+        while (pool.nr_slots < DUMP_COMPRESS_BATCH_PAGES) {
+            DumpPageSlot *slot = &pool.slots[pool.nr_slots];
+
+            slot->buf = slot->copy;
+            if (!get_next_page(&block_iter, &pfn_iter, &slot->buf, s)) {
+                more = false;
+                break;
             }
-        } else {
-            /*
-             * not zero page, then:
-             * 1. compress the page
-             * 2. write the compressed page into the cache of page_data
-             * 3. get page desc of the compressed page and write it into the
-             *    cache of page_desc
-             *
-             * only one compression format will be used here, for
-             * s->flag_compress is set. But when compression fails to work,
-             * we fall back to save in plaintext.
-             */
-             size_out = len_buf_out;
-             if ((s->flag_compress & DUMP_DH_COMPRESSED_ZLIB) &&
-                    (compress2(buf_out, (uLongf *)&size_out, buf,
-                               s->dump_info.page_size, Z_BEST_SPEED) == Z_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_ZLIB);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#ifdef CONFIG_LZO
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_LZO) &&
-                    (lzo1x_1_compress(buf, s->dump_info.page_size, buf_out,
-                    (lzo_uint *)&size_out, wrkmem) == LZO_E_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_LZO);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-#ifdef CONFIG_SNAPPY
-            } else if ((s->flag_compress & DUMP_DH_COMPRESSED_SNAPPY) &&
-                    (snappy_compress((char *)buf, s->dump_info.page_size,
-                    (char *)buf_out, &size_out) == SNAPPY_OK) &&
-                    (size_out < s->dump_info.page_size)) {
-                pd.flags = cpu_to_dump32(s, DUMP_DH_COMPRESSED_SNAPPY);
-                pd.size  = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf_out, size_out, false);
-                if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
-                    goto out;
-                }
-#endif
-            } else {
-                /*
-                 * fall back to save in plaintext, size_out should be
-                 * assigned the target's page size
-                 */
-                pd.flags = cpu_to_dump32(s, 0);
-                size_out = s->dump_info.page_size;
-                pd.size = cpu_to_dump32(s, size_out);
-
-                ret = write_cache(&page_data, buf,
-                                  s->dump_info.page_size, false);
+            pool.nr_slots++;
+        }
+
+        dump_compress_pool_run(&pool);
+
+        for (size_t i = 0; i < pool.nr_slots; i++) {
+            DumpPageSlot *slot = &pool.slots[i];
+
+            if (!slot->size) {
+                /* zero page */
+                ret = write_cache(&page_desc, &pd_zero,
+                                  sizeof(PageDescriptor), false);
                 if (ret < 0) {
-                    error_setg(errp, "dump: failed to write page data");
+                    error_setg(errp, "dump: failed to write page desc");
                     goto out;
                 }
+                s->written_size += s->dump_info.page_size;
+                continue;
+            }
+
+            ret = write_cache(&page_data, slot->flags ? slot->out : slot->buf,
+                              slot->size, false);
+            if (ret < 0) {
+                error_setg(errp, "dump: failed to write page data");
+                goto out;
             }
 
             /* get and write page desc here */
+            pd.flags = cpu_to_dump32(s, slot->flags);
+            pd.size = cpu_to_dump32(s, slot->size);
             pd.page_flags = cpu_to_dump64(s, 0);
             pd.offset = cpu_to_dump64(s, offset_data);
-            offset_data += size_out;
+            offset_data += slot->size;
 
             ret = write_cache(&page_desc, &pd, sizeof(PageDescriptor), false);
             if (ret < 0) {
                 error_setg(errp, "dump: failed to write page desc");
                 goto out;
             }
+            s->written_size += s->dump_info.page_size;
         }
-        s->written_size += s->dump_info.page_size;
     }
 
     ret = write_cache(&page_desc, NULL, 0, true);
@@ -1634,11 +1810,7 @@ out:
     free_data_cache(&page_desc);
     free_data_cache(&page_data);
 
-#ifdef CONFIG_LZO
-    g_free(wrkmem);
-#endif
-
-    g_free(buf_out);
+    dump_compress_pool_destroy(&pool);
 }
 
 static void create_kdump_vmcore(DumpState *s, Error **errp)
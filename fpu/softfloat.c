@@ -396,6 +396,85 @@ float64_gen2(float64 xa, float64 xb, float_status *s,
     return soft(ua.s, ub.s, s);
 }
 
+/*
+ * There is no portable host half-precision type, so float16 hardfloat
+ * computes in single precision and rounds the result to half precision.
+ * The double rounding is innocuous for +, -, *, / and sqrt because
+ * 24 >= 2 * 11 + 2 (see Figueroa, "When is double rounding innocuous?").
+ * This does not hold for fused multiply-add, which stays in softfloat.
+ */
+typedef float16 (*soft_f16_op2_fn)(float16 a, float16 b, float_status *s);
+typedef bool (*f16_check_fn)(float16 a, float16 b);
+
+static inline bool f16_is_zon(float16 a)
+{
+    return float16_is_zero(a) || float16_is_normal(a);
+}
+
+static inline bool f16_is_zon2(float16 a, float16 b)
+{
+    return f16_is_zon(a) && f16_is_zon(b);
+}
+
+/* Exact conversion of a zero or normal float16 */
+static inline float f16_to_hard(float16 a)
+{
+    uint32_t sign = (uint32_t)(float16_val(a) & 0x8000) << 16;
+    uint32_t rest = float16_val(a) & 0x7fff;
+    union_float32 u;
+
+    if (rest) {
+        rest = (rest + ((127 - 15) << 10)) << 13;
+    }
+    u.s = make_float32(sign | rest);
+    return u.h;
+}
+
+/*
+ * Round a single precision result to half precision, nearest-even.
+ * Anything that does not end up as a zero or a normal float16 is left
+ * to softfloat, which handles the underflow and overflow flags.
+ */
+static inline bool f16_from_hard(float h, float16 *ret)
+{
+    union_float32 u = { .h = h };
+    uint32_t v = float32_val(u.s);
+    uint16_t sign = (v >> 16) & 0x8000;
+    uint32_t rest = v & 0x7fffffff;
+    uint32_t m, round;
+
+    if (rest == 0) {
+        *ret = make_float16(sign);
+        return true;
+    }
+    if (rest < (127 - 14) << 23 || rest >= (127 + 16) << 23) {
+        return false;
+    }
+    m = (rest >> 13) - ((127 - 15) << 10);
+    round = rest & 0x1fff;
+    if (round > 0x1000 || (round == 0x1000 && (m & 1))) {
+        m++;
+    }
+    if (m >= 0x7c00) {
+        return false;
+    }
+    *ret = make_float16(sign | m);
+    return true;
+}
+
+static inline float16
+float16_gen2(float16 a, float16 b, float_status *s,
+             hard_f32_op2_fn hard, soft_f16_op2_fn soft, f16_check_fn pre)
+{
+    float16 r;
+
+    if (likely(can_use_fpu(s)) && likely(pre(a, b)) &&
+        likely(f16_from_hard(hard(f16_to_hard(a), f16_to_hard(b)), &r))) {
+        return r;
+    }
+    return soft(a, b, s);
+}
+
 /*
  * Classify a floating point number. Everything above float_class_qnan
  * is a NaN so cls >= float_class_qnan is any NaN.
@@ -1882,8 +1961,8 @@ static floatx80 floatx80_round_pack_canonical(FloatParts128 *p,
  * Addition and subtraction
  */
 
-static float16 QEMU_FLATTEN
-float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_addsub(float16 a, float16 b, float_status *status, bool subtract)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -1894,14 +1973,14 @@ float16_addsub(float16 a, float16 b, float_status *status, bool subtract)
     return float16_round_pack_canonical(pr, status);
 }
 
-float16 float16_add(float16 a, float16 b, float_status *status)
+static float16 soft_f16_add(float16 a, float16 b, float_status *status)
 {
-    return float16_addsub(a, b, status, false);
+    return soft_f16_addsub(a, b, status, false);
 }
 
-float16 float16_sub(float16 a, float16 b, float_status *status)
+static float16 soft_f16_sub(float16 a, float16 b, float_status *status)
 {
-    return float16_addsub(a, b, status, true);
+    return soft_f16_addsub(a, b, status, true);
 }
 
 static float32 QEMU_SOFTFLOAT_ATTR
@@ -1985,6 +2064,16 @@ static bool f64_addsubmul_post(union_float64 a, union_float64 b)
     }
 }
 
+float16 QEMU_FLATTEN float16_add(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_add, soft_f16_add, f16_is_zon2);
+}
+
+float16 QEMU_FLATTEN float16_sub(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_sub, soft_f16_sub, f16_is_zon2);
+}
+
 static float32 float32_addsub(float32 a, float32 b, float_status *s,
                               hard_f32_op2_fn hard, soft_f32_op2_fn soft)
 {
@@ -2117,7 +2206,8 @@ floatx80 floatx80_sub(floatx80 a, floatx80 b, float_status *status)
  * Multiplication
  */
 
-float16 QEMU_FLATTEN float16_mul(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_mul(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2162,6 +2252,11 @@ static double hard_f64_mul(double a, double b)
     return a * b;
 }
 
+float16 QEMU_FLATTEN float16_mul(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_mul, soft_f16_mul, f16_is_zon2);
+}
+
 float32 QEMU_FLATTEN
 float32_mul(float32 a, float32 b, float_status *s)
 {
@@ -2461,7 +2556,8 @@ float128 QEMU_FLATTEN float128_muladd(float128 a, float128 b, float128 c,
  * Division
  */
 
-float16 float16_div(float16 a, float16 b, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_div(float16 a, float16 b, float_status *status)
 {
     FloatParts64 pa, pb, *pr;
 
@@ -2540,6 +2636,16 @@ static bool f64_div_post(union_float64 a, union_float64 b)
     return !float64_is_zero(a.s);
 }
 
+static bool f16_div_pre(float16 a, float16 b)
+{
+    return f16_is_zon(a) && float16_is_normal(b);
+}
+
+float16 QEMU_FLATTEN float16_div(float16 a, float16 b, float_status *s)
+{
+    return float16_gen2(a, b, s, hard_f32_div, soft_f16_div, f16_div_pre);
+}
+
 float32 QEMU_FLATTEN
 float32_div(float32 a, float32 b, float_status *s)
 {
@@ -4638,7 +4744,8 @@ floatx80 floatx80_scalbn(floatx80 a, int n, float_status *status)
  * Square Root
  */
 
-float16 QEMU_FLATTEN float16_sqrt(float16 a, float_status *status)
+static float16 QEMU_SOFTFLOAT_ATTR
+soft_f16_sqrt(float16 a, float_status *status)
 {
     FloatParts64 p;
 
@@ -4647,6 +4754,18 @@ float16 QEMU_FLATTEN float16_sqrt(float16 a, float_status *status)
     return float16_round_pack_canonical(&p, status);
 }
 
+float16 QEMU_FLATTEN float16_sqrt(float16 a, float_status *s)
+{
+    float16 r;
+
+    if (likely(can_use_fpu(s)) && likely(f16_is_zon(a)) &&
+        !float16_is_neg(a) &&
+        likely(f16_from_hard(sqrtf(f16_to_hard(a)), &r))) {
+        return r;
+    }
+    return soft_f16_sqrt(a, s);
+}
+
 static float32 QEMU_SOFTFLOAT_ATTR
 soft_f32_sqrt(float32 a, float_status *status)
 {
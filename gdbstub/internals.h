@@ -11,7 +11,11 @@
 
 #include "exec/cpu-common.h"
 
-#define MAX_PACKET_LENGTH 4096
+/*
+ * Large enough for the 'g' packet of CPUs with big vector registers
+ * and for reading large chunks of memory in one round trip.
+ */
+#define MAX_PACKET_LENGTH 0x10000
 
 /*
  * Shared structures and definitions
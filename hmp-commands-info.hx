@@ -270,6 +270,36 @@ SRST
     Show dynamic compiler opcode counters
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tcg-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the samples of the TCG profiler",
+    },
+#endif
+
+SRST
+  ``info tcg-profile``
+    Show the samples of the TCG profiler, one line per guest PC and MMU
+    index in the folded stacks format of flame graph tools.
+ERST
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tlb-sample",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the heatmap of the TLB sampler",
+    },
+#endif
+
+SRST
+  ``info tlb-sample``
+    Show the heatmap of the TLB sampler, one line per sampled guest
+    physical page with its loads, stores, fetches and vCPUs.
+ERST
+
     {
         .name       = "sync-profile",
         .args_type  = "mean:-m,no_coalesce:-n,max:i?",
@@ -639,6 +639,44 @@ SRST
   whether profiling is on or off.
 ERST
 
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tcg-profile",
+        .args_type  = "op:s,frequency:i?",
+        .params     = "on|off [frequency]",
+        .help       = "start or stop sampling the guest code executed by TCG, "
+                      "frequency times per second (default: 99)",
+        .cmd        = hmp_tcg_profile,
+    },
+#endif
+
+SRST
+``tcg-profile on|off [frequency]``
+  Start or stop sampling the guest code executed by the vCPUs under TCG.
+  Starting drops the samples of the previous run.  The samples are shown
+  by ``info tcg-profile``.
+ERST
+
+#if defined(CONFIG_TCG)
+    {
+        .name       = "tlb-sample",
+        .args_type  = "op:s,frequency:i?,entries:i?",
+        .params     = "on|off [frequency [entries]]",
+        .help       = "start or stop sampling the guest pages accessed "
+                      "under TCG, by evicting entries TLB entries per vCPU "
+                      "frequency times per second (default: 100 and 8)",
+        .cmd        = hmp_tlb_sample,
+    },
+#endif
+
+SRST
+``tlb-sample on|off [frequency [entries]]``
+  Start or stop sampling the guest pages accessed by the vCPUs under
+  TCG, through the refills of random TLB entries that are evicted
+  periodically.  Starting drops the heatmap of the previous run.  The
+  heatmap is shown by ``info tlb-sample``.
+ERST
+
     {
         .name       = "system_reset",
         .args_type  = "",
@@ -17,6 +17,10 @@
 
 #include "qemu/osdep.h"
 #include "qemu/xattr.h"
+#include <sys/syscall.h>
+#ifdef HAVE_OPENAT2_H
+#include <linux/openat2.h>
+#endif
 #include "9p-util.h"
 
 ssize_t fgetxattrat_nofollow(int dirfd, const char *filename, const char *name,
@@ -68,3 +72,26 @@ int qemu_mknodat(int dirfd, const char *filename, mode_t mode, dev_t dev)
 {
     return mknodat(dirfd, filename, mode, dev);
 }
+
+int openat_dir_beneath(int dirfd, const char *path)
+{
+#if defined(HAVE_OPENAT2_H) && defined(__NR_openat2)
+    static bool unsupported;
+    struct open_how how = {
+        .flags = O_DIRECTORY | O_RDONLY | O_NOFOLLOW | O_PATH_9P_UTIL,
+        .resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS |
+                   RESOLVE_NO_MAGICLINKS,
+    };
+    int fd;
+
+    if (!qatomic_read(&unsupported)) {
+        fd = syscall(__NR_openat2, dirfd, path, &how, sizeof(how));
+        if (fd != -1 || errno != ENOSYS) {
+            return fd;
+        }
+        qatomic_set(&unsupported, true);
+    }
+#endif
+    errno = ENOSYS;
+    return -1;
+}
@@ -210,6 +210,16 @@ ssize_t flistxattrat_nofollow(int dirfd, const char *filename,
 ssize_t fremovexattrat_nofollow(int dirfd, const char *filename,
                                 const char *name);
 
+#ifdef CONFIG_LINUX
+/*
+ * Open the directory @path below @dirfd in a single openat2() call,
+ * failing with ELOOP if any of its components is a symlink and with
+ * EXDEV if it would leave @dirfd.  Fails with ENOSYS if the host kernel
+ * lacks openat2().
+ */
+int openat_dir_beneath(int dirfd, const char *path);
+#endif
+
 /*
  * Darwin has d_seekoff, which appears to function similarly to d_off.
  * However, it does not appear to be supported on all file systems,
@@ -26,6 +26,7 @@
 #include "system/block-ram-registrar.h"
 #include "system/system.h"
 #include "system/runstate.h"
+#include "system/stats.h"
 #include "hw/virtio/virtio-blk.h"
 #include "scsi/constants.h"
 #ifdef __linux__
@@ -49,23 +50,116 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
     req->in_len = 0;
     req->next = NULL;
     req->mr_next = NULL;
+    req->pop_time_ns = block_acct_clock_ns();
 }
 
-void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+static VirtIOBlockQueueStats *virtio_blk_queue_stats(VirtIOBlockReq *req)
 {
-    VirtIOBlock *s = req->dev;
-    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    return &req->dev->queue_stats[virtio_get_queue_index(req->vq)];
+}
 
-    trace_virtio_blk_req_complete(vdev, req, status);
+static void virtio_blk_req_set_status(VirtIOBlockReq *req,
+                                      unsigned char status)
+{
+    trace_virtio_blk_req_complete(VIRTIO_DEVICE(req->dev), req, status);
 
     stb_p(&req->in->status, status);
     iov_discard_undo(&req->inhdr_undo);
     iov_discard_undo(&req->outhdr_undo);
-    virtqueue_push(req->vq, &req->elem, req->in_len);
+}
+
+static void virtio_blk_notify_now(VirtIOBlock *s, VirtQueue *vq)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+
     if (qemu_in_iothread()) {
-        virtio_notify_irqfd(vdev, req->vq);
+        virtio_notify_irqfd(vdev, vq);
     } else {
-        virtio_notify(vdev, req->vq);
+        virtio_notify(vdev, vq);
+    }
+}
+
+/* Context: vq AioContext */
+static void virtio_blk_notify_coalesce_timer(void *opaque)
+{
+    VirtIOBlockNotifyCoalesce *nc = opaque;
+    VirtIOBlock *s = nc->dev;
+
+    nc->pending = 0;
+    virtio_blk_notify_now(s, nc->vq);
+
+    /* Paired with inc in virtio_blk_notify() */
+    blk_dec_in_flight(s->conf.conf.blk);
+}
+
+/*
+ * Notify the guest about @num new used buffers in @vq.  With
+ * notify-coalesce-usecs, the notification is delayed by up to that long,
+ * or until notify-coalesce-count completions are pending.  The timer
+ * counts as an in-flight request, so that drain delivers the notification.
+ *
+ * Context: vq AioContext
+ */
+static void virtio_blk_notify(VirtIOBlock *s, VirtQueue *vq, unsigned int num)
+{
+    VirtIOBlockNotifyCoalesce *nc;
+
+    if (!s->notify_coalesce) {
+        virtio_blk_notify_now(s, vq);
+        return;
+    }
+
+    nc = &s->notify_coalesce[virtio_get_queue_index(vq)];
+    nc->pending += num;
+    if (s->conf.notify_coalesce_count &&
+        nc->pending >= s->conf.notify_coalesce_count) {
+        if (timer_pending(nc->timer)) {
+            timer_del(nc->timer);
+            blk_dec_in_flight(s->conf.conf.blk);
+        }
+        nc->pending = 0;
+        virtio_blk_notify_now(s, vq);
+    } else if (!timer_pending(nc->timer)) {
+        /* Paired with dec in virtio_blk_notify_coalesce_timer() */
+        blk_inc_in_flight(s->conf.conf.blk);
+        timer_mod(nc->timer, qemu_clock_get_us(QEMU_CLOCK_REALTIME) +
+                             s->conf.notify_coalesce_usecs);
+    }
+}
+
+void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
+{
+    virtio_blk_req_set_status(req, status);
+    virtqueue_push(req->vq, &req->elem, req->in_len);
+    virtio_blk_notify(req->dev, req->vq, 1);
+}
+
+/*
+ * Push @num requests whose status is already set, all from the same
+ * virtqueue, with a single used index update and notification.  Frees
+ * the requests.
+ */
+static void virtio_blk_req_complete_batch(VirtIOBlockReq **reqs,
+                                          unsigned int num)
+{
+    VirtQueueElement *elems[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int lens[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i;
+
+    if (!num) {
+        return;
+    }
+
+    assert(num <= VIRTIO_BLK_MAX_MERGE_REQS);
+    for (i = 0; i < num; i++) {
+        elems[i] = &reqs[i]->elem;
+        lens[i] = reqs[i]->in_len;
+    }
+    virtqueue_fill_batch(reqs[0]->vq, elems, lens, num);
+    virtio_blk_notify(reqs[0]->dev, reqs[0]->vq, num);
+
+    for (i = 0; i < num; i++) {
+        g_free(reqs[i]);
     }
 }
 
@@ -101,12 +195,18 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
     VirtIOBlockReq *next = opaque;
     VirtIOBlock *s = next->dev;
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    VirtIOBlockReq *done[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int num_done = 0;
 
     while (next) {
         VirtIOBlockReq *req = next;
         next = req->mr_next;
         trace_virtio_blk_rw_complete(vdev, req, ret);
 
+        block_log2_histogram_account(&virtio_blk_queue_stats(req)->complete,
+                                     block_acct_clock_ns() -
+                                     req->submit_time_ns);
+
         if (req->qiov.nalloc != -1) {
             /* If nalloc is != -1 req->qiov is a local copy of the original
              * external iovec. It was allocated in submit_requests to be
@@ -130,10 +230,18 @@ static void virtio_blk_rw_complete(void *opaque, int ret)
             }
         }
 
-        virtio_blk_req_complete(req, VIRTIO_BLK_S_OK);
+        virtio_blk_req_set_status(req, VIRTIO_BLK_S_OK);
         block_acct_done(blk_get_stats(s->blk), &req->acct);
-        g_free(req);
+
+        if (num_done == ARRAY_SIZE(done) ||
+            (num_done && done[0]->vq != req->vq)) {
+            virtio_blk_req_complete_batch(done, num_done);
+            num_done = 0;
+        }
+        done[num_done++] = req;
     }
+
+    virtio_blk_req_complete_batch(done, num_done);
 }
 
 static void virtio_blk_flush_complete(void *opaque, int ret)
@@ -168,14 +276,18 @@ static void virtio_blk_discard_write_zeroes_complete(void *opaque, int ret)
     g_free(req);
 }
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
+/* Pop up to @max requests from @vq */
+static unsigned int virtio_blk_get_requests(VirtIOBlock *s, VirtQueue *vq,
+                                            VirtIOBlockReq **reqs,
+                                            unsigned int max)
 {
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
+    unsigned int i, num;
 
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
+    num = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq), (void **)reqs, max);
+    for (i = 0; i < num; i++) {
+        virtio_blk_init_request(s, vq, reqs[i]);
     }
-    return req;
+    return num;
 }
 
 static void virtio_blk_handle_scsi(VirtIOBlockReq *req)
@@ -221,9 +333,11 @@ static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
     int64_t sector_num = mrb->reqs[start]->sector_num;
     bool is_write = mrb->is_write;
     BdrvRequestFlags flags = 0;
+    VirtIOBlockQueueStats *qs = virtio_blk_queue_stats(mrb->reqs[start]);
+    int64_t submit_time_ns;
+    int i;
 
     if (num_reqs > 1) {
-        int i;
         struct iovec *tmp_iov = qiov->iov;
         int tmp_niov = qiov->niov;
 
@@ -255,6 +369,15 @@ static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
         flags |= BDRV_REQ_REGISTERED_BUF;
     }
 
+    submit_time_ns = block_acct_clock_ns();
+    for (i = start; i < start + num_reqs; i++) {
+        VirtIOBlockReq *req = mrb->reqs[i];
+
+        block_log2_histogram_account(&virtio_blk_queue_stats(req)->queue,
+                                     submit_time_ns - req->pop_time_ns);
+        req->submit_time_ns = submit_time_ns;
+    }
+
     if (is_write) {
         blk_aio_pwritev(blk, sector_num << BDRV_SECTOR_BITS, qiov,
                         flags, virtio_blk_rw_complete,
@@ -264,6 +387,10 @@ static inline void submit_requests(VirtIOBlock *s, MultiReqBuffer *mrb,
                        flags, virtio_blk_rw_complete,
                        mrb->reqs[start]);
     }
+
+    /* The requests may have completed already, don't look at them again */
+    block_log2_histogram_account(&qs->submit,
+                                 block_acct_clock_ns() - submit_time_ns);
 }
 
 static int multireq_compare(const void *a, const void *b)
@@ -978,10 +1105,32 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     return 0;
 }
 
+/* Context: AioContext of the virtqueues sharing the window */
+static void virtio_blk_merge_window_bh(void *opaque)
+{
+    VirtIOBlockMergeWindow *window = opaque;
+    VirtIOBlock *s = window->dev;
+
+    window->scheduled = false;
+    if (window->mrb.num_reqs) {
+        /* Let the BlockBackend batch the submission of the merged requests */
+        defer_call_begin();
+        virtio_blk_submit_multireq(s, &window->mrb);
+        defer_call_end();
+    }
+
+    /* Paired with inc in virtio_blk_handle_vq() */
+    blk_dec_in_flight(s->conf.conf.blk);
+}
+
 void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
-    MultiReqBuffer mrb = {};
+    VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
+    unsigned int i, num;
+    VirtIOBlockMergeWindow *window =
+        s->vq_merge_window[virtio_get_queue_index(vq)];
+    MultiReqBuffer local_mrb = {};
+    MultiReqBuffer *mrb = window ? &window->mrb : &local_mrb;
     bool suppress_notifications = virtio_queue_get_notification(vq);
 
     defer_call_begin();
@@ -991,10 +1140,19 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                g_free(req);
+        while ((num = virtio_blk_get_requests(s, vq, reqs,
+                                              ARRAY_SIZE(reqs)))) {
+            for (i = 0; i < num; i++) {
+                if (virtio_blk_handle_request(reqs[i], mrb)) {
+                    break;
+                }
+            }
+            if (i < num) {
+                /* The device is broken, drop the rest of the batch too */
+                for (; i < num; i++) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    g_free(reqs[i]);
+                }
                 break;
             }
         }
@@ -1004,8 +1162,21 @@ void virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
         }
     } while (!virtio_queue_empty(vq));
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s, &mrb);
+    if (!mrb->num_reqs) {
+        /* Nothing to submit */
+    } else if (!window) {
+        virtio_blk_submit_multireq(s, mrb);
+    } else if (!window->scheduled) {
+        /*
+         * Give the other virtqueues of this AioContext one event loop
+         * iteration to add adjacent requests.
+         */
+        window->scheduled = true;
+
+        /* Paired with dec in virtio_blk_merge_window_bh() */
+        blk_inc_in_flight(s->conf.conf.blk);
+        aio_bh_schedule_oneshot(qemu_get_current_aio_context(),
+                                virtio_blk_merge_window_bh, window);
     }
 
     defer_call_end();
@@ -1501,6 +1672,59 @@ static void virtio_blk_vq_aio_context_cleanup(VirtIOBlock *s)
     s->vq_aio_context = NULL;
 }
 
+/* Context: BQL held */
+static void virtio_blk_batching_init(VirtIOBlock *s)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    uint16_t num_queues = s->conf.num_queues;
+
+    if (s->conf.notify_coalesce_usecs) {
+        s->notify_coalesce = g_new0(VirtIOBlockNotifyCoalesce, num_queues);
+        for (uint16_t i = 0; i < num_queues; i++) {
+            VirtIOBlockNotifyCoalesce *nc = &s->notify_coalesce[i];
+
+            nc->dev = s;
+            nc->vq = virtio_get_queue(vdev, i);
+            nc->timer = aio_timer_new(s->vq_aio_context[i],
+                                      QEMU_CLOCK_REALTIME, SCALE_US,
+                                      virtio_blk_notify_coalesce_timer, nc);
+        }
+    }
+
+    /* Virtqueues sharing an AioContext share the window of the first one */
+    s->vq_merge_window = g_new0(VirtIOBlockMergeWindow *, num_queues);
+    if (!s->conf.request_merging) {
+        return;
+    }
+    s->merge_windows = g_new0(VirtIOBlockMergeWindow, num_queues);
+    for (uint16_t i = 0; i < num_queues; i++) {
+        for (uint16_t j = 0; j < i; j++) {
+            if (s->vq_aio_context[j] == s->vq_aio_context[i]) {
+                s->merge_windows[j].dev = s;
+                s->vq_merge_window[j] = &s->merge_windows[j];
+                s->vq_merge_window[i] = s->vq_merge_window[j];
+                break;
+            }
+        }
+    }
+}
+
+/* Context: BQL held, after blk_drain() */
+static void virtio_blk_batching_cleanup(VirtIOBlock *s)
+{
+    if (s->notify_coalesce) {
+        for (uint16_t i = 0; i < s->conf.num_queues; i++) {
+            timer_free(s->notify_coalesce[i].timer);
+        }
+    }
+    g_free(s->notify_coalesce);
+    s->notify_coalesce = NULL;
+    g_free(s->vq_merge_window);
+    s->vq_merge_window = NULL;
+    g_free(s->merge_windows);
+    s->merge_windows = NULL;
+}
+
 /* Context: BQL held */
 static int virtio_blk_start_ioeventfd(VirtIODevice *vdev)
 {
@@ -1725,6 +1949,11 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
                    conf->queue_size, VIRTQUEUE_MAX_SIZE);
         return;
     }
+    if (conf->notify_coalesce_count && !conf->notify_coalesce_usecs) {
+        error_setg(errp, "notify-coalesce-count property requires "
+                   "notify-coalesce-usecs");
+        return;
+    }
 
     if (!blkconf_apply_backend_options(&conf->conf,
                                        !blk_supports_write_perm(conf->conf.blk),
@@ -1780,6 +2009,7 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     for (i = 0; i < conf->num_queues; i++) {
         virtio_add_queue(vdev, conf->queue_size, virtio_blk_handle_output);
     }
+    s->queue_stats = g_new0(VirtIOBlockQueueStats, conf->num_queues);
     qemu_coroutine_inc_pool_size(conf->num_queues * conf->queue_size / 2);
 
     /* Don't start ioeventfd if transport does not support notifiers. */
@@ -1793,9 +2023,12 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
         for (i = 0; i < conf->num_queues; i++) {
             virtio_del_queue(vdev, i);
         }
+        g_free(s->queue_stats);
+        s->queue_stats = NULL;
         virtio_cleanup(vdev);
         return;
     }
+    virtio_blk_batching_init(s);
 
     /*
      * This must be after virtio_init() so virtio_blk_dma_restart_cb() gets
@@ -1824,10 +2057,13 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
 
     blk_drain(s->blk);
     del_boot_device_lchs(dev, "/disk@0,0");
+    virtio_blk_batching_cleanup(s);
     virtio_blk_vq_aio_context_cleanup(s);
     for (i = 0; i < conf->num_queues; i++) {
         virtio_del_queue(vdev, i);
     }
+    g_free(s->queue_stats);
+    s->queue_stats = NULL;
     qemu_coroutine_dec_pool_size(conf->num_queues * conf->queue_size / 2);
     qemu_mutex_destroy(&s->rq_lock);
     blk_ram_registrar_destroy(&s->blk_ram_registrar);
@@ -1884,6 +2120,10 @@ static const Property virtio_blk_properties[] = {
                        conf.max_write_zeroes_sectors, BDRV_REQUEST_MAX_SECTORS),
     DEFINE_PROP_BOOL("x-enable-wce-if-config-wce", VirtIOBlock,
                      conf.x_enable_wce_if_config_wce, true),
+    DEFINE_PROP_UINT32("notify-coalesce-usecs", VirtIOBlock,
+                       conf.notify_coalesce_usecs, 0),
+    DEFINE_PROP_UINT32("notify-coalesce-count", VirtIOBlock,
+                       conf.notify_coalesce_count, 0),
 };
 
 static void virtio_blk_class_init(ObjectClass *klass, void *data)
@@ -1916,9 +2156,162 @@ static const TypeInfo virtio_blk_info = {
     .class_size = sizeof(VirtIOBlkClass),
 };
 
+#define VIRTIO_BLK_STAT_VIRTQUEUE           "virtqueue"
+#define VIRTIO_BLK_STAT_QUEUE_LATENCY       "queue-latency"
+#define VIRTIO_BLK_STAT_SUBMIT_LATENCY      "submit-latency"
+#define VIRTIO_BLK_STAT_COMPLETE_LATENCY    "complete-latency"
+#define VIRTIO_BLK_STAT_VIRTQUEUE_DEPTH     "virtqueue-depth"
+
+static StatsList *virtio_blk_stats_add(StatsList *list, strList *names,
+                                       const char *name, StatsValue *value)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        qapi_free_StatsValue(value);
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = value;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+static StatsValue *virtio_blk_stats_histogram(BlockLog2Histogram *hist)
+{
+    StatsValue *value = g_new0(StatsValue, 1);
+    int i;
+
+    value->type = QTYPE_QLIST;
+    for (i = BLOCK_LOG2_HISTOGRAM_NBINS - 1; i >= 0; i--) {
+        QAPI_LIST_PREPEND(value->u.list, stat64_get(&hist->bins[i]));
+    }
+    return value;
+}
+
+typedef struct VirtIOBlockStatsArgs {
+    StatsResultList **result;
+    strList *names;
+    strList *targets;
+} VirtIOBlockStatsArgs;
+
+static int virtio_blk_stats_query(Object *obj, void *opaque)
+{
+    VirtIOBlockStatsArgs *args = opaque;
+    VirtIOBlock *s;
+    g_autofree char *path = NULL;
+    unsigned i;
+
+    if (!object_dynamic_cast(obj, TYPE_VIRTIO_BLK)) {
+        return 0;
+    }
+
+    s = VIRTIO_BLK(obj);
+    if (!s->queue_stats) {
+        return 0;
+    }
+
+    path = object_get_canonical_path(obj);
+    if (!apply_str_list_filter(path, args->targets)) {
+        return 0;
+    }
+
+    /* One result for each virtqueue, so that iothreads can be told apart */
+    for (i = 0; i < s->conf.num_queues; i++) {
+        VirtIOBlockQueueStats *qs = &s->queue_stats[i];
+        StatsValue *value = g_new0(StatsValue, 1);
+        StatsList *list = NULL;
+
+        value->type = QTYPE_QNUM;
+        value->u.scalar = i;
+        list = virtio_blk_stats_add(list, args->names,
+                                    VIRTIO_BLK_STAT_VIRTQUEUE, value);
+        value = g_new0(StatsValue, 1);
+        value->type = QTYPE_QNUM;
+        value->u.scalar = virtio_queue_get_inuse(VIRTIO_DEVICE(s), i);
+        list = virtio_blk_stats_add(list, args->names,
+                                    VIRTIO_BLK_STAT_VIRTQUEUE_DEPTH, value);
+        list = virtio_blk_stats_add(list, args->names,
+                                    VIRTIO_BLK_STAT_QUEUE_LATENCY,
+                                    virtio_blk_stats_histogram(&qs->queue));
+        list = virtio_blk_stats_add(list, args->names,
+                                    VIRTIO_BLK_STAT_SUBMIT_LATENCY,
+                                    virtio_blk_stats_histogram(&qs->submit));
+        list = virtio_blk_stats_add(list, args->names,
+                                    VIRTIO_BLK_STAT_COMPLETE_LATENCY,
+                                    virtio_blk_stats_histogram(&qs->complete));
+        if (list) {
+            add_stats_entry(args->result, STATS_PROVIDER_VIRTIO_BLK, path,
+                            list);
+        }
+    }
+    return 0;
+}
+
+static void virtio_blk_stats_cb(StatsResultList **result, StatsTarget target,
+                                strList *names, strList *targets,
+                                Error **errp)
+{
+    VirtIOBlockStatsArgs args = {
+        .result = result,
+        .names = names,
+        .targets = targets,
+    };
+
+    if (target != STATS_TARGET_BLOCK) {
+        return;
+    }
+    object_child_foreach_recursive(object_get_root(), virtio_blk_stats_query,
+                                   &args);
+}
+
+static StatsSchemaValueList *virtio_blk_schemas_add(StatsSchemaValueList *list,
+                                                    const char *name,
+                                                    StatsType type)
+{
+    StatsSchemaValueList *schema_entry = g_new0(StatsSchemaValueList, 1);
+
+    schema_entry->value = g_new0(StatsSchemaValue, 1);
+    schema_entry->value->type = type;
+    schema_entry->value->name = g_strdup(name);
+    if (type == STATS_TYPE_LOG2_HISTOGRAM) {
+        schema_entry->value->has_unit = true;
+        schema_entry->value->unit = STATS_UNIT_SECONDS;
+        schema_entry->value->has_base = true;
+        schema_entry->value->base = 10;
+        schema_entry->value->exponent = -9;
+    }
+    schema_entry->next = list;
+
+    return schema_entry;
+}
+
+static void virtio_blk_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    list = virtio_blk_schemas_add(list, VIRTIO_BLK_STAT_VIRTQUEUE,
+                                  STATS_TYPE_INSTANT);
+    list = virtio_blk_schemas_add(list, VIRTIO_BLK_STAT_VIRTQUEUE_DEPTH,
+                                  STATS_TYPE_INSTANT);
+    list = virtio_blk_schemas_add(list, VIRTIO_BLK_STAT_QUEUE_LATENCY,
+                                  STATS_TYPE_LOG2_HISTOGRAM);
+    list = virtio_blk_schemas_add(list, VIRTIO_BLK_STAT_SUBMIT_LATENCY,
+                                  STATS_TYPE_LOG2_HISTOGRAM);
+    list = virtio_blk_schemas_add(list, VIRTIO_BLK_STAT_COMPLETE_LATENCY,
+                                  STATS_TYPE_LOG2_HISTOGRAM);
+    add_stats_schema(result, STATS_PROVIDER_VIRTIO_BLK, STATS_TARGET_BLOCK,
+                     list);
+}
+
 static void virtio_register_types(void)
 {
     type_register_static(&virtio_blk_info);
+    add_stats_callbacks(STATS_PROVIDER_VIRTIO_BLK, virtio_blk_stats_cb,
+                        virtio_blk_schemas_cb);
 }
 
 type_init(virtio_register_types)
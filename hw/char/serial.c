@@ -30,6 +30,7 @@
 #include "migration/vmstate.h"
 #include "chardev/char-serial.h"
 #include "qapi/error.h"
+#include "qemu/main-loop.h"
 #include "qemu/timer.h"
 #include "system/reset.h"
 #include "system/runstate.h"
@@ -220,12 +221,57 @@ static void serial_update_msl(SerialState *s)
     }
 }
 
+/*
+ * Write the bytes that were shifted out of the TSR to the backend.
+ * Return false if some are left because the backend is busy.
+ */
+static bool serial_flush_out(SerialState *s)
+{
+    while (!fifo8_is_empty(&s->out_fifo)) {
+        const uint8_t *buf;
+        uint32_t len;
+        int rc;
+
+        buf = fifo8_peek_bufptr(&s->out_fifo, fifo8_num_used(&s->out_fifo),
+                                &len);
+        rc = qemu_chr_fe_write(&s->chr, buf, len);
+        if (rc == 0 || (rc == -1 && errno == EAGAIN)) {
+            return false;
+        }
+        /* Bytes that the backend failed to write are lost */
+        fifo8_drop(&s->out_fifo, rc > 0 ? rc : len);
+    }
+    return true;
+}
+
+static gboolean serial_watch_cb(void *do_not_use, GIOCondition cond,
+                                void *opaque);
+
+static void serial_out_bh(void *opaque)
+{
+    SerialState *s = opaque;
+
+    if (serial_flush_out(s) || s->watch_tag > 0) {
+        return;
+    }
+    s->watch_tag = qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                         serial_watch_cb, s);
+    if (s->watch_tag == 0) {
+        /* The backend will never accept them */
+        fifo8_reset(&s->out_fifo);
+    }
+}
+
 static gboolean serial_watch_cb(void *do_not_use, GIOCondition cond,
                                 void *opaque)
 {
     SerialState *s = opaque;
     s->watch_tag = 0;
-    serial_xmit(s);
+    if (s->tsr_retry > 0) {
+        serial_xmit(s);
+    } else {
+        serial_out_bh(s);
+    }
     return G_SOURCE_REMOVE;
 }
 
@@ -256,20 +302,32 @@ static void serial_xmit(SerialState *s)
             /* in loopback mode, say that we just received a char */
             serial_receive1(s, &s->tsr, 1);
         } else {
-            int rc = qemu_chr_fe_write(&s->chr, &s->tsr, 1);
-
-            if ((rc == 0 ||
-                 (rc == -1 && errno == EAGAIN)) &&
+            /*
+             * Leave writing to the backend to out_bh, so that the vCPU
+             * doesn't do a system call for every byte and the backend
+             * receives the output in batches.  Only hold off the guest
+             * when out_fifo is full and the backend is busy.
+             */
+            if (fifo8_is_full(&s->out_fifo)) {
+                serial_flush_out(s);
+            }
+            if (fifo8_is_full(&s->out_fifo) &&
                 s->tsr_retry < MAX_XMIT_RETRY) {
-                assert(s->watch_tag == 0);
-                s->watch_tag =
-                    qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
-                                          serial_watch_cb, s);
+                if (s->watch_tag == 0) {
+                    s->watch_tag =
+                        qemu_chr_fe_add_watch(&s->chr, G_IO_OUT | G_IO_HUP,
+                                              serial_watch_cb, s);
+                }
                 if (s->watch_tag > 0) {
                     s->tsr_retry++;
                     return;
                 }
             }
+            if (fifo8_is_full(&s->out_fifo)) {
+                fifo8_drop(&s->out_fifo, 1);
+            }
+            fifo8_push(&s->out_fifo, s->tsr);
+            qemu_bh_schedule(s->out_bh);
         }
         s->tsr_retry = 0;
 
@@ -351,10 +409,13 @@ static void serial_ioport_write(void *opaque, hwaddr addr, uint64_t val,
                 }
                 fifo8_push(&s->xmit_fifo, s->thr);
             }
-            s->thr_ipending = 0;
             s->lsr &= ~UART_LSR_THRE;
             s->lsr &= ~UART_LSR_TEMT;
-            serial_update_irq(s);
+            /* Nothing else that the interrupt depends on changed */
+            if (s->thr_ipending) {
+                s->thr_ipending = 0;
+                serial_update_irq(s);
+            }
             if (s->tsr_retry == 0) {
                 serial_xmit(s);
             }
@@ -632,6 +693,7 @@ static int serial_pre_save(void *opaque)
 {
     SerialState *s = opaque;
     s->fcr_vmstate = s->fcr;
+    serial_flush_out(s);
 
     return 0;
 }
@@ -679,6 +741,10 @@ static int serial_post_load(void *opaque, int version_id)
         }
     }
 
+    if (!fifo8_is_empty(&s->out_fifo)) {
+        qemu_bh_schedule(s->out_bh);
+    }
+
     s->last_break_enable = (s->lcr >> 6) & 1;
     /* Initialize fcr via setter to perform essential side-effects */
     serial_write_fcr(s, s->fcr_vmstate);
@@ -767,6 +833,23 @@ static const VMStateDescription vmstate_serial_xmit_fifo = {
     }
 };
 
+static bool serial_out_fifo_needed(void *opaque)
+{
+    SerialState *s = (SerialState *)opaque;
+    return !fifo8_is_empty(&s->out_fifo);
+}
+
+static const VMStateDescription vmstate_serial_out_fifo = {
+    .name = "serial/out_fifo",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = serial_out_fifo_needed,
+    .fields = (const VMStateField[]) {
+        VMSTATE_STRUCT(out_fifo, SerialState, 1, vmstate_fifo8, Fifo8),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static bool serial_fifo_timeout_timer_needed(void *opaque)
 {
     SerialState *s = (SerialState *)opaque;
@@ -844,6 +927,7 @@ const VMStateDescription vmstate_serial = {
         &vmstate_serial_tsr,
         &vmstate_serial_recv_fifo,
         &vmstate_serial_xmit_fifo,
+        &vmstate_serial_out_fifo,
         &vmstate_serial_fifo_timeout_timer,
         &vmstate_serial_timeout_ipending,
         &vmstate_serial_poll,
@@ -859,6 +943,8 @@ static void serial_reset(void *opaque)
         g_source_remove(s->watch_tag);
         s->watch_tag = 0;
     }
+    serial_flush_out(s);
+    fifo8_reset(&s->out_fifo);
 
     s->rbr = 0;
     s->ier = 0;
@@ -932,6 +1018,9 @@ static void serial_realize(DeviceState *dev, Error **errp)
                              serial_event, serial_be_change, s, NULL, true);
     fifo8_create(&s->recv_fifo, UART_FIFO_LENGTH);
     fifo8_create(&s->xmit_fifo, UART_FIFO_LENGTH);
+    fifo8_create(&s->out_fifo, SERIAL_OUT_FIFO_LENGTH);
+    s->out_bh = qemu_bh_new_guarded(serial_out_bh, s,
+                                    &dev->mem_reentrancy_guard);
     serial_reset(s);
 }
 
@@ -939,6 +1028,12 @@ static void serial_unrealize(DeviceState *dev)
 {
     SerialState *s = SERIAL(dev);
 
+    if (s->watch_tag > 0) {
+        g_source_remove(s->watch_tag);
+        s->watch_tag = 0;
+    }
+    qemu_bh_delete(s->out_bh);
+    serial_flush_out(s);
     qemu_chr_fe_deinit(&s->chr, false);
 
     timer_free(s->modem_status_poll);
@@ -947,6 +1042,7 @@ static void serial_unrealize(DeviceState *dev)
 
     fifo8_destroy(&s->recv_fifo);
     fifo8_destroy(&s->xmit_fifo);
+    fifo8_destroy(&s->out_fifo);
 
     qemu_unregister_reset(serial_reset, s);
 }
@@ -130,6 +130,7 @@ static void cpu_common_reset_hold(Object *obj, ResetType type)
     cpu->exception_index = -1;
     cpu->crash_occurred = false;
     cpu->cflags_next_tb = -1;
+    cpu->tb_tier_up_addr = -1;
 
     cpu_exec_reset_hold(cpu);
 }
@@ -23,6 +23,7 @@
 #include "exec/address-spaces.h"
 #include "exec/cputlb.h"
 #include "exec/memory.h"
+#include "exec/target_page.h"
 #include "exec/tb-flush.h"
 #include "exec/tswap.h"
 #include "hw/qdev-core.h"
@@ -81,6 +82,25 @@ hwaddr cpu_get_phys_page_debug(CPUState *cpu, vaddr addr)
     return cpu_get_phys_page_attrs_debug(cpu, addr, &attrs);
 }
 
+hwaddr cpu_get_phys_range_debug(CPUState *cpu, vaddr addr, vaddr *len,
+                                MemTxAttrs *attrs)
+{
+    vaddr page = addr & TARGET_PAGE_MASK;
+    hwaddr paddr;
+
+    if (cpu->cc->sysemu_ops->get_phys_range_debug) {
+        paddr = cpu->cc->sysemu_ops->get_phys_range_debug(cpu, addr, len,
+                                                          attrs);
+        attrs->debug = 1;
+        return paddr;
+    }
+
+    /* Fallback for CPUs which only translate one page at a time */
+    paddr = cpu_get_phys_page_attrs_debug(cpu, page, attrs);
+    *len = page + TARGET_PAGE_SIZE - addr;
+    return paddr == -1 ? -1 : paddr + (addr - page);
+}
+
 int cpu_asidx_from_attrs(CPUState *cpu, MemTxAttrs attrs)
 {
     int ret = 0;
@@ -267,6 +287,7 @@ static const VMStateDescription vmstate_cpu_common_crash_occurred = {
 
 const VMStateDescription vmstate_cpu_common = {
     .name = "cpu_common",
+    .parallel_save = true,
     .version_id = 1,
     .minimum_version_id = 1,
     .pre_load = cpu_common_pre_load,
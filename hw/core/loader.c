@@ -54,6 +54,7 @@
 #include "migration/cpr.h"
 #include "migration/vmstate.h"
 #include "monitor/monitor.h"
+#include "system/hostmem.h"
 #include "system/reset.h"
 #include "system/system.h"
 #include "uboot_image.h"
@@ -63,6 +64,7 @@
 #include "hw/boards.h"
 #include "qemu/cutils.h"
 #include "system/runstate.h"
+#include "system/tcg.h"
 #include "tcg/debuginfo.h"
 
 #include <zlib.h>
@@ -954,7 +956,7 @@ static QTAILQ_HEAD(, Rom) roms = QTAILQ_HEAD_INITIALIZER(roms);
 
 /*
  * rom->data can be heap-allocated or memory-mapped (e.g. when added with
- * rom_add_elf_program())
+ * rom_add_file() or rom_add_elf_program())
  */
 static void rom_free_data(Rom *rom)
 {
@@ -1047,6 +1049,7 @@ ssize_t rom_add_file(const char *file, const char *fw_dir,
     gsize size;
     g_autoptr(GError) gerr = NULL;
     char devpath[100];
+    int fd;
 
     if (as && mr) {
         fprintf(stderr, "Specifying an Address Space and Memory Region is " \
@@ -1063,12 +1066,28 @@ ssize_t rom_add_file(const char *file, const char *fw_dir,
         rom->path = g_strdup(file);
     }
 
-    if (!g_file_get_contents(rom->path, (gchar **) &rom->data,
-                             &size, &gerr)) {
+    /*
+     * Map the file rather than reading it into a heap buffer: large
+     * kernels and initrds then need no anonymous memory for the copy
+     * kept around for reset, and VMs booting the same image share its
+     * page cache.  The mapping is private and writable, because boards
+     * may patch the data through rom_ptr().
+     */
+    fd = open(rom->path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        fprintf(stderr, "rom: file %-20s: error %s\n",
+                rom->name, strerror(errno));
+        goto err;
+    }
+    rom->mapped_file = g_mapped_file_new_from_fd(fd, true, &gerr);
+    close(fd);
+    if (!rom->mapped_file) {
         fprintf(stderr, "rom: file %-20s: error %s\n",
                 rom->name, gerr->message);
         goto err;
     }
+    rom->data = (uint8_t *)g_mapped_file_get_contents(rom->mapped_file);
+    size = g_mapped_file_get_length(rom->mapped_file);
 
     if (fw_dir) {
         rom->fw_dir  = g_strdup(fw_dir);
@@ -1198,6 +1217,104 @@ ssize_t rom_add_option(const char *file, int32_t bootindex)
     return rom_add_file(file, "genroms", 0, bootindex, true, NULL, NULL);
 }
 
+/*
+ * A new mapping would not inherit what the memory backend of @rb applied to
+ * the original one: NUMA policy, preallocation, or per-backend merge and
+ * dump advice.  Neither would it be locked with -overcommit mem-lock.
+ */
+static bool rom_can_map_ram_block(RAMBlock *rb)
+{
+    Object *owner = memory_region_owner(rb->mr);
+    HostMemoryBackend *backend;
+
+    if (qemu_ram_is_shared(rb) || qemu_ram_get_fd(rb) >= 0 ||
+        qemu_ram_pagesize(rb) != qemu_real_host_page_size() ||
+        should_mlock(mlock_state)) {
+        return false;
+    }
+
+    backend = (HostMemoryBackend *)object_dynamic_cast(owner,
+                                                       TYPE_MEMORY_BACKEND);
+    return !backend ||
+           (backend->policy == HOST_MEM_POLICY_DEFAULT && !backend->prealloc &&
+            backend->merge == machine_mem_merge(current_machine) &&
+            backend->dump == machine_dump_guest_core(current_machine));
+}
+
+/*
+ * With "-machine rom-file-share=on", map the page-aligned head of the image
+ * file of @rom copy-on-write over the private anonymous guest RAM it is
+ * loaded into, so that its pages stay shared with the page cache (and with
+ * other VMs loading the same file) until the guest writes to them.
+ *
+ * Return the number of bytes of rom->data that are now in guest RAM.
+ */
+static size_t rom_map_file(Rom *rom)
+{
+#ifdef CONFIG_POSIX
+    size_t pagesize = qemu_real_host_page_size();
+    size_t len = QEMU_ALIGN_DOWN(rom->datasize, pagesize);
+    hwaddr xlat, mr_len = len;
+    ram_addr_t offset;
+    MemoryRegion *mr;
+    RAMBlock *rb;
+    struct stat st;
+    void *host;
+    int fd;
+
+    /*
+     * Replacing the mapping discards the previous contents of guest RAM
+     * behind the back of whoever pinned it, and TCG would keep translated
+     * code of the previous contents around.
+     */
+    if (!current_machine->rom_file_share || !len || !rom->path ||
+        !rom->mapped_file || current_machine->cgs || tcg_enabled() ||
+        rom->data != (uint8_t *)g_mapped_file_get_contents(rom->mapped_file) ||
+        ram_block_discard_is_disabled()) {
+        return 0;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    mr = address_space_translate(rom->as, rom->addr, &xlat, &mr_len, true,
+                                 MEMTXATTRS_UNSPECIFIED);
+    if (mr_len < len || !memory_region_is_ram(mr) ||
+        memory_region_is_ram_device(mr)) {
+        return 0;
+    }
+    host = memory_region_get_ram_ptr(mr) + xlat;
+    rb = qemu_ram_block_from_host(host, false, &offset);
+    if (!rb || !rom_can_map_ram_block(rb) ||
+        !QEMU_PTR_IS_ALIGNED(host, pagesize)) {
+        return 0;
+    }
+
+    fd = open(rom->path, O_RDONLY | O_BINARY);
+    if (fd < 0) {
+        return 0;
+    }
+    /* A file that shrank since it was loaded would fault in the guest. */
+    if (fstat(fd, &st) < 0 || st.st_size < rom->datasize) {
+        close(fd);
+        return 0;
+    }
+    if (qemu_ram_map_file_private(rb, offset, len, fd) < 0) {
+        close(fd);
+        return 0;
+    }
+    close(fd);
+
+    /* The ROM data may have been patched after it was loaded. */
+    if (memcmp(host, rom->data, len)) {
+        memcpy(host, rom->data, len);
+    }
+    memory_region_set_dirty(mr, xlat, len);
+    trace_loader_map_rom(rom->name, rom->addr, len);
+    return len;
+#else
+    return 0;
+#endif
+}
+
 static void rom_reset(void *unused)
 {
     Rom *rom;
@@ -1230,8 +1347,12 @@ static void rom_reset(void *unused)
             memcpy(host, rom->data, rom->datasize);
             memset(host + rom->datasize, 0, rom->romsize - rom->datasize);
         } else {
-            address_space_write_rom(rom->as, rom->addr, MEMTXATTRS_UNSPECIFIED,
-                                    rom->data, rom->datasize);
+            size_t mapped = rom_map_file(rom);
+
+            address_space_write_rom(rom->as, rom->addr + mapped,
+                                    MEMTXATTRS_UNSPECIFIED,
+                                    rom->data + mapped,
+                                    rom->datasize - mapped);
             address_space_set(rom->as, rom->addr + rom->datasize, 0,
                               rom->romsize - rom->datasize,
                               MEMTXATTRS_UNSPECIFIED);
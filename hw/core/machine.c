@@ -479,6 +479,20 @@ static void machine_set_aux_ram_share(Object *obj, bool value, Error **errp)
 
     ms->aux_ram_share = value;
 }
+
+static bool machine_get_rom_file_share(Object *obj, Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    return ms->rom_file_share;
+}
+
+static void machine_set_rom_file_share(Object *obj, bool value, Error **errp)
+{
+    MachineState *ms = MACHINE(obj);
+
+    ms->rom_file_share = value;
+}
 #endif
 
 static bool machine_get_usb(Object *obj, Error **errp)
@@ -1190,6 +1204,12 @@ static void machine_class_init(ObjectClass *oc, void *data)
     object_class_property_add_bool(oc, "aux-ram-share",
                                    machine_get_aux_ram_share,
                                    machine_set_aux_ram_share);
+
+    object_class_property_add_bool(oc, "rom-file-share",
+                                   machine_get_rom_file_share,
+                                   machine_set_rom_file_share);
+    object_class_property_set_description(oc, "rom-file-share",
+        "Map image files loaded into guest RAM copy-on-write");
 #endif
 
     object_class_property_add_bool(oc, "usb",
@@ -40,6 +40,7 @@
 #include "qemu/option.h"
 #include "qemu/config-file.h"
 #include "qemu/cutils.h"
+#include "qemu/thread-context.h"
 
 QemuOptsList qemu_numa_opts = {
     .name = "numa",
@@ -162,6 +163,19 @@ static void parse_numa_node(MachineState *ms, NumaNodeOptions *node,
         numa_info[nodenr].node_mem = object_property_get_uint(o, "size", NULL);
         numa_info[nodenr].node_memdev = MEMORY_BACKEND(o);
     }
+    if (node->thread_context) {
+        Object *o;
+        o = object_resolve_path_type(node->thread_context,
+                                     TYPE_THREAD_CONTEXT, NULL);
+        if (!o) {
+            error_setg(errp, "thread-context=%s is not a thread context",
+                       node->thread_context);
+            return;
+        }
+
+        object_ref(o);
+        numa_info[nodenr].thread_context = THREAD_CONTEXT(o);
+    }
 
     numa_info[nodenr].present = true;
     max_numa_nodeid = MAX(max_numa_nodeid, nodenr + 1);
@@ -755,6 +769,44 @@ void numa_cpu_pre_plug(const CPUArchId *slot, DeviceState *dev, Error **errp)
     }
 }
 
+void numa_cpu_set_thread_affinity(MachineState *ms, CPUState *cpu)
+{
+    MachineClass *mc = MACHINE_GET_CLASS(ms);
+    CpuInstanceProperties props;
+    ThreadContext *tc;
+    unsigned long *bitmap;
+    unsigned long nbits;
+    int ret;
+
+    if (!ms->numa_state || !ms->numa_state->num_nodes ||
+        !mc->cpu_index_to_instance_props) {
+        return;
+    }
+    /* vCPUs that share a thread, as with round-robin TCG, stay together */
+    if (cpu != first_cpu && cpu->thread == first_cpu->thread) {
+        return;
+    }
+
+    props = mc->cpu_index_to_instance_props(ms, cpu->cpu_index);
+    if (!props.has_node_id) {
+        return;
+    }
+    tc = ms->numa_state->nodes[props.node_id].thread_context;
+    if (!tc) {
+        return;
+    }
+
+    ret = qemu_thread_get_affinity(&tc->thread, &bitmap, &nbits);
+    if (!ret) {
+        ret = qemu_thread_set_affinity(cpu->thread, bitmap, nbits);
+        g_free(bitmap);
+    }
+    if (ret) {
+        warn_report("Setting CPU affinity of vCPU %d failed: %s",
+                    cpu->cpu_index, strerror(ret));
+    }
+}
+
 static void numa_stat_memory_devices(NumaNodeMem node_mem[])
 {
     MemoryDeviceInfoList *info_list = qmp_memory_device_list();
@@ -857,6 +857,7 @@ void phase_advance(MachineInitPhase phase)
 {
     assert(machine_phase == phase - 1);
     machine_phase = phase;
+    trace_machine_init_phase(phase);
 }
 
 static const TypeInfo device_type_info = {
@@ -34,11 +34,6 @@
 #include "hw/irq.h"
 #include "migration/vmstate.h"
 
-typedef struct riscv_aclint_mtimer_callback {
-    RISCVAclintMTimerState *s;
-    int num;
-} riscv_aclint_mtimer_callback;
-
 static uint64_t cpu_riscv_read_rtc_raw(uint32_t timebase_freq)
 {
     return muldiv64(qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL),
@@ -51,6 +46,23 @@ static uint64_t cpu_riscv_read_rtc(void *opaque)
     return cpu_riscv_read_rtc_raw(mtimer->timebase_freq) + mtimer->time_delta;
 }
 
+/*
+ * Arm the timer of the hart at index @hartid for @next.  The shared timer
+ * is only moved when @next is earlier than its current expiry; if a hart
+ * pushed its deadline out instead, the timer fires early and is rearmed
+ * by riscv_aclint_mtimer_cb().  This keeps mtimecmp writes of many harts
+ * from constantly requeueing timers on the main loop timer list.
+ */
+static void riscv_aclint_mtimer_arm(RISCVAclintMTimerState *mtimer,
+                                    int hartid, int64_t next)
+{
+    mtimer->deadlines[hartid] = next;
+    if (next != INT64_MAX &&
+        (uint64_t)next < timer_expire_time_ns(mtimer->timer)) {
+        timer_mod(mtimer->timer, next);
+    }
+}
+
 /*
  * Called when timecmp is written to update the QEMU timer or immediately
  * trigger timer interrupt if mtimecmp <= current timer value.
@@ -75,6 +87,7 @@ static void riscv_aclint_mtimer_write_timecmp(RISCVAclintMTimerState *mtimer,
          * If we're setting an MTIMECMP value in the "past",
          * immediately raise the timer interrupt
          */
+        mtimer->deadlines[hartid] = INT64_MAX;
         qemu_irq_raise(mtimer->timer_irqs[hartid]);
         return;
     }
@@ -106,18 +119,33 @@ static void riscv_aclint_mtimer_write_timecmp(RISCVAclintMTimerState *mtimer,
         next = MIN(next, INT64_MAX);
     }
 
-    timer_mod(mtimer->timers[hartid], next);
+    riscv_aclint_mtimer_arm(mtimer, hartid, next);
 }
 
 /*
  * Callback used when the timer set using timer_mod expires.
- * Should raise the timer interrupt line
+ * Should raise the timer interrupt line of every hart whose deadline
+ * passed, and rearm the timer for the earliest remaining one.
  */
 static void riscv_aclint_mtimer_cb(void *opaque)
 {
-    riscv_aclint_mtimer_callback *state = opaque;
+    RISCVAclintMTimerState *mtimer = opaque;
+    int64_t now = qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL);
+    int64_t next = INT64_MAX;
+    int i;
+
+    for (i = 0; i < mtimer->num_harts; i++) {
+        if (mtimer->deadlines[i] <= now) {
+            mtimer->deadlines[i] = INT64_MAX;
+            qemu_irq_raise(mtimer->timer_irqs[i]);
+        } else {
+            next = MIN(next, mtimer->deadlines[i]);
+        }
+    }
 
-    qemu_irq_raise(state->s->timer_irqs[state->num]);
+    if (next != INT64_MAX) {
+        timer_mod(mtimer->timer, next);
+    }
 }
 
 /* CPU read MTIMER register */
@@ -288,8 +316,12 @@ static void riscv_aclint_mtimer_realize(DeviceState *dev, Error **errp)
     s->timer_irqs = g_new(qemu_irq, s->num_harts);
     qdev_init_gpio_out(dev, s->timer_irqs, s->num_harts);
 
-    s->timers = g_new0(QEMUTimer *, s->num_harts);
+    s->timer = timer_new_ns(QEMU_CLOCK_VIRTUAL, &riscv_aclint_mtimer_cb, s);
+    s->deadlines = g_new(int64_t, s->num_harts);
     s->timecmp = g_new0(uint64_t, s->num_harts);
+    for (i = 0; i < s->num_harts; i++) {
+        s->deadlines[i] = INT64_MAX;
+    }
     /* Claim timer interrupt bits */
     for (i = 0; i < s->num_harts; i++) {
         RISCVCPU *cpu = RISCV_CPU(cpu_by_arch_id(s->hartid_base + i));
@@ -375,21 +407,14 @@ DeviceState *riscv_aclint_mtimer_create(hwaddr addr, hwaddr size,
         CPUState *cpu = cpu_by_arch_id(hartid_base + i);
         RISCVCPU *rvcpu = RISCV_CPU(cpu);
         CPURISCVState *env = cpu ? cpu_env(cpu) : NULL;
-        riscv_aclint_mtimer_callback *cb =
-            g_new0(riscv_aclint_mtimer_callback, 1);
 
         if (!env) {
-            g_free(cb);
             continue;
         }
         if (provide_rdtime) {
             riscv_cpu_set_rdtime_fn(env, cpu_riscv_read_rtc, dev);
         }
 
-        cb->s = s;
-        cb->num = i;
-        s->timers[i] = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                  &riscv_aclint_mtimer_cb, cb);
         s->timecmp[i] = 0;
 
         qdev_connect_gpio_out(dev, i,
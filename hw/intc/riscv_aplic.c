@@ -22,6 +22,7 @@
 #include "qemu/module.h"
 #include "qemu/error-report.h"
 #include "qemu/bswap.h"
+#include "qemu/bitmap.h"
 #include "exec/address-spaces.h"
 #include "hw/sysbus.h"
 #include "hw/pci/msi.h"
@@ -230,30 +231,53 @@ static uint32_t riscv_aplic_read_input_word(RISCVAPLICState *aplic,
     return ret;
 }
 
-static uint32_t riscv_aplic_read_pending_word(RISCVAPLICState *aplic,
-                                              uint32_t word)
+static uint32_t riscv_aplic_bitmap_word(const unsigned long *map,
+                                        uint32_t word)
 {
-    uint32_t i, irq, ret = 0;
+    uint32_t bit = word * 32;
 
-    for (i = 0; i < 32; i++) {
-        irq = word * 32 + i;
-        if (!irq || aplic->num_irqs <= irq) {
-            continue;
-        }
+    /* Bits at or above num_irqs, and bit 0, are never set */
+    return map[BIT_WORD(bit)] >> (bit % BITS_PER_LONG);
+}
 
-        ret |= ((aplic->state[irq] & APLIC_ISTATE_PENDING) ? 1 : 0) << i;
+/*
+ * Return the first source at or above @irq which is both pending and
+ * enabled, or num_irqs if there is none.
+ */
+static uint32_t riscv_aplic_next_enpend(RISCVAPLICState *aplic, uint32_t irq)
+{
+    uint32_t i, nr_words = BITS_TO_LONGS(aplic->num_irqs);
+    unsigned long bits;
+
+    if (aplic->num_irqs <= irq) {
+        return aplic->num_irqs;
     }
 
-    return ret;
+    i = BIT_WORD(irq);
+    bits = aplic->pending[i] & aplic->enabled[i] & BITMAP_FIRST_WORD_MASK(irq);
+    while (!bits) {
+        if (++i >= nr_words) {
+            return aplic->num_irqs;
+        }
+        bits = aplic->pending[i] & aplic->enabled[i];
+    }
+
+    return i * BITS_PER_LONG + ctzl(bits);
+}
+
+static uint32_t riscv_aplic_read_pending_word(RISCVAPLICState *aplic,
+                                              uint32_t word)
+{
+    return riscv_aplic_bitmap_word(aplic->pending, word);
 }
 
 static void riscv_aplic_set_pending_raw(RISCVAPLICState *aplic,
                                         uint32_t irq, bool pending)
 {
     if (pending) {
-        aplic->state[irq] |= APLIC_ISTATE_PENDING;
+        set_bit(irq, aplic->pending);
     } else {
-        aplic->state[irq] &= ~APLIC_ISTATE_PENDING;
+        clear_bit(irq, aplic->pending);
     }
 }
 
@@ -302,44 +326,25 @@ static void riscv_aplic_set_pending_word(RISCVAPLICState *aplic,
                                          uint32_t word, uint32_t value,
                                          bool pending)
 {
-    uint32_t i, irq;
-
-    for (i = 0; i < 32; i++) {
-        irq = word * 32 + i;
-        if (!irq || aplic->num_irqs <= irq) {
-            continue;
-        }
-
-        if (value & (1U << i)) {
-            riscv_aplic_set_pending(aplic, irq, pending);
-        }
+    while (value) {
+        riscv_aplic_set_pending(aplic, word * 32 + ctz32(value), pending);
+        value &= value - 1;
     }
 }
 
 static uint32_t riscv_aplic_read_enabled_word(RISCVAPLICState *aplic,
                                               int word)
 {
-    uint32_t i, irq, ret = 0;
-
-    for (i = 0; i < 32; i++) {
-        irq = word * 32 + i;
-        if (!irq || aplic->num_irqs <= irq) {
-            continue;
-        }
-
-        ret |= ((aplic->state[irq] & APLIC_ISTATE_ENABLED) ? 1 : 0) << i;
-    }
-
-    return ret;
+    return riscv_aplic_bitmap_word(aplic->enabled, word);
 }
 
 static void riscv_aplic_set_enabled_raw(RISCVAPLICState *aplic,
                                         uint32_t irq, bool enabled)
 {
     if (enabled) {
-        aplic->state[irq] |= APLIC_ISTATE_ENABLED;
+        set_bit(irq, aplic->enabled);
     } else {
-        aplic->state[irq] &= ~APLIC_ISTATE_ENABLED;
+        clear_bit(irq, aplic->enabled);
     }
 }
 
@@ -369,17 +374,9 @@ static void riscv_aplic_set_enabled_word(RISCVAPLICState *aplic,
                                          uint32_t word, uint32_t value,
                                          bool enabled)
 {
-    uint32_t i, irq;
-
-    for (i = 0; i < 32; i++) {
-        irq = word * 32 + i;
-        if (!irq || aplic->num_irqs <= irq) {
-            continue;
-        }
-
-        if (value & (1U << i)) {
-            riscv_aplic_set_enabled(aplic, irq, enabled);
-        }
+    while (value) {
+        riscv_aplic_set_enabled(aplic, word * 32 + ctz32(value), enabled);
+        value &= value - 1;
     }
 }
 
@@ -438,6 +435,21 @@ static void riscv_aplic_msi_send(RISCVAPLICState *aplic,
     addr |= (uint64_t)(guest_idx & APLIC_xMSICFGADDR_PPN_HART(lhxs));
     addr <<= APLIC_xMSICFGADDR_PPN_SHIFT;
 
+    /*
+     * In split mode the IMSICs live in the kernel, and their MMIO regions
+     * only forward writes to KVM_SIGNAL_MSI.  Skip the memory dispatch.
+     */
+    if (kvm_enabled() && aplic->kvm_splitmode) {
+        MSIMessage msg = { .address = addr, .data = eiid };
+
+        if (kvm_irqchip_send_msi(kvm_state, msg) < 0) {
+            qemu_log_mask(LOG_GUEST_ERROR, "%s: MSI injection failed for "
+                          "hart_index=%d guest_index=%d eiid=%d\n",
+                          __func__, hart_idx, guest_idx, eiid);
+        }
+        return;
+    }
+
     address_space_stl_le(&address_space_memory, addr,
                          eiid, MEMTXATTRS_UNSPECIFIED, &result);
     if (result != MEMTX_OK) {
@@ -447,19 +459,10 @@ static void riscv_aplic_msi_send(RISCVAPLICState *aplic,
     }
 }
 
-static void riscv_aplic_msi_irq_update(RISCVAPLICState *aplic, uint32_t irq)
+static void riscv_aplic_msi_forward(RISCVAPLICState *aplic, uint32_t irq)
 {
     uint32_t hart_idx, guest_idx, eiid;
 
-    if (!aplic->msimode || (aplic->num_irqs <= irq) ||
-        !(aplic->domaincfg & APLIC_DOMAINCFG_IE)) {
-        return;
-    }
-
-    if ((aplic->state[irq] & APLIC_ISTATE_ENPEND) != APLIC_ISTATE_ENPEND) {
-        return;
-    }
-
     riscv_aplic_set_pending_raw(aplic, irq, false);
 
     hart_idx = aplic->target[irq] >> APLIC_TARGET_HART_IDX_SHIFT;
@@ -475,6 +478,33 @@ static void riscv_aplic_msi_irq_update(RISCVAPLICState *aplic, uint32_t irq)
     riscv_aplic_msi_send(aplic, hart_idx, guest_idx, eiid);
 }
 
+static void riscv_aplic_msi_irq_update(RISCVAPLICState *aplic, uint32_t irq)
+{
+    if (!aplic->msimode || (aplic->num_irqs <= irq) ||
+        !(aplic->domaincfg & APLIC_DOMAINCFG_IE)) {
+        return;
+    }
+
+    if (test_bit(irq, aplic->pending) && test_bit(irq, aplic->enabled)) {
+        riscv_aplic_msi_forward(aplic, irq);
+    }
+}
+
+/* Forward every pending and enabled source in one pass over the bitmaps */
+static void riscv_aplic_msi_update(RISCVAPLICState *aplic)
+{
+    uint32_t irq;
+
+    if (!aplic->msimode || !(aplic->domaincfg & APLIC_DOMAINCFG_IE)) {
+        return;
+    }
+
+    for (irq = riscv_aplic_next_enpend(aplic, 1); irq < aplic->num_irqs;
+         irq = riscv_aplic_next_enpend(aplic, irq + 1)) {
+        riscv_aplic_msi_forward(aplic, irq);
+    }
+}
+
 static uint32_t riscv_aplic_idc_topi(RISCVAPLICState *aplic, uint32_t idc)
 {
     uint32_t best_irq, best_iprio;
@@ -486,12 +516,8 @@ static uint32_t riscv_aplic_idc_topi(RISCVAPLICState *aplic, uint32_t idc)
 
     ithres = aplic->ithreshold[idc];
     best_irq = best_iprio = UINT32_MAX;
-    for (irq = 1; irq < aplic->num_irqs; irq++) {
-        if ((aplic->state[irq] & APLIC_ISTATE_ENPEND) !=
-            APLIC_ISTATE_ENPEND) {
-            continue;
-        }
-
+    for (irq = riscv_aplic_next_enpend(aplic, 1); irq < aplic->num_irqs;
+         irq = riscv_aplic_next_enpend(aplic, irq + 1)) {
         ihartidx = aplic->target[irq] >> APLIC_TARGET_HART_IDX_SHIFT;
         ihartidx &= APLIC_TARGET_HART_IDX_MASK;
         if (ihartidx != idc) {
@@ -577,7 +603,10 @@ static void riscv_aplic_request(void *opaque, int irq, int level)
         return;
     }
 
-    state = aplic->state[irq];
+    state = aplic->state[irq] & ~APLIC_ISTATE_ENPEND;
+    if (test_bit(irq, aplic->pending)) {
+        state |= APLIC_ISTATE_PENDING;
+    }
     switch (sourcecfg & APLIC_SOURCECFG_SM_MASK) {
     case APLIC_SOURCECFG_SM_EDGE_RISE:
         if ((level > 0) && !(state & APLIC_ISTATE_INPUT) &&
@@ -858,9 +887,7 @@ static void riscv_aplic_write(void *opaque, hwaddr addr, uint64_t value,
     }
 
     if (aplic->msimode) {
-        for (irq = 1; irq < aplic->num_irqs; irq++) {
-            riscv_aplic_msi_irq_update(aplic, irq);
-        }
+        riscv_aplic_msi_update(aplic);
     } else {
         if (idc == UINT32_MAX) {
             for (idc = 0; idc < aplic->num_harts; idc++) {
@@ -918,6 +945,8 @@ static void riscv_aplic_realize(DeviceState *dev, Error **errp)
         aplic->bitfield_words = (aplic->num_irqs + 31) >> 5;
         aplic->sourcecfg = g_new0(uint32_t, aplic->num_irqs);
         aplic->state = g_new0(uint32_t, aplic->num_irqs);
+        aplic->pending = bitmap_new(aplic->num_irqs);
+        aplic->enabled = bitmap_new(aplic->num_irqs);
         aplic->target = g_new0(uint32_t, aplic->num_irqs);
         if (!aplic->msimode) {
             for (i = 0; i < aplic->num_irqs; i++) {
@@ -962,10 +991,50 @@ static const Property riscv_aplic_properties[] = {
     DEFINE_PROP_BOOL("mmode", RISCVAPLICState, mmode, 0),
 };
 
+static int riscv_aplic_pre_save(void *opaque)
+{
+    RISCVAPLICState *aplic = opaque;
+    uint32_t irq;
+
+    /* The pending and enabled bitmaps migrate as part of the state array */
+    for (irq = 0; irq < aplic->num_irqs; irq++) {
+        aplic->state[irq] &= ~APLIC_ISTATE_ENPEND;
+        if (test_bit(irq, aplic->pending)) {
+            aplic->state[irq] |= APLIC_ISTATE_PENDING;
+        }
+        if (test_bit(irq, aplic->enabled)) {
+            aplic->state[irq] |= APLIC_ISTATE_ENABLED;
+        }
+    }
+
+    return 0;
+}
+
+static int riscv_aplic_post_load(void *opaque, int version_id)
+{
+    RISCVAPLICState *aplic = opaque;
+    uint32_t irq;
+
+    bitmap_zero(aplic->pending, aplic->num_irqs);
+    bitmap_zero(aplic->enabled, aplic->num_irqs);
+    for (irq = 1; irq < aplic->num_irqs; irq++) {
+        if (aplic->state[irq] & APLIC_ISTATE_PENDING) {
+            set_bit(irq, aplic->pending);
+        }
+        if (aplic->state[irq] & APLIC_ISTATE_ENABLED) {
+            set_bit(irq, aplic->enabled);
+        }
+    }
+
+    return 0;
+}
+
 static const VMStateDescription vmstate_riscv_aplic = {
     .name = "riscv_aplic",
     .version_id = 2,
     .minimum_version_id = 2,
+    .pre_save = riscv_aplic_pre_save,
+    .post_load = riscv_aplic_post_load,
     .fields = (const VMStateField[]) {
             VMSTATE_UINT32(domaincfg, RISCVAPLICState),
             VMSTATE_UINT32(mmsicfgaddr, RISCVAPLICState),
@@ -22,6 +22,7 @@
 #include "qemu/module.h"
 #include "qemu/error-report.h"
 #include "qemu/bswap.h"
+#include "qemu/main-loop.h"
 #include "exec/address-spaces.h"
 #include "hw/sysbus.h"
 #include "hw/pci/msi.h"
@@ -76,7 +77,12 @@ static void riscv_imsic_update(RISCVIMSICState *imsic, uint32_t page)
      * deactivated connected CPU IRQ line.
      * If multiple interrupts are pending, this sequence functions identically
      * to qemu_irq_pulse.
+     *
+     * CSR accesses and lockless MSI writes may run without the BQL, so take
+     * it here: the line and IMSIC_EISTATE_ENPEND of the first identity are
+     * only ever changed together under the BQL.
      */
+    BQL_LOCK_GUARD();
 
     if (qatomic_fetch_and(&imsic->eistate[base], ~IMSIC_EISTATE_ENPEND)) {
         qemu_irq_lower(imsic->external_irqs[page]);
@@ -87,6 +93,52 @@ static void riscv_imsic_update(RISCVIMSICState *imsic, uint32_t page)
     }
 }
 
+static bool riscv_imsic_deliverable(RISCVIMSICState *imsic, uint32_t page,
+                                    uint32_t id)
+{
+    uint32_t threshold = qatomic_read(&imsic->eithreshold[page]);
+
+    return qatomic_read(&imsic->eidelivery[page]) &&
+           (!threshold || id < threshold);
+}
+
+static void riscv_imsic_notify(RISCVIMSICState *imsic, uint32_t page,
+                               uint32_t id)
+{
+    uint32_t base = page * imsic->num_irqs;
+    uint32_t prev;
+
+    prev = qatomic_fetch_or(&imsic->eistate[base + id], IMSIC_EISTATE_PENDING);
+
+    /*
+     * Setting a pending bit can only ever assert the interrupt line, so
+     * there is no need to rescan the whole file.  Nothing changes if the
+     * identity was already pending, is not deliverable, or the line is
+     * already asserted.  Any CSR write that makes this identity deliverable
+     * later re-evaluates the file through riscv_imsic_update().
+     */
+    if ((prev & IMSIC_EISTATE_PENDING) || !(prev & IMSIC_EISTATE_ENABLED) ||
+        !riscv_imsic_deliverable(imsic, page, id)) {
+        return;
+    }
+
+    /*
+     * The MMIO region may be dispatched without the BQL.  The pending bit
+     * is set lock-free above, but the line is only changed under the BQL,
+     * after checking again that a concurrent claim, disable or
+     * riscv_imsic_update() has not made the raise stale.
+     */
+    BQL_LOCK_GUARD();
+    if ((qatomic_read(&imsic->eistate[base + id]) & IMSIC_EISTATE_ENPEND) !=
+            IMSIC_EISTATE_ENPEND ||
+        !riscv_imsic_deliverable(imsic, page, id) ||
+        (qatomic_read(&imsic->eistate[base]) & IMSIC_EISTATE_ENPEND)) {
+        return;
+    }
+    qemu_irq_raise(imsic->external_irqs[page]);
+    qatomic_or(&imsic->eistate[base], IMSIC_EISTATE_ENPEND);
+}
+
 static int riscv_imsic_eidelivery_rmw(RISCVIMSICState *imsic, uint32_t page,
                                       target_ulong *val,
                                       target_ulong new_val,
@@ -99,7 +151,8 @@ static int riscv_imsic_eidelivery_rmw(RISCVIMSICState *imsic, uint32_t page,
     }
 
     wr_mask &= 0x1;
-    imsic->eidelivery[page] = (old_val & ~wr_mask) | (new_val & wr_mask);
+    qatomic_set(&imsic->eidelivery[page],
+                (old_val & ~wr_mask) | (new_val & wr_mask));
 
     riscv_imsic_update(imsic, page);
     return 0;
@@ -117,7 +170,8 @@ static int riscv_imsic_eithreshold_rmw(RISCVIMSICState *imsic, uint32_t page,
     }
 
     wr_mask &= IMSIC_MAX_ID;
-    imsic->eithreshold[page] = (old_val & ~wr_mask) | (new_val & wr_mask);
+    qatomic_set(&imsic->eithreshold[page],
+                (old_val & ~wr_mask) | (new_val & wr_mask));
 
     riscv_imsic_update(imsic, page);
     return 0;
@@ -316,11 +370,8 @@ static void riscv_imsic_write(void *opaque, hwaddr addr, uint64_t value,
     page = addr >> IMSIC_MMIO_PAGE_SHIFT;
     if ((addr & (IMSIC_MMIO_PAGE_SZ - 1)) == IMSIC_MMIO_PAGE_LE) {
         if (value && (value < imsic->num_irqs)) {
-            qatomic_or(&imsic->eistate[(page * imsic->num_irqs) + value],
-                       IMSIC_EISTATE_PENDING);
-
             /* Update CPU external interrupt status */
-            riscv_imsic_update(imsic, page);
+            riscv_imsic_notify(imsic, page, value);
         }
     }
 
@@ -371,6 +422,9 @@ static void riscv_imsic_realize(DeviceState *dev, Error **errp)
     memory_region_init_io(&imsic->mmio, OBJECT(dev), &riscv_imsic_ops,
                           imsic, TYPE_RISCV_IMSIC,
                           IMSIC_MMIO_SIZE(imsic->num_pages));
+    if (imsic->lockless_msi) {
+        memory_region_enable_lockless_io(&imsic->mmio);
+    }
     sysbus_init_mmio(SYS_BUS_DEVICE(dev), &imsic->mmio);
 
     /* Force select AIA feature and setup CSR read-modify-write callback */
@@ -396,6 +450,7 @@ static const Property riscv_imsic_properties[] = {
     DEFINE_PROP_UINT32("hartid", RISCVIMSICState, hartid, 0),
     DEFINE_PROP_UINT32("num-pages", RISCVIMSICState, num_pages, 0),
     DEFINE_PROP_UINT32("num-irqs", RISCVIMSICState, num_irqs, 0),
+    DEFINE_PROP_BOOL("x-lockless-msi", RISCVIMSICState, lockless_msi, false),
 };
 
 static const VMStateDescription vmstate_riscv_imsic = {
@@ -56,6 +56,9 @@
 
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of TX descriptors read from the ring with one DMA access */
+#define E1000E_TX_DESC_BATCH (32)
+
 union e1000_rx_desc_union {
     struct e1000_rx_desc legacy;
     union e1000_rx_desc_extended extended;
@@ -854,6 +857,30 @@ e1000e_ring_len(E1000ECore *core, const E1000ERingInfo *r)
     return core->mac[r->dlen];
 }
 
+/*
+ * Read up to @max descriptors starting at the head of the ring into @descs,
+ * with a single DMA access, like the descriptor prefetch of the hardware.
+ * The ring must not be empty.  Return the number of descriptors read.
+ */
+static uint32_t
+e1000e_ring_fetch_descr(E1000ECore *core, const E1000ERingInfo *r,
+                        void *descs, uint32_t max)
+{
+    uint32_t ring_descs = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+    uint32_t head = core->mac[r->dh];
+    uint32_t n = 1;
+
+    /* Don't cross the end of the ring or the tail. */
+    if (head < ring_descs) {
+        n = MIN(e1000e_ring_free_descr_num(core, r), ring_descs - head);
+        n = MIN(n, max);
+    }
+
+    pci_dma_read(core->owner, e1000e_ring_head_descr(core, r), descs,
+                 n * E1000_RING_DESC_LEN);
+    return n;
+}
+
 typedef struct E1000E_TxRing_st {
     const E1000ERingInfo *i;
     struct e1000e_tx *tx;
@@ -900,7 +927,9 @@ static void
 e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
 {
     dma_addr_t base;
-    struct e1000_tx_desc desc;
+    struct e1000_tx_desc descs[E1000E_TX_DESC_BATCH];
+    struct e1000_tx_desc *desc;
+    uint32_t fetched = 0, next = 0;
     bool ide = false;
     const E1000ERingInfo *txi = txr->i;
     uint32_t cause = E1000_ICS_TXQE;
@@ -913,13 +942,18 @@ e1000e_start_xmit(E1000ECore *core, const E1000E_TxRing *txr)
     while (!e1000e_ring_empty(core, txi)) {
         base = e1000e_ring_head_descr(core, txi);
 
-        pci_dma_read(core->owner, base, &desc, sizeof(desc));
+        if (next == fetched) {
+            fetched = e1000e_ring_fetch_descr(core, txi, descs,
+                                              ARRAY_SIZE(descs));
+            next = 0;
+        }
+        desc = &descs[next++];
 
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.buffer_addr,
-                              desc.lower.data, desc.upper.data);
+        trace_e1000e_tx_descr((void *)(intptr_t)desc->buffer_addr,
+                              desc->lower.data, desc->upper.data);
 
-        e1000e_process_tx_desc(core, txr->tx, &desc, txi->idx);
-        cause |= e1000e_txdesc_writeback(core, base, &desc, &ide, txi->idx);
+        e1000e_process_tx_desc(core, txr->tx, desc, txi->idx);
+        cause |= e1000e_txdesc_writeback(core, base, desc, &ide, txi->idx);
 
         e1000e_ring_advance(core, txi, 1);
     }
@@ -57,6 +57,9 @@
 
 #define E1000E_MAX_TX_FRAGS (64)
 
+/* Number of TX descriptors read from the ring with one DMA access */
+#define IGB_TX_DESC_BATCH (32)
+
 union e1000_rx_desc_union {
     struct e1000_rx_desc legacy;
     union e1000_adv_rx_desc adv;
@@ -754,6 +757,31 @@ igb_ring_enabled(IGBCore *core, const E1000ERingInfo *r)
     return core->mac[r->dlen] > 0;
 }
 
+/*
+ * Read up to @max descriptors starting at the head of the ring into @descs,
+ * with a single DMA access by @d, like the descriptor prefetch of the
+ * hardware.  The ring must not be empty.  Return the number of descriptors
+ * read.
+ */
+static uint32_t
+igb_ring_fetch_descr(IGBCore *core, PCIDevice *d, const E1000ERingInfo *r,
+                     void *descs, uint32_t max)
+{
+    uint32_t ring_descs = core->mac[r->dlen] / E1000_RING_DESC_LEN;
+    uint32_t head = core->mac[r->dh];
+    uint32_t n = 1;
+
+    /* Don't cross the end of the ring or the tail. */
+    if (head < ring_descs) {
+        n = MIN(igb_ring_free_descr_num(core, r), ring_descs - head);
+        n = MIN(n, max);
+    }
+
+    pci_dma_read(d, igb_ring_head_descr(core, r), descs,
+                 n * E1000_RING_DESC_LEN);
+    return n;
+}
+
 typedef struct IGB_TxRing_st {
     const E1000ERingInfo *i;
     struct igb_tx *tx;
@@ -876,7 +904,9 @@ igb_start_xmit(IGBCore *core, const IGB_TxRing *txr)
 {
     PCIDevice *d;
     dma_addr_t base;
-    union e1000_adv_tx_desc desc;
+    union e1000_adv_tx_desc descs[IGB_TX_DESC_BATCH];
+    union e1000_adv_tx_desc *desc;
+    uint32_t fetched = 0, next = 0;
     const E1000ERingInfo *txi = txr->i;
     uint32_t eic = 0;
 
@@ -893,14 +923,19 @@ igb_start_xmit(IGBCore *core, const IGB_TxRing *txr)
     while (!igb_ring_empty(core, txi)) {
         base = igb_ring_head_descr(core, txi);
 
-        pci_dma_read(d, base, &desc, sizeof(desc));
+        if (next == fetched) {
+            fetched = igb_ring_fetch_descr(core, d, txi, descs,
+                                           ARRAY_SIZE(descs));
+            next = 0;
+        }
+        desc = &descs[next++];
 
-        trace_e1000e_tx_descr((void *)(intptr_t)desc.read.buffer_addr,
-                              desc.read.cmd_type_len, desc.wb.status);
+        trace_e1000e_tx_descr((void *)(intptr_t)desc->read.buffer_addr,
+                              desc->read.cmd_type_len, desc->wb.status);
 
-        igb_process_tx_desc(core, d, txr->tx, &desc, txi->idx);
+        igb_process_tx_desc(core, d, txr->tx, desc, txi->idx);
         igb_ring_advance(core, txi, 1);
-        eic |= igb_txdesc_writeback(core, base, &desc, txi);
+        eic |= igb_txdesc_writeback(core, base, desc, txi);
     }
 
     if (eic) {
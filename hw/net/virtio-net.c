@@ -13,10 +13,12 @@
 
 #include "qemu/osdep.h"
 #include "qemu/atomic.h"
+#include "qemu/defer-call.h"
 #include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
+#include "block/aio-wait.h"
 #include "hw/virtio/virtio.h"
 #include "net/net.h"
 #include "net/checksum.h"
@@ -31,6 +33,7 @@
 #include "net/vhost_net.h"
 #include "net/announce.h"
 #include "hw/virtio/virtio-bus.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "qapi/error.h"
 #include "qapi/qapi-events-net.h"
 #include "hw/qdev-properties.h"
@@ -374,14 +377,32 @@ static void virtio_net_vnet_endian_status(VirtIONet *n, uint8_t status)
     }
 }
 
+static bool virtio_net_has_iothread(VirtIONet *n)
+{
+    return n->net_conf.iothread || n->net_conf.iothread_vq_mapping_list;
+}
+
+/* Interrupt the guest from the thread that runs the queue pair of @vq */
+static void virtio_net_notify(VirtIONet *n, VirtQueue *vq)
+{
+    if (qemu_in_iothread()) {
+        virtio_notify_irqfd(VIRTIO_DEVICE(n), vq);
+    } else {
+        virtio_notify(VIRTIO_DEVICE(n), vq);
+    }
+}
+
 static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(VIRTIO_NET(vdev), vq);
     }
 }
 
+static void virtio_net_dataplane_pause(VirtIONet *n);
+static void virtio_net_dataplane_resume(VirtIONet *n);
+
 static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
@@ -389,6 +410,8 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
     int i;
     uint8_t queue_status;
 
+    virtio_net_dataplane_pause(n);
+
     virtio_net_vnet_endian_status(n, status);
     virtio_net_vhost_status(n, status);
 
@@ -437,6 +460,8 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
             }
         }
     }
+
+    virtio_net_dataplane_resume(n);
 }
 
 static void virtio_net_set_link_status(NetClientState *nc)
@@ -762,6 +787,11 @@ static uint64_t virtio_net_get_features(VirtIODevice *vdev, uint64_t features,
 
     virtio_add_feature(&features, VIRTIO_NET_F_MAC);
 
+    /* Resetting one queue pair would race with the IOThread running it */
+    if (virtio_net_has_iothread(n)) {
+        virtio_clear_feature(&features, VIRTIO_F_RING_RESET);
+    }
+
     if (!peer_has_vnet_hdr(n)) {
         virtio_clear_feature(&features, VIRTIO_NET_F_CSUM);
         virtio_clear_feature(&features, VIRTIO_NET_F_HOST_TSO4);
@@ -1298,6 +1328,16 @@ static void virtio_net_commit_rss_config(VirtIONet *n)
             }
         }
 
+        if (n->rss_data.enabled_software_rss) {
+            QEMU_BUILD_BUG_ON(sizeof(n->rss_data.key) <
+                              NET_TOEPLITZ_MAX_INPUT + 4);
+            if (!n->rss_data.toeplitz_table) {
+                n->rss_data.toeplitz_table = g_new(NetToeplitzTable, 1);
+            }
+            net_toeplitz_table_init(n->rss_data.toeplitz_table,
+                                    n->rss_data.key);
+        }
+
         trace_virtio_net_rss_enable(n,
                                     n->rss_data.hash_types,
                                     n->rss_data.indirections_len,
@@ -1599,6 +1639,9 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtQueueElement *elem;
 
+    /* Commands change state that the queue pairs read without locking */
+    virtio_net_dataplane_pause(VIRTIO_NET(vdev));
+
     for (;;) {
         size_t written;
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
@@ -1618,6 +1661,8 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
             break;
         }
     }
+
+    virtio_net_dataplane_resume(VIRTIO_NET(vdev));
 }
 
 /* RX */
@@ -1627,7 +1672,9 @@ static void virtio_net_handle_rx(VirtIODevice *vdev, VirtQueue *vq)
     VirtIONet *n = VIRTIO_NET(vdev);
     int queue_index = vq2q(virtio_get_queue_index(vq));
 
+    defer_call_begin();
     qemu_flush_queued_packets(qemu_get_subqueue(n->nic, queue_index));
+    defer_call_end();
 }
 
 static bool virtio_net_can_receive(NetClientState *nc)
@@ -1892,7 +1939,8 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
         return n->rss_data.redirect ? n->rss_data.default_queue : -1;
     }
 
-    hash = net_rx_pkt_calc_rss_hash(pkt, net_hash_type, n->rss_data.key);
+    hash = net_rx_pkt_calc_rss_hash_table(pkt, net_hash_type,
+                                          n->rss_data.toeplitz_table);
 
     if (n->rss_data.populate_hash) {
         hdr->hash_value = hash;
@@ -1907,6 +1955,17 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
     return (index == new_index) ? -1 : new_index;
 }
 
+/*
+ * Interrupt the guest once for a burst of packets that the backend
+ * delivers within a defer_call_begin()/defer_call_end() section.
+ */
+static void virtio_net_rx_notify_deferred_fn(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+
+    virtio_net_notify(q->n, q->rx_vq);
+}
+
 typedef struct Header {
     struct virtio_net_hdr_v1_hash virtio_net;
     struct eth_header eth;
@@ -1921,7 +1980,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     VirtIONetQueue *q;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     VirtQueueElement *elems[VIRTQUEUE_MAX_SIZE];
-    size_t lens[VIRTQUEUE_MAX_SIZE];
+    unsigned int lens[VIRTQUEUE_MAX_SIZE];
     struct iovec mhdr_sg[VIRTQUEUE_MAX_SIZE];
     Header hdr;
     unsigned mhdr_cnt = 0;
@@ -2040,14 +2099,12 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
                      sizeof hdr.virtio_net.hdr.num_buffers);
     }
 
+    /* signal other side */
+    virtqueue_fill_batch(q->rx_vq, elems, lens, i);
     for (j = 0; j < i; j++) {
-        /* signal other side */
-        virtqueue_fill(q->rx_vq, elems[j], lens[j], j);
         g_free(elems[j]);
     }
-
-    virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    defer_call(virtio_net_rx_notify_deferred_fn, q);
 
     return size;
 
@@ -2693,11 +2750,10 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     VirtIONetQueue *q = virtio_net_get_subqueue(nc);
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
     int ret;
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(n, q->tx_vq);
 
     g_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
@@ -2721,12 +2777,35 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     }
 }
 
+/* Number of TX descriptors popped and completed at a time */
+#define VIRTIO_NET_TX_BATCH 32
+
 /* TX */
+static void virtio_net_tx_push_batch(VirtIONetQueue *q,
+                                     VirtQueueElement **elems,
+                                     unsigned int num)
+{
+    static const unsigned int lens[VIRTIO_NET_TX_BATCH];
+    unsigned int i;
+
+    if (!num) {
+        return;
+    }
+
+    virtqueue_fill_batch(q->tx_vq, elems, lens, num);
+    virtio_net_notify(q->n, q->tx_vq);
+    for (i = 0; i < num; i++) {
+        g_free(elems[i]);
+    }
+}
+
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtQueueElement *elems[VIRTIO_NET_TX_BATCH];
     VirtQueueElement *elem;
+    unsigned int i = 0, num_elems = 0;
     int32_t num_packets = 0;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
@@ -2744,10 +2823,21 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
         struct virtio_net_hdr vhdr;
 
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
-            break;
+        if (i == num_elems) {
+            /* Stop popping where tx_burst would stop */
+            size_t max = MIN(ARRAY_SIZE(elems),
+                             MAX(n->tx_burst - num_packets, 1));
+
+            virtio_net_tx_push_batch(q, elems, num_elems);
+            num_elems = virtqueue_pop_batch(q->tx_vq,
+                                            sizeof(VirtQueueElement),
+                                            (void **)elems, max);
+            i = 0;
+            if (!num_elems) {
+                break;
+            }
         }
+        elem = elems[i++];
 
         out_num = elem->out_num;
         out_sg = elem->out_sg;
@@ -2802,25 +2892,32 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
                                       out_sg, out_num, virtio_net_tx_complete);
         if (ret == 0) {
+            /* Give back what was popped after @elem, in reverse order */
+            while (num_elems > i) {
+                num_elems--;
+                virtqueue_unpop(q->tx_vq, elems[num_elems], 0);
+                g_free(elems[num_elems]);
+            }
+            virtio_net_tx_push_batch(q, elems, i - 1);
             virtio_queue_set_notification(q->tx_vq, 0);
             q->async_tx.elem = elem;
             return -EBUSY;
         }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
-
         if (++num_packets >= n->tx_burst) {
             break;
         }
     }
+    virtio_net_tx_push_batch(q, elems, i);
     return num_packets;
 
 detach:
-    virtqueue_detach_element(q->tx_vq, elem, 0);
-    g_free(elem);
+    virtio_net_tx_push_batch(q, elems, i - 1);
+    for (i--; i < num_elems; i++) {
+        virtqueue_detach_element(q->tx_vq, elems[i], 0);
+        g_free(elems[i]);
+    }
     return -EINVAL;
 }
 
@@ -2980,30 +3077,62 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
-static void virtio_net_add_queue(VirtIONet *n, int index)
+static bool virtio_net_tx_use_timer(VirtIONet *n)
 {
-    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    return n->net_conf.tx && !strcmp(n->net_conf.tx, "timer");
+}
 
-    n->vqs[index].rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
-                                           virtio_net_handle_rx);
+/* Create the TX timer or BH of @q in @ctx, or in the main loop if NULL */
+static void virtio_net_tx_init(VirtIONetQueue *q, AioContext *ctx)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(q->n);
 
-    if (n->net_conf.tx && !strcmp(n->net_conf.tx, "timer")) {
-        n->vqs[index].tx_vq =
-            virtio_add_queue(vdev, n->net_conf.tx_queue_size,
-                             virtio_net_handle_tx_timer);
-        n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                              virtio_net_tx_timer,
-                                              &n->vqs[index]);
+    if (virtio_net_tx_use_timer(q->n)) {
+        if (ctx) {
+            q->tx_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL, SCALE_NS,
+                                        virtio_net_tx_timer, q);
+        } else {
+            q->tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                       virtio_net_tx_timer, q);
+        }
+    } else if (ctx) {
+        /*
+         * The reentrancy guard is only meant for the thread that does
+         * MMIO under the BQL; setting it from an IOThread would make
+         * concurrent vCPU accesses to the device fail.
+         */
+        q->tx_bh = aio_bh_new(ctx, virtio_net_tx_bh, q);
     } else {
-        n->vqs[index].tx_vq =
-            virtio_add_queue(vdev, n->net_conf.tx_queue_size,
-                             virtio_net_handle_tx_bh);
-        n->vqs[index].tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, &n->vqs[index],
-                                                  &DEVICE(vdev)->mem_reentrancy_guard);
+        q->tx_bh = qemu_bh_new_guarded(virtio_net_tx_bh, q,
+                                       &DEVICE(vdev)->mem_reentrancy_guard);
     }
+}
 
-    n->vqs[index].tx_waiting = 0;
-    n->vqs[index].n = n;
+static void virtio_net_tx_cleanup(VirtIONetQueue *q)
+{
+    if (q->tx_timer) {
+        timer_free(q->tx_timer);
+        q->tx_timer = NULL;
+    } else {
+        qemu_bh_delete(q->tx_bh);
+        q->tx_bh = NULL;
+    }
+}
+
+static void virtio_net_add_queue(VirtIONet *n, int index)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtIONetQueue *q = &n->vqs[index];
+
+    q->n = n;
+    q->rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
+                                virtio_net_handle_rx);
+    q->tx_vq = virtio_add_queue(vdev, n->net_conf.tx_queue_size,
+                                virtio_net_tx_use_timer(n) ?
+                                virtio_net_handle_tx_timer :
+                                virtio_net_handle_tx_bh);
+    virtio_net_tx_init(q, NULL);
+    q->tx_waiting = 0;
 }
 
 static void virtio_net_del_queue(VirtIONet *n, int index)
@@ -3015,17 +3144,275 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     qemu_purge_queued_packets(nc);
 
     virtio_del_queue(vdev, index * 2);
-    if (q->tx_timer) {
-        timer_free(q->tx_timer);
-        q->tx_timer = NULL;
-    } else {
-        qemu_bh_delete(q->tx_bh);
-        q->tx_bh = NULL;
-    }
+    virtio_net_tx_cleanup(q);
     q->tx_waiting = 0;
     virtio_del_queue(vdev, index * 2 + 1);
 }
 
+/*
+ * Stop processing the queue pair @q in the thread that runs it.
+ *
+ * Context: BH in the AioContext of @q
+ */
+static void virtio_net_queue_pair_detach_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+    AioContext *ctx = qemu_get_current_aio_context();
+
+    virtio_queue_aio_detach_host_notifier(q->rx_vq, ctx);
+    virtio_queue_aio_detach_host_notifier(q->tx_vq, ctx);
+    if (nc->peer) {
+        nc->peer->info->set_aio_context(nc->peer, NULL);
+    }
+    virtio_net_tx_cleanup(q);
+}
+
+/*
+ * Move the virtqueue handlers, the TX timer or BH and the backend of the
+ * queue pair @q to @ctx.  With a NULL @ctx, the virtqueues go back to the
+ * handlers of virtio_device_start_ioeventfd_impl().
+ *
+ * Context: BQL held
+ */
+static void virtio_net_queue_pair_set_aio_context(VirtIONetQueue *q,
+                                                  AioContext *ctx)
+{
+    NetClientState *nc = qemu_get_subqueue(q->n->nic, q - q->n->vqs);
+    AioContext *main_ctx = qemu_get_aio_context();
+    AioContext *fd_ctx = ctx == main_ctx ? NULL : ctx;
+    EventNotifier *rx_notifier = virtio_queue_get_host_notifier(q->rx_vq);
+    EventNotifier *tx_notifier = virtio_queue_get_host_notifier(q->tx_vq);
+
+    if (q->cur_ctx == ctx) {
+        return;
+    }
+
+    if (!q->cur_ctx) {
+        event_notifier_set_handler(rx_notifier, NULL);
+        event_notifier_set_handler(tx_notifier, NULL);
+        virtio_net_tx_cleanup(q);
+    } else if (q->cur_ctx == main_ctx) {
+        virtio_net_queue_pair_detach_bh(q);
+    } else {
+        aio_wait_bh_oneshot(q->cur_ctx, virtio_net_queue_pair_detach_bh, q);
+    }
+
+    if (nc->peer) {
+        nc->peer->info->set_aio_context(nc->peer, fd_ctx);
+    }
+
+    virtio_net_tx_init(q, fd_ctx);
+    if (q->tx_waiting) {
+        if (q->tx_timer) {
+            timer_mod(q->tx_timer,
+                      qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) + q->n->tx_timeout);
+        } else {
+            replay_bh_schedule_event(q->tx_bh);
+        }
+    }
+
+    /* Attaching kicks the virtqueues, so no notification is lost */
+    if (ctx) {
+        virtio_queue_aio_attach_host_notifier_no_poll(q->rx_vq, ctx);
+        virtio_queue_aio_attach_host_notifier(q->tx_vq, ctx);
+    } else {
+        event_notifier_set_handler(rx_notifier,
+                                   virtio_queue_host_notifier_read);
+        event_notifier_set_handler(tx_notifier,
+                                   virtio_queue_host_notifier_read);
+        event_notifier_set(rx_notifier);
+        event_notifier_set(tx_notifier);
+    }
+    q->cur_ctx = ctx;
+}
+
+/*
+ * Bring the queue pairs back to the main loop, so that state they read
+ * without locking can be changed under the BQL.  Calls can be nested.
+ *
+ * Context: BQL held
+ */
+static void virtio_net_dataplane_pause(VirtIONet *n)
+{
+    int i;
+
+    if (!n->dataplane_started || n->dataplane_pause_depth++) {
+        return;
+    }
+
+    for (i = 0; i < (n->multiqueue ? n->max_queue_pairs : 1); i++) {
+        virtio_net_queue_pair_set_aio_context(&n->vqs[i],
+                                              qemu_get_aio_context());
+    }
+}
+
+/* Context: BQL held */
+static void virtio_net_dataplane_resume(VirtIONet *n)
+{
+    int i;
+
+    if (!n->dataplane_started || --n->dataplane_pause_depth) {
+        return;
+    }
+
+    for (i = 0; i < (n->multiqueue ? n->max_queue_pairs : 1); i++) {
+        virtio_net_queue_pair_set_aio_context(&n->vqs[i], n->vqs[i].ctx);
+    }
+}
+
+/* Context: BQL held */
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int nvqs = virtio_get_num_queues(vdev);
+    int i, r;
+
+    if (!virtio_net_has_iothread(n)) {
+        return virtio_device_start_ioeventfd_impl(vdev);
+    }
+
+    /* Set up guest notifier (irq) */
+    r = k->set_guest_notifiers(qbus->parent, nvqs, true);
+    if (r != 0) {
+        error_report("virtio-net failed to set guest notifier (%d), "
+                     "ensure -accel kvm is set.", r);
+        return -ENOSYS;
+    }
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r < 0) {
+        k->set_guest_notifiers(qbus->parent, nvqs, false);
+        return r;
+    }
+
+    /* The control virtqueue stays in the main loop */
+    for (i = 0; i < (n->multiqueue ? n->max_queue_pairs : 1); i++) {
+        virtio_net_queue_pair_set_aio_context(&n->vqs[i], n->vqs[i].ctx);
+    }
+    n->dataplane_started = true;
+    return 0;
+}
+
+/* Context: BQL held */
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int i;
+
+    if (!virtio_net_has_iothread(n)) {
+        virtio_device_stop_ioeventfd_impl(vdev);
+        return;
+    }
+
+    assert(!n->dataplane_pause_depth);
+    n->dataplane_started = false;
+    for (i = 0; i < (n->multiqueue ? n->max_queue_pairs : 1); i++) {
+        virtio_net_queue_pair_set_aio_context(&n->vqs[i], NULL);
+    }
+
+    virtio_device_stop_ioeventfd_impl(vdev);
+    k->set_guest_notifiers(qbus->parent, virtio_get_num_queues(vdev), false);
+}
+
+/* Context: BQL held */
+static bool virtio_net_vq_aio_context_init(VirtIONet *n, Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(vdev)));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    virtio_net_conf *conf = &n->net_conf;
+    g_autofree AioContext **ctxs = NULL;
+    int i;
+
+    if (!virtio_net_has_iothread(n)) {
+        return true;
+    }
+
+    if (conf->iothread && conf->iothread_vq_mapping_list) {
+        error_setg(errp,
+                   "iothread and iothread-vq-mapping properties cannot be set "
+                   "at the same time");
+        return false;
+    }
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp,
+                   "device is incompatible with iothread "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (!virtio_device_ioeventfd_enabled(vdev)) {
+        error_setg(errp, "ioeventfd is required for iothread");
+        return false;
+    }
+    if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSC_EXT)) {
+        error_setg(errp, "iothread is not supported with guest_rsc_ext");
+        return false;
+    }
+
+    for (i = 0; i < n->nic_conf.peers.queues; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (get_vhost_net(peer)) {
+            error_setg(errp, "iothread is not supported with vhost");
+            return false;
+        }
+        if (!peer->info->set_aio_context) {
+            error_setg(errp, "netdev '%s' does not support iothread",
+                       peer->name);
+            return false;
+        }
+        if (!QTAILQ_EMPTY(&peer->filters)) {
+            error_setg(errp, "iothread is not supported with netdev filters");
+            return false;
+        }
+    }
+
+    /* The mapping assigns queue pairs, not individual virtqueues */
+    ctxs = g_new(AioContext *, n->max_queue_pairs);
+    if (conf->iothread_vq_mapping_list) {
+        if (!iothread_vq_mapping_apply(conf->iothread_vq_mapping_list, ctxs,
+                                       n->max_queue_pairs, errp)) {
+            return false;
+        }
+    } else {
+        AioContext *ctx = iothread_get_aio_context(conf->iothread);
+
+        for (i = 0; i < n->max_queue_pairs; i++) {
+            ctxs[i] = ctx;
+        }
+
+        /* Released in virtio_net_vq_aio_context_cleanup() */
+        object_ref(OBJECT(conf->iothread));
+    }
+
+    for (i = 0; i < n->max_queue_pairs; i++) {
+        n->vqs[i].ctx = ctxs[i];
+    }
+
+    /* virtio_net_guest_notifier_mask() only knows about vhost */
+    vdev->use_guest_notifier_mask = false;
+    return true;
+}
+
+/* Context: BQL held */
+static void virtio_net_vq_aio_context_cleanup(VirtIONet *n)
+{
+    assert(!n->dataplane_started);
+
+    if (n->net_conf.iothread_vq_mapping_list) {
+        iothread_vq_mapping_cleanup(n->net_conf.iothread_vq_mapping_list);
+    }
+
+    if (n->net_conf.iothread) {
+        object_unref(OBJECT(n->net_conf.iothread));
+    }
+}
+
 static void virtio_net_change_num_queue_pairs(VirtIONet *n, int new_max_queue_pairs)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
@@ -3845,6 +4232,12 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         return;
     }
     n->vqs = g_new0(VirtIONetQueue, n->max_queue_pairs);
+    if (!virtio_net_vq_aio_context_init(n, errp)) {
+        g_free(n->vqs);
+        n->vqs = NULL;
+        virtio_cleanup(vdev);
+        return;
+    }
     n->curr_queue_pairs = 1;
     n->tx_timeout = n->net_conf.txtimer;
 
@@ -3960,10 +4353,12 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     /* delete also control vq */
     virtio_del_queue(vdev, max_queue_pairs * 2);
     qemu_announce_timer_del(&n->announce_timer, false);
+    virtio_net_vq_aio_context_cleanup(n);
     g_free(n->vqs);
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
+    g_free(n->rss_data.toeplitz_table);
     net_rx_pkt_uninit(n->rx_pkt);
     virtio_cleanup(vdev);
 }
@@ -4131,6 +4526,10 @@ static const Property virtio_net_properties[] = {
     DEFINE_PROP_INT32("speed", VirtIONet, net_conf.speed, SPEED_UNKNOWN),
     DEFINE_PROP_STRING("duplex", VirtIONet, net_conf.duplex_str),
     DEFINE_PROP_BOOL("failover", VirtIONet, failover, false),
+    DEFINE_PROP_LINK("iothread", VirtIONet, net_conf.iothread, TYPE_IOTHREAD,
+                     IOThread *),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", VirtIONet,
+                                         net_conf.iothread_vq_mapping_list),
     DEFINE_PROP_BIT64("guest_uso4", VirtIONet, host_features,
                       VIRTIO_NET_F_GUEST_USO4, true),
     DEFINE_PROP_BIT64("guest_uso6", VirtIONet, host_features,
@@ -4158,6 +4557,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->queue_reset = virtio_net_queue_reset;
     vdc->queue_enable = virtio_net_queue_enable;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
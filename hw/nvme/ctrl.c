@@ -43,6 +43,7 @@
  *              atomic.dn=<on|off[optional]>, \
  *              atomic.awun<N[optional]>, \
  *              atomic.awupf<N[optional]>, \
+ *              iothread-vq-mapping=<mapping[optional]>, \
  *              subsys=<subsys_id>
  *      -device nvme-ns,drive=<drive_id>,bus=<bus_name>,nsid=<nsid>,\
  *              zoned=<true|false[optional]>, \
@@ -150,6 +151,12 @@
  *   a secondary controller. The default 0 resolves to
  *   `(sriov_vq_flexible / sriov_max_vfs)`.
  *
+ * - `iothread-vq-mapping`
+ *   Assigns I/O queue pairs to IOThreads, with the syntax of the virtio-blk
+ *   property of the same name. The `vqs` are I/O queue pair indices, i.e.
+ *   `vqs: [0]` is queue id 1. Requires `ioeventfd=on`. See the NVMe
+ *   documentation for when a queue pair actually leaves the main loop.
+ *
  * nvme namespace device parameters
  * ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~
  * - `shared`
@@ -204,8 +211,12 @@
 #include "system/system.h"
 #include "system/block-backend.h"
 #include "system/hostmem.h"
+#include "system/iothread.h"
+#include "system/kvm.h"
+#include "block/aio-wait.h"
 #include "hw/pci/msix.h"
 #include "hw/pci/pcie_sriov.h"
+#include "hw/virtio/iothread-vq-mapping.h"
 #include "system/spdm-socket.h"
 #include "migration/vmstate.h"
 
@@ -608,6 +619,22 @@ static int nvme_addr_write(NvmeCtrl *n, hwaddr addr, const void *buf, int size)
     return pci_dma_write(PCI_DEVICE(n), addr, buf, size);
 }
 
+/*
+ * Queues in host memory are accessed through a DMACache; queues in the CMB
+ * or PMR keep going through nvme_addr_read() and nvme_addr_write().
+ */
+static DMACache *nvme_queue_dma_cache_new(NvmeCtrl *n, hwaddr addr,
+                                          hwaddr size, DMADirection dir)
+{
+    if ((n->bar.cmbsz && nvme_addr_is_cmb(n, addr)) ||
+        nvme_addr_is_pmr(n, addr)) {
+        return NULL;
+    }
+
+    return dma_cache_new(pci_get_address_space(PCI_DEVICE(n)), addr, size,
+                         dir);
+}
+
 static bool nvme_nsid_valid(NvmeCtrl *n, uint32_t nsid)
 {
     return nsid &&
@@ -676,7 +703,11 @@ static void nvme_irq_assert(NvmeCtrl *n, NvmeCQueue *cq)
     if (cq->irq_enabled) {
         if (msix_enabled(pci)) {
             trace_pci_nvme_irq_msix(cq->vector);
-            msix_notify(pci, cq->vector);
+            if (cq->virq >= 0) {
+                event_notifier_set(&cq->irq_notifier);
+            } else {
+                msix_notify(pci, cq->vector);
+            }
         } else {
             trace_pci_nvme_irq_pin();
             assert(cq->vector < 32);
@@ -695,7 +726,7 @@ static void nvme_irq_deassert(NvmeCtrl *n, NvmeCQueue *cq)
             return;
         } else {
             assert(cq->vector < 32);
-            if (!n->cq_pending) {
+            if (!qatomic_read(&n->cq_pending)) {
                 n->irq_status &= ~(1 << cq->vector);
             }
             nvme_irq_check(n);
@@ -1450,6 +1481,75 @@ uint16_t nvme_bounce_mdata(NvmeCtrl *n, void *ptr, uint32_t len,
     return nvme_tx(n, &req->sg, ptr, len, dir);
 }
 
+static void nvme_blk_unmap(NvmeRequest *req)
+{
+    QEMUIOVector *iov = &req->dma_iov;
+    int i;
+
+    for (i = 0; i < iov->niov; i++) {
+        dma_memory_unmap(req->sg.qsg.as, iov->iov[i].iov_base,
+                         iov->iov[i].iov_len, req->dma_dir,
+                         iov->iov[i].iov_len);
+    }
+
+    qemu_iovec_reset(iov);
+}
+
+/*
+ * Map the DMA scatter-gather list of @req to host pointers in
+ * req->dma_iov, so that it can be given to the block layer without going
+ * through the dma-helpers.  Contiguous guest ranges, like the pages of a
+ * PRP list that happen to be adjacent, are mapped at once.  Returns false
+ * if some range cannot be mapped right now; nothing is mapped then.
+ */
+static bool nvme_blk_map(NvmeRequest *req, DMADirection dir)
+{
+    QEMUSGList *qsg = &req->sg.qsg;
+    QEMUIOVector *iov = &req->dma_iov;
+    dma_addr_t base, len, plen;
+    void *mem;
+    int i = 0;
+
+    req->dma_dir = dir;
+
+    while (i < qsg->nsg) {
+        base = qsg->sg[i].base;
+        len = qsg->sg[i].len;
+
+        for (i++; i < qsg->nsg && qsg->sg[i].base == base + len; i++) {
+            len += qsg->sg[i].len;
+        }
+
+        while (len) {
+            plen = len;
+            mem = NULL;
+            if (iov->niov < IOV_MAX) {
+                mem = dma_memory_map(qsg->as, base, &plen, dir,
+                                     MEMTXATTRS_UNSPECIFIED);
+            }
+
+            if (!mem) {
+                nvme_blk_unmap(req);
+                return false;
+            }
+
+            qemu_iovec_add(iov, mem, plen);
+            base += plen;
+            len -= plen;
+        }
+    }
+
+    return true;
+}
+
+static void nvme_blk_mapped_cb(void *opaque, int ret)
+{
+    NvmeRequest *req = opaque;
+
+    nvme_blk_unmap(req);
+    req->dma_cb(req, ret);
+}
+
 static inline void nvme_blk_read(BlockBackend *blk, int64_t offset,
                                  uint32_t align, BlockCompletionFunc *cb,
                                  NvmeRequest *req)
@@ -1457,6 +1557,14 @@ static inline void nvme_blk_read(BlockBackend *blk, int64_t offset,
     assert(req->sg.flags & NVME_SG_ALLOC);
 
     if (req->sg.flags & NVME_SG_DMA) {
+        if (nvme_blk_map(req, DMA_DIRECTION_FROM_DEVICE)) {
+            req->dma_cb = cb;
+            req->aiocb = blk_aio_preadv(blk, offset, &req->dma_iov, 0,
+                                        nvme_blk_mapped_cb, req);
+            return;
+        }
+
+        /* the dma-helpers wait for bounce buffers to become free */
         req->aiocb = dma_blk_read(blk, &req->sg.qsg, offset, align, cb, req);
     } else {
         req->aiocb = blk_aio_preadv(blk, offset, &req->sg.iov, 0, cb, req);
@@ -1470,6 +1578,13 @@ static inline void nvme_blk_write(BlockBackend *blk, int64_t offset,
     assert(req->sg.flags & NVME_SG_ALLOC);
 
     if (req->sg.flags & NVME_SG_DMA) {
+        if (nvme_blk_map(req, DMA_DIRECTION_TO_DEVICE)) {
+            req->dma_cb = cb;
+            req->aiocb = blk_aio_pwritev(blk, offset, &req->dma_iov, 0,
+                                         nvme_blk_mapped_cb, req);
+            return;
+        }
+
         req->aiocb = dma_blk_write(blk, &req->sg.qsg, offset, align, cb, req);
     } else {
         req->aiocb = blk_aio_pwritev(blk, offset, &req->sg.iov, 0, cb, req);
@@ -1478,9 +1593,29 @@ static inline void nvme_blk_write(BlockBackend *blk, int64_t offset,
 
 static void nvme_update_cq_eventidx(const NvmeCQueue *cq)
 {
-    trace_pci_nvme_update_cq_eventidx(cq->cqid, cq->head);
+    /*
+     * The host cannot move the head past the tail, so while polling an event
+     * index at the tail keeps it from writing the doorbell.
+     */
+    uint32_t ei = cq->polling ? cq->tail : cq->head;
 
-    stl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->ei_addr, cq->head,
+    trace_pci_nvme_update_cq_eventidx(cq->cqid, ei);
+
+    stl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->ei_addr, ei,
+                   MEMTXATTRS_UNSPECIFIED);
+}
+
+static void nvme_update_sq_eventidx(const NvmeSQueue *sq)
+{
+    /*
+     * The host cannot move the tail onto the entry before the head, so while
+     * polling an event index there keeps it from writing the doorbell.
+     */
+    uint32_t ei = sq->polling ? (sq->head ?: sq->size) - 1 : sq->tail;
+
+    trace_pci_nvme_update_sq_eventidx(sq->sqid, ei);
+
+    stl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->ei_addr, ei,
                    MEMTXATTRS_UNSPECIFIED);
 }
 
@@ -1518,8 +1653,13 @@ static void nvme_post_cqes(void *opaque)
         req->cqe.sq_id = cpu_to_le16(sq->sqid);
         req->cqe.sq_head = cpu_to_le16(sq->head);
         addr = cq->dma_addr + (cq->tail << NVME_CQES);
-        ret = pci_dma_write(PCI_DEVICE(n), addr, (void *)&req->cqe,
-                            sizeof(req->cqe));
+        if (cq->dma_cache) {
+            ret = dma_cache_write(cq->dma_cache, addr, &req->cqe,
+                                  sizeof(req->cqe));
+        } else {
+            ret = pci_dma_write(PCI_DEVICE(n), addr, (void *)&req->cqe,
+                                sizeof(req->cqe));
+        }
         if (ret) {
             trace_pci_nvme_err_addr_write(addr);
             trace_pci_nvme_err_cfs();
@@ -1532,15 +1672,20 @@ static void nvme_post_cqes(void *opaque)
         nvme_inc_cq_tail(cq);
         nvme_sg_unmap(&req->sg);
 
-        if (QTAILQ_EMPTY(&sq->req_list) && !nvme_sq_empty(sq)) {
+        /* sq->bh is NULL while the queue moves between AioContexts */
+        if (sq->bh && QTAILQ_EMPTY(&sq->req_list) && !nvme_sq_empty(sq)) {
             qemu_bh_schedule(sq->bh);
         }
 
         QTAILQ_INSERT_TAIL(&sq->req_list, req, entry);
     }
+    if (cq->polling && n->dbbuf_enabled) {
+        nvme_update_cq_eventidx(cq);
+    }
+
     if (cq->tail != cq->head) {
         if (cq->irq_enabled && !pending) {
-            n->cq_pending++;
+            qatomic_inc(&n->cq_pending);
         }
 
         nvme_irq_assert(n, cq);
@@ -4719,20 +4864,15 @@ static uint16_t nvme_io_cmd(NvmeCtrl *n, NvmeRequest *req)
     g_assert_not_reached();
 }
 
-static void nvme_cq_notifier(EventNotifier *e)
+static void nvme_cq_head_moved(NvmeCQueue *cq)
 {
-    NvmeCQueue *cq = container_of(e, NvmeCQueue, notifier);
     NvmeCtrl *n = cq->ctrl;
 
-    if (!event_notifier_test_and_clear(e)) {
-        return;
-    }
-
     nvme_update_cq_head(cq);
 
     if (cq->tail == cq->head) {
         if (cq->irq_enabled) {
-            n->cq_pending--;
+            qatomic_dec(&n->cq_pending);
         }
 
         nvme_irq_deassert(n, cq);
@@ -4741,6 +4881,17 @@ static void nvme_cq_notifier(EventNotifier *e)
     qemu_bh_schedule(cq->bh);
 }
 
+static void nvme_cq_notifier(EventNotifier *e)
+{
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, notifier);
+
+    if (!event_notifier_test_and_clear(e)) {
+        return;
+    }
+
+    nvme_cq_head_moved(cq);
+}
+
 static int nvme_init_cq_ioeventfd(NvmeCQueue *cq)
 {
     NvmeCtrl *n = cq->ctrl;
@@ -4788,9 +4939,487 @@ static int nvme_init_sq_ioeventfd(NvmeSQueue *sq)
     return 0;
 }
 
+/*
+ * In an IOThread, the shadow doorbells of a queue are polled like a
+ * virtqueue.  While polling, the event indexes are moved out of reach of
+ * the host, so that it skips the doorbell writes completely.
+ */
+static void nvme_sq_poll_begin(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    sq->polling = true;
+    nvme_update_sq_eventidx(sq);
+}
+
+static bool nvme_sq_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+    uint32_t tail;
+
+    /* nvme_post_cqes() resumes the queue when requests become free */
+    if (QTAILQ_EMPTY(&sq->req_list)) {
+        return false;
+    }
+
+    ldl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->db_addr, &tail,
+                   MEMTXATTRS_UNSPECIFIED);
+
+    return tail != sq->head;
+}
+
+static void nvme_sq_poll_ready(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    nvme_process_sq(sq);
+}
+
+static void nvme_sq_poll_end(EventNotifier *e)
+{
+    NvmeSQueue *sq = container_of(e, NvmeSQueue, notifier);
+
+    sq->polling = false;
+    nvme_update_sq_eventidx(sq);
+
+    /* Caller polls once more after this to catch requests that race with us */
+    smp_mb();
+}
+
+static void nvme_cq_poll_begin(EventNotifier *e)
+{
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, notifier);
+
+    cq->polling = true;
+    nvme_update_cq_eventidx(cq);
+}
+
+static bool nvme_cq_poll(void *opaque)
+{
+    EventNotifier *e = opaque;
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, notifier);
+    uint32_t head;
+
+    ldl_le_pci_dma(PCI_DEVICE(cq->ctrl), cq->db_addr, &head,
+                   MEMTXATTRS_UNSPECIFIED);
+
+    return head != cq->head;
+}
+
+static void nvme_cq_poll_ready(EventNotifier *e)
+{
+    nvme_cq_head_moved(container_of(e, NvmeCQueue, notifier));
+}
+
+static void nvme_cq_poll_end(EventNotifier *e)
+{
+    NvmeCQueue *cq = container_of(e, NvmeCQueue, notifier);
+
+    cq->polling = false;
+    nvme_update_cq_eventidx(cq);
+
+    /* Caller polls once more after this to catch requests that race with us */
+    smp_mb();
+}
+
+/*
+ * I/O queue pairs mapped with "iothread-vq-mapping" run in IOThreads while
+ * the controller is otherwise idle.  That requires the doorbells and the
+ * interrupt of the pair to be eventfds, so that no part of the fast path
+ * needs the BQL.  Everything else, most notably admin commands, only runs
+ * after nvme_ioq_pause() has moved the pairs back to the main loop.
+ */
+static QEMUBH *nvme_bh_new(NvmeCtrl *n, AioContext *ctx, QEMUBHFunc *cb,
+                           void *opaque)
+{
+    /*
+     * The reentrancy guard is only meant for the thread that does MMIO under
+     * the BQL; setting it from an IOThread would make concurrent vCPU
+     * accesses to the device fail.
+     */
+    if (ctx) {
+        return aio_bh_new(ctx, cb, opaque);
+    }
+
+    return qemu_bh_new_guarded(cb, opaque, &DEVICE(n)->mem_reentrancy_guard);
+}
+
+static void nvme_set_notifier_handler(EventNotifier *e, AioContext *ctx,
+                                      EventNotifierHandler *handler)
+{
+    if (ctx) {
+        aio_set_event_notifier(ctx, e, handler, NULL, NULL);
+    } else {
+        event_notifier_set_handler(e, handler);
+    }
+}
+
+static int nvme_cq_irqfd_attach(NvmeCQueue *cq)
+{
+    int ret;
+
+    ret = kvm_irqchip_add_irqfd_notifier_gsi(kvm_state, &cq->irq_notifier,
+                                             NULL, cq->virq);
+    if (ret < 0) {
+        return ret;
+    }
+
+    cq->irqfd_attached = true;
+    return 0;
+}
+
+static void nvme_cq_irqfd_detach(NvmeCQueue *cq)
+{
+    if (!cq->irqfd_attached) {
+        return;
+    }
+
+    kvm_irqchip_remove_irqfd_notifier_gsi(kvm_state, &cq->irq_notifier,
+                                          cq->virq);
+    cq->irqfd_attached = false;
+}
+
+/* Signal the MSI-X vector of @cq through a KVM irqfd, if possible */
+static void nvme_cq_irqfd_init(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    PCIDevice *pci = PCI_DEVICE(n);
+    KVMRouteChange c;
+    int virq;
+
+    if (cq->virq >= 0 || !cq->irq_enabled || !msix_enabled(pci) ||
+        !kvm_msi_via_irqfd_enabled()) {
+        return;
+    }
+
+    if (event_notifier_init(&cq->irq_notifier, 0) < 0) {
+        return;
+    }
+
+    c = kvm_irqchip_begin_route_changes(kvm_state);
+    virq = kvm_irqchip_add_msi_route(&c, cq->vector, pci);
+    if (virq < 0) {
+        event_notifier_cleanup(&cq->irq_notifier);
+        return;
+    }
+    kvm_irqchip_commit_route_changes(&c);
+    cq->virq = virq;
+
+    if (!msix_is_masked(pci, cq->vector) && nvme_cq_irqfd_attach(cq) < 0) {
+        kvm_irqchip_release_virq(kvm_state, cq->virq);
+        event_notifier_cleanup(&cq->irq_notifier);
+        cq->virq = -1;
+    }
+}
+
+static void nvme_cq_irqfd_cleanup(NvmeCQueue *cq)
+{
+    if (cq->virq < 0) {
+        return;
+    }
+
+    nvme_cq_irqfd_detach(cq);
+    kvm_irqchip_release_virq(kvm_state, cq->virq);
+    event_notifier_cleanup(&cq->irq_notifier);
+    cq->virq = -1;
+}
+
+static int nvme_msix_vector_unmask(PCIDevice *pci, unsigned int vector,
+                                   MSIMessage msg)
+{
+    NvmeCtrl *n = NVME(pci);
+    int i, ret;
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        NvmeCQueue *cq = n->cq[i];
+
+        if (!cq || cq->virq < 0 || cq->vector != vector) {
+            continue;
+        }
+
+        ret = kvm_irqchip_update_msi_route(kvm_state, cq->virq, msg, pci);
+        if (ret < 0) {
+            return ret;
+        }
+        kvm_irqchip_commit_routes(kvm_state);
+
+        if (!cq->irqfd_attached) {
+            ret = nvme_cq_irqfd_attach(cq);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    return 0;
+}
+
+static void nvme_msix_vector_mask(PCIDevice *pci, unsigned int vector)
+{
+    NvmeCtrl *n = NVME(pci);
+    int i;
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        NvmeCQueue *cq = n->cq[i];
+
+        if (cq && cq->virq >= 0 && cq->vector == vector) {
+            nvme_cq_irqfd_detach(cq);
+        }
+    }
+}
+
+static void nvme_msix_vector_poll(PCIDevice *pci, unsigned int vector_start,
+                                  unsigned int vector_end)
+{
+    NvmeCtrl *n = NVME(pci);
+    int i;
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        NvmeCQueue *cq = n->cq[i];
+
+        if (!cq || cq->virq < 0 ||
+            cq->vector < vector_start || cq->vector >= vector_end ||
+            !msix_is_masked(pci, cq->vector)) {
+            continue;
+        }
+
+        if (event_notifier_test_and_clear(&cq->irq_notifier)) {
+            msix_set_pending(pci, cq->vector);
+        }
+    }
+}
+
+static bool nvme_cq_can_use_iothread(NvmeCtrl *n, NvmeCQueue *cq)
+{
+    NvmeSQueue *sq;
+
+    if (!n->ioq_ctx[cq->cqid] || !cq->ioeventfd_enabled) {
+        return false;
+    }
+
+    if (cq->irq_enabled &&
+        (cq->virq < 0 || !msix_enabled(PCI_DEVICE(n)))) {
+        return false;
+    }
+
+    QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
+        if (!sq->ioeventfd_enabled) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* Zoned and FDP namespaces keep state that all queues update unlocked */
+static bool nvme_ns_can_use_iothreads(NvmeCtrl *n)
+{
+    NvmeNamespace *ns;
+    int i;
+
+    for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
+        ns = nvme_ns(n, i);
+        if (ns && (ns->params.zoned ||
+                   (ns->endgrp && ns->endgrp->fdp.enabled))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void nvme_ioq_drain(NvmeCtrl *n)
+{
+    NvmeNamespace *ns;
+    int i;
+
+    for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
+        ns = nvme_ns(n, i);
+        if (ns) {
+            nvme_ns_drain(ns);
+        }
+    }
+}
+
+/* Stop fetching commands from the SQs of @cq, which runs in @ctx */
+static void nvme_ioq_stop_sqs(NvmeCQueue *cq, AioContext *ctx)
+{
+    NvmeSQueue *sq;
+
+    nvme_set_notifier_handler(&cq->notifier, ctx, NULL);
+    QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
+        nvme_set_notifier_handler(&sq->notifier, ctx, NULL);
+        qemu_bh_delete(sq->bh);
+        sq->bh = NULL;
+    }
+}
+
+/* Post what completed since nvme_ioq_stop_sqs() and stop @cq */
+static void nvme_ioq_stop_cq(NvmeCQueue *cq)
+{
+    if (!QTAILQ_EMPTY(&cq->req_list)) {
+        nvme_post_cqes(cq);
+    }
+
+    qemu_bh_delete(cq->bh);
+    cq->bh = NULL;
+}
+
+static void nvme_ioq_stop_sqs_bh(void *opaque)
+{
+    NvmeCQueue *cq = opaque;
+
+    nvme_ioq_stop_sqs(cq, cq->ctx);
+}
+
+static void nvme_ioq_stop_cq_bh(void *opaque)
+{
+    nvme_ioq_stop_cq(opaque);
+}
+
+/* Run @cq and its SQs in @ctx, or in the main loop if @ctx is NULL */
+static void nvme_ioq_start(NvmeCQueue *cq, AioContext *ctx)
+{
+    NvmeCtrl *n = cq->ctrl;
+    NvmeSQueue *sq;
+
+    /* detaching may have stopped in the middle of a polling section */
+    cq->polling = false;
+    if (n->dbbuf_enabled) {
+        nvme_update_cq_eventidx(cq);
+    }
+
+    cq->bh = nvme_bh_new(n, ctx, nvme_post_cqes, cq);
+    QTAILQ_FOREACH(sq, &cq->sq_list, entry) {
+        sq->polling = false;
+        sq->bh = nvme_bh_new(n, ctx, nvme_process_sq, sq);
+        if (ctx) {
+            aio_set_event_notifier(ctx, &sq->notifier, nvme_sq_notifier,
+                                   nvme_sq_poll, nvme_sq_poll_ready);
+            aio_set_event_notifier_poll(ctx, &sq->notifier,
+                                        nvme_sq_poll_begin, nvme_sq_poll_end);
+        } else {
+            event_notifier_set_handler(&sq->notifier, nvme_sq_notifier);
+        }
+
+        /* pick up the doorbell writes that came in while stopped */
+        qemu_bh_schedule(sq->bh);
+    }
+
+    if (ctx) {
+        aio_set_event_notifier(ctx, &cq->notifier, nvme_cq_notifier,
+                               nvme_cq_poll, nvme_cq_poll_ready);
+        aio_set_event_notifier_poll(ctx, &cq->notifier,
+                                    nvme_cq_poll_begin, nvme_cq_poll_end);
+    } else {
+        event_notifier_set_handler(&cq->notifier, nvme_cq_notifier);
+    }
+
+    if (!QTAILQ_EMPTY(&cq->req_list)) {
+        qemu_bh_schedule(cq->bh);
+    }
+}
+
+/*
+ * Move the I/O queues that run in IOThreads to the main loop, so that the
+ * caller may touch their state.  Calls nest and are undone by
+ * nvme_ioq_resume().
+ *
+ * Context: BQL held
+ */
+static void nvme_ioq_pause(NvmeCtrl *n)
+{
+    NvmeCQueue *cq;
+    int i;
+
+    if (!n->ioq_ctx || n->ioq_pause_depth++) {
+        return;
+    }
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        cq = n->cq[i];
+        if (cq && cq->ctx) {
+            aio_wait_bh_oneshot(cq->ctx, nvme_ioq_stop_sqs_bh, cq);
+        }
+    }
+
+    /* requests complete in the AioContext that submitted them */
+    nvme_ioq_drain(n);
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        cq = n->cq[i];
+        if (cq && cq->ctx) {
+            aio_wait_bh_oneshot(cq->ctx, nvme_ioq_stop_cq_bh, cq);
+            nvme_ioq_start(cq, NULL);
+        }
+    }
+}
+
+/*
+ * Move the I/O queues that can use their IOThread back to it.
+ *
+ * Context: BQL held
+ */
+static void nvme_ioq_resume(NvmeCtrl *n)
+{
+    bool ns_ok, moved = false;
+    NvmeCQueue *cq;
+    int i;
+
+    if (!n->ioq_ctx) {
+        return;
+    }
+
+    assert(n->ioq_pause_depth > 0);
+    if (--n->ioq_pause_depth) {
+        return;
+    }
+
+    ns_ok = nvme_ns_can_use_iothreads(n);
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        cq = n->cq[i];
+        if (!cq) {
+            continue;
+        }
+
+        cq->ctx = NULL;
+        if (!ns_ok || !n->ioq_ctx[i]) {
+            continue;
+        }
+
+        nvme_cq_irqfd_init(n, cq);
+        if (nvme_cq_can_use_iothread(n, cq)) {
+            cq->ctx = n->ioq_ctx[i];
+            nvme_ioq_stop_sqs(cq, NULL);
+            moved = true;
+        }
+    }
+
+    if (!moved) {
+        return;
+    }
+
+    nvme_ioq_drain(n);
+
+    for (i = 1; i <= n->params.max_ioqpairs; i++) {
+        cq = n->cq[i];
+        if (cq && cq->ctx) {
+            nvme_ioq_stop_cq(cq);
+            nvme_ioq_start(cq, cq->ctx);
+        }
+    }
+}
+
+static void nvme_ioq_resume_bh(void *opaque)
+{
+    nvme_ioq_resume(opaque);
+}
+
 static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
 {
     uint16_t offset = sq->sqid << 3;
+    int i;
 
     n->sq[sq->sqid] = NULL;
     qemu_bh_delete(sq->bh);
@@ -4800,7 +5429,12 @@ static void nvme_free_sq(NvmeSQueue *sq, NvmeCtrl *n)
         event_notifier_set_handler(&sq->notifier, NULL);
         event_notifier_cleanup(&sq->notifier);
     }
+    for (i = 0; i < sq->size; i++) {
+        qemu_iovec_destroy(&sq->io_req[i].dma_iov);
+    }
     g_free(sq->io_req);
+    dma_cache_free(sq->dma_cache);
+    sq->dma_cache = NULL;
     if (sq->sqid) {
         g_free(sq);
     }
@@ -4856,6 +5490,8 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
 
     sq->ctrl = n;
     sq->dma_addr = dma_addr;
+    sq->dma_cache = nvme_queue_dma_cache_new(n, dma_addr, size << NVME_SQES,
+                                             DMA_DIRECTION_TO_DEVICE);
     sq->sqid = sqid;
     sq->size = size;
     sq->cqid = cqid;
@@ -4866,6 +5502,7 @@ static void nvme_init_sq(NvmeSQueue *sq, NvmeCtrl *n, uint64_t dma_addr,
     QTAILQ_INIT(&sq->out_req_list);
     for (i = 0; i < sq->size; i++) {
         sq->io_req[i].sq = sq;
+        qemu_iovec_init(&sq->io_req[i].dma_iov, 1);
         QTAILQ_INSERT_TAIL(&(sq->req_list), &sq->io_req[i], entry);
     }
 
@@ -5515,9 +6152,12 @@ static void nvme_free_cq(NvmeCQueue *cq, NvmeCtrl *n)
         event_notifier_set_handler(&cq->notifier, NULL);
         event_notifier_cleanup(&cq->notifier);
     }
+    nvme_cq_irqfd_cleanup(cq);
     if (msix_enabled(pci) && cq->irq_enabled) {
         msix_vector_unuse(pci, cq->vector);
     }
+    dma_cache_free(cq->dma_cache);
+    cq->dma_cache = NULL;
     if (cq->cqid) {
         g_free(cq);
     }
@@ -5541,7 +6181,7 @@ static uint16_t nvme_del_cq(NvmeCtrl *n, NvmeRequest *req)
     }
 
     if (cq->irq_enabled && cq->tail != cq->head) {
-        n->cq_pending--;
+        qatomic_dec(&n->cq_pending);
     }
 
     nvme_irq_deassert(n, cq);
@@ -5564,10 +6204,15 @@ static void nvme_init_cq(NvmeCQueue *cq, NvmeCtrl *n, uint64_t dma_addr,
     cq->cqid = cqid;
     cq->size = size;
     cq->dma_addr = dma_addr;
+    cq->dma_cache = nvme_queue_dma_cache_new(n, dma_addr, size << NVME_CQES,
+                                             DMA_DIRECTION_FROM_DEVICE);
     cq->phase = 1;
     cq->irq_enabled = irq_enabled;
     cq->vector = vector;
     cq->head = cq->tail = 0;
+    cq->ctx = NULL;
+    cq->virq = -1;
+    cq->irqfd_attached = false;
     QTAILQ_INIT(&cq->req_list);
     QTAILQ_INIT(&cq->sq_list);
     if (n->dbbuf_enabled) {
@@ -7004,6 +7649,11 @@ static void nvme_do_format(NvmeFormatAIOCB *iocb)
 done:
     iocb->common.cb(iocb->common.opaque, iocb->ret);
     qemu_aio_unref(iocb);
+
+    /* resuming drains, which a completion callback must not do */
+    if (n->ioq_ctx) {
+        aio_bh_schedule_oneshot(qemu_get_aio_context(), nvme_ioq_resume_bh, n);
+    }
 }
 
 static uint16_t nvme_format(NvmeCtrl *n, NvmeRequest *req)
@@ -7049,6 +7699,9 @@ static uint16_t nvme_format(NvmeCtrl *n, NvmeRequest *req)
     }
 
     req->aiocb = &iocb->common;
+
+    /* keep I/O in the main loop while namespaces change their format */
+    nvme_ioq_pause(n);
     nvme_do_format(iocb);
 
     return NVME_NO_COMPLETE;
@@ -7333,25 +7986,8 @@ static uint16_t nvme_directive_receive(NvmeCtrl *n, NvmeRequest *req)
     }
 }
 
-static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
+static uint16_t nvme_do_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
 {
-    trace_pci_nvme_admin_cmd(nvme_cid(req), nvme_sqid(req), req->cmd.opcode,
-                             nvme_adm_opc_str(req->cmd.opcode));
-
-    if (!(n->cse.acs[req->cmd.opcode] & NVME_CMD_EFF_CSUPP)) {
-        trace_pci_nvme_err_invalid_admin_opc(req->cmd.opcode);
-        return NVME_INVALID_OPCODE | NVME_DNR;
-    }
-
-    /* SGLs shall not be used for Admin commands in NVMe over PCIe */
-    if (NVME_CMD_FLAGS_PSDT(req->cmd.flags) != NVME_PSDT_PRP) {
-        return NVME_INVALID_FIELD | NVME_DNR;
-    }
-
-    if (NVME_CMD_FLAGS_FUSE(req->cmd.flags)) {
-        return NVME_INVALID_FIELD;
-    }
-
     switch (req->cmd.opcode) {
     case NVME_ADM_CMD_DELETE_SQ:
         return nvme_del_sq(n, req);
@@ -7392,12 +8028,52 @@ static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
     return NVME_INVALID_OPCODE | NVME_DNR;
 }
 
-static void nvme_update_sq_eventidx(const NvmeSQueue *sq)
+static uint16_t nvme_admin_cmd(NvmeCtrl *n, NvmeRequest *req)
 {
-    trace_pci_nvme_update_sq_eventidx(sq->sqid, sq->tail);
+    uint16_t status;
+    bool pause;
 
-    stl_le_pci_dma(PCI_DEVICE(sq->ctrl), sq->ei_addr, sq->tail,
-                   MEMTXATTRS_UNSPECIFIED);
+    trace_pci_nvme_admin_cmd(nvme_cid(req), nvme_sqid(req), req->cmd.opcode,
+                             nvme_adm_opc_str(req->cmd.opcode));
+
+    if (!(n->cse.acs[req->cmd.opcode] & NVME_CMD_EFF_CSUPP)) {
+        trace_pci_nvme_err_invalid_admin_opc(req->cmd.opcode);
+        return NVME_INVALID_OPCODE | NVME_DNR;
+    }
+
+    /* SGLs shall not be used for Admin commands in NVMe over PCIe */
+    if (NVME_CMD_FLAGS_PSDT(req->cmd.flags) != NVME_PSDT_PRP) {
+        return NVME_INVALID_FIELD | NVME_DNR;
+    }
+
+    if (NVME_CMD_FLAGS_FUSE(req->cmd.flags)) {
+        return NVME_INVALID_FIELD;
+    }
+
+    /* commands that only read controller state leave the I/O queues be */
+    switch (req->cmd.opcode) {
+    case NVME_ADM_CMD_GET_LOG_PAGE:
+    case NVME_ADM_CMD_IDENTIFY:
+    case NVME_ADM_CMD_GET_FEATURES:
+    case NVME_ADM_CMD_ASYNC_EV_REQ:
+        pause = false;
+        break;
+    default:
+        pause = true;
+        break;
+    }
+
+    if (pause) {
+        nvme_ioq_pause(n);
+    }
+
+    status = nvme_do_admin_cmd(n, req);
+
+    if (pause) {
+        nvme_ioq_resume(n);
+    }
+
+    return status;
 }
 
 static void nvme_update_sq_tail(NvmeSQueue *sq)
@@ -7493,6 +8169,7 @@ static void nvme_process_sq(void *opaque)
     hwaddr addr;
     NvmeCmd cmd;
     NvmeRequest *req;
+    int res;
 
     if (n->dbbuf_enabled) {
         nvme_update_sq_tail(sq);
@@ -7503,7 +8180,12 @@ static void nvme_process_sq(void *opaque)
         bool cmd_is_atomic;
 
         addr = sq->dma_addr + (sq->head << NVME_SQES);
-        if (nvme_addr_read(n, addr, (void *)&cmd, sizeof(cmd))) {
+        if (sq->dma_cache) {
+            res = dma_cache_read(sq->dma_cache, addr, &cmd, sizeof(cmd));
+        } else {
+            res = nvme_addr_read(n, addr, (void *)&cmd, sizeof(cmd));
+        }
+        if (res) {
             trace_pci_nvme_err_addr_read(addr);
             trace_pci_nvme_err_cfs();
             stl_le_p(&n->bar.csts, NVME_CSTS_FAILED);
@@ -7601,6 +8283,8 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     NvmeNamespace *ns;
     int i;
 
+    nvme_ioq_pause(n);
+
     for (i = 1; i <= NVME_MAX_NAMESPACES; i++) {
         ns = nvme_ns(n, i);
         if (!ns) {
@@ -7664,6 +8348,8 @@ static void nvme_ctrl_reset(NvmeCtrl *n, NvmeResetType rst)
     n->dbbuf_dbs = 0;
     n->dbbuf_eis = 0;
     n->dbbuf_enabled = false;
+
+    nvme_ioq_resume(n);
 }
 
 static void nvme_ctrl_shutdown(NvmeCtrl *n)
@@ -8149,7 +8835,7 @@ static void nvme_process_db(NvmeCtrl *n, hwaddr addr, int val)
 
         if (cq->tail == cq->head) {
             if (cq->irq_enabled) {
-                n->cq_pending--;
+                qatomic_dec(&n->cq_pending);
             }
 
             nvme_irq_deassert(n, cq);
@@ -8294,6 +8980,25 @@ static bool nvme_check_params(NvmeCtrl *n, Error **errp)
         return false;
     }
 
+    if (params->iothread_vq_mapping_list) {
+        if (!params->ioeventfd) {
+            error_setg(errp, "iothread-vq-mapping requires ioeventfd=on");
+            return false;
+        }
+
+        if (params->sriov_max_vfs) {
+            error_setg(errp, "iothread-vq-mapping cannot be used with "
+                       "sriov_max_vfs");
+            return false;
+        }
+
+        if (params->atomic_awun || params->atomic_awupf) {
+            error_setg(errp, "iothread-vq-mapping cannot be used with "
+                       "atomic.awun or atomic.awupf");
+            return false;
+        }
+    }
+
     if (params->msix_qsize < 1 ||
         params->msix_qsize > PCI_MSIX_FLAGS_QSIZE + 1) {
         error_setg(errp, "msix_qsize must be between 1 and %d",
@@ -8409,6 +9114,39 @@ static bool nvme_check_params(NvmeCtrl *n, Error **errp)
     return true;
 }
 
+static bool nvme_init_iothreads(NvmeCtrl *n, PCIDevice *pci_dev,
+                                Error **errp)
+{
+    NvmeParams *params = &n->params;
+
+    if (!params->iothread_vq_mapping_list) {
+        return true;
+    }
+
+    /* indexed by queue id, the admin queue pair always uses the main loop */
+    n->ioq_ctx = g_new0(AioContext *, params->max_ioqpairs + 1);
+    if (!iothread_vq_mapping_apply(params->iothread_vq_mapping_list,
+                                   &n->ioq_ctx[1], params->max_ioqpairs,
+                                   errp)) {
+        g_free(n->ioq_ctx);
+        n->ioq_ctx = NULL;
+        return false;
+    }
+
+    if (msix_present(pci_dev) && kvm_msi_via_irqfd_enabled() &&
+        msix_set_vector_notifiers(pci_dev, nvme_msix_vector_unmask,
+                                  nvme_msix_vector_mask,
+                                  nvme_msix_vector_poll) < 0) {
+        warn_report("nvme: cannot set MSI-X vector notifiers, I/O queues "
+                    "will stay in the main loop");
+        iothread_vq_mapping_cleanup(params->iothread_vq_mapping_list);
+        g_free(n->ioq_ctx);
+        n->ioq_ctx = NULL;
+    }
+
+    return true;
+}
+
 static void nvme_init_state(NvmeCtrl *n)
 {
     NvmePriCtrlCap *cap = &n->pri_ctrl_cap;
@@ -8982,6 +9720,9 @@ static void nvme_realize(PCIDevice *pci_dev, Error **errp)
     if (!nvme_init_pci(n, pci_dev, errp)) {
         return;
     }
+    if (!nvme_init_iothreads(n, pci_dev, errp)) {
+        return;
+    }
     nvme_init_ctrl(n, pci_dev);
 
     /* setup a namespace if the controller drive property was given */
@@ -9014,6 +9755,14 @@ static void nvme_exit(PCIDevice *pci_dev)
 
     nvme_subsys_unregister_ctrl(n->subsys, n);
 
+    if (n->ioq_ctx) {
+        if (msix_present(pci_dev) && kvm_msi_via_irqfd_enabled()) {
+            msix_unset_vector_notifiers(pci_dev);
+        }
+        iothread_vq_mapping_cleanup(n->params.iothread_vq_mapping_list);
+        g_free(n->ioq_ctx);
+    }
+
     g_free(n->cq);
     g_free(n->sq);
     g_free(n->aer_reqs);
@@ -9084,6 +9833,8 @@ static const Property nvme_props[] = {
     DEFINE_PROP_UINT16("atomic.awun", NvmeCtrl, params.atomic_awun, 0),
     DEFINE_PROP_UINT16("atomic.awupf", NvmeCtrl, params.atomic_awupf, 0),
     DEFINE_PROP_BOOL("ocp", NvmeCtrl, params.ocp, false),
+    DEFINE_PROP_IOTHREAD_VQ_MAPPING_LIST("iothread-vq-mapping", NvmeCtrl,
+                                         params.iothread_vq_mapping_list),
 };
 
 static void nvme_get_smart_warning(Object *obj, Visitor *v, const char *name,
@@ -9152,7 +9903,15 @@ static void nvme_sriov_post_write_config(PCIDevice *dev, uint16_t old_num_vfs)
 static void nvme_pci_write_config(PCIDevice *dev, uint32_t address,
                                   uint32_t val, int len)
 {
+    NvmeCtrl *n = NVME(dev);
     uint16_t old_num_vfs = pcie_sriov_num_vfs(dev);
+    bool msix_ctrl = msix_present(dev) &&
+        ranges_overlap(address, len, dev->msix_cap + PCI_MSIX_FLAGS, 2);
+
+    /* I/O queues use MSI-X in IOThreads, see nvme_cq_can_use_iothread() */
+    if (msix_ctrl) {
+        nvme_ioq_pause(n);
+    }
 
     if (pcie_find_capability(dev, PCI_EXT_CAP_ID_DOE)) {
         pcie_doe_write_config(&dev->doe_spdm, address, val, len);
@@ -9160,6 +9919,10 @@ static void nvme_pci_write_config(PCIDevice *dev, uint32_t address,
     pci_default_write_config(dev, address, val, len);
     pcie_cap_flr_write_config(dev, address, val, len);
     nvme_sriov_post_write_config(dev, old_num_vfs);
+
+    if (msix_ctrl) {
+        nvme_ioq_resume(n);
+    }
 }
 
 static uint32_t nvme_pci_read_config(PCIDevice *dev, uint32_t address, int len)
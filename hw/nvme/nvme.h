@@ -23,6 +23,7 @@
 #include "hw/block/block.h"
 
 #include "block/nvme.h"
+#include "qapi/qapi-types-virtio.h"
 
 #define NVME_MAX_CONTROLLERS 256
 #define NVME_MAX_NAMESPACES  256
@@ -426,6 +427,10 @@ typedef struct NvmeRequest {
     NvmeCmd                 cmd;
     BlockAcctCookie         acct;
     NvmeSg                  sg;
+    /* sg mapped to host memory, see nvme_blk_map() */
+    QEMUIOVector            dma_iov;
+    DMADirection            dma_dir;
+    BlockCompletionFunc     *dma_cb;
     bool                    atomic_write;
     QTAILQ_ENTRY(NvmeRequest)entry;
 } NvmeRequest;
@@ -488,11 +493,15 @@ typedef struct NvmeSQueue {
     uint32_t    tail;
     uint32_t    size;
     uint64_t    dma_addr;
+    /* NULL if the queue is in the CMB or PMR */
+    DMACache    *dma_cache;
     uint64_t    db_addr;
     uint64_t    ei_addr;
     QEMUBH      *bh;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
+    /* the shadow doorbell is being polled, see nvme_sq_poll_begin() */
+    bool        polling;
     NvmeRequest *io_req;
     QTAILQ_HEAD(, NvmeRequest) req_list;
     QTAILQ_HEAD(, NvmeRequest) out_req_list;
@@ -509,11 +518,20 @@ typedef struct NvmeCQueue {
     uint32_t    vector;
     uint32_t    size;
     uint64_t    dma_addr;
+    /* NULL if the queue is in the CMB or PMR */
+    DMACache    *dma_cache;
     uint64_t    db_addr;
     uint64_t    ei_addr;
     QEMUBH      *bh;
     EventNotifier notifier;
     bool        ioeventfd_enabled;
+    bool        polling;
+    /* IOThread running the queue and its SQs, NULL for the main loop */
+    AioContext  *ctx;
+    /* MSI-X irqfd, virq is -1 if the vector is signalled with msix_notify */
+    EventNotifier irq_notifier;
+    int         virq;
+    bool        irqfd_attached;
     QTAILQ_HEAD(, NvmeSQueue) sq_list;
     QTAILQ_HEAD(, NvmeRequest) req_list;
 } NvmeCQueue;
@@ -554,6 +572,8 @@ typedef struct NvmeParams {
     uint16_t atomic_awun;
     uint16_t atomic_awupf;
     bool     atomic_dn;
+
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
 } NvmeParams;
 
 typedef struct NvmeCtrl {
@@ -584,6 +604,11 @@ typedef struct NvmeCtrl {
     uint64_t    dbbuf_eis;
     bool        dbbuf_enabled;
 
+    /* AioContext of each I/O queue pair by queue id, NULL if unmapped */
+    AioContext  **ioq_ctx;
+    /* I/O queues run in the main loop while this is non-zero */
+    unsigned int ioq_pause_depth;
+
     struct {
         uint32_t acs[256];
         struct {
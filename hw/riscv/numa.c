@@ -18,11 +18,13 @@
 
 #include "qemu/osdep.h"
 #include "qemu/units.h"
+#include "qemu/cutils.h"
 #include "qemu/error-report.h"
 #include "qapi/error.h"
 #include "hw/boards.h"
 #include "hw/qdev-properties.h"
 #include "hw/riscv/numa.h"
+#include "system/hostmem.h"
 #include "system/device_tree.h"
 
 static bool numa_enabled(const MachineState *ms)
@@ -156,6 +158,35 @@ uint64_t riscv_socket_mem_size(const MachineState *ms, int socket_id)
             ms->numa_state->nodes[socket_id].node_mem : 0;
 }
 
+void riscv_socket_check_mem_align(const MachineState *ms, hwaddr base)
+{
+    int i;
+
+    if (!numa_enabled(ms)) {
+        return;
+    }
+
+    for (i = 0; i < ms->numa_state->num_nodes; i++) {
+        HostMemoryBackend *memdev = ms->numa_state->nodes[i].node_memdev;
+        hwaddr addr = base + riscv_socket_mem_offset(ms, i);
+        size_t pagesize;
+
+        if (!memdev || !ms->numa_state->nodes[i].node_mem) {
+            continue;
+        }
+
+        pagesize = host_memory_backend_pagesize(memdev);
+        if (addr & (pagesize - 1)) {
+            g_autofree char *size_str = size_to_str(pagesize);
+
+            warn_report("socket%d memory at 0x%" HWADDR_PRIx " is not "
+                        "aligned to the %s page size of its memory backend "
+                        "and cannot be mapped with host huge pages", i, addr,
+                        size_str);
+        }
+    }
+}
+
 void riscv_socket_fdt_write_id(const MachineState *ms, const char *node_name,
                                int socket_id)
 {
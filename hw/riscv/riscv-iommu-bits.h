@@ -244,6 +244,13 @@ enum RISCV_IOMMU_HPMEVENT_id {
     RISCV_IOMMU_HPMEVENT_MAX        = 9
 };
 
+/* Custom events, in the range the specification sets aside for them */
+enum RISCV_IOMMU_HPMEVENT_custom_id {
+    RISCV_IOMMU_HPMEVENT_QEMU_TLB_HIT   = 16384,
+    RISCV_IOMMU_HPMEVENT_QEMU_TLB_EVICT = 16385,
+    RISCV_IOMMU_HPMEVENT_QEMU_MAX       = 16386
+};
+
 /* 5.24 Translation request IOVA (64bits) */
 #define RISCV_IOMMU_REG_TR_REQ_IOVA     0x0258
 
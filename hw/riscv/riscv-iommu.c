@@ -24,7 +24,12 @@
 #include "hw/riscv/riscv_hart.h"
 #include "migration/vmstate.h"
 #include "qapi/error.h"
+#include "qapi/qapi-types-stats.h"
+#include "qemu/lockable.h"
+#include "qemu/main-loop.h"
+#include "qemu/rcu.h"
 #include "qemu/timer.h"
+#include "system/stats.h"
 
 #include "cpu_bits.h"
 #include "riscv-iommu.h"
@@ -34,13 +39,15 @@
 
 #define LIMIT_CACHE_CTX               (1U << 7)
 #define LIMIT_CACHE_IOT               (1U << 20)
+#define INIT_CACHE_IOT                (1U << 12)
+
+/* Commands processed by the IOThread before yielding */
+#define RISCV_IOMMU_CQ_BATCH          64
 
 /* Physical page number coversions */
 #define PPN_PHYS(ppn)                 ((ppn) << TARGET_PAGE_BITS)
 #define PPN_DOWN(phy)                 ((phy) >> TARGET_PAGE_BITS)
 
-typedef struct RISCVIOMMUEntry RISCVIOMMUEntry;
-
 /* Device assigned I/O address space */
 struct RISCVIOMMUSpace {
     IOMMUMemoryRegion iova_mr;  /* IOVA memory region for attached device */
@@ -60,12 +67,15 @@ typedef enum RISCVIOMMUTransTag {
 
 /* Address translation cache entry */
 struct RISCVIOMMUEntry {
+    struct rcu_head rcu;        /* Must be first, see g_free_rcu() */
     RISCVIOMMUTransTag tag;     /* Translation Tag */
     uint64_t iova:44;           /* IOVA Page Number */
     uint64_t pscid:20;          /* Process Soft-Context identifier */
     uint64_t phys:44;           /* Physical Page Number */
     uint64_t gscid:16;          /* Guest Soft-Context identifier */
     uint64_t perm:2;            /* IOMMU_RW flags */
+    bool used;                  /* Referenced since the last eviction scan */
+    QTAILQ_ENTRY(RISCVIOMMUEntry) lru; /* Eviction order, under cache_lock */
 };
 
 /* IOMMU index for transactions without process_id specified. */
@@ -105,6 +115,43 @@ void riscv_iommu_notify(RISCVIOMMUState *s, int vec_type)
     }
 }
 
+/*
+ * Replace the cache of a queue with one for the (@mask + 1) entries of
+ * @entry_size bytes at @addr, or drop it if @entry_size is zero.  Called
+ * with the BQL held.
+ */
+static void riscv_iommu_queue_cache_set(RISCVIOMMUState *s, DMACache **cache,
+                                        dma_addr_t addr, uint32_t mask,
+                                        size_t entry_size, DMADirection dir)
+{
+    DMACache *old = *cache;
+    DMACache *new = NULL;
+
+    if (entry_size) {
+        new = dma_cache_new(s->target_as, addr,
+                            ((uint64_t)mask + 1) * entry_size, dir);
+    }
+    qatomic_rcu_set(cache, new);
+    dma_cache_free(old);
+}
+
+/* Write a record to the fault or page request queue. */
+static MemTxResult riscv_iommu_queue_write(RISCVIOMMUState *s,
+                                           DMACache **cache, dma_addr_t addr,
+                                           const void *buf, dma_addr_t len)
+{
+    DMACache *c;
+
+    RCU_READ_LOCK_GUARD();
+
+    c = qatomic_rcu_read(cache);
+    if (!c) {
+        return dma_memory_write(s->target_as, addr, buf, len,
+                                MEMTXATTRS_UNSPECIFIED);
+    }
+    return dma_cache_write(c, addr, buf, len);
+}
+
 static void riscv_iommu_fault(RISCVIOMMUState *s,
                               struct riscv_iommu_fq_record *ev)
 {
@@ -127,8 +174,8 @@ static void riscv_iommu_fault(RISCVIOMMUState *s,
                               RISCV_IOMMU_FQCSR_FQOF, 0);
     } else {
         dma_addr_t addr = s->fq_addr + tail * sizeof(*ev);
-        if (dma_memory_write(s->target_as, addr, ev, sizeof(*ev),
-                             MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        if (riscv_iommu_queue_write(s, &s->fq_cache, addr, ev,
+                                    sizeof(*ev)) != MEMTX_OK) {
             riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_FQCSR,
                                   RISCV_IOMMU_FQCSR_FQMF, 0);
         } else {
@@ -163,8 +210,8 @@ static void riscv_iommu_pri(RISCVIOMMUState *s,
                               RISCV_IOMMU_PQCSR_PQOF, 0);
     } else {
         dma_addr_t addr = s->pq_addr + tail * sizeof(*pr);
-        if (dma_memory_write(s->target_as, addr, pr, sizeof(*pr),
-                             MEMTXATTRS_UNSPECIFIED) != MEMTX_OK) {
+        if (riscv_iommu_queue_write(s, &s->pq_cache, addr, pr,
+                                    sizeof(*pr)) != MEMTX_OK) {
             riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_PQCSR,
                                   RISCV_IOMMU_PQCSR_PQMF, 0);
         } else {
@@ -1072,68 +1119,119 @@ static int riscv_iommu_ctx_fetch(RISCVIOMMUState *s, RISCVIOMMUContext *ctx)
     return 0;
 }
 
-/* Translation Context cache support */
-static gboolean riscv_iommu_ctx_equal(gconstpointer v1, gconstpointer v2)
+/*
+ * Translation Context cache support
+ *
+ * Lookups are lock-free and run under the RCU read lock, which callers of
+ * riscv_iommu_ctx() hold until riscv_iommu_ctx_put().  Insertions and
+ * invalidations are serialised by cache_lock, and removed contexts are
+ * freed after a grace period.
+ */
+typedef bool riscv_iommu_ctx_match_fn(const RISCVIOMMUContext *ctx,
+                                      const RISCVIOMMUContext *arg);
+
+static bool riscv_iommu_ctx_equal(const void *v1, const void *v2)
 {
-    RISCVIOMMUContext *c1 = (RISCVIOMMUContext *) v1;
-    RISCVIOMMUContext *c2 = (RISCVIOMMUContext *) v2;
+    const RISCVIOMMUContext *c1 = v1;
+    const RISCVIOMMUContext *c2 = v2;
     return c1->devid == c2->devid &&
            c1->process_id == c2->process_id;
 }
 
-static guint riscv_iommu_ctx_hash(gconstpointer v)
+static uint32_t riscv_iommu_ctx_hash(const RISCVIOMMUContext *ctx)
 {
-    RISCVIOMMUContext *ctx = (RISCVIOMMUContext *) v;
     /*
      * Generate simple hash of (process_id, devid)
      * assuming 24-bit wide devid.
      */
-    return (guint)(ctx->devid) + ((guint)(ctx->process_id) << 24);
+    return (uint32_t)(ctx->devid) + ((uint32_t)(ctx->process_id) << 24);
 }
 
-static void riscv_iommu_ctx_inval_devid_procid(gpointer key, gpointer value,
-                                               gpointer data)
+static bool riscv_iommu_ctx_inval_devid_procid(const RISCVIOMMUContext *ctx,
+                                               const RISCVIOMMUContext *arg)
 {
-    RISCVIOMMUContext *ctx = (RISCVIOMMUContext *) value;
-    RISCVIOMMUContext *arg = (RISCVIOMMUContext *) data;
-    if (ctx->tc & RISCV_IOMMU_DC_TC_V &&
-        ctx->devid == arg->devid &&
-        ctx->process_id == arg->process_id) {
-        ctx->tc &= ~RISCV_IOMMU_DC_TC_V;
-    }
+    return ctx->devid == arg->devid &&
+           ctx->process_id == arg->process_id;
 }
 
-static void riscv_iommu_ctx_inval_devid(gpointer key, gpointer value,
-                                        gpointer data)
+static bool riscv_iommu_ctx_inval_devid(const RISCVIOMMUContext *ctx,
+                                        const RISCVIOMMUContext *arg)
 {
-    RISCVIOMMUContext *ctx = (RISCVIOMMUContext *) value;
-    RISCVIOMMUContext *arg = (RISCVIOMMUContext *) data;
-    if (ctx->tc & RISCV_IOMMU_DC_TC_V &&
-        ctx->devid == arg->devid) {
-        ctx->tc &= ~RISCV_IOMMU_DC_TC_V;
-    }
+    return ctx->devid == arg->devid;
+}
+
+static bool riscv_iommu_ctx_inval_all(const RISCVIOMMUContext *ctx,
+                                      const RISCVIOMMUContext *arg)
+{
+    return true;
 }
 
-static void riscv_iommu_ctx_inval_all(gpointer key, gpointer value,
-                                      gpointer data)
+typedef struct RISCVIOMMUCtxInval {
+    RISCVIOMMUState *s;
+    riscv_iommu_ctx_match_fn *func;
+    RISCVIOMMUContext key;
+} RISCVIOMMUCtxInval;
+
+static bool riscv_iommu_ctx_inval_one(void *p, uint32_t h, void *up)
 {
-    RISCVIOMMUContext *ctx = (RISCVIOMMUContext *) value;
-    if (ctx->tc & RISCV_IOMMU_DC_TC_V) {
-        ctx->tc &= ~RISCV_IOMMU_DC_TC_V;
+    RISCVIOMMUCtxInval *inval = up;
+    RISCVIOMMUContext *ctx = p;
+
+    if (!inval->func(ctx, &inval->key)) {
+        return false;
     }
+    inval->s->ctx_count--;
+    g_free_rcu(ctx, rcu);
+    return true;
 }
 
-static void riscv_iommu_ctx_inval(RISCVIOMMUState *s, GHFunc func,
-                                  uint32_t devid, uint32_t process_id)
+/* Called with cache_lock held */
+static void riscv_iommu_ctx_inval_locked(RISCVIOMMUState *s,
+                                         riscv_iommu_ctx_match_fn *func,
+                                         uint32_t devid, uint32_t process_id)
 {
-    GHashTable *ctx_cache;
-    RISCVIOMMUContext key = {
-        .devid = devid,
-        .process_id = process_id,
+    RISCVIOMMUCtxInval inval = {
+        .s = s,
+        .func = func,
+        .key = {
+            .devid = devid,
+            .process_id = process_id,
+        },
     };
-    ctx_cache = g_hash_table_ref(s->ctx_cache);
-    g_hash_table_foreach(ctx_cache, func, &key);
-    g_hash_table_unref(ctx_cache);
+
+    qht_iter_remove(&s->ctx_cache, riscv_iommu_ctx_inval_one, &inval);
+}
+
+static void riscv_iommu_ctx_inval(RISCVIOMMUState *s,
+                                  riscv_iommu_ctx_match_fn *func,
+                                  uint32_t devid, uint32_t process_id)
+{
+    QEMU_LOCK_GUARD(&s->cache_lock);
+    riscv_iommu_ctx_inval_locked(s, func, devid, process_id);
+}
+
+/*
+ * Publish a newly fetched context.  If another request cached the same
+ * context first, free @ctx and return the cached one instead.
+ */
+static RISCVIOMMUContext *riscv_iommu_ctx_insert(RISCVIOMMUState *s,
+                                                 RISCVIOMMUContext *ctx)
+{
+    void *existing;
+
+    QEMU_LOCK_GUARD(&s->cache_lock);
+
+    if (s->ctx_count >= LIMIT_CACHE_CTX) {
+        riscv_iommu_ctx_inval_locked(s, riscv_iommu_ctx_inval_all, 0, 0);
+    }
+
+    if (!qht_insert(&s->ctx_cache, ctx, riscv_iommu_ctx_hash(ctx),
+                    &existing)) {
+        g_free(ctx);
+        return existing;
+    }
+    s->ctx_count++;
+    return ctx;
 }
 
 /* Find or allocate translation context for a given {device_id, process_id} */
@@ -1141,18 +1239,17 @@ static RISCVIOMMUContext *riscv_iommu_ctx(RISCVIOMMUState *s,
                                           unsigned devid, unsigned process_id,
                                           void **ref)
 {
-    GHashTable *ctx_cache;
     RISCVIOMMUContext *ctx;
     RISCVIOMMUContext key = {
         .devid = devid,
         .process_id = process_id,
     };
 
-    ctx_cache = g_hash_table_ref(s->ctx_cache);
-    ctx = g_hash_table_lookup(ctx_cache, &key);
+    rcu_read_lock();
+    ctx = qht_lookup(&s->ctx_cache, &key, riscv_iommu_ctx_hash(&key));
 
-    if (ctx && (ctx->tc & RISCV_IOMMU_DC_TC_V)) {
-        *ref = ctx_cache;
+    if (ctx) {
+        *ref = s;
         return ctx;
     }
 
@@ -1162,20 +1259,11 @@ static RISCVIOMMUContext *riscv_iommu_ctx(RISCVIOMMUState *s,
 
     int fault = riscv_iommu_ctx_fetch(s, ctx);
     if (!fault) {
-        if (g_hash_table_size(ctx_cache) >= LIMIT_CACHE_CTX) {
-            g_hash_table_unref(ctx_cache);
-            ctx_cache = g_hash_table_new_full(riscv_iommu_ctx_hash,
-                                              riscv_iommu_ctx_equal,
-                                              g_free, NULL);
-            g_hash_table_ref(ctx_cache);
-            g_hash_table_unref(qatomic_xchg(&s->ctx_cache, ctx_cache));
-        }
-        g_hash_table_add(ctx_cache, ctx);
-        *ref = ctx_cache;
-        return ctx;
+        *ref = s;
+        return riscv_iommu_ctx_insert(s, ctx);
     }
 
-    g_hash_table_unref(ctx_cache);
+    rcu_read_unlock();
     *ref = NULL;
 
     riscv_iommu_report_fault(s, ctx, RISCV_IOMMU_FQ_TTYPE_UADDR_RD,
@@ -1188,7 +1276,7 @@ static RISCVIOMMUContext *riscv_iommu_ctx(RISCVIOMMUState *s,
 static void riscv_iommu_ctx_put(RISCVIOMMUState *s, void *ref)
 {
     if (ref) {
-        g_hash_table_unref((GHashTable *)ref);
+        rcu_read_unlock();
     }
 }
 
@@ -1230,168 +1318,246 @@ static AddressSpace *riscv_iommu_space(RISCVIOMMUState *s, uint32_t devid)
     return &as->iova_as;
 }
 
-/* Translation Object cache support */
-static gboolean riscv_iommu_iot_equal(gconstpointer v1, gconstpointer v2)
+/*
+ * Translation Object cache support
+ *
+ * Like the context cache, lookups are lock-free under the RCU read lock and
+ * updates are serialised by cache_lock.  Eviction uses the CLOCK algorithm:
+ * a hit only sets the entry's used flag, and the eviction scan gives used
+ * entries a second chance by moving them to the tail of iot_lru.
+ */
+typedef bool riscv_iommu_iot_match_fn(const RISCVIOMMUEntry *iot,
+                                      const RISCVIOMMUEntry *arg);
+
+static bool riscv_iommu_iot_equal(const void *v1, const void *v2)
 {
-    RISCVIOMMUEntry *t1 = (RISCVIOMMUEntry *) v1;
-    RISCVIOMMUEntry *t2 = (RISCVIOMMUEntry *) v2;
+    const RISCVIOMMUEntry *t1 = v1;
+    const RISCVIOMMUEntry *t2 = v2;
     return t1->gscid == t2->gscid && t1->pscid == t2->pscid &&
            t1->iova == t2->iova && t1->tag == t2->tag;
 }
 
-static guint riscv_iommu_iot_hash(gconstpointer v)
+static uint32_t riscv_iommu_iot_hash(const RISCVIOMMUEntry *t)
 {
-    RISCVIOMMUEntry *t = (RISCVIOMMUEntry *) v;
-    return (guint)t->iova;
+    return (uint32_t)t->iova;
 }
 
 /* GV: 0 AV: 0 PSCV: 0 GVMA: 0 */
 /* GV: 0 AV: 0 GVMA: 1 */
-static
-void riscv_iommu_iot_inval_all(gpointer key, gpointer value, gpointer data)
+static bool riscv_iommu_iot_inval_all(const RISCVIOMMUEntry *iot,
+                                      const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag;
 }
 
 /* GV: 0 AV: 0 PSCV: 1 GVMA: 0 */
-static
-void riscv_iommu_iot_inval_pscid(gpointer key, gpointer value, gpointer data)
+static bool riscv_iommu_iot_inval_pscid(const RISCVIOMMUEntry *iot,
+                                        const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->pscid == arg->pscid) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag &&
+           iot->pscid == arg->pscid;
 }
 
 /* GV: 0 AV: 1 PSCV: 0 GVMA: 0 */
-static
-void riscv_iommu_iot_inval_iova(gpointer key, gpointer value, gpointer data)
+static bool riscv_iommu_iot_inval_iova(const RISCVIOMMUEntry *iot,
+                                       const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->iova == arg->iova) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag &&
+           iot->iova == arg->iova;
 }
 
 /* GV: 0 AV: 1 PSCV: 1 GVMA: 0 */
-static void riscv_iommu_iot_inval_pscid_iova(gpointer key, gpointer value,
-                                             gpointer data)
+static bool riscv_iommu_iot_inval_pscid_iova(const RISCVIOMMUEntry *iot,
+                                             const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->pscid == arg->pscid &&
-        iot->iova == arg->iova) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag &&
+           iot->pscid == arg->pscid &&
+           iot->iova == arg->iova;
 }
 
 /* GV: 1 AV: 0 PSCV: 0 GVMA: 0 */
 /* GV: 1 AV: 0 GVMA: 1 */
-static
-void riscv_iommu_iot_inval_gscid(gpointer key, gpointer value, gpointer data)
+static bool riscv_iommu_iot_inval_gscid(const RISCVIOMMUEntry *iot,
+                                        const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->gscid == arg->gscid) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag &&
+           iot->gscid == arg->gscid;
 }
 
 /* GV: 1 AV: 0 PSCV: 1 GVMA: 0 */
-static void riscv_iommu_iot_inval_gscid_pscid(gpointer key, gpointer value,
-                                              gpointer data)
+static bool riscv_iommu_iot_inval_gscid_pscid(const RISCVIOMMUEntry *iot,
+                                              const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->gscid == arg->gscid &&
-        iot->pscid == arg->pscid) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag &&
+           iot->gscid == arg->gscid &&
+           iot->pscid == arg->pscid;
 }
 
 /* GV: 1 AV: 1 PSCV: 0 GVMA: 0 */
 /* GV: 1 AV: 1 GVMA: 1 */
-static void riscv_iommu_iot_inval_gscid_iova(gpointer key, gpointer value,
-                                             gpointer data)
+static bool riscv_iommu_iot_inval_gscid_iova(const RISCVIOMMUEntry *iot,
+                                             const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->gscid == arg->gscid &&
-        iot->iova == arg->iova) {
-        iot->perm = IOMMU_NONE;
-    }
+    return iot->tag == arg->tag &&
+           iot->gscid == arg->gscid &&
+           iot->iova == arg->iova;
 }
 
 /* GV: 1 AV: 1 PSCV: 1 GVMA: 0 */
-static void riscv_iommu_iot_inval_gscid_pscid_iova(gpointer key, gpointer value,
-                                                   gpointer data)
+static bool riscv_iommu_iot_inval_gscid_pscid_iova(const RISCVIOMMUEntry *iot,
+                                                   const RISCVIOMMUEntry *arg)
 {
-    RISCVIOMMUEntry *iot = (RISCVIOMMUEntry *) value;
-    RISCVIOMMUEntry *arg = (RISCVIOMMUEntry *) data;
-    if (iot->tag == arg->tag &&
-        iot->gscid == arg->gscid &&
-        iot->pscid == arg->pscid &&
-        iot->iova == arg->iova) {
-        iot->perm = IOMMU_NONE;
-    }
+    return riscv_iommu_iot_equal(iot, arg);
 }
 
-/* caller should keep ref-count for iot_cache object */
-static RISCVIOMMUEntry *riscv_iommu_iot_lookup(RISCVIOMMUContext *ctx,
-    GHashTable *iot_cache, hwaddr iova, RISCVIOMMUTransTag transtag)
+/* Look up a cached translation and fill in @iotlb on a hit */
+static bool riscv_iommu_iot_lookup(RISCVIOMMUState *s, RISCVIOMMUContext *ctx,
+    IOMMUTLBEntry *iotlb, RISCVIOMMUTransTag transtag)
 {
+    RISCVIOMMUEntry *iot;
     RISCVIOMMUEntry key = {
         .tag   = transtag,
         .gscid = get_field(ctx->gatp, RISCV_IOMMU_DC_IOHGATP_GSCID),
         .pscid = get_field(ctx->ta, RISCV_IOMMU_DC_TA_PSCID),
-        .iova  = PPN_DOWN(iova),
+        .iova  = PPN_DOWN(iotlb->iova),
     };
-    return g_hash_table_lookup(iot_cache, &key);
+
+    RCU_READ_LOCK_GUARD();
+    iot = qht_lookup(&s->iot_cache, &key, riscv_iommu_iot_hash(&key));
+    if (!iot || iot->perm == IOMMU_NONE) {
+        return false;
+    }
+
+    /* Avoid dirtying the cache line when the entry is already marked */
+    if (!qatomic_read(&iot->used)) {
+        qatomic_set(&iot->used, true);
+    }
+
+    iotlb->translated_addr = PPN_PHYS(iot->phys);
+    iotlb->addr_mask = ~TARGET_PAGE_MASK;
+    iotlb->perm = iot->perm;
+    return true;
+}
+
+/* Called with cache_lock held */
+static void riscv_iommu_iot_remove(RISCVIOMMUState *s, RISCVIOMMUEntry *iot)
+{
+    QTAILQ_REMOVE(&s->iot_lru, iot, lru);
+    s->iot_count--;
+    g_free_rcu(iot, rcu);
+}
+
+/* Called with cache_lock held */
+static void riscv_iommu_iot_evict(RISCVIOMMUState *s)
+{
+    RISCVIOMMUEntry *iot;
+
+    for (;;) {
+        iot = QTAILQ_FIRST(&s->iot_lru);
+        if (!qatomic_read(&iot->used)) {
+            break;
+        }
+        qatomic_set(&iot->used, false);
+        QTAILQ_REMOVE(&s->iot_lru, iot, lru);
+        QTAILQ_INSERT_TAIL(&s->iot_lru, iot, lru);
+    }
+
+    qht_remove(&s->iot_cache, iot, riscv_iommu_iot_hash(iot));
+    riscv_iommu_iot_remove(s, iot);
 }
 
-/* caller should keep ref-count for iot_cache object */
-static void riscv_iommu_iot_update(RISCVIOMMUState *s,
-    GHashTable *iot_cache, RISCVIOMMUEntry *iot)
+/*
+ * Insert a new translation, evicting an entry if the cache is full.
+ * Returns true if an entry was evicted.
+ */
+static bool riscv_iommu_iot_update(RISCVIOMMUState *s, RISCVIOMMUEntry *iot)
 {
     if (!s->iot_limit) {
-        return;
+        g_free(iot);
+        return false;
     }
 
-    if (g_hash_table_size(s->iot_cache) >= s->iot_limit) {
-        iot_cache = g_hash_table_new_full(riscv_iommu_iot_hash,
-                                          riscv_iommu_iot_equal,
-                                          g_free, NULL);
-        g_hash_table_unref(qatomic_xchg(&s->iot_cache, iot_cache));
+    QEMU_LOCK_GUARD(&s->cache_lock);
+
+    /* Another request may have cached the same page in the meantime */
+    iot->used = true;
+    if (!qht_insert(&s->iot_cache, iot, riscv_iommu_iot_hash(iot), NULL)) {
+        g_free(iot);
+        return false;
     }
-    g_hash_table_add(iot_cache, iot);
+
+    QTAILQ_INSERT_TAIL(&s->iot_lru, iot, lru);
+    if (++s->iot_count <= s->iot_limit) {
+        return false;
+    }
+
+    riscv_iommu_iot_evict(s);
+    return true;
 }
 
-static void riscv_iommu_iot_inval(RISCVIOMMUState *s, GHFunc func,
-    uint32_t gscid, uint32_t pscid, hwaddr iova, RISCVIOMMUTransTag transtag)
+typedef struct RISCVIOMMUIotInval {
+    RISCVIOMMUState *s;
+    riscv_iommu_iot_match_fn *func;
+    RISCVIOMMUEntry key;
+} RISCVIOMMUIotInval;
+
+static bool riscv_iommu_iot_inval_one(void *p, uint32_t h, void *up)
 {
-    GHashTable *iot_cache;
-    RISCVIOMMUEntry key = {
-        .tag = transtag,
-        .gscid = gscid,
-        .pscid = pscid,
-        .iova  = PPN_DOWN(iova),
+    RISCVIOMMUIotInval *inval = up;
+    RISCVIOMMUEntry *iot = p;
+
+    if (!inval->func(iot, &inval->key)) {
+        return false;
+    }
+    riscv_iommu_iot_remove(inval->s, iot);
+    return true;
+}
+
+static void riscv_iommu_iot_inval(RISCVIOMMUState *s,
+    riscv_iommu_iot_match_fn *func, uint32_t gscid, uint32_t pscid,
+    hwaddr iova, RISCVIOMMUTransTag transtag)
+{
+    RISCVIOMMUEntry *iot;
+    uint32_t hash;
+    RISCVIOMMUIotInval inval = {
+        .s = s,
+        .func = func,
+        .key = {
+            .tag = transtag,
+            .gscid = gscid,
+            .pscid = pscid,
+            .iova  = PPN_DOWN(iova),
+        },
     };
 
-    iot_cache = g_hash_table_ref(s->iot_cache);
-    g_hash_table_foreach(iot_cache, func, &key);
-    g_hash_table_unref(iot_cache);
+    QEMU_LOCK_GUARD(&s->cache_lock);
+
+    /* A fully qualified invalidation matches at most the one keyed entry */
+    if (func == riscv_iommu_iot_inval_gscid_pscid_iova) {
+        hash = riscv_iommu_iot_hash(&inval.key);
+        iot = qht_lookup(&s->iot_cache, &inval.key, hash);
+        if (iot) {
+            qht_remove(&s->iot_cache, iot, hash);
+            riscv_iommu_iot_remove(s, iot);
+        }
+        return;
+    }
+
+    qht_iter_remove(&s->iot_cache, riscv_iommu_iot_inval_one, &inval);
+}
+
+static bool riscv_iommu_iot_flush_one(void *p, uint32_t h, void *up)
+{
+    riscv_iommu_iot_remove(up, p);
+    return true;
+}
+
+/* Drop every cached context and translation */
+static void riscv_iommu_cache_flush(RISCVIOMMUState *s)
+{
+    QEMU_LOCK_GUARD(&s->cache_lock);
+    riscv_iommu_ctx_inval_locked(s, riscv_iommu_ctx_inval_all, 0, 0);
+    qht_iter_remove(&s->iot_cache, riscv_iommu_iot_flush_one, s);
 }
 
 static RISCVIOMMUTransTag riscv_iommu_get_transtag(RISCVIOMMUContext *ctx)
@@ -1413,15 +1579,12 @@ static int riscv_iommu_translate(RISCVIOMMUState *s, RISCVIOMMUContext *ctx,
 {
     RISCVIOMMUTransTag transtag = riscv_iommu_get_transtag(ctx);
     RISCVIOMMUEntry *iot;
-    IOMMUAccessFlags perm;
     bool enable_pid;
     bool enable_pri;
-    GHashTable *iot_cache;
     int fault;
 
     riscv_iommu_hpm_incr_ctr(s, ctx, RISCV_IOMMU_HPMEVENT_URQ);
 
-    iot_cache = g_hash_table_ref(s->iot_cache);
     /*
      * TC[32] is reserved for custom extensions, used here to temporarily
      * enable automatic page-request generation for ATS queries.
@@ -1440,17 +1603,15 @@ static int riscv_iommu_translate(RISCVIOMMUState *s, RISCVIOMMUContext *ctx,
         }
     }
 
-    iot = riscv_iommu_iot_lookup(ctx, iot_cache, iotlb->iova, transtag);
-    perm = iot ? iot->perm : IOMMU_NONE;
-    if (perm != IOMMU_NONE) {
-        iotlb->translated_addr = PPN_PHYS(iot->phys);
-        iotlb->addr_mask = ~TARGET_PAGE_MASK;
-        iotlb->perm = perm;
+    if (riscv_iommu_iot_lookup(s, ctx, iotlb, transtag)) {
+        riscv_iommu_hpm_incr_ctr(s, ctx, RISCV_IOMMU_HPMEVENT_QEMU_TLB_HIT);
+        qatomic_set(&s->iot_hits, qatomic_read(&s->iot_hits) + 1);
         fault = 0;
         goto done;
     }
 
     riscv_iommu_hpm_incr_ctr(s, ctx, RISCV_IOMMU_HPMEVENT_TLB_MISS);
+    qatomic_set(&s->iot_misses, qatomic_read(&s->iot_misses) + 1);
 
     /* Translate using device directory / page table information. */
     fault = riscv_iommu_spa_fetch(s, ctx, iotlb);
@@ -1474,12 +1635,15 @@ static int riscv_iommu_translate(RISCVIOMMUState *s, RISCVIOMMUContext *ctx,
         iot->pscid = get_field(ctx->ta, RISCV_IOMMU_DC_TA_PSCID);
         iot->perm = iotlb->perm;
         iot->tag = transtag;
-        riscv_iommu_iot_update(s, iot_cache, iot);
+        if (riscv_iommu_iot_update(s, iot)) {
+            riscv_iommu_hpm_incr_ctr(s, ctx,
+                                     RISCV_IOMMU_HPMEVENT_QEMU_TLB_EVICT);
+            qatomic_set(&s->iot_evictions,
+                        qatomic_read(&s->iot_evictions) + 1);
+        }
     }
 
 done:
-    g_hash_table_unref(iot_cache);
-
     if (enable_pri && fault) {
         struct riscv_iommu_pq_record pr = {0};
         if (enable_pid) {
@@ -1538,6 +1702,9 @@ static void riscv_iommu_ats(RISCVIOMMUState *s,
     uint32_t devid;
     const bool pv = cmd->dword0 & RISCV_IOMMU_CMD_ATS_PV;
 
+    /* Address space list and IOMMU notifiers are protected by the BQL */
+    BQL_LOCK_GUARD();
+
     if (cmd->dword0 & RISCV_IOMMU_CMD_ATS_DSV) {
         /* Use device segment and requester id */
         devid = get_field(cmd->dword0,
@@ -1630,18 +1797,61 @@ static void riscv_iommu_process_ddtp(RISCVIOMMUState *s)
 /* Command function and opcode field. */
 #define RISCV_IOMMU_CMD(func, op) (((func) << 7) | (op))
 
+/* Publish command queue progress, and report @fault if it is not zero. */
+static void riscv_iommu_cq_complete(RISCVIOMMUState *s, uint32_t head,
+                                    uint32_t fault)
+{
+    uint32_t ctrl;
+
+    BQL_LOCK_GUARD();
+
+    /* The queue may have been disabled or reset while commands ran */
+    ctrl = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQCSR);
+    if (!(ctrl & RISCV_IOMMU_CQCSR_CQON)) {
+        return;
+    }
+
+    riscv_iommu_reg_set32(s, RISCV_IOMMU_REG_CQH, head);
+
+    if (fault) {
+        riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_CQCSR, fault, 0);
+        if (ctrl & RISCV_IOMMU_CQCSR_CIE) {
+            riscv_iommu_notify(s, RISCV_IOMMU_INTR_CQ);
+        }
+    }
+}
+
+/*
+ * Drain the command queue.  Called either from the MMIO write handler with
+ * the BQL held, or from the IOThread bottom half without it; in the latter
+ * case the BQL is only taken to access registers and for ATS notifications.
+ * Cache invalidations rely on cache_lock alone.
+ */
 static void riscv_iommu_process_cq_tail(RISCVIOMMUState *s)
 {
     struct riscv_iommu_command cmd;
     MemTxResult res;
-    dma_addr_t addr;
-    uint32_t tail, head, ctrl;
+    dma_addr_t addr, cq_addr;
+    DMACache *cq_cache;
+    uint32_t tail, head, ctrl, cq_mask;
+    uint32_t fault = 0, count = 0;
     uint64_t cmd_opcode;
-    GHFunc func;
-
-    ctrl = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQCSR);
-    tail = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQT) & s->cq_mask;
-    head = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQH) & s->cq_mask;
+    riscv_iommu_iot_match_fn *iot_func;
+    riscv_iommu_ctx_match_fn *func;
+    /* Pending IOFENCE.C completion write, see below */
+    bool fence_pending = false;
+    uint64_t fence_addr = 0;
+    uint32_t fence_data = 0, fence_head = 0;
+
+    {
+        BQL_LOCK_GUARD();
+        ctrl = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQCSR);
+        cq_mask = s->cq_mask;
+        cq_addr = s->cq_addr;
+        cq_cache = s->cq_cache;
+        tail = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQT) & cq_mask;
+        head = riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQH) & cq_mask;
+    }
 
     /* Check for pending error or queue processing disabled */
     if (!(ctrl & RISCV_IOMMU_CQCSR_CQON) ||
@@ -1650,14 +1860,17 @@ static void riscv_iommu_process_cq_tail(RISCVIOMMUState *s)
     }
 
     while (tail != head) {
-        addr = s->cq_addr  + head * sizeof(cmd);
-        res = dma_memory_read(s->target_as, addr, &cmd, sizeof(cmd),
-                              MEMTXATTRS_UNSPECIFIED);
+        addr = cq_addr + head * sizeof(cmd);
+        if (cq_cache) {
+            res = dma_cache_read(cq_cache, addr, &cmd, sizeof(cmd));
+        } else {
+            res = dma_memory_read(s->target_as, addr, &cmd, sizeof(cmd),
+                                  MEMTXATTRS_UNSPECIFIED);
+        }
 
         if (res != MEMTX_OK) {
-            riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_CQCSR,
-                                  RISCV_IOMMU_CQCSR_CQMF, 0);
-            goto fault;
+            fault = RISCV_IOMMU_CQCSR_CQMF;
+            goto out;
         }
 
         trace_riscv_iommu_cmd(s->parent_obj.id, cmd.dword0, cmd.dword1);
@@ -1668,16 +1881,29 @@ static void riscv_iommu_process_cq_tail(RISCVIOMMUState *s)
         switch (cmd_opcode) {
         case RISCV_IOMMU_CMD(RISCV_IOMMU_CMD_IOFENCE_FUNC_C,
                              RISCV_IOMMU_CMD_IOFENCE_OPCODE):
-            res = riscv_iommu_iofence(s,
-                cmd.dword0 & RISCV_IOMMU_CMD_IOFENCE_AV, cmd.dword1 << 2,
-                get_field(cmd.dword0, RISCV_IOMMU_CMD_IOFENCE_DATA));
+            if (!(cmd.dword0 & RISCV_IOMMU_CMD_IOFENCE_AV)) {
+                break;
+            }
 
-            if (res != MEMTX_OK) {
-                riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_CQCSR,
-                                      RISCV_IOMMU_CQCSR_CQMF, 0);
-                goto fault;
+            /*
+             * Only the last of several back-to-back fences to the same
+             * address needs to be written, as long as it is written before
+             * the head pointer moves past it.
+             */
+            if (fence_pending && fence_addr != cmd.dword1 << 2) {
+                res = riscv_iommu_iofence(s, true, fence_addr, fence_data);
+                if (res != MEMTX_OK) {
+                    head = fence_head;
+                    fault = RISCV_IOMMU_CQCSR_CQMF;
+                    goto out;
+                }
             }
-            break;
+            fence_pending = true;
+            fence_addr = cmd.dword1 << 2;
+            fence_data = get_field(cmd.dword0, RISCV_IOMMU_CMD_IOFENCE_DATA);
+            fence_head = head;
+            /* Skip flushing the pending fence below */
+            goto next;
 
         case RISCV_IOMMU_CMD(RISCV_IOMMU_CMD_IOTINVAL_FUNC_GVMA,
                              RISCV_IOMMU_CMD_IOTINVAL_OPCODE):
@@ -1696,18 +1922,18 @@ static void riscv_iommu_process_cq_tail(RISCVIOMMUState *s)
                 goto cmd_ill;
             }
 
-            func = riscv_iommu_iot_inval_all;
+            iot_func = riscv_iommu_iot_inval_all;
 
             if (gv) {
-                func = (av) ? riscv_iommu_iot_inval_gscid_iova :
-                              riscv_iommu_iot_inval_gscid;
+                iot_func = (av) ? riscv_iommu_iot_inval_gscid_iova :
+                                  riscv_iommu_iot_inval_gscid;
             }
 
             riscv_iommu_iot_inval(
-                s, func, gscid, pscid, iova, RISCV_IOMMU_TRANS_TAG_VG);
+                s, iot_func, gscid, pscid, iova, RISCV_IOMMU_TRANS_TAG_VG);
 
             riscv_iommu_iot_inval(
-                s, func, gscid, pscid, iova, RISCV_IOMMU_TRANS_TAG_VN);
+                s, iot_func, gscid, pscid, iova, RISCV_IOMMU_TRANS_TAG_VN);
             break;
         }
 
@@ -1727,24 +1953,24 @@ static void riscv_iommu_process_cq_tail(RISCVIOMMUState *s)
             if (gv) {
                 transtag = RISCV_IOMMU_TRANS_TAG_VN;
                 if (pscv) {
-                    func = (av) ? riscv_iommu_iot_inval_gscid_pscid_iova :
-                                  riscv_iommu_iot_inval_gscid_pscid;
+                    iot_func = (av) ? riscv_iommu_iot_inval_gscid_pscid_iova :
+                                      riscv_iommu_iot_inval_gscid_pscid;
                 } else {
-                    func = (av) ? riscv_iommu_iot_inval_gscid_iova :
-                                  riscv_iommu_iot_inval_gscid;
+                    iot_func = (av) ? riscv_iommu_iot_inval_gscid_iova :
+                                      riscv_iommu_iot_inval_gscid;
                 }
             } else {
                 transtag = RISCV_IOMMU_TRANS_TAG_SS;
                 if (pscv) {
-                    func = (av) ? riscv_iommu_iot_inval_pscid_iova :
-                                  riscv_iommu_iot_inval_pscid;
+                    iot_func = (av) ? riscv_iommu_iot_inval_pscid_iova :
+                                      riscv_iommu_iot_inval_pscid;
                 } else {
-                    func = (av) ? riscv_iommu_iot_inval_iova :
-                                  riscv_iommu_iot_inval_all;
+                    iot_func = (av) ? riscv_iommu_iot_inval_iova :
+                                      riscv_iommu_iot_inval_all;
                 }
             }
 
-            riscv_iommu_iot_inval(s, func, gscid, pscid, iova, transtag);
+            riscv_iommu_iot_inval(s, iot_func, gscid, pscid, iova, transtag);
             break;
         }
 
@@ -1796,21 +2022,39 @@ static void riscv_iommu_process_cq_tail(RISCVIOMMUState *s)
         default:
         cmd_ill:
             /* Invalid instruction, do not advance instruction index. */
-            riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_CQCSR,
-                RISCV_IOMMU_CQCSR_CMD_ILL, 0);
-            goto fault;
+            fault = RISCV_IOMMU_CQCSR_CMD_ILL;
+            goto out;
+        }
+
+        if (fence_pending) {
+            fence_pending = false;
+            res = riscv_iommu_iofence(s, true, fence_addr, fence_data);
+            if (res != MEMTX_OK) {
+                head = fence_head;
+                fault = RISCV_IOMMU_CQCSR_CQMF;
+                goto out;
+            }
         }
 
-        /* Advance and update head pointer after command completes. */
-        head = (head + 1) & s->cq_mask;
-        riscv_iommu_reg_set32(s, RISCV_IOMMU_REG_CQH, head);
+    next:
+        /* Advance head pointer after command completes. */
+        head = (head + 1) & cq_mask;
+
+        /* Let the IOThread run other work between batches */
+        if (s->cq_bh && ++count == RISCV_IOMMU_CQ_BATCH) {
+            qemu_bh_schedule(s->cq_bh);
+            break;
+        }
     }
-    return;
 
-fault:
-    if (ctrl & RISCV_IOMMU_CQCSR_CIE) {
-        riscv_iommu_notify(s, RISCV_IOMMU_INTR_CQ);
+out:
+    if (fence_pending &&
+        riscv_iommu_iofence(s, true, fence_addr, fence_data) != MEMTX_OK) {
+        head = fence_head;
+        fault = RISCV_IOMMU_CQCSR_CQMF;
     }
+
+    riscv_iommu_cq_complete(s, head, fault);
 }
 
 static void riscv_iommu_process_cq_control(RISCVIOMMUState *s)
@@ -1826,6 +2070,9 @@ static void riscv_iommu_process_cq_control(RISCVIOMMUState *s)
         s->cq_mask = (2ULL << get_field(base, RISCV_IOMMU_CQB_LOG2SZ)) - 1;
         s->cq_addr = PPN_PHYS(get_field(base, RISCV_IOMMU_CQB_PPN));
         stl_le_p(&s->regs_ro[RISCV_IOMMU_REG_CQT], ~s->cq_mask);
+        riscv_iommu_queue_cache_set(s, &s->cq_cache, s->cq_addr, s->cq_mask,
+                                    sizeof(struct riscv_iommu_command),
+                                    DMA_DIRECTION_TO_DEVICE);
         stl_le_p(&s->regs_rw[RISCV_IOMMU_REG_CQH], 0);
         stl_le_p(&s->regs_rw[RISCV_IOMMU_REG_CQT], 0);
         ctrl_set = RISCV_IOMMU_CQCSR_CQON;
@@ -1834,6 +2081,8 @@ static void riscv_iommu_process_cq_control(RISCVIOMMUState *s)
                    RISCV_IOMMU_CQCSR_FENCE_W_IP;
     } else if (!enable && active) {
         stl_le_p(&s->regs_ro[RISCV_IOMMU_REG_CQT], ~0);
+        riscv_iommu_queue_cache_set(s, &s->cq_cache, 0, 0, 0,
+                                    DMA_DIRECTION_TO_DEVICE);
         ctrl_set = 0;
         ctrl_clr = RISCV_IOMMU_CQCSR_BUSY | RISCV_IOMMU_CQCSR_CQON;
     } else {
@@ -1844,6 +2093,21 @@ static void riscv_iommu_process_cq_control(RISCVIOMMUState *s)
     riscv_iommu_reg_mod32(s, RISCV_IOMMU_REG_CQCSR, ctrl_set, ctrl_clr);
 }
 
+/* IOThread bottom half, scheduled by writes to CQT and CQCSR */
+static void riscv_iommu_cq_bh(void *opaque)
+{
+    RISCVIOMMUState *s = opaque;
+
+    bql_lock();
+    if (riscv_iommu_reg_get32(s, RISCV_IOMMU_REG_CQCSR) &
+        RISCV_IOMMU_CQCSR_BUSY) {
+        riscv_iommu_process_cq_control(s);
+    }
+    bql_unlock();
+
+    riscv_iommu_process_cq_tail(s);
+}
+
 static void riscv_iommu_process_fq_control(RISCVIOMMUState *s)
 {
     uint64_t base;
@@ -1857,6 +2121,9 @@ static void riscv_iommu_process_fq_control(RISCVIOMMUState *s)
         s->fq_mask = (2ULL << get_field(base, RISCV_IOMMU_FQB_LOG2SZ)) - 1;
         s->fq_addr = PPN_PHYS(get_field(base, RISCV_IOMMU_FQB_PPN));
         stl_le_p(&s->regs_ro[RISCV_IOMMU_REG_FQH], ~s->fq_mask);
+        riscv_iommu_queue_cache_set(s, &s->fq_cache, s->fq_addr, s->fq_mask,
+                                    sizeof(struct riscv_iommu_fq_record),
+                                    DMA_DIRECTION_FROM_DEVICE);
         stl_le_p(&s->regs_rw[RISCV_IOMMU_REG_FQH], 0);
         stl_le_p(&s->regs_rw[RISCV_IOMMU_REG_FQT], 0);
         ctrl_set = RISCV_IOMMU_FQCSR_FQON;
@@ -1864,6 +2131,8 @@ static void riscv_iommu_process_fq_control(RISCVIOMMUState *s)
             RISCV_IOMMU_FQCSR_FQOF;
     } else if (!enable && active) {
         stl_le_p(&s->regs_ro[RISCV_IOMMU_REG_FQH], ~0);
+        riscv_iommu_queue_cache_set(s, &s->fq_cache, 0, 0, 0,
+                                    DMA_DIRECTION_TO_DEVICE);
         ctrl_set = 0;
         ctrl_clr = RISCV_IOMMU_FQCSR_BUSY | RISCV_IOMMU_FQCSR_FQON;
     } else {
@@ -1887,6 +2156,9 @@ static void riscv_iommu_process_pq_control(RISCVIOMMUState *s)
         s->pq_mask = (2ULL << get_field(base, RISCV_IOMMU_PQB_LOG2SZ)) - 1;
         s->pq_addr = PPN_PHYS(get_field(base, RISCV_IOMMU_PQB_PPN));
         stl_le_p(&s->regs_ro[RISCV_IOMMU_REG_PQH], ~s->pq_mask);
+        riscv_iommu_queue_cache_set(s, &s->pq_cache, s->pq_addr, s->pq_mask,
+                                    sizeof(struct riscv_iommu_pq_record),
+                                    DMA_DIRECTION_FROM_DEVICE);
         stl_le_p(&s->regs_rw[RISCV_IOMMU_REG_PQH], 0);
         stl_le_p(&s->regs_rw[RISCV_IOMMU_REG_PQT], 0);
         ctrl_set = RISCV_IOMMU_PQCSR_PQON;
@@ -1894,6 +2166,8 @@ static void riscv_iommu_process_pq_control(RISCVIOMMUState *s)
             RISCV_IOMMU_PQCSR_PQOF;
     } else if (!enable && active) {
         stl_le_p(&s->regs_ro[RISCV_IOMMU_REG_PQH], ~0);
+        riscv_iommu_queue_cache_set(s, &s->pq_cache, 0, 0, 0,
+                                    DMA_DIRECTION_TO_DEVICE);
         ctrl_set = 0;
         ctrl_clr = RISCV_IOMMU_PQCSR_BUSY | RISCV_IOMMU_PQCSR_PQON;
     } else {
@@ -2174,7 +2448,12 @@ static MemTxResult riscv_iommu_mmio_write(void *opaque, hwaddr addr,
         riscv_iommu_process_hpm_writes(s, regb, cy_inh);
     }
 
-    if (process_fn) {
+    if (process_fn && s->cq_bh &&
+        (process_fn == riscv_iommu_process_cq_tail ||
+         process_fn == riscv_iommu_process_cq_control)) {
+        /* Command queue is processed in the IOThread */
+        qemu_bh_schedule(s->cq_bh);
+    } else if (process_fn) {
         process_fn(s);
     }
 
@@ -2324,13 +2603,13 @@ static void riscv_iommu_instance_init(Object *obj)
     memset(s->regs_ro, 0xff, RISCV_IOMMU_REG_SIZE);
 
     /* Device translation context cache */
-    s->ctx_cache = g_hash_table_new_full(riscv_iommu_ctx_hash,
-                                         riscv_iommu_ctx_equal,
-                                         g_free, NULL);
+    qht_init(&s->ctx_cache, riscv_iommu_ctx_equal, LIMIT_CACHE_CTX,
+             QHT_MODE_AUTO_RESIZE);
 
-    s->iot_cache = g_hash_table_new_full(riscv_iommu_iot_hash,
-                                         riscv_iommu_iot_equal,
-                                         g_free, NULL);
+    qht_init(&s->iot_cache, riscv_iommu_iot_equal, INIT_CACHE_IOT,
+             QHT_MODE_AUTO_RESIZE);
+    QTAILQ_INIT(&s->iot_lru);
+    qemu_mutex_init(&s->cache_lock);
 
     s->iommus.le_next = NULL;
     s->iommus.le_prev = NULL;
@@ -2445,14 +2724,33 @@ static void riscv_iommu_realize(DeviceState *dev, Error **errp)
             timer_new_ns(QEMU_CLOCK_VIRTUAL, riscv_iommu_hpm_timer_cb, s);
         s->hpm_event_ctr_map = g_hash_table_new(g_direct_hash, g_direct_equal);
     }
+
+    if (s->iothread) {
+        object_ref(OBJECT(s->iothread));
+        s->cq_bh = aio_bh_new_guarded(iothread_get_aio_context(s->iothread),
+                                      riscv_iommu_cq_bh, s,
+                                      &dev->mem_reentrancy_guard);
+    }
 }
 
 static void riscv_iommu_unrealize(DeviceState *dev)
 {
     RISCVIOMMUState *s = RISCV_IOMMU(dev);
 
-    g_hash_table_unref(s->iot_cache);
-    g_hash_table_unref(s->ctx_cache);
+    if (s->cq_bh) {
+        qemu_bh_delete(s->cq_bh);
+        s->cq_bh = NULL;
+        object_unref(OBJECT(s->iothread));
+    }
+
+    dma_cache_free(s->cq_cache);
+    dma_cache_free(s->fq_cache);
+    dma_cache_free(s->pq_cache);
+
+    riscv_iommu_cache_flush(s);
+    qht_destroy(&s->iot_cache);
+    qht_destroy(&s->ctx_cache);
+    qemu_mutex_destroy(&s->cache_lock);
 
     if (s->cap & RISCV_IOMMU_CAP_HPM) {
         g_hash_table_unref(s->hpm_event_ctr_map);
@@ -2491,8 +2789,7 @@ void riscv_iommu_reset(RISCVIOMMUState *s)
 
     riscv_iommu_reg_set32(s, RISCV_IOMMU_REG_IPSR, 0);
 
-    g_hash_table_remove_all(s->ctx_cache);
-    g_hash_table_remove_all(s->iot_cache);
+    riscv_iommu_cache_flush(s);
 }
 
 static const Property riscv_iommu_properties[] = {
@@ -2508,6 +2805,8 @@ static const Property riscv_iommu_properties[] = {
     DEFINE_PROP_BOOL("g-stage", RISCVIOMMUState, enable_g_stage, TRUE),
     DEFINE_PROP_LINK("downstream-mr", RISCVIOMMUState, target_mr,
         TYPE_MEMORY_REGION, MemoryRegion *),
+    DEFINE_PROP_LINK("iothread", RISCVIOMMUState, iothread,
+        TYPE_IOTHREAD, IOThread *),
     DEFINE_PROP_UINT8("hpm-counters", RISCVIOMMUState, hpm_cntrs,
                       RISCV_IOMMU_IOCOUNT_NUM),
 };
@@ -2669,10 +2968,123 @@ static const TypeInfo riscv_iommu_memory_region_info = {
     .class_init = riscv_iommu_memory_region_init,
 };
 
+#define RISCV_IOMMU_STAT_IOT_HITS       "iotlb-hits"
+#define RISCV_IOMMU_STAT_IOT_MISSES     "iotlb-misses"
+#define RISCV_IOMMU_STAT_IOT_EVICTIONS  "iotlb-evictions"
+#define RISCV_IOMMU_STAT_IOT_ENTRIES    "iotlb-entries"
+#define RISCV_IOMMU_STAT_CTX_ENTRIES    "context-entries"
+
+typedef struct RISCVIOMMUStatsArgs {
+    StatsResultList **result;
+    strList *names;
+} RISCVIOMMUStatsArgs;
+
+static StatsList *riscv_iommu_stats_add(StatsList *list, strList *names,
+                                        const char *name, uint64_t val)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = val;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+static int riscv_iommu_stats_query(Object *obj, void *opaque)
+{
+    RISCVIOMMUStatsArgs *args = opaque;
+    RISCVIOMMUState *s;
+    StatsList *list = NULL;
+    g_autofree char *path = NULL;
+
+    if (!object_dynamic_cast(obj, TYPE_RISCV_IOMMU)) {
+        return 0;
+    }
+    s = RISCV_IOMMU(obj);
+
+    list = riscv_iommu_stats_add(list, args->names, RISCV_IOMMU_STAT_IOT_HITS,
+                                 qatomic_read(&s->iot_hits));
+    list = riscv_iommu_stats_add(list, args->names,
+                                 RISCV_IOMMU_STAT_IOT_MISSES,
+                                 qatomic_read(&s->iot_misses));
+    list = riscv_iommu_stats_add(list, args->names,
+                                 RISCV_IOMMU_STAT_IOT_EVICTIONS,
+                                 qatomic_read(&s->iot_evictions));
+    list = riscv_iommu_stats_add(list, args->names,
+                                 RISCV_IOMMU_STAT_IOT_ENTRIES,
+                                 qatomic_read(&s->iot_count));
+    list = riscv_iommu_stats_add(list, args->names,
+                                 RISCV_IOMMU_STAT_CTX_ENTRIES,
+                                 qatomic_read(&s->ctx_count));
+    if (list) {
+        path = object_get_canonical_path(obj);
+        add_stats_entry(args->result, STATS_PROVIDER_RISCV_IOMMU, path, list);
+    }
+    return 0;
+}
+
+static void riscv_iommu_stats_cb(StatsResultList **result, StatsTarget target,
+                                 strList *names, strList *targets,
+                                 Error **errp)
+{
+    RISCVIOMMUStatsArgs args = {
+        .result = result,
+        .names = names,
+    };
+
+    if (target != STATS_TARGET_VM) {
+        return;
+    }
+    object_child_foreach_recursive(object_get_root(), riscv_iommu_stats_query,
+                                   &args);
+}
+
+static StatsSchemaValueList *
+riscv_iommu_schemas_add(StatsSchemaValueList *list, const char *name,
+                        StatsType type)
+{
+    StatsSchemaValueList *schema_entry = g_new0(StatsSchemaValueList, 1);
+
+    schema_entry->value = g_new0(StatsSchemaValue, 1);
+    schema_entry->value->type = type;
+    schema_entry->value->name = g_strdup(name);
+    schema_entry->next = list;
+
+    return schema_entry;
+}
+
+static void riscv_iommu_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    list = riscv_iommu_schemas_add(list, RISCV_IOMMU_STAT_IOT_HITS,
+                                   STATS_TYPE_CUMULATIVE);
+    list = riscv_iommu_schemas_add(list, RISCV_IOMMU_STAT_IOT_MISSES,
+                                   STATS_TYPE_CUMULATIVE);
+    list = riscv_iommu_schemas_add(list, RISCV_IOMMU_STAT_IOT_EVICTIONS,
+                                   STATS_TYPE_CUMULATIVE);
+    list = riscv_iommu_schemas_add(list, RISCV_IOMMU_STAT_IOT_ENTRIES,
+                                   STATS_TYPE_INSTANT);
+    list = riscv_iommu_schemas_add(list, RISCV_IOMMU_STAT_CTX_ENTRIES,
+                                   STATS_TYPE_INSTANT);
+    add_stats_schema(result, STATS_PROVIDER_RISCV_IOMMU, STATS_TARGET_VM,
+                     list);
+}
+
 static void riscv_iommu_register_mr_types(void)
 {
     type_register_static(&riscv_iommu_memory_region_info);
     type_register_static(&riscv_iommu_info);
+    add_stats_callbacks(STATS_PROVIDER_RISCV_IOMMU, riscv_iommu_stats_cb,
+                        riscv_iommu_schemas_cb);
 }
 
 type_init(riscv_iommu_register_mr_types);
@@ -20,12 +20,16 @@
 #define HW_RISCV_IOMMU_STATE_H
 
 #include "qom/object.h"
+#include "qemu/qht.h"
+#include "qemu/rcu.h"
 #include "hw/qdev-properties.h"
 #include "system/dma.h"
+#include "system/iothread.h"
 #include "hw/riscv/iommu.h"
 #include "hw/riscv/riscv-iommu-bits.h"
 
 typedef enum riscv_iommu_igs_modes riscv_iommu_igs_mode;
+typedef struct RISCVIOMMUEntry RISCVIOMMUEntry;
 
 struct RISCVIOMMUState {
     /*< private >*/
@@ -57,6 +61,15 @@ struct RISCVIOMMUState {
     uint32_t fq_mask;     /* Fault/event queue index bit mask */
     uint32_t pq_mask;     /* Page request queue index bit mask */
 
+    /*
+     * Cached access to the queues, set when a queue is turned on.  The
+     * command queue cache is only used and replaced by the thread that
+     * processes the command queue, the others are protected by RCU.
+     */
+    DMACache *cq_cache;
+    DMACache *fq_cache;
+    DMACache *pq_cache;
+
     /* interrupt notifier */
     void (*notify)(RISCVIOMMUState *iommu, unsigned vector);
 
@@ -68,11 +81,29 @@ struct RISCVIOMMUState {
     AddressSpace trap_as;
     MemoryRegion trap_mr;
 
-    GHashTable *ctx_cache;          /* Device translation Context Cache */
+    QemuMutex cache_lock;           /* Serialises ctx/iot cache updates */
+
+    struct qht ctx_cache;           /* Device translation Context Cache */
+    unsigned ctx_count;             /* Entries in ctx_cache */
 
-    GHashTable *iot_cache;          /* IO Translated Address Cache */
+    struct qht iot_cache;           /* IO Translated Address Cache */
+    QTAILQ_HEAD(, RISCVIOMMUEntry) iot_lru; /* IOT cache eviction order */
+    unsigned iot_count;             /* Entries in iot_cache */
     unsigned iot_limit;             /* IO Translation Cache size limit */
 
+    /*
+     * Translation cache statistics for query-stats.  Updated without
+     * atomic read-modify-write, so concurrent translations may lose a
+     * count now and then.
+     */
+    uint64_t iot_hits;
+    uint64_t iot_misses;
+    uint64_t iot_evictions;
+
+    /* Optional IOThread draining the command queue */
+    IOThread *iothread;
+    QEMUBH *cq_bh;
+
     /* MMIO Hardware Interface */
     MemoryRegion regs_mr;
     uint8_t *regs_rw;  /* register state (user write) */
@@ -102,6 +133,7 @@ void riscv_iommu_notify(RISCVIOMMUState *s, int vec_type);
 typedef struct RISCVIOMMUContext RISCVIOMMUContext;
 /* Device translation context state. */
 struct RISCVIOMMUContext {
+    struct rcu_head rcu;        /* Must be first, see g_free_rcu() */
     uint64_t devid:24;          /* Requester Id, AKA device_id */
     uint64_t process_id:20;     /* Process ID. PASID for PCIe */
     uint64_t tc;                /* Translation Control */
@@ -112,7 +112,10 @@ static void riscv_cpu_register_csr_qtest_callback(void)
 static bool riscv_hart_realize(RISCVHartArrayState *s, int idx,
                                char *cpu_type, Error **errp)
 {
-    object_initialize_child(OBJECT(s), "harts[*]", &s->harts[idx], cpu_type);
+    /* An explicit index saves a search for a free "harts[*]" name */
+    g_autofree char *name = g_strdup_printf("harts[%d]", idx);
+
+    object_initialize_child(OBJECT(s), name, &s->harts[idx], cpu_type);
     qdev_prop_set_uint64(DEVICE(&s->harts[idx]), "resetvec", s->resetvec);
 
     if (s->harts[idx].cfg.ext_smrnmi) {
@@ -58,6 +58,8 @@
 #include "qapi/qapi-visit-common.h"
 #include "hw/virtio/virtio-iommu.h"
 #include "hw/uefi/var-service-api.h"
+#include "qemu/timer.h"
+#include "trace.h"
 
 /* KVM AIA only supports APLIC MSI. APLIC Wired is always emulated by QEMU. */
 static bool virt_use_kvm_aia_aplic_imsic(RISCVVirtAIAType aia_type)
@@ -230,7 +232,7 @@ static void create_pcie_irq_map(RISCVVirtState *s, void *fdt, char *nodename,
 }
 
 static void create_fdt_socket_cpus(RISCVVirtState *s, int socket,
-                                   char *clust_name, uint32_t *phandle,
+                                   uint32_t *phandle, uint32_t *cpu_phandles,
                                    uint32_t *intc_phandles)
 {
     int cpu;
@@ -242,11 +244,11 @@ static void create_fdt_socket_cpus(RISCVVirtState *s, int socket,
     for (cpu = s->soc[socket].num_harts - 1; cpu >= 0; cpu--) {
         RISCVCPU *cpu_ptr = &s->soc[socket].harts[cpu];
         g_autofree char *cpu_name = NULL;
-        g_autofree char *core_name = NULL;
         g_autofree char *intc_name = NULL;
         g_autofree char *sv_name = NULL;
 
         cpu_phandle = (*phandle)++;
+        cpu_phandles[cpu] = cpu_phandle;
 
         cpu_name = g_strdup_printf("/cpus/cpu@%d",
             s->soc[socket].hartid_base + cpu);
@@ -294,10 +296,25 @@ static void create_fdt_socket_cpus(RISCVVirtState *s, int socket,
             "riscv,cpu-intc");
         qemu_fdt_setprop(ms->fdt, intc_name, "interrupt-controller", NULL, 0);
         qemu_fdt_setprop_cell(ms->fdt, intc_name, "#interrupt-cells", 1);
+    }
+}
+
+static void create_fdt_socket_cpu_map(RISCVVirtState *s, int socket,
+                                      uint32_t *cpu_phandles)
+{
+    int cpu;
+    MachineState *ms = MACHINE(s);
+    g_autofree char *clust_name = NULL;
+
+    clust_name = g_strdup_printf("/cpus/cpu-map/cluster%d", socket);
+    qemu_fdt_add_subnode(ms->fdt, clust_name);
+
+    for (cpu = s->soc[socket].num_harts - 1; cpu >= 0; cpu--) {
+        g_autofree char *core_name = NULL;
 
         core_name = g_strdup_printf("%s/core%d", clust_name, cpu);
         qemu_fdt_add_subnode(ms->fdt, core_name);
-        qemu_fdt_setprop_cell(ms->fdt, core_name, "cpu", cpu_phandle);
+        qemu_fdt_setprop_cell(ms->fdt, core_name, "cpu", cpu_phandles[cpu]);
     }
 }
 
@@ -745,6 +762,7 @@ static void create_fdt_sockets(RISCVVirtState *s, const MemMapEntry *memmap,
     MachineState *ms = MACHINE(s);
     uint32_t msi_m_phandle = 0, msi_s_phandle = 0;
     uint32_t xplic_phandles[MAX_NODES];
+    g_autofree uint32_t *cpu_phandles = NULL;
     g_autofree uint32_t *intc_phandles = NULL;
     int socket_count = riscv_socket_count(ms);
 
@@ -755,19 +773,16 @@ static void create_fdt_sockets(RISCVVirtState *s, const MemMapEntry *memmap,
                           RISCV_ACLINT_DEFAULT_TIMEBASE_FREQ);
     qemu_fdt_setprop_cell(ms->fdt, "/cpus", "#size-cells", 0x0);
     qemu_fdt_setprop_cell(ms->fdt, "/cpus", "#address-cells", 0x1);
-    qemu_fdt_add_subnode(ms->fdt, "/cpus/cpu-map");
 
+    cpu_phandles = g_new0(uint32_t, ms->smp.cpus);
     intc_phandles = g_new0(uint32_t, ms->smp.cpus);
 
     phandle_pos = ms->smp.cpus;
     for (socket = (socket_count - 1); socket >= 0; socket--) {
-        g_autofree char *clust_name = NULL;
         phandle_pos -= s->soc[socket].num_harts;
 
-        clust_name = g_strdup_printf("/cpus/cpu-map/cluster%d", socket);
-        qemu_fdt_add_subnode(ms->fdt, clust_name);
-
-        create_fdt_socket_cpus(s, socket, clust_name, phandle,
+        create_fdt_socket_cpus(s, socket, phandle,
+                               &cpu_phandles[phandle_pos],
                                &intc_phandles[phandle_pos]);
 
         create_fdt_socket_memory(s, memmap, socket);
@@ -781,6 +796,18 @@ static void create_fdt_sockets(RISCVVirtState *s, const MemMapEntry *memmap,
         }
     }
 
+    /*
+     * New subnodes go in front of their siblings, so adding cpu-map after
+     * the cpus keeps it first and its path lookups from walking every
+     * cpu node.
+     */
+    qemu_fdt_add_subnode(ms->fdt, "/cpus/cpu-map");
+    phandle_pos = ms->smp.cpus;
+    for (socket = (socket_count - 1); socket >= 0; socket--) {
+        phandle_pos -= s->soc[socket].num_harts;
+        create_fdt_socket_cpu_map(s, socket, &cpu_phandles[phandle_pos]);
+    }
+
     if (s->aia_type == VIRT_AIA_TYPE_APLIC_IMSIC) {
         create_fdt_imsic(s, memmap, phandle, intc_phandles,
             &msi_m_phandle, &msi_s_phandle);
@@ -1533,6 +1560,7 @@ static void virt_machine_init(MachineState *machine)
     DeviceState *mmio_irqchip, *virtio_irqchip, *pcie_irqchip;
     int i, base_hartid, hart_count;
     int socket_count = riscv_socket_count(machine);
+    int64_t start;
 
     /* Check socket count limit */
     if (VIRT_SOCKETS_MAX < socket_count) {
@@ -1576,7 +1604,9 @@ static void virt_machine_init(MachineState *machine)
                                 base_hartid, &error_abort);
         object_property_set_int(OBJECT(&s->soc[i]), "num-harts",
                                 hart_count, &error_abort);
+        start = get_clock();
         sysbus_realize(SYS_BUS_DEVICE(&s->soc[i]), &error_fatal);
+        trace_riscv_virt_socket_realize(i, hart_count, get_clock() - start);
 
         if (virt_aclint_allowed() && s->have_aclint) {
             if (s->aia_type == VIRT_AIA_TYPE_APLIC_IMSIC) {
@@ -1672,6 +1702,7 @@ static void virt_machine_init(MachineState *machine)
     /* register system main memory (actual RAM) */
     memory_region_add_subregion(system_memory, memmap[VIRT_DRAM].base,
         machine->ram);
+    riscv_socket_check_mem_align(machine, memmap[VIRT_DRAM].base);
 
     /* boot rom */
     memory_region_init_rom(mask_rom, NULL, "riscv_virt_board.mrom",
@@ -1722,7 +1753,9 @@ static void virt_machine_init(MachineState *machine)
             exit(1);
         }
     } else {
+        start = get_clock();
         create_fdt(s, memmap);
+        trace_riscv_virt_create_fdt(machine->smp.cpus, get_clock() - start);
     }
 
     if (virt_is_iommu_sys_enabled(s)) {
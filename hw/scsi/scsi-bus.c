@@ -16,6 +16,10 @@
 #include "trace.h"
 #include "system/dma.h"
 #include "qemu/cutils.h"
+#include "qemu/coroutine-tls.h"
+#include "qemu/notify.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
 
 static char *scsibus_get_dev_path(DeviceState *dev);
 static char *scsibus_get_fw_dev_path(DeviceState *dev);
@@ -817,6 +821,109 @@ static const struct SCSIReqOps reqops_target_command = {
     .free_req     = scsi_target_free_buf,
 };
 
+enum {
+    SCSI_REQ_POOL_SIZES = 4,    /* distinct request sizes cached per thread */
+    SCSI_REQ_POOL_MAX_SIZE = 64, /* requests cached per size */
+};
+
+/*
+ * Requests are allocated and freed once per command.  With virtqueues
+ * mapped to several iothreads, each thread keeps the requests it freed
+ * for reuse, so that neither malloc nor a shared pool is hit for every
+ * command.  A bus usually sees one or two request types per device
+ * model, sorted out by their size.
+ */
+typedef struct SCSIReqPoolEntry {
+    QSLIST_ENTRY(SCSIReqPoolEntry) next;
+} SCSIReqPoolEntry;
+
+typedef struct SCSIReqPool {
+    size_t req_size;            /* 0 if unused */
+    unsigned int count;
+    QSLIST_HEAD(, SCSIReqPoolEntry) list;
+} SCSIReqPool;
+
+typedef struct SCSIReqPools {
+    SCSIReqPool pools[SCSI_REQ_POOL_SIZES];
+    Notifier cleanup_notifier;
+} SCSIReqPools;
+
+QEMU_DEFINE_STATIC_CO_TLS(SCSIReqPools, local_req_pools);
+
+static void local_req_pools_cleanup(Notifier *n, void *value)
+{
+    SCSIReqPools *local_pools = get_ptr_local_req_pools();
+    SCSIReqPoolEntry *entry, *tmp;
+    int i;
+
+    for (i = 0; i < SCSI_REQ_POOL_SIZES; i++) {
+        SCSIReqPool *pool = &local_pools->pools[i];
+
+        QSLIST_FOREACH_SAFE(entry, &pool->list, next, tmp) {
+            QSLIST_REMOVE_HEAD(&pool->list, next);
+            g_free(entry);
+        }
+        pool->count = 0;
+    }
+}
+
+/*
+ * Return the pool of this thread for requests of @req_size bytes,
+ * assigning an unused one if @create is true.  Return NULL if there is
+ * none.
+ */
+static SCSIReqPool *local_req_pool_find(size_t req_size, bool create)
+{
+    SCSIReqPools *local_pools = get_ptr_local_req_pools();
+    int i;
+
+    for (i = 0; i < SCSI_REQ_POOL_SIZES; i++) {
+        SCSIReqPool *pool = &local_pools->pools[i];
+
+        if (pool->req_size == req_size) {
+            return pool;
+        }
+        if (pool->req_size == 0) {
+            if (!create) {
+                return NULL;
+            }
+            if (!local_pools->cleanup_notifier.notify) {
+                local_pools->cleanup_notifier.notify = local_req_pools_cleanup;
+                qemu_thread_atexit_add(&local_pools->cleanup_notifier);
+            }
+            pool->req_size = req_size;
+            return pool;
+        }
+    }
+    return NULL;
+}
+
+static void *scsi_req_pool_get(size_t req_size)
+{
+    SCSIReqPool *pool = local_req_pool_find(req_size, false);
+    void *req;
+
+    if (pool && pool->count) {
+        req = QSLIST_FIRST(&pool->list);
+        QSLIST_REMOVE_HEAD(&pool->list, next);
+        pool->count--;
+        return req;
+    }
+    return g_malloc(req_size);
+}
+
+static void scsi_req_pool_put(void *req, size_t req_size)
+{
+    SCSIReqPool *pool = local_req_pool_find(req_size, true);
+    SCSIReqPoolEntry *entry = req;
+
+    if (pool && pool->count < SCSI_REQ_POOL_MAX_SIZE) {
+        QSLIST_INSERT_HEAD(&pool->list, entry, next);
+        pool->count++;
+    } else {
+        g_free(req);
+    }
+}
 
 SCSIRequest *scsi_req_alloc(const SCSIReqOps *reqops, SCSIDevice *d,
                             uint32_t tag, uint32_t lun, void *hba_private)
@@ -827,7 +934,7 @@ SCSIRequest *scsi_req_alloc(const SCSIReqOps *reqops, SCSIDevice *d,
     const int memset_off = offsetof(SCSIRequest, sense)
                            + sizeof(req->sense);
 
-    req = g_malloc(reqops->size);
+    req = scsi_req_pool_get(reqops->size);
     memset((uint8_t *)req + memset_off, 0, reqops->size - memset_off);
     req->refcount = 1;
     req->bus = bus;
@@ -1516,7 +1623,7 @@ void scsi_req_unref(SCSIRequest *req)
         }
         object_unref(OBJECT(req->dev));
         object_unref(OBJECT(qbus->parent));
-        g_free(req);
+        scsi_req_pool_put(req, req->ops->size);
     }
 }
 
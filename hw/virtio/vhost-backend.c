@@ -385,6 +385,24 @@ int vhost_backend_update_device_iotlb(struct vhost_dev *dev,
     return -ENODEV;
 }
 
+int vhost_backend_iotlb_batch_begin(struct vhost_dev *dev)
+{
+    if (dev->vhost_ops && dev->vhost_ops->vhost_iotlb_batch) {
+        return dev->vhost_ops->vhost_iotlb_batch(dev, true);
+    }
+
+    return 0;
+}
+
+int vhost_backend_iotlb_batch_end(struct vhost_dev *dev)
+{
+    if (dev->vhost_ops && dev->vhost_ops->vhost_iotlb_batch) {
+        return dev->vhost_ops->vhost_iotlb_batch(dev, false);
+    }
+
+    return 0;
+}
+
 int vhost_backend_invalidate_device_iotlb(struct vhost_dev *dev,
                                                  uint64_t iova, uint64_t len)
 {
@@ -34,6 +34,9 @@ struct VhostIOVATree {
 
     /* GPA->IOVA address memory maps */
     IOVATree *gpa_iova_map;
+
+    /* Incremented every time a mapping is removed */
+    uint64_t generation;
 };
 
 /**
@@ -52,6 +55,7 @@ VhostIOVATree *vhost_iova_tree_new(hwaddr iova_first, hwaddr iova_last)
     tree->iova_taddr_map = iova_tree_new();
     tree->iova_map = iova_tree_new();
     tree->gpa_iova_map = gpa_tree_new();
+    tree->generation = 1;
     return tree;
 }
 
@@ -66,6 +70,19 @@ void vhost_iova_tree_delete(VhostIOVATree *iova_tree)
     g_free(iova_tree);
 }
 
+/**
+ * Get the generation of a VhostIOVATree
+ *
+ * @tree: The VhostIOVATree
+ *
+ * Returns a non-zero value that changes whenever a mapping is removed, so
+ * a copy of a mapping found in the tree is valid while it is unchanged.
+ */
+uint64_t vhost_iova_tree_generation(const VhostIOVATree *tree)
+{
+    return tree->generation;
+}
+
 /**
  * Find the IOVA address stored from a memory address
  *
@@ -126,6 +143,7 @@ void vhost_iova_tree_remove(VhostIOVATree *iova_tree, DMAMap map)
 {
     iova_tree_remove(iova_tree->iova_taddr_map, map);
     iova_tree_remove(iova_tree->iova_map, map);
+    iova_tree->generation++;
 }
 
 /**
@@ -188,4 +206,5 @@ void vhost_iova_tree_remove_gpa(VhostIOVATree *iova_tree, DMAMap map)
 {
     iova_tree_remove(iova_tree->gpa_iova_map, map);
     iova_tree_remove(iova_tree->iova_map, map);
+    iova_tree->generation++;
 }
@@ -71,6 +71,47 @@ uint16_t vhost_svq_available_slots(const VhostShadowVirtqueue *svq)
     return svq->num_free;
 }
 
+/**
+ * Find the map of a buffer, trying first the one used by the previous
+ * buffer: the IOVA trees are searched linearly, and the buffers of a burst
+ * usually come from the same memory region.
+ *
+ * @svq: Shadow VirtQueue
+ * @needle: The buffer, with its length in size
+ * @gpa: True to search the GPA->IOVA tree, false for the IOVA->HVA one
+ */
+static const DMAMap *vhost_svq_find_map(VhostShadowVirtqueue *svq,
+                                        const DMAMap *needle, bool gpa)
+{
+    uint64_t gen = vhost_iova_tree_generation(svq->iova_tree);
+    DMAMap *cached = gpa ? &svq->last_gpa_map : &svq->last_hva_map;
+    const DMAMap *map;
+    hwaddr off;
+
+    if (svq->map_cache_gen != gen) {
+        /* IOMMU_NONE maps are never added to the tree */
+        svq->last_gpa_map.perm = IOMMU_NONE;
+        svq->last_hva_map.perm = IOMMU_NONE;
+        svq->map_cache_gen = gen;
+    } else if (cached->perm != IOMMU_NONE &&
+               needle->translated_addr >= cached->translated_addr) {
+        off = needle->translated_addr - cached->translated_addr;
+        if (off <= cached->size && needle->size <= cached->size - off) {
+            return cached;
+        }
+    }
+
+    if (gpa) {
+        map = vhost_iova_tree_find_gpa(svq->iova_tree, needle);
+    } else {
+        map = vhost_iova_tree_find_iova(svq->iova_tree, needle);
+    }
+    if (map) {
+        *cached = *map;
+    }
+    return map;
+}
+
 /**
  * Translate addresses between the qemu's virtual address and the SVQ IOVA
  *
@@ -80,7 +121,7 @@ uint16_t vhost_svq_available_slots(const VhostShadowVirtqueue *svq)
  * @num: Length of iovec and minimum length of vaddr
  * @gpas: Descriptors' GPAs, if backed by guest memory
  */
-static bool vhost_svq_translate_addr(const VhostShadowVirtqueue *svq,
+static bool vhost_svq_translate_addr(VhostShadowVirtqueue *svq,
                                      hwaddr *addrs, const struct iovec *iovec,
                                      size_t num, const hwaddr *gpas)
 {
@@ -101,14 +142,14 @@ static bool vhost_svq_translate_addr(const VhostShadowVirtqueue *svq,
                 .translated_addr = gpas[i],
                 .size = iovec[i].iov_len,
             };
-            map = vhost_iova_tree_find_gpa(svq->iova_tree, &needle);
+            map = vhost_svq_find_map(svq, &needle, true);
         } else {
             /* Search the IOVA->HVA tree */
             needle = (DMAMap) {
                 .translated_addr = (hwaddr)(uintptr_t)iovec[i].iov_base,
                 .size = iovec[i].iov_len,
             };
-            map = vhost_iova_tree_find_iova(svq->iova_tree, &needle);
+            map = vhost_svq_find_map(svq, &needle, false);
         }
 
         /*
@@ -223,23 +264,30 @@ static bool vhost_svq_add_split(VhostShadowVirtqueue *svq,
 
     /*
      * Put the entry in the available array (but don't update avail->idx until
-     * they do sync).
+     * vhost_svq_kick).
      */
     avail_idx = svq->shadow_avail_idx & (svq->vring.num - 1);
     avail->ring[avail_idx] = cpu_to_le16(*head);
     svq->shadow_avail_idx++;
 
-    /* Update the avail index after write the descriptor */
-    smp_wmb();
-    avail->idx = cpu_to_le16(svq->shadow_avail_idx);
-
     return true;
 }
 
+/* Expose to the device all the buffers added since the last kick */
 static void vhost_svq_kick(VhostShadowVirtqueue *svq)
 {
+    uint16_t old = svq->kicked_avail_idx;
     bool needs_kick;
 
+    if (old == svq->shadow_avail_idx) {
+        return;
+    }
+
+    /* Update the avail index after write the descriptor */
+    smp_wmb();
+    svq->vring.avail->idx = cpu_to_le16(svq->shadow_avail_idx);
+    svq->kicked_avail_idx = svq->shadow_avail_idx;
+
     /*
      * We need to expose the available array entries before checking the used
      * flags
@@ -249,7 +297,7 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     if (virtio_vdev_has_feature(svq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
         uint16_t avail_event = le16_to_cpu(
                 *(uint16_t *)(&svq->vring.used->ring[svq->vring.num]));
-        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, svq->shadow_avail_idx - 1);
+        needs_kick = vring_need_event(avail_event, svq->shadow_avail_idx, old);
     } else {
         needs_kick =
                 !(svq->vring.used->flags & cpu_to_le16(VRING_USED_F_NO_NOTIFY));
@@ -262,15 +310,15 @@ static void vhost_svq_kick(VhostShadowVirtqueue *svq)
     event_notifier_set(&svq->hdev_kick);
 }
 
-/**
- * Add an element to a SVQ.
- *
- * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+/*
+ * Add an element to a SVQ, without exposing it to the device until the next
+ * vhost_svq_kick.
  */
-int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
-                  size_t out_num, const hwaddr *out_addr,
-                  const struct iovec *in_sg, size_t in_num,
-                  const hwaddr *in_addr, VirtQueueElement *elem)
+static int vhost_svq_add_no_kick(VhostShadowVirtqueue *svq,
+                                 const struct iovec *out_sg, size_t out_num,
+                                 const hwaddr *out_addr,
+                                 const struct iovec *in_sg, size_t in_num,
+                                 const hwaddr *in_addr, VirtQueueElement *elem)
 {
     unsigned qemu_head;
     unsigned ndescs = in_num + out_num;
@@ -289,16 +337,38 @@ int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
     svq->num_free -= ndescs;
     svq->desc_state[qemu_head].elem = elem;
     svq->desc_state[qemu_head].ndescs = ndescs;
-    vhost_svq_kick(svq);
     return 0;
 }
 
-/* Convenience wrapper to add a guest's element to SVQ */
+/**
+ * Add an element to a SVQ.
+ *
+ * Return -EINVAL if element is invalid, -ENOSPC if dev queue is full
+ */
+int vhost_svq_add(VhostShadowVirtqueue *svq, const struct iovec *out_sg,
+                  size_t out_num, const hwaddr *out_addr,
+                  const struct iovec *in_sg, size_t in_num,
+                  const hwaddr *in_addr, VirtQueueElement *elem)
+{
+    int r = vhost_svq_add_no_kick(svq, out_sg, out_num, out_addr, in_sg,
+                                  in_num, in_addr, elem);
+
+    if (likely(r == 0)) {
+        vhost_svq_kick(svq);
+    }
+    return r;
+}
+
+/*
+ * Convenience wrapper to add a guest's element to SVQ.  The caller kicks the
+ * device once for the whole burst.
+ */
 static int vhost_svq_add_element(VhostShadowVirtqueue *svq,
                                  VirtQueueElement *elem)
 {
-    return vhost_svq_add(svq, elem->out_sg, elem->out_num, elem->out_addr,
-                         elem->in_sg, elem->in_num, elem->in_addr, elem);
+    return vhost_svq_add_no_kick(svq, elem->out_sg, elem->out_num,
+                                 elem->out_addr, elem->in_sg, elem->in_num,
+                                 elem->in_addr, elem);
 }
 
 /**
@@ -359,12 +429,14 @@ static void vhost_handle_guest_kick(VhostShadowVirtqueue *svq)
                 }
 
                 /* VQ is full or broken, just return and ignore kicks */
+                vhost_svq_kick(svq);
                 return;
             }
             /* elem belongs to SVQ or external caller now */
             elem = NULL;
         }
 
+        vhost_svq_kick(svq);
         virtio_queue_set_notification(svq->vq, true);
     } while (!virtio_queue_empty(svq->vq));
 }
@@ -687,11 +759,13 @@ void vhost_svq_start(VhostShadowVirtqueue *svq, VirtIODevice *vdev,
     event_notifier_set_handler(&svq->hdev_call, vhost_svq_handle_call);
     svq->next_guest_avail_elem = NULL;
     svq->shadow_avail_idx = 0;
+    svq->kicked_avail_idx = 0;
     svq->shadow_used_idx = 0;
     svq->last_used_idx = 0;
     svq->vdev = vdev;
     svq->vq = vq;
     svq->iova_tree = iova_tree;
+    svq->map_cache_gen = 0;
 
     svq->vring.num = virtio_queue_get_num(vdev, virtio_get_queue_index(vq));
     svq->num_free = svq->vring.num;
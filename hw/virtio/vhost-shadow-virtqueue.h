@@ -78,6 +78,13 @@ typedef struct VhostShadowVirtqueue {
     /* IOVA mapping */
     VhostIOVATree *iova_tree;
 
+    /* Last maps that translated a guest buffer and a qemu buffer */
+    DMAMap last_gpa_map;
+    DMAMap last_hva_map;
+
+    /* iova_tree generation of last_gpa_map and last_hva_map */
+    uint64_t map_cache_gen;
+
     /* SVQ vring descriptors state */
     SVQDescState *desc_state;
 
@@ -99,6 +106,9 @@ typedef struct VhostShadowVirtqueue {
     /* Next head to expose to the device */
     uint16_t shadow_avail_idx;
 
+    /* Avail idx last exposed to the device */
+    uint16_t kicked_avail_idx;
+
     /* Next free descriptor */
     uint16_t free_head;
 
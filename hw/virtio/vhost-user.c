@@ -261,6 +261,9 @@ struct vhost_user {
     /* True once we've entered postcopy_listen */
     bool               postcopy_listen;
 
+    /* IOTLB messages are acknowledged by VHOST_IOTLB_BATCH_END */
+    bool               iotlb_batching;
+
     /* Our current regions */
     int num_shadow_regions;
     struct vhost_memory_region shadow_regions[VHOST_USER_MAX_RAM_SLOTS];
@@ -2409,14 +2412,19 @@ static int vhost_user_net_set_mtu(struct vhost_dev *dev, uint16_t mtu)
 static int vhost_user_send_device_iotlb_msg(struct vhost_dev *dev,
                                             struct vhost_iotlb_msg *imsg)
 {
+    struct vhost_user *u = dev->opaque;
     int ret;
     VhostUserMsg msg = {
         .hdr.request = VHOST_USER_IOTLB_MSG,
         .hdr.size = sizeof(msg.payload.iotlb),
-        .hdr.flags = VHOST_USER_VERSION | VHOST_USER_NEED_REPLY_MASK,
+        .hdr.flags = VHOST_USER_VERSION,
         .payload.iotlb = *imsg,
     };
 
+    if (!u->iotlb_batching) {
+        msg.hdr.flags |= VHOST_USER_NEED_REPLY_MASK;
+    }
+
     ret = vhost_user_write(dev, &msg, NULL, 0);
     if (ret < 0) {
         return ret;
@@ -2425,6 +2433,23 @@ static int vhost_user_send_device_iotlb_msg(struct vhost_dev *dev,
     return process_message_reply(dev, &msg);
 }
 
+static int vhost_user_iotlb_batch(struct vhost_dev *dev, bool begin)
+{
+    struct vhost_user *u = dev->opaque;
+    struct vhost_iotlb_msg imsg = {
+        .type = begin ? VHOST_IOTLB_BATCH_BEGIN : VHOST_IOTLB_BATCH_END,
+    };
+
+    if (!virtio_has_feature(dev->protocol_features,
+                            VHOST_USER_PROTOCOL_F_IOTLB_BATCH)) {
+        return 0;
+    }
+
+    /* Only the message that ends the batch waits for a reply */
+    u->iotlb_batching = begin;
+    return vhost_user_send_device_iotlb_msg(dev, &imsg);
+}
+
 
 static void vhost_user_set_iotlb_callback(struct vhost_dev *dev, int enabled)
 {
@@ -3039,6 +3064,7 @@ const VhostOps user_ops = {
         .vhost_net_set_mtu = vhost_user_net_set_mtu,
         .vhost_set_iotlb_callback = vhost_user_set_iotlb_callback,
         .vhost_send_device_iotlb_msg = vhost_user_send_device_iotlb_msg,
+        .vhost_iotlb_batch = vhost_user_iotlb_batch,
         .vhost_get_config = vhost_user_get_config,
         .vhost_set_config = vhost_user_set_config,
         .vhost_crypto_create_session = vhost_user_crypto_create_session,
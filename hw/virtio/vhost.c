@@ -1207,7 +1207,12 @@ static int vhost_memory_region_lookup(struct vhost_dev *hdev,
     return -EFAULT;
 }
 
-int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
+/*
+ * Install the IOTLB entry that translates @iova and store the first I/O
+ * virtual address that it does not cover in @next.
+ */
+static int vhost_device_iotlb_fill(struct vhost_dev *dev, uint64_t iova,
+                                   int write, uint64_t *next)
 {
     IOMMUTLBEntry iotlb;
     uint64_t uaddr, len;
@@ -1232,6 +1237,7 @@ int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
 
         len = MIN(iotlb.addr_mask + 1, len);
         iova = iova & ~iotlb.addr_mask;
+        *next = iova + len;
 
         ret = vhost_backend_update_device_iotlb(dev, iova, uaddr,
                                                 len, iotlb.perm);
@@ -1248,6 +1254,35 @@ out:
     return ret;
 }
 
+int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
+{
+    uint64_t next;
+
+    return vhost_device_iotlb_fill(dev, iova, write, &next);
+}
+
+/*
+ * Install the IOTLB entries that cover [@iova, @iova + @len).  Only fail
+ * if @iova itself cannot be translated, the rest is best effort.
+ */
+static int vhost_device_iotlb_prefetch(struct vhost_dev *dev, uint64_t iova,
+                                       uint64_t len, int write)
+{
+    uint64_t end = iova + len;
+    uint64_t next;
+    int ret;
+
+    ret = vhost_device_iotlb_fill(dev, iova, write, &next);
+    while (!ret && next > iova && next < end) {
+        iova = next;
+        if (vhost_device_iotlb_fill(dev, iova, write, &next)) {
+            break;
+        }
+    }
+
+    return ret;
+}
+
 int vhost_virtqueue_start(struct vhost_dev *dev,
                           struct VirtIODevice *vdev,
                           struct vhost_virtqueue *vq,
@@ -2091,14 +2126,29 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev, bool vrings)
         hdev->vhost_ops->vhost_set_iotlb_callback) {
             hdev->vhost_ops->vhost_set_iotlb_callback(hdev, true);
 
-        /* Update used ring information for IOTLB to work correctly,
-         * vhost-kernel code requires for this.*/
+        /*
+         * Install the entries for the rings in one batch rather than
+         * waiting for the backend to miss on each of their pages.
+         * Update used ring information for IOTLB to work correctly,
+         * vhost-kernel code requires for this.
+         */
+        vhost_backend_iotlb_batch_begin(hdev);
         for (i = 0; i < hdev->nvqs; ++i) {
             struct vhost_virtqueue *vq = hdev->vqs + i;
-            r = vhost_device_iotlb_miss(hdev, vq->used_phys, true);
+            r = vhost_device_iotlb_prefetch(hdev, vq->used_phys,
+                                            vq->used_size, true);
             if (r) {
+                vhost_backend_iotlb_batch_end(hdev);
                 goto fail_iotlb;
             }
+            vhost_device_iotlb_prefetch(hdev, vq->desc_phys, vq->desc_size,
+                                        false);
+            vhost_device_iotlb_prefetch(hdev, vq->avail_phys, vq->avail_size,
+                                        false);
+        }
+        r = vhost_backend_iotlb_batch_end(hdev);
+        if (r) {
+            goto fail_iotlb;
         }
     }
     vhost_start_config_intr(hdev);
@@ -65,6 +65,44 @@ static bool virtio_balloon_pbp_matches(PartiallyBalloonedPage *pbp,
     return pbp->base_gpa == base_gpa;
 }
 
+/*
+ * Contiguous range of a RAMBlock whose discard is deferred until the range
+ * can't grow any further, so that runs of pages that the guest inflates or
+ * reports are discarded with one ram_block_discard_range() call each.
+ */
+typedef struct BalloonDiscardRange {
+    RAMBlock *rb;
+    ram_addr_t offset;
+    size_t length;
+} BalloonDiscardRange;
+
+static void virtio_balloon_discard_flush(BalloonDiscardRange *range)
+{
+    if (!range->length) {
+        return;
+    }
+    /* We ignore errors from ram_block_discard_range(), because it
+     * has already reported them, and failing to discard a balloon
+     * page is not fatal */
+    ram_block_discard_range(range->rb, range->offset, range->length);
+    range->length = 0;
+}
+
+static void virtio_balloon_discard_add(BalloonDiscardRange *range,
+                                       RAMBlock *rb, ram_addr_t offset,
+                                       size_t length)
+{
+    if (range->length && range->rb == rb &&
+        range->offset + range->length == offset) {
+        range->length += length;
+        return;
+    }
+    virtio_balloon_discard_flush(range);
+    range->rb = rb;
+    range->offset = offset;
+    range->length = length;
+}
+
 static bool virtio_balloon_inhibited(void)
 {
     /*
@@ -77,7 +115,8 @@ static bool virtio_balloon_inhibited(void)
 
 static void balloon_inflate_page(VirtIOBalloon *balloon,
                                  MemoryRegion *mr, hwaddr mr_offset,
-                                 PartiallyBalloonedPage *pbp)
+                                 PartiallyBalloonedPage *pbp,
+                                 BalloonDiscardRange *range)
 {
     void *addr = memory_region_get_ram_ptr(mr) + mr_offset;
     ram_addr_t rb_offset, rb_aligned_offset, base_gpa;
@@ -93,10 +132,7 @@ static void balloon_inflate_page(VirtIOBalloon *balloon,
     if (rb_page_size == BALLOON_PAGE_SIZE) {
         /* Easy case */
 
-        ram_block_discard_range(rb, rb_offset, rb_page_size);
-        /* We ignore errors from ram_block_discard_range(), because it
-         * has already reported them, and failing to discard a balloon
-         * page is not fatal */
+        virtio_balloon_discard_add(range, rb, rb_offset, rb_page_size);
         return;
     }
 
@@ -132,10 +168,8 @@ static void balloon_inflate_page(VirtIOBalloon *balloon,
         /* We've accumulated a full host page, we can actually discard
          * it now */
 
-        ram_block_discard_range(rb, rb_aligned_offset, rb_page_size);
-        /* We ignore errors from ram_block_discard_range(), because it
-         * has already reported them, and failing to discard a balloon
-         * page is not fatal */
+        virtio_balloon_discard_add(range, rb, rb_aligned_offset,
+                                   rb_page_size);
         virtio_balloon_pbp_free(pbp);
     }
 }
@@ -341,8 +375,10 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIOBalloon *dev = VIRTIO_BALLOON(vdev);
     VirtQueueElement *elem;
+    bool notify = false;
 
     while ((elem = virtqueue_pop(vq, sizeof(VirtQueueElement)))) {
+        BalloonDiscardRange range = {};
         unsigned int i;
 
         /*
@@ -388,14 +424,21 @@ static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
                 continue;
             }
 
-            ram_block_discard_range(rb, ram_offset, size);
+            virtio_balloon_discard_add(&range, rb, ram_offset, size);
         }
+        /* The guest may reuse the pages as soon as the element is used. */
+        virtio_balloon_discard_flush(&range);
 
 skip_element:
         virtqueue_push(vq, elem, 0);
-        virtio_notify(vdev, vq);
+        notify = true;
         g_free(elem);
     }
+
+    /* Interrupt the guest once for all the reports that were processed. */
+    if (notify) {
+        virtio_notify(vdev, vq);
+    }
 }
 
 static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
@@ -406,6 +449,7 @@ static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
 
     for (;;) {
         PartiallyBalloonedPage pbp = {};
+        BalloonDiscardRange range = {};
         size_t offset = 0;
         uint32_t pfn;
 
@@ -440,7 +484,8 @@ static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
             if (!virtio_balloon_inhibited()) {
                 if (vq == s->ivq) {
                     balloon_inflate_page(s, section.mr,
-                                         section.offset_within_region, &pbp);
+                                         section.offset_within_region, &pbp,
+                                         &range);
                 } else if (vq == s->dvq) {
                     balloon_deflate_page(s, section.mr, section.offset_within_region);
                 } else {
@@ -449,6 +494,7 @@ static void virtio_balloon_handle_output(VirtIODevice *vdev, VirtQueue *vq)
             }
             memory_region_unref(section.mr);
         }
+        virtio_balloon_discard_flush(&range);
 
         virtqueue_push(vq, elem, 0);
         virtio_notify(vdev, vq);
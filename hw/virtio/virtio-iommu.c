@@ -300,6 +300,93 @@ static gboolean virtio_iommu_notify_map_cb(gpointer key, gpointer value,
     return false;
 }
 
+/*
+ * Drop the translations cached by all endpoints.  Only needed when a
+ * translation goes away or changes; new mappings cannot make a cached
+ * entry wrong since only successful lookups are cached.
+ */
+static void virtio_iommu_iotlb_flush(VirtIOIOMMU *s)
+{
+    s->iotlb_gen++;
+}
+
+static VirtIOIOMMUIOTLBEntry *virtio_iommu_iotlb_lookup(IOMMUDevice *sdev,
+                                                        hwaddr addr)
+{
+    VirtIOIOMMU *s = sdev->viommu;
+    int i;
+
+    for (i = 0; i < VIOMMU_IOTLB_SIZE; i++) {
+        VirtIOIOMMUIOTLBEntry *e = &sdev->iotlb[i];
+
+        if (e->gen == s->iotlb_gen && addr >= e->low && addr <= e->high) {
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void virtio_iommu_iotlb_insert(IOMMUDevice *sdev,
+                                      VirtIOIOMMUInterval *interval,
+                                      VirtIOIOMMUMapping *mapping)
+{
+    VirtIOIOMMU *s = sdev->viommu;
+    VirtIOIOMMUIOTLBEntry *e = &sdev->iotlb[sdev->iotlb_next];
+
+    sdev->iotlb_next = (sdev->iotlb_next + 1) % VIOMMU_IOTLB_SIZE;
+    e->gen = s->iotlb_gen;
+    e->low = interval->low;
+    e->high = interval->high;
+    e->phys_addr = mapping->phys_addr;
+    e->flags = mapping->flags;
+}
+
+/*
+ * UNMAP requests only record their notification in @s, so that requests
+ * for adjacent ranges of a domain (as issued by guests whose DMA API maps
+ * and unmaps each buffer separately) reach vhost and VFIO as a single,
+ * larger range.  The notification is delivered before the reply of the
+ * request is pushed, or before any other request is handled.
+ *
+ * MAP notifications are never merged: VFIO would create one DMA mapping
+ * for the merged range, and a later UNMAP of only one of the requests
+ * would then split it, which VFIO type1 refuses.  Merged UNMAPs are fine,
+ * because they only ever cover whole earlier MAPs.
+ */
+static void virtio_iommu_notify_flush(VirtIOIOMMU *s)
+{
+    VirtIOIOMMUDomain *domain = s->notify_domain;
+    VirtIOIOMMUEndpoint *ep;
+
+    if (!domain) {
+        return;
+    }
+    s->notify_domain = NULL;
+
+    QLIST_FOREACH(ep, &domain->endpoint_list, next) {
+        virtio_iommu_notify_unmap(ep->iommu_mr, s->notify_start,
+                                  s->notify_end);
+    }
+}
+
+/* Record the UNMAP notification of the whole mapping [virt_start, virt_end] */
+static void virtio_iommu_notify_unmap_defer(VirtIOIOMMU *s,
+                                            VirtIOIOMMUDomain *domain,
+                                            hwaddr virt_start,
+                                            hwaddr virt_end)
+{
+    if (s->notify_domain == domain &&
+        s->notify_end != UINT64_MAX && s->notify_end + 1 == virt_start) {
+        s->notify_end = virt_end;
+        return;
+    }
+
+    virtio_iommu_notify_flush(s);
+    s->notify_domain = domain;
+    s->notify_start = virt_start;
+    s->notify_end = virt_end;
+}
+
 static void virtio_iommu_detach_endpoint_from_domain(VirtIOIOMMUEndpoint *ep)
 {
     VirtIOIOMMUDomain *domain = ep->domain;
@@ -309,6 +396,7 @@ static void virtio_iommu_detach_endpoint_from_domain(VirtIOIOMMUEndpoint *ep)
         return;
     }
     trace_virtio_iommu_detach_endpoint_from_domain(domain->id, ep->id);
+    virtio_iommu_iotlb_flush(sdev->viommu);
     g_tree_foreach(domain->mappings, virtio_iommu_notify_unmap_cb,
                    ep->iommu_mr);
     QLIST_REMOVE(ep, next);
@@ -530,6 +618,7 @@ static int rebuild_resv_regions(IOMMUDevice *sdev)
      * through properties
      */
     add_prop_resv_regions(sdev);
+    virtio_iommu_iotlb_flush(sdev->viommu);
     return 0;
 }
 
@@ -586,6 +675,7 @@ static void virtio_iommu_unset_host_iova_ranges(VirtIOIOMMU *s, PCIBus *bus,
     sdev->host_resv_ranges = NULL;
     sdev->resv_regions = NULL;
     add_prop_resv_regions(sdev);
+    virtio_iommu_iotlb_flush(s);
 }
 
 
@@ -836,6 +926,8 @@ static int virtio_iommu_map(VirtIOIOMMU *s,
 
     g_tree_insert(domain->mappings, interval, mapping);
 
+    /* Keep the order of the notifications */
+    virtio_iommu_notify_flush(s);
     QLIST_FOREACH(ep, &domain->endpoint_list, next) {
         virtio_iommu_notify_map(ep->iommu_mr, virt_start, virt_end, phys_start,
                                 flags);
@@ -853,7 +945,6 @@ static int virtio_iommu_unmap(VirtIOIOMMU *s,
     VirtIOIOMMUMapping *iter_val;
     VirtIOIOMMUInterval interval, *iter_key;
     VirtIOIOMMUDomain *domain;
-    VirtIOIOMMUEndpoint *ep;
     int ret = VIRTIO_IOMMU_S_OK;
 
     trace_virtio_iommu_unmap(domain_id, virt_start, virt_end);
@@ -876,10 +967,9 @@ static int virtio_iommu_unmap(VirtIOIOMMU *s,
         uint64_t current_high = iter_key->high;
 
         if (interval.low <= current_low && interval.high >= current_high) {
-            QLIST_FOREACH(ep, &domain->endpoint_list, next) {
-                virtio_iommu_notify_unmap(ep->iommu_mr, current_low,
-                                          current_high);
-            }
+            virtio_iommu_notify_unmap_defer(s, domain, current_low,
+                                            current_high);
+            virtio_iommu_iotlb_flush(s);
             g_tree_remove(domain->mappings, iter_key);
             trace_virtio_iommu_unmap_done(domain_id, current_low, current_high);
         } else {
@@ -999,6 +1089,9 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
     VirtIOIOMMU *s = VIRTIO_IOMMU(vdev);
     struct virtio_iommu_req_head head;
     struct virtio_iommu_req_tail tail = {};
+    VirtQueueElement *done[VIOMMU_DEFAULT_QUEUE_SIZE];
+    unsigned int done_len[VIOMMU_DEFAULT_QUEUE_SIZE];
+    unsigned int nr_done = 0, i;
     VirtQueueElement *elem;
     unsigned int iov_cnt;
     struct iovec *iov;
@@ -1010,7 +1103,7 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
 
         elem = virtqueue_pop(vq, sizeof(VirtQueueElement));
         if (!elem) {
-            return;
+            break;
         }
 
         if (iov_size(elem->in_sg, elem->in_num) < sizeof(tail) ||
@@ -1032,6 +1125,10 @@ static void virtio_iommu_handle_command(VirtIODevice *vdev, VirtQueue *vq)
             goto out;
         }
         qemu_rec_mutex_lock(&s->mutex);
+        if (head.type != VIRTIO_IOMMU_T_MAP &&
+            head.type != VIRTIO_IOMMU_T_UNMAP) {
+            virtio_iommu_notify_flush(s);
+        }
         switch (head.type) {
         case VIRTIO_IOMMU_T_ATTACH:
             tail.status = virtio_iommu_handle_attach(s, iov, iov_cnt);
@@ -1085,12 +1182,29 @@ out:
         }
         assert(sz == output_size);
 
-        virtqueue_push(vq, elem, sz);
-        virtio_notify(vdev, vq);
-        g_free(elem);
+        done[nr_done] = elem;
+        done_len[nr_done] = sz;
         g_free(buf);
         buf = NULL;
+        if (++nr_done == ARRAY_SIZE(done)) {
+            break;
+        }
+    }
+
+    /* The guest may reuse the IOVAs as soon as it sees the replies */
+    qemu_rec_mutex_lock(&s->mutex);
+    virtio_iommu_notify_flush(s);
+    qemu_rec_mutex_unlock(&s->mutex);
+
+    if (!nr_done) {
+        return;
+    }
+    for (i = 0; i < nr_done; i++) {
+        virtqueue_fill(vq, done[i], done_len[i], i);
+        g_free(done[i]);
     }
+    virtqueue_flush(vq, nr_done);
+    virtio_notify(vdev, vq);
 }
 
 static void virtio_iommu_report_fault(VirtIOIOMMU *viommu, uint8_t reason,
@@ -1143,6 +1257,7 @@ static IOMMUTLBEntry virtio_iommu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     VirtIOIOMMUInterval interval, *mapping_key;
     VirtIOIOMMUMapping *mapping_value;
     VirtIOIOMMU *s = sdev->viommu;
+    VirtIOIOMMUIOTLBEntry *cached;
     bool read_fault, write_fault;
     VirtIOIOMMUEndpoint *ep;
     uint32_t sid, flags;
@@ -1170,6 +1285,16 @@ static IOMMUTLBEntry virtio_iommu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     trace_virtio_iommu_translate(mr->parent_obj.name, sid, addr, flag);
     qemu_rec_mutex_lock(&s->mutex);
 
+    cached = virtio_iommu_iotlb_lookup(sdev, addr);
+    if (cached &&
+        !((flag & IOMMU_RO) && !(cached->flags & VIRTIO_IOMMU_MAP_F_READ)) &&
+        !((flag & IOMMU_WO) && !(cached->flags & VIRTIO_IOMMU_MAP_F_WRITE))) {
+        entry.translated_addr = addr - cached->low + cached->phys_addr;
+        entry.perm = flag;
+        trace_virtio_iommu_translate_out(addr, entry.translated_addr, sid);
+        goto unlock;
+    }
+
     ep = g_tree_lookup(s->endpoints, GUINT_TO_POINTER(sid));
 
     if (bypass_allowed)
@@ -1253,6 +1378,7 @@ static IOMMUTLBEntry virtio_iommu_translate(IOMMUMemoryRegion *mr, hwaddr addr,
     }
     entry.translated_addr = addr - mapping_key->low + mapping_value->phys_addr;
     entry.perm = flag;
+    virtio_iommu_iotlb_insert(sdev, mapping_key, mapping_value);
     trace_virtio_iommu_translate_out(addr, entry.translated_addr, sid);
 
 unlock:
@@ -1300,6 +1426,7 @@ static void virtio_iommu_set_config(VirtIODevice *vdev,
             return;
         }
         dev_config->bypass = in_config->bypass;
+        virtio_iommu_iotlb_flush(dev);
         virtio_iommu_switch_address_space_all(dev);
     }
 
@@ -1393,6 +1520,7 @@ static void virtio_iommu_system_reset(void *opaque)
      * system reset
      */
     s->config.bypass = s->boot_bypass;
+    virtio_iommu_iotlb_flush(s);
     virtio_iommu_switch_address_space_all(s);
 
 }
@@ -1463,6 +1591,8 @@ static void virtio_iommu_device_realize(DeviceState *dev, Error **errp)
     virtio_add_feature(&s->features, VIRTIO_IOMMU_F_BYPASS_CONFIG);
 
     qemu_rec_mutex_init(&s->mutex);
+    /* Generation 0 marks unused IOTLB entries */
+    s->iotlb_gen = 1;
 
     s->as_by_busptr = g_hash_table_new_full(NULL, NULL, NULL, g_free);
 
@@ -1510,6 +1640,8 @@ static void virtio_iommu_device_reset_exit(Object *obj, ResetType type)
 
     trace_virtio_iommu_device_reset_exit();
 
+    s->notify_domain = NULL;
+    virtio_iommu_iotlb_flush(s);
     if (s->domains) {
         g_tree_destroy(s->domains);
     }
@@ -1620,6 +1752,7 @@ static int iommu_post_load(void *opaque, int version_id)
     VirtIOIOMMU *s = opaque;
 
     g_tree_foreach(s->domains, reconstruct_endpoints, s);
+    virtio_iommu_iotlb_flush(s);
 
     /*
      * Memory regions are dynamically turned on/off depending on
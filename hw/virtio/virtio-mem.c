@@ -585,6 +585,22 @@ static void virtio_mem_deactivate_unplugged_memslots(VirtIOMEM *vmem,
     memory_region_transaction_commit();
 }
 
+/*
+ * Preallocate the memory backing @size bytes at @offset, using as many
+ * threads as the memory backend's "prealloc-threads" allows, so that large
+ * plug requests don't fault in all of their memory on a single thread.
+ */
+static bool virtio_mem_prealloc(VirtIOMEM *vmem, uint64_t offset,
+                                uint64_t size, Error **errp)
+{
+    void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
+    int fd = memory_region_get_fd(&vmem->memdev->mr);
+
+    return qemu_prealloc_mem(fd, area, size,
+                             MAX(vmem->memdev->prealloc_threads, 1),
+                             vmem->memdev->prealloc_context, false, errp);
+}
+
 static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
                                       uint64_t size, bool plug)
 {
@@ -610,11 +626,9 @@ static int virtio_mem_set_block_state(VirtIOMEM *vmem, uint64_t start_gpa,
     }
 
     if (vmem->prealloc) {
-        void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-        int fd = memory_region_get_fd(&vmem->memdev->mr);
         Error *local_err = NULL;
 
-        if (!qemu_prealloc_mem(fd, area, size, 1, NULL, false, &local_err)) {
+        if (!virtio_mem_prealloc(vmem, offset, size, &local_err)) {
             static bool warned;
 
             /*
@@ -1267,11 +1281,9 @@ static int virtio_mem_post_load(void *opaque, int version_id)
 static int virtio_mem_prealloc_range_cb(VirtIOMEM *vmem, void *arg,
                                         uint64_t offset, uint64_t size)
 {
-    void *area = memory_region_get_ram_ptr(&vmem->memdev->mr) + offset;
-    int fd = memory_region_get_fd(&vmem->memdev->mr);
     Error *local_err = NULL;
 
-    if (!qemu_prealloc_mem(fd, area, size, 1, NULL, false, &local_err)) {
+    if (!virtio_mem_prealloc(vmem, offset, size, &local_err)) {
         error_report_err(local_err);
         return -ENOMEM;
     }
@@ -17,6 +17,7 @@
 #include "trace.h"
 #include "qemu/defer-call.h"
 #include "qemu/error-report.h"
+#include "qemu/iov.h"
 #include "qemu/log.h"
 #include "qemu/main-loop.h"
 #include "qemu/module.h"
@@ -944,6 +945,8 @@ static void virtqueue_ordered_fill(VirtQueue *vq, const VirtQueueElement *elem,
         /* Found element, set length and mark as filled */
         if (vq->used_elems[i].index == elem->index) {
             vq->used_elems[i].len = len;
+            vq->used_elems[i].in_order_full =
+                len == iov_size(elem->in_sg, elem->in_num);
             vq->used_elems[i].in_order_filled = true;
             break;
         }
@@ -1080,11 +1083,12 @@ static void virtqueue_packed_flush(VirtQueue *vq, unsigned int count)
 static void virtqueue_ordered_flush(VirtQueue *vq)
 {
     unsigned int i = vq->used_idx % vq->vring.num;
-    unsigned int ndescs = 0;
+    unsigned int ndescs = 0, batch = 0, next;
     uint16_t old = vq->used_idx;
     uint16_t new;
     bool packed;
     VRingUsedElem uelem;
+    VirtQueueElement *used, *first = NULL;
 
     packed = virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED);
 
@@ -1101,30 +1105,46 @@ static void virtqueue_ordered_flush(VirtQueue *vq)
         return;
     }
 
-    /* Search for filled elements in-order */
+    /*
+     * Search for filled elements in-order.  The driver can be told about
+     * a run of them with a single used entry, which carries the id of the
+     * last buffer of the run; the buffers before it are implicitly used
+     * with their whole device-writable length.  So a run ends at the
+     * first element that wrote less than that, or at the last filled one.
+     */
     while (vq->used_elems[i].in_order_filled) {
+        used = &vq->used_elems[i];
+        next = i + used->ndescs;
+        if (next >= vq->vring.num) {
+            next -= vq->vring.num;
+        }
+
+        used->in_order_filled = false;
+        ndescs += used->ndescs;
+        i = next;
+
+        if (used->in_order_full && vq->used_elems[next].in_order_filled) {
+            continue;
+        }
+
         /*
          * First entry for packed VQs is written last so the guest
          * doesn't see invalid descriptors.
          */
-        if (packed && i != vq->used_idx) {
-            virtqueue_packed_fill_desc(vq, &vq->used_elems[i], ndescs, false);
-        } else if (!packed) {
-            uelem.id = vq->used_elems[i].index;
-            uelem.len = vq->used_elems[i].len;
-            vring_used_write(vq, &uelem, i);
-        }
-
-        vq->used_elems[i].in_order_filled = false;
-        ndescs += vq->used_elems[i].ndescs;
-        i += vq->used_elems[i].ndescs;
-        if (i >= vq->vring.num) {
-            i -= vq->vring.num;
+        if (packed && batch) {
+            virtqueue_packed_fill_desc(vq, used, batch, false);
+        } else if (packed) {
+            first = used;
+        } else {
+            uelem.id = used->index;
+            uelem.len = used->len;
+            vring_used_write(vq, &uelem, (old + batch) % vq->vring.num);
         }
+        batch = ndescs;
     }
 
     if (packed) {
-        virtqueue_packed_fill_desc(vq, &vq->used_elems[vq->used_idx], 0, true);
+        virtqueue_packed_fill_desc(vq, first, 0, true);
         vq->used_idx += ndescs;
         if (vq->used_idx >= vq->vring.num) {
             vq->used_idx -= vq->vring.num;
@@ -1168,6 +1188,22 @@ void virtqueue_push(VirtQueue *vq, const VirtQueueElement *elem,
     virtqueue_flush(vq, 1);
 }
 
+void virtqueue_fill_batch(VirtQueue *vq, VirtQueueElement **elems,
+                          const unsigned int *lens, unsigned int n)
+{
+    unsigned int i;
+
+    if (!n) {
+        return;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    for (i = 0; i < n; i++) {
+        virtqueue_fill(vq, elems[i], lens[i], i);
+    }
+    virtqueue_flush(vq, n);
+}
+
 /* Called within rcu_read_lock().  */
 static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
 {
@@ -1670,10 +1706,34 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/* Called within rcu_read_lock().  */
+static VRingMemoryRegionCaches *virtqueue_split_get_caches(VirtQueue *vq)
 {
-    unsigned int i, head, max, idx;
-    VRingMemoryRegionCaches *caches;
+    VRingMemoryRegionCaches *caches = vring_get_region_caches(vq);
+
+    if (!caches) {
+        virtio_error(vq->vdev, "Region caches not initialized");
+        return NULL;
+    }
+
+    if (caches->desc.len < vq->vring.num * sizeof(VRingDesc)) {
+        virtio_error(vq->vdev, "Cannot map descriptor ring");
+        return NULL;
+    }
+    return caches;
+}
+
+/*
+ * Map the descriptor chain starting at @head, which the driver made
+ * available at vq->last_avail_idx - 1.
+ *
+ * Called within rcu_read_lock().
+ */
+static void *virtqueue_split_pop_head(VirtQueue *vq, size_t sz,
+                                      VRingMemoryRegionCaches *caches,
+                                      unsigned int head)
+{
+    unsigned int i, max, idx;
     MemoryRegionCache indirect_desc_cache;
     MemoryRegionCache *desc_cache;
     int64_t len;
@@ -1687,45 +1747,12 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
 
     address_space_cache_init_empty(&indirect_desc_cache);
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
     max = vq->vring.num;
-
-    if (vq->inuse >= vq->vring.num) {
-        virtio_error(vdev, "Virtqueue size exceeded");
-        goto done;
-    }
-
-    if (!virtqueue_get_head(vq, vq->last_avail_idx++, &head)) {
-        goto done;
-    }
-
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
-    if (caches->desc.len < max * sizeof(VRingDesc)) {
-        virtio_error(vdev, "Cannot map descriptor ring");
-        goto done;
-    }
-
     desc_cache = &caches->desc;
     vring_split_desc_read(vdev, &desc, desc_cache, i);
     if (desc.flags & VRING_DESC_F_INDIRECT) {
@@ -1816,6 +1843,96 @@ err_undo_map:
     goto done;
 }
 
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+{
+    VRingMemoryRegionCaches *caches;
+    unsigned int head;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_queue_empty_rcu(vq)) {
+        return NULL;
+    }
+    /* Needed after virtio_queue_empty(), see comment in
+     * virtqueue_num_heads(). */
+    smp_rmb();
+
+    if (vq->inuse >= vq->vring.num) {
+        virtio_error(vq->vdev, "Virtqueue size exceeded");
+        return NULL;
+    }
+
+    if (!virtqueue_get_head(vq, vq->last_avail_idx++, &head)) {
+        return NULL;
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+
+    caches = virtqueue_split_get_caches(vq);
+    if (!caches) {
+        return NULL;
+    }
+
+    return virtqueue_split_pop_head(vq, sz, caches, head);
+}
+
+static unsigned int virtqueue_split_pop_batch(VirtQueue *vq, size_t sz,
+                                              void **elems, unsigned int max)
+{
+    VRingMemoryRegionCaches *caches;
+    unsigned int heads[VIRTQUEUE_MAX_SIZE];
+    unsigned int i, n;
+    int rc;
+
+    RCU_READ_LOCK_GUARD();
+    /* Reads the avail index at most once, with the barrier that follows. */
+    rc = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (rc <= 0) {
+        return 0;
+    }
+
+    if (vq->inuse >= vq->vring.num) {
+        virtio_error(vq->vdev, "Virtqueue size exceeded");
+        return 0;
+    }
+
+    caches = virtqueue_split_get_caches(vq);
+    if (!caches) {
+        return 0;
+    }
+
+    n = MIN(MIN((unsigned int)rc, max), vq->vring.num - vq->inuse);
+
+    /*
+     * The avail ring entries are consecutive; read them all up front and
+     * start fetching the head descriptors they point to, so that the
+     * descriptor reads below do not each wait for memory.
+     */
+    for (i = 0; i < n; i++) {
+        if (!virtqueue_get_head(vq, vq->last_avail_idx + i, &heads[i])) {
+            n = i;
+            break;
+        }
+        if (caches->desc.ptr) {
+            __builtin_prefetch(caches->desc.ptr + heads[i] * sizeof(VRingDesc));
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        vq->last_avail_idx++;
+        elems[i] = virtqueue_split_pop_head(vq, sz, caches, heads[i]);
+        if (!elems[i]) {
+            break;
+        }
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+    return i;
+}
+
 static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 {
     unsigned int i, max;
@@ -1978,6 +2095,28 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     }
 }
 
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    unsigned int n;
+
+    if (virtio_device_disabled(vq->vdev)) {
+        return 0;
+    }
+
+    if (!virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        return virtqueue_split_pop_batch(vq, sz, elems, max);
+    }
+
+    for (n = 0; n < max; n++) {
+        elems[n] = virtqueue_packed_pop(vq, sz);
+        if (!elems[n]) {
+            break;
+        }
+    }
+    return n;
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -2418,6 +2557,12 @@ int virtio_queue_get_max_num(VirtIODevice *vdev, int n)
     return vdev->vq[n].vring.num_default;
 }
 
+unsigned int virtio_queue_get_inuse(VirtIODevice *vdev, int n)
+{
+    /* Only written by the thread that processes the queue */
+    return qatomic_read(&vdev->vq[n].inuse);
+}
+
 int virtio_get_num_queues(VirtIODevice *vdev)
 {
     int i;
@@ -4020,7 +4165,7 @@ static const Property virtio_properties[] = {
                      disable_legacy_check, false),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -4090,7 +4235,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
@@ -27,6 +27,7 @@
 
 #include "qemu/timed-average.h"
 #include "qemu/thread.h"
+#include "qemu/stats64.h"
 #include "qapi/qapi-types-common.h"
 
 typedef struct BlockAcctTimedStats BlockAcctTimedStats;
@@ -79,6 +80,17 @@ typedef struct BlockLatencyHistogram {
     uint64_t *bins;
 } BlockLatencyHistogram;
 
+/*
+ * Latency histogram that is cheap enough to be always enabled: bin 0
+ * counts latencies of 0 ns and bin i > 0 the latencies in
+ * [2^(i-1), 2^i) ns.  The last bin also counts everything above.
+ */
+#define BLOCK_LOG2_HISTOGRAM_NBINS 40
+
+typedef struct BlockLog2Histogram {
+    Stat64 bins[BLOCK_LOG2_HISTOGRAM_NBINS];
+} BlockLog2Histogram;
+
 struct BlockAcctStats {
     QemuMutex lock;
     uint64_t nr_bytes[BLOCK_MAX_IOTYPE];
@@ -120,5 +132,8 @@ double block_acct_queue_depth(BlockAcctTimedStats *stats,
 int block_latency_histogram_set(BlockAcctStats *stats, enum BlockAcctType type,
                                 uint64List *boundaries);
 void block_latency_histograms_clear(BlockAcctStats *stats);
+int64_t block_acct_clock_ns(void);
+void block_log2_histogram_account(BlockLog2Histogram *hist,
+                                  int64_t latency_ns);
 
 #endif
@@ -125,6 +125,11 @@ typedef QSLIST_HEAD(, AioHandler) AioHandlerSList;
 
 typedef struct AioPolledEvent {
     int64_t ns;        /* current polling time in nanoseconds */
+
+    /* Statistics, only updated in the AioContext's home thread */
+    uint64_t hits;     /* events detected by userspace polling */
+    uint64_t misses;   /* events detected by fd monitoring while polled */
+    int64_t event_ns;  /* moving average of the time waited for an event */
 } AioPolledEvent;
 
 struct AioContext {
@@ -218,10 +223,14 @@ struct AioContext {
 #endif
 #ifdef CONFIG_LINUX_IO_URING
     LuringState *linux_io_uring;
+    /* Ring with big sqes and cqes for NVMe passthrough, NULL until used */
+    LuringState *linux_io_uring_cmd;
 
     /* State for file descriptor monitoring using Linux io_uring */
     struct io_uring fdmon_io_uring;
     AioHandlerSList submit_list;
+    /* Monitor file descriptors with multishot IORING_OP_POLL_ADD */
+    bool fdmon_io_uring_multishot;
 #endif
 
     /* TimerLists for calling timers - one per clock type.  Has its own
@@ -517,6 +526,12 @@ LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp);
 
 /* Return the LuringState bound to this AioContext */
 LuringState *aio_get_linux_io_uring(AioContext *ctx);
+
+/* Setup the LuringState for NVMe passthrough bound to this AioContext */
+LuringState *aio_setup_linux_io_uring_cmd(AioContext *ctx, Error **errp);
+
+/* Return the LuringState for NVMe passthrough bound to this AioContext */
+LuringState *aio_get_linux_io_uring_cmd(AioContext *ctx);
 /**
  * aio_timer_new_with_attrs:
  * @ctx: the aio context
@@ -708,6 +723,21 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
                                  int64_t grow, int64_t shrink,
                                  Error **errp);
 
+typedef void AioPollStatsFn(int fd, const AioPolledEvent *poll, void *opaque);
+
+/**
+ * aio_context_foreach_poll_handler:
+ * @ctx: the aio context
+ * @fn: function called for each handler that supports userspace polling
+ * @opaque: passed to @fn
+ *
+ * Report the adaptive polling state of the handlers of @ctx.  May be called
+ * from any thread.  The statistics are read without synchronization and may
+ * therefore be slightly inconsistent.
+ */
+void aio_context_foreach_poll_handler(AioContext *ctx, AioPollStatsFn *fn,
+                                      void *opaque);
+
 /**
  * aio_context_set_aio_params:
  * @ctx: the aio context
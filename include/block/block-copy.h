@@ -59,10 +59,16 @@ int coroutine_fn block_copy(BlockCopyState *s, int64_t offset, int64_t bytes,
  * must be > 0.
  *
  * @max_chunk means maximum length for one IO operation. Zero means unlimited.
+ *
+ * With @adaptive, the number of parallel coroutines and the length of IO
+ * operations start low and, up to @max_workers and @max_chunk, follow the
+ * observed copy latency, so that the copy backs off when the source or target
+ * are busy.
  */
 BlockCopyCallState *block_copy_async(BlockCopyState *s,
                                      int64_t offset, int64_t bytes,
                                      int max_workers, int64_t max_chunk,
+                                     bool adaptive,
                                      BlockCopyAsyncCallbackFunc cb,
                                      void *cb_opaque);
 
@@ -99,6 +105,14 @@ void block_copy_call_cancel(BlockCopyCallState *call_state);
 
 BdrvDirtyBitmap *block_copy_dirty_bitmap(BlockCopyState *s);
 int64_t block_copy_cluster_size(BlockCopyState *s);
+
+/*
+ * Current number of parallel coroutines and maximum length of IO operations
+ * of adaptive calls.  @chunk is zero as long as the chunk size was not
+ * lowered below the maximum.  Can be called from any thread.
+ */
+void block_copy_get_adaptive_limits(BlockCopyState *s, int *workers,
+                                    int64_t *chunk);
 void block_copy_set_skip_unallocated(BlockCopyState *s, bool skip);
 
 #endif /* BLOCK_COPY_H */
@@ -537,6 +537,18 @@ struct BlockDriver {
         QEMUIOVector *qiov, size_t qiov_offset,
         BdrvRequestFlags flags);
 
+    /*
+     * Optional fast path for .bdrv_co_preadv, called outside coroutine
+     * context for requests without flags.  Return -EAGAIN, without side
+     * effects, if the read cannot complete without waiting; the block
+     * layer then resubmits it through .bdrv_co_preadv.
+     *
+     * Such requests are not tracked, so they are not serialised against
+     * concurrent requests that other threads submit to the same node.
+     */
+    int GRAPH_RDLOCK_PTR (*bdrv_preadv_nowait)(BlockDriverState *bs,
+        int64_t offset, int64_t bytes, QEMUIOVector *qiov);
+
     int coroutine_fn GRAPH_RDLOCK_PTR (*bdrv_co_writev)(BlockDriverState *bs,
         int64_t sector_num, int nb_sectors, QEMUIOVector *qiov,
         int flags);
@@ -562,6 +574,10 @@ struct BlockDriver {
         BlockDriverState *bs, int64_t offset, int64_t bytes, QEMUIOVector *qiov,
         size_t qiov_offset, BdrvRequestFlags flags);
 
+    /* Like .bdrv_preadv_nowait, but for .bdrv_co_pwritev */
+    int GRAPH_RDLOCK_PTR (*bdrv_pwritev_nowait)(BlockDriverState *bs,
+        int64_t offset, int64_t bytes, QEMUIOVector *qiov);
+
     /*
      * Efficiently zero a region of the disk image.  Typically an image format
      * would use a compact metadata representation to implement this.  This
@@ -57,6 +57,17 @@ int coroutine_fn GRAPH_RDLOCK bdrv_co_pwritev_part(BdrvChild *child,
     int64_t offset, int64_t bytes,
     QEMUIOVector *qiov, size_t qiov_offset, BdrvRequestFlags flags);
 
+/*
+ * Submit a read or write without entering a coroutine, if the request is
+ * simple enough and the driver of @child implements .bdrv_preadv_nowait
+ * or .bdrv_pwritev_nowait.  Return -EAGAIN, having done nothing, if the
+ * request must go through bdrv_co_preadv() or bdrv_co_pwritev() instead.
+ */
+int GRAPH_RDLOCK bdrv_try_preadv_nowait(BdrvChild *child, int64_t offset,
+                                        int64_t bytes, QEMUIOVector *qiov);
+int GRAPH_RDLOCK bdrv_try_pwritev_nowait(BdrvChild *child, int64_t offset,
+                                         int64_t bytes, QEMUIOVector *qiov);
+
 static inline int coroutine_fn GRAPH_RDLOCK bdrv_co_pread(BdrvChild *child,
     int64_t offset, int64_t bytes, void *buf, BdrvRequestFlags flags)
 {
@@ -74,7 +74,11 @@ static inline bool laio_has_fua(void)
 #endif
 /* io_uring.c - Linux io_uring implementation */
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *luring_init(Error **errp);
+/*
+ * luring_init: create a ring.  If @uring_cmd is true, the ring has the big
+ * sqes and cqes that luring_co_submit_nvme_cmd() needs.
+ */
+LuringState *luring_init(bool uring_cmd, Error **errp);
 void luring_cleanup(LuringState *s);
 
 /* luring_co_submit: submit I/O requests in the thread's current AioContext. */
@@ -84,6 +88,28 @@ int coroutine_fn luring_co_submit(BlockDriverState *bs, int fd, uint64_t offset,
 void luring_detach_aio_context(LuringState *s, AioContext *old_context);
 void luring_attach_aio_context(LuringState *s, AioContext *new_context);
 bool luring_has_fua(void);
+
+/*
+ * luring_fd_closed: drop @fd from the fixed files of all rings.  Must be
+ * called before closing a file descriptor that was passed to
+ * luring_co_submit(), while no request on it is being submitted.
+ */
+void luring_fd_closed(int fd);
+
+#ifdef HAVE_IO_URING_NVME_CMD
+/*
+ * luring_co_submit_nvme_cmd: like luring_co_submit(), but issue the request
+ * as NVMe command through the NVMe generic character device @fd.  @offset
+ * and the size of @qiov must be multiples of the logical block size
+ * (1 << @lba_shift) of namespace @nsid.  Requests go to the ring that
+ * aio_setup_linux_io_uring_cmd() created for the current AioContext.
+ */
+int coroutine_fn luring_co_submit_nvme_cmd(BlockDriverState *bs, int fd,
+                                           uint32_t nsid,
+                                           unsigned int lba_shift,
+                                           uint64_t offset, QEMUIOVector *qiov,
+                                           int type, BdrvRequestFlags flags);
+#endif
 #else
 static inline bool luring_has_fua(void)
 {
@@ -57,6 +57,17 @@ typedef struct ThrottleGroupMember {
     unsigned       pending_reqs[THROTTLE_MAX];
     QLIST_ENTRY(ThrottleGroupMember) round_robin;
 
+    /* I/O reserved from the group's limits, which requests of this member
+     * can use up until @expire_ns without taking the ThrottleGroup lock.
+     * Accessed with atomic operations, and only replaced with the
+     * ThrottleGroup lock held.
+     */
+    struct {
+        intptr_t bytes;
+        intptr_t ops;
+        int64_t expire_ns;
+    } credit[THROTTLE_MAX];
+
 } ThrottleGroupMember;
 
 #define TYPE_THROTTLE_GROUP "throttle-group"
@@ -68,6 +68,17 @@ typedef uintptr_t ram_addr_t;
 /* memory API */
 
 void qemu_ram_remap(ram_addr_t addr);
+/*
+ * qemu_ram_map_file_private - map a file copy-on-write into anonymous RAM
+ *
+ * Replace @length bytes at @offset in private anonymous @block with a
+ * MAP_PRIVATE mapping of @fd from offset 0.  Discarding the range later
+ * still gives zeroed memory.  Returns 0 on success, or -EINVAL if @block
+ * is not private anonymous memory allocated by QEMU.  On other failures,
+ * returns -errno and the range is anonymous memory with undefined contents.
+ */
+int qemu_ram_map_file_private(RAMBlock *block, ram_addr_t offset,
+                              size_t length, int fd);
 /* This should not be used by devices.  */
 ram_addr_t qemu_ram_addr_from_host(void *ptr);
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr);
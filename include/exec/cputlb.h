@@ -52,7 +52,9 @@ void tlb_reset_dirty_range_all(ram_addr_t start, ram_addr_t length);
  *
  * At most one entry for a given virtual address is permitted. Only a
  * single TARGET_PAGE_SIZE region is mapped; @full->lg_page_size is only
- * used by tlb_flush_page.
+ * used by tlb_flush_page, unless @full->lg_page_uniform is set, in which
+ * case @full is also used to refill the tlb on a miss on any other page
+ * of the large page, without calling tlb_fill.
  */
 void tlb_set_page_full(CPUState *cpu, int mmu_idx, vaddr addr,
                        CPUTLBEntryFull *full);
@@ -776,6 +776,7 @@ struct MemoryRegion {
     bool rom_device;
     bool flush_coalesced_mmio;
     bool unmergeable;
+    bool lockless_io;
     uint8_t dirty_log_mask;
     bool is_iommu;
     RAMBlock *ram_block;
@@ -1143,6 +1144,8 @@ struct FlatView {
     unsigned nr_allocated;
     struct AddressSpaceDispatch *dispatch;
     MemoryRegion *root;
+    /* Set of all MemoryRegions visited while rendering the view */
+    GHashTable *regions;
 };
 
 static inline FlatView *address_space_to_flatview(AddressSpace *as)
@@ -2253,6 +2256,18 @@ void memory_region_set_flush_coalesced(MemoryRegion *mr);
  */
 void memory_region_clear_flush_coalesced(MemoryRegion *mr);
 
+/**
+ * memory_region_enable_lockless_io: Dispatch accesses without the BQL.
+ *
+ * Accesses from vCPUs and from memory_ld/st helpers will not take the Big
+ * QEMU Lock before calling into the region's #MemoryRegionOps.  The device
+ * must protect its own state, typically with atomics, and must take the BQL
+ * itself before touching anything that requires it.
+ *
+ * @mr: the memory region to be updated.
+ */
+void memory_region_enable_lockless_io(MemoryRegion *mr);
+
 /**
  * memory_region_add_eventfd: Request an eventfd to be triggered when a word
  *                            is written to a location.
@@ -28,6 +28,7 @@
 #include "exec/ramblock.h"
 #include "exec/exec-all.h"
 #include "qemu/rcu.h"
+#include "qemu/cutils.h"
 
 #include "exec/hwaddr.h"
 #include "exec/cpu-common.h"
@@ -341,6 +342,40 @@ static inline void cpu_physical_memory_set_dirty_range(ram_addr_t start,
     xen_hvm_modified_memory(start, length);
 }
 
+/*
+ * Dirty logs are usually sparse, so the functions below check this many
+ * words at a time with buffer_is_zero(), which uses vector instructions
+ * where available, and only look at individual words of nonzero chunks.
+ */
+#define DIRTY_BITMAP_CHUNK_LONGS 64
+
+/*
+ * Return the number of words, at most DIRTY_BITMAP_CHUNK_LONGS and at
+ * most @left, that follow the word at @offset in the same dirty memory
+ * block.
+ */
+static inline unsigned long dirty_bitmap_chunk_longs(unsigned long offset,
+                                                     unsigned long left)
+{
+    return MIN(MIN(left, DIRTY_BITMAP_CHUNK_LONGS),
+               BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE) - offset);
+}
+
+/*
+ * Set @bits in the dirty memory word at @word.  Pages that are dirtied
+ * all the time, or whose client never clears them, usually have all their
+ * bits set already, so skip the locked read-modify-write in that case.
+ * This is safe because whoever clears the bits afterwards will look at
+ * the page contents after clearing them.
+ */
+static inline void cpu_physical_memory_set_dirty_word(unsigned long *word,
+                                                      unsigned long bits)
+{
+    if ((qatomic_read(word) & bits) != bits) {
+        qatomic_or(word, bits);
+    }
+}
+
 #if !defined(_WIN32)
 
 /*
@@ -369,6 +404,7 @@ uint64_t cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
         unsigned long **blocks[DIRTY_MEMORY_NUM];
         unsigned long idx;
         unsigned long offset;
+        unsigned long n;
         long k;
         long nr = BITS_TO_LONGS(pages);
 
@@ -382,32 +418,44 @@ uint64_t cpu_physical_memory_set_dirty_lebitmap(unsigned long *bitmap,
                     qatomic_rcu_read(&ram_list.dirty_memory[i])->blocks;
             }
 
-            for (k = 0; k < nr; k++) {
-                if (bitmap[k]) {
-                    unsigned long temp = leul_to_cpu(bitmap[k]);
+            for (k = 0; k < nr; k += n) {
+                n = dirty_bitmap_chunk_longs(offset, nr - k);
+                if (buffer_is_zero(&bitmap[k], n * sizeof(unsigned long))) {
+                    offset += n;
+                } else {
+                    for (i = k; i < k + n; i++, offset++) {
+                        unsigned long temp;
+
+                        if (!bitmap[i]) {
+                            continue;
+                        }
 
-                    nbits = ctpopl(temp);
-                    qatomic_or(&blocks[DIRTY_MEMORY_VGA][idx][offset], temp);
+                        temp = leul_to_cpu(bitmap[i]);
+                        nbits = ctpopl(temp);
+                        cpu_physical_memory_set_dirty_word(
+                            &blocks[DIRTY_MEMORY_VGA][idx][offset], temp);
 
-                    if (global_dirty_tracking) {
-                        qatomic_or(
+                        if (global_dirty_tracking) {
+                            cpu_physical_memory_set_dirty_word(
                                 &blocks[DIRTY_MEMORY_MIGRATION][idx][offset],
                                 temp);
-                        if (unlikely(
-                            global_dirty_tracking & GLOBAL_DIRTY_DIRTY_RATE)) {
-                            total_dirty_pages += nbits;
+                            if (unlikely(global_dirty_tracking &
+                                         GLOBAL_DIRTY_DIRTY_RATE)) {
+                                total_dirty_pages += nbits;
+                            }
                         }
-                    }
 
-                    num_dirty += nbits;
+                        num_dirty += nbits;
 
-                    if (tcg_enabled()) {
-                        qatomic_or(&blocks[DIRTY_MEMORY_CODE][idx][offset],
-                                   temp);
+                        if (tcg_enabled()) {
+                            cpu_physical_memory_set_dirty_word(
+                                &blocks[DIRTY_MEMORY_CODE][idx][offset],
+                                temp);
+                        }
                     }
                 }
 
-                if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
+                if (offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
                     offset = 0;
                     idx++;
                 }
@@ -459,6 +507,16 @@ static inline void cpu_physical_memory_dirty_bits_cleared(ram_addr_t start,
     }
 
 }
+
+/*
+ * Return the start of the GRANULE-aligned range of guest RAM around ADDR,
+ * clipped to the RAMBlock that contains ADDR, and its length in *PLENGTH.
+ * GRANULE must be a power of 2.
+ */
+ram_addr_t cpu_physical_memory_dirty_granule(ram_addr_t addr,
+                                             ram_addr_t granule,
+                                             ram_addr_t *plength);
+
 bool cpu_physical_memory_test_and_clear_dirty(ram_addr_t start,
                                               ram_addr_t length,
                                               unsigned client);
@@ -494,7 +552,7 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
     if (((word * BITS_PER_LONG) << TARGET_PAGE_BITS) ==
          (start + rb->offset) &&
         !(length & ((BITS_PER_LONG << TARGET_PAGE_BITS) - 1))) {
-        int k;
+        int k, i, n;
         int nr = BITS_TO_LONGS(length >> TARGET_PAGE_BITS);
         unsigned long * const *src;
         unsigned long idx = (word * BITS_PER_LONG) / DIRTY_MEMORY_BLOCK_SIZE;
@@ -505,17 +563,25 @@ uint64_t cpu_physical_memory_sync_dirty_bitmap(RAMBlock *rb,
         src = qatomic_rcu_read(
                 &ram_list.dirty_memory[DIRTY_MEMORY_MIGRATION])->blocks;
 
-        for (k = page; k < page + nr; k++) {
-            if (src[idx][offset]) {
-                unsigned long bits = qatomic_xchg(&src[idx][offset], 0);
-                unsigned long new_dirty;
-                new_dirty = ~dest[k];
-                dest[k] |= bits;
-                new_dirty &= bits;
-                num_dirty += ctpopl(new_dirty);
+        for (k = page; k < page + nr; k += n) {
+            unsigned long *chunk = &src[idx][offset];
+
+            n = dirty_bitmap_chunk_longs(offset, page + nr - k);
+            if (!buffer_is_zero(chunk, n * sizeof(unsigned long))) {
+                for (i = 0; i < n; i++) {
+                    if (chunk[i]) {
+                        unsigned long bits = qatomic_xchg(&chunk[i], 0);
+                        unsigned long new_dirty;
+                        new_dirty = ~dest[k + i];
+                        dest[k + i] |= bits;
+                        new_dirty &= bits;
+                        num_dirty += ctpopl(new_dirty);
+                    }
+                }
             }
 
-            if (++offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
+            offset += n;
+            if (offset >= BITS_TO_LONGS(DIRTY_MEMORY_BLOCK_SIZE)) {
                 offset = 0;
                 idx++;
             }
@@ -44,6 +44,8 @@ struct RAMBlock {
     uint64_t fd_offset;
     int guest_memfd;
     size_t page_size;
+    /* Parts of this anonymous RAM may be MAP_PRIVATE file mappings */
+    bool file_mapped;
     /* dirty bitmap used during migration */
     unsigned long *bmap;
 
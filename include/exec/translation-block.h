@@ -91,6 +91,12 @@ struct TranslationBlock {
     uint16_t size;
     uint16_t icount;
 
+    /*
+     * Executions left before the TB is retranslated with the optimizer,
+     * decremented by the TB itself; 0 if it was translated with it.
+     */
+    int32_t tier_up_budget;
+
     struct tb_tc tc;
 
     /*
@@ -414,6 +414,7 @@ struct MachineState {
     ConfidentialGuestSupport *cgs;
     HostMemoryBackend *memdev;
     bool aux_ram_share;
+    bool rom_file_share;
     /*
      * convenience alias to ram_memdev_id backend memory region
      * or to numa container memory region
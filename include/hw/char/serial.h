@@ -32,6 +32,8 @@
 #include "qom/object.h"
 
 #define UART_FIFO_LENGTH    16      /* 16550A Fifo Length */
+/* Bytes shifted out of the TSR that the backend has yet to accept */
+#define SERIAL_OUT_FIFO_LENGTH  256
 
 struct SerialState {
     DeviceState parent;
@@ -65,6 +67,9 @@ struct SerialState {
     uint64_t last_xmit_ts;
     Fifo8 recv_fifo;
     Fifo8 xmit_fifo;
+    /* Written to the backend in batches by out_bh */
+    Fifo8 out_fifo;
+    QEMUBH *out_bh;
     /* Interrupt trigger level for recv_fifo */
     uint8_t recv_fifo_itl;
 
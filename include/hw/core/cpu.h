@@ -198,8 +198,26 @@ struct CPUClass {
  */
 #define NB_MMU_MODES 16
 
-/* Use a fully associative victim tlb of 8 entries. */
-#define CPU_VTLB_SIZE 8
+/*
+ * The victim tlb is CPU_VTLB_WAYS-way set associative with LRU replacement.
+ * Its number of entries defaults to CPU_VTLB_DEFAULT_SIZE and can be set,
+ * as a power of 2 between CPU_VTLB_WAYS and CPU_VTLB_MAX_SIZE, with the
+ * vtlb-size property of the tcg accelerator.  There may be no more sets than
+ * entries in the smallest main tlb, see victim_tlb_hit().
+ */
+#define CPU_VTLB_WAYS 8
+#define CPU_VTLB_DEFAULT_SIZE 64
+#define CPU_VTLB_MAX_SIZE 512
+
+/* Use a fully associative table of 8 entries for uniform large pages. */
+#define CPU_LTLB_SIZE 8
+
+/*
+ * Flushes requested by other vCPUs are batched until the target vCPU
+ * next processes its queued work.  Past this many distinct requests,
+ * the batch is escalated to a full flush of the mmu_idx involved.
+ */
+#define CPU_TLB_PENDING_FLUSH_MAX 16
 
 /*
  * The full TLB entry, which is not accessed by generated TCG code,
@@ -233,6 +251,14 @@ struct CPUTLBEntryFull {
     /* @lg_page_size contains the log2 of the page size. */
     uint8_t lg_page_size;
 
+    /*
+     * @lg_page_uniform is set by tlb_fill when the translation, protection
+     * and attributes are the same for every TARGET_PAGE_SIZE page of a
+     * larger @lg_page_size page.  The other pages of the large page may
+     * then be entered in the tlb without calling tlb_fill again.
+     */
+    bool lg_page_uniform;
+
     /* Additional tlb flags requested by tlb_fill. */
     uint8_t tlb_fill_flags;
 
@@ -282,12 +308,31 @@ typedef struct CPUTLBDesc {
     /* maximum number of entries observed in the window */
     size_t window_max_entries;
     size_t n_used_entries;
-    /* The next index to use in the tlb victim table.  */
-    size_t vindex;
+    /* LRU clock of the tlb victim table, and the last use of each entry. */
+    uint32_t vclock;
+    uint32_t *vlru;
     /* The tlb victim table, in two parts.  */
-    CPUTLBEntry vtable[CPU_VTLB_SIZE];
-    CPUTLBEntryFull vfulltlb[CPU_VTLB_SIZE];
+    CPUTLBEntry *vtable;
+    CPUTLBEntryFull *vfulltlb;
     CPUTLBEntryFull *fulltlb;
+    /*
+     * Victim tlb statistics, read and written like those in CPUTLBCommon.
+     * A miss here is a main tlb miss that had to call tlb_fill.
+     */
+    size_t vtlb_hit_count;
+    size_t vtlb_miss_count;
+    /*
+     * Uniform large pages, used to refill the tlb for any of their pages.
+     * They all lie within the large_page_addr/mask region, so that any
+     * flush which touches one of them flushes the whole mmu_idx.
+     */
+    size_t lindex;
+    struct {
+        vaddr addr;
+        vaddr mask;
+        CPUTLBEntryFull full;
+    } ltlb[CPU_LTLB_SIZE];
+    size_t ltlb_hit_count;
 } CPUTLBDesc;
 
 /*
@@ -302,6 +347,24 @@ typedef struct CPUTLBCommon {
      * Protected by tlb_c.lock.
      */
     uint16_t dirty;
+    /* Number of sets in each d.vtable, a power of 2.  */
+    unsigned vtlb_sets;
+    /*
+     * Page and range flushes requested by other vCPUs, not yet performed.
+     * A single work item is queued for all of them while pending_queued
+     * is set; requests past CPU_TLB_PENDING_FLUSH_MAX are merged into
+     * pending_full, the set of mmu_idx to flush entirely.
+     * Protected by tlb_c.lock.
+     */
+    bool pending_queued;
+    uint16_t pending_full;
+    unsigned pending_count;
+    struct {
+        vaddr addr;
+        vaddr len;
+        uint16_t idxmap;
+        uint16_t bits;
+    } pending[CPU_TLB_PENDING_FLUSH_MAX];
     /*
      * Statistics.  These are not lock protected, but are read and
      * written atomically.  This allows the monitor to print a snapshot
@@ -310,6 +373,7 @@ typedef struct CPUTLBCommon {
     size_t full_flush_count;
     size_t part_flush_count;
     size_t elide_flush_count;
+    size_t batch_flush_count;
 } CPUTLBCommon;
 
 /*
@@ -395,6 +459,24 @@ struct qemu_work_item;
 
 #define CPU_UNSET_NUMA_NODE_ID -1
 
+/*
+ * Counts of the ways a vCPU left translated code, for the tcg stats
+ * provider.  Written only by the vCPU thread and read atomically.
+ */
+typedef struct CPUTBExitStats {
+    /* goto_tb not yet linked, after which the next TB may be chained */
+    size_t goto_tb;
+    /* exit_tb to the main loop, such as after a lookup_tb_ptr miss */
+    size_t exit_tb;
+    /* exit request, interrupt or icount expiry */
+    size_t requested;
+    /* lookup_tb_ptr found the next TB, or returned to the main loop */
+    size_t lookup_hits;
+    size_t lookup_misses;
+    /* TB retranslated to end with the instruction that does I/O */
+    size_t io_recompile;
+} CPUTBExitStats;
+
 /**
  * struct CPUState - common state of one CPU core or thread.
  *
@@ -413,7 +495,7 @@ struct qemu_work_item;
  * @thread_id: native thread id of vCPU, only live once @created is #true
  * @running: #true if CPU is currently running (lockless).
  * @has_waiter: #true if a CPU is currently waiting for the cpu_exec_end;
- * valid under cpu_list_lock.
+ * cleared atomically by whoever releases the waiter (lockless).
  * @created: Indicates whether the CPU thread has been successfully created.
  * @halt_cond: condition variable sleeping threads can wait on.
  * @interrupt_request: Indicates a pending interrupt request.
@@ -429,6 +511,7 @@ struct qemu_work_item;
  * @num_ases: number of CPUAddressSpaces in @cpu_ases
  * @as: Pointer to the first AddressSpace, for the convenience of targets which
  *      only have a single AddressSpace
+ * @tb_exit_stats: TCG statistics of how translated code was left.
  * @gdb_regs: Additional GDB registers.
  * @gdb_num_regs: Number of total registers accessible to GDB.
  * @gdb_num_g_regs: Number of registers in GDB 'g' packets.
@@ -447,6 +530,12 @@ struct qemu_work_item;
  *    ring is enabled.
  * @kvm_fetch_index: Keeps the index that we last fetched from the per-vCPU
  *    dirty ring structure.
+ * @tcg_dirty_ring: Points to the TCG dirty ring for this CPU when TCG dirty
+ *    ring is enabled.
+ * @tcg_profile_pending: Set by the TCG profiler to request a sample of the
+ *    next TB executed by this CPU.
+ * @tlb_sample: Evicted TLB entries and recorded refills of the TLB
+ *    sampler, allocated when the sampler first runs.
  *
  * @neg_align: The CPUState is the common part of a concrete ArchCPU
  * which is allocated when an individual CPU instance is created. As
@@ -487,6 +576,8 @@ struct CPUState {
     bool exit_request;
     int exclusive_context_count;
     uint32_t cflags_next_tb;
+    /* Physical address of the next TB to translate with the optimizer */
+    uint64_t tb_tier_up_addr;
     /* updates protected by BQL */
     uint32_t interrupt_request;
     int singlestep_enabled;
@@ -505,6 +596,10 @@ struct CPUState {
     MemoryRegion *memory;
 
     struct CPUJumpCache *tb_jmp_cache;
+    CPUTBExitStats tb_exit_stats;
+    struct TCGDirtyRing *tcg_dirty_ring;
+    bool tcg_profile_pending;
+    struct TLBSample *tlb_sample;
 
     GArray *gdb_regs;
     int gdb_num_regs;
@@ -730,6 +825,24 @@ hwaddr cpu_get_phys_page_attrs_debug(CPUState *cpu, vaddr addr,
  */
 hwaddr cpu_get_phys_page_debug(CPUState *cpu, vaddr addr);
 
+/**
+ * cpu_get_phys_range_debug:
+ * @cpu: The CPU to obtain the physical address for.
+ * @addr: The virtual address.
+ * @len: Updated on return with the number of bytes from @addr that are
+ *       mapped contiguously, at least up to the end of the page.
+ * @attrs: Updated on return with the memory transaction attributes to use
+ *         for this access.
+ *
+ * Like cpu_get_phys_page_attrs_debug(), but translates the whole mapping
+ * that contains @addr at once.
+ * Use it only for debugging because no protection checks are done.
+ *
+ * Returns: Physical address of @addr or -1 if no page found.
+ */
+hwaddr cpu_get_phys_range_debug(CPUState *cpu, vaddr addr, vaddr *len,
+                                MemTxAttrs *attrs);
+
 /** cpu_asidx_from_attrs:
  * @cpu: CPU
  * @attrs: memory transaction attributes
@@ -1034,6 +1147,14 @@ void cpu_exec_start(CPUState *cpu);
  */
 void cpu_exec_end(CPUState *cpu);
 
+/* Reasons for exclusive sections, counted separately */
+typedef enum ExclusiveCause {
+    EXCLUSIVE_CAUSE_OTHER,
+    EXCLUSIVE_CAUSE_STEP_ATOMIC,
+    EXCLUSIVE_CAUSE_SAFE_WORK,
+    EXCLUSIVE_CAUSE__MAX,
+} ExclusiveCause;
+
 /**
  * start_exclusive:
  *
@@ -1046,6 +1167,15 @@ void cpu_exec_end(CPUState *cpu);
  */
 void start_exclusive(void);
 
+/**
+ * start_exclusive_cause:
+ * @cause: What the exclusive section is for.
+ *
+ * Like start_exclusive(), and account the section and the time spent
+ * stopping the other CPUs to @cause.
+ */
+void start_exclusive_cause(ExclusiveCause cause);
+
 /**
  * end_exclusive:
  *
@@ -1053,6 +1183,15 @@ void start_exclusive(void);
  */
 void end_exclusive(void);
 
+/**
+ * exclusive_dump_stats:
+ * @buf: Where to print.
+ *
+ * Print the number of exclusive sections of each cause so far, and the
+ * average and maximum time they waited for the other CPUs to stop.
+ */
+void exclusive_dump_stats(GString *buf);
+
 /**
  * qemu_init_vcpu:
  * @cpu: The vCPU to initialize.
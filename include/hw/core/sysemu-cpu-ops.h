@@ -42,6 +42,17 @@ typedef struct SysemuCPUOps {
      */
     hwaddr (*get_phys_page_attrs_debug)(CPUState *cpu, vaddr addr,
                                         MemTxAttrs *attrs);
+    /**
+     * @get_phys_range_debug: Callback for obtaining the physical address
+     *       of @addr, the memory transaction attributes to use for the
+     *       access, and in @len the number of bytes from @addr that are
+     *       mapped contiguously with them.
+     * CPUs with large pages can implement this on top of the above, so
+     * that debug accesses to a large range walk the page tables once per
+     * mapping rather than once per page.
+     */
+    hwaddr (*get_phys_range_debug)(CPUState *cpu, vaddr addr, vaddr *len,
+                                   MemTxAttrs *attrs);
     /**
      * @asidx_from_attrs: Callback to return the CPU AddressSpace to use for
      *       a memory access with the specified memory transaction attributes.
@@ -33,7 +33,10 @@ typedef struct RISCVAclintMTimerState {
     SysBusDevice parent_obj;
     uint64_t time_delta;
     uint64_t *timecmp;
-    QEMUTimer **timers;
+    /* QEMU_CLOCK_VIRTUAL deadline of each hart, INT64_MAX if none */
+    int64_t *deadlines;
+    /* Shared by all harts, armed no later than the earliest deadline */
+    QEMUTimer *timer;
 
     /*< public >*/
     MemoryRegion mmio;
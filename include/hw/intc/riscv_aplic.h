@@ -49,6 +49,8 @@ struct RISCVAPLICState {
     uint32_t genmsi;
     uint32_t *sourcecfg;
     uint32_t *state;
+    unsigned long *pending;
+    unsigned long *enabled;
     uint32_t *target;
     uint32_t *idelivery;
     uint32_t *iforce;
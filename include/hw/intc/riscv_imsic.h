@@ -60,6 +60,7 @@ struct RISCVIMSICState {
     uint32_t hartid;
     uint32_t num_pages;
     uint32_t num_irqs;
+    bool lockless_msi;
 };
 
 DeviceState *riscv_imsic_create(hwaddr addr, uint32_t hartid, bool mmode,
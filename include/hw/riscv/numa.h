@@ -76,6 +76,17 @@ uint64_t riscv_socket_mem_offset(const MachineState *ms, int socket_id);
  */
 uint64_t riscv_socket_mem_size(const MachineState *ms, int socket_id);
 
+/**
+ * riscv_socket_check_mem_align:
+ * @ms: pointer to machine state
+ * @base: guest physical address of the first socket's ram
+ *
+ * Warn about sockets whose ram does not start on a page boundary of its
+ * host memory backend, since the accelerator cannot map such ram with
+ * host huge pages.
+ */
+void riscv_socket_check_mem_align(const MachineState *ms, hwaddr base);
+
 /**
  * riscv_socket_check_hartids:
  * @ms: pointer to machine state
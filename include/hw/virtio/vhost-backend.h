@@ -115,6 +115,7 @@ typedef void (*vhost_set_iotlb_callback_op)(struct vhost_dev *dev,
                                            int enabled);
 typedef int (*vhost_send_device_iotlb_msg_op)(struct vhost_dev *dev,
                                               struct vhost_iotlb_msg *imsg);
+typedef int (*vhost_iotlb_batch_op)(struct vhost_dev *dev, bool begin);
 typedef int (*vhost_set_config_op)(struct vhost_dev *dev, const uint8_t *data,
                                    uint32_t offset, uint32_t size,
                                    uint32_t flags);
@@ -199,6 +200,7 @@ typedef struct VhostOps {
     vhost_vsock_set_running_op vhost_vsock_set_running;
     vhost_set_iotlb_callback_op vhost_set_iotlb_callback;
     vhost_send_device_iotlb_msg_op vhost_send_device_iotlb_msg;
+    vhost_iotlb_batch_op vhost_iotlb_batch;
     vhost_get_config_op vhost_get_config;
     vhost_set_config_op vhost_set_config;
     vhost_crypto_create_session_op vhost_crypto_create_session;
@@ -221,6 +223,13 @@ int vhost_backend_update_device_iotlb(struct vhost_dev *dev,
                                              uint64_t len,
                                              IOMMUAccessFlags perm);
 
+/*
+ * Bracket IOTLB updates and invalidations, so that a backend that supports
+ * it acknowledges all of them at once in vhost_backend_iotlb_batch_end().
+ */
+int vhost_backend_iotlb_batch_begin(struct vhost_dev *dev);
+int vhost_backend_iotlb_batch_end(struct vhost_dev *dev);
+
 int vhost_backend_invalidate_device_iotlb(struct vhost_dev *dev,
                                                  uint64_t iova, uint64_t len);
 
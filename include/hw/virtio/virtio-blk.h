@@ -48,8 +48,28 @@ struct VirtIOBlkConf
     uint32_t max_discard_sectors;
     uint32_t max_write_zeroes_sectors;
     bool x_enable_wce_if_config_wce;
+    uint32_t notify_coalesce_usecs;
+    uint32_t notify_coalesce_count;
 };
 
+/* Latencies of the read and write requests of one virtqueue */
+typedef struct VirtIOBlockQueueStats {
+    /* From virtqueue_pop() until submission to the BlockBackend */
+    BlockLog2Histogram queue;
+    /* Time spent submitting to the BlockBackend by the virtqueue's thread */
+    BlockLog2Histogram submit;
+    /* From submission until the BlockBackend completes the request */
+    BlockLog2Histogram complete;
+} VirtIOBlockQueueStats;
+
+/* Completions of one virtqueue that the guest was not notified about yet */
+typedef struct VirtIOBlockNotifyCoalesce {
+    struct VirtIOBlock *dev;
+    VirtQueue *vq;
+    QEMUTimer *timer;
+    unsigned int pending;
+} VirtIOBlockNotifyCoalesce;
+
 struct VirtIOBlockReq;
 struct VirtIOBlock {
     VirtIODevice parent_obj;
@@ -71,6 +91,20 @@ struct VirtIOBlock {
      */
     AioContext **vq_aio_context;
 
+    /* One element per virtqueue, updated from its AioContext */
+    VirtIOBlockQueueStats *queue_stats;
+
+    /* One element per virtqueue if notify-coalesce-usecs is set */
+    VirtIOBlockNotifyCoalesce *notify_coalesce;
+
+    /*
+     * One element per virtqueue, NULL unless the virtqueue shares its
+     * AioContext with others and requests are merged.  Points into
+     * merge_windows.
+     */
+    struct VirtIOBlockMergeWindow **vq_merge_window;
+    struct VirtIOBlockMergeWindow *merge_windows;
+
     uint64_t host_features;
     size_t config_size;
     BlockRAMRegistrar blk_ram_registrar;
@@ -90,6 +124,8 @@ typedef struct VirtIOBlockReq {
     struct VirtIOBlockReq *next;
     struct VirtIOBlockReq *mr_next;
     BlockAcctCookie acct;
+    int64_t pop_time_ns;
+    int64_t submit_time_ns;
 } VirtIOBlockReq;
 
 #define VIRTIO_BLK_MAX_MERGE_REQS 32
@@ -100,6 +136,16 @@ typedef struct MultiReqBuffer {
     bool is_write;
 } MultiReqBuffer;
 
+/*
+ * Requests of all virtqueues sharing an AioContext, submitted once per
+ * event loop iteration so that they can be merged with each other.
+ */
+typedef struct VirtIOBlockMergeWindow {
+    VirtIOBlock *dev;
+    MultiReqBuffer mrb;
+    bool scheduled;
+} VirtIOBlockMergeWindow;
+
 typedef struct VirtIOBlkClass {
     /*< private >*/
     VirtioDeviceClass parent;
@@ -33,6 +33,17 @@ OBJECT_DECLARE_SIMPLE_TYPE(VirtIOIOMMU, VIRTIO_IOMMU)
 
 #define TYPE_VIRTIO_IOMMU_MEMORY_REGION "virtio-iommu-memory-region"
 
+#define VIOMMU_IOTLB_SIZE 8
+
+/* A mapping recently used by the translate callback of an endpoint */
+typedef struct VirtIOIOMMUIOTLBEntry {
+    uint64_t gen;               /* VirtIOIOMMU::iotlb_gen, or 0 if unused */
+    uint64_t low;
+    uint64_t high;
+    uint64_t phys_addr;
+    uint32_t flags;
+} VirtIOIOMMUIOTLBEntry;
+
 typedef struct IOMMUDevice {
     void         *viommu;
     PCIBus       *bus;
@@ -43,6 +54,8 @@ typedef struct IOMMUDevice {
     MemoryRegion bypass_mr;     /* The alias of shared memory MR */
     GList *resv_regions;
     GList *host_resv_ranges;
+    VirtIOIOMMUIOTLBEntry iotlb[VIOMMU_IOTLB_SIZE];
+    unsigned int iotlb_next;
 } IOMMUDevice;
 
 typedef struct IOMMUPciBus {
@@ -65,6 +78,12 @@ struct VirtIOIOMMU {
     GTree *domains;
     QemuRecMutex mutex;
     GTree *endpoints;
+    /* Bumped whenever a cached translation may have become stale */
+    uint64_t iotlb_gen;
+    /* UNMAP notification being merged with the following requests */
+    struct VirtIOIOMMUDomain *notify_domain;
+    uint64_t notify_start;
+    uint64_t notify_end;
     bool boot_bypass;
     Notifier machine_done;
     bool granule_frozen;
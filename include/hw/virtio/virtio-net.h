@@ -20,6 +20,8 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "system/iothread.h"
+#include "qapi/qapi-types-virtio.h"
 
 #include "ebpf/ebpf_rss.h"
 
@@ -56,6 +58,8 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    IOThread *iothread;
+    IOThreadVirtQueueMappingList *iothread_vq_mapping_list;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -149,6 +153,8 @@ typedef struct VirtioNetRssData {
     uint16_t indirections_len;
     uint16_t *indirections_table;
     uint16_t default_queue;
+    /* Built from @key for software RSS */
+    struct NetToeplitzTable *toeplitz_table;
 } VirtioNetRssData;
 
 typedef struct VirtIONetQueue {
@@ -161,6 +167,10 @@ typedef struct VirtIONetQueue {
         VirtQueueElement *elem;
     } async_tx;
     struct VirtIONet *n;
+    /* IOThread assigned to the queue pair, NULL for the main loop */
+    AioContext *ctx;
+    /* Where the queue pair currently runs, NULL until ioeventfd starts */
+    AioContext *cur_ctx;
 } VirtIONetQueue;
 
 struct VirtIONet {
@@ -191,6 +201,10 @@ struct VirtIONet {
     uint8_t nouni;
     uint8_t nobcast;
     uint8_t vhost_started;
+    /* Queue pairs run in their IOThreads (see virtio_net_start_ioeventfd) */
+    bool dataplane_started;
+    /* Nesting depth of virtio_net_dataplane_pause() */
+    unsigned int dataplane_pause_depth;
     struct {
         uint32_t in_use;
         uint32_t first_multi;
@@ -36,6 +36,8 @@ OBJECT_DECLARE_TYPE(QIOChannel, QIOChannelClass,
 
 #define QIO_CHANNEL_READ_FLAG_MSG_PEEK 0x1
 #define QIO_CHANNEL_READ_FLAG_RELAXED_EOF 0x2
+/* Hint to block until all of the iov is filled, where supported */
+#define QIO_CHANNEL_READ_FLAG_WAITALL 0x4
 
 typedef enum QIOChannelFeature QIOChannelFeature;
 
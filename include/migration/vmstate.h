@@ -198,6 +198,15 @@ struct VMStateDescription {
      * a QEMU_VM_SECTION_START section.
      */
     bool early_setup;
+    /*
+     * This VMSD can be saved from a worker thread, concurrently with
+     * other such VMSDs that are registered next to it, when
+     * "x-vmstate-save-threads" is set.  Its save must not depend on
+     * saving any other state, nor need the BQL to be taken by the
+     * current thread.  The stream order is unchanged, and all states
+     * registered before it are saved first.
+     */
+    bool parallel_save;
     int version_id;
     int minimum_version_id;
     MigrationPriority priority;
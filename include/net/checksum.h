@@ -108,4 +108,33 @@ void net_toeplitz_add(uint32_t *result,
     *result = accumulator;
 }
 
+/* Longest RSS hash input: IPv6 source and destination addresses and ports */
+#define NET_TOEPLITZ_MAX_INPUT 36
+
+/*
+ * Toeplitz hash contribution of every possible byte value at every input
+ * position, so that hashing takes one lookup per input byte instead of
+ * one conditional XOR per input bit.  Computing it needs
+ * NET_TOEPLITZ_MAX_INPUT + 4 bytes of key.
+ */
+typedef struct NetToeplitzTable {
+    uint32_t lut[NET_TOEPLITZ_MAX_INPUT][256];
+} NetToeplitzTable;
+
+void net_toeplitz_table_init(NetToeplitzTable *table, const uint8_t *key);
+
+static inline
+uint32_t net_toeplitz_table_hash(const NetToeplitzTable *table,
+                                 const uint8_t *input, uint32_t len)
+{
+    uint32_t hash = 0;
+    uint32_t byte;
+
+    assert(len <= NET_TOEPLITZ_MAX_INPUT);
+    for (byte = 0; byte < len; byte++) {
+        hash ^= table->lut[byte][input[byte]];
+    }
+    return hash;
+}
+
 #endif /* QEMU_NET_CHECKSUM_H */
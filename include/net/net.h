@@ -67,6 +67,14 @@ typedef void (SocketReadStateFinalize)(SocketReadState *rs);
 typedef void (NetAnnounce)(NetClientState *);
 typedef bool (SetSteeringEBPF)(NetClientState *, int);
 typedef bool (NetCheckPeerType)(NetClientState *, ObjectClass *, Error **);
+/*
+ * Move the fd handlers of the client to @ctx, or to the main loop if @ctx
+ * is NULL.  The net layer does no locking of its own: a client and its
+ * peer, together with their queues, must only ever be used from a single
+ * thread at a time, and the caller must quiesce them in the old thread
+ * before letting another one use them.
+ */
+typedef void (NetSetAioContext)(NetClientState *, AioContext *ctx);
 
 typedef struct NetClientInfo {
     NetClientDriver type;
@@ -92,6 +100,7 @@ typedef struct NetClientInfo {
     NetAnnounce *announce;
     SetSteeringEBPF *set_steering_ebpf;
     NetCheckPeerType *check_peer_type;
+    NetSetAioContext *set_aio_context;
 } NetClientInfo;
 
 struct NetClientState {
@@ -0,0 +1,40 @@
+/*
+ * JSON Output Visitor
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#ifndef JSON_OUTPUT_VISITOR_H
+#define JSON_OUTPUT_VISITOR_H
+
+#include "qapi/visitor.h"
+
+typedef struct JSONOutputVisitor JSONOutputVisitor;
+
+/**
+ * Create a JSON output visitor for @result
+ *
+ * A JSON output visitor visit writes a QAPI object as JSON text,
+ * without building the intermediate QObject that
+ * qobject_output_visitor_new() followed by qobject_to_json() needs.
+ * Its output is the same as that of the QObject output visitor
+ * serialized with qobject_to_json_pretty(), except that members appear
+ * in visit order rather than in QDict hash order.
+ *
+ * Using @pretty indents the output like qobject_to_json_pretty().
+ *
+ * For type 'any', the QObject is serialized with qobject_to_json().
+ *
+ * Errors are not expected to happen.
+ *
+ * If the visit succeeds, pass @result to visit_complete() to collect
+ * the JSON text, which the caller must free with g_free().
+ *
+ * The caller is responsible for freeing the visitor with
+ * visit_free().
+ */
+Visitor *json_output_visitor_new(bool pretty, char **result);
+
+#endif
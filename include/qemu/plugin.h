@@ -70,6 +70,7 @@ enum plugin_dyn_cb_type {
     PLUGIN_CB_REGULAR,
     PLUGIN_CB_COND,
     PLUGIN_CB_MEM_REGULAR,
+    PLUGIN_CB_MEM_TRACE,
     PLUGIN_CB_INLINE_ADD_U64,
     PLUGIN_CB_INLINE_STORE_U64,
 };
@@ -128,6 +129,24 @@ struct qemu_plugin_scoreboard {
     QLIST_ENTRY(qemu_plugin_scoreboard) entry;
 };
 
+/*
+ * A memory trace keeps one buffer per vcpu in a scoreboard. Generated
+ * code appends to the buffer of the running vcpu and only calls out to
+ * the plugin once it is full.
+ */
+struct qemu_plugin_mem_trace {
+    struct qemu_plugin_scoreboard *score;
+    size_t n_entries;
+    qemu_plugin_vcpu_mem_trace_cb_t cb;
+    void *userp;
+};
+
+/* Layout of one scoreboard entry of a memory trace */
+struct qemu_plugin_mem_trace_buf {
+    uint64_t count;
+    qemu_plugin_mem_trace_entry entries[];
+};
+
 /* Internal context for this TranslationBlock */
 struct qemu_plugin_tb {
     GPtrArray *insns;
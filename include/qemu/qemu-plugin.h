@@ -65,11 +65,14 @@ typedef uint64_t qemu_plugin_id_t;
  *
  * version 4:
  * - added qemu_plugin_read_memory_vaddr
+ *
+ * version 5:
+ * - added qemu_plugin_mem_trace_* and qemu_plugin_register_vcpu_mem_trace
  */
 
 extern QEMU_PLUGIN_EXPORT int qemu_plugin_version;
 
-#define QEMU_PLUGIN_VERSION 4
+#define QEMU_PLUGIN_VERSION 5
 
 /**
  * struct qemu_info_t - system information for plugins
@@ -701,6 +704,95 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     qemu_plugin_u64 entry,
     uint64_t imm);
 
+/** struct qemu_plugin_mem_trace - Opaque handle for a memory trace */
+struct qemu_plugin_mem_trace;
+
+/**
+ * typedef qemu_plugin_mem_trace_entry - one recorded memory access
+ * @vaddr: the virtual address of the access
+ * @info: handle for further queries, as passed to qemu_plugin_vcpu_mem_cb_t
+ */
+typedef struct {
+    uint64_t vaddr;
+    qemu_plugin_meminfo_t info;
+} qemu_plugin_mem_trace_entry;
+
+/**
+ * typedef qemu_plugin_vcpu_mem_trace_cb_t - memory trace callback
+ * @vcpu_index: the vCPU the accesses took place on
+ * @entries: the recorded accesses, in program order
+ * @n: number of @entries
+ * @userdata: any user data attached to the trace
+ *
+ * @entries is only valid for the duration of the callback. Since the
+ * accesses are reported after the fact, qemu_plugin_get_hwaddr() cannot
+ * be used on them.
+ */
+typedef void (*qemu_plugin_vcpu_mem_trace_cb_t)(
+    unsigned int vcpu_index,
+    const qemu_plugin_mem_trace_entry *entries,
+    size_t n,
+    void *userdata);
+
+/**
+ * qemu_plugin_mem_trace_new() - allocate a new memory trace
+ * @n_entries: number of accesses buffered per vCPU
+ * @cb: callback of type qemu_plugin_vcpu_mem_trace_cb_t
+ * @userdata: opaque pointer for userdata
+ *
+ * A memory trace is a per-vCPU buffer of memory accesses. Instructions
+ * registered with qemu_plugin_register_vcpu_mem_trace() append to it
+ * from generated code, and @cb is only called once a vCPU's buffer
+ * holds @n_entries accesses. This is far cheaper than a
+ * qemu_plugin_register_vcpu_mem_cb() callback per access.
+ *
+ * Returns a handle that must be freed with qemu_plugin_mem_trace_free().
+ */
+QEMU_PLUGIN_API
+struct qemu_plugin_mem_trace *
+qemu_plugin_mem_trace_new(size_t n_entries,
+                          qemu_plugin_vcpu_mem_trace_cb_t cb,
+                          void *userdata);
+
+/**
+ * qemu_plugin_mem_trace_free() - free a memory trace
+ * @trace: trace to free
+ *
+ * Accesses still buffered are dropped; use qemu_plugin_mem_trace_flush()
+ * first if they matter.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace);
+
+/**
+ * qemu_plugin_mem_trace_flush() - hand over buffered accesses
+ * @trace: trace to flush
+ * @vcpu_index: vCPU whose buffer to flush
+ *
+ * Calls the trace callback with whatever accesses @vcpu_index has buffered
+ * so far, if any. This must be called either from @vcpu_index itself
+ * (e.g. from a vCPU exit callback) or once all vCPUs are stopped (e.g.
+ * from an atexit callback).
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_mem_trace_flush(struct qemu_plugin_mem_trace *trace,
+                                 unsigned int vcpu_index);
+
+/**
+ * qemu_plugin_register_vcpu_mem_trace() - record mem accesses in a trace
+ * @insn: handle for instruction to instrument
+ * @rw: record reads, writes or both
+ * @trace: trace to append to
+ *
+ * This records every memory access generated by the instruction into
+ * @trace. Recording is done inline, the trace callback is only called
+ * when the buffer of the vCPU is full.
+ */
+QEMU_PLUGIN_API
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_trace *trace);
+
 /**
  * qemu_plugin_request_time_control() - request the ability to control time
  *
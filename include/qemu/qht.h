@@ -29,10 +29,19 @@ struct qht {
  *         chain, excluding empty chains.
  * @occupancy: frequency distribution representing chain occupancy rate.
  *             Valid range: from 0.0 (empty) to 1.0 (full occupancy).
+ * @resize_pending: number of head buckets that a resize in progress has yet
+ *                  to move. Their entries are included in @entries.
+ * @lookup_retries: number of times a lookup was retried because it raced
+ *                  with a writer of the same bucket.
+ * @lock_contended: number of times a writer found its bucket lock taken.
+ * @contention: frequency distribution representing the sum of lookup retries
+ *              and contended locks of each head bucket, excluding buckets
+ *              that saw neither.
  *
  * An entry is a pointer-hash pair.
  * Each bucket can host several entries.
  * Chains are chains of buckets, whose first link is always a head bucket.
+ * Contention counters restart from zero whenever the hash table is resized.
  */
 struct qht_stats {
     size_t head_buckets;
@@ -40,6 +49,10 @@ struct qht_stats {
     size_t entries;
     struct qdist chain;
     struct qdist occupancy;
+    size_t resize_pending;
+    size_t lookup_retries;
+    size_t lock_contended;
+    struct qdist contention;
 };
 
 typedef bool (*qht_lookup_func_t)(const void *obj, const void *userp);
@@ -168,6 +181,10 @@ bool qht_reset_size(struct qht *ht, size_t n_elems);
  *
  * Returns true on success.
  * Returns false if the resize was not necessary and therefore not performed.
+ *
+ * Entries are moved into the resized hash table in the background of later
+ * updates, without blocking concurrent lookups or updates; a resize that is
+ * still in progress is completed first.
  * See also: qht_reset_size().
  */
 bool qht_resize(struct qht *ht, size_t n_elems);
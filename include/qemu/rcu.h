@@ -61,6 +61,15 @@ struct rcu_reader_data {
 
     /* Data used by reader only */
     unsigned depth;
+    bool registered;
+
+    /*
+     * Callbacks queued by call_rcu1() on this thread, newest first.  Pushed
+     * by the thread itself, taken all at once by the call_rcu thread.
+     */
+    struct rcu_head *cb_top;
+    unsigned long cb_count;
+    int64_t cb_since;
 
     /* Data used for registry, protected by rcu_registry_lock */
     QLIST_ENTRY(rcu_reader_data) node;
@@ -143,6 +152,22 @@ struct rcu_head {
 void call_rcu1(struct rcu_head *head, RCUCBFunc *func);
 void drain_call_rcu(void);
 
+/*
+ * Statistics of the call_rcu thread.  Latencies are measured from the time
+ * the oldest callback of a batch was queued to the time the batch ran.
+ */
+typedef struct RCUCallStats {
+    uint64_t batches;
+    uint64_t expedited_batches;
+    uint64_t callbacks;
+    unsigned long pending;
+    unsigned long max_batch;
+    int64_t last_latency_ns;
+    int64_t max_latency_ns;
+} RCUCallStats;
+
+void rcu_call_stats(RCUCallStats *stats);
+
 /* The operands of the minus operator must have the same type,
  * which must be the one that we specify in the cast.
  */
@@ -158,6 +158,12 @@ bool throttle_schedule_timer(ThrottleState *ts,
 
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size);
+
+bool throttle_reserve(ThrottleState *ts, QEMUClockType clock_type,
+                      ThrottleDirection direction, int64_t ns,
+                      intptr_t *bytes, intptr_t *ops);
+void throttle_unreserve(ThrottleState *ts, ThrottleDirection direction,
+                        intptr_t bytes, intptr_t ops);
 void throttle_limits_to_config(ThrottleLimits *arg, ThrottleConfig *cfg,
                                Error **errp);
 void throttle_config_to_limits(ThrottleConfig *cfg, ThrottleLimits *var);
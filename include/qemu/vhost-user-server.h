@@ -31,7 +31,9 @@ typedef struct VuFdWatch {
  * VuServer:
  * A vhost-user server instance with user-defined VuDevIface callbacks.
  * Vhost-user device backends can be implemented using VuServer. VuDevIface
- * callbacks and virtqueue kicks run in the given AioContext.
+ * callbacks and virtqueue kicks run in the given AioContext, unless the
+ * virtqueues are spread over other AioContexts with
+ * vhost_user_server_set_queue_aio_contexts().
  */
 typedef struct {
     QIONetListener *listener;
@@ -42,6 +44,16 @@ typedef struct {
 
     unsigned int in_flight; /* atomic */
 
+    /*
+     * Virtqueue i is processed in queue_ctxs[i % nr_queue_ctxs], if any.
+     * While a vhost-user message is handled, the virtqueues are paused.
+     */
+    AioContext **queue_ctxs;
+    unsigned int nr_queue_ctxs;
+    bool queues_paused;
+    unsigned int pause_bhs; /* atomic */
+    Coroutine *idle_waiter; /* atomic */
+
     /* Protected by ctx lock */
     bool in_qio_channel_yield;
     bool wait_idle;
@@ -63,6 +75,10 @@ bool vhost_user_server_start(VuServer *server,
 
 void vhost_user_server_stop(VuServer *server);
 
+void vhost_user_server_set_queue_aio_contexts(VuServer *server,
+                                              AioContext **ctxs,
+                                              unsigned int nr_ctxs);
+
 void vhost_user_server_inc_in_flight(VuServer *server);
 void vhost_user_server_dec_in_flight(VuServer *server);
 bool vhost_user_server_has_in_flight(VuServer *server);
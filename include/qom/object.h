@@ -159,6 +159,8 @@ struct Object
     GHashTable *properties;
     uint32_t ref;
     Object *parent;
+    /* Name of the child<> property of @parent that holds this object */
+    const char *child_name;
 };
 
 /**
@@ -20,6 +20,9 @@ void vcpu_dirty_rate_stat_stop(void);
 void vcpu_dirty_rate_stat_initialize(void);
 void vcpu_dirty_rate_stat_finalize(void);
 
+/* Entries of each per-vCPU dirty ring, or 0 if the accelerator has none */
+uint32_t vcpu_dirty_ring_size(void);
+
 void dirtylimit_state_lock(void);
 void dirtylimit_state_unlock(void);
 void dirtylimit_state_initialize(void);
@@ -33,6 +36,7 @@ void dirtylimit_set_vcpu(int cpu_index,
                          bool enable);
 void dirtylimit_set_all(uint64_t quota,
                         bool enable);
+void dirtylimit_set_fair_share(uint64_t quota, uint64_t min_quota);
 void dirtylimit_vcpu_execute(CPUState *cpu);
 uint64_t dirtylimit_throttle_time_per_round(void);
 uint64_t dirtylimit_ring_full_time(void);
@@ -236,6 +236,70 @@ static inline void dma_memory_unmap(AddressSpace *as,
                         dir == DMA_DIRECTION_FROM_DEVICE, access_len);
 }
 
+/**
+ * DMACache: cached DMA access to a fixed guest structure
+ *
+ * Devices that repeatedly access the same guest ring or table through
+ * dma_memory_read() and dma_memory_write() pay for a FlatView lookup on
+ * every access.  A #DMACache keeps a #MemoryRegionCache for the range
+ * [@addr, @addr + @len) and rebuilds it whenever the memory map of the
+ * address space changes, the same way virtio caches its vrings.
+ *
+ * Accesses outside the cached range, or to a range that could not be
+ * cached, fall back to dma_memory_read() and dma_memory_write().  All
+ * accesses use %MEMTXATTRS_UNSPECIFIED.
+ */
+typedef struct DMACache DMACache;
+
+/**
+ * dma_cache_new: Create a #DMACache.  Must be called with the BQL held.
+ *
+ * @as: #AddressSpace to be accessed
+ * @addr: start of the cached range within that address space
+ * @len: length of the cached range
+ * @dir: %DMA_DIRECTION_FROM_DEVICE if the range is written by the device
+ */
+DMACache *dma_cache_new(AddressSpace *as, dma_addr_t addr, dma_addr_t len,
+                        DMADirection dir);
+
+/**
+ * dma_cache_free: Free a #DMACache.  Must be called with the BQL held.
+ *
+ * The memory is only released after an RCU grace period, so accesses
+ * concurrent with dma_cache_free() are safe if the caller fetched @cache
+ * with qatomic_rcu_read() within an RCU critical section.
+ *
+ * @cache: #DMACache to be freed, or %NULL
+ */
+void dma_cache_free(DMACache *cache);
+
+/**
+ * dma_cache_read: Read from a guest structure through a #DMACache.
+ *
+ * Same semantics as dma_memory_read().
+ *
+ * @cache: #DMACache covering the structure
+ * @addr: address within the address space of @cache
+ * @buf: buffer with the data transferred
+ * @len: length of the data transferred
+ */
+MemTxResult dma_cache_read(DMACache *cache, dma_addr_t addr,
+                           void *buf, dma_addr_t len);
+
+/**
+ * dma_cache_write: Write to a guest structure through a #DMACache.
+ *
+ * Same semantics as dma_memory_write().  @cache must have been created
+ * with %DMA_DIRECTION_FROM_DEVICE.
+ *
+ * @cache: #DMACache covering the structure
+ * @addr: address within the address space of @cache
+ * @buf: buffer with the data transferred
+ * @len: length of the data transferred
+ */
+MemTxResult dma_cache_write(DMACache *cache, dma_addr_t addr,
+                            const void *buf, dma_addr_t len);
+
 #define DEFINE_LDST_DMA(_lname, _sname, _bits, _end) \
     static inline MemTxResult ld##_lname##_##_end##_dma(AddressSpace *as, \
                                                         dma_addr_t addr, \
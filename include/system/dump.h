@@ -160,6 +160,7 @@ typedef struct DumpState {
     bool kdump_raw;
     hwaddr memory_offset;
     int fd;
+    bool sparse;                /* skip zero pages with holes in fd */
 
     /*
      * Dump filter area variables
@@ -16,6 +16,7 @@
 
 #include "block/aio.h"
 #include "qemu/thread.h"
+#include "qemu/thread-context.h"
 #include "qom/object.h"
 #include "system/event-loop-base.h"
 
@@ -33,6 +34,8 @@ struct IOThread {
     bool stopping;              /* has iothread_stop() been called? */
     bool running;               /* should iothread_run() continue? */
     int thread_id;
+    /* Context in which the thread is created, to inherit its CPU affinity */
+    ThreadContext *thread_context;
 
     /* AioContext poll parameters */
     int64_t poll_max_ns;
@@ -44,6 +44,8 @@ typedef struct NodeInfo {
     uint8_t lb_info_provided;
     uint16_t initiator;
     uint8_t distance[MAX_NODES];
+    /* vCPU threads of the node get the CPU affinity of this context */
+    struct ThreadContext *thread_context;
 } NodeInfo;
 
 typedef struct NumaNodeMem {
@@ -108,6 +110,11 @@ void query_numa_node_mem(NumaNodeMem node_mem[], MachineState *ms);
 extern QemuOptsList qemu_numa_opts;
 void numa_cpu_pre_plug(const struct CPUArchId *slot, DeviceState *dev,
                        Error **errp);
+/*
+ * Give the thread of @cpu the CPU affinity of the thread context of its
+ * NUMA node, if the node has one.
+ */
+void numa_cpu_set_thread_affinity(MachineState *ms, CPUState *cpu);
 bool numa_uses_legacy_mem(void);
 
 #endif
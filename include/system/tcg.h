@@ -13,8 +13,12 @@
 #ifdef CONFIG_TCG
 extern bool tcg_allowed;
 #define tcg_enabled() (tcg_allowed)
+
+/* Entries of each per-vCPU dirty ring, or 0 if dirty rings are disabled. */
+extern uint32_t tcg_dirty_ring_size;
 #else
 #define tcg_enabled() 0
+#define tcg_dirty_ring_size 0
 #endif
 
 #endif
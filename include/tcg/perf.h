@@ -14,6 +14,13 @@ void perf_enable_perfmap(void);
 /* Start writing jit-<pid>.dump. */
 void perf_enable_jitdump(void);
 
+/*
+ * Move symbol lookups and writes for JITted code to a background thread.
+ * The thread does not survive fork(), so only system emulation uses it,
+ * and only starts it once it has daemonized.
+ */
+void perf_start_writer(void);
+
 /* Add information about TCG prologue to profiler maps. */
 void perf_report_prologue(const void *start, size_t size);
 
@@ -32,6 +39,10 @@ static inline void perf_enable_jitdump(void)
 {
 }
 
+static inline void perf_start_writer(void)
+{
+}
+
 static inline void perf_report_prologue(const void *start, size_t size)
 {
 }
@@ -34,6 +34,21 @@ int page_get_flags(target_ulong address);
  */
 void page_set_flags(target_ulong start, target_ulong last, int flags);
 
+/**
+ * page_set_host_writable:
+ * @start: first byte of range, host page aligned
+ * @last: last byte of range, host page aligned
+ * @host_prot: host protection to apply, including PROT_WRITE
+ * Context: holding mmap lock
+ *
+ * Apply @host_prot to the host pages of [@start, @last] after
+ * page_set_flags() made the range writable, except to the host pages
+ * that it kept read-only because they hold translated code.
+ * Return 0 on success, or -1 with errno set if mprotect() fails.
+ */
+int page_set_host_writable(target_ulong start, target_ulong last,
+                           int host_prot);
+
 void page_reset_target_data(target_ulong start, target_ulong last);
 
 /**
@@ -60,6 +75,17 @@ bool page_check_range(target_ulong start, target_ulong last, int flags);
  */
 bool page_check_range_empty(target_ulong start, target_ulong last);
 
+/**
+ * page_check_range_any:
+ * @start: first byte of range
+ * @last: last byte of range
+ * @flags: flags to look for
+ * Context: holding mmap lock
+ *
+ * Return true if any page in [@start, @last] has any of @flags set.
+ */
+bool page_check_range_any(target_ulong start, target_ulong last, int flags);
+
 /**
  * page_find_range_empty
  * @min: first byte of search range
@@ -207,11 +207,18 @@ static void iothread_init(EventLoopBase *base, Error **errp)
         return;
     }
 
-    /* This assumes we are called from a thread with useful CPU affinity for us
-     * to inherit.
+    /* Without a thread context, this assumes we are called from a thread
+     * with useful CPU affinity for us to inherit.
      */
-    qemu_thread_create(&iothread->thread, thread_name, iothread_run,
-                       iothread, QEMU_THREAD_JOINABLE);
+    if (iothread->thread_context) {
+        thread_context_create_thread(iothread->thread_context,
+                                     &iothread->thread, thread_name,
+                                     iothread_run, iothread,
+                                     QEMU_THREAD_JOINABLE);
+    } else {
+        qemu_thread_create(&iothread->thread, thread_name, iothread_run,
+                           iothread, QEMU_THREAD_JOINABLE);
+    }
 
     /* Wait for initialization to complete */
     while (iothread->thread_id == -1) {
@@ -311,6 +318,13 @@ static void iothread_class_init(ObjectClass *klass, void *class_data)
                               iothread_get_poll_param,
                               iothread_set_poll_param,
                               NULL, &poll_shrink_info);
+    object_class_property_add_link(klass, "thread-context",
+                                   TYPE_THREAD_CONTEXT,
+                                   offsetof(IOThread, thread_context),
+                                   object_property_allow_set_link,
+                                   OBJ_PROP_LINK_STRONG);
+    object_class_property_set_description(klass, "thread-context",
+        "Context to use for creating the thread");
 }
 
 static const TypeInfo iothread_info = {
@@ -339,9 +353,24 @@ AioContext *iothread_get_aio_context(IOThread *iothread)
     return iothread->ctx;
 }
 
+static void query_one_poll_handler(int fd, const AioPolledEvent *poll,
+                                   void *opaque)
+{
+    IOThreadPollHandlerInfoList ***tail = opaque;
+    IOThreadPollHandlerInfo *info = g_new0(IOThreadPollHandlerInfo, 1);
+
+    info->fd = fd;
+    info->poll_ns = poll->ns;
+    info->poll_hits = poll->hits;
+    info->poll_misses = poll->misses;
+    info->event_ns = poll->event_ns;
+    QAPI_LIST_APPEND(*tail, info);
+}
+
 static int query_one_iothread(Object *object, void *opaque)
 {
     IOThreadInfoList ***tail = opaque;
+    IOThreadPollHandlerInfoList **handlers_tail;
     IOThreadInfo *info;
     IOThread *iothread;
 
@@ -358,6 +387,12 @@ static int query_one_iothread(Object *object, void *opaque)
     info->poll_shrink = iothread->poll_shrink;
     info->aio_max_batch = iothread->parent_obj.aio_max_batch;
 
+    handlers_tail = &info->poll_handlers;
+    if (iothread->ctx) {
+        aio_context_foreach_poll_handler(iothread->ctx, query_one_poll_handler,
+                                         &handlers_tail);
+    }
+
     QAPI_LIST_APPEND(*tail, info);
     return 0;
 }
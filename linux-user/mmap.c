@@ -175,6 +175,7 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
     int prots[3];
     abi_ulong host_start, host_last, last;
     int prot1, ret, page_flags, nranges;
+    bool protect_code;
 
     trace_target_mprotect(start, len, target_prot);
 
@@ -255,15 +256,41 @@ int target_mprotect(abi_ulong start, abi_ulong len, int target_prot)
         }
     }
 
+    /*
+     * page_set_flags() keeps pages with translated code read-only when
+     * they become writable, so that the first write still faults into
+     * page_unprotect().  Until it has done so, do not let other threads
+     * write to pages that may hold translations.
+     */
+    protect_code = (target_prot & PROT_WRITE) &&
+                   page_check_range_any(start & -host_page_size,
+                                        ROUND_UP(last, host_page_size) - 1,
+                                        PAGE_EXEC);
+
     for (int i = 0; i < nranges; ++i) {
         ret = mprotect(g2h_untagged(starts[i]), lens[i],
-                       target_to_host_prot(prots[i]));
+                       target_to_host_prot(protect_code ?
+                                           prots[i] & ~PROT_WRITE :
+                                           prots[i]));
         if (ret != 0) {
             goto error;
         }
     }
 
     page_set_flags(start, last, page_flags);
+
+    if (protect_code) {
+        for (int i = 0; i < nranges; ++i) {
+            if (!(prots[i] & PROT_WRITE)) {
+                continue;
+            }
+            ret = page_set_host_writable(starts[i], starts[i] + lens[i] - 1,
+                                         target_to_host_prot(prots[i]));
+            if (ret != 0) {
+                goto error;
+            }
+        }
+    }
     ret = 0;
 
  error:
@@ -616,7 +643,12 @@ static abi_long mmap_h_eq_g(abi_ulong start, abi_ulong len,
 
     start = h2g(p);
     last = start + len - 1;
-    return mmap_end(start, last, start, last, flags, page_flags);
+
+    /* Nested within target_mmap__locked, except for the lockless case. */
+    mmap_lock();
+    mmap_end(start, last, start, last, flags, page_flags);
+    mmap_unlock();
+    return start;
 }
 
 /*
@@ -992,12 +1024,21 @@ abi_long target_mmap(abi_ulong start, abi_ulong len, int target_prot,
         }
     }
 
-    mmap_lock();
-
-    ret = target_mmap__locked(start, len, target_prot, flags,
-                              page_flags, fd, offset);
-
-    mmap_unlock();
+    if (!reserved_va && qemu_real_host_page_size() == TARGET_PAGE_SIZE &&
+        !(flags & (MAP_FIXED | MAP_FIXED_NOREPLACE))) {
+        /*
+         * The host kernel picks the address and no existing guest page
+         * is affected, so only recording the new mapping needs the lock.
+         * Multithreaded allocators can then mmap concurrently.
+         */
+        ret = mmap_h_eq_g(start, len, target_to_host_prot(target_prot),
+                          flags, page_flags, fd, offset);
+    } else {
+        mmap_lock();
+        ret = target_mmap__locked(start, len, target_prot, flags,
+                                  page_flags, fd, offset);
+        mmap_unlock();
+    }
 
     /*
      * If we're mapping shared memory, ensure we generate code for parallel
@@ -1244,21 +1285,26 @@ abi_long target_madvise(abi_ulong start, abi_ulong len_in, int advice)
      * otherwise. Completely implementing such emulation is quite complicated
      * though.
      */
-    mmap_lock();
     switch (advice) {
     case MADV_WIPEONFORK:
     case MADV_KEEPONFORK:
         ret = -EINVAL;
         /* fall through */
     case MADV_DONTNEED:
+        /*
+         * The host madvise may take a while to drop the pages; keep it
+         * out of the mmap_lock so that allocators purging memory do not
+         * serialize with other threads' mmap and translation.
+         */
         if (page_check_range(start, len, PAGE_PASSTHROUGH)) {
             ret = get_errno(madvise(g2h_untagged(start), len, advice));
             if ((advice == MADV_DONTNEED) && (ret == 0)) {
+                mmap_lock();
                 page_reset_target_data(start, start + len - 1);
+                mmap_unlock();
             }
         }
     }
-    mmap_unlock();
 
     return ret;
 }
@@ -0,0 +1,356 @@
+/*
+ * Synthetic RAM dirtier for migration benchmarks
+ *
+ * An x-migration-dirtier object writes to the pages of a memory backend
+ * from a thread of its own, at a fixed rate and in a fixed pattern, and
+ * marks them dirty like a guest write would be.  Migration then has a
+ * reproducible workload to converge against, without a guest kernel or
+ * stress program.  Like a guest, the dirtier only runs while the VM
+ * runs, so it stops before the downtime of precopy and of the switch
+ * to postcopy.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/module.h"
+#include "qemu/rcu.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "qapi/qapi-types-qom.h"
+#include "qapi/visitor.h"
+#include "qom/object_interfaces.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "system/hostmem.h"
+#include "system/runstate.h"
+#include "trace.h"
+
+#define TYPE_MIGRATION_DIRTIER "x-migration-dirtier"
+OBJECT_DECLARE_SIMPLE_TYPE(MigrationDirtier, MIGRATION_DIRTIER)
+
+/* The rate is enforced in slices of this length */
+#define DIRTIER_SLICE_NS (10 * SCALE_MS)
+/* Pages dirtied between checks of the clock without a rate limit */
+#define DIRTIER_UNLIMITED_PAGES 4096
+
+struct MigrationDirtier {
+    Object parent_obj;
+
+    HostMemoryBackend *memdev;
+    /* In MB/s, 0 for no limit */
+    uint64_t dirty_rate;
+    MigrationDirtierPattern pattern;
+    uint64_t working_set;
+
+    bool started;
+    QemuThread thread;
+    VMChangeStateEntry *vmstate;
+
+    /* @running, @paused and @quit are protected by @lock */
+    QemuMutex lock;
+    QemuCond cond;
+    bool running;
+    bool paused;
+    bool quit;
+
+    /* Owned by the thread */
+    uint8_t *host;
+    uint64_t next;
+    uint64_t seed;
+    uint64_t credit;
+    uint64_t dirtied_pages;
+};
+
+static uint64_t dirtier_random(MigrationDirtier *d)
+{
+    /* xorshift64 */
+    d->seed ^= d->seed << 13;
+    d->seed ^= d->seed >> 7;
+    d->seed ^= d->seed << 17;
+    return d->seed;
+}
+
+static void dirtier_run_slice(MigrationDirtier *d)
+{
+    MemoryRegion *mr = host_memory_backend_get_memory(d->memdev);
+    uint64_t page_size = qemu_target_page_size();
+    uint64_t rate = qatomic_read(&d->dirty_rate);
+    uint64_t pages, offset, i;
+
+    if (rate) {
+        d->credit += rate * MiB * DIRTIER_SLICE_NS / NANOSECONDS_PER_SECOND;
+        pages = d->credit / page_size;
+        d->credit -= pages * page_size;
+    } else {
+        pages = DIRTIER_UNLIMITED_PAGES;
+    }
+
+    for (i = 0; i < pages && qatomic_read(&d->running); i++) {
+        if (qatomic_read(&d->pattern) == MIGRATION_DIRTIER_PATTERN_RANDOM) {
+            offset = dirtier_random(d) % (d->working_set / page_size) *
+                     page_size;
+        } else {
+            offset = d->next;
+            d->next = (d->next + page_size) % d->working_set;
+        }
+        (*(uint64_t *)(d->host + offset))++;
+        memory_region_set_dirty(mr, offset, page_size);
+    }
+    qatomic_set(&d->dirtied_pages, d->dirtied_pages + i);
+}
+
+static void *dirtier_thread(void *opaque)
+{
+    MigrationDirtier *d = opaque;
+    int64_t slice_end = 0, now;
+
+    rcu_register_thread();
+
+    qemu_mutex_lock(&d->lock);
+    while (!d->quit) {
+        if (!d->running) {
+            d->paused = true;
+            qemu_cond_broadcast(&d->cond);
+            qemu_cond_wait(&d->cond, &d->lock);
+            d->paused = false;
+            slice_end = get_clock();
+            continue;
+        }
+
+        now = get_clock();
+        if (now < slice_end) {
+            qemu_cond_timedwait(&d->cond, &d->lock,
+                                DIV_ROUND_UP(slice_end - now, SCALE_MS));
+            continue;
+        }
+        /* Do not catch up on a backlog in a burst */
+        slice_end = MAX(slice_end, now - DIRTIER_SLICE_NS);
+
+        qemu_mutex_unlock(&d->lock);
+        dirtier_run_slice(d);
+        qemu_mutex_lock(&d->lock);
+
+        if (qatomic_read(&d->dirty_rate)) {
+            slice_end += DIRTIER_SLICE_NS;
+        }
+    }
+    d->paused = true;
+    qemu_cond_broadcast(&d->cond);
+    qemu_mutex_unlock(&d->lock);
+
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static void dirtier_set_running(MigrationDirtier *d, bool running)
+{
+    qemu_mutex_lock(&d->lock);
+    qatomic_set(&d->running, running);
+    qemu_cond_broadcast(&d->cond);
+    /* Once the VM is stopped, its RAM must not change anymore */
+    while (!running && !d->paused) {
+        qemu_cond_wait(&d->cond, &d->lock);
+    }
+    qemu_mutex_unlock(&d->lock);
+}
+
+static void dirtier_vm_state_change(void *opaque, bool running,
+                                    RunState state)
+{
+    MigrationDirtier *d = opaque;
+
+    if (running && !host_memory_backend_is_mapped(d->memdev)) {
+        warn_report_once("x-migration-dirtier: memory backend '%s' is not "
+                         "used by the VM, not dirtying it",
+                         object_get_canonical_path_component(
+                             OBJECT(d->memdev)));
+        return;
+    }
+    trace_migration_dirtier_state(running, qatomic_read(&d->dirtied_pages));
+    dirtier_set_running(d, running);
+}
+
+static void dirtier_complete(UserCreatable *uc, Error **errp)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(uc);
+    MemoryRegion *mr;
+    uint64_t page_size = qemu_target_page_size();
+
+    if (!d->memdev) {
+        error_setg(errp, "property 'memdev' is required");
+        return;
+    }
+
+    mr = host_memory_backend_get_memory(d->memdev);
+    if (!d->working_set) {
+        d->working_set = memory_region_size(mr);
+    }
+    d->working_set = QEMU_ALIGN_DOWN(d->working_set, page_size);
+    if (!d->working_set || d->working_set > memory_region_size(mr)) {
+        error_setg(errp, "property 'working-set' must be at least a page and "
+                   "at most the size of the memory backend");
+        return;
+    }
+
+    d->host = memory_region_get_ram_ptr(mr);
+    d->seed = 0x9e3779b97f4a7c15ULL;
+    d->started = true;
+    qemu_thread_create(&d->thread, "dirtier", dirtier_thread, d,
+                       QEMU_THREAD_JOINABLE);
+    d->vmstate = qemu_add_vm_change_state_handler(dirtier_vm_state_change, d);
+    if (runstate_is_running()) {
+        dirtier_vm_state_change(d, true, RUN_STATE_RUNNING);
+    }
+}
+
+static void dirtier_get_dirty_rate(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+    uint64_t value = qatomic_read(&d->dirty_rate);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void dirtier_set_dirty_rate(Object *obj, Visitor *v, const char *name,
+                                   void *opaque, Error **errp)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+    uint64_t value;
+
+    if (!visit_type_uint64(v, name, &value, errp)) {
+        return;
+    }
+    qatomic_set(&d->dirty_rate, value);
+}
+
+static int dirtier_get_pattern(Object *obj, Error **errp)
+{
+    return qatomic_read(&MIGRATION_DIRTIER(obj)->pattern);
+}
+
+static void dirtier_set_pattern(Object *obj, int value, Error **errp)
+{
+    qatomic_set(&MIGRATION_DIRTIER(obj)->pattern, value);
+}
+
+static void dirtier_get_working_set(Object *obj, Visitor *v, const char *name,
+                                    void *opaque, Error **errp)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+
+    visit_type_size(v, name, &d->working_set, errp);
+}
+
+static void dirtier_set_working_set(Object *obj, Visitor *v, const char *name,
+                                    void *opaque, Error **errp)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+    uint64_t value;
+
+    if (d->started) {
+        error_setg(errp, "cannot change property '%s' of %s", name,
+                   object_get_typename(obj));
+        return;
+    }
+    if (!visit_type_size(v, name, &value, errp)) {
+        return;
+    }
+    d->working_set = value;
+}
+
+static void dirtier_get_dirtied_pages(Object *obj, Visitor *v,
+                                      const char *name, void *opaque,
+                                      Error **errp)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+    uint64_t value = qatomic_read(&d->dirtied_pages);
+
+    visit_type_uint64(v, name, &value, errp);
+}
+
+static void dirtier_check_memdev(const Object *obj, const char *name,
+                                 Object *val, Error **errp)
+{
+    if (MIGRATION_DIRTIER(obj)->started) {
+        error_setg(errp, "cannot change property '%s' of %s", name,
+                   object_get_typename(OBJECT(obj)));
+    }
+}
+
+static void dirtier_class_init(ObjectClass *oc, void *data)
+{
+    UserCreatableClass *ucc = USER_CREATABLE_CLASS(oc);
+
+    ucc->complete = dirtier_complete;
+
+    object_class_property_add_link(oc, "memdev", TYPE_MEMORY_BACKEND,
+                                   offsetof(MigrationDirtier, memdev),
+                                   dirtier_check_memdev,
+                                   OBJ_PROP_LINK_STRONG);
+    object_class_property_set_description(oc, "memdev",
+        "Memory backend to dirty");
+    object_class_property_add(oc, "dirty-rate", "uint64",
+                              dirtier_get_dirty_rate,
+                              dirtier_set_dirty_rate, NULL, NULL);
+    object_class_property_set_description(oc, "dirty-rate",
+        "Dirty rate in MB/s, 0 for no limit");
+    object_class_property_add_enum(oc, "pattern", "MigrationDirtierPattern",
+                                   &MigrationDirtierPattern_lookup,
+                                   dirtier_get_pattern, dirtier_set_pattern);
+    object_class_property_set_description(oc, "pattern",
+        "Order in which the pages are dirtied");
+    object_class_property_add(oc, "working-set", "size",
+                              dirtier_get_working_set,
+                              dirtier_set_working_set, NULL, NULL);
+    object_class_property_set_description(oc, "working-set",
+        "Size of the dirtied part of the memory backend");
+    object_class_property_add(oc, "dirtied-pages", "uint64",
+                              dirtier_get_dirtied_pages, NULL, NULL, NULL);
+}
+
+static void dirtier_instance_init(Object *obj)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+
+    qemu_mutex_init(&d->lock);
+    qemu_cond_init(&d->cond);
+}
+
+static void dirtier_instance_finalize(Object *obj)
+{
+    MigrationDirtier *d = MIGRATION_DIRTIER(obj);
+
+    if (d->started) {
+        qemu_del_vm_change_state_handler(d->vmstate);
+        qemu_mutex_lock(&d->lock);
+        d->quit = true;
+        qemu_cond_broadcast(&d->cond);
+        qemu_mutex_unlock(&d->lock);
+        qemu_thread_join(&d->thread);
+    }
+    qemu_cond_destroy(&d->cond);
+    qemu_mutex_destroy(&d->lock);
+}
+
+static const TypeInfo dirtier_info = {
+    .name = TYPE_MIGRATION_DIRTIER,
+    .parent = TYPE_OBJECT,
+    .class_init = dirtier_class_init,
+    .instance_size = sizeof(MigrationDirtier),
+    .instance_init = dirtier_instance_init,
+    .instance_finalize = dirtier_instance_finalize,
+    .interfaces = (InterfaceInfo[]) {
+        { TYPE_USER_CREATABLE },
+        { }
+    }
+};
+
+static void dirtier_register_types(void)
+{
+    type_register_static(&dirtier_info);
+}
+type_init(dirtier_register_types)
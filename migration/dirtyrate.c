@@ -12,6 +12,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/error-report.h"
+#include "block/thread-pool.h"
 #include "hw/core/cpu.h"
 #include "qapi/error.h"
 #include "exec/ramblock.h"
@@ -25,7 +26,7 @@
 #include "monitor/hmp.h"
 #include "monitor/monitor.h"
 #include "qobject/qdict.h"
-#include "system/kvm.h"
+#include "system/dirtylimit.h"
 #include "system/runstate.h"
 #include "exec/memory.h"
 #include "qemu/xxhash.h"
@@ -394,6 +395,80 @@ static uint32_t get_ramblock_vfn_hash(struct RamblockDirtyInfo *info,
     return hash;
 }
 
+/* Number of sampled pages hashed by one job of the hashing thread pool. */
+#define DIRTYRATE_HASH_BATCH 4096
+
+typedef struct DirtyRateHashJob {
+    struct RamblockDirtyInfo *info;
+    uint64_t start;
+    uint64_t end;
+    bool compare;
+    uint64_t dirty_count;
+} DirtyRateHashJob;
+
+static int dirtyrate_hash_job(void *opaque)
+{
+    DirtyRateHashJob *job = opaque;
+    struct RamblockDirtyInfo *info = job->info;
+    uint32_t hash;
+    uint64_t i;
+
+    for (i = job->start; i < job->end; i++) {
+        hash = get_ramblock_vfn_hash(info, info->sample_page_vfn[i]);
+        if (!job->compare) {
+            info->hash_result[i] = hash;
+        } else if (hash != info->hash_result[i]) {
+            trace_calc_page_dirty_rate(info->idstr, hash, info->hash_result[i]);
+            job->dirty_count++;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Hash the sampled pages of the @count blocks in @infos, in batches spread
+ * over one worker thread per host CPU.  Without @compare, the hashes are
+ * saved in the hash_result array of each block; with @compare, the pages
+ * whose hash changed since then are added to its sample_dirty_count.
+ *
+ * The caller must hold the RCU read lock, which covers the workers too
+ * since this waits for them.
+ */
+static void dirtyrate_hash_blocks(struct RamblockDirtyInfo **infos, int count,
+                                  bool compare)
+{
+    g_autoptr(GPtrArray) jobs = g_ptr_array_new_with_free_func(g_free);
+    ThreadPool *pool = thread_pool_new();
+    int i;
+
+    thread_pool_set_max_threads(pool, g_get_num_processors());
+    for (i = 0; i < count; i++) {
+        struct RamblockDirtyInfo *info = infos[i];
+        uint64_t start;
+
+        for (start = 0; start < info->sample_pages_count;
+             start += DIRTYRATE_HASH_BATCH) {
+            DirtyRateHashJob *job = g_new0(DirtyRateHashJob, 1);
+
+            job->info = info;
+            job->start = start;
+            job->end = MIN(start + DIRTYRATE_HASH_BATCH,
+                           info->sample_pages_count);
+            job->compare = compare;
+            g_ptr_array_add(jobs, job);
+            thread_pool_submit(pool, dirtyrate_hash_job, job, NULL);
+        }
+    }
+    thread_pool_wait(pool);
+    thread_pool_free(pool);
+
+    for (i = 0; i < jobs->len; i++) {
+        DirtyRateHashJob *job = g_ptr_array_index(jobs, i);
+
+        job->info->sample_dirty_count += job->dirty_count;
+    }
+}
+
 static bool save_ramblock_hash(struct RamblockDirtyInfo *info)
 {
     unsigned int sample_pages_count;
@@ -424,8 +499,6 @@ static bool save_ramblock_hash(struct RamblockDirtyInfo *info)
     for (i = 0; i < sample_pages_count; i++) {
         info->sample_page_vfn[i] = g_rand_int_range(rand, 0,
                                                     info->ramblock_pages - 1);
-        info->hash_result[i] = get_ramblock_vfn_hash(info,
-                                                     info->sample_page_vfn[i]);
     }
     g_rand_free(rand);
 
@@ -486,6 +559,7 @@ static bool record_ramblock_hash_info(struct RamblockDirtyInfo **block_dinfo,
 {
     struct RamblockDirtyInfo *info = NULL;
     struct RamblockDirtyInfo *dinfo = NULL;
+    g_autofree struct RamblockDirtyInfo **hashed = NULL;
     RAMBlock *block = NULL;
     int total_count = 0;
     int index = 0;
@@ -502,6 +576,7 @@ static bool record_ramblock_hash_info(struct RamblockDirtyInfo **block_dinfo,
     if (dinfo == NULL) {
         goto out;
     }
+    hashed = g_new0(struct RamblockDirtyInfo *, total_count);
 
     RAMBLOCK_FOREACH_MIGRATABLE(block) {
         if (skip_sample_ramblock(block)) {
@@ -515,8 +590,10 @@ static bool record_ramblock_hash_info(struct RamblockDirtyInfo **block_dinfo,
         if (!save_ramblock_hash(info)) {
             goto out;
         }
+        hashed[index] = info;
         index++;
     }
+    dirtyrate_hash_blocks(hashed, index, false);
     ret = true;
 
 out:
@@ -525,20 +602,6 @@ out:
     return ret;
 }
 
-static void calc_page_dirty_rate(struct RamblockDirtyInfo *info)
-{
-    uint32_t hash;
-    int i;
-
-    for (i = 0; i < info->sample_pages_count; i++) {
-        hash = get_ramblock_vfn_hash(info, info->sample_page_vfn[i]);
-        if (hash != info->hash_result[i]) {
-            trace_calc_page_dirty_rate(info->idstr, hash, info->hash_result[i]);
-            info->sample_dirty_count++;
-        }
-    }
-}
-
 static struct RamblockDirtyInfo *
 find_block_matched(RAMBlock *block, int count,
                   struct RamblockDirtyInfo *infos)
@@ -568,9 +631,13 @@ find_block_matched(RAMBlock *block, int count,
 static bool compare_page_hash_info(struct RamblockDirtyInfo *info,
                                   int block_count)
 {
+    g_autofree struct RamblockDirtyInfo **matched = NULL;
     struct RamblockDirtyInfo *block_dinfo = NULL;
     RAMBlock *block = NULL;
+    int matched_count = 0;
+    int i;
 
+    matched = g_new0(struct RamblockDirtyInfo *, block_count);
     RAMBLOCK_FOREACH_MIGRATABLE(block) {
         if (skip_sample_ramblock(block)) {
             continue;
@@ -579,8 +646,12 @@ static bool compare_page_hash_info(struct RamblockDirtyInfo *info,
         if (block_dinfo == NULL) {
             continue;
         }
-        calc_page_dirty_rate(block_dinfo);
-        update_dirtyrate_stat(block_dinfo);
+        matched[matched_count++] = block_dinfo;
+    }
+
+    dirtyrate_hash_blocks(matched, matched_count, true);
+    for (i = 0; i < matched_count; i++) {
+        update_dirtyrate_stat(matched[i]);
     }
 
     if (DirtyStat.page_sampling.total_sample_count == 0) {
@@ -807,13 +878,13 @@ void qmp_calc_dirty_rate(int64_t calc_time,
     }
 
     /*
-     * dirty ring mode only works when kvm dirty ring is enabled.
+     * dirty ring mode only works when kvm or tcg dirty ring is enabled.
      * on the contrary, dirty bitmap mode is not.
      */
     if (((mode == DIRTY_RATE_MEASURE_MODE_DIRTY_RING) &&
-        !kvm_dirty_ring_enabled()) ||
+        !vcpu_dirty_ring_size()) ||
         ((mode == DIRTY_RATE_MEASURE_MODE_DIRTY_BITMAP) &&
-         kvm_dirty_ring_enabled())) {
+         vcpu_dirty_ring_size())) {
         error_setg(errp, "mode %s is not enabled, use other method instead.",
                          DirtyRateMeasureMode_str(mode));
          return;
@@ -9,6 +9,7 @@
 #include "exec/ramblock.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
+#include "qemu/madvise.h"
 #include "qapi/error.h"
 #include "channel.h"
 #include "file.h"
@@ -25,6 +26,22 @@ static struct FileOutgoingArgs {
     char *fname;
 } outgoing_args;
 
+/*
+ * The file written by the last completed mapped-ram migration, whose
+ * contents are still described by the RAM dirty bitmaps.
+ */
+static struct FileOutgoingImage {
+    dev_t dev;
+    ino_t ino;
+    uint64_t offset;
+    /* The file holds a complete image that the bitmaps describe */
+    bool valid;
+    /* The current migration writes to the file */
+    bool active;
+    /* The current migration only updates the image already in the file */
+    bool updating;
+} outgoing_image;
+
 /* Remove the offset option from @filespec and return it in @offsetp. */
 
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp)
@@ -50,6 +67,25 @@ void file_cleanup_outgoing_migration(void)
     outgoing_args.fname = NULL;
 }
 
+bool file_outgoing_updates_image(void)
+{
+    return outgoing_image.updating;
+}
+
+bool file_outgoing_image_done(bool keep)
+{
+    outgoing_image.valid = outgoing_image.active && keep;
+    outgoing_image.active = false;
+    outgoing_image.updating = false;
+
+    return outgoing_image.valid;
+}
+
+void file_outgoing_image_invalidate(void)
+{
+    outgoing_image.valid = false;
+}
+
 static void file_enable_direct_io(int *flags)
 {
 #ifdef O_DIRECT
@@ -100,6 +136,7 @@ void file_start_outgoing_migration(MigrationState *s,
     g_autofree char *filename = g_strdup(file_args->filename);
     uint64_t offset = file_args->offset;
     QIOChannel *ioc;
+    struct stat st;
 
     trace_migration_file_outgoing(filename);
 
@@ -108,7 +145,27 @@ void file_start_outgoing_migration(MigrationState *s,
         return;
     }
 
-    if (ftruncate(fioc->fd, offset)) {
+    if (fstat(fioc->fd, &st)) {
+        error_setg_errno(errp, errno, "failed to stat migration file");
+        return;
+    }
+
+    /*
+     * Pages that were not dirtied since the previous migration to the
+     * same file are still in place, so only rewrite the dirty ones.
+     * The image is not valid anymore until this migration completes.
+     */
+    outgoing_image.updating = migrate_mapped_ram_incremental() &&
+        outgoing_image.valid && outgoing_image.dev == st.st_dev &&
+        outgoing_image.ino == st.st_ino && outgoing_image.offset == offset;
+    outgoing_image.dev = st.st_dev;
+    outgoing_image.ino = st.st_ino;
+    outgoing_image.offset = offset;
+    outgoing_image.valid = false;
+    outgoing_image.active = true;
+    trace_migration_file_outgoing_image(outgoing_image.updating);
+
+    if (!outgoing_image.updating && ftruncate(fioc->fd, offset)) {
         error_setg_errno(errp, errno,
                          "failed to truncate migration file to offset %" PRIx64,
                          offset);
@@ -266,3 +323,43 @@ int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp)
 
     return 0;
 }
+
+bool file_can_map_ramblock(QIOChannel *ioc)
+{
+#ifdef CONFIG_POSIX
+    return object_dynamic_cast(OBJECT(ioc), TYPE_QIO_CHANNEL_FILE);
+#else
+    return false;
+#endif
+}
+
+/*
+ * Replace @size bytes of the guest RAM of @block at @offset with a
+ * private mapping of the pages in the migration file.  The pages are
+ * read from the file when the guest first touches them, and copied
+ * when it first writes them.
+ */
+bool file_map_ramblock(QIOChannel *ioc, RAMBlock *block, ram_addr_t offset,
+                       size_t size, Error **errp)
+{
+#ifdef CONFIG_POSIX
+    void *host = block->host + offset;
+    void *addr;
+
+    addr = mmap(host, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+                QIO_CHANNEL_FILE(ioc)->fd, block->pages_offset + offset);
+    if (addr == MAP_FAILED) {
+        error_setg_errno(errp, errno, "(%s) failed to map page " RAM_ADDR_FMT
+                         " from file offset %" PRIx64, block->idstr, offset,
+                         block->pages_offset + offset);
+        return false;
+    }
+
+    /* Let the kernel read the pages ahead in the background */
+    qemu_madvise(host, size, QEMU_MADV_WILLNEED);
+    trace_migration_file_map_ramblock(block->idstr, offset, size);
+    return true;
+#else
+    g_assert_not_reached();
+#endif
+}
@@ -19,8 +19,14 @@ void file_start_outgoing_migration(MigrationState *s,
                                    FileMigrationArgs *file_args, Error **errp);
 int file_parse_offset(char *filespec, uint64_t *offsetp, Error **errp);
 void file_cleanup_outgoing_migration(void);
+bool file_outgoing_updates_image(void);
+bool file_outgoing_image_done(bool keep);
+void file_outgoing_image_invalidate(void);
 bool file_send_channel_create(gpointer opaque, Error **errp);
 int file_write_ramblock_iov(QIOChannel *ioc, const struct iovec *iov,
                             int niov, MultiFDPages_t *pages, Error **errp);
 int multifd_file_recv_data(MultiFDRecvParams *p, Error **errp);
+bool file_can_map_ramblock(QIOChannel *ioc);
+bool file_map_ramblock(QIOChannel *ioc, RAMBlock *block, ram_addr_t offset,
+                       size_t size, Error **errp);
 #endif
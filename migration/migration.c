@@ -512,17 +512,17 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
     return qemu_fflush(mis->to_src_file);
 }
 
-/* Request one page from the source VM at the given start address.
- *   rb: the RAMBlock to request the page in
+/* Request pages from the source VM at the given start address.
+ *   rb: the RAMBlock to request the pages in
  *   Start: Address offset within the RB
  *   Len: Length in bytes required - must be a multiple of pagesize
  */
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start)
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len)
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
@@ -582,7 +582,8 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis,
         return 0;
     }
 
-    return migrate_send_rp_message_req_pages(mis, rb, start);
+    return migrate_send_rp_message_req_pages(mis, rb, start,
+                                             qemu_ram_pagesize(rb));
 }
 
 static bool migration_colo_enabled;
@@ -1054,12 +1055,18 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
     } else {
         /* Multiple connections */
         assert(migration_needs_multiple_sockets());
-        if (migrate_multifd()) {
+        if (migrate_multifd() && !multifd_recv_all_channels_created()) {
             multifd_recv_new_channel(ioc, &local_err);
         } else {
+            /*
+             * With multifd, the source only connects the preempt channel
+             * when postcopy starts, after all multifd channels.
+             */
             assert(migrate_postcopy_preempt());
             f = qemu_file_new_input(ioc);
             postcopy_preempt_new_channel(mis, f);
+            /* It never starts the incoming migration by itself */
+            return;
         }
         if (local_err) {
             error_propagate(errp, local_err);
@@ -1763,6 +1770,7 @@ int migrate_init(MigrationState *s, Error **errp)
     s->expected_downtime = 0;
     s->setup_time = 0;
     s->start_postcopy = false;
+    s->postcopy_multifd_ready = false;
     s->migration_thread_running = false;
     error_free(s->error);
     s->error = NULL;
@@ -2531,6 +2539,14 @@ static void *source_return_path_thread(void *opaque)
             tmp32 = ldl_be_p(buf);
             trace_source_return_path_thread_pong(tmp32);
             qemu_sem_post(&ms->rp_state.rp_pong_acks);
+            /*
+             * PING 3 is in the postcopy package after LISTEN, so its
+             * PONG means that the destination armed its userfaults and
+             * can place pages arriving on the multifd channels.
+             */
+            if (tmp32 == 3 && multifd_ram_postcopy_supported()) {
+                qatomic_set(&ms->postcopy_multifd_ready, true);
+            }
             break;
 
         case MIG_RP_MSG_REQ_PAGES:
@@ -2738,6 +2754,11 @@ static int postcopy_start(MigrationState *ms, Error **errp)
      * that are dirty
      */
     if (migrate_postcopy_ram()) {
+        qatomic_set(&ms->postcopy_multifd_ready, false);
+        if (multifd_ram_postcopy_sync()) {
+            error_setg(errp, "%s: Failed to sync multifd channels", __func__);
+            goto fail;
+        }
         ram_postcopy_send_discard_bitmap(ms);
     }
 
@@ -2775,6 +2796,7 @@ static int postcopy_start(MigrationState *ms, Error **errp)
     }
 
     if (migrate_postcopy_ram()) {
+        /* Its PONG also enables multifd for postcopy, see rp thread */
         qemu_savevm_send_ping(fb, 3);
     }
 
@@ -3159,6 +3181,13 @@ static MigThrError postcopy_pause(MigrationState *s)
 {
     assert(s->state == MIGRATION_STATUS_POSTCOPY_ACTIVE);
 
+    /*
+     * The multifd channels cannot be recovered, use the main channel from
+     * now on.  Pages lost on them are resent after the received bitmap is
+     * synchronized on resume.
+     */
+    qatomic_set(&s->postcopy_multifd_ready, false);
+
     while (true) {
         QEMUFile *file;
 
@@ -198,6 +198,14 @@ struct MigrationIncomingState {
      * */
     struct PostcopyBlocktimeContext *blocktime_ctx;
 
+    /*
+     * Per-vCPU fault streams used by the fault thread to prefetch pages,
+     * see "x-postcopy-prefetch-pages".  The last entry is shared by all
+     * faulting threads that are not vCPUs.
+     */
+    struct PostcopyFaultStream *fault_streams;
+    unsigned int fault_streams_nr;
+
     /* notify PAUSED postcopy incoming migrations to try to continue */
     QemuSemaphore postcopy_pause_sem_dst;
     QemuSemaphore postcopy_pause_sem_fault;
@@ -287,6 +295,12 @@ struct MigrationState {
      * main thread, and we keep post() and wait() in pair.
      */
     QemuSemaphore postcopy_qemufile_src_sem;
+    /*
+     * Set by the return path thread when the destination acknowledged the
+     * postcopy package, from then on background pages of postcopy go to
+     * the multifd channels.  Cleared for good if postcopy is paused.
+     */
+    bool postcopy_multifd_ready;
     QIOChannelBuffer *bioc;
     /*
      * Protects to_dst_file/from_dst_file pointers.  We need to make sure we
@@ -493,6 +507,28 @@ struct MigrationState {
      */
     uint8_t clear_bitmap_shift;
 
+    /*
+     * On the destination, when a vCPU keeps faulting on pages at a fixed
+     * stride during postcopy, request this many host pages ahead of the
+     * fault along with it.  Zero disables prefetching.
+     */
+    uint32_t postcopy_prefetch_pages;
+
+    /*
+     * Number of worker threads saving the device states that have
+     * parallel_save set at the end of precopy.  Zero saves all of them
+     * from the migration thread.
+     */
+    uint32_t vmstate_save_threads;
+
+    /*
+     * With the dirty-limit capability, share the dirty page rate allowed
+     * by throttle-trigger-threshold among the vCPUs so that only those
+     * dirtying the most pages are limited, instead of giving all of them
+     * the same vcpu-dirty-limit.
+     */
+    bool vcpu_dirty_limit_adaptive;
+
     /*
      * This save hostname when out-going migration starts
      */
@@ -548,7 +584,8 @@ void migrate_send_rp_pong(MigrationIncomingState *mis,
 int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
                               ram_addr_t start, uint64_t haddr);
 int migrate_send_rp_message_req_pages(MigrationIncomingState *mis,
-                                      RAMBlock *rb, ram_addr_t start);
+                                      RAMBlock *rb, ram_addr_t start,
+                                      size_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
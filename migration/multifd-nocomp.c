@@ -15,8 +15,10 @@
 #include "exec/target_page.h"
 #include "file.h"
 #include "migration-stats.h"
+#include "migration.h"
 #include "multifd.h"
 #include "options.h"
+#include "postcopy-ram.h"
 #include "qapi/error.h"
 #include "qemu/cutils.h"
 #include "qemu/error-report.h"
@@ -130,6 +132,9 @@ static int multifd_nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
 
     multifd_send_prepare_iovs(p);
     p->flags |= MULTIFD_FLAG_NOCOMP;
+    if (migration_in_postcopy()) {
+        p->flags |= MULTIFD_FLAG_POSTCOPY;
+    }
 
     multifd_send_fill_packet(p);
 
@@ -150,6 +155,9 @@ static int multifd_nocomp_send_prepare(MultiFDSendParams *p, Error **errp)
 static int multifd_nocomp_recv_setup(MultiFDRecvParams *p, Error **errp)
 {
     p->iov = g_new0(struct iovec, multifd_ram_page_count());
+    if (migrate_postcopy_ram()) {
+        p->postcopy_buf = g_malloc(MULTIFD_PACKET_SIZE);
+    }
     return 0;
 }
 
@@ -157,11 +165,65 @@ static void multifd_nocomp_recv_cleanup(MultiFDRecvParams *p)
 {
     g_free(p->iov);
     p->iov = NULL;
+    g_clear_pointer(&p->postcopy_buf, g_free);
+}
+
+/*
+ * During postcopy, guest memory is registered with userfaultfd, so the
+ * pages cannot be read in place.  Read them into the bounce buffer and
+ * place them, which also wakes up any thread that faulted on them.
+ */
+static int multifd_nocomp_recv_postcopy(MultiFDRecvParams *p, Error **errp)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    uint32_t page_size = multifd_ram_page_size();
+    int ret;
+
+    if (!p->postcopy_buf || qemu_ram_pagesize(p->block) != page_size) {
+        error_setg(errp, "multifd %u: cannot place postcopy pages of "
+                   "ramblock %s", p->id, p->block->idstr);
+        return -1;
+    }
+
+    for (int i = 0; i < p->zero_num; i++) {
+        ret = postcopy_place_page_zero(mis, p->host + p->zero[i], p->block);
+        if (ret) {
+            error_setg_errno(errp, -ret, "multifd %u: failed to place "
+                             "zero page", p->id);
+            return -1;
+        }
+    }
+
+    if (!p->normal_num) {
+        return 0;
+    }
+
+    for (int i = 0; i < p->normal_num; i++) {
+        p->iov[i].iov_base = p->postcopy_buf + i * page_size;
+        p->iov[i].iov_len = page_size;
+    }
+    if (qio_channel_readv_all(p->c, p->iov, p->normal_num, errp)) {
+        return -1;
+    }
+
+    for (int i = 0; i < p->normal_num; i++) {
+        ret = postcopy_place_page(mis, p->host + p->normal[i],
+                                  p->postcopy_buf + i * page_size, p->block);
+        if (ret) {
+            error_setg_errno(errp, -ret, "multifd %u: failed to place "
+                             "page", p->id);
+            return -1;
+        }
+    }
+    return 0;
 }
 
 static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
 {
+    uint32_t page_size = multifd_ram_page_size();
     uint32_t flags;
+    int niov = 0;
+    int ret;
 
     if (migrate_mapped_ram()) {
         return multifd_file_recv_data(p, errp);
@@ -175,18 +237,39 @@ static int multifd_nocomp_recv(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
+    if (p->flags & MULTIFD_FLAG_POSTCOPY) {
+        return multifd_nocomp_recv_postcopy(p, errp);
+    }
+
     multifd_recv_zero_page_process(p);
 
     if (!p->normal_num) {
         return 0;
     }
 
+    /*
+     * Pages were queued in runs, so merge contiguous ones into a single
+     * iov entry, and let the socket fill all of them in one go instead of
+     * returning whatever data has arrived so far.
+     */
     for (int i = 0; i < p->normal_num; i++) {
-        p->iov[i].iov_base = p->host + p->normal[i];
-        p->iov[i].iov_len = multifd_ram_page_size();
+        if (niov && p->normal[i] == p->normal[i - 1] + page_size) {
+            p->iov[niov - 1].iov_len += page_size;
+        } else {
+            p->iov[niov].iov_base = p->host + p->normal[i];
+            p->iov[niov].iov_len = page_size;
+            niov++;
+        }
         ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
     }
-    return qio_channel_readv_all(p->c, p->iov, p->normal_num, errp);
+
+    ret = qio_channel_readv_full_all_eof(p->c, p->iov, niov, NULL, NULL,
+                                         QIO_CHANNEL_READ_FLAG_WAITALL, errp);
+    if (ret == 0) {
+        error_setg(errp, "Unexpected end-of-file before all data were read");
+        return -1;
+    }
+    return ret < 0 ? ret : 0;
 }
 
 static void multifd_pages_reset(MultiFDPages_t *pages)
@@ -403,6 +486,11 @@ int multifd_ram_flush_and_sync(QEMUFile *f)
         return 0;
     }
 
+    /* Postcopy may not, or no longer, use the multifd channels */
+    if (migration_in_postcopy() && !multifd_ram_postcopy_active()) {
+        return 0;
+    }
+
     if (!multifd_payload_empty(multifd_ram_send)) {
         if (!multifd_send(&multifd_ram_send)) {
             error_report("%s: multifd_send fail", __func__);
@@ -437,6 +525,50 @@ int multifd_ram_flush_and_sync(QEMUFile *f)
     return 0;
 }
 
+/*
+ * Sync the multifd channels at the switch to postcopy, before the discard
+ * bitmap is sent.  No RAM_SAVE_FLAG_MULTIFD_FLUSH goes with it, because
+ * the destination syncs when it prepares for the discards, so that no
+ * page that was in flight can land after its discard.
+ */
+int multifd_ram_postcopy_sync(void)
+{
+    if (!migrate_multifd()) {
+        return 0;
+    }
+
+    if (!multifd_payload_empty(multifd_ram_send)) {
+        if (!multifd_send(&multifd_ram_send)) {
+            error_report("%s: multifd_send fail", __func__);
+            return -1;
+        }
+    }
+
+    return multifd_send_sync_main(MULTIFD_SYNC_ALL);
+}
+
+/*
+ * Can the multifd channels carry background pages during postcopy?  This
+ * needs the preempt channel, as urgent pages must not queue behind them.
+ */
+bool multifd_ram_postcopy_supported(void)
+{
+    return migrate_multifd() && migrate_postcopy_preempt() &&
+           !migrate_mapped_ram() &&
+           migrate_multifd_compression() == MULTIFD_COMPRESSION_NONE &&
+           multifd_ram_sync_per_round();
+}
+
+/*
+ * Do the multifd channels carry background pages right now?  This starts
+ * once the destination acknowledged the postcopy package, see
+ * postcopy_start(), and stops for good if postcopy is paused.
+ */
+bool multifd_ram_postcopy_active(void)
+{
+    return qatomic_read(&migrate_get_current()->postcopy_multifd_ready);
+}
+
 bool multifd_send_prepare_common(MultiFDSendParams *p)
 {
     MultiFDPages_t *pages = &p->data->u.ram;
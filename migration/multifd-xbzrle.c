@@ -0,0 +1,445 @@
+/*
+ * Multifd XBZRLE delta compression implementation
+ *
+ * Each page of a packet is sent either raw, as an XBZRLE delta against
+ * the content sent for it in an earlier round, as "unchanged", or as a
+ * copy of an identical page earlier in the same packet.  The previous
+ * content is kept in a page cache shared by all channels and split into
+ * shards by guest address, so that channels rarely contend on it.
+ *
+ * The destination applies deltas to its own copy of the page, which
+ * holds exactly what the source cached: a page is sent at most once
+ * between two multifd syncs, and the destination only lets a channel
+ * proceed past a sync once all channels reached it.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/host-utils.h"
+#include "qemu/lockable.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "migration-stats.h"
+#include "trace.h"
+#include "options.h"
+#include "multifd.h"
+#include "page_cache.h"
+#include "ram.h"
+#include "xbzrle.h"
+
+/*
+ * Each page has a big endian 32-bit descriptor, with the encoding in the
+ * top 8 bits and its argument in the low 24 bits.  The descriptors for
+ * all normal pages come first, followed by the payloads in page order.
+ */
+#define XBZRLE_PAGE_RAW     0   /* a whole page follows */
+#define XBZRLE_PAGE_SAME    1   /* unchanged since it was last sent */
+#define XBZRLE_PAGE_DELTA   2   /* argument: length of the delta */
+#define XBZRLE_PAGE_COPY    3   /* argument: index of the page to copy */
+
+#define XBZRLE_DESC(type, arg)  (((uint32_t)(type) << 24) | (arg))
+#define XBZRLE_DESC_TYPE(desc)  ((desc) >> 24)
+#define XBZRLE_DESC_ARG(desc)   ((desc) & 0xffffff)
+
+/* A delta is only worth sending if it saves at least this many bytes */
+#define XBZRLE_MIN_SAVING       64
+
+#define XBZRLE_CACHE_SHARDS     16
+
+typedef struct {
+    QemuMutex lock;
+    PageCache *cache;
+} XbzrleCacheShard;
+
+/* Page cache shared by all send channels */
+static struct {
+    QemuMutex lock;
+    unsigned users;
+    XbzrleCacheShard shards[XBZRLE_CACHE_SHARDS];
+} xbzrle_cache;
+
+struct xbzrle_data {
+    /* descriptors, followed by the payloads */
+    uint8_t *zbuff;
+    /* size of zbuff */
+    uint32_t zbuff_len;
+    /* copy of the normal pages of the packet, one page each */
+    uint8_t *pages;
+    /* hashes of the copied pages, used to find duplicates */
+    uint64_t *hashes;
+};
+
+static XbzrleCacheShard *xbzrle_cache_shard(ram_addr_t addr)
+{
+    return &xbzrle_cache.shards[(addr >> qemu_target_page_bits()) %
+                                XBZRLE_CACHE_SHARDS];
+}
+
+static int xbzrle_cache_get(Error **errp)
+{
+    uint64_t shard_size;
+    int i;
+
+    QEMU_LOCK_GUARD(&xbzrle_cache.lock);
+
+    if (xbzrle_cache.users++) {
+        return 0;
+    }
+
+    shard_size = pow2floor(migrate_xbzrle_cache_size() / XBZRLE_CACHE_SHARDS);
+    shard_size = MAX(shard_size, qemu_target_page_size());
+    for (i = 0; i < XBZRLE_CACHE_SHARDS; i++) {
+        XbzrleCacheShard *shard = &xbzrle_cache.shards[i];
+
+        shard->cache = cache_init(shard_size, qemu_target_page_size(), errp);
+        if (!shard->cache) {
+            while (i--) {
+                cache_fini(xbzrle_cache.shards[i].cache);
+                xbzrle_cache.shards[i].cache = NULL;
+                qemu_mutex_destroy(&xbzrle_cache.shards[i].lock);
+            }
+            xbzrle_cache.users = 0;
+            return -1;
+        }
+        qemu_mutex_init(&shard->lock);
+    }
+    return 0;
+}
+
+static void xbzrle_cache_put(void)
+{
+    int i;
+
+    QEMU_LOCK_GUARD(&xbzrle_cache.lock);
+
+    if (--xbzrle_cache.users) {
+        return;
+    }
+
+    for (i = 0; i < XBZRLE_CACHE_SHARDS; i++) {
+        cache_fini(xbzrle_cache.shards[i].cache);
+        xbzrle_cache.shards[i].cache = NULL;
+        qemu_mutex_destroy(&xbzrle_cache.shards[i].lock);
+    }
+}
+
+static uint64_t xbzrle_page_hash(const uint8_t *page, uint32_t page_size)
+{
+    const uint64_t *p = (const uint64_t *)page;
+    uint64_t h = 0x9e3779b97f4a7c15ull;
+    uint32_t i;
+
+    for (i = 0; i < page_size / sizeof(uint64_t); i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    return h ^ (h >> 29);
+}
+
+/* Multifd XBZRLE compression */
+
+static int multifd_xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z;
+    uint32_t page_count = multifd_ram_page_count();
+    uint32_t page_size = multifd_ram_page_size();
+
+    if (migrate_zero_page_detection() == ZERO_PAGE_DETECTION_LEGACY) {
+        /* Zero pages sent by the migration thread would not be cached */
+        error_setg(errp, "multifd %u: xbzrle compression is not compatible "
+                   "with zero-page-detection=legacy", p->id);
+        return -1;
+    }
+
+    if (xbzrle_cache_get(errp) < 0) {
+        error_prepend(errp, "multifd %u: ", p->id);
+        return -1;
+    }
+
+    z = g_new0(struct xbzrle_data, 1);
+    z->zbuff_len = page_count * (sizeof(uint32_t) + page_size);
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    z->pages = g_try_malloc(page_count * page_size);
+    z->hashes = g_new(uint64_t, page_count);
+    if (!z->zbuff || !z->pages) {
+        g_free(z->zbuff);
+        g_free(z->pages);
+        g_free(z->hashes);
+        g_free(z);
+        xbzrle_cache_put();
+        error_setg(errp, "multifd %u: out of memory for xbzrle buffers",
+                   p->id);
+        return -1;
+    }
+    p->compress_data = z;
+
+    /* Needs 2 IOVs, one for packet header and one for compressed data */
+    p->iov = g_new0(struct iovec, 2);
+
+    return 0;
+}
+
+static void multifd_xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->compress_data;
+
+    g_free(z->zbuff);
+    g_free(z->pages);
+    g_free(z->hashes);
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+    xbzrle_cache_put();
+
+    g_free(p->iov);
+    p->iov = NULL;
+}
+
+/*
+ * Encode the copy of one normal page at @buf to @out, given the pages
+ * already seen in the packet, and return its descriptor.
+ */
+static uint32_t multifd_xbzrle_encode(struct xbzrle_data *z, uint32_t index,
+                                      ram_addr_t addr, uint8_t *buf,
+                                      uint8_t *out, uint32_t *out_len)
+{
+    uint32_t page_size = multifd_ram_page_size();
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    XbzrleCacheShard *shard = xbzrle_cache_shard(addr);
+    uint32_t desc = XBZRLE_DESC(XBZRLE_PAGE_RAW, 0);
+    uint32_t i;
+    int len;
+
+    *out_len = 0;
+
+    z->hashes[index] = xbzrle_page_hash(buf, page_size);
+    for (i = 0; i < index; i++) {
+        if (z->hashes[i] == z->hashes[index] &&
+            !memcmp(z->pages + i * page_size, buf, page_size)) {
+            desc = XBZRLE_DESC(XBZRLE_PAGE_COPY, i);
+            break;
+        }
+    }
+
+    QEMU_LOCK_GUARD(&shard->lock);
+
+    if (!cache_is_cached(shard->cache, addr, generation)) {
+        cache_insert(shard->cache, addr, buf, generation);
+    } else {
+        uint8_t *cached = get_cached_data(shard->cache, addr);
+
+        if (XBZRLE_DESC_TYPE(desc) != XBZRLE_PAGE_COPY) {
+            len = xbzrle_encode_buffer(cached, buf, page_size, out,
+                                       page_size - XBZRLE_MIN_SAVING);
+            if (len == 0) {
+                return XBZRLE_DESC(XBZRLE_PAGE_SAME, 0);
+            }
+            if (len > 0) {
+                desc = XBZRLE_DESC(XBZRLE_PAGE_DELTA, len);
+                *out_len = len;
+            }
+        }
+        memcpy(cached, buf, page_size);
+    }
+
+    if (XBZRLE_DESC_TYPE(desc) == XBZRLE_PAGE_RAW) {
+        memcpy(out, buf, page_size);
+        *out_len = page_size;
+    }
+    return desc;
+}
+
+static int multifd_xbzrle_send_prepare(MultiFDSendParams *p, Error **errp)
+{
+    MultiFDPages_t *pages = &p->data->u.ram;
+    struct xbzrle_data *z = p->compress_data;
+    uint32_t page_size = multifd_ram_page_size();
+    uint64_t generation = stat64_get(&mig_stats.dirty_sync_count);
+    uint32_t *descs = (uint32_t *)z->zbuff;
+    uint32_t out_size, len;
+    uint32_t i;
+
+    if (!multifd_send_prepare_common(p)) {
+        goto out;
+    }
+
+    out_size = pages->normal_num * sizeof(uint32_t);
+    for (i = 0; i < pages->normal_num; i++) {
+        ram_addr_t addr = pages->block->offset + pages->offset[i];
+        uint8_t *buf = z->pages + i * page_size;
+
+        /*
+         * The VM might be running, so work on a copy of the page: the
+         * content that is cached must be the content that is sent.
+         */
+        memcpy(buf, pages->block->host + pages->offset[i], page_size);
+        descs[i] = cpu_to_be32(multifd_xbzrle_encode(z, i, addr, buf,
+                                                     z->zbuff + out_size,
+                                                     &len));
+        out_size += len;
+    }
+
+    /* The destination clears zero pages, so must the cache */
+    for (; i < pages->num; i++) {
+        ram_addr_t addr = pages->block->offset + pages->offset[i];
+        XbzrleCacheShard *shard = xbzrle_cache_shard(addr);
+
+        WITH_QEMU_LOCK_GUARD(&shard->lock) {
+            if (cache_is_cached(shard->cache, addr, generation)) {
+                memset(get_cached_data(shard->cache, addr), 0, page_size);
+            }
+        }
+    }
+
+    p->iov[p->iovs_num].iov_base = z->zbuff;
+    p->iov[p->iovs_num].iov_len = out_size;
+    p->iovs_num++;
+    p->next_packet_size = out_size;
+
+out:
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+    multifd_send_fill_packet(p);
+    return 0;
+}
+
+static int multifd_xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = g_new0(struct xbzrle_data, 1);
+
+    z->zbuff_len = multifd_ram_page_count() *
+                   (sizeof(uint32_t) + multifd_ram_page_size());
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->zbuff) {
+        g_free(z);
+        error_setg(errp, "multifd %u: out of memory for zbuff", p->id);
+        return -1;
+    }
+    p->compress_data = z;
+    return 0;
+}
+
+static void multifd_xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *z = p->compress_data;
+
+    g_free(z->zbuff);
+    z->zbuff = NULL;
+    g_free(p->compress_data);
+    p->compress_data = NULL;
+}
+
+static int multifd_xbzrle_recv(MultiFDRecvParams *p, Error **errp)
+{
+    struct xbzrle_data *z = p->compress_data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t page_size = multifd_ram_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    uint32_t *descs = (uint32_t *)z->zbuff;
+    uint32_t in_off;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %u: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+
+    multifd_recv_zero_page_process(p);
+
+    if (!p->normal_num) {
+        assert(in_size == 0);
+        return 0;
+    }
+
+    in_off = p->normal_num * sizeof(uint32_t);
+    if (in_size > z->zbuff_len || in_size < in_off) {
+        error_setg(errp, "multifd %u: packet size received %u is invalid",
+                   p->id, in_size);
+        return -1;
+    }
+
+    ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < p->normal_num; i++) {
+        uint32_t desc = be32_to_cpu(descs[i]);
+        uint32_t arg = XBZRLE_DESC_ARG(desc);
+        uint8_t *host = p->host + p->normal[i];
+
+        ramblock_recv_bitmap_set_offset(p->block, p->normal[i]);
+
+        switch (XBZRLE_DESC_TYPE(desc)) {
+        case XBZRLE_PAGE_RAW:
+            arg = page_size;
+            if (in_size - in_off < arg) {
+                goto truncated;
+            }
+            memcpy(host, z->zbuff + in_off, page_size);
+            break;
+        case XBZRLE_PAGE_SAME:
+            arg = 0;
+            break;
+        case XBZRLE_PAGE_DELTA:
+            if (in_size - in_off < arg) {
+                goto truncated;
+            }
+            if (xbzrle_decode_buffer(z->zbuff + in_off, arg,
+                                     host, page_size) < 0) {
+                error_setg(errp, "multifd %u: failed to decode page %d",
+                           p->id, i);
+                return -1;
+            }
+            break;
+        case XBZRLE_PAGE_COPY:
+            if (arg >= i) {
+                error_setg(errp, "multifd %u: page %d copies page %u",
+                           p->id, i, arg);
+                return -1;
+            }
+            memcpy(host, p->host + p->normal[arg], page_size);
+            arg = 0;
+            break;
+        default:
+            error_setg(errp, "multifd %u: unknown page encoding %x",
+                       p->id, XBZRLE_DESC_TYPE(desc));
+            return -1;
+        }
+        in_off += arg;
+    }
+
+    if (in_off != in_size) {
+        error_setg(errp, "multifd %u: packet size received %u size used %u",
+                   p->id, in_size, in_off);
+        return -1;
+    }
+
+    return 0;
+
+truncated:
+    error_setg(errp, "multifd %u: packet of size %u is truncated",
+               p->id, in_size);
+    return -1;
+}
+
+static const MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = multifd_xbzrle_send_setup,
+    .send_cleanup = multifd_xbzrle_send_cleanup,
+    .send_prepare = multifd_xbzrle_send_prepare,
+    .recv_setup = multifd_xbzrle_recv_setup,
+    .recv_cleanup = multifd_xbzrle_recv_cleanup,
+    .recv = multifd_xbzrle_recv
+};
+
+static void multifd_xbzrle_register(void)
+{
+    qemu_mutex_init(&xbzrle_cache.lock);
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
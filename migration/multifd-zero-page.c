@@ -81,12 +81,26 @@ out:
     stat64_add(&mig_stats.zero_pages, pages->num - pages->normal_num);
 }
 
+/**
+ * multifd_recv_zero_page_process: Zero the zero pages of a packet.
+ *
+ * A page that was never received still holds the zeroes of fresh
+ * anonymous memory and is left alone.  A page that was received before
+ * is only cleared if it is not zero already: checking it reads the page
+ * once, while clearing it reads and writes it back.
+ *
+ * @param p A pointer to the recv params.
+ */
 void multifd_recv_zero_page_process(MultiFDRecvParams *p)
 {
+    size_t page_size = multifd_ram_page_size();
+
     for (int i = 0; i < p->zero_num; i++) {
         void *page = p->host + p->zero[i];
         if (ramblock_recv_bitmap_test_byte_offset(p->block, p->zero[i])) {
-            memset(page, 0, multifd_ram_page_size());
+            if (!buffer_is_zero(page, page_size)) {
+                memset(page, 0, page_size);
+            }
         } else {
             ramblock_recv_bitmap_set_offset(p->block, p->zero[i]);
         }
@@ -58,6 +58,7 @@ MultiFDRecvData *multifd_get_recv_data(void);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_XBZRLE (3 << 1)
 #define MULTIFD_FLAG_QPL (4 << 1)
 #define MULTIFD_FLAG_UADK (8 << 1)
 #define MULTIFD_FLAG_QATZIP (16 << 1)
@@ -68,6 +69,12 @@ MultiFDRecvData *multifd_get_recv_data(void);
  */
 #define MULTIFD_FLAG_DEVICE_STATE (32 << 1)
 
+/*
+ * If set it means that this packet was sent during postcopy, and its pages
+ * must be placed atomically with UFFDIO_COPY.
+ */
+#define MULTIFD_FLAG_POSTCOPY (64 << 1)
+
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
 
@@ -288,6 +295,8 @@ typedef struct {
     uint32_t zero_num;
     /* used for de-compression methods */
     void *compress_data;
+    /* bounce buffer for the pages placed with UFFDIO_COPY in postcopy */
+    uint8_t *postcopy_buf;
     /* Flags for the QIOChannel */
     int read_flags;
 } MultiFDRecvParams;
@@ -396,6 +405,9 @@ static inline uint32_t multifd_ram_page_count(void)
 void multifd_ram_save_setup(void);
 void multifd_ram_save_cleanup(void);
 int multifd_ram_flush_and_sync(QEMUFile *f);
+int multifd_ram_postcopy_sync(void);
+bool multifd_ram_postcopy_supported(void);
+bool multifd_ram_postcopy_active(void);
 bool multifd_ram_sync_per_round(void);
 bool multifd_ram_sync_per_section(void);
 void multifd_ram_payload_alloc(MultiFDPages_t *pages);
@@ -29,7 +29,7 @@
 #include "qemu-file.h"
 #include "ram.h"
 #include "options.h"
-#include "system/kvm.h"
+#include "system/dirtylimit.h"
 
 /* Maximum migrate downtime set to 2000 seconds */
 #define MAX_MIGRATE_DOWNTIME_SECONDS 2000
@@ -101,6 +101,12 @@ const Property migration_properties[] = {
                       clear_bitmap_shift, CLEAR_BITMAP_SHIFT_DEFAULT),
     DEFINE_PROP_BOOL("x-preempt-pre-7-2", MigrationState,
                      preempt_pre_7_2, false),
+    DEFINE_PROP_UINT32("x-postcopy-prefetch-pages", MigrationState,
+                       postcopy_prefetch_pages, 0),
+    DEFINE_PROP_UINT32("x-vmstate-save-threads", MigrationState,
+                       vmstate_save_threads, 0),
+    DEFINE_PROP_BOOL("x-vcpu-dirty-limit-adaptive", MigrationState,
+                     vcpu_dirty_limit_adaptive, false),
     DEFINE_PROP_BOOL("multifd-clean-tls-termination", MigrationState,
                      multifd_clean_tls_termination, true),
 
@@ -201,6 +207,10 @@ const Property migration_properties[] = {
                         MIGRATION_CAPABILITY_SWITCHOVER_ACK),
     DEFINE_PROP_MIG_CAP("x-dirty-limit", MIGRATION_CAPABILITY_DIRTY_LIMIT),
     DEFINE_PROP_MIG_CAP("mapped-ram", MIGRATION_CAPABILITY_MAPPED_RAM),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram-incremental",
+                        MIGRATION_CAPABILITY_MAPPED_RAM_INCREMENTAL),
+    DEFINE_PROP_MIG_CAP("x-mapped-ram-lazy-load",
+                        MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD),
 };
 const size_t migration_properties_count = ARRAY_SIZE(migration_properties);
 
@@ -260,6 +270,20 @@ bool migrate_mapped_ram(void)
     return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
 }
 
+bool migrate_mapped_ram_incremental(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM_INCREMENTAL];
+}
+
+bool migrate_mapped_ram_lazy_load(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    return s->capabilities[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD];
+}
+
 bool migrate_ignore_shared(void)
 {
     MigrationState *s = migrate_get_current();
@@ -491,11 +515,6 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
             error_setg(errp, "Postcopy is not compatible with ignore-shared");
             return false;
         }
-
-        if (new_caps[MIGRATION_CAPABILITY_MULTIFD]) {
-            error_setg(errp, "Postcopy is not yet compatible with multifd");
-            return false;
-        }
     }
 
     if (new_caps[MIGRATION_CAPABILITY_BACKGROUND_SNAPSHOT]) {
@@ -583,8 +602,8 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
             return false;
         }
 
-        if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
-            error_setg(errp, "dirty-limit requires KVM with accelerator"
+        if (!vcpu_dirty_ring_size()) {
+            error_setg(errp, "dirty-limit requires KVM or TCG with accelerator"
                    " property 'dirty-ring-size' set");
             return false;
         }
@@ -611,6 +630,19 @@ bool migrate_caps_check(bool *old_caps, bool *new_caps, Error **errp)
         }
     }
 
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_INCREMENTAL] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        error_setg(errp,
+                   "Incremental mapped-ram migration requires mapped-ram");
+        return false;
+    }
+
+    if (new_caps[MIGRATION_CAPABILITY_MAPPED_RAM_LAZY_LOAD] &&
+        !new_caps[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        error_setg(errp, "Lazy mapped-ram loading requires mapped-ram");
+        return false;
+    }
+
     return true;
 }
 
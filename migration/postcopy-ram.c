@@ -38,6 +38,7 @@
 #include "qemu/userfaultfd.h"
 #include "qemu/mmap-alloc.h"
 #include "options.h"
+#include "multifd.h"
 
 /* Arbitrary limit on size of each discard command,
  * keeps them around ~200 bytes
@@ -649,6 +650,8 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
         close(mis->userfault_fd);
         close(mis->userfault_event_fd);
         mis->have_fault_thread = false;
+        g_clear_pointer(&mis->fault_streams, g_free);
+        mis->fault_streams_nr = 0;
     }
 
     if (should_mlock(mlock_state)) {
@@ -698,6 +701,13 @@ static int nhp_range(RAMBlock *rb, void *opaque)
  */
 int postcopy_ram_prepare_discard(MigrationIncomingState *mis)
 {
+    /*
+     * Pair with the sync the source does before sending the discards,
+     * so that pages still in flight on multifd channels land before the
+     * discards, and before guest memory is registered with userfaultfd.
+     */
+    multifd_recv_sync_main();
+
     if (foreach_not_ignored_block(nhp_range, mis)) {
         return -1;
     }
@@ -811,6 +821,118 @@ static int get_mem_fault_cpu_index(uint32_t pid)
     return -1;
 }
 
+/*
+ * Faults of one vCPU, used to detect a vCPU walking through memory with
+ * a fixed stride (usually one host page) and to request the pages it is
+ * going to touch next before it faults on them.
+ */
+typedef struct PostcopyFaultStream {
+    RAMBlock *rb;
+    /* Offset of the last fault */
+    ram_addr_t last;
+    /* Distance between the last two faults, or 0 if there is no stream */
+    ram_addr_t stride;
+    /* Offset of the first page of the stream that was not requested */
+    ram_addr_t next;
+} PostcopyFaultStream;
+
+/* Bound the amount of data a single fault can request */
+#define POSTCOPY_PREFETCH_PAGES_MAX     64
+/* Larger strides, in host pages, are not considered a stream */
+#define POSTCOPY_PREFETCH_STRIDE_MAX    16
+
+static void postcopy_prefetch_setup(MigrationIncomingState *mis)
+{
+    MachineState *ms = MACHINE(qdev_get_machine());
+
+    if (!migrate_get_current()->postcopy_prefetch_pages) {
+        return;
+    }
+    mis->fault_streams_nr = ms->smp.max_cpus + 1;
+    mis->fault_streams = g_new0(PostcopyFaultStream, mis->fault_streams_nr);
+}
+
+/*
+ * Called by the fault thread after requesting the page at @offset of @rb
+ * for the thread @ptid.  If the fault continues a stream of faults of the
+ * same vCPU, request the next pages of the stream that were not received
+ * yet.  Consecutive pages are requested with a single message, so that
+ * the source can send them in one batch.
+ */
+static void postcopy_prefetch_pages(MigrationIncomingState *mis,
+                                    RAMBlock *rb, ram_addr_t offset,
+                                    uint32_t ptid)
+{
+    uint32_t window = MIN(migrate_get_current()->postcopy_prefetch_pages,
+                          POSTCOPY_PREFETCH_PAGES_MAX);
+    size_t pagesize = qemu_ram_pagesize(rb);
+    PostcopyFaultStream *s;
+    ram_addr_t addr, start = 0, len = 0;
+    uint32_t i;
+    int cpu;
+
+    if (!mis->fault_streams) {
+        return;
+    }
+
+    cpu = ptid ? get_mem_fault_cpu_index(ptid) : -1;
+    if (cpu < 0 || cpu >= mis->fault_streams_nr - 1) {
+        cpu = mis->fault_streams_nr - 1;
+    }
+    s = &mis->fault_streams[cpu];
+
+    if (s->rb == rb && s->stride && offset > s->last && offset < s->next &&
+        (offset - s->last) % s->stride == 0) {
+        /* The page was prefetched already, but it is still in flight */
+        s->last = offset;
+        return;
+    }
+
+    if (s->rb != rb || !s->stride || offset != s->next) {
+        /* Not a stream (yet); remember the stride for the next fault */
+        if (s->rb == rb && offset > s->last &&
+            offset - s->last <= POSTCOPY_PREFETCH_STRIDE_MAX * pagesize) {
+            s->stride = offset - s->last;
+        } else {
+            s->stride = 0;
+        }
+        s->rb = rb;
+        s->last = offset;
+        s->next = offset + s->stride;
+        return;
+    }
+
+    s->last = offset;
+    for (i = 0, addr = offset + s->stride;
+         i < window && addr < rb->used_length;
+         i++, addr += s->stride) {
+        /* Only a hint, a page will not go back to being not received */
+        if (ramblock_recv_bitmap_test_byte_offset(rb, addr)) {
+            continue;
+        }
+        if (len && start + len == addr) {
+            len += pagesize;
+            continue;
+        }
+        if (len) {
+            trace_postcopy_ram_fault_thread_prefetch(qemu_ram_get_idstr(rb),
+                                                     start, len);
+            if (migrate_send_rp_message_req_pages(mis, rb, start, len)) {
+                return;
+            }
+        }
+        start = addr;
+        len = pagesize;
+    }
+    s->next = addr;
+
+    if (len) {
+        trace_postcopy_ram_fault_thread_prefetch(qemu_ram_get_idstr(rb),
+                                                 start, len);
+        migrate_send_rp_message_req_pages(mis, rb, start, len);
+    }
+}
+
 static uint32_t get_low_time_offset(PostcopyBlocktimeContext *dc)
 {
     int64_t start_time_offset = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
@@ -1084,6 +1206,8 @@ retry:
                 postcopy_pause_fault_thread(mis);
                 goto retry;
             }
+            postcopy_prefetch_pages(mis, rb, rb_offset,
+                                    msg.arg.pagefault.feat.ptid);
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1230,6 +1354,7 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
+    postcopy_prefetch_setup(mis);
     postcopy_thread_create(mis, &mis->fault_thread,
                            MIGRATION_THREAD_DST_FAULT,
                            postcopy_ram_fault_thread, QEMU_THREAD_JOINABLE);
@@ -59,6 +59,13 @@ struct QEMUFile {
 
     bool can_pass_fd;
     QTAILQ_HEAD(, FdEntry) fds;
+
+    /*
+     * Bytes written to a detached file are accounted here instead of
+     * in the migration statistics.
+     */
+    bool detached;
+    uint64_t transferred;
 };
 
 /*
@@ -142,6 +149,23 @@ QEMUFile *qemu_file_new_input(QIOChannel *ioc)
     return qemu_file_new_impl(ioc, false);
 }
 
+QEMUFile *qemu_file_new_output_detached(QIOChannel *ioc)
+{
+    QEMUFile *f = qemu_file_new_impl(ioc, true);
+
+    f->detached = true;
+    return f;
+}
+
+static void qemu_file_add_transferred(QEMUFile *f, uint64_t size)
+{
+    if (f->detached) {
+        f->transferred += size;
+    } else {
+        stat64_add(&mig_stats.qemu_file_transferred, size);
+    }
+}
+
 /*
  * Get last error for stream f with optional Error*
  *
@@ -295,8 +319,7 @@ int qemu_fflush(QEMUFile *f)
                                    &local_error) < 0) {
             qemu_file_set_error_obj(f, -EIO, local_error);
         } else {
-            uint64_t size = iov_size(f->iov, f->iovcnt);
-            stat64_add(&mig_stats.qemu_file_transferred, size);
+            qemu_file_add_transferred(f, iov_size(f->iov, f->iovcnt));
         }
 
         qemu_iovec_release_ram(f);
@@ -560,7 +583,7 @@ void qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
         return;
     }
 
-    stat64_add(&mig_stats.qemu_file_transferred, buflen);
+    qemu_file_add_transferred(f, buflen);
 
     return;
 }
@@ -795,11 +818,17 @@ int coroutine_mixed_fn qemu_get_byte(QEMUFile *f)
 
 uint64_t qemu_file_transferred(QEMUFile *f)
 {
-    uint64_t ret = stat64_get(&mig_stats.qemu_file_transferred);
+    uint64_t ret;
     int i;
 
     g_assert(qemu_file_is_writable(f));
 
+    if (f->detached) {
+        ret = f->transferred;
+    } else {
+        ret = stat64_get(&mig_stats.qemu_file_transferred);
+    }
+
     for (i = 0; i < f->iovcnt; i++) {
         ret += f->iov[i].iov_len;
     }
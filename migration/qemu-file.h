@@ -31,6 +31,11 @@
 
 QEMUFile *qemu_file_new_input(QIOChannel *ioc);
 QEMUFile *qemu_file_new_output(QIOChannel *ioc);
+/*
+ * An output file whose contents are copied into the migration stream
+ * later, so that writing to it does not count as transferred data.
+ */
+QEMUFile *qemu_file_new_output_detached(QIOChannel *ioc);
 int qemu_fclose(QEMUFile *f);
 
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(QEMUFile, qemu_fclose)
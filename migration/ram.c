@@ -28,6 +28,7 @@
 
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/madvise.h"
@@ -56,6 +57,7 @@
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
+#include "file.h"
 #include "system/runstate.h"
 #include "rdma.h"
 #include "options.h"
@@ -987,6 +989,26 @@ static void migration_dirty_limit_guest(void)
     trace_migration_dirty_limit_guest(quota_dirtyrate);
 }
 
+/*
+ * Let the vCPUs dirty the threshold share of what was transferred in
+ * the last period, throttling only those that dirty the most pages.
+ * Unlike the uniform limit, this is refreshed every period as vCPUs
+ * change their behaviour.
+ */
+static void migration_dirty_limit_guest_adaptive(RAMState *rs,
+                                                 uint64_t bytes_dirty_threshold)
+{
+    MigrationState *s = migrate_get_current();
+    uint64_t period_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME) -
+                         rs->time_last_bitmap_sync;
+    uint64_t quota_dirtyrate;
+
+    quota_dirtyrate = bytes_dirty_threshold * 1000 / MAX(period_ms, 1) / MiB;
+    dirtylimit_set_fair_share(quota_dirtyrate,
+                              s->parameters.vcpu_dirty_limit);
+    trace_migration_dirty_limit_guest(quota_dirtyrate);
+}
+
 static void migration_trigger_throttle(RAMState *rs)
 {
     uint64_t threshold = migrate_throttle_trigger_threshold();
@@ -995,6 +1017,13 @@ static void migration_trigger_throttle(RAMState *rs)
     uint64_t bytes_dirty_period = rs->num_dirty_pages_period * TARGET_PAGE_SIZE;
     uint64_t bytes_dirty_threshold = bytes_xfer_period * threshold / 100;
 
+    if (migrate_dirty_limit() &&
+        migrate_get_current()->vcpu_dirty_limit_adaptive &&
+        dirtylimit_in_service()) {
+        migration_dirty_limit_guest_adaptive(rs, bytes_dirty_threshold);
+        return;
+    }
+
     /*
      * The following detection logic can be refined later. For now:
      * Check to see if the ratio between dirtied bytes and the approx.
@@ -1009,6 +1038,9 @@ static void migration_trigger_throttle(RAMState *rs)
             trace_migration_throttle();
             mig_throttle_guest_down(bytes_dirty_period,
                                     bytes_dirty_threshold);
+        } else if (migrate_dirty_limit() &&
+                   migrate_get_current()->vcpu_dirty_limit_adaptive) {
+            migration_dirty_limit_guest_adaptive(rs, bytes_dirty_threshold);
         } else if (migrate_dirty_limit()) {
             migration_dirty_limit_guest();
         }
@@ -1895,7 +1927,9 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
         ram_addr_t page_start = start >> TARGET_PAGE_BITS;
         size_t page_size = qemu_ram_pagesize(ramblock);
         PageSearchStatus *pss = &ram_state->pss[RAM_CHANNEL_POSTCOPY];
-        int ret = 0;
+        bool unflushed = false;
+        ram_addr_t offset;
+        int ret = 0, sent;
 
         qemu_mutex_lock(&rs->bitmap_mutex);
 
@@ -1913,25 +1947,32 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
          * assert; if something wrong we're mostly split brain anyway.
          */
         assert(len % page_size == 0);
-        while (len) {
-            if (ram_save_host_page_urgent(pss)) {
+        for (offset = 0; offset < len; offset += page_size) {
+            /*
+             * ram_save_host_page_urgent() may leave pss->page anywhere
+             * (e.g. at the next dirty page), so point it at each host
+             * page of the request explicitly.
+             */
+            pss->page = page_start + (offset >> TARGET_PAGE_BITS);
+            sent = ram_save_host_page_urgent(pss);
+            if (sent < 0) {
                 error_setg(errp, "ram_save_host_page_urgent() failed: "
                            "ramblock=%s, start_addr=0x"RAM_ADDR_FMT,
                            ramblock->idstr, start);
                 ret = -1;
                 break;
             }
+            unflushed |= sent;
             /*
-             * NOTE: after ram_save_host_page_urgent() succeeded, pss->page
-             * will automatically be moved and point to the next host page
-             * we're going to send, so no need to update here.
-             *
-             * Normally QEMU never sends >1 host page in requests, so
-             * logically we don't even need that as the loop should only
-             * run once, but just to be consistent.
+             * The first host page is the one the destination faulted on,
+             * push it out right away.  Requests for more pages come from
+             * the destination prefetching, flush those as one batch.
              */
-            len -= page_size;
-        };
+            if (unflushed && (offset == 0 || offset + page_size == len)) {
+                qemu_fflush(pss->pss_channel);
+                unflushed = false;
+            }
+        }
         qemu_mutex_unlock(&rs->bitmap_mutex);
 
         return ret;
@@ -1952,6 +1993,28 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
     return 0;
 }
 
+/*
+ * Whether the page at pss goes to the multifd channels.  During postcopy,
+ * only background pages do, and only once the destination can place them
+ * (see multifd_ram_postcopy_active()).  Urgent pages stay on the preempt
+ * channel, and pages of huge page RAMBlocks on the main channel, because
+ * their host pages must be placed at once.
+ */
+static bool ram_save_use_multifd(RAMState *rs, PageSearchStatus *pss)
+{
+    if (!migrate_multifd()) {
+        return false;
+    }
+
+    if (!migration_in_postcopy()) {
+        return true;
+    }
+
+    return pss == &rs->pss[RAM_CHANNEL_PRECOPY] &&
+           qemu_ram_pagesize(pss->block) == TARGET_PAGE_SIZE &&
+           multifd_ram_postcopy_active();
+}
+
 /**
  * ram_save_target_page: save one target page to the precopy thread
  * OR to multifd workers.
@@ -1962,6 +2025,7 @@ int ram_save_queue_pages(const char *rbname, ram_addr_t start, ram_addr_t len,
 static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
 {
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd = ram_save_use_multifd(rs, pss);
     int res;
 
     /* Hand over to RDMA first */
@@ -1969,14 +2033,14 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss)
         return res;
     }
 
-    if (!migrate_multifd()
+    if (!use_multifd
         || migrate_zero_page_detection() == ZERO_PAGE_DETECTION_LEGACY) {
         if (save_zero_page(rs, pss, offset)) {
             return 1;
         }
     }
 
-    if (migrate_multifd()) {
+    if (use_multifd) {
         RAMBlock *block = pss->block;
         return ram_save_multifd_page(block, offset);
     }
@@ -2041,9 +2105,10 @@ static void pss_host_page_finish(PageSearchStatus *pss)
 
 /*
  * Send an urgent host page specified by `pss'.  Need to be called with
- * bitmap_mutex held.
+ * bitmap_mutex held.  The caller is responsible for flushing the channel.
  *
- * Returns 0 if save host page succeeded, false otherwise.
+ * Returns 1 if any page was sent, 0 if there was nothing to send, or a
+ * negative value on error.
  */
 static int ram_save_host_page_urgent(PageSearchStatus *pss)
 {
@@ -2081,11 +2146,62 @@ static int ram_save_host_page_urgent(PageSearchStatus *pss)
     } while (pss_within_range(pss));
 out:
     pss_host_page_finish(pss);
-    /* For urgent requests, flush immediately if sent */
-    if (sent) {
-        qemu_fflush(pss->pss_channel);
+    return ret ? ret : sent;
+}
+
+/*
+ * Whether ram_save_host_page() can hand whole runs of dirty pages to the
+ * multifd channels.  This needs precopy-only multifd, where pages are not
+ * sent from the migration thread and host pages may be split across
+ * packets.
+ */
+static bool ram_save_multifd_run_allowed(void)
+{
+    return migrate_multifd() && !migrate_rdma() &&
+           !migrate_postcopy_ram() && !migrate_background_snapshot() &&
+           migrate_zero_page_detection() != ZERO_PAGE_DETECTION_LEGACY;
+}
+
+/**
+ * ram_save_multifd_run: queue a run of dirty pages on the multifd channels
+ *
+ * Instead of clearing and queueing one target page per call, take the run
+ * of consecutive dirty pages at pss->page, up to one multifd packet, clear
+ * it from the bitmap a word at a time and queue it in one go.  Zero page
+ * detection and the copy itself already happen in the sender threads, so
+ * this leaves the migration thread with little more than the bitmap scan.
+ *
+ * The caller must be with ram_state.bitmap_mutex held.
+ *
+ * Returns the number of pages queued or negative on error
+ *
+ * @rs: current RAM state
+ * @pss: data about the page we want to send
+ */
+static int ram_save_multifd_run(RAMState *rs, PageSearchStatus *pss)
+{
+    RAMBlock *block = pss->block;
+    unsigned long size = block->used_length >> TARGET_PAGE_BITS;
+    unsigned long start = pss->page, end, page;
+
+    end = find_next_zero_bit(block->bmap,
+                             MIN(size, start + multifd_ram_page_count()),
+                             start);
+
+    /* Same rule as migration_bitmap_clear_dirty(): clear before sending */
+    migration_clear_memory_region_dirty_bitmap_range(block, start,
+                                                     end - start);
+    bitmap_clear(block->bmap, start, end - start);
+    rs->migration_dirty_pages -= end - start;
+
+    for (page = start; page < end; page++) {
+        if (!multifd_queue_page(block, (ram_addr_t)page << TARGET_PAGE_BITS)) {
+            return -1;
+        }
     }
-    return ret;
+
+    pss->page = end;
+    return end - start;
 }
 
 /**
@@ -2123,6 +2239,10 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss)
         return 0;
     }
 
+    if (ram_save_multifd_run_allowed()) {
+        return ram_save_multifd_run(rs, pss);
+    }
+
     /* Update host page boundary information */
     pss_host_page_prepare(pss);
 
@@ -2316,9 +2436,19 @@ static void ram_bitmaps_destroy(void)
 static void ram_save_cleanup(void *opaque)
 {
     RAMState **rsp = opaque;
+    bool keep_bitmaps;
+
+    /*
+     * Keep tracking dirty pages after a completed incremental mapped-ram
+     * migration, so that the next one to the same file can reuse the
+     * bitmaps and only write what was dirtied in between.
+     */
+    keep_bitmaps = migrate_mapped_ram_incremental() &&
+        migrate_get_current()->state == MIGRATION_STATUS_COMPLETED;
+    keep_bitmaps = file_outgoing_image_done(keep_bitmaps);
 
     /* We don't use dirty log with background snapshots */
-    if (!migrate_background_snapshot()) {
+    if (!migrate_background_snapshot() && !keep_bitmaps) {
         /* caller have hold BQL or is in a bh, so there is
          * no writing race against the migration bitmap
          */
@@ -2332,7 +2462,9 @@ static void ram_save_cleanup(void *opaque)
         }
     }
 
-    ram_bitmaps_destroy();
+    if (!keep_bitmaps) {
+        ram_bitmaps_destroy();
+    }
 
     xbzrle_cleanup();
     multifd_ram_save_cleanup();
@@ -2661,15 +2793,31 @@ static bool ram_state_init(RAMState **rsp, Error **errp)
     return true;
 }
 
-static void ram_list_init_bitmaps(void)
+/*
+ * Returns true if the bitmaps kept by the previous incremental mapped-ram
+ * migration are reused, in which case only the pages dirtied since then
+ * are marked.
+ */
+static bool ram_list_init_bitmaps(void)
 {
     MigrationState *ms = migrate_get_current();
+    bool reuse = file_outgoing_updates_image();
     RAMBlock *block;
     unsigned long pages;
     uint8_t shift;
 
     /* Skip setting bitmap if there is no RAM */
     if (ram_bytes_total()) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            if (!block->bmap || !block->file_bmap) {
+                reuse = false;
+            }
+        }
+        if (reuse) {
+            return true;
+        }
+        ram_bitmaps_destroy();
+
         shift = ms->clear_bitmap_shift;
         if (shift > CLEAR_BITMAP_SHIFT_MAX) {
             error_report("clear_bitmap_shift (%u) too big, using "
@@ -2701,6 +2849,8 @@ static void ram_list_init_bitmaps(void)
             block->clear_bmap = bitmap_new(clear_bmap_size(pages, shift));
         }
     }
+
+    return false;
 }
 
 static void migration_bitmap_clear_discarded_pages(RAMState *rs)
@@ -2719,11 +2869,19 @@ static void migration_bitmap_clear_discarded_pages(RAMState *rs)
 static bool ram_init_bitmaps(RAMState *rs, Error **errp)
 {
     bool ret = true;
+    RAMBlock *block;
 
     qemu_mutex_lock_ramlist();
 
     WITH_RCU_READ_LOCK_GUARD() {
-        ram_list_init_bitmaps();
+        if (ram_list_init_bitmaps()) {
+            rs->migration_dirty_pages = 0;
+            RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+                rs->migration_dirty_pages +=
+                    bitmap_count_one(block->bmap,
+                                     block->used_length >> TARGET_PAGE_BITS);
+            }
+        }
         /* We don't use dirty log with background snapshots */
         if (!migrate_background_snapshot()) {
             ret = memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION, errp);
@@ -2872,6 +3030,8 @@ static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
 {
     g_autofree MappedRamHeader *header = NULL;
     size_t header_size, bitmap_size;
+    off_t bitmap_offset;
+    uint64_t pages_offset;
     long num_pages;
 
     header = g_new0(MappedRamHeader, 1);
@@ -2885,10 +3045,25 @@ static void mapped_ram_setup_ramblock(QEMUFile *file, RAMBlock *block)
      * go as they are written at the end of migration and during the
      * iterative phase, respectively.
      */
-    block->bitmap_offset = qemu_get_offset(file) + header_size;
-    block->pages_offset = ROUND_UP(block->bitmap_offset +
-                                   bitmap_size,
-                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+    bitmap_offset = qemu_get_offset(file) + header_size;
+    pages_offset = ROUND_UP(bitmap_offset + bitmap_size,
+                            MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    /*
+     * When updating the image of a previous migration, pages that moved
+     * within the file must all be written again.
+     */
+    if (file_outgoing_updates_image() &&
+        (block->bitmap_offset != bitmap_offset ||
+         block->pages_offset != pages_offset)) {
+        ram_state->migration_dirty_pages += num_pages -
+            bitmap_count_one(block->bmap, num_pages);
+        bitmap_set(block->bmap, 0, num_pages);
+        bitmap_zero(block->file_bmap, num_pages);
+    }
+
+    block->bitmap_offset = bitmap_offset;
+    block->pages_offset = pages_offset;
 
     header->version = cpu_to_be32(MAPPED_RAM_HDR_VERSION);
     header->page_size = cpu_to_be64(TARGET_PAGE_SIZE);
@@ -3062,10 +3237,13 @@ static void ram_save_file_bmap(QEMUFile *f)
         /*
          * Free the bitmap here to catch any synchronization issues
          * with multifd channels. No channels should be sending pages
-         * after we've written the bitmap to file.
+         * after we've written the bitmap to file.  Incremental
+         * migrations keep it, as it describes the image in the file.
          */
-        g_free(block->file_bmap);
-        block->file_bmap = NULL;
+        if (!migrate_mapped_ram_incremental()) {
+            g_free(block->file_bmap);
+            block->file_bmap = NULL;
+        }
     }
 }
 
@@ -3253,6 +3431,15 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
         if (ret < 0) {
             return ret;
         }
+    } else if (migration_in_postcopy() && multifd_ram_postcopy_active()) {
+        /*
+         * The destination must place the last pages sent on multifd
+         * channels before postcopy ends.
+         */
+        ret = multifd_ram_flush_and_sync(f);
+        if (ret < 0) {
+            return ret;
+        }
     }
 
     if (migrate_mapped_ram()) {
@@ -3729,6 +3916,11 @@ int ram_load_postcopy(QEMUFile *f, int channel)
         }
 
         switch (flags & ~RAM_SAVE_FLAG_CONTINUE) {
+        case RAM_SAVE_FLAG_MULTIFD_FLUSH:
+            /* Background pages of postcopy may come on multifd channels */
+            multifd_recv_sync_main();
+            break;
+
         case RAM_SAVE_FLAG_ZERO:
             ch = qemu_get_byte(f);
             if (ch != 0) {
@@ -3920,6 +4112,62 @@ err:
     return false;
 }
 
+/*
+ * Whether the pages of @block can be mapped from the migration file
+ * rather than read.  This only works for private anonymous memory made
+ * of target pages, and the mapped pages must never be discarded, as
+ * they would show the file contents again instead of zeroes.
+ */
+static bool mapped_ram_can_map_ramblock(QEMUFile *f, RAMBlock *block)
+{
+    static bool discard_disabled;
+
+    if (!migrate_mapped_ram_lazy_load()) {
+        return false;
+    }
+
+    if (block->fd >= 0 || qemu_ram_is_shared(block) ||
+        block->page_size != TARGET_PAGE_SIZE ||
+        qemu_real_host_page_size() != TARGET_PAGE_SIZE ||
+        !file_can_map_ramblock(qemu_file_get_ioc(f))) {
+        trace_ram_load_mapped_ram_read(block->idstr, "unsupported block");
+        return false;
+    }
+
+    if (!discard_disabled) {
+        if (ram_block_discard_disable(true)) {
+            trace_ram_load_mapped_ram_read(block->idstr, "discard required");
+            return false;
+        }
+        discard_disabled = true;
+    }
+
+    return true;
+}
+
+static bool map_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
+                                    long num_pages, unsigned long *bitmap,
+                                    Error **errp)
+{
+    QIOChannel *ioc = qemu_file_get_ioc(f);
+    unsigned long set_bit_idx, clear_bit_idx;
+
+    for (set_bit_idx = find_first_bit(bitmap, num_pages);
+         set_bit_idx < num_pages;
+         set_bit_idx = find_next_bit(bitmap, num_pages, clear_bit_idx + 1)) {
+
+        clear_bit_idx = find_next_zero_bit(bitmap, num_pages, set_bit_idx + 1);
+
+        if (!file_map_ramblock(ioc, block, set_bit_idx << TARGET_PAGE_BITS,
+                               TARGET_PAGE_SIZE * (clear_bit_idx - set_bit_idx),
+                               errp)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
                                       ram_addr_t length, Error **errp)
 {
@@ -3957,7 +4205,11 @@ static void parse_ramblock_mapped_ram(QEMUFile *f, RAMBlock *block,
         return;
     }
 
-    if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+    if (mapped_ram_can_map_ramblock(f, block)) {
+        if (!map_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
+            return;
+        }
+    } else if (!read_ramblock_mapped_ram(f, block, num_pages, bitmap, errp)) {
         return;
     }
 
@@ -4458,6 +4710,9 @@ static void ram_mig_ram_block_resized(RAMBlockNotifier *n, void *host,
         return;
     }
 
+    /* The image of an incremental mapped-ram migration no longer fits */
+    file_outgoing_image_invalidate();
+
     if (migration_is_running()) {
         /*
          * Precopy code on the source cannot deal with the size of RAM blocks
@@ -48,6 +48,14 @@
 
 #define RDMA_REG_CHUNK_SHIFT 20 /* 1 MB */
 
+/*
+ * Only every RDMA_WRITE_SIGNAL_BATCH-th RDMA Write asks for a completion.
+ * Work requests on a QP complete in order, so the completion of a signaled
+ * write also retires all the unsignaled writes posted before it.
+ */
+#define RDMA_WRITE_SIGNAL_BATCH 16
+#define RDMA_WRITE_FIFO_SIZE (RDMA_SIGNALED_SEND_MAX + RDMA_WRITE_SIGNAL_BATCH)
+
 /*
  * This is only for non-live state being migrated.
  * Instead of RDMA_WRITE messages, we use RDMA_SEND
@@ -284,6 +292,12 @@ typedef struct RDMALocalBlocks {
     RDMALocalBlock *block;
 } RDMALocalBlocks;
 
+/* An RDMA Write that was posted but whose completion was not seen yet. */
+typedef struct RDMAPostedWrite {
+    uint64_t wr_id;
+    bool signaled;
+} RDMAPostedWrite;
+
 /*
  * Main data structure for RDMA state.
  * While there is only one copy of this structure being allocated right now,
@@ -308,6 +322,19 @@ typedef struct RDMAContext {
     /* number of outstanding writes */
     int nb_sent;
 
+    /*
+     * Outstanding writes, oldest first, and how many of the newest ones
+     * were posted unsignaled.  The remote address and key of the newest
+     * write are kept so that qemu_rdma_signal_writes() can post a
+     * zero-length signaled write behind it.
+     */
+    RDMAPostedWrite posted_writes[RDMA_WRITE_FIFO_SIZE];
+    unsigned int posted_head;
+    unsigned int posted_len;
+    int nb_unsignaled;
+    uint64_t last_remote_addr;
+    uint32_t last_rkey;
+
     /* store info about current buffer so that we can
        merge it with future sends */
     uint64_t current_addr;
@@ -1438,6 +1465,38 @@ static uint64_t qemu_rdma_make_wrid(uint64_t wr_id, uint64_t index,
     return result;
 }
 
+/*
+ * The completion of a signaled RDMA Write was seen: retire it together
+ * with the unsignaled writes that were posted before it.
+ */
+static void qemu_rdma_retire_writes(RDMAContext *rdma)
+{
+    bool signaled = false;
+
+    while (rdma->posted_len && !signaled) {
+        RDMAPostedWrite *posted = &rdma->posted_writes[rdma->posted_head];
+        uint64_t chunk =
+            (posted->wr_id & RDMA_WRID_CHUNK_MASK) >> RDMA_WRID_CHUNK_SHIFT;
+        uint64_t index =
+            (posted->wr_id & RDMA_WRID_BLOCK_MASK) >> RDMA_WRID_BLOCK_SHIFT;
+        RDMALocalBlock *block = &(rdma->local_ram_blocks.block[index]);
+
+        signaled = posted->signaled;
+        rdma->posted_head = (rdma->posted_head + 1) % RDMA_WRITE_FIFO_SIZE;
+        rdma->posted_len--;
+
+        trace_qemu_rdma_poll_write(RDMA_WRID_RDMA_WRITE, rdma->nb_sent,
+                                   index, chunk, block->local_host_addr,
+                                   (void *)(uintptr_t)block->remote_host_addr);
+
+        clear_bit(chunk, block->transit_bitmap);
+
+        if (rdma->nb_sent > 0) {
+            rdma->nb_sent--;
+        }
+    }
+}
+
 /*
  * Consult the connection manager to see a work request
  * (of any kind) has completed.
@@ -1475,21 +1534,7 @@ static int qemu_rdma_poll(RDMAContext *rdma, struct ibv_cq *cq,
     }
 
     if (wr_id == RDMA_WRID_RDMA_WRITE) {
-        uint64_t chunk =
-            (wc.wr_id & RDMA_WRID_CHUNK_MASK) >> RDMA_WRID_CHUNK_SHIFT;
-        uint64_t index =
-            (wc.wr_id & RDMA_WRID_BLOCK_MASK) >> RDMA_WRID_BLOCK_SHIFT;
-        RDMALocalBlock *block = &(rdma->local_ram_blocks.block[index]);
-
-        trace_qemu_rdma_poll_write(wr_id, rdma->nb_sent,
-                                   index, chunk, block->local_host_addr,
-                                   (void *)(uintptr_t)block->remote_host_addr);
-
-        clear_bit(chunk, block->transit_bitmap);
-
-        if (rdma->nb_sent > 0) {
-            rdma->nb_sent--;
-        }
+        qemu_rdma_retire_writes(rdma);
     } else {
         trace_qemu_rdma_poll_other(wr_id, rdma->nb_sent);
     }
@@ -1985,6 +2030,51 @@ static int qemu_rdma_exchange_recv(RDMAContext *rdma, RDMAControlHeader *head,
     return 0;
 }
 
+/*
+ * Make sure that a completion will be generated for the newest RDMA Write,
+ * so that waiting for RDMA_WRID_RDMA_WRITE cannot hang on writes that were
+ * posted unsignaled.  This posts a zero-length signaled write behind them.
+ */
+static int qemu_rdma_signal_writes(RDMAContext *rdma, Error **errp)
+{
+    struct ibv_send_wr send_wr = {
+        .opcode = IBV_WR_RDMA_WRITE,
+        .send_flags = IBV_SEND_SIGNALED,
+        .num_sge = 0,
+        .wr.rdma.remote_addr = rdma->last_remote_addr,
+        .wr.rdma.rkey = rdma->last_rkey,
+    };
+    struct ibv_send_wr *bad_wr;
+    RDMAPostedWrite *newest;
+    int ret;
+
+    if (!rdma->nb_unsignaled) {
+        return 0;
+    }
+
+    newest = &rdma->posted_writes[(rdma->posted_head + rdma->posted_len - 1) %
+                                  RDMA_WRITE_FIFO_SIZE];
+    send_wr.wr_id = newest->wr_id;
+    newest->signaled = true;
+    rdma->nb_unsignaled = 0;
+
+    while ((ret = ibv_post_send(rdma->qp, &send_wr, &bad_wr)) == ENOMEM) {
+        trace_qemu_rdma_write_one_queue_full();
+        if (qemu_rdma_block_for_wrid(rdma, RDMA_WRID_RDMA_WRITE, NULL) < 0) {
+            error_setg(errp, "rdma migration: failed to make "
+                       "room in full send queue!");
+            return -1;
+        }
+    }
+    if (ret > 0) {
+        error_setg_errno(errp, ret,
+                         "rdma migration: post rdma write failed");
+        return -1;
+    }
+
+    return 0;
+}
+
 /*
  * Write an actual chunk of memory using RDMA.
  *
@@ -2000,6 +2090,8 @@ static int qemu_rdma_write_one(RDMAContext *rdma,
     struct ibv_send_wr *bad_wr;
     int reg_result_idx, ret, count = 0;
     uint64_t chunk, chunks;
+    RDMAPostedWrite *posted;
+    bool signaled;
     uint8_t *chunk_start, *chunk_end;
     RDMALocalBlock *block = &(rdma->local_ram_blocks.block[current_index]);
     RDMARegister reg;
@@ -2045,6 +2137,10 @@ retry:
         trace_qemu_rdma_write_one_block(count++, current_index, chunk,
                 sge.addr, length, rdma->nb_sent, block->nb_chunks);
 
+        if (qemu_rdma_signal_writes(rdma, errp) < 0) {
+            return -1;
+        }
+
         ret = qemu_rdma_block_for_wrid(rdma, RDMA_WRID_RDMA_WRITE, NULL);
 
         if (ret < 0) {
@@ -2172,7 +2268,8 @@ retry:
                                         current_index, chunk);
 
     send_wr.opcode = IBV_WR_RDMA_WRITE;
-    send_wr.send_flags = IBV_SEND_SIGNALED;
+    signaled = rdma->nb_unsignaled + 1 >= RDMA_WRITE_SIGNAL_BATCH;
+    send_wr.send_flags = signaled ? IBV_SEND_SIGNALED : 0;
     send_wr.sg_list = &sge;
     send_wr.num_sge = 1;
     send_wr.wr.rdma.remote_addr = block->remote_host_addr +
@@ -2204,6 +2301,16 @@ retry:
         return -1;
     }
 
+    assert(rdma->posted_len < RDMA_WRITE_FIFO_SIZE);
+    posted = &rdma->posted_writes[(rdma->posted_head + rdma->posted_len) %
+                                  RDMA_WRITE_FIFO_SIZE];
+    posted->wr_id = send_wr.wr_id;
+    posted->signaled = signaled;
+    rdma->posted_len++;
+    rdma->nb_unsignaled = signaled ? 0 : rdma->nb_unsignaled + 1;
+    rdma->last_remote_addr = send_wr.wr.rdma.remote_addr;
+    rdma->last_rkey = send_wr.wr.rdma.rkey;
+
     set_bit(chunk, block->transit_bitmap);
     stat64_add(&mig_stats.normal_pages, sge.length / qemu_target_page_size());
     /*
@@ -2602,6 +2709,9 @@ static int qemu_rdma_connect(RDMAContext *rdma, bool return_path,
 
     rdma->control_ready_expected = 1;
     rdma->nb_sent = 0;
+    rdma->posted_head = 0;
+    rdma->posted_len = 0;
+    rdma->nb_unsignaled = 0;
     return 0;
 
 err_rdma_source_connect:
@@ -2920,7 +3030,8 @@ static int qemu_rdma_drain_cq(RDMAContext *rdma)
 {
     Error *err = NULL;
 
-    if (qemu_rdma_write_flush(rdma, &err) < 0) {
+    if (qemu_rdma_write_flush(rdma, &err) < 0 ||
+        qemu_rdma_signal_writes(rdma, &err) < 0) {
         error_report_err(err);
         return -1;
     }
@@ -1602,6 +1602,96 @@ ret_fail_abort_threads:
     return -1;
 }
 
+/* A device state saved by a worker thread, see "x-vmstate-save-threads" */
+typedef struct SaveStateJob {
+    SaveStateEntry *se;
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    JSONWriter *vmdesc;
+    Error *err;
+    int ret;
+    QSIMPLEQ_ENTRY(SaveStateJob) next;
+} SaveStateJob;
+
+typedef QSIMPLEQ_HEAD(, SaveStateJob) SaveStateJobList;
+
+static int vmstate_save_job(void *opaque)
+{
+    SaveStateJob *job = opaque;
+    int64_t start_ts = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+
+    job->ret = vmstate_save(job->f, job->se, job->vmdesc, &job->err);
+    if (!job->ret) {
+        job->ret = qemu_fflush(job->f);
+    }
+    trace_vmstate_downtime_save("non-iterable", job->se->idstr,
+                                job->se->instance_id,
+                                qemu_clock_get_us(QEMU_CLOCK_REALTIME) -
+                                start_ts);
+    return 0;
+}
+
+static void vmstate_save_job_submit(ThreadPool *pool, SaveStateJobList *jobs,
+                                    SaveStateEntry *se, JSONWriter *vmdesc)
+{
+    SaveStateJob *job = g_new0(SaveStateJob, 1);
+
+    job->se = se;
+    job->bioc = qio_channel_buffer_new(4096);
+    job->f = qemu_file_new_output_detached(QIO_CHANNEL(job->bioc));
+    if (vmdesc) {
+        job->vmdesc = json_writer_new(false);
+    }
+    QSIMPLEQ_INSERT_TAIL(jobs, job, next);
+
+    thread_pool_submit(pool, vmstate_save_job, job, NULL);
+}
+
+/*
+ * Wait for the device states saved by @pool and append them to @f and
+ * @vmdesc in the order they were submitted.
+ */
+static int vmstate_save_jobs_complete(QEMUFile *f, ThreadPool *pool,
+                                      SaveStateJobList *jobs,
+                                      JSONWriter *vmdesc)
+{
+    MigrationState *ms = migrate_get_current();
+    SaveStateJob *job;
+    int ret = 0;
+
+    thread_pool_wait(pool);
+
+    while ((job = QSIMPLEQ_FIRST(jobs))) {
+        QSIMPLEQ_REMOVE_HEAD(jobs, next);
+
+        if (!ret && job->ret) {
+            ret = job->ret;
+            if (!job->err) {
+                qemu_file_get_error_obj(job->f, &job->err);
+            }
+            if (job->err) {
+                migrate_set_error(ms, job->err);
+                error_report_err(job->err);
+                job->err = NULL;
+            }
+            qemu_file_set_error(f, ret);
+        } else if (!ret) {
+            qemu_put_buffer(f, job->bioc->data, job->bioc->usage);
+            if (vmdesc && *json_writer_get(job->vmdesc)) {
+                json_writer_raw(vmdesc, NULL, json_writer_get(job->vmdesc));
+            }
+        }
+
+        error_free(job->err);
+        json_writer_free(job->vmdesc);
+        qemu_fclose(job->f);
+        object_unref(OBJECT(job->bioc));
+        g_free(job);
+    }
+
+    return ret;
+}
+
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy)
 {
@@ -1611,17 +1701,37 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     int vmdesc_len;
     SaveStateEntry *se;
     Error *local_err = NULL;
+    ThreadPool *pool = NULL;
+    SaveStateJobList jobs = QSIMPLEQ_HEAD_INITIALIZER(jobs);
     int ret;
 
     /* Making sure cpu states are synchronized before saving non-iterable */
     cpu_synchronize_all_states();
 
+    if (ms->vmstate_save_threads) {
+        pool = thread_pool_new();
+        thread_pool_set_max_threads(pool, ms->vmstate_save_threads);
+    }
+
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (se->vmsd && se->vmsd->early_setup) {
             /* Already saved during qemu_savevm_state_setup(). */
             continue;
         }
 
+        if (pool && se->vmsd && se->vmsd->parallel_save) {
+            vmstate_save_job_submit(pool, &jobs, se, vmdesc);
+            continue;
+        }
+
+        /* Anything else is saved after all the states registered before */
+        if (!QSIMPLEQ_EMPTY(&jobs)) {
+            ret = vmstate_save_jobs_complete(f, pool, &jobs, vmdesc);
+            if (ret) {
+                goto out;
+            }
+        }
+
         start_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
         ret = vmstate_save(f, se, vmdesc, &local_err);
@@ -1629,7 +1739,7 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
             migrate_set_error(ms, local_err);
             error_report_err(local_err);
             qemu_file_set_error(f, ret);
-            return ret;
+            goto out;
         }
 
         end_ts_each = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
@@ -1637,6 +1747,13 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                     end_ts_each - start_ts_each);
     }
 
+    if (!QSIMPLEQ_EMPTY(&jobs)) {
+        ret = vmstate_save_jobs_complete(f, pool, &jobs, vmdesc);
+        if (ret) {
+            goto out;
+        }
+    }
+
     if (!in_postcopy) {
         /* Postcopy stream will still be going */
         qemu_put_byte(f, QEMU_VM_EOF);
@@ -1653,8 +1770,13 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     }
 
     trace_vmstate_downtime_checkpoint("src-non-iterable-saved");
+    ret = 0;
 
-    return 0;
+out:
+    if (pool) {
+        thread_pool_free(pool);
+    }
+    return ret;
 }
 
 int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only)
@@ -2265,7 +2387,8 @@ static gboolean postcopy_sync_page_req(gpointer key, gpointer value,
         return FALSE;
     }
 
-    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset);
+    ret = migrate_send_rp_message_req_pages(mis, rb, rb_offset,
+                                            qemu_ram_pagesize(rb));
     if (ret) {
         /* Please refer to above comment. */
         error_report("%s: send rp message failed for addr %p",
@@ -18,6 +18,7 @@
 #include "qobject/json-writer.h"
 #include "qemu-file.h"
 #include "qemu/bitops.h"
+#include "qemu/bswap.h"
 #include "qemu/error-report.h"
 #include "trace.h"
 
@@ -131,6 +132,94 @@ static void vmstate_handle_alloc(void *ptr, const VMStateField *field,
     }
 }
 
+/*
+ * Arrays of plain integers are byte-swapped and copied as a whole
+ * instead of calling the put/get callback of each element, which
+ * matters for large register files such as vector registers.  Returns
+ * the size of the elements of @field if it is such an array, else 0.
+ */
+static int vmstate_integer_array_size(const VMStateField *field,
+                                      int n_elems, int size)
+{
+    const VMStateInfo *info = field->info;
+    int elem_size;
+
+    if (n_elems < 2 ||
+        (field->flags & (VMS_STRUCT | VMS_VSTRUCT | VMS_ARRAY_OF_POINTER))) {
+        return 0;
+    }
+
+    if (info == &vmstate_info_uint8 || info == &vmstate_info_int8) {
+        elem_size = 1;
+    } else if (info == &vmstate_info_uint16 || info == &vmstate_info_int16) {
+        elem_size = 2;
+    } else if (info == &vmstate_info_uint32 || info == &vmstate_info_int32) {
+        elem_size = 4;
+    } else if (info == &vmstate_info_uint64 || info == &vmstate_info_int64) {
+        elem_size = 8;
+    } else {
+        return 0;
+    }
+
+    return size == elem_size ? elem_size : 0;
+}
+
+/* Convert @len bytes of @size integers between host and big endian */
+static void vmstate_integer_array_bswap(void *buf, size_t len, int size)
+{
+#if !HOST_BIG_ENDIAN
+    size_t i;
+
+    switch (size) {
+    case 2:
+        for (i = 0; i < len; i += 2) {
+            stw_he_p(buf + i, bswap16(lduw_he_p(buf + i)));
+        }
+        break;
+    case 4:
+        for (i = 0; i < len; i += 4) {
+            stl_he_p(buf + i, bswap32(ldl_he_p(buf + i)));
+        }
+        break;
+    case 8:
+        for (i = 0; i < len; i += 8) {
+            stq_he_p(buf + i, bswap64(ldq_he_p(buf + i)));
+        }
+        break;
+    }
+#endif
+}
+
+static void vmstate_put_integer_array(QEMUFile *f, const void *elems,
+                                      int n_elems, int size)
+{
+    uint64_t buf[64];
+    size_t len = (size_t)n_elems * size;
+    size_t done, chunk;
+
+    if (size == 1 || HOST_BIG_ENDIAN) {
+        qemu_put_buffer(f, elems, len);
+        return;
+    }
+
+    for (done = 0; done < len; done += chunk) {
+        chunk = MIN(len - done, sizeof(buf));
+        memcpy(buf, elems + done, chunk);
+        vmstate_integer_array_bswap(buf, chunk, size);
+        qemu_put_buffer(f, (uint8_t *)buf, chunk);
+    }
+}
+
+static void vmstate_get_integer_array(QEMUFile *f, void *elems,
+                                      int n_elems, int size)
+{
+    size_t len = (size_t)n_elems * size;
+
+    if (qemu_get_buffer(f, elems, len) == len) {
+        vmstate_integer_array_bswap(elems, len, size);
+    }
+}
+
 int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                        void *opaque, int version_id)
 {
@@ -171,6 +260,18 @@ int vmstate_load_state(QEMUFile *f, const VMStateDescription *vmsd,
                 first_elem = *(void **)first_elem;
                 assert(first_elem || !n_elems || !size);
             }
+            if (vmstate_integer_array_size(field, n_elems, size)) {
+                vmstate_get_integer_array(f, first_elem, n_elems, size);
+                ret = qemu_file_get_error(f);
+                if (ret < 0) {
+                    error_report("Failed to load %s:%s", vmsd->name,
+                                 field->name);
+                    trace_vmstate_load_field_error(field->name, ret);
+                    return ret;
+                }
+                field++;
+                continue;
+            }
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
                 const VMStateField *inner_field;
@@ -433,6 +534,16 @@ int vmstate_save_state_v(QEMUFile *f, const VMStateDescription *vmsd,
                 assert(first_elem || !n_elems || !size);
             }
 
+            if (vmstate_integer_array_size(field, n_elems, size) &&
+                (!vmdesc || vmsd_can_compress(field))) {
+                /* Described like a compressed array of single elements */
+                vmsd_desc_field_start(vmsd, vmdesc, field, 0, n_elems);
+                vmstate_put_integer_array(f, first_elem, n_elems, size);
+                vmsd_desc_field_end(vmsd, vmdesc, field, size);
+                field++;
+                continue;
+            }
+
             for (i = 0; i < n_elems; i++) {
                 void *curr_elem = first_elem + size * i;
                 const VMStateField *inner_field;
@@ -28,6 +28,7 @@
 #include "nbd-internal.h"
 #include "qemu/units.h"
 #include "qemu/memalign.h"
+#include "system/iothread.h"
 
 #define NBD_META_ID_BASE_ALLOCATION 0
 #define NBD_META_ID_ALLOCATION_DEPTH 1
@@ -101,6 +102,16 @@ struct NBDExport {
     bool allocation_depth;
     BdrvDirtyBitmap **export_bitmaps;
     size_t nr_export_bitmaps;
+
+    /*
+     * AioContexts of the "iothreads" option, which new clients are spread
+     * over.  If empty, clients run in the export's AioContext.  The export
+     * holds a reference to each IOThread in @client_iothreads.
+     */
+    IOThread **client_iothreads;
+    AioContext **client_ctxs;
+    size_t nr_client_ctxs;
+    size_t next_client_ctx;
 };
 
 static QTAILQ_HEAD(, NBDExport) exports = QTAILQ_HEAD_INITIALIZER(exports);
@@ -129,6 +140,7 @@ struct NBDClient {
     QemuMutex lock;
 
     NBDExport *exp;
+    AioContext *ctx; /* Where requests run if not the export's context */
     QCryptoTLSCreds *tlscreds;
     char *tlsauthz;
     uint32_t handshake_max_secs;
@@ -159,6 +171,41 @@ struct NBDClient {
 
 static void nbd_client_receive_next_request(NBDClient *client);
 
+static void nbd_export_free_client_ctxs(NBDExport *exp)
+{
+    size_t i;
+
+    for (i = 0; i < exp->nr_client_ctxs; i++) {
+        if (exp->client_iothreads[i]) {
+            object_unref(OBJECT(exp->client_iothreads[i]));
+        }
+    }
+    g_free(exp->client_iothreads);
+    g_free(exp->client_ctxs);
+    exp->client_iothreads = NULL;
+    exp->client_ctxs = NULL;
+    exp->nr_client_ctxs = 0;
+}
+
+/* Add @client to the clients of its export once negotiation has picked it */
+static void nbd_client_attach_export(NBDClient *client)
+{
+    NBDExport *exp = client->exp;
+
+    if (exp->nr_client_ctxs) {
+        client->ctx = exp->client_ctxs[exp->next_client_ctx++ %
+                                       exp->nr_client_ctxs];
+    }
+    QTAILQ_INSERT_TAIL(&exp->clients, client, next);
+    blk_exp_ref(&exp->common);
+}
+
+/* The AioContext that the requests of @client run in */
+static AioContext *nbd_client_aio_context(NBDClient *client)
+{
+    return client->ctx ?: client->exp->common.ctx;
+}
+
 /* Basic flow for negotiation
 
    Server         Client
@@ -536,8 +583,7 @@ nbd_negotiate_handle_export_name(NBDClient *client, bool no_zeroes,
         return ret;
     }
 
-    QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
-    blk_exp_ref(&client->exp->common);
+    nbd_client_attach_export(client);
 
     return 0;
 }
@@ -752,8 +798,7 @@ nbd_negotiate_handle_info(NBDClient *client, Error **errp)
     if (client->opt == NBD_OPT_GO) {
         client->exp = exp;
         client->check_align = check_align;
-        QTAILQ_INSERT_TAIL(&client->exp->clients, client, next);
-        blk_exp_ref(&client->exp->common);
+        nbd_client_attach_export(client);
         rc = 1;
     }
     return rc;
@@ -1727,7 +1772,7 @@ static void nbd_drained_end(void *opaque)
     }
 }
 
-/* Runs in export AioContext */
+/* Runs in the client's AioContext */
 static void nbd_wake_read_bh(void *opaque)
 {
     NBDClient *client = opaque;
@@ -1753,7 +1798,7 @@ static bool nbd_drained_poll(void *opaque)
                  * qio_channel_yield().
                  */
                 if (client->recv_coroutine != NULL && client->read_yielding) {
-                    aio_bh_schedule_oneshot(nbd_export_aio_context(client->exp),
+                    aio_bh_schedule_oneshot(nbd_client_aio_context(client),
                                             nbd_wake_read_bh, client);
                 }
 
@@ -1803,6 +1848,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
     uint64_t perm, shared_perm;
     bool readonly = !exp_args->writable;
     BlockDirtyBitmapOrStrList *bitmaps;
+    strList *iothreads;
     size_t i;
     int ret;
 
@@ -1836,11 +1882,32 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
         return size;
     }
 
+    for (iothreads = arg->iothreads; iothreads; iothreads = iothreads->next) {
+        exp->nr_client_ctxs++;
+    }
+    exp->client_iothreads = g_new0(IOThread *, exp->nr_client_ctxs);
+    exp->client_ctxs = g_new0(AioContext *, exp->nr_client_ctxs);
+    for (i = 0, iothreads = arg->iothreads; iothreads;
+         i++, iothreads = iothreads->next)
+    {
+        IOThread *iothread = iothread_by_id(iothreads->value);
+
+        if (!iothread) {
+            error_setg(errp, "iothread \"%s\" not found", iothreads->value);
+            nbd_export_free_client_ctxs(exp);
+            return -EINVAL;
+        }
+        object_ref(OBJECT(iothread));
+        exp->client_iothreads[i] = iothread;
+        exp->client_ctxs[i] = iothread_get_aio_context(iothread);
+    }
+
     /* Don't allow resize while the NBD server is running, otherwise we don't
      * care what happens with the node. */
     blk_get_perm(blk, &perm, &shared_perm);
     ret = blk_set_perm(blk, perm, shared_perm & ~BLK_PERM_RESIZE, errp);
     if (ret < 0) {
+        nbd_export_free_client_ctxs(exp);
         return ret;
     }
 
@@ -1951,6 +2018,7 @@ static int nbd_export_create(BlockExport *blk_exp, BlockExportOptions *exp_args,
 
 fail:
     bdrv_graph_rdunlock_main_loop();
+    nbd_export_free_client_ctxs(exp);
     g_free(exp->export_bitmaps);
     g_free(exp->name);
     g_free(exp->description);
@@ -2021,6 +2089,7 @@ static void nbd_export_delete(BlockExport *blk_exp)
     for (i = 0; i < exp->nr_export_bitmaps; i++) {
         bdrv_dirty_bitmap_set_busy(exp->export_bitmaps[i], false);
     }
+    nbd_export_free_client_ctxs(exp);
 }
 
 const BlockExportDriver blk_exp_nbd = {
@@ -3207,7 +3276,7 @@ static void nbd_client_receive_next_request(NBDClient *client)
         nbd_client_get(client);
         req = nbd_request_get(client);
         client->recv_coroutine = qemu_coroutine_create(nbd_trip, req);
-        aio_co_schedule(client->exp->common.ctx, client->recv_coroutine);
+        aio_co_schedule(nbd_client_aio_context(client), client->recv_coroutine);
     }
 }
 
@@ -19,24 +19,44 @@
 #include "net/checksum.h"
 #include "net/eth.h"
 
+/*
+ * The one's complement sum does not depend on byte order (RFC 1071), so
+ * add up the buffer as native-endian 32-bit words into a 64-bit
+ * accumulator, which the compiler can vectorize, and fix up the byte
+ * order of the folded 16-bit sum at the end.  The result is always
+ * folded, so the callers can add many of them without overflow.
+ */
 uint32_t net_checksum_add_cont(int len, uint8_t *buf, int seq)
 {
-    uint32_t sum1 = 0, sum2 = 0;
-    int i;
+    uint64_t sum = 0;
+    int i = 0;
 
-    for (i = 0; i < len - 1; i += 2) {
-        sum1 += (uint32_t)buf[i];
-        sum2 += (uint32_t)buf[i + 1];
+    for (; i + 16 <= len; i += 16) {
+        sum += (uint64_t)ldl_he_p(buf + i) + ldl_he_p(buf + i + 4) +
+               ldl_he_p(buf + i + 8) + ldl_he_p(buf + i + 12);
+    }
+    for (; i + 4 <= len; i += 4) {
+        sum += ldl_he_p(buf + i);
+    }
+    if (i + 2 <= len) {
+        sum += lduw_he_p(buf + i);
+        i += 2;
     }
     if (i < len) {
-        sum1 += (uint32_t)buf[i];
+        uint8_t last[2] = { buf[i], 0 };
+        sum += lduw_he_p(last);
     }
 
-    if (seq & 1) {
-        return sum1 + (sum2 << 8);
-    } else {
-        return sum2 + (sum1 << 8);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffffffff) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
+    sum = (sum & 0xffff) + (sum >> 16);
+
+    /* Big-endian words for an even @seq, byte-swapped ones for an odd one. */
+    if (HOST_BIG_ENDIAN ? (seq & 1) : !(seq & 1)) {
+        sum = bswap16(sum);
     }
+    return sum;
 }
 
 uint16_t net_checksum_finish(uint32_t sum)
@@ -206,3 +226,28 @@ net_checksum_add_iov(const struct iovec *iov, const unsigned int iov_cnt,
     }
     return res;
 }
+
+void net_toeplitz_table_init(NetToeplitzTable *table, const uint8_t *key)
+{
+    uint32_t byte, bit, value;
+
+    for (byte = 0; byte < NET_TOEPLITZ_MAX_INPUT; byte++) {
+        uint32_t *lut = table->lut[byte];
+        uint32_t window = ldl_be_p(key + byte);
+        uint8_t next = key[byte + 4];
+
+        /* The 32 key bits that bit 7 - @bit of this input byte selects */
+        lut[0] = 0;
+        for (bit = 0; bit < 8; bit++) {
+            lut[0x80 >> bit] = window;
+            window = (window << 1) | (next >> 7);
+            next <<= 1;
+        }
+
+        for (value = 1; value < 256; value++) {
+            uint32_t low = value & -value;
+
+            lut[value] = lut[value & ~low] ^ lut[low];
+        }
+    }
+}
@@ -35,10 +35,13 @@
 #include "net/eth.h"
 #include "net/net.h"
 #include "clients.h"
+#include "migration/cpr.h"
+#include "migration/misc.h"
 #include "monitor/monitor.h"
 #include "system/system.h"
 #include "qapi/error.h"
 #include "qemu/cutils.h"
+#include "qemu/defer-call.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/sockets.h"
@@ -59,9 +62,14 @@ typedef struct TAPState {
     bool has_ufo;
     bool has_uso;
     bool enabled;
+    /* Where the fd handlers run, NULL for the main loop */
+    AioContext *ctx;
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    /* Queue index under which the fd is preserved for cpr, or -1. */
+    int cpr_index;
+    NotifierWithReturn cpr_notifier;
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -72,10 +80,15 @@ static void tap_writable(void *opaque);
 
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll && s->enabled ? tap_send : NULL;
+    IOHandler *fd_write = s->write_poll && s->enabled ? tap_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, fd_read, fd_write,
+                           NULL, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -162,6 +175,8 @@ static void tap_send(void *opaque)
     int size;
     int packets = 0;
 
+    /* Let the peer signal the whole burst to the guest at once */
+    defer_call_begin();
     while (true) {
         uint8_t *buf = s->buf;
         uint8_t min_pkt[ETH_ZLEN];
@@ -203,6 +218,7 @@ static void tap_send(void *opaque)
             break;
         }
     }
+    defer_call_end();
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -286,10 +302,38 @@ static void tap_exit_notify(Notifier *notifier, void *data)
     }
 }
 
+static char *tap_cpr_name(const char *name)
+{
+    return g_strdup_printf("tap/%s", name);
+}
+
+/*
+ * Once cpr-transfer succeeded, the new QEMU owns the interface: do not
+ * tear it down when this process exits.
+ */
+static int tap_cpr_notifier(NotifierWithReturn *notifier,
+                            MigrationEvent *e, Error **errp)
+{
+    TAPState *s = container_of(notifier, TAPState, cpr_notifier);
+
+    if (e->type == MIG_EVENT_PRECOPY_DONE) {
+        s->down_script[0] = '\0';
+    }
+    return 0;
+}
+
 static void tap_cleanup(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
 
+    if (s->cpr_index >= 0) {
+        g_autofree char *cpr_name = tap_cpr_name(nc->name);
+
+        migration_remove_notifier(&s->cpr_notifier);
+        cpr_delete_fd(cpr_name, s->cpr_index);
+        s->cpr_index = -1;
+    }
+
     if (s->vhost_net) {
         vhost_net_cleanup(s->vhost_net);
         g_free(s->vhost_net);
@@ -314,6 +358,21 @@ static void tap_poll(NetClientState *nc, bool enable)
     tap_write_poll(s, enable);
 }
 
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+    bool read_poll = s->read_poll;
+    bool write_poll = s->write_poll;
+
+    s->read_poll = s->write_poll = false;
+    tap_update_fd_handler(s);
+
+    s->ctx = ctx;
+    s->read_poll = read_poll;
+    s->write_poll = write_poll;
+    tap_update_fd_handler(s);
+}
+
 static bool tap_set_steering_ebpf(NetClientState *nc, int prog_fd)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -347,6 +406,7 @@ static NetClientInfo net_tap_info = {
     .set_vnet_le = tap_set_vnet_le,
     .set_vnet_be = tap_set_vnet_be,
     .set_steering_ebpf = tap_set_steering_ebpf,
+    .set_aio_context = tap_set_aio_context,
 };
 
 static TAPState *net_tap_fd_init(NetClientState *peer,
@@ -363,6 +423,7 @@ static TAPState *net_tap_fd_init(NetClientState *peer,
     s = DO_UPCAST(TAPState, nc, nc);
 
     s->fd = fd;
+    s->cpr_index = -1;
     s->host_vnet_hdr_len = vnet_hdr ? sizeof(struct virtio_net_hdr) : 0;
     s->using_vnet_hdr = false;
     s->has_ufo = tap_probe_has_ufo(s->fd);
@@ -607,13 +668,34 @@ int net_init_bridge(const Netdev *netdev, const char *name,
     return 0;
 }
 
-static int net_tap_init(const NetdevTapOptions *tap, int *vnet_hdr,
+/*
+ * Open queue @index of the tap interface of netdev @name.  The fd is
+ * preserved across cpr-transfer, so that the new QEMU inherits the
+ * interface as it was set up, without opening it again or running the
+ * setup script.
+ */
+static int net_tap_init(const NetdevTapOptions *tap, const char *name,
+                        int index, int *vnet_hdr,
                         const char *setup_script, char *ifname,
                         size_t ifname_sz, int mq_required, Error **errp)
 {
+    g_autofree char *cpr_name = tap_cpr_name(name);
     Error *err = NULL;
     int fd, vnet_hdr_required;
 
+    fd = cpr_find_fd(cpr_name, index);
+    if (fd >= 0) {
+        *vnet_hdr = tap_probe_vnet_hdr(fd, errp);
+        if (*vnet_hdr < 0) {
+            return -1;
+        }
+        if (!ifname[0] && tap_fd_get_ifname(fd, ifname)) {
+            error_setg(errp, "Fail to get ifname");
+            return -1;
+        }
+        return fd;
+    }
+
     if (tap->has_vnet_hdr) {
         *vnet_hdr = tap->vnet_hdr;
         vnet_hdr_required = *vnet_hdr;
@@ -639,6 +721,7 @@ static int net_tap_init(const NetdevTapOptions *tap, int *vnet_hdr,
         }
     }
 
+    cpr_save_fd(cpr_name, index, fd);
     return fd;
 }
 
@@ -648,12 +731,18 @@ static void net_init_tap_one(const NetdevTapOptions *tap, NetClientState *peer,
                              const char *model, const char *name,
                              const char *ifname, const char *script,
                              const char *downscript, const char *vhostfdname,
-                             int vnet_hdr, int fd, Error **errp)
+                             int vnet_hdr, int fd, int cpr_index, Error **errp)
 {
     Error *err = NULL;
     TAPState *s = net_tap_fd_init(peer, model, name, fd, vnet_hdr);
     int vhostfd;
 
+    if (cpr_index >= 0) {
+        s->cpr_index = cpr_index;
+        migration_add_notifier_mode(&s->cpr_notifier, tap_cpr_notifier,
+                                    MIG_MODE_CPR_TRANSFER);
+    }
+
     tap_set_sndbuf(s->fd, tap, &err);
     if (err) {
         error_propagate(errp, err);
@@ -813,7 +902,7 @@ int net_init_tap(const Netdev *netdev, const char *name,
 
         net_init_tap_one(tap, peer, "tap", name, NULL,
                          script, downscript,
-                         vhostfdname, vnet_hdr, fd, &err);
+                         vhostfdname, vnet_hdr, fd, -1, &err);
         if (err) {
             error_propagate(errp, err);
             close(fd);
@@ -877,7 +966,7 @@ int net_init_tap(const Netdev *netdev, const char *name,
             net_init_tap_one(tap, peer, "tap", name, ifname,
                              script, downscript,
                              tap->vhostfds ? vhost_fds[i] : NULL,
-                             vnet_hdr, fd, &err);
+                             vnet_hdr, fd, -1, &err);
             if (err) {
                 error_propagate(errp, err);
                 ret = -1;
@@ -922,7 +1011,7 @@ free_fail:
 
         net_init_tap_one(tap, peer, "bridge", name, ifname,
                          script, downscript, vhostfdname,
-                         vnet_hdr, fd, &err);
+                         vnet_hdr, fd, -1, &err);
         if (err) {
             error_propagate(errp, err);
             close(fd);
@@ -951,7 +1040,8 @@ free_fail:
         }
 
         for (i = 0; i < queues; i++) {
-            fd = net_tap_init(tap, &vnet_hdr, i >= 1 ? "no" : script,
+            fd = net_tap_init(tap, name, i, &vnet_hdr,
+                              i >= 1 ? "no" : script,
                               ifname, sizeof ifname, queues > 1, errp);
             if (fd == -1) {
                 return -1;
@@ -968,7 +1058,7 @@ free_fail:
             net_init_tap_one(tap, peer, "tap", name, ifname,
                              i >= 1 ? "no" : script,
                              i >= 1 ? "no" : downscript,
-                             vhostfdname, vnet_hdr, fd, &err);
+                             vhostfdname, vnet_hdr, fd, i, &err);
             if (err) {
                 error_propagate(errp, err);
                 close(fd);
@@ -188,6 +188,13 @@ void qemu_plugin_register_vcpu_mem_inline_per_vcpu(
     plugin_register_inline_op_on_entry(&insn->mem_cbs, rw, op, entry, imm);
 }
 
+void qemu_plugin_register_vcpu_mem_trace(struct qemu_plugin_insn *insn,
+                                         enum qemu_plugin_mem_rw rw,
+                                         struct qemu_plugin_mem_trace *trace)
+{
+    plugin_register_vcpu_mem_trace(&insn->mem_cbs, rw, trace);
+}
+
 void qemu_plugin_register_vcpu_tb_trans_cb(qemu_plugin_id_t id,
                                            qemu_plugin_vcpu_tb_trans_cb_t cb)
 {
@@ -481,6 +488,26 @@ void *qemu_plugin_scoreboard_find(struct qemu_plugin_scoreboard *score,
     return base_ptr + vcpu_index * g_array_get_element_size(score->data);
 }
 
+struct qemu_plugin_mem_trace *
+qemu_plugin_mem_trace_new(size_t n_entries,
+                          qemu_plugin_vcpu_mem_trace_cb_t cb,
+                          void *userdata)
+{
+    return plugin_mem_trace_new(n_entries, cb, userdata);
+}
+
+void qemu_plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace)
+{
+    plugin_mem_trace_free(trace);
+}
+
+void qemu_plugin_mem_trace_flush(struct qemu_plugin_mem_trace *trace,
+                                 unsigned int vcpu_index)
+{
+    g_assert(vcpu_index < qemu_plugin_num_vcpus());
+    plugin_mem_trace_flush(trace, vcpu_index);
+}
+
 static uint64_t *plugin_u64_address(qemu_plugin_u64 entry,
                                     unsigned int vcpu_index)
 {
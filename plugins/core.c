@@ -457,6 +457,105 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
     dyn_cb->regular = regular_cb;
 }
 
+static struct qemu_plugin_mem_trace_buf *
+plugin_mem_trace_buf(struct qemu_plugin_mem_trace *trace, int cpu_index)
+{
+    GArray *arr = trace->score->data;
+
+    return (struct qemu_plugin_mem_trace_buf *)
+        (arr->data + cpu_index * g_array_get_element_size(arr));
+}
+
+/*
+ * Disable CFI checks.
+ * The callback function has been loaded from an external library so we do not
+ * have type information
+ */
+QEMU_DISABLE_CFI
+void plugin_mem_trace_flush(struct qemu_plugin_mem_trace *trace,
+                            int cpu_index)
+{
+    struct qemu_plugin_mem_trace_buf *buf =
+        plugin_mem_trace_buf(trace, cpu_index);
+
+    if (buf->count) {
+        trace->cb(cpu_index, buf->entries, buf->count, trace->userp);
+        buf->count = 0;
+    }
+}
+
+/* Called from generated code once the buffer of a vcpu is full. */
+static void plugin_mem_trace_full(unsigned int cpu_index, void *userp)
+{
+    plugin_mem_trace_flush(userp, cpu_index);
+}
+
+static void plugin_mem_trace_append(struct qemu_plugin_mem_trace *trace,
+                                    int cpu_index, uint64_t vaddr,
+                                    qemu_plugin_meminfo_t info)
+{
+    struct qemu_plugin_mem_trace_buf *buf =
+        plugin_mem_trace_buf(trace, cpu_index);
+
+    buf->entries[buf->count].vaddr = vaddr;
+    buf->entries[buf->count].info = info;
+    if (++buf->count == trace->n_entries) {
+        plugin_mem_trace_flush(trace, cpu_index);
+    }
+}
+
+struct qemu_plugin_mem_trace *
+plugin_mem_trace_new(size_t n_entries,
+                     qemu_plugin_vcpu_mem_trace_cb_t cb, void *udata)
+{
+    struct qemu_plugin_mem_trace *trace;
+
+    assert(n_entries > 0);
+    trace = g_new0(struct qemu_plugin_mem_trace, 1);
+    trace->score = plugin_scoreboard_new(
+        sizeof(struct qemu_plugin_mem_trace_buf) +
+        n_entries * sizeof(qemu_plugin_mem_trace_entry));
+    trace->n_entries = n_entries;
+    trace->cb = cb;
+    trace->userp = udata;
+    return trace;
+}
+
+void plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace)
+{
+    plugin_scoreboard_free(trace->score);
+    g_free(trace);
+}
+
+void plugin_register_vcpu_mem_trace(GArray **arr,
+                                    enum qemu_plugin_mem_rw rw,
+                                    struct qemu_plugin_mem_trace *trace)
+{
+    static TCGHelperInfo info = {
+        .flags = TCG_CALL_NO_RWG,
+        /*
+         * Match plugin_mem_trace_full:
+         *   void (*)(uint32_t, void *)
+         */
+        .typemask = (dh_typemask(void, 0) |
+                     dh_typemask(i32, 1) |
+                     dh_typemask(ptr, 2))
+    };
+
+    /*
+     * The buffer is filled inline; the regular callback is only the
+     * slow path taken when it is full.
+     */
+    struct qemu_plugin_dyn_cb *dyn_cb = plugin_get_dyn_cb(arr);
+    struct qemu_plugin_regular_cb regular_cb = {
+        .userp = trace,
+        .rw = rw,
+        .f.vcpu_udata = plugin_mem_trace_full,
+        .info = &info };
+    dyn_cb->type = PLUGIN_CB_MEM_TRACE;
+    dyn_cb->regular = regular_cb;
+}
+
 /*
  * Disable CFI checks.
  * The callback function has been loaded from an external library so we do not
@@ -626,6 +725,12 @@ void qemu_plugin_vcpu_mem_cb(CPUState *cpu, uint64_t vaddr,
                 exec_inline_op(cb->type, &cb->inline_insn, cpu->cpu_index);
             }
             break;
+        case PLUGIN_CB_MEM_TRACE:
+            if (rw & cb->regular.rw) {
+                plugin_mem_trace_append(cb->regular.userp, cpu->cpu_index,
+                                        vaddr, make_plugin_meminfo(oi, rw));
+            }
+            break;
         default:
             g_assert_not_reached();
         }
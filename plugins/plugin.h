@@ -109,6 +109,19 @@ void plugin_register_vcpu_mem_cb(GArray **arr,
                                  enum qemu_plugin_mem_rw rw,
                                  void *udata);
 
+struct qemu_plugin_mem_trace *
+plugin_mem_trace_new(size_t n_entries,
+                     qemu_plugin_vcpu_mem_trace_cb_t cb, void *udata);
+
+void plugin_mem_trace_free(struct qemu_plugin_mem_trace *trace);
+
+void plugin_mem_trace_flush(struct qemu_plugin_mem_trace *trace,
+                            int cpu_index);
+
+void plugin_register_vcpu_mem_trace(GArray **arr,
+                                    enum qemu_plugin_mem_rw rw,
+                                    struct qemu_plugin_mem_trace *trace);
+
 void exec_inline_op(enum plugin_dyn_cb_type type,
                     struct qemu_plugin_inline_cb *cb,
                     int cpu_index);
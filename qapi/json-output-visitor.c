@@ -0,0 +1,219 @@
+/*
+ * JSON Output Visitor
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2.1 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/compat-policy.h"
+#include "qapi/json-output-visitor.h"
+#include "qapi/visitor-impl.h"
+#include "qobject/json-writer.h"
+#include "qobject/qjson.h"
+
+struct JSONOutputVisitor {
+    Visitor visitor;
+
+    JSONWriter *writer;
+    unsigned int depth; /* Number of unfinished containers */
+    bool has_root;      /* Don't allow reuse on more than one root */
+    char **result;      /* User's storage location for result */
+};
+
+static JSONOutputVisitor *to_jov(Visitor *v)
+{
+    return container_of(v, JSONOutputVisitor, visitor);
+}
+
+static void json_output_value(JSONOutputVisitor *jov)
+{
+    if (!jov->depth) {
+        assert(!jov->has_root);
+        jov->has_root = true;
+    }
+}
+
+static bool json_output_start_struct(Visitor *v, const char *name,
+                                     void **obj, size_t unused, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_start_object(jov->writer, name);
+    jov->depth++;
+    return true;
+}
+
+static void json_output_end_struct(Visitor *v, void **obj)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    assert(jov->depth);
+    jov->depth--;
+    json_writer_end_object(jov->writer);
+}
+
+static bool json_output_start_list(Visitor *v, const char *name,
+                                   GenericList **listp, size_t size,
+                                   Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_start_array(jov->writer, name);
+    jov->depth++;
+    return true;
+}
+
+static GenericList *json_output_next_list(Visitor *v, GenericList *tail,
+                                          size_t size)
+{
+    return tail->next;
+}
+
+static void json_output_end_list(Visitor *v, void **obj)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    assert(jov->depth);
+    jov->depth--;
+    json_writer_end_array(jov->writer);
+}
+
+static bool json_output_type_int64(Visitor *v, const char *name,
+                                   int64_t *obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_int64(jov->writer, name, *obj);
+    return true;
+}
+
+static bool json_output_type_uint64(Visitor *v, const char *name,
+                                    uint64_t *obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_uint64(jov->writer, name, *obj);
+    return true;
+}
+
+static bool json_output_type_bool(Visitor *v, const char *name, bool *obj,
+                                  Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_bool(jov->writer, name, *obj);
+    return true;
+}
+
+static bool json_output_type_str(Visitor *v, const char *name, char **obj,
+                                 Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_str(jov->writer, name, *obj ? *obj : "");
+    return true;
+}
+
+static bool json_output_type_number(Visitor *v, const char *name,
+                                    double *obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_double(jov->writer, name, *obj);
+    return true;
+}
+
+static bool json_output_type_any(Visitor *v, const char *name,
+                                 QObject **obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+    g_autoptr(GString) json = qobject_to_json(*obj);
+
+    json_output_value(jov);
+    json_writer_raw(jov->writer, name, json->str);
+    return true;
+}
+
+static bool json_output_type_null(Visitor *v, const char *name,
+                                  QNull **obj, Error **errp)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    json_output_value(jov);
+    json_writer_null(jov->writer, name);
+    return true;
+}
+
+static bool json_output_policy_skip(Visitor *v, const char *name,
+                                    uint64_t features)
+{
+    CompatPolicy *pol = &v->compat_policy;
+
+    return ((features & 1u << QAPI_DEPRECATED)
+            && pol->deprecated_output == COMPAT_POLICY_OUTPUT_HIDE)
+        || ((features & 1u << QAPI_UNSTABLE)
+            && pol->unstable_output == COMPAT_POLICY_OUTPUT_HIDE);
+}
+
+static void json_output_complete(Visitor *v, void *opaque)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    /* A visit must have occurred, with each start paired with end.  */
+    assert(jov->has_root && !jov->depth);
+    assert(opaque == jov->result);
+
+    *jov->result = g_string_free(json_writer_get_and_free(jov->writer),
+                                 false);
+    jov->writer = NULL;
+    jov->result = NULL;
+}
+
+static void json_output_free(Visitor *v)
+{
+    JSONOutputVisitor *jov = to_jov(v);
+
+    if (jov->writer) {
+        json_writer_free(jov->writer);
+    }
+    g_free(jov);
+}
+
+Visitor *json_output_visitor_new(bool pretty, char **result)
+{
+    JSONOutputVisitor *v;
+
+    v = g_malloc0(sizeof(*v));
+
+    v->visitor.type = VISITOR_OUTPUT;
+    v->visitor.start_struct = json_output_start_struct;
+    v->visitor.end_struct = json_output_end_struct;
+    v->visitor.start_list = json_output_start_list;
+    v->visitor.next_list = json_output_next_list;
+    v->visitor.end_list = json_output_end_list;
+    v->visitor.type_int64 = json_output_type_int64;
+    v->visitor.type_uint64 = json_output_type_uint64;
+    v->visitor.type_bool = json_output_type_bool;
+    v->visitor.type_str = json_output_type_str;
+    v->visitor.type_number = json_output_type_number;
+    v->visitor.type_any = json_output_type_any;
+    v->visitor.type_null = json_output_type_null;
+    v->visitor.policy_skip = json_output_policy_skip;
+    v->visitor.complete = json_output_complete;
+    v->visitor.free = json_output_free;
+
+    v->writer = json_writer_new(pretty);
+    *result = NULL;
+    v->result = result;
+
+    return &v->visitor;
+}
@@ -1166,6 +1166,30 @@ static int64_t find_nonzero(const uint8_t *buf, int64_t n)
     return -1;
 }
 
+/*
+ * Like is_allocated_sectors, but looks at whole clusters of 'cluster_sectors'
+ * sectors, as compressed clusters can only be written as a whole.  The last
+ * cluster may be partial.
+ */
+static int is_allocated_clusters(const uint8_t *buf, int n, int *pnum,
+                                 int cluster_sectors)
+{
+    bool is_zero;
+    int i;
+
+    is_zero = buffer_is_zero(buf, MIN(n, cluster_sectors) * BDRV_SECTOR_SIZE);
+    for (i = cluster_sectors; i < n; i += cluster_sectors) {
+        if (is_zero != buffer_is_zero(buf + i * BDRV_SECTOR_SIZE,
+                                      MIN(n - i, cluster_sectors) *
+                                      BDRV_SECTOR_SIZE)) {
+            break;
+        }
+    }
+
+    *pnum = MIN(i, n);
+    return !is_zero;
+}
+
 /*
  * Returns true iff the first sector pointed to by 'buf' contains at least
  * a non-NUL byte.
@@ -1682,6 +1706,8 @@ typedef struct ImgConvertState {
     BlockBackend *target;
     bool has_zero_init;
     bool compressed;
+    /* The target compresses the clusters of one request in parallel */
+    bool compress_multiple_clusters;
     bool target_is_new;
     bool target_has_backing;
     int64_t target_backing_sectors; /* negative if unknown */
@@ -1904,7 +1930,7 @@ static int coroutine_fn convert_co_write(ImgConvertState *s, int64_t sector_num,
                  is_allocated_sectors_min(buf, n, &n, s->min_sparse,
                                           sector_num, s->alignment)) ||
                 (s->compressed &&
-                 !buffer_is_zero(buf, n * BDRV_SECTOR_SIZE)))
+                 is_allocated_clusters(buf, n, &n, s->cluster_sectors)))
             {
                 ret = blk_co_pwrite(s->target, sector_num << BDRV_SECTOR_BITS,
                                     n << BDRV_SECTOR_BITS, buf, flags);
@@ -2106,13 +2132,20 @@ static int convert_do_copy(ImgConvertState *s)
     }
 
     /* Allocate buffer for copied data. For compressed images, only one cluster
-     * can be copied at a time. */
+     * can be copied at a time, unless the target compresses the clusters of a
+     * request in parallel: then writing them together keeps several threads
+     * busy even though writes are in order. */
     if (s->compressed) {
         if (s->cluster_sectors <= 0 || s->cluster_sectors > s->buf_sectors) {
             error_report("invalid cluster size");
             return -EINVAL;
         }
-        s->buf_sectors = s->cluster_sectors;
+        if (s->compress_multiple_clusters) {
+            s->buf_sectors = QEMU_ALIGN_DOWN(s->buf_sectors,
+                                             s->cluster_sectors);
+        } else {
+            s->buf_sectors = s->cluster_sectors;
+        }
     }
 
     while (sector_num < s->total_sectors) {
@@ -2777,6 +2810,8 @@ static int img_convert(int argc, char **argv)
     } else {
         s.compressed = s.compressed || bdi.needs_compressed_writes;
         s.cluster_sectors = bdi.cluster_size / BDRV_SECTOR_SIZE;
+        s.compress_multiple_clusters =
+            out_bs->drv->bdrv_co_pwritev_compressed_part != NULL;
     }
 
     if (rate_limit) {
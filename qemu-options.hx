@@ -40,6 +40,7 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                hmat=on|off controls ACPI HMAT support (default=off)\n"
 #ifdef CONFIG_POSIX
     "                aux-ram-share=on|off allocate auxiliary guest RAM as shared (default: off)\n"
+    "                rom-file-share=on|off map image files into guest RAM copy-on-write (default: off)\n"
 #endif
     "                memory-backend='backend-id' specifies explicitly provided backend for main RAM (default=none)\n"
     "                cxl-fmw.0.targets.0=firsttarget,cxl-fmw.0.targets.1=secondtarget,cxl-fmw.0.size=size[,cxl-fmw.0.interleave-granularity=granularity]\n"
@@ -115,6 +116,20 @@ SRST
 
         To use the cpr-transfer migration mode, you must set aux-ram-share=on.
 
+    ``rom-file-share=on|off``
+        Map raw image files that are loaded into guest RAM, such as
+        firmware, kernel or initrd images, copy-on-write from the file
+        instead of copying them.  Until the guest writes to them, the
+        pages of the image are shared with the host page cache and with
+        every other VM that loads the same file, without waiting for
+        the memory merge support to find them.  Only page-aligned parts
+        of images that are loaded into private anonymous RAM are mapped,
+        and never when the guest RAM must not be discarded, for example
+        because of device assignment, with TCG, with ``mem-lock``, or when
+        the memory backend sets a NUMA policy or preallocates memory.
+        Discarded guest RAM still reads as zeroes.  The image files must
+        not be modified while the VM is running.  The default is off.
+
     ``memory-backend='id'``
         An alternative to legacy ``-mem-path`` and ``mem-prealloc`` options.
         Allows to use a memory backend as main RAM.
@@ -228,7 +243,11 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                one-insn-per-tb=on|off (one guest instruction per TCG translation block)\n"
     "                split-wx=on|off (enable TCG split w^x mapping)\n"
     "                tb-size=n (TCG translation block cache size)\n"
-    "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
+    "                vtlb-size=n (TCG victim TLB entries per MMU mode, default 64)\n"
+    "                vcpu-affinity=cpus (pin TCG vCPU threads to host CPUs)\n"
+    "                halt-poll-ns=n (TCG idle vCPU wakeup polling time, default 0)\n"
+    "                dirty-granularity=n (TCG dirty tracking granularity, default 0)\n"
+    "                dirty-ring-size=n (KVM/TCG dirty ring GFN count, default 0)\n"
     "                eager-split-size=n (KVM Eager Page Split chunk size, default 0, disabled. ARM only)\n"
     "                notify-vmexit=run|internal-error|disable,notify-window=n (enable notify VM exit and set notify window, x86 only)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n"
@@ -271,6 +290,34 @@ SRST
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
+    ``vtlb-size=n``
+        Controls the number of entries of the TCG victim TLB of each MMU
+        mode, which holds translations evicted from the main TLB. It must
+        be a power of 2 between 8 and 512 (default=64). Victim TLB hits
+        and misses are reported by ``info jit``.
+
+    ``vcpu-affinity=cpus``
+        Pins each multi-threaded TCG vCPU thread to a single host CPU. vCPU
+        N runs on the Nth host CPU of the list, wrapping around if there are
+        more vCPUs than host CPUs. The list is given as ranges, e.g.
+        ``vcpu-affinity=4-7``; use ``,,`` to separate entries, e.g.
+        ``vcpu-affinity=0,,2-3``. Combine with ``-object thread-context``
+        to keep iothreads on other host CPUs.
+
+    ``halt-poll-ns=n``
+        Lets an idle multi-threaded TCG vCPU thread poll for up to n
+        nanoseconds for a wakeup before it goes to sleep (default=0,
+        maximum 10000000). This cuts wakeup latency for guests that send
+        many IPIs, at the cost of host CPU time spent polling.
+
+    ``dirty-granularity=n``
+        Makes the first write to a clean page during TCG dirty tracking
+        (e.g. live migration) mark the whole surrounding n-byte aligned
+        range of guest RAM dirty, so that guests writing densely to large
+        pages take one slow-path trap per range instead of one per page.
+        n must be a power of 2 no larger than 2M; 0 or any value not above
+        the target page size keeps per-page tracking (default=0).
+
     ``thread=single|multi``
         Controls number of TCG threads. When the TCG is multi-threaded
         there will be one thread per vCPU therefore taking advantage of
@@ -289,6 +336,12 @@ SRST
         is disabled (dirty-ring-size=0).  When enabled, KVM will instead
         record dirty pages in a bitmap.
 
+        With TCG, each vCPU queues the pages it dirties in a ring of n
+        entries that is harvested on every dirty log sync, instead of
+        updating the dirty bitmap shared by all vCPUs.  n must be a power
+        of two.  This also enables the dirty-limit migration capability
+        and the dirty-ring mode of calc-dirty-rate.
+
     ``eager-split-size=n``
         KVM implements dirty page logging at the PAGE_SIZE granularity and
         enabling dirty-logging on a huge-page requires breaking it into
@@ -426,7 +479,7 @@ ERST
 
 DEF("numa", HAS_ARG, QEMU_OPTION_numa,
     "-numa node[,mem=size][,cpus=firstcpu[-lastcpu]][,nodeid=node][,initiator=node]\n"
-    "-numa node[,memdev=id][,cpus=firstcpu[-lastcpu]][,nodeid=node][,initiator=node]\n"
+    "-numa node[,memdev=id][,cpus=firstcpu[-lastcpu]][,nodeid=node][,initiator=node][,thread-context=id]\n"
     "-numa dist,src=source,dst=destination,val=distance\n"
     "-numa cpu,node-id=node[,socket-id=x][,core-id=y][,thread-id=z]\n"
     "-numa hmat-lb,initiator=node,target=node,hierarchy=memory|first-level|second-level|third-level,data-type=access-latency|read-latency|write-latency[,latency=lat][,bandwidth=bw]\n"
@@ -435,7 +488,7 @@ DEF("numa", HAS_ARG, QEMU_OPTION_numa,
 SRST
 ``-numa node[,mem=size][,cpus=firstcpu[-lastcpu]][,nodeid=node][,initiator=initiator]``
   \ 
-``-numa node[,memdev=id][,cpus=firstcpu[-lastcpu]][,nodeid=node][,initiator=initiator]``
+``-numa node[,memdev=id][,cpus=firstcpu[-lastcpu]][,nodeid=node][,initiator=initiator][,thread-context=id]``
   \
 ``-numa dist,src=source,dst=destination,val=distance``
   \ 
@@ -520,6 +573,27 @@ SRST
         -numa cpu,node-id=0,socket-id=0 \
         -numa cpu,node-id=0,socket-id=1
 
+    '\ ``thread-context``\ ' places the vCPU threads of the NUMA node on
+    the host CPUs that the thread context object with the given id has
+    affinity to.  Together with '\ ``host-nodes``\ ' of the memory
+    backend and the '\ ``thread-context``\ ' of the iothreads that
+    serve the node's devices, this keeps each guest node on one host
+    node.  For example, on a host with two NUMA nodes:
+
+    ::
+
+        -object thread-context,id=tc0,node-affinity=0 \
+        -object thread-context,id=tc1,node-affinity=1 \
+        -object memory-backend-ram,size=1G,id=m0,host-nodes=0,policy=bind \
+        -object memory-backend-ram,size=1G,id=m1,host-nodes=1,policy=bind \
+        -object iothread,id=io0,thread-context=tc0 \
+        -object iothread,id=io1,thread-context=tc1 \
+        -smp 4,sockets=2 \
+        -numa node,nodeid=0,memdev=m0,thread-context=tc0 \
+        -numa node,nodeid=1,memdev=m1,thread-context=tc1 \
+        -numa cpu,node-id=0,socket-id=0 \
+        -numa cpu,node-id=1,socket-id=1
+
     source and destination are NUMA node IDs. distance is the NUMA
     distance from source to destination. The distance from a node to
     itself is always 10. If any pair of nodes is given a distance, then
@@ -2909,6 +2983,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
 #ifdef CONFIG_AF_XDP
     "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
     "         [,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]\n"
+    "         [,busy-poll-budget=b]\n"
     "                attach to the existing network interface 'name' with AF_XDP socket\n"
     "                use 'mode=MODE' to specify an XDP program attach mode\n"
     "                use 'force-copy=on|off' to force XDP copy mode even if device supports zero-copy (default: off)\n"
@@ -2918,6 +2993,7 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                  added to a socket map in XDP program.  One socket per queue.\n"
     "                use 'queues=n' to specify how many queues of a multiqueue interface should be used\n"
     "                use 'start-queue=m' to specify the first queue that should be used\n"
+    "                use 'busy-poll-budget=b' to busy poll the device, up to b packets at a time\n"
 #endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
@@ -3610,7 +3686,7 @@ SRST
         # launch QEMU instance
         |qemu_system| linux.img -nic vde,sock=/tmp/myswitch
 
-``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z]``
+``-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,inhibit=on|off][,sock-fds=x:y:...:z][,busy-poll-budget=b]``
     Configure AF_XDP backend to connect to a network interface 'name'
     using AF_XDP socket.  A specific program attach mode for a default
     XDP program can be forced with 'mode', defaults to best-effort,
@@ -3659,6 +3735,19 @@ SRST
         |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
             -netdev af-xdp,id=n1,ifname=eth0,queues=3,inhibit=on,sock-fds=15:16:17
 
+    With 'busy-poll-budget' set, the sockets prefer busy polling: QEMU
+    runs the NAPI context of the device queues itself, up to 'b' packets
+    at a time, whenever it looks for received packets.  Interrupts are
+    then only deferred if the interface is configured for it, e.g. with
+    the napi_defer_hard_irqs and gro_flush_timeout sysfs attributes.
+
+    .. parsed-literal::
+
+        echo 2 > /sys/class/net/eth0/napi_defer_hard_irqs
+        echo 200000 > /sys/class/net/eth0/gro_flush_timeout
+        |qemu_system| linux.img -device virtio-net-pci,netdev=n1 \\
+            -netdev af-xdp,id=n1,ifname=eth0,busy-poll-budget=64
+
 ``-netdev vhost-user,chardev=id[,vhostforce=on|off][,queues=n]``
     Establish a vhost-user netdev, backed by a chardev id. The chardev
     should be a unix domain socket backed one. The vhost-user uses a
@@ -4917,13 +5006,13 @@ SRST
 ERST
 
 DEF("icount", HAS_ARG, QEMU_OPTION_icount, \
-    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>]]\n" \
+    "-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=<filename>[,rrsnapshot=<snapshot>][,rrcompress=on|off]]\n" \
     "                enable virtual instruction counter with 2^N clock ticks per\n" \
     "                instruction, enable aligning the host and virtual clocks\n" \
     "                or disable real time cpu sleeping, and optionally enable\n" \
     "                record-and-replay mode\n", QEMU_ARCH_ALL)
 SRST
-``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot]]``
+``-icount [shift=N|auto][,align=on|off][,sleep=on|off][,rr=record|replay,rrfile=filename[,rrsnapshot=snapshot][,rrcompress=on|off]]``
     Enable virtual instruction counter. The virtual cpu will execute one
     instruction every 2^N ns of virtual time. If ``auto`` is specified
     then the virtual cpu speed will be automatically adjusted to keep
@@ -4965,6 +5054,8 @@ SRST
     name. In record mode, a new VM snapshot with the given name is created
     at the start of execution recording. In replay mode this option
     specifies the snapshot name used to load the initial VM state.
+    ``rrcompress=on`` makes record mode write the log as zstd compressed
+    blocks; replay mode detects compressed logs automatically.
 ERST
 
 DEF("watchdog-action", HAS_ARG, QEMU_OPTION_watchdog_action, \
@@ -1096,6 +1096,8 @@ typedef struct OCFData
 {
     void (*fn)(ObjectClass *klass, void *opaque);
     const char *implements_type;
+    /* Set if implements_type is a class, to filter before class_init */
+    TypeImpl *implements_impl;
     bool include_abstract;
     void *opaque;
 } OCFData;
@@ -1107,6 +1109,16 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
     TypeImpl *type = value;
     ObjectClass *k;
 
+    /*
+     * Only interfaces need the class to be initialized to tell whether
+     * it implements them; don't run class_init for every unrelated type
+     * just to look for e.g. machine types.
+     */
+    if (data->implements_impl &&
+        !type_is_ancestor(type, data->implements_impl)) {
+        return;
+    }
+
     type_initialize(type);
     k = type->class;
 
@@ -1114,7 +1126,7 @@ static void object_class_foreach_tramp(gpointer key, gpointer value,
         return;
     }
 
-    if (data->implements_type && 
+    if (data->implements_type && !data->implements_impl &&
         !object_class_dynamic_cast(k, data->implements_type)) {
         return;
     }
@@ -1126,7 +1138,15 @@ void object_class_foreach(void (*fn)(ObjectClass *klass, void *opaque),
                           const char *implements_type, bool include_abstract,
                           void *opaque)
 {
-    OCFData data = { fn, implements_type, include_abstract, opaque };
+    OCFData data = { fn, implements_type, NULL, include_abstract, opaque };
+
+    if (implements_type) {
+        TypeImpl *target = type_get_by_name_noload(implements_type);
+
+        if (target && !type_is_ancestor(target, type_interface)) {
+            data.implements_impl = target;
+        }
+    }
 
     enumerating_types = true;
     g_hash_table_foreach(type_table_get(), object_class_foreach_tramp, &data);
@@ -1814,6 +1834,7 @@ static void object_finalize_child_property(Object *obj, const char *name,
         (child->class->unparent)(child);
     }
     child->parent = NULL;
+    child->child_name = NULL;
     object_unref(child);
 }
 
@@ -1837,6 +1858,7 @@ object_property_try_add_child(Object *obj, const char *name,
     op->resolve = object_resolve_child_property;
     object_ref(child);
     child->parent = obj;
+    child->child_name = op->name;
     return op;
 }
 
@@ -2077,26 +2099,17 @@ object_property_add_const_link(Object *obj, const char *name,
 
 const char *object_get_canonical_path_component(const Object *obj)
 {
-    ObjectProperty *prop = NULL;
-    GHashTableIter iter;
-
     if (obj->parent == NULL) {
         return NULL;
     }
 
-    g_hash_table_iter_init(&iter, obj->parent->properties);
-    while (g_hash_table_iter_next(&iter, NULL, (gpointer *)&prop)) {
-        if (!object_property_is_child(prop)) {
-            continue;
-        }
-
-        if (prop->opaque == obj) {
-            return prop->name;
-        }
-    }
-
-    /* obj had a parent but was not a child, should never happen */
-    g_assert_not_reached();
+    /*
+     * Remembered when the object was added, rather than looked up among
+     * the properties of the parent: containers such as
+     * /machine/unattached can have thousands of children.
+     */
+    assert(obj->child_name);
+    return obj->child_name;
 }
 
 char *object_get_canonical_path(const Object *obj)
@@ -15,6 +15,12 @@
 #include "replay-internal.h"
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
+#include "qemu/bswap.h"
+#include "qemu/queue.h"
+#include "qemu/units.h"
+#ifdef CONFIG_ZSTD
+#include <zstd.h>
+#endif
 
 /* Mutex to protect reading and writing events to the log.
    data_kind and has_unread_data are also protected
@@ -44,12 +50,377 @@ static void replay_read_error(void)
     exit(1);
 }
 
-void replay_put_byte(uint8_t byte)
+/*
+ * In record mode the events are collected in chunks that a background
+ * thread writes to replay_file, so that the vCPU and main loop threads
+ * do not wait for stdio while they hold the replay mutex.
+ *
+ * A compressed log stores each chunk as a block: the big-endian raw
+ * and compressed sizes followed by the zstd frame.  The block index at
+ * the end of the file maps the offsets of the uncompressed stream to
+ * the blocks, so replay_log_seek() only has to decompress one block.
+ * The offsets seen by the rest of replay, e.g. those saved in the
+ * snapshots, are always offsets of the uncompressed stream.
+ */
+#define REPLAY_LOG_CHUNK_SIZE   (64 * KiB)
+/* Throttle the producers if this many chunks are waiting for the disk */
+#define REPLAY_LOG_MAX_CHUNKS   64
+#define REPLAY_LOG_ZSTD_LEVEL   1
+
+typedef struct ReplayLogChunk {
+    QSIMPLEQ_ENTRY(ReplayLogChunk) next;
+    size_t len;
+    uint8_t data[REPLAY_LOG_CHUNK_SIZE];
+} ReplayLogChunk;
+
+typedef struct ReplayLogIndexEntry {
+    /* Offset of the first byte of the block in the uncompressed stream */
+    uint64_t offset;
+    /* Position of the block header in replay_file */
+    uint64_t file_pos;
+} ReplayLogIndexEntry;
+
+/* Protected by the replay mutex */
+static bool log_buffered;
+static bool log_compressed;
+static ReplayLogChunk *log_chunk;
+/* Offset in the event stream of the first byte of log_chunk */
+static uint64_t log_offset;
+
+/* Protected by log_lock */
+static QemuMutex log_lock;
+static QemuCond log_cond;
+static QSIMPLEQ_HEAD(, ReplayLogChunk) log_queue =
+    QSIMPLEQ_HEAD_INITIALIZER(log_queue);
+static unsigned int log_queued;
+static bool log_stop;
+static bool log_thread_running;
+static QemuThread log_thread;
+
+/*
+ * Block index of a compressed log.  In record mode it is only used by
+ * the writer thread until replay_log_finish() joins it.
+ */
+static GArray *log_index;
+
+/* Compressed playback, protected by the replay mutex */
+static ReplayLogChunk *read_chunk;
+static size_t read_pos;
+static guint read_block;
+
+#ifdef CONFIG_ZSTD
+/* Only used by the writer thread */
+static ZSTD_CCtx *log_cctx;
+static uint8_t *log_zbuf;
+static uint64_t log_written;
+
+static void replay_log_write_block(ReplayLogChunk *chunk)
 {
-    if (replay_file) {
-        if (putc(byte, replay_file) == EOF) {
+    size_t zbuf_size = ZSTD_compressBound(REPLAY_LOG_CHUNK_SIZE);
+    ReplayLogIndexEntry entry;
+    uint8_t header[8];
+    size_t zlen;
+    long pos;
+
+    if (!log_cctx) {
+        log_cctx = ZSTD_createCCtx();
+        log_zbuf = g_malloc(zbuf_size);
+    }
+    zlen = ZSTD_compressCCtx(log_cctx, log_zbuf, zbuf_size,
+                             chunk->data, chunk->len, REPLAY_LOG_ZSTD_LEVEL);
+    pos = ftell(replay_file);
+    if (ZSTD_isError(zlen) || pos < 0) {
+        replay_write_error();
+        return;
+    }
+
+    entry.offset = log_written;
+    entry.file_pos = pos;
+    g_array_append_val(log_index, entry);
+    log_written += chunk->len;
+
+    stl_be_p(header, chunk->len);
+    stl_be_p(header + 4, zlen);
+    if (fwrite(header, 1, sizeof(header), replay_file) != sizeof(header) ||
+        fwrite(log_zbuf, 1, zlen, replay_file) != zlen) {
+        replay_write_error();
+    }
+}
+
+static bool replay_log_read_block(guint block)
+{
+    ReplayLogIndexEntry *entry;
+    uint8_t header[8];
+    uint32_t len, zlen;
+    g_autofree uint8_t *zbuf = NULL;
+
+    if (block >= log_index->len) {
+        return false;
+    }
+    entry = &g_array_index(log_index, ReplayLogIndexEntry, block);
+    if (fseek(replay_file, entry->file_pos, SEEK_SET) ||
+        fread(header, 1, sizeof(header), replay_file) != sizeof(header)) {
+        return false;
+    }
+    len = ldl_be_p(header);
+    zlen = ldl_be_p(header + 4);
+    if (len > REPLAY_LOG_CHUNK_SIZE ||
+        zlen > ZSTD_compressBound(REPLAY_LOG_CHUNK_SIZE)) {
+        return false;
+    }
+
+    zbuf = g_malloc(zlen);
+    if (fread(zbuf, 1, zlen, replay_file) != zlen ||
+        ZSTD_decompress(read_chunk->data, len, zbuf, zlen) != len) {
+        return false;
+    }
+    read_chunk->len = len;
+    read_pos = 0;
+    read_block = block;
+    return true;
+}
+#else
+static void replay_log_write_block(ReplayLogChunk *chunk)
+{
+    g_assert_not_reached();
+}
+
+static bool replay_log_read_block(guint block)
+{
+    g_assert_not_reached();
+}
+#endif
+
+static void *replay_log_thread_fn(void *opaque)
+{
+    ReplayLogChunk *chunk;
+
+    qemu_mutex_lock(&log_lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&log_queue) && !log_stop) {
+            qemu_cond_wait(&log_cond, &log_lock);
+        }
+        chunk = QSIMPLEQ_FIRST(&log_queue);
+        if (!chunk) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&log_queue, next);
+        qemu_mutex_unlock(&log_lock);
+
+        if (log_compressed) {
+            replay_log_write_block(chunk);
+        } else if (fwrite(chunk->data, 1, chunk->len, replay_file) !=
+                   chunk->len) {
             replay_write_error();
         }
+        g_free(chunk);
+
+        qemu_mutex_lock(&log_lock);
+        log_queued--;
+        qemu_cond_broadcast(&log_cond);
+    }
+    qemu_mutex_unlock(&log_lock);
+
+    return NULL;
+}
+
+static void replay_log_submit(void)
+{
+    ReplayLogChunk *chunk = log_chunk;
+
+    if (!chunk) {
+        return;
+    }
+    log_chunk = NULL;
+    log_offset += chunk->len;
+
+    qemu_mutex_lock(&log_lock);
+    if (!log_thread_running) {
+        /* Started lazily, so that it is not lost if QEMU daemonizes */
+        qemu_thread_create(&log_thread, "replay-log", replay_log_thread_fn,
+                           NULL, QEMU_THREAD_JOINABLE);
+        log_thread_running = true;
+    }
+    while (log_queued >= REPLAY_LOG_MAX_CHUNKS) {
+        qemu_cond_wait(&log_cond, &log_lock);
+    }
+    QSIMPLEQ_INSERT_TAIL(&log_queue, chunk, next);
+    log_queued++;
+    qemu_cond_broadcast(&log_cond);
+    qemu_mutex_unlock(&log_lock);
+}
+
+static void replay_log_write(const uint8_t *buf, size_t size)
+{
+    size_t n;
+
+    if (!log_buffered) {
+        if (fwrite(buf, 1, size, replay_file) != size) {
+            replay_write_error();
+        }
+        return;
+    }
+
+    while (size) {
+        if (!log_chunk) {
+            log_chunk = g_new(ReplayLogChunk, 1);
+            log_chunk->len = 0;
+        }
+        n = MIN(size, REPLAY_LOG_CHUNK_SIZE - log_chunk->len);
+        memcpy(log_chunk->data + log_chunk->len, buf, n);
+        log_chunk->len += n;
+        buf += n;
+        size -= n;
+        if (log_chunk->len == REPLAY_LOG_CHUNK_SIZE) {
+            replay_log_submit();
+        }
+    }
+}
+
+void replay_log_init(bool compress)
+{
+    qemu_mutex_init(&log_lock);
+    qemu_cond_init(&log_cond);
+    log_offset = ftell(replay_file);
+    log_buffered = true;
+    log_compressed = compress;
+    if (compress) {
+#ifdef CONFIG_ZSTD
+        log_written = log_offset;
+#endif
+        log_index = g_array_new(false, false, sizeof(ReplayLogIndexEntry));
+    }
+}
+
+uint64_t replay_log_finish(void)
+{
+    ReplayLogIndexEntry *entry;
+    long index_pos;
+    guint i;
+
+    if (!log_buffered) {
+        return 0;
+    }
+    replay_log_submit();
+    log_buffered = false;
+
+    qemu_mutex_lock(&log_lock);
+    log_stop = true;
+    qemu_cond_broadcast(&log_cond);
+    qemu_mutex_unlock(&log_lock);
+    if (log_thread_running) {
+        qemu_thread_join(&log_thread);
+        log_thread_running = false;
+    }
+    if (!log_compressed) {
+        return 0;
+    }
+
+    /* Events written from now on, i.e. the header, are not compressed */
+    log_compressed = false;
+    index_pos = ftell(replay_file);
+    replay_put_dword(log_index->len);
+    for (i = 0; i < log_index->len; i++) {
+        entry = &g_array_index(log_index, ReplayLogIndexEntry, i);
+        replay_put_qword(entry->offset);
+        replay_put_qword(entry->file_pos);
+    }
+    g_array_free(log_index, true);
+    log_index = NULL;
+
+    return index_pos;
+}
+
+bool replay_log_open_compressed(uint64_t index_pos)
+{
+#ifdef CONFIG_ZSTD
+    ReplayLogIndexEntry entry;
+    uint32_t count, i;
+
+    if (fseek(replay_file, index_pos, SEEK_SET)) {
+        return false;
+    }
+    count = replay_get_dword();
+    log_index = g_array_sized_new(false, false, sizeof(entry), count);
+    for (i = 0; i < count; i++) {
+        entry.offset = replay_get_qword();
+        entry.file_pos = replay_get_qword();
+        g_array_append_val(log_index, entry);
+    }
+    read_chunk = g_new0(ReplayLogChunk, 1);
+    log_compressed = true;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void replay_log_seek(uint64_t offset)
+{
+    ReplayLogIndexEntry *entry;
+    guint lo, hi, mid;
+
+    if (!log_compressed) {
+        fseek(replay_file, offset, SEEK_SET);
+        return;
+    }
+
+    /* Find the last block that starts at or before @offset */
+    lo = 0;
+    hi = log_index->len;
+    while (hi - lo > 1) {
+        mid = (lo + hi) / 2;
+        entry = &g_array_index(log_index, ReplayLogIndexEntry, mid);
+        if (entry->offset <= offset) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    if (!replay_log_read_block(lo)) {
+        replay_read_error();
+    }
+    entry = &g_array_index(log_index, ReplayLogIndexEntry, lo);
+    if (offset < entry->offset || offset - entry->offset > read_chunk->len) {
+        replay_read_error();
+    }
+    read_pos = offset - entry->offset;
+}
+
+static bool replay_log_read(uint8_t *buf, size_t size)
+{
+    size_t n;
+
+    if (!log_compressed) {
+        return fread(buf, 1, size, replay_file) == size;
+    }
+
+    while (size) {
+        if (read_pos == read_chunk->len &&
+            !replay_log_read_block(read_block + 1)) {
+            return false;
+        }
+        n = MIN(size, read_chunk->len - read_pos);
+        memcpy(buf, read_chunk->data + read_pos, n);
+        read_pos += n;
+        buf += n;
+        size -= n;
+    }
+    return true;
+}
+
+uint64_t replay_log_tell(void)
+{
+    if (log_buffered) {
+        return log_offset + (log_chunk ? log_chunk->len : 0);
+    }
+    return ftell(replay_file);
+}
+
+void replay_put_byte(uint8_t byte)
+{
+    if (replay_file) {
+        replay_log_write(&byte, 1);
     }
 }
 
@@ -62,29 +433,39 @@ void replay_put_event(uint8_t event)
 
 void replay_put_word(uint16_t word)
 {
-    replay_put_byte(word >> 8);
-    replay_put_byte(word);
+    uint8_t buf[2];
+
+    if (replay_file) {
+        stw_be_p(buf, word);
+        replay_log_write(buf, sizeof(buf));
+    }
 }
 
 void replay_put_dword(uint32_t dword)
 {
-    replay_put_word(dword >> 16);
-    replay_put_word(dword);
+    uint8_t buf[4];
+
+    if (replay_file) {
+        stl_be_p(buf, dword);
+        replay_log_write(buf, sizeof(buf));
+    }
 }
 
 void replay_put_qword(int64_t qword)
 {
-    replay_put_dword(qword >> 32);
-    replay_put_dword(qword);
+    uint8_t buf[8];
+
+    if (replay_file) {
+        stq_be_p(buf, qword);
+        replay_log_write(buf, sizeof(buf));
+    }
 }
 
 void replay_put_array(const uint8_t *buf, size_t size)
 {
     if (replay_file) {
         replay_put_dword(size);
-        if (fwrite(buf, 1, size, replay_file) != size) {
-            replay_write_error();
-        }
+        replay_log_write(buf, size);
     }
 }
 
@@ -92,11 +473,9 @@ uint8_t replay_get_byte(void)
 {
     uint8_t byte = 0;
     if (replay_file) {
-        int r = getc(replay_file);
-        if (r == EOF) {
+        if (!replay_log_read(&byte, 1)) {
             replay_read_error();
         }
-        byte = r;
     }
     return byte;
 }
@@ -138,7 +517,7 @@ void replay_get_array(uint8_t *buf, size_t *size)
 {
     if (replay_file) {
         *size = replay_get_dword();
-        if (fread(buf, 1, *size, replay_file) != *size) {
+        if (!replay_log_read(buf, *size)) {
             replay_read_error();
         }
     }
@@ -149,7 +528,7 @@ void replay_get_array_alloc(uint8_t **buf, size_t *size)
     if (replay_file) {
         *size = replay_get_dword();
         *buf = g_malloc(*size);
-        if (fread(*buf, 1, *size, replay_file) != *size) {
+        if (!replay_log_read(*buf, *size)) {
             replay_read_error();
         }
     }
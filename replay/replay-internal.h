@@ -106,6 +106,22 @@ extern uint64_t replay_break_icount;
 /* Timer for the replay breakpoint callback */
 extern QEMUTimer *replay_break_timer;
 
+/*! Starts buffering the recorded events in memory. Full buffers
+    are written to replay_file by a background thread, as zstd
+    compressed blocks if \p compress is set. */
+void replay_log_init(bool compress);
+/*! Writes out the buffered events and stops the writer thread.
+    Later events are written to replay_file directly.
+    \return the position of the block index of a compressed log, or 0 */
+uint64_t replay_log_finish(void);
+/*! Returns the offset in the event stream of the next event. */
+uint64_t replay_log_tell(void);
+/*! Loads the block index of a compressed log from \p index_pos.
+    \return false if QEMU was built without zstd support */
+bool replay_log_open_compressed(uint64_t index_pos);
+/*! Moves the read position to \p offset of the event stream. */
+void replay_log_seek(uint64_t offset);
+
 void replay_put_byte(uint8_t byte);
 void replay_put_event(uint8_t event);
 void replay_put_word(uint16_t word);
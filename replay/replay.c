@@ -23,6 +23,8 @@
 /* Current version of the replay mechanism.
    Increase it when file format changes. */
 #define REPLAY_VERSION              0xe0200c
+/* Same event format, stored as zstd compressed blocks */
+#define REPLAY_VERSION_ZSTD         0xe1200c
 /* Size of replay log header */
 #define HEADER_SIZE                 (sizeof(uint32_t) + sizeof(uint64_t))
 
@@ -336,7 +338,7 @@ G_NORETURN void replay_sync_error(const char *error)
     abort();
 }
 
-static void replay_enable(const char *fname, int mode)
+static void replay_enable(const char *fname, int mode, bool compress)
 {
     const char *fmode = NULL;
     assert(!replay_file);
@@ -374,14 +376,22 @@ static void replay_enable(const char *fname, int mode)
     /* skip file header for RECORD and check it for PLAY */
     if (replay_mode == REPLAY_MODE_RECORD) {
         fseek(replay_file, HEADER_SIZE, SEEK_SET);
+        replay_log_init(compress);
     } else if (replay_mode == REPLAY_MODE_PLAY) {
         unsigned int version = replay_get_dword();
-        if (version != REPLAY_VERSION) {
+        if (version == REPLAY_VERSION_ZSTD) {
+            uint64_t index_pos = replay_get_qword();
+            if (!replay_log_open_compressed(index_pos)) {
+                fprintf(stderr, "Replay: compressed log file needs "
+                        "zstd support\n");
+                exit(1);
+            }
+        } else if (version != REPLAY_VERSION) {
             fprintf(stderr, "Replay: invalid input log file version\n");
             exit(1);
         }
         /* go to the beginning */
-        fseek(replay_file, HEADER_SIZE, SEEK_SET);
+        replay_log_seek(HEADER_SIZE);
         replay_fetch_data_kind();
     }
 
@@ -394,6 +404,7 @@ void replay_configure(QemuOpts *opts)
 {
     const char *fname;
     const char *rr;
+    bool compress;
     ReplayMode mode = REPLAY_MODE_NONE;
     Location loc;
 
@@ -423,9 +434,17 @@ void replay_configure(QemuOpts *opts)
         exit(1);
     }
 
+    compress = qemu_opt_get_bool(opts, "rrcompress", false);
+#ifndef CONFIG_ZSTD
+    if (compress) {
+        error_report("rrcompress requires QEMU to be built with zstd");
+        exit(1);
+    }
+#endif
+
     replay_snapshot = g_strdup(qemu_opt_get(opts, "rrsnapshot"));
     replay_vmstate_register();
-    replay_enable(fname, mode);
+    replay_enable(fname, mode, compress);
 
 out:
     loc_pop(&loc);
@@ -453,6 +472,8 @@ void replay_start(void)
 
 void replay_finish(void)
 {
+    uint64_t index_pos;
+
     if (replay_mode == REPLAY_MODE_NONE) {
         return;
     }
@@ -469,10 +490,16 @@ void replay_finish(void)
             replay_shutdown_request(SHUTDOWN_CAUSE_HOST_SIGNAL);
             /* write end event */
             replay_put_event(EVENT_END);
+            index_pos = replay_log_finish();
 
             /* write header */
             fseek(replay_file, 0, SEEK_SET);
-            replay_put_dword(REPLAY_VERSION);
+            if (index_pos) {
+                replay_put_dword(REPLAY_VERSION_ZSTD);
+                replay_put_qword(index_pos);
+            } else {
+                replay_put_dword(REPLAY_VERSION);
+            }
         }
 
         fclose(replay_file);
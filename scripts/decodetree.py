@@ -44,6 +44,10 @@
 output_fd = None
 output_null = False
 insntype = 'uint32_t'
+# Switches on scattered bits with at least this many cases are given
+# a dense index, so that the compiler can emit a jump table for them.
+jump_table_min_cases = 4
+jump_table_max_bits = 10
 decode_function = 'decode'
 
 # An identifier for C.
@@ -245,6 +249,26 @@ def is_contiguous(bits):
         return -1
 
 
+def contiguous_runs(bits):
+    """Return the (shift, width) of each run of set bits in BITS,
+       most significant run first."""
+    runs = []
+    while bits != 0:
+        shift = ctz(bits)
+        width = ctz(~(bits >> shift))
+        runs.insert(0, (shift, width))
+        bits &= ~(((1 << width) - 1) << shift)
+    return runs
+
+
+def compact_bits(val, runs):
+    """Gather the bits of VAL selected by RUNS into a dense index."""
+    r = 0
+    for (sh, w) in runs:
+        r = (r << w) | ((val >> sh) & ((1 << w) - 1))
+    return r
+
+
 def eq_fields_for_args(flds_a, arg):
     if len(flds_a) != len(arg.fields):
         return False
@@ -747,7 +771,11 @@ def output_code(self, i, extracted, outerbits, outermask):
 
         # Attempt to aid the compiler in producing compact switch statements.
         # If the bits in the mask are contiguous, extract them.
+        # If there are enough cases on few enough scattered bits, gather
+        # them into a dense index instead of leaving the compiler to
+        # build a tree of comparisons against sparse constants.
         sh = is_contiguous(self.thismask)
+        runs = contiguous_runs(self.thismask)
         if sh > 0:
             # Propagate SH down into the local functions.
             def str_switch(b, sh=sh):
@@ -755,6 +783,21 @@ def str_switch(b, sh=sh):
 
             def str_case(b, sh=sh):
                 return hex(b >> sh)
+        elif (sh < 0 and len(self.subs) >= jump_table_min_cases
+              and sum(w for (_, w) in runs) <= jump_table_max_bits):
+            def str_switch(b, runs=runs):
+                pos = sum(w for (_, w) in runs)
+                parts = []
+                for (rsh, w) in runs:
+                    pos -= w
+                    part = f'((insn >> {rsh}) & {(1 << w) - 1:#x})'
+                    if pos:
+                        part += f' << {pos}'
+                    parts.append(part)
+                return ' | '.join(parts)
+
+            def str_case(b, runs=runs):
+                return hex(compact_bits(b, runs))
         else:
             def str_switch(b):
                 return f'insn & {whexC(b)}'
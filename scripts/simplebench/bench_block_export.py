@@ -0,0 +1,245 @@
+#!/usr/bin/env python3
+#
+# Benchmark block exports of qemu-storage-daemon
+#
+# The daemon exports a stack of block nodes (raw, qcow2, throttle,
+# copy-on-read or luks on top of null-co or a file) over NBD,
+# vhost-user-blk or FUSE, and "qemu-img bench" runs 4k reads or writes
+# against the export.  Each LABEL:BUILD_DIR given on the command
+# line is one column of the resulting table, so that a regression in the
+# block layer or in the AioContext loop shows up as the relative
+# difference of the two builds.
+#
+# Keep --dir on a tmpfs, so that no disk is below the file driver.  The
+# in-process numbers of the same stacks, including latency percentiles,
+# are printed by tests/bench/block-null-bench.
+#
+# vhost-user-blk needs qemu-img built with libblkio, FUSE needs the daemon
+# built with FUSE support.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import argparse
+import os
+import re
+import resource
+import signal
+import subprocess
+import tempfile
+import time
+
+import simplebench
+from results_to_text import results_to_text
+
+
+IMAGE_SIZE = 1 << 30
+SECRET = ['--object', 'secret,id=bench-sec,data=bench']
+
+exports = ['nbd', 'vhost-user-blk', 'fuse']
+stacks = ['raw', 'qcow2', 'throttle', 'copy-on-read', 'luks']
+backends = ['null-co', 'file']
+
+# Stacks that need an image on the file
+image_stacks = {
+    'qcow2': ['-f', 'qcow2'],
+    'luks': SECRET + ['-f', 'luks', '-o', 'key-secret=bench-sec,iter-time=10'],
+}
+
+
+def build_path(env, name):
+    for path in (name, os.path.join('storage-daemon', name)):
+        path = os.path.join(env['build'], path)
+        if os.path.exists(path):
+            return path
+    return name
+
+
+def daemon_args(env, case, tmp):
+    args = [build_path(env, 'qemu-storage-daemon'),
+            '--daemonize', '--pidfile', f'{tmp}/qsd.pid']
+
+    if case['backend'] == 'null-co':
+        proto = f'null-co,size={IMAGE_SIZE},read-zeroes=off'
+    else:
+        proto = f'file,filename={tmp}/bench.img'
+    args += ['--blockdev', f'driver={proto},node-name=proto']
+
+    stack = case['stack']
+    top = f'driver={stack},node-name=top,file=proto'
+    if stack == 'throttle':
+        args += ['--object', 'throttle-group,id=bench-tg,'
+                 'x-iops-total=100000000']
+        top += ',throttle-group=bench-tg'
+    elif stack == 'luks':
+        args += SECRET
+        top += ',key-secret=bench-sec'
+    args += ['--blockdev', top]
+
+    export = f'type={case["export"]},id=exp,node-name=top,writable=on'
+    if case['export'] == 'nbd':
+        args += ['--nbd-server', f'addr.type=unix,addr.path={tmp}/nbd.sock']
+        export += ',name=bench'
+    elif case['export'] == 'vhost-user-blk':
+        export += f',addr.type=unix,addr.path={tmp}/vhost.sock'
+    else:
+        export += f',mountpoint={tmp}/fuse.img'
+    args += ['--export', export]
+    return args
+
+
+def client_image(case, tmp):
+    if case['export'] == 'nbd':
+        return ['--image-opts', 'driver=nbd,server.type=unix,'
+                f'server.path={tmp}/nbd.sock,export=bench']
+    elif case['export'] == 'vhost-user-blk':
+        return ['--image-opts',
+                f'driver=virtio-blk-vhost-user,path={tmp}/vhost.sock']
+    else:
+        return ['-f', 'raw', f'{tmp}/fuse.img']
+
+
+def proc_cpu_seconds(pid):
+    with open(f'/proc/{pid}/stat') as f:
+        # Skip the command name, it may contain spaces
+        fields = f.read().rpartition(')')[2].split()
+    return (int(fields[11]) + int(fields[12])) / os.sysconf('SC_CLK_TCK')
+
+
+def children_cpu_seconds():
+    ru = resource.getrusage(resource.RUSAGE_CHILDREN)
+    return ru.ru_utime + ru.ru_stime
+
+
+def bench_func(env, case):
+    with tempfile.TemporaryDirectory(dir=case['dir']) as tmp:
+        if case['stack'] in image_stacks:
+            cmd = [build_path(env, 'qemu-img'), 'create']
+            cmd += image_stacks[case['stack']] + [f'{tmp}/bench.img',
+                                                  str(IMAGE_SIZE)]
+            subprocess.run(cmd, stdout=subprocess.DEVNULL, check=True)
+        elif case['backend'] == 'file':
+            with open(f'{tmp}/bench.img', 'wb') as f:
+                f.truncate(IMAGE_SIZE)
+        if case['export'] == 'fuse':
+            # The mount point of a FUSE export is a regular file
+            open(f'{tmp}/fuse.img', 'wb').close()
+
+        p = subprocess.run(daemon_args(env, case, tmp),
+                           stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                           universal_newlines=True)
+        if p.returncode != 0:
+            return {'error': f'qemu-storage-daemon failed: {p.stdout}'}
+        with open(f'{tmp}/qsd.pid') as f:
+            pid = int(f.read())
+
+        try:
+            args = [build_path(env, 'qemu-img'), 'bench', '-t', 'none',
+                    '-c', str(case['count']), '-d', str(case['depth']),
+                    '-s', '4k', '-S', '1m']
+            if case['write']:
+                args.append('-w')
+            args += client_image(case, tmp)
+
+            daemon_cpu = proc_cpu_seconds(pid)
+            client_cpu = children_cpu_seconds()
+            start = time.monotonic()
+            p = subprocess.run(args, stdout=subprocess.PIPE,
+                               stderr=subprocess.STDOUT,
+                               universal_newlines=True)
+            seconds = time.monotonic() - start
+            daemon_cpu = proc_cpu_seconds(pid) - daemon_cpu
+            client_cpu = children_cpu_seconds() - client_cpu
+        finally:
+            os.kill(pid, signal.SIGTERM)
+            while os.path.exists(f'/proc/{pid}'):
+                time.sleep(0.01)
+
+    if p.returncode != 0:
+        return {'error': f'qemu-img failed: {p.returncode}: {p.stdout}'}
+    m = re.search(r'Run completed in (\d+.\d+) seconds.', p.stdout)
+    if m:
+        seconds = float(m.group(1))
+
+    return {
+        'iops': case['count'] / seconds,
+        'seconds': seconds,
+        'daemon-cpu-us': daemon_cpu * 1e6 / case['count'],
+        'client-cpu-us': client_cpu * 1e6 / case['count'],
+    }
+
+
+def cpu_to_text(result):
+    """Average CPU time per request of the daemon, and of the client."""
+    lines = ['CPU time per request in us, daemon/client', '']
+    for case in result['cases']:
+        cells = []
+        for env in result['envs']:
+            res = result['tab'][case['id']][env['id']]
+            runs = [r for r in res['runs'] if 'iops' in r]
+            if not runs:
+                cells.append('--')
+                continue
+            daemon = sum(r['daemon-cpu-us'] for r in runs) / len(runs)
+            client = sum(r['client-cpu-us'] for r in runs) / len(runs)
+            cells.append(f'{daemon:.1f}/{client:.1f}')
+        lines.append(f'{case["id"]:40} ' + '  '.join(cells))
+    return '\n'.join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Benchmark block exports of qemu-storage-daemon')
+    parser.add_argument('--dir', default='/dev/shm',
+                        help='directory for sockets and images (tmpfs)')
+    parser.add_argument('--export', action='append', choices=exports,
+                        help='export type to run (repeatable)')
+    parser.add_argument('--stack', action='append', choices=stacks,
+                        help='node on top of the backend (repeatable)')
+    parser.add_argument('--backend', action='append', choices=backends,
+                        help='protocol node at the bottom (repeatable)')
+    parser.add_argument('--depth', action='append', type=int,
+                        help='queue depth (repeatable, default 1 and 64)')
+    parser.add_argument('--write', action='store_true',
+                        help='benchmark writes instead of reads')
+    parser.add_argument('--requests', type=int, default=200000,
+                        help='requests per run')
+    parser.add_argument('--count', type=int, default=3,
+                        help='runs per case and build')
+    parser.add_argument('builds', nargs='+', metavar='[LABEL:]BUILD_DIR',
+                        help='build directories with qemu-img and '
+                        'qemu-storage-daemon')
+    args = parser.parse_args()
+
+    envs = []
+    for build in args.builds:
+        label, _, path = build.rpartition(':')
+        envs.append({'id': label or path, 'build': path})
+
+    cases = []
+    for export in args.export or exports:
+        for backend in args.backend or backends:
+            for stack in args.stack or stacks:
+                # Image formats need an image, null-co has none
+                if backend == 'null-co' and stack in image_stacks:
+                    continue
+                for depth in args.depth or [1, 64]:
+                    cases.append({
+                        'id': f'{export} {stack}/{backend} qd{depth}',
+                        'export': export,
+                        'stack': stack,
+                        'backend': backend,
+                        'depth': depth,
+                        'write': args.write,
+                        'count': args.requests,
+                        'dir': args.dir,
+                    })
+
+    result = simplebench.bench(bench_func, envs, cases, count=args.count)
+    print(results_to_text(result))
+    print()
+    print(cpu_to_text(result))
+
+
+if __name__ == '__main__':
+    main()
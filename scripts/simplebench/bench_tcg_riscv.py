@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+#
+# Benchmark TCG emulation speed with the RISC-V bare-metal workloads
+#
+# The workloads are the bench-* programs of tests/tcg/riscv64, as built by
+# "make check-tcg" in tests/tcg/riscv64-softmmu.  Each QEMU binary given on
+# the command line, e.g. builds of different commits, is one column of the
+# resulting table, so that a regression shows up as the relative difference
+# in the row of the category that regressed.
+#
+# With --plugin pointing to tests/tcg/plugins/libinsn.so, the guest
+# instructions of every workload are counted once per binary and the table
+# shows MIPS instead of seconds.
+#
+# SPDX-License-Identifier: GPL-2.0-or-later
+#
+
+import argparse
+import os
+import re
+import subprocess
+import tempfile
+import time
+
+import simplebench
+from results_to_text import results_to_text
+
+
+# Categories, with the iteration counts that take about a second with a
+# recent host and QEMU
+workloads = [
+    {'id': 'integer', 'file': 'bench-int', 'iters': 20000000},
+    {'id': 'tlb-miss', 'file': 'bench-tlb', 'iters': 2000},
+    {'id': 'fp', 'file': 'bench-fp', 'iters': 10000000},
+    {'id': 'trap/csr', 'file': 'bench-trap', 'iters': 2000000},
+    {'id': 'smp-atomic', 'file': 'bench-atomic', 'iters': 2000000,
+     'harts': 4},
+    {'id': 'rvv', 'file': 'bench-rvv', 'iters': 20000,
+     'args': ['-cpu', 'rv64,v=true']},
+]
+
+BENCH_ITERS_ADDR = 0x80100000
+BENCH_HARTS_ADDR = 0x80100008
+
+
+def qemu_args(env, case):
+    args = [env['qemu-binary'], '-M', 'virt', '-bios', 'none',
+            '-display', 'none', '-monitor', 'none', '-serial', 'none',
+            '-semihosting', '-accel', 'tcg,thread=multi']
+    args += case.get('args', [])
+    harts = case.get('harts', 1)
+    args += ['-smp', str(harts),
+             '-device', f'loader,addr={BENCH_HARTS_ADDR:#x},data={harts},'
+             'data-len=8',
+             '-device', f'loader,addr={BENCH_ITERS_ADDR:#x},'
+             f"data={case['iters']},data-len=8",
+             '-device', f"loader,file={case['path']}"]
+    return args
+
+
+def count_insns(env, case):
+    with tempfile.NamedTemporaryFile(mode='r', suffix='.pout') as log:
+        args = qemu_args(env, case) + ['-plugin', env['plugin'],
+                                       '-d', 'plugin', '-D', log.name]
+        p = subprocess.run(args, stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL)
+        if p.returncode != 0:
+            return None
+        m = re.search(r'total insns: (\d+)', log.read())
+        return int(m.group(1)) if m else None
+
+
+def bench_func(env, case):
+    args = qemu_args(env, case)
+
+    start = time.monotonic()
+    p = subprocess.run(args, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                       universal_newlines=True)
+    seconds = time.monotonic() - start
+
+    if p.returncode != 0:
+        return {'error': f'{case["file"]} failed: {p.returncode}: {p.stdout}'}
+
+    res = {'seconds': seconds}
+    if env.get('plugin'):
+        key = (env['id'], case['id'])
+        if key not in env['insns']:
+            env['insns'][key] = count_insns(env, case)
+        insns = env['insns'][key]
+        if insns is None:
+            return {'error': f'counting instructions of {case["file"]} failed'}
+        res['iops'] = insns / seconds / 1e6
+    return res
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description='Benchmark TCG with the RISC-V bare-metal workloads')
+    parser.add_argument('--workloads', required=True,
+                        help='directory with the built bench-* programs, '
+                        'e.g. BUILD/tests/tcg/riscv64-softmmu')
+    parser.add_argument('--count', type=int, default=3,
+                        help='runs per workload and binary')
+    parser.add_argument('--scale', type=float, default=1,
+                        help='factor for the iteration counts')
+    parser.add_argument('--plugin', help='path to libinsn.so, to report MIPS')
+    parser.add_argument('--only', action='append',
+                        help='run only this category (repeatable)')
+    parser.add_argument('binaries', nargs='+', metavar='[LABEL:]QEMU',
+                        help='qemu-system-riscv64 binaries to compare')
+    args = parser.parse_args()
+
+    envs = []
+    for binary in args.binaries:
+        label, _, path = binary.rpartition(':')
+        envs.append({
+            'id': label or path,
+            'qemu-binary': path,
+            'plugin': args.plugin,
+            'insns': {},
+        })
+
+    cases = []
+    for w in workloads:
+        if args.only and w['id'] not in args.only:
+            continue
+        case = dict(w)
+        case['path'] = os.path.join(args.workloads, w['file'])
+        case['iters'] = max(1, round(w['iters'] * args.scale))
+        cases.append(case)
+
+    result = simplebench.bench(bench_func, envs, cases, count=args.count)
+    print(results_to_text(result))
+
+
+if __name__ == '__main__':
+    main()
@@ -60,7 +60,8 @@ def bench_one(test_func, test_env, test_case, count=5, initial_run=True,
     """
     if initial_run:
         print('  #initial run:')
-        do_drop_caches()
+        if drop_caches:
+            do_drop_caches()
         print('   ', test_func(test_env, test_case))
 
     runs = []
@@ -68,7 +69,8 @@ def bench_one(test_func, test_env, test_case, count=5, initial_run=True,
         t = time.time()
 
         print('  #run {}'.format(i+1))
-        do_drop_caches()
+        if drop_caches:
+            do_drop_caches()
         res = test_func(test_env, test_case)
         print('   ', res)
         runs.append(res)
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+#
+# Convert a simple trace backend binary trace file to the Chrome trace
+# event format, which the Perfetto UI and chrome://tracing can load.
+#
+# This work is licensed under the terms of the GNU GPL, version 2.  See
+# the COPYING file in the top-level directory.
+#
+# Usage: simpletrace-chrome.py [--no-header] trace-events-all trace-12345 > trace.json
+
+import json
+import sys
+import simpletrace
+from tracetool.backend.simple import is_string
+
+
+class ChromeTrace(simpletrace.Analyzer2):
+    """Emit one instant event per trace record, on the track of its thread."""
+
+    def begin(self):
+        self.first = True
+        sys.stdout.write('{"traceEvents": [\n')
+
+    def catchall(self, *rec_args, event, timestamp_ns, pid, tid, **kwargs):
+        args = {}
+        for r, (type, name) in zip(rec_args, event.args):
+            args[name] = r.decode(errors='replace') if is_string(type) else r
+        record = {
+            'name': event.name,
+            'ph': 'i',
+            's': 't',
+            'ts': timestamp_ns / 1000,
+            'pid': pid,
+            'tid': tid,
+            'args': args,
+        }
+        if not self.first:
+            sys.stdout.write(',\n')
+        self.first = False
+        sys.stdout.write(json.dumps(record))
+
+    def end(self):
+        sys.stdout.write('\n], "displayTimeUnit": "ns"}\n')
+
+
+if __name__ == '__main__':
+    try:
+        simpletrace.run(ChromeTrace())
+    except simpletrace.SimpleException as e:
+        sys.stderr.write(str(e) + "\n")
+        sys.exit(1)
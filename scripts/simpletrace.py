@@ -31,7 +31,7 @@
 record_type_event = 1
 
 log_header_fmt = '=QQQ'
-rec_header_fmt = '=QQII'
+rec_header_fmt = '=QQIIQ'
 rec_header_fmt_len = struct.calcsize(rec_header_fmt)
 
 class SimpleException(Exception):
@@ -53,10 +53,10 @@ def get_mapping(fobj):
     return (event_id, name)
 
 def read_record(fobj):
-    """Deserialize a trace record from a file into a tuple (event_num, timestamp, pid, args)."""
-    event_id, timestamp_ns, record_length, record_pid = read_header(fobj, rec_header_fmt)
+    """Deserialize a trace record from a file into a tuple (event_num, timestamp, pid, tid, args)."""
+    event_id, timestamp_ns, record_length, record_pid, record_tid = read_header(fobj, rec_header_fmt)
     args_payload = fobj.read(record_length - rec_header_fmt_len)
-    return (event_id, timestamp_ns, record_pid, args_payload)
+    return (event_id, timestamp_ns, record_pid, record_tid, args_payload)
 
 def read_trace_header(fobj):
     """Read and verify trace file header"""
@@ -66,13 +66,13 @@ def read_trace_header(fobj):
     if _header_magic != header_magic:
         raise ValueError(f'Not a valid trace file, header magic {_header_magic} != {header_magic}')
 
-    if log_version not in [0, 2, 3, 4]:
+    if log_version not in [0, 2, 3, 4, 5]:
         raise ValueError(f'Unknown version {log_version} of tracelog format!')
-    if log_version != 4:
+    if log_version != 5:
         raise ValueError(f'Log format {log_version} not supported with this QEMU release!')
 
 def read_trace_records(events, fobj, read_header):
-    """Deserialize trace records from a file, yielding record tuples (event, event_num, timestamp, pid, arg1, ..., arg6).
+    """Deserialize trace records from a file, yielding record tuples (event, event_num, timestamp, pid, tid, arg1, ..., arg6).
 
     Args:
         event_mapping (str -> Event): events dict, indexed by name
@@ -103,7 +103,7 @@ def read_trace_records(events, fobj, read_header):
             event_id, event_name = get_mapping(fobj)
             event_id_to_name[event_id] = event_name
         else:
-            event_id, timestamp_ns, pid, args_payload = read_record(fobj)
+            event_id, timestamp_ns, pid, tid, args_payload = read_record(fobj)
             event_name = event_id_to_name[event_id]
 
             try:
@@ -128,7 +128,7 @@ def read_trace_records(events, fobj, read_header):
                     offset += 8
                     args.append(value)
 
-            yield (event_mapping[event_name], event_name, timestamp_ns, pid) + tuple(args)
+            yield (event_mapping[event_name], event_name, timestamp_ns, pid, tid) + tuple(args)
 
 class Analyzer:
     """[Deprecated. Refer to Analyzer2 instead.]
@@ -239,6 +239,7 @@ class Analyzer2(Analyzer):
         event_id: The id of the event in the current trace file
         timestamp_ns: The timestamp in nanoseconds of the trace
         pid: The process id recorded for the given trace
+        tid: The id of the thread that emitted the trace
 
     Example:
     The following method handles the runstate_set(int new_state) trace event::
@@ -310,13 +311,14 @@ def _process(events, log_fobj, analyzer, read_header=True):
         read_trace_header(log_fobj)
 
     with analyzer:
-        for event, event_id, timestamp_ns, record_pid, *rec_args in read_trace_records(events, log_fobj, read_header):
+        for event, event_id, timestamp_ns, record_pid, record_tid, *rec_args in read_trace_records(events, log_fobj, read_header):
             analyzer._process_event(
                 rec_args,
                 event=event,
                 event_id=event_id,
                 timestamp_ns=timestamp_ns,
                 pid=record_pid,
+                tid=record_tid,
             )
 
 def run(analyzer):
@@ -340,7 +342,7 @@ class Formatter2(Analyzer2):
         def __init__(self):
             self.last_timestamp_ns = None
 
-        def catchall(self, *rec_args, event, timestamp_ns, pid, event_id):
+        def catchall(self, *rec_args, event, timestamp_ns, pid, tid, event_id, **kwargs):
             if self.last_timestamp_ns is None:
                 self.last_timestamp_ns = timestamp_ns
             delta_ns = timestamp_ns - self.last_timestamp_ns
@@ -350,7 +352,7 @@ def catchall(self, *rec_args, event, timestamp_ns, pid, event_id):
                 f'{name}={r}' if is_string(type) else f'{name}=0x{r:x}'
                 for r, (type, name) in zip(rec_args, event.args)
             ]
-            print(f'{event.name} {delta_ns / 1000:0.3f} {pid=} ' + ' '.join(fields))
+            print(f'{event.name} {delta_ns / 1000:0.3f} {pid=} {tid=} ' + ' '.join(fields))
 
     try:
         run(Formatter2())
@@ -34,7 +34,7 @@ def generate(events, backend, group):
             name=e.name)
 
         # Calculate record size
-        sizes = ['24'] # sizeof(TraceRecord)
+        sizes = ['32'] # sizeof(TraceRecord)
         for type_, name in e.args:
             name = stap_escape(name)
             if is_string(type_):
@@ -52,7 +52,8 @@ def generate(events, backend, group):
         fields = [('8b', str(event_id)),
                   ('8b', 'gettimeofday_ns()'),
                   ('4b', sizestr),
-                  ('4b', 'pid()')]
+                  ('4b', 'pid()'),
+                  ('8b', 'tid()')]
         for type_, name in e.args:
             name = stap_escape(name)
             if is_string(type_):
@@ -156,6 +156,8 @@ static StatsFilter *stats_filter(StatsTarget target, const char *names,
         break;
     }
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
+    case STATS_TARGET_IOTHREAD:
         break;
     default:
         break;
@@ -229,6 +231,8 @@ void hmp_info_stats(Monitor *mon, const QDict *qdict)
         filter = stats_filter(target, names, cpu_index, provider);
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
+    case STATS_TARGET_IOTHREAD:
         filter = stats_filter(target, names, -1, provider);
         break;
     default:
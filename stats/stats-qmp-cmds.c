@@ -65,6 +65,8 @@ static bool invoke_stats_cb(StatsCallbacks *entry,
         }
         break;
     case STATS_TARGET_CRYPTODEV:
+    case STATS_TARGET_BLOCK:
+    case STATS_TARGET_IOTHREAD:
         break;
     default:
         abort();
@@ -38,6 +38,7 @@
 #include "qemu/main-loop.h"
 #include "qemu/plugin.h"
 #include "system/cpus.h"
+#include "system/numa.h"
 #include "qemu/guest-random.h"
 #include "hw/nmi.h"
 #include "system/replay.h"
@@ -707,6 +708,8 @@ void qemu_init_vcpu(CPUState *cpu)
     while (!cpu->created) {
         qemu_cond_wait(&qemu_cpu_cond, &bql);
     }
+
+    numa_cpu_set_thread_affinity(ms, cpu);
 }
 
 void cpu_stop_current(void)
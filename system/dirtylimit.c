@@ -23,6 +23,7 @@
 #include "exec/target_page.h"
 #include "hw/boards.h"
 #include "system/kvm.h"
+#include "system/tcg.h"
 #include "trace.h"
 #include "migration/misc.h"
 
@@ -238,12 +239,20 @@ bool dirtylimit_vcpu_index_valid(int cpu_index)
              cpu_index >= ms->smp.max_cpus);
 }
 
+uint32_t vcpu_dirty_ring_size(void)
+{
+    if (kvm_enabled()) {
+        return kvm_dirty_ring_enabled() ? kvm_dirty_ring_size() : 0;
+    }
+    return tcg_enabled() ? tcg_dirty_ring_size : 0;
+}
+
 static uint64_t dirtylimit_dirty_ring_full_time(uint64_t dirtyrate)
 {
     static uint64_t max_dirtyrate;
     uint64_t dirty_ring_size_MiB;
 
-    dirty_ring_size_MiB = qemu_target_pages_to_MiB(kvm_dirty_ring_size());
+    dirty_ring_size_MiB = qemu_target_pages_to_MiB(vcpu_dirty_ring_size());
 
     if (max_dirtyrate < dirtyrate) {
         max_dirtyrate = dirtyrate;
@@ -315,7 +324,7 @@ static void dirtylimit_set_throttle(CPUState *cpu,
     }
 
     /*
-     * TODO: in the big kvm_dirty_ring_size case (eg: 65536, or other scenario),
+     * TODO: in the big dirty ring size case (eg: 65536, or other scenario),
      *       current dirty page rate may never reach the quota, we should stop
      *       increasing sleep time?
      */
@@ -459,7 +468,7 @@ void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index,
                                  int64_t cpu_index,
                                  Error **errp)
 {
-    if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
+    if (!vcpu_dirty_ring_size()) {
         return;
     }
 
@@ -513,8 +522,8 @@ void qmp_set_vcpu_dirty_limit(bool has_cpu_index,
                               uint64_t dirty_rate,
                               Error **errp)
 {
-    if (!kvm_enabled() || !kvm_dirty_ring_enabled()) {
-        error_setg(errp, "dirty page limit feature requires KVM with"
+    if (!vcpu_dirty_ring_size()) {
+        error_setg(errp, "dirty page limit feature requires KVM or TCG with"
                    " accelerator property 'dirty-ring-size' set'");
         return;
     }
@@ -550,6 +559,64 @@ void qmp_set_vcpu_dirty_limit(bool has_cpu_index,
     dirtylimit_state_unlock();
 }
 
+typedef struct VcpuDirtyRate {
+    int cpu_index;
+    uint64_t dirty_rate;
+} VcpuDirtyRate;
+
+static int vcpu_dirty_rate_cmp(const void *a, const void *b)
+{
+    const VcpuDirtyRate *ra = a, *rb = b;
+
+    return (ra->dirty_rate > rb->dirty_rate) -
+           (ra->dirty_rate < rb->dirty_rate);
+}
+
+/*
+ * Share a total dirty page rate of @quota MB/s among the vCPUs: the
+ * vCPUs that dirty less than an equal share of what is left are not
+ * limited, and the others split the rest equally, but never get less
+ * than @min_quota MB/s each.  Only the vCPUs that dirty most pages are
+ * thus throttled.
+ */
+void dirtylimit_set_fair_share(uint64_t quota, uint64_t min_quota)
+{
+    g_autofree VcpuDirtyRate *rates = NULL;
+    uint64_t share, remaining = quota;
+    int i, n = 0, left;
+    CPUState *cpu;
+
+    dirtylimit_state_lock();
+
+    if (!dirtylimit_in_service()) {
+        dirtylimit_init();
+    }
+
+    rates = g_new(VcpuDirtyRate, dirtylimit_state->max_cpus);
+    CPU_FOREACH(cpu) {
+        rates[n].cpu_index = cpu->cpu_index;
+        rates[n].dirty_rate = vcpu_dirty_rate_get(cpu->cpu_index);
+        n++;
+    }
+    qsort(rates, n, sizeof(*rates), vcpu_dirty_rate_cmp);
+
+    for (i = 0, left = n; i < n; i++, left--) {
+        share = remaining / left;
+        if (rates[i].dirty_rate <= share) {
+            remaining -= rates[i].dirty_rate;
+            dirtylimit_set_vcpu(rates[i].cpu_index, 0, false);
+            continue;
+        }
+
+        share = MAX(share, min_quota);
+        trace_dirtylimit_set_fair_share(rates[i].cpu_index,
+                                        rates[i].dirty_rate, share);
+        dirtylimit_set_vcpu(rates[i].cpu_index, share, true);
+    }
+
+    dirtylimit_state_unlock();
+}
+
 void hmp_set_vcpu_dirty_limit(Monitor *mon, const QDict *qdict)
 {
     int64_t dirty_rate = qdict_get_int(qdict, "dirty_rate");
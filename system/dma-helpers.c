@@ -26,6 +26,154 @@ MemTxResult dma_memory_set(AddressSpace *as, dma_addr_t addr,
     return address_space_set(as, addr, c, len, attrs);
 }
 
+typedef struct DMACacheRegion {
+    struct rcu_head rcu;
+    MemoryRegionCache mrc;
+} DMACacheRegion;
+
+struct DMACache {
+    struct rcu_head rcu;
+    AddressSpace *as;
+    dma_addr_t addr;
+    dma_addr_t len;
+    bool is_write;
+    /* NULL if the range could not be cached, protected by RCU */
+    DMACacheRegion *region;
+    MemoryListener listener;
+};
+
+/* Called within call_rcu().  */
+static void dma_cache_region_free(DMACacheRegion *region)
+{
+    address_space_cache_destroy(&region->mrc);
+    g_free(region);
+}
+
+static void dma_cache_refresh(DMACache *cache)
+{
+    DMACacheRegion *old = cache->region;
+    DMACacheRegion *new = g_new0(DMACacheRegion, 1);
+    int64_t len;
+
+    len = address_space_cache_init(&new->mrc, cache->as, cache->addr,
+                                   cache->len, cache->is_write);
+    if (len <= 0) {
+        dma_cache_region_free(new);
+        new = NULL;
+    }
+
+    qatomic_rcu_set(&cache->region, new);
+    if (old) {
+        call_rcu(old, dma_cache_region_free, rcu);
+    }
+}
+
+static void dma_cache_listener_commit(MemoryListener *listener)
+{
+    DMACache *cache = container_of(listener, DMACache, listener);
+
+    dma_cache_refresh(cache);
+}
+
+DMACache *dma_cache_new(AddressSpace *as, dma_addr_t addr, dma_addr_t len,
+                        DMADirection dir)
+{
+    DMACache *cache = g_new0(DMACache, 1);
+
+    assert(len > 0);
+
+    cache->as = as;
+    cache->addr = addr;
+    cache->len = len;
+    cache->is_write = dir == DMA_DIRECTION_FROM_DEVICE;
+    cache->listener.commit = dma_cache_listener_commit;
+    cache->listener.name = "dma-cache";
+
+    /* Registering the listener calls commit, which fills the cache */
+    memory_listener_register(&cache->listener, as);
+    return cache;
+}
+
+/* Called within call_rcu().  */
+static void dma_cache_destroy(DMACache *cache)
+{
+    if (cache->region) {
+        dma_cache_region_free(cache->region);
+    }
+    g_free(cache);
+}
+
+void dma_cache_free(DMACache *cache)
+{
+    if (!cache) {
+        return;
+    }
+
+    memory_listener_unregister(&cache->listener);
+    call_rcu(cache, dma_cache_destroy, rcu);
+}
+
+/*
+ * Return the cached region if it covers [@addr, @addr + @len), and store
+ * the offset of @addr within it in @offset.
+ */
+static DMACacheRegion *dma_cache_lookup(DMACache *cache, dma_addr_t addr,
+                                        dma_addr_t len, hwaddr *offset)
+{
+    DMACacheRegion *region = qatomic_rcu_read(&cache->region);
+
+    if (!region || addr < cache->addr) {
+        return NULL;
+    }
+
+    *offset = addr - cache->addr;
+    if (*offset >= region->mrc.len || len > region->mrc.len - *offset) {
+        return NULL;
+    }
+    return region;
+}
+
+MemTxResult dma_cache_read(DMACache *cache, dma_addr_t addr,
+                           void *buf, dma_addr_t len)
+{
+    DMACacheRegion *region;
+    hwaddr offset;
+
+    RCU_READ_LOCK_GUARD();
+
+    region = dma_cache_lookup(cache, addr, len, &offset);
+    if (!region) {
+        return dma_memory_read(cache->as, addr, buf, len,
+                               MEMTXATTRS_UNSPECIFIED);
+    }
+
+    dma_barrier(cache->as, DMA_DIRECTION_TO_DEVICE);
+    return address_space_read_cached(&region->mrc, offset, buf, len);
+}
+
+MemTxResult dma_cache_write(DMACache *cache, dma_addr_t addr,
+                            const void *buf, dma_addr_t len)
+{
+    DMACacheRegion *region;
+    MemTxResult res;
+    hwaddr offset;
+
+    assert(cache->is_write);
+
+    RCU_READ_LOCK_GUARD();
+
+    region = dma_cache_lookup(cache, addr, len, &offset);
+    if (!region) {
+        return dma_memory_write(cache->as, addr, buf, len,
+                                MEMTXATTRS_UNSPECIFIED);
+    }
+
+    dma_barrier(cache->as, DMA_DIRECTION_FROM_DEVICE);
+    res = address_space_write_cached(&region->mrc, offset, buf, len);
+    address_space_cache_invalidate(&region->mrc, offset, len);
+    return res;
+}
+
 void qemu_sglist_init(QEMUSGList *qsg, DeviceState *dev, int alloc_hint,
                       AddressSpace *as)
 {
@@ -0,0 +1,151 @@
+/*
+ * query-stats provider for IOThread objects
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/module.h"
+#include "qapi/qapi-types-stats.h"
+#include "system/iothread.h"
+#include "system/stats.h"
+
+#define IOTHREAD_STAT_POLL_HANDLERS "poll-handlers"
+#define IOTHREAD_STAT_POLL_HITS     "poll-hits"
+#define IOTHREAD_STAT_POLL_MISSES   "poll-misses"
+#define IOTHREAD_STAT_POLL_NS       "poll-ns"
+
+typedef struct IOThreadStatsArgs {
+    StatsResultList **result;
+    strList *names;
+    strList *targets;
+} IOThreadStatsArgs;
+
+typedef struct IOThreadPollTotals {
+    uint64_t handlers;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t max_ns;
+} IOThreadPollTotals;
+
+static StatsList *iothread_stats_add(StatsList *list, strList *names,
+                                     const char *name, uint64_t val)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = val;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+/* The counters are only written by the IOThread, and summed up here */
+static void iothread_stats_poll_handler(int fd, const AioPolledEvent *poll,
+                                        void *opaque)
+{
+    IOThreadPollTotals *totals = opaque;
+
+    totals->handlers++;
+    totals->hits += poll->hits;
+    totals->misses += poll->misses;
+    totals->max_ns = MAX(totals->max_ns, poll->ns);
+}
+
+static int iothread_stats_query(Object *obj, void *opaque)
+{
+    IOThreadStatsArgs *args = opaque;
+    IOThreadPollTotals totals = {};
+    g_autofree char *path = NULL;
+    StatsList *list = NULL;
+    IOThread *iothread;
+
+    iothread = (IOThread *)object_dynamic_cast(obj, TYPE_IOTHREAD);
+    if (!iothread || !iothread->ctx) {
+        return 0;
+    }
+
+    path = object_get_canonical_path(obj);
+    if (!apply_str_list_filter(path, args->targets)) {
+        return 0;
+    }
+
+    aio_context_foreach_poll_handler(iothread->ctx,
+                                     iothread_stats_poll_handler, &totals);
+
+    list = iothread_stats_add(list, args->names, IOTHREAD_STAT_POLL_HANDLERS,
+                              totals.handlers);
+    list = iothread_stats_add(list, args->names, IOTHREAD_STAT_POLL_HITS,
+                              totals.hits);
+    list = iothread_stats_add(list, args->names, IOTHREAD_STAT_POLL_MISSES,
+                              totals.misses);
+    list = iothread_stats_add(list, args->names, IOTHREAD_STAT_POLL_NS,
+                              totals.max_ns);
+    if (list) {
+        add_stats_entry(args->result, STATS_PROVIDER_IOTHREAD, path, list);
+    }
+    return 0;
+}
+
+static void iothread_stats_cb(StatsResultList **result, StatsTarget target,
+                              strList *names, strList *targets, Error **errp)
+{
+    IOThreadStatsArgs args = {
+        .result = result,
+        .names = names,
+        .targets = targets,
+    };
+
+    if (target != STATS_TARGET_IOTHREAD) {
+        return;
+    }
+    /* Includes the internal IOThreads, unlike query-iothreads */
+    object_child_foreach_recursive(object_get_root(), iothread_stats_query,
+                                   &args);
+}
+
+static StatsSchemaValueList *iothread_schemas_add(StatsSchemaValueList *list,
+                                                  const char *name,
+                                                  StatsType type)
+{
+    StatsSchemaValueList *schema_entry = g_new0(StatsSchemaValueList, 1);
+
+    schema_entry->value = g_new0(StatsSchemaValue, 1);
+    schema_entry->value->type = type;
+    schema_entry->value->name = g_strdup(name);
+    schema_entry->next = list;
+
+    return schema_entry;
+}
+
+static void iothread_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_HANDLERS,
+                                STATS_TYPE_INSTANT);
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_HITS,
+                                STATS_TYPE_CUMULATIVE);
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_MISSES,
+                                STATS_TYPE_CUMULATIVE);
+    list = iothread_schemas_add(list, IOTHREAD_STAT_POLL_NS,
+                                STATS_TYPE_INSTANT);
+    add_stats_schema(result, STATS_PROVIDER_IOTHREAD, STATS_TARGET_IOTHREAD,
+                     list);
+}
+
+static void iothread_stats_register(void)
+{
+    add_stats_callbacks(STATS_PROVIDER_IOTHREAD, iothread_stats_cb,
+                        iothread_schemas_cb);
+}
+
+type_init(iothread_stats_register)
@@ -40,6 +40,15 @@
 static unsigned memory_region_transaction_depth;
 static bool memory_region_update_pending;
 static bool ioeventfd_update_pending;
+
+/*
+ * Regions whose rendering changed in the current transaction, unless
+ * memory_region_update_all is set.  Only FlatViews that visited one of
+ * them are rendered again on commit.
+ */
+static GHashTable *memory_region_update_regions;
+static bool memory_region_update_all;
+#define MEMORY_REGION_UPDATE_REGIONS_MAX 256
 unsigned int global_dirty_tracking;
 
 static QTAILQ_HEAD(, MemoryListener) memory_listeners
@@ -263,6 +272,7 @@ static FlatView *flatview_new(MemoryRegion *mr_root)
     view = g_new0(FlatView, 1);
     view->ref = 1;
     view->root = mr_root;
+    view->regions = g_hash_table_new(NULL, NULL);
     memory_region_ref(mr_root);
     trace_flatview_new(view, mr_root);
 
@@ -298,6 +308,7 @@ static void flatview_destroy(FlatView *view)
         memory_region_unref(view->ranges[i].mr);
     }
     g_free(view->ranges);
+    g_hash_table_destroy(view->regions);
     memory_region_unref(view->root);
     g_free(view);
 }
@@ -614,6 +625,9 @@ static void render_memory_region(FlatView *view,
     FlatRange fr;
     AddrRange tmp;
 
+    /* Even if it is disabled or out of @clip now, it may not be later */
+    g_hash_table_add(view->regions, mr);
+
     if (!mr->enabled) {
         return;
     }
@@ -1062,26 +1076,90 @@ static void flatviews_init(void)
     }
 }
 
+/* Record that the rendering of @mr changed in the current transaction */
+static void memory_region_update_pending_region(MemoryRegion *mr)
+{
+    memory_region_update_pending = true;
+    if (memory_region_update_all) {
+        return;
+    }
+    if (!memory_region_update_regions) {
+        memory_region_update_regions = g_hash_table_new(NULL, NULL);
+    }
+    g_hash_table_add(memory_region_update_regions, mr);
+    if (g_hash_table_size(memory_region_update_regions) >
+        MEMORY_REGION_UPDATE_REGIONS_MAX) {
+        memory_region_update_all = true;
+    }
+}
+
+/* Record that the rendering of all regions may have changed */
+static void memory_region_update_pending_all(void)
+{
+    memory_region_update_pending = true;
+    memory_region_update_all = true;
+}
+
+/* Can @view be kept as is after the current transaction? */
+static bool flatview_is_up_to_date(FlatView *view)
+{
+    GHashTableIter iter;
+    gpointer mr;
+
+    if (memory_region_update_all) {
+        return false;
+    }
+    if (!memory_region_update_regions) {
+        return true;
+    }
+
+    g_hash_table_iter_init(&iter, memory_region_update_regions);
+    while (g_hash_table_iter_next(&iter, &mr, NULL)) {
+        if (g_hash_table_contains(view->regions, mr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 static void flatviews_reset(void)
 {
+    GHashTable *old_views = flat_views;
     AddressSpace *as;
 
-    if (flat_views) {
-        g_hash_table_unref(flat_views);
-        flat_views = NULL;
-    }
+    flat_views = NULL;
     flatviews_init();
 
-    /* Render unique FVs */
+    /*
+     * Render unique FVs.  FlatViews that did not visit any updated region
+     * are kept, together with their dispatch tables, and the address
+     * spaces using them do not see any change.
+     */
     QTAILQ_FOREACH(as, &address_spaces, address_spaces_link) {
         MemoryRegion *physmr = memory_region_get_flatview_root(as->root);
+        FlatView *view;
 
         if (g_hash_table_lookup(flat_views, physmr)) {
             continue;
         }
 
+        view = old_views ? g_hash_table_lookup(old_views, physmr) : NULL;
+        if (view && flatview_is_up_to_date(view)) {
+            flatview_ref(view);
+            g_hash_table_replace(flat_views, physmr, view);
+            continue;
+        }
+
         generate_memory_topology(physmr);
     }
+
+    if (old_views) {
+        g_hash_table_unref(old_views);
+    }
+    if (memory_region_update_regions) {
+        g_hash_table_remove_all(memory_region_update_regions);
+    }
+    memory_region_update_all = false;
 }
 
 static void address_space_set_flatview(AddressSpace *as)
@@ -1093,6 +1171,13 @@ static void address_space_set_flatview(AddressSpace *as)
     assert(new_view);
 
     if (old_view == new_view) {
+        /*
+         * The FlatView was kept by flatviews_reset().  Listeners such as
+         * vhost rebuild their state from region_nop on every commit.
+         */
+        if (!QTAILQ_EMPTY(&as->listeners)) {
+            address_space_update_topology_pass(as, old_view, new_view, true);
+        }
         return;
     }
 
@@ -2267,7 +2352,9 @@ void memory_region_set_log(MemoryRegion *mr, bool log, unsigned client)
 
     memory_region_transaction_begin();
     mr->dirty_log_mask = (mr->dirty_log_mask & ~mask) | (log * mask);
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_region(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2397,7 +2484,9 @@ void memory_region_set_readonly(MemoryRegion *mr, bool readonly)
     if (mr->readonly != readonly) {
         memory_region_transaction_begin();
         mr->readonly = readonly;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_region(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2407,7 +2496,9 @@ void memory_region_set_nonvolatile(MemoryRegion *mr, bool nonvolatile)
     if (mr->nonvolatile != nonvolatile) {
         memory_region_transaction_begin();
         mr->nonvolatile = nonvolatile;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_region(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2417,7 +2508,9 @@ void memory_region_rom_device_set_romd(MemoryRegion *mr, bool romd_mode)
     if (mr->romd_mode != romd_mode) {
         memory_region_transaction_begin();
         mr->romd_mode = romd_mode;
-        memory_region_update_pending |= mr->enabled;
+        if (mr->enabled) {
+            memory_region_update_pending_region(mr);
+        }
         memory_region_transaction_commit();
     }
 }
@@ -2567,6 +2660,11 @@ void memory_region_clear_flush_coalesced(MemoryRegion *mr)
     }
 }
 
+void memory_region_enable_lockless_io(MemoryRegion *mr)
+{
+    mr->lockless_io = true;
+}
+
 void memory_region_add_eventfd(MemoryRegion *mr,
                                hwaddr addr,
                                unsigned size,
@@ -2653,7 +2751,9 @@ static void memory_region_update_container_subregions(MemoryRegion *subregion)
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_pending_region(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2703,7 +2803,9 @@ void memory_region_del_subregion(MemoryRegion *mr,
     }
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
     memory_region_unref(subregion);
-    memory_region_update_pending |= mr->enabled && subregion->enabled;
+    if (mr->enabled && subregion->enabled) {
+        memory_region_update_pending_region(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2714,7 +2816,7 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
     }
     memory_region_transaction_begin();
     mr->enabled = enabled;
-    memory_region_update_pending = true;
+    memory_region_update_pending_region(mr);
     memory_region_transaction_commit();
 }
 
@@ -2730,7 +2832,7 @@ void memory_region_set_size(MemoryRegion *mr, uint64_t size)
     }
     memory_region_transaction_begin();
     mr->size = s;
-    memory_region_update_pending = true;
+    memory_region_update_pending_region(mr);
     memory_region_transaction_commit();
 }
 
@@ -2766,7 +2868,9 @@ void memory_region_set_alias_offset(MemoryRegion *mr, hwaddr offset)
 
     memory_region_transaction_begin();
     mr->alias_offset = offset;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_region(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2778,7 +2882,9 @@ void memory_region_set_unmergeable(MemoryRegion *mr, bool unmergeable)
 
     memory_region_transaction_begin();
     mr->unmergeable = unmergeable;
-    memory_region_update_pending |= mr->enabled;
+    if (mr->enabled) {
+        memory_region_update_pending_region(mr);
+    }
     memory_region_transaction_commit();
 }
 
@@ -2977,7 +3083,7 @@ bool memory_global_dirty_log_start(unsigned int flags, Error **errp)
         }
 
         memory_region_transaction_begin();
-        memory_region_update_pending = true;
+        memory_region_update_pending_all();
         memory_region_transaction_commit();
     }
     return true;
@@ -2993,7 +3099,7 @@ static void memory_global_dirty_log_do_stop(unsigned int flags)
 
     if (!global_dirty_tracking) {
         memory_region_transaction_begin();
-        memory_region_update_pending = true;
+        memory_region_update_pending_all();
         memory_region_transaction_commit();
         MEMORY_LISTENER_CALL_GLOBAL(log_global_stop, Reverse);
     }
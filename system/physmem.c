@@ -136,6 +136,8 @@ typedef struct PhysPageMap {
 } PhysPageMap;
 
 struct AddressSpaceDispatch {
+    /* Unique among all dispatches ever created, see PhysSectionCache */
+    uint64_t id;
     MemoryRegionSection *mru_section;
     /* This is a multi-level map on the physical address space.
      * The bottom level has pointers to MemoryRegionSections.
@@ -340,19 +342,68 @@ static MemoryRegionSection *phys_page_find(AddressSpaceDispatch *d, hwaddr addr)
     }
 }
 
+/*
+ * Per-thread cache of the sections recently returned by phys_page_find().
+ * Unlike a single shared MRU entry, it is not written by other threads,
+ * and it does not miss each time a device alternates between a few
+ * sections, e.g. a virtio ring and the buffers it points to.
+ *
+ * Entries are tagged with AddressSpaceDispatch::id rather than with the
+ * dispatch's address: once the FlatView changes, the old dispatch is freed
+ * after an RCU grace period and a new one can be allocated at the same
+ * address.  The sections of a dispatch are never modified once the
+ * dispatch is in use, so a matching entry stays valid as long as the
+ * caller's RCU critical section keeps the dispatch alive.
+ */
+#define PHYS_SECTION_CACHE_SIZE 4
+
+typedef struct PhysSectionCache {
+    struct {
+        uint64_t dispatch_id;
+        MemoryRegionSection *section;
+    } entries[PHYS_SECTION_CACHE_SIZE];
+    unsigned int next;
+} PhysSectionCache;
+
+static __thread PhysSectionCache phys_section_cache;
+/* Protected by the BQL, like FlatView rendering */
+static uint64_t address_space_dispatch_next_id = 1;
+
+static MemoryRegionSection *phys_section_cache_find(AddressSpaceDispatch *d,
+                                                    hwaddr addr)
+{
+    PhysSectionCache *cache = &phys_section_cache;
+    MemoryRegionSection *section;
+    int i;
+
+    for (i = 0; i < PHYS_SECTION_CACHE_SIZE; i++) {
+        if (cache->entries[i].dispatch_id == d->id &&
+            section_covers_addr(cache->entries[i].section, addr)) {
+            return cache->entries[i].section;
+        }
+    }
+
+    section = phys_page_find(d, addr);
+
+    /* The unassigned section covers everything, only cache real hits */
+    if (section != &d->map.sections[PHYS_SECTION_UNASSIGNED]) {
+        i = cache->next;
+        cache->next = (i + 1) % PHYS_SECTION_CACHE_SIZE;
+        cache->entries[i].dispatch_id = d->id;
+        cache->entries[i].section = section;
+        qatomic_set(&d->mru_section, section);
+    }
+    return section;
+}
+
 /* Called from RCU critical section */
 static MemoryRegionSection *address_space_lookup_region(AddressSpaceDispatch *d,
                                                         hwaddr addr,
                                                         bool resolve_subpage)
 {
-    MemoryRegionSection *section = qatomic_read(&d->mru_section);
+    MemoryRegionSection *section = phys_section_cache_find(d, addr);
     subpage_t *subpage;
 
-    if (!section || section == &d->map.sections[PHYS_SECTION_UNASSIGNED] ||
-        !section_covers_addr(section, addr)) {
-        section = phys_page_find(d, addr);
-        qatomic_set(&d->mru_section, section);
-    }
     if (resolve_subpage && section->mr->subpage) {
         subpage = container_of(section->mr, subpage_t, iomem);
         section = &d->map.sections[subpage->sub_section[SUBPAGE_IDX(addr)]];
@@ -856,6 +907,23 @@ found:
     return block;
 }
 
+ram_addr_t cpu_physical_memory_dirty_granule(ram_addr_t addr,
+                                             ram_addr_t granule,
+                                             ram_addr_t *plength)
+{
+    RAMBlock *block;
+    ram_addr_t start, end;
+
+    RCU_READ_LOCK_GUARD();
+    block = qemu_get_ram_block(addr);
+    start = QEMU_ALIGN_DOWN(addr, granule);
+    end = MIN(start + granule, block->offset + block->used_length);
+    start = MAX(start, block->offset);
+
+    *plength = end - start;
+    return start;
+}
+
 void tlb_reset_dirty_range_all(ram_addr_t start, ram_addr_t length)
 {
     CPUState *cpu;
@@ -2308,6 +2376,43 @@ static int qemu_ram_remap_mmap(RAMBlock *block, uint64_t start, size_t length)
     return area != host_startaddr ? -errno : 0;
 }
 
+/* Re-apply the advice of ram_block_add() to a range that was mapped again */
+static void qemu_ram_setup_advice(void *host, size_t length)
+{
+    memory_try_enable_merging(host, length);
+    qemu_ram_setup_dump(host, length);
+    qemu_madvise(host, length, QEMU_MADV_HUGEPAGE);
+    if (!qtest_enabled()) {
+        qemu_madvise(host, length, QEMU_MADV_DONTFORK);
+    }
+}
+
+int qemu_ram_map_file_private(RAMBlock *block, ram_addr_t offset,
+                              size_t length, int fd)
+{
+    void *host = ramblock_ptr(block, offset);
+    int ret = 0;
+
+    if (block->fd >= 0 || (block->flags & (RAM_SHARED | RAM_PREALLOC))) {
+        return -EINVAL;
+    }
+    if (mmap(host, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED,
+             fd, 0) == MAP_FAILED) {
+        ret = -errno;
+        /* A failed MAP_FIXED may have unmapped the range already. */
+        if (qemu_ram_remap_mmap(block, offset, length)) {
+            error_report("Could not remap RAM %s:%" PRIx64 " +%zx",
+                         block->idstr, (uint64_t)offset, length);
+            abort();
+        }
+    } else {
+        /* Discarding must now replace the mapping, see below. */
+        block->file_mapped = true;
+    }
+    qemu_ram_setup_advice(host, length);
+    return ret;
+}
+
 /*
  * qemu_ram_remap - remap a single RAM page
  *
@@ -2690,6 +2795,7 @@ AddressSpaceDispatch *address_space_dispatch_new(FlatView *fv)
     AddressSpaceDispatch *d = g_new0(AddressSpaceDispatch, 1);
     uint16_t n;
 
+    d->id = address_space_dispatch_next_id++;
     n = dummy_section(&d->map, fv, &io_mem_unassigned);
     assert(n == PHYS_SECTION_UNASSIGNED);
 
@@ -2873,7 +2979,7 @@ bool prepare_mmio_access(MemoryRegion *mr)
 {
     bool release_lock = false;
 
-    if (!bql_locked()) {
+    if (!bql_locked() && !mr->lockless_io) {
         bql_lock();
         release_lock = true;
     }
@@ -3712,7 +3818,7 @@ int cpu_memory_rw_debug(CPUState *cpu, vaddr addr,
                         void *ptr, size_t len, bool is_write)
 {
     hwaddr phys_addr;
-    vaddr l, page;
+    vaddr l;
     uint8_t *buf = ptr;
 
     cpu_synchronize_state(cpu);
@@ -3721,16 +3827,14 @@ int cpu_memory_rw_debug(CPUState *cpu, vaddr addr,
         MemTxAttrs attrs;
         MemTxResult res;
 
-        page = addr & TARGET_PAGE_MASK;
-        phys_addr = cpu_get_phys_page_attrs_debug(cpu, page, &attrs);
+        /* Translate the whole mapping at once, e.g. a huge page */
+        phys_addr = cpu_get_phys_range_debug(cpu, addr, &l, &attrs);
         asidx = cpu_asidx_from_attrs(cpu, attrs);
         /* if no physical page mapped, return an error */
         if (phys_addr == -1)
             return -1;
-        l = (page + TARGET_PAGE_SIZE) - addr;
         if (l > len)
             l = len;
-        phys_addr += (addr & ~TARGET_PAGE_MASK);
         res = address_space_rw(cpu->cpu_ases[asidx].as, phys_addr, attrs, buf,
                                l, is_write);
         if (res != MEMTX_OK) {
@@ -3867,6 +3971,18 @@ int ram_block_discard_range(RAMBlock *rb, uint64_t start, size_t length)
 #if defined(CONFIG_MADVISE)
             if (qemu_ram_is_shared(rb) && rb->fd < 0) {
                 ret = madvise(host_startaddr, length, QEMU_MADV_REMOVE);
+            } else if (rb->file_mapped) {
+                /*
+                 * MADV_DONTNEED would bring back the contents of the files
+                 * that qemu_ram_map_file_private() mapped, rather than
+                 * zeroes.  Replace the range with anonymous memory.
+                 */
+                ret = qemu_ram_remap_mmap(rb, start, length);
+                if (!ret) {
+                    qemu_ram_setup_advice(host_startaddr, length);
+                } else {
+                    errno = -ret;
+                }
             } else {
                 ret = madvise(host_startaddr, length, QEMU_MADV_DONTNEED);
             }
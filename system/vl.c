@@ -455,6 +455,9 @@ static QemuOptsList qemu_icount_opts = {
         }, {
             .name = "rrsnapshot",
             .type = QEMU_OPT_STRING,
+        }, {
+            .name = "rrcompress",
+            .type = QEMU_OPT_BOOL,
         },
         { /* end of list */ }
     },
@@ -1969,6 +1972,11 @@ static bool object_create_early(const char *type)
     }
 #endif
 
+    /* Reason: x-migration-dirtier property "memdev" */
+    if (g_str_equal(type, "x-migration-dirtier")) {
+        return false;
+    }
+
     /* Reason: vhost-user-blk-server property "node-name" */
     if (g_str_equal(type, "vhost-user-blk-server")) {
         return false;
@@ -3845,5 +3853,7 @@ void qemu_init(int argc, char **argv)
     qemu_init_displays();
     accel_setup_post(current_machine);
     os_setup_post();
+    /* Threads do not survive os_daemonize(), so start it only now. */
+    perf_start_writer();
     resume_mux_open();
 }
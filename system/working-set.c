@@ -0,0 +1,371 @@
+/*
+ * Guest working set estimation with host idle page tracking
+ *
+ * The RAM of each NUMA node is watched over a number of time windows.
+ * At the start of each window, the host pages of the node are marked
+ * idle in /sys/kernel/mm/page_idle/bitmap; at its end, the pages that are
+ * no longer idle were accessed during the window.  Guest accesses clear
+ * the idle flag in all cases: under TCG they are plain accesses of QEMU
+ * to the host page, under KVM the kernel gathers the accessed bits of the
+ * secondary MMU through the MMU notifiers.  Accesses by QEMU itself, e.g.
+ * by migration or vhost, are counted too.
+ *
+ * The result is a histogram per node of the time since the last access
+ * to each page, from which the working set over any number of windows
+ * can be read off.  This needs CAP_SYS_ADMIN to read the page frame
+ * numbers from /proc/self/pagemap, and a kernel with
+ * CONFIG_IDLE_PAGE_TRACKING.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/error-report.h"
+#include "qemu/thread.h"
+#include "qemu/timer.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-machine.h"
+#include "exec/memory.h"
+#include "hw/boards.h"
+#include "system/hostmem.h"
+#include "system/numa.h"
+#include "trace.h"
+
+#define PAGEMAP_PRESENT     (1ULL << 63)
+#define PAGEMAP_PFN_MASK    ((1ULL << 55) - 1)
+/* Page frame numbers read from /proc/self/pagemap at once */
+#define PAGEMAP_BATCH       512
+
+#define WORKING_SET_MIN_WINDOW_MS   100
+#define WORKING_SET_MAX_WINDOW_MS   (3600 * 1000)
+#define WORKING_SET_MAX_WINDOWS     64
+#define WORKING_SET_DEFAULT_WINDOWS 10
+
+typedef struct WorkingSetRegion {
+    uint32_t node;
+    uint8_t *host;
+    uint64_t size;
+    /* Page frame number of each host page at the start of the window */
+    uint64_t *pfn;
+    /* Windows since the last access to each host page, capped */
+    uint8_t *idle;
+} WorkingSetRegion;
+
+static struct {
+    /* WorkingSetStatus, written by the thread once it started */
+    int status;
+    uint32_t window_ms;
+    uint32_t windows;
+    size_t page_size;
+    int pagemap_fd;
+    int bitmap_fd;
+    WorkingSetRegion *regions;
+    unsigned int nr_regions;
+    /* Set on failure, before the status becomes "failed" */
+    char *error;
+} working_set = {
+    .pagemap_fd = -1,
+    .bitmap_fd = -1,
+};
+
+static void working_set_free(void)
+{
+    unsigned int i;
+
+    for (i = 0; i < working_set.nr_regions; i++) {
+        g_free(working_set.regions[i].pfn);
+        g_free(working_set.regions[i].idle);
+    }
+    g_free(working_set.regions);
+    working_set.regions = NULL;
+    working_set.nr_regions = 0;
+    g_free(working_set.error);
+    working_set.error = NULL;
+    if (working_set.pagemap_fd >= 0) {
+        close(working_set.pagemap_fd);
+        working_set.pagemap_fd = -1;
+    }
+    if (working_set.bitmap_fd >= 0) {
+        close(working_set.bitmap_fd);
+        working_set.bitmap_fd = -1;
+    }
+}
+
+static void working_set_add_region(uint32_t node, MemoryRegion *mr)
+{
+    WorkingSetRegion *r;
+    uint64_t pages = memory_region_size(mr) / working_set.page_size;
+
+    working_set.regions = g_renew(WorkingSetRegion, working_set.regions,
+                                  working_set.nr_regions + 1);
+    r = &working_set.regions[working_set.nr_regions++];
+    r->node = node;
+    r->host = memory_region_get_ram_ptr(mr);
+    r->size = pages * working_set.page_size;
+    r->pfn = g_new(uint64_t, pages);
+    r->idle = g_new(uint8_t, pages);
+    /* Pages never accessed end up in the last bucket */
+    memset(r->idle, working_set.windows, pages);
+}
+
+static bool working_set_find_regions(Error **errp)
+{
+    MachineState *ms = current_machine;
+    int i;
+
+    for (i = 0; ms->numa_state && i < ms->numa_state->num_nodes; i++) {
+        HostMemoryBackend *memdev = ms->numa_state->nodes[i].node_memdev;
+
+        if (memdev) {
+            working_set_add_region(i, host_memory_backend_get_memory(memdev));
+        }
+    }
+    if (!working_set.nr_regions) {
+        if (!ms->ram || !memory_region_is_ram(ms->ram)) {
+            error_setg(errp, "the machine has no RAM backend to measure");
+            return false;
+        }
+        working_set_add_region(0, ms->ram);
+    }
+    return true;
+}
+
+/*
+ * Read the page frame numbers of the host pages of @r, 0 for those that
+ * are not resident, into @pfn.
+ */
+static bool working_set_read_pfns(WorkingSetRegion *r, uint64_t *pfn,
+                                  Error **errp)
+{
+    uint64_t pages = r->size / working_set.page_size;
+    uint64_t i, base = (uintptr_t)r->host / working_set.page_size;
+
+    for (i = 0; i < pages; i += PAGEMAP_BATCH) {
+        uint64_t n = MIN(PAGEMAP_BATCH, pages - i), j;
+        ssize_t len = n * sizeof(uint64_t);
+
+        if (pread(working_set.pagemap_fd, &pfn[i], len,
+                  (base + i) * sizeof(uint64_t)) != len) {
+            error_setg_errno(errp, errno, "cannot read /proc/self/pagemap");
+            return false;
+        }
+        for (j = i; j < i + n; j++) {
+            pfn[j] = pfn[j] & PAGEMAP_PRESENT ? pfn[j] & PAGEMAP_PFN_MASK : 0;
+        }
+    }
+    return true;
+}
+
+/*
+ * Read or write the words of the idle page bitmap that hold the bits of
+ * the nonzero page frames in @r->pfn.  On write, the set bits mark the
+ * page frames idle; on read, @visit is called for each of them with its
+ * bit.
+ */
+static bool working_set_bitmap(WorkingSetRegion *r, bool write,
+                               void (*visit)(WorkingSetRegion *r,
+                                             uint64_t page, bool idle),
+                               Error **errp)
+{
+    uint64_t pages = r->size / working_set.page_size;
+    uint64_t i = 0;
+
+    while (i < pages) {
+        uint64_t word = r->pfn[i] / 64, bits = 0, j;
+        off_t offset = word * sizeof(uint64_t);
+
+        /* Not resident, or already accounted for */
+        if (!r->pfn[i]) {
+            i++;
+            continue;
+        }
+
+        /* Consecutive page frames share the word */
+        for (j = i; j < pages && r->pfn[j] && r->pfn[j] / 64 == word; j++) {
+            bits |= 1ULL << (r->pfn[j] % 64);
+        }
+
+        if (write) {
+            if (pwrite(working_set.bitmap_fd, &bits, sizeof(bits), offset) !=
+                sizeof(bits)) {
+                error_setg_errno(errp, errno,
+                                 "cannot write the idle page bitmap");
+                return false;
+            }
+        } else {
+            if (pread(working_set.bitmap_fd, &bits, sizeof(bits), offset) !=
+                sizeof(bits)) {
+                error_setg_errno(errp, errno,
+                                 "cannot read the idle page bitmap");
+                return false;
+            }
+            for (; i < j; i++) {
+                visit(r, i, bits & (1ULL << (r->pfn[i] % 64)));
+            }
+        }
+        i = j;
+    }
+    return true;
+}
+
+static void working_set_visit(WorkingSetRegion *r, uint64_t page, bool idle)
+{
+    if (!idle) {
+        r->idle[page] = 0;
+    } else if (r->idle[page] < working_set.windows) {
+        r->idle[page]++;
+    }
+}
+
+static bool working_set_window(Error **errp)
+{
+    g_autofree uint64_t *pfn = NULL;
+    unsigned int i;
+    uint64_t j;
+
+    for (i = 0; i < working_set.nr_regions; i++) {
+        WorkingSetRegion *r = &working_set.regions[i];
+
+        if (!working_set_read_pfns(r, r->pfn, errp) ||
+            !working_set_bitmap(r, true, NULL, errp)) {
+            return false;
+        }
+    }
+
+    g_usleep(working_set.window_ms * 1000ULL);
+
+    for (i = 0; i < working_set.nr_regions; i++) {
+        WorkingSetRegion *r = &working_set.regions[i];
+        uint64_t pages = r->size / working_set.page_size;
+
+        pfn = g_renew(uint64_t, pfn, pages);
+        if (!working_set_read_pfns(r, pfn, errp)) {
+            return false;
+        }
+        for (j = 0; j < pages; j++) {
+            if (pfn[j] && pfn[j] == r->pfn[j]) {
+                continue;
+            }
+            /* Faulted in or moved during the window, or not resident */
+            working_set_visit(r, j, !pfn[j]);
+            r->pfn[j] = 0;
+        }
+        if (!working_set_bitmap(r, false, working_set_visit, errp)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void *working_set_thread(void *opaque)
+{
+    Error *local_err = NULL;
+    uint32_t i;
+
+    for (i = 0; i < working_set.windows; i++) {
+        trace_working_set_window(i, working_set.windows);
+        if (!working_set_window(&local_err)) {
+            working_set.error = g_strdup(error_get_pretty(local_err));
+            error_free(local_err);
+            qatomic_store_release(&working_set.status,
+                                  WORKING_SET_STATUS_FAILED);
+            return NULL;
+        }
+    }
+    qatomic_store_release(&working_set.status, WORKING_SET_STATUS_MEASURED);
+    return NULL;
+}
+
+void qmp_x_calc_working_set(uint32_t window_ms, bool has_windows,
+                            uint32_t windows, Error **errp)
+{
+    QemuThread thread;
+
+    if (qatomic_read(&working_set.status) == WORKING_SET_STATUS_MEASURING) {
+        error_setg(errp, "the working set is already being measured");
+        return;
+    }
+    if (window_ms < WORKING_SET_MIN_WINDOW_MS ||
+        window_ms > WORKING_SET_MAX_WINDOW_MS) {
+        error_setg(errp, "'window-ms' must be between %d and %d",
+                   WORKING_SET_MIN_WINDOW_MS, WORKING_SET_MAX_WINDOW_MS);
+        return;
+    }
+    if (!has_windows) {
+        windows = WORKING_SET_DEFAULT_WINDOWS;
+    }
+    if (!windows || windows > WORKING_SET_MAX_WINDOWS) {
+        error_setg(errp, "'windows' must be between 1 and %d",
+                   WORKING_SET_MAX_WINDOWS);
+        return;
+    }
+
+    working_set_free();
+    working_set.status = WORKING_SET_STATUS_UNSTARTED;
+    working_set.window_ms = window_ms;
+    working_set.windows = windows;
+    working_set.page_size = qemu_real_host_page_size();
+
+    working_set.pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+    if (working_set.pagemap_fd < 0) {
+        error_setg_errno(errp, errno, "cannot open /proc/self/pagemap");
+        return;
+    }
+    working_set.bitmap_fd = open("/sys/kernel/mm/page_idle/bitmap", O_RDWR);
+    if (working_set.bitmap_fd < 0) {
+        error_setg_errno(errp, errno, "cannot open the idle page bitmap, "
+                         "it needs CONFIG_IDLE_PAGE_TRACKING and root");
+        goto fail;
+    }
+    if (!working_set_find_regions(errp)) {
+        goto fail;
+    }
+
+    working_set.status = WORKING_SET_STATUS_MEASURING;
+    qemu_thread_create(&thread, "working-set", working_set_thread, NULL,
+                       QEMU_THREAD_DETACHED);
+    return;
+
+fail:
+    working_set_free();
+}
+
+WorkingSetInfo *qmp_x_query_working_set(Error **errp)
+{
+    WorkingSetInfo *info = g_new0(WorkingSetInfo, 1);
+    WorkingSetNodeList **tail = &info->nodes;
+    unsigned int i;
+    uint64_t j;
+
+    info->status = qatomic_load_acquire(&working_set.status);
+    info->window_ms = working_set.window_ms;
+    info->windows = working_set.windows;
+    info->page_size = working_set.page_size;
+
+    if (info->status == WORKING_SET_STATUS_FAILED) {
+        info->error = g_strdup(working_set.error);
+    }
+    if (info->status != WORKING_SET_STATUS_MEASURED) {
+        return info;
+    }
+
+    info->has_nodes = true;
+    for (i = 0; i < working_set.nr_regions; i++) {
+        WorkingSetRegion *r = &working_set.regions[i];
+        WorkingSetNode *node = g_new0(WorkingSetNode, 1);
+        g_autofree uint64_t *hist = g_new0(uint64_t, working_set.windows + 1);
+        uint64List **hist_tail = &node->idle_histogram;
+        uint64_t pages = r->size / working_set.page_size;
+
+        for (j = 0; j < pages; j++) {
+            hist[r->idle[j]] += working_set.page_size;
+        }
+        node->node = r->node;
+        node->size = r->size;
+        for (j = 0; j <= working_set.windows; j++) {
+            QAPI_LIST_APPEND(hist_tail, hist[j]);
+        }
+        QAPI_LIST_APPEND(tail, node);
+    }
+    return info;
+}
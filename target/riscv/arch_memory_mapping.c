@@ -0,0 +1,197 @@
+/*
+ * RISC-V memory mapping
+ *
+ * Walk the Sv32/Sv39/Sv48/Sv57 page tables selected by satp once, and
+ * report each run of leaf pages that is contiguous in both the virtual
+ * and the physical address space, with the same permissions, as a single
+ * mapping.  Used by "info mem" and by paging-mode guest memory dumps.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "cpu_bits.h"
+#include "exec/cpu-common.h"
+#include "system/memory_mapping.h"
+
+typedef struct RISCVPageTableWalk {
+    AddressSpace *as;
+    int ptidxbits;
+    int ptesize;
+    int va_bits;
+    bool canonical;
+    RISCVPageTableFn *fn;
+    void *opaque;
+
+    /* The mapping accumulated so far, empty if @size is 0 */
+    vaddr vbase;
+    hwaddr pbase;
+    vaddr size;
+    int attr;
+} RISCVPageTableWalk;
+
+static void riscv_walk_flush(RISCVPageTableWalk *w)
+{
+    if (w->size) {
+        w->fn(w->opaque, w->vbase, w->pbase, w->size, w->attr);
+        w->size = 0;
+    }
+}
+
+static void riscv_walk_leaf(RISCVPageTableWalk *w, vaddr va, hwaddr pa,
+                            vaddr size, int attr)
+{
+    /* Perform linear address sign extension */
+    if (w->canonical && (va & BIT_ULL(w->va_bits - 1))) {
+        va |= -BIT_ULL(w->va_bits);
+    }
+
+    if (w->size && w->attr == attr &&
+        w->vbase + w->size == va && w->pbase + w->size == pa) {
+        w->size += size;
+        return;
+    }
+
+    riscv_walk_flush(w);
+    w->vbase = va;
+    w->pbase = pa;
+    w->size = size;
+    w->attr = attr;
+}
+
+static void riscv_walk_level(RISCVPageTableWalk *w, hwaddr base, vaddr start,
+                             int level)
+{
+    vaddr pgsize = BIT_ULL(PGSHIFT + level * w->ptidxbits);
+    int idx;
+
+    for (idx = 0; idx < (1 << w->ptidxbits); idx++, start += pgsize) {
+        hwaddr pte_addr = base + idx * w->ptesize;
+        uint64_t pte;
+        hwaddr ppn;
+        int attr;
+
+        if (w->ptesize == 4) {
+            pte = address_space_ldl_le(w->as, pte_addr,
+                                       MEMTXATTRS_UNSPECIFIED, NULL);
+        } else {
+            pte = address_space_ldq_le(w->as, pte_addr,
+                                       MEMTXATTRS_UNSPECIFIED, NULL);
+        }
+
+        /* PTE has to be valid */
+        attr = pte & 0xff;
+        if (!(attr & PTE_V)) {
+            continue;
+        }
+
+        ppn = (pte & PTE_PPN_MASK) >> PTE_PPN_SHIFT;
+        if (!(attr & (PTE_R | PTE_W | PTE_X))) {
+            /* pointer to the next level of the page table */
+            if (level > 0) {
+                riscv_walk_level(w, ppn << PGSHIFT, start, level - 1);
+            }
+            continue;
+        }
+
+        /* A 64KiB NAPOT page encodes its size in the low bits of the PPN */
+        if (w->ptesize == 8 && (pte & PTE_N) && level == 0) {
+            ppn = (ppn & ~0xfULL) | ((start >> PGSHIFT) & 0xf);
+        }
+        riscv_walk_leaf(w, start, ppn << PGSHIFT, pgsize, attr);
+    }
+}
+
+bool riscv_cpu_walk_page_table(CPURISCVState *env, RISCVPageTableFn *fn,
+                               void *opaque)
+{
+    RISCVPageTableWalk w = {
+        .as = env_cpu(env)->as,
+        .fn = fn,
+        .opaque = opaque,
+    };
+    int levels, vm;
+    hwaddr base;
+
+    if (riscv_cpu_mxl(env) == MXL_RV32) {
+        base = (hwaddr)get_field(env->satp, SATP32_PPN) << PGSHIFT;
+        vm = get_field(env->satp, SATP32_MODE);
+    } else {
+        base = (hwaddr)get_field(env->satp, SATP64_PPN) << PGSHIFT;
+        vm = get_field(env->satp, SATP64_MODE);
+        w.canonical = true;
+    }
+
+    switch (vm) {
+    case VM_1_10_SV32:
+        levels = 2;
+        w.ptidxbits = 10;
+        w.ptesize = 4;
+        w.canonical = false;
+        break;
+    case VM_1_10_SV39:
+        levels = 3;
+        w.ptidxbits = 9;
+        w.ptesize = 8;
+        break;
+    case VM_1_10_SV48:
+        levels = 4;
+        w.ptidxbits = 9;
+        w.ptesize = 8;
+        break;
+    case VM_1_10_SV57:
+        levels = 5;
+        w.ptidxbits = 9;
+        w.ptesize = 8;
+        break;
+    default:
+        /* Bare, no translation */
+        return false;
+    }
+
+    /* calculate virtual address bits */
+    w.va_bits = PGSHIFT + levels * w.ptidxbits;
+
+    /* walk page tables, starting from address 0 */
+    riscv_walk_level(&w, base, 0, levels - 1);
+    /* don't forget the last one */
+    riscv_walk_flush(&w);
+    return true;
+}
+
+bool riscv_cpu_get_paging_enabled(const CPUState *cs)
+{
+    CPURISCVState *env = &RISCV_CPU(cs)->env;
+
+    if (!riscv_cpu_cfg(env)->mmu) {
+        return false;
+    }
+    if (riscv_cpu_mxl(env) == MXL_RV32) {
+        return get_field(env->satp, SATP32_MODE) != VM_1_10_MBARE;
+    }
+    return get_field(env->satp, SATP64_MODE) != VM_1_10_MBARE;
+}
+
+static void riscv_add_mapping(void *opaque, vaddr va, hwaddr pa, vaddr size,
+                              int attr)
+{
+    MemoryMappingList *list = opaque;
+
+    if (cpu_physical_memory_is_io(pa)) {
+        /* I/O region */
+        return;
+    }
+    memory_mapping_list_add_merge_sorted(list, pa, va, size);
+}
+
+bool riscv_cpu_get_memory_mapping(CPUState *cs, MemoryMappingList *list,
+                                  Error **errp)
+{
+    CPURISCVState *env = &RISCV_CPU(cs)->env;
+
+    if (riscv_cpu_get_paging_enabled(cs)) {
+        riscv_cpu_walk_page_table(env, riscv_add_mapping, list);
+    }
+    return true;
+}
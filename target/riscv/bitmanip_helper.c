@@ -23,31 +23,27 @@
 #include "exec/exec-all.h"
 #include "exec/helper-proto.h"
 #include "tcg/tcg.h"
+#include "crypto/clmul.h"
 
 target_ulong HELPER(clmul)(target_ulong rs1, target_ulong rs2)
 {
-    target_ulong result = 0;
-
-    for (int i = 0; i < TARGET_LONG_BITS; i++) {
-        if ((rs2 >> i) & 1) {
-            result ^= (rs1 << i);
-        }
-    }
-
-    return result;
+#if TARGET_LONG_BITS == 64
+    return int128_getlo(clmul_64(rs1, rs2));
+#else
+    return clmul_32(rs1, rs2);
+#endif
 }
 
+/* Bits [2 * XLEN - 2 : XLEN - 1] of the carry-less product */
 target_ulong HELPER(clmulr)(target_ulong rs1, target_ulong rs2)
 {
-    target_ulong result = 0;
-
-    for (int i = 0; i < TARGET_LONG_BITS; i++) {
-        if ((rs2 >> i) & 1) {
-            result ^= (rs1 >> (TARGET_LONG_BITS - i - 1));
-        }
-    }
+#if TARGET_LONG_BITS == 64
+    Int128 r = clmul_64(rs1, rs2);
 
-    return result;
+    return int128_gethi(r) << 1 | int128_getlo(r) >> 63;
+#else
+    return clmul_32(rs1, rs2) >> 31;
+#endif
 }
 
 static inline target_ulong do_swap(target_ulong x, uint64_t mask, int shift)
@@ -1090,6 +1090,7 @@ static void riscv_cpu_reset_hold(Object *obj, ResetType type)
         }
         i++;
     }
+    riscv_cpu_iprio_changed(env);
 
     /*
      * Bits 10, 6, 2 and 12 of mideleg are read only 1 when the Hypervisor
@@ -1108,6 +1109,9 @@ static void riscv_cpu_reset_hold(Object *obj, ResetType type)
         env->mseccfg = 0;
     }
 
+    env->sec_domain = 0;
+    memset(env->sec_domain_bank, 0, sizeof(env->sec_domain_bank));
+
     pmp_unlock_entries(env);
 #else
     env->priv = PRV_U;
@@ -1478,6 +1482,7 @@ static void riscv_cpu_init(Object *obj)
     cpu->cfg.cbom_blocksize = 64;
     cpu->cfg.cbop_blocksize = 64;
     cpu->cfg.cboz_blocksize = 64;
+    cpu->cfg.pmp_regions = OLD_MAX_RISCV_PMPS;
     cpu->env.vext_ver = VEXT_VERSION_1_00_0;
 }
 
@@ -1935,6 +1940,47 @@ static const PropertyInfo prop_pmp = {
     .set = prop_pmp_set,
 };
 
+static void prop_num_pmp_regions_set(Object *obj, Visitor *v, const char *name,
+                                     void *opaque, Error **errp)
+{
+    RISCVCPU *cpu = RISCV_CPU(obj);
+    uint8_t value;
+
+    if (!visit_type_uint8(v, name, &value, errp)) {
+        return;
+    }
+
+    if (value != 16 && value != 32 && value != 64) {
+        error_setg(errp, "Number of PMP regions must be 16, 32 or 64");
+        return;
+    }
+
+    if (cpu->cfg.pmp_regions != value && riscv_cpu_is_vendor(obj)) {
+        cpu_set_prop_err(cpu, name, errp);
+        error_append_hint(errp, "Current '%s' val: %u\n",
+                          name, cpu->cfg.pmp_regions);
+        return;
+    }
+
+    cpu_option_add_user_setting(name, value);
+    cpu->cfg.pmp_regions = value;
+}
+
+static void prop_num_pmp_regions_get(Object *obj, Visitor *v, const char *name,
+                                     void *opaque, Error **errp)
+{
+    uint8_t value = RISCV_CPU(obj)->cfg.pmp_regions;
+
+    visit_type_uint8(v, name, &value, errp);
+}
+
+static const PropertyInfo prop_num_pmp_regions = {
+    .type = "uint8",
+    .description = "num-pmp-regions",
+    .get = prop_num_pmp_regions_get,
+    .set = prop_num_pmp_regions_set,
+};
+
 static int priv_spec_from_str(const char *priv_spec_str)
 {
     int priv_version = -1;
@@ -2931,9 +2977,14 @@ static const Property riscv_cpu_properties[] = {
 
     {.name = "pmu-mask", .info = &prop_pmu_mask},
     {.name = "pmu-num", .info = &prop_pmu_num}, /* Deprecated */
+    DEFINE_PROP_BOOL("pmu-insn-count", RISCVCPU, cfg.pmu_insn_count, false),
 
     {.name = "mmu", .info = &prop_mmu},
+    DEFINE_PROP_BOOL("page-walk-cache", RISCVCPU, cfg.page_walk_cache, true),
     {.name = "pmp", .info = &prop_pmp},
+    {.name = "pmp-regions", .info = &prop_num_pmp_regions},
+    DEFINE_PROP_BOOL("pmp-range-flush", RISCVCPU, cfg.pmp_range_flush, true),
+    DEFINE_PROP_BOOL("x-sec-domain-tlb", RISCVCPU, cfg.sec_domain_tlb, false),
 
     {.name = "priv_spec", .info = &prop_priv_spec},
     {.name = "vext_spec", .info = &prop_vext_spec},
@@ -3028,7 +3079,10 @@ static int64_t riscv_get_arch_id(CPUState *cs)
 
 static const struct SysemuCPUOps riscv_sysemu_ops = {
     .has_work = riscv_cpu_has_work,
+    .get_memory_mapping = riscv_cpu_get_memory_mapping,
+    .get_paging_enabled = riscv_cpu_get_paging_enabled,
     .get_phys_page_debug = riscv_cpu_get_phys_page_debug,
+    .get_phys_range_debug = riscv_cpu_get_phys_range_debug,
     .write_elf64_note = riscv_cpu_write_elf64_note,
     .write_elf32_note = riscv_cpu_write_elf32_note,
     .legacy_vmsd = &vmstate_riscv_cpu,
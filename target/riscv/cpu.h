@@ -162,11 +162,55 @@ extern RISCVCPUImpliedExtsRule *riscv_multi_ext_implied_rules[];
 
 #define MMU_USER_IDX 3
 
-#define MAX_RISCV_PMPS (16)
+#define MAX_RISCV_PMPS (64)
+#define OLD_MAX_RISCV_PMPS (16)
 
 #if !defined(CONFIG_USER_ONLY)
 #include "pmp.h"
 #include "debug.h"
+
+/*
+ * Number of security domains with their own set of MMU indexes, see
+ * riscv_cpu_set_sec_domain().
+ */
+#define RISCV_SEC_DOMAINS 2
+
+/* State banked for the security domains that are not running */
+typedef struct {
+    target_ulong satp;
+    pmp_entry_t pmp[MAX_RISCV_PMPS];
+} RISCVSecDomainState;
+
+/*
+ * Page-walk cache of non-leaf PTEs, see get_physical_address().  The
+ * privileged spec allows these to be cached until the next SFENCE.VMA
+ * or HFENCE, like leaf PTEs in the TLB.
+ */
+#define RISCV_PWC_SIZE 64
+
+typedef struct RISCVPWCEntry {
+    hwaddr root;        /* root page table of the walk */
+    hwaddr base;        /* page table at @level */
+    target_ulong vpn;   /* address bits that select @base */
+    uint8_t level;      /* walk level of @base, 0 if the entry is invalid */
+    uint8_t vm;         /* translation mode of the walk */
+    uint8_t stage;      /* RISCV_PWC_STAGE_* */
+} RISCVPWCEntry;
+
+/*
+ * G-stage translations of the VS-stage page tables, so that a VS-stage
+ * walk does not need a full G-stage walk per level.  Flushed together
+ * with the page-walk cache, which HFENCE.GVMA also flushes.
+ */
+#define RISCV_GTC_SIZE 32
+
+typedef struct RISCVGTCEntry {
+    target_ulong hgatp; /* G-stage root and VMID of the translation */
+    hwaddr gpa;         /* guest physical page */
+    hwaddr hpa;         /* host physical page */
+    bool mxr;           /* HS-level MXR the translation was done with */
+    bool valid;
+} RISCVGTCEntry;
 #endif
 
 #define RV_VLEN_MAX 1024
@@ -180,6 +224,22 @@ FIELD(VTYPE, VMA, 7, 1)
 FIELD(VTYPE, VEDIV, 8, 2)
 FIELD(VTYPE, RESERVED, 10, sizeof(target_ulong) * 8 - 11)
 
+/*
+ * Last result of the AIA priority selection for one interrupt level,
+ * keyed by the set of pending and enabled interrupts it was computed for.
+ */
+typedef struct RISCVIrqPrioCache {
+    uint64_t pending;
+    int irq;
+} RISCVIrqPrioCache;
+
+enum {
+    RISCV_IRQ_PRIO_CACHE_M,
+    RISCV_IRQ_PRIO_CACHE_S,
+    RISCV_IRQ_PRIO_CACHE_VS,
+    RISCV_IRQ_PRIO_CACHE_NUM
+};
+
 typedef struct PMUCTRState {
     /* Current value of a counter */
     target_ulong mhpmcounter_val;
@@ -356,6 +416,9 @@ struct CPUArchState {
     target_ulong hvictl;
     uint8_t hviprio[64];
 
+    /* Only used by the vCPU thread, see riscv_cpu_local_irq_pending() */
+    RISCVIrqPrioCache irq_prio_cache[RISCV_IRQ_PRIO_CACHE_NUM];
+
     /* Upper 64-bits of 128-bit CSRs */
     uint64_t mscratchh;
     uint64_t sscratchh;
@@ -422,6 +485,12 @@ struct CPUArchState {
 
     PMUFixedCtrState pmu_fixed_ctrs[2];
 
+    /*
+     * Instructions retired, summed up per TB by the translator when the
+     * "pmu-insn-count" property is set and icount is disabled.
+     */
+    uint64_t pmu_insn_count;
+
     target_ulong sscratch;
     target_ulong mscratch;
 
@@ -434,6 +503,23 @@ struct CPUArchState {
     pmp_table_t pmp_state;
     target_ulong mseccfg;
 
+    /*
+     * PMP statistics, reported through query-stats.  Only the vCPU thread
+     * updates them, so they are plain counters: the region cache is checked
+     * on every slow path access, which is too hot for atomic adds.
+     * query-stats may read slightly stale values.
+     */
+    uint64_t pmp_subpage_fills;
+    uint64_t pmp_region_cache_hits;
+
+    /* security domain TLB tagging */
+    uint8_t sec_domain;
+    RISCVSecDomainState sec_domain_bank[RISCV_SEC_DOMAINS];
+
+    /* page-walk cache, not migrated */
+    RISCVPWCEntry pwc[RISCV_PWC_SIZE];
+    RISCVGTCEntry gtc[RISCV_GTC_SIZE];
+
     /* trigger module */
     target_ulong trigger_cur;
     target_ulong tdata1[RV_MAX_TRIGGERS];
@@ -490,6 +576,8 @@ struct CPUArchState {
     uint64_t kvm_timer_compare;
     uint64_t kvm_timer_state;
     uint64_t kvm_timer_frequency;
+    /* register values as last read from KVM, see kvm-cpu.c */
+    struct KVMRISCVRegShadow *kvm_shadow;
 #endif /* CONFIG_KVM */
 
     /* RNMI */
@@ -558,10 +646,24 @@ int riscv_cpu_write_elf64_note(WriteCoreDumpFunction f, CPUState *cs,
                                int cpuid, DumpState *s);
 int riscv_cpu_write_elf32_note(WriteCoreDumpFunction f, CPUState *cs,
                                int cpuid, DumpState *s);
+
+/*
+ * Called by riscv_cpu_walk_page_table() for each run of leaf pages that
+ * maps @size bytes at @va contiguously to @pa, with PTE bits @attr.
+ */
+typedef void RISCVPageTableFn(void *opaque, vaddr va, hwaddr pa, vaddr size,
+                              int attr);
+/* Walk the page tables of satp, return false if there is no translation */
+bool riscv_cpu_walk_page_table(CPURISCVState *env, RISCVPageTableFn *fn,
+                               void *opaque);
+bool riscv_cpu_get_paging_enabled(const CPUState *cs);
+bool riscv_cpu_get_memory_mapping(CPUState *cs, MemoryMappingList *list,
+                                  Error **errp);
 int riscv_cpu_gdb_read_register(CPUState *cpu, GByteArray *buf, int reg);
 int riscv_cpu_gdb_write_register(CPUState *cpu, uint8_t *buf, int reg);
 int riscv_cpu_hviprio_index2irq(int index, int *out_irq, int *out_rdzero);
 uint8_t riscv_cpu_default_priority(int irq);
+void riscv_cpu_iprio_changed(CPURISCVState *env);
 uint64_t riscv_cpu_all_pending(CPURISCVState *env);
 int riscv_cpu_mirq_pending(CPURISCVState *env);
 int riscv_cpu_sirq_pending(CPURISCVState *env);
@@ -572,6 +674,13 @@ void riscv_cpu_set_geilen(CPURISCVState *env, target_ulong geilen);
 bool riscv_cpu_vector_enabled(CPURISCVState *env);
 void riscv_cpu_set_virt_enabled(CPURISCVState *env, bool enable);
 int riscv_env_mmu_index(CPURISCVState *env, bool ifetch);
+#ifndef CONFIG_USER_ONLY
+uint16_t riscv_sec_domain_idxmap(CPURISCVState *env);
+void riscv_sec_domain_tlb_flush(CPURISCVState *env);
+void riscv_cpu_set_sec_domain(CPURISCVState *env, unsigned domain);
+void riscv_cpu_register_stats(void);
+void riscv_pwc_flush(CPURISCVState *env);
+#endif
 bool cpu_get_fcfien(CPURISCVState *env);
 bool cpu_get_bcfien(CPURISCVState *env);
 bool riscv_env_smode_dbltrp_enabled(CPURISCVState *env, bool virt);
@@ -594,6 +703,8 @@ void riscv_cpu_do_transaction_failed(CPUState *cs, hwaddr physaddr,
                                      int mmu_idx, MemTxAttrs attrs,
                                      MemTxResult response, uintptr_t retaddr);
 hwaddr riscv_cpu_get_phys_page_debug(CPUState *cpu, vaddr addr);
+hwaddr riscv_cpu_get_phys_range_debug(CPUState *cpu, vaddr addr, vaddr *len,
+                                      MemTxAttrs *attrs);
 bool riscv_cpu_exec_interrupt(CPUState *cs, int interrupt_request);
 void riscv_cpu_swap_hypervisor_regs(CPURISCVState *env);
 int riscv_cpu_claim_interrupts(RISCVCPU *cpu, uint64_t interrupts);
@@ -619,6 +730,7 @@ void riscv_cpu_set_mode(CPURISCVState *env, target_ulong newpriv, bool virt_en);
 
 void riscv_ctr_add_entry(CPURISCVState *env, target_long src, target_long dst,
     enum CTRType type, target_ulong prev_priv, bool prev_virt);
+uint16_t riscv_ctr_rec_types(CPURISCVState *env);
 void riscv_ctr_clear(CPURISCVState *env);
 
 void riscv_translate_init(void);
@@ -665,6 +777,12 @@ FIELD(TB_FLAGS, BCFI_ENABLED, 28, 1)
 FIELD(TB_FLAGS, PM_PMM, 29, 2)
 FIELD(TB_FLAGS, PM_SIGNEXTEND, 31, 1)
 
+/*
+ * TB_FLAGS2 live in cs_base. CTR_TYPES is the set of Smctr transfer types
+ * (BIT(CTRDATA_TYPE_*)) that are recorded for a transfer within the mode.
+ */
+FIELD(TB_FLAGS2, CTR_TYPES, 0, 16)
+
 #ifdef TARGET_RISCV32
 #define riscv_cpu_mxl(env)  ((void)(env), MXL_RV32)
 #else
@@ -892,6 +1010,14 @@ enum riscv_pmu_event_idx {
     RISCV_PMU_EVENT_CACHE_DTLB_READ_MISS = 0x10019,
     RISCV_PMU_EVENT_CACHE_DTLB_WRITE_MISS = 0x1001B,
     RISCV_PMU_EVENT_CACHE_ITLB_PREFETCH_MISS = 0x10021,
+    /*
+     * QEMU specific raw events, advertised to the SBI implementation
+     * through riscv,raw-event-to-mhpmcounters.
+     */
+    RISCV_PMU_EVENT_QEMU_EXCEPTIONS = 0x10000001,
+    RISCV_PMU_EVENT_QEMU_INTERRUPTS = 0x10000002,
+    RISCV_PMU_EVENT_QEMU_TB_TRANSLATIONS = 0x10000003,
+    RISCV_PMU_EVENT_QEMU_CSR_ACCESSES = 0x10000004,
 };
 
 /* used by tcg/tcg-cpu.c*/
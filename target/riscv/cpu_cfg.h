@@ -184,13 +184,18 @@ struct RISCVCPUConfig {
     bool ext_XVentanaCondOps;
 
     uint32_t pmu_mask;
+    bool pmu_insn_count;
     uint16_t vlenb;
     uint16_t elen;
     uint16_t cbom_blocksize;
     uint16_t cbop_blocksize;
     uint16_t cboz_blocksize;
     bool mmu;
+    bool page_walk_cache;
     bool pmp;
+    bool pmp_range_flush;
+    uint8_t pmp_regions;
+    bool sec_domain_tlb;
     bool debug;
     bool misa_w;
 
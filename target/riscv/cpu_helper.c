@@ -34,6 +34,7 @@
 #include "system/cpu-timers.h"
 #include "cpu_bits.h"
 #include "debug.h"
+#include "domain-check.h"
 #include "pmp.h"
 
 int riscv_env_mmu_index(CPURISCVState *env, bool ifetch)
@@ -61,10 +62,106 @@ int riscv_env_mmu_index(CPURISCVState *env, bool ifetch)
         }
     }
 
+    if (env->sec_domain) {
+        mode |= MMU_SEC_DOMAIN_BIT;
+    }
+
     return mode | (virt ? MMU_2STAGE_BIT : 0);
 #endif
 }
 
+#ifndef CONFIG_USER_ONLY
+/*
+ * Return the MMU indexes that hold TLB entries of the running security
+ * domain. All of them when security domains are not in use.
+ */
+uint16_t riscv_sec_domain_idxmap(CPURISCVState *env)
+{
+    uint16_t idxmap = 0;
+    int idx;
+
+    if (!riscv_cpu_cfg(env)->sec_domain_tlb) {
+        return MAKE_64BIT_MASK(0, NB_MMU_MODES);
+    }
+
+    for (idx = 0; idx < NB_MMU_MODES; idx++) {
+        if (!!(idx & MMU_SEC_DOMAIN_BIT) == env->sec_domain) {
+            idxmap |= 1 << idx;
+        }
+    }
+
+    return idxmap;
+}
+
+/*
+ * Flush the TLB entries that may depend on the current satp and PMP
+ * settings, leaving those of the other security domains alone.
+ */
+void riscv_sec_domain_tlb_flush(CPURISCVState *env)
+{
+    CPUState *cs = env_cpu(env);
+
+    riscv_pwc_flush(env);
+    if (riscv_cpu_cfg(env)->sec_domain_tlb) {
+        tlb_flush_by_mmuidx(cs, riscv_sec_domain_idxmap(env));
+    } else {
+        tlb_flush(cs);
+    }
+}
+
+/*
+ * Switch to security domain @domain.
+ *
+ * Each domain owns a set of MMU indexes and a bank of satp and PMP
+ * entries, so that the TLB entries filled while a domain ran stay valid
+ * across switches and no flush is needed. Locked PMP entries cannot be
+ * changed anyway and are shared by all domains.
+ */
+void riscv_cpu_set_sec_domain(CPURISCVState *env, unsigned domain)
+{
+    RISCVSecDomainState *bank;
+    int num = riscv_cpu_cfg(env)->pmp_regions;
+    int i;
+
+    if (!riscv_cpu_cfg(env)->sec_domain_tlb ||
+        domain >= RISCV_SEC_DOMAINS || domain == env->sec_domain) {
+        return;
+    }
+
+    bank = &env->sec_domain_bank[env->sec_domain];
+    bank->satp = env->satp;
+    memcpy(bank->pmp, env->pmp_state.pmp, sizeof(bank->pmp));
+
+    bank = &env->sec_domain_bank[domain];
+    env->satp = bank->satp;
+    for (i = 0; i < num; i++) {
+        uint8_t cfg = env->pmp_state.pmp[i].cfg_reg;
+
+        if ((cfg & PMP_LOCK) && !MSECCFG_RLB_ISSET(env)) {
+            continue;
+        }
+        /* pmpaddr of a locked TOR entry's base is locked too */
+        if (i + 1 < num &&
+            (env->pmp_state.pmp[i + 1].cfg_reg & PMP_LOCK) &&
+            !MSECCFG_RLB_ISSET(env) &&
+            get_field(env->pmp_state.pmp[i + 1].cfg_reg, PMP_AMATCH) ==
+            PMP_AMATCH_TOR) {
+            env->pmp_state.pmp[i].cfg_reg = bank->pmp[i].cfg_reg;
+            continue;
+        }
+        env->pmp_state.pmp[i] = bank->pmp[i];
+    }
+
+    for (i = 0; i < num; i++) {
+        pmp_update_rule_addr(env, i);
+    }
+    pmp_update_rule_nums(env);
+    pmp_update_region_table(env);
+
+    env->sec_domain = domain;
+}
+#endif
+
 bool cpu_get_fcfien(CPURISCVState *env)
 {
     /* no cfi extension, return false */
@@ -219,6 +316,11 @@ void cpu_get_tb_cpu_state(CPURISCVState *env, vaddr *pc,
     if (cpu->cfg.debug && !icount_enabled()) {
         flags = FIELD_DP32(flags, TB_FLAGS, ITRIGGER, env->itrigger_enabled);
     }
+
+    if (cpu->cfg.ext_smctr || cpu->cfg.ext_ssctr) {
+        *cs_base = FIELD_DP64(*cs_base, TB_FLAGS2, CTR_TYPES,
+                              riscv_ctr_rec_types(env));
+    }
 #endif
 
     flags = FIELD_DP32(flags, TB_FLAGS, FS, fs);
@@ -514,6 +616,38 @@ static int riscv_cpu_pending_to_irq(CPURISCVState *env,
     return best_irq;
 }
 
+/*
+ * With AIA, picking the highest priority interrupt walks every pending bit
+ * and its iprio entry. The outcome only changes when the pending set or the
+ * priorities do, so remember it per level. The pending set is the lookup
+ * key, which covers mip, mie, delegation and the virtual interrupt CSRs;
+ * riscv_cpu_iprio_changed() must be called when an iprio array is written.
+ */
+static int riscv_cpu_pending_to_irq_cached(CPURISCVState *env, int level,
+                                           int extirq,
+                                           unsigned int extirq_def_prio,
+                                           uint64_t pending, uint8_t *iprio)
+{
+    RISCVIrqPrioCache *cache = &env->irq_prio_cache[level];
+
+    if (cache->pending != pending) {
+        cache->irq = riscv_cpu_pending_to_irq(env, extirq, extirq_def_prio,
+                                              pending, iprio);
+        cache->pending = pending;
+    }
+    return cache->irq;
+}
+
+void riscv_cpu_iprio_changed(CPURISCVState *env)
+{
+    int i;
+
+    for (i = 0; i < RISCV_IRQ_PRIO_CACHE_NUM; i++) {
+        env->irq_prio_cache[i].pending = 0;
+        env->irq_prio_cache[i].irq = RISCV_EXCP_NONE;
+    }
+}
+
 /*
  * Doesn't report interrupts inserted using mvip from M-mode firmware or
  * using hvip bits 13:63 from HS-mode. Those are returned in
@@ -600,8 +734,9 @@ static int riscv_cpu_local_irq_pending(CPURISCVState *env)
     /* Check M-mode interrupts */
     irqs = pending & ~env->mideleg & -mie;
     if (irqs) {
-        return riscv_cpu_pending_to_irq(env, IRQ_M_EXT, IPRIO_DEFAULT_M,
-                                        irqs, env->miprio);
+        return riscv_cpu_pending_to_irq_cached(env, RISCV_IRQ_PRIO_CACHE_M,
+                                               IRQ_M_EXT, IPRIO_DEFAULT_M,
+                                               irqs, env->miprio);
     }
 
     /* Check for virtual S-mode interrupts. */
@@ -610,8 +745,9 @@ static int riscv_cpu_local_irq_pending(CPURISCVState *env)
     /* Check HS-mode interrupts */
     irqs =  ((pending & env->mideleg & ~env->hideleg) | irqs_f) & -hsie;
     if (irqs) {
-        return riscv_cpu_pending_to_irq(env, IRQ_S_EXT, IPRIO_DEFAULT_S,
-                                        irqs, env->siprio);
+        return riscv_cpu_pending_to_irq_cached(env, RISCV_IRQ_PRIO_CACHE_S,
+                                               IRQ_S_EXT, IPRIO_DEFAULT_S,
+                                               irqs, env->siprio);
     }
 
     /* Check for virtual VS-mode interrupts. */
@@ -627,8 +763,9 @@ static int riscv_cpu_local_irq_pending(CPURISCVState *env)
 
     irqs = (irq_delegated | irqs_f_vs) & -vsie;
     if (irqs) {
-        virq = riscv_cpu_pending_to_irq(env, IRQ_S_EXT, IPRIO_DEFAULT_S,
-                                        irqs, env->hviprio);
+        virq = riscv_cpu_pending_to_irq_cached(env, RISCV_IRQ_PRIO_CACHE_VS,
+                                               IRQ_S_EXT, IPRIO_DEFAULT_S,
+                                               irqs, env->hviprio);
         if (virq <= 0 || (virq > 12 && virq <= 63)) {
             return virq;
         } else {
@@ -1028,6 +1165,10 @@ static bool riscv_ctr_check_xte(CPURISCVState *env, target_long src_prv,
 void riscv_ctr_add_entry(CPURISCVState *env, target_long src, target_long dst,
     enum CTRType type, target_ulong src_priv, bool src_virt)
 {
+    /*
+     * Keep in sync with riscv_ctr_rec_types(), which the translator uses to
+     * skip this call for transfers that stay in the current mode.
+     */
     bool tgt_virt = env->virt_enabled;
     uint64_t src_mask = riscv_ctr_priv_to_mask(src_priv, src_virt);
     uint64_t tgt_mask = riscv_ctr_priv_to_mask(env->priv, tgt_virt);
@@ -1124,6 +1265,34 @@ void riscv_ctr_add_entry(CPURISCVState *env, target_long src, target_long dst,
     env->sctrstatus = set_field(env->sctrstatus, SCTRSTATUS_WRPTR_MASK, head);
 }
 
+/*
+ * The transfer types recorded by riscv_ctr_add_entry() when the source and
+ * target modes are both the current one, i.e. for branches and jumps.
+ * This only depends on state that ends the TB when it changes, so it is
+ * folded into the TB flags and filtered at translation time.
+ */
+uint16_t riscv_ctr_rec_types(CPURISCVState *env)
+{
+    uint64_t mask = riscv_ctr_priv_to_mask(env->priv, env->virt_enabled);
+    uint64_t ctl = riscv_ctr_get_control(env, env->priv, env->virt_enabled);
+    uint16_t types;
+
+    if (!(ctl & mask) || env->sctrstatus & SCTRSTATUS_FROZEN) {
+        return 0;
+    }
+
+    if (ctl & XCTRCTL_RASEMU) {
+        return BIT(CTRDATA_TYPE_INDIRECT_CALL) |
+               BIT(CTRDATA_TYPE_DIRECT_CALL) |
+               BIT(CTRDATA_TYPE_RETURN) |
+               BIT(CTRDATA_TYPE_CO_ROUTINE_SWAP);
+    }
+
+    /* Not taken branch filter is an enable bit, the others inhibit. */
+    types = ~(ctl >> XCTRCTL_INH_START);
+    return types ^ BIT(CTRDATA_TYPE_NONTAKEN_BRANCH);
+}
+
 void riscv_cpu_set_mode(CPURISCVState *env, target_ulong newpriv, bool virt_en)
 {
     g_assert(newpriv <= PRV_M && newpriv != PRV_RESERVED);
@@ -1280,8 +1449,98 @@ static bool check_svukte_addr(CPURISCVState *env, vaddr addr)
  * @two_stage: Are we going to perform two stage translation
  * @is_debug: Is this access from a debugger or the monitor?
  */
+/* Which page tables a page-walk cache entry was filled from */
+enum {
+    RISCV_PWC_STAGE_S,      /* single stage, satp */
+    RISCV_PWC_STAGE_VS,     /* VS-stage, tables at guest physical addresses */
+    RISCV_PWC_STAGE_G,      /* G-stage, hgatp */
+};
+
+void riscv_pwc_flush(CPURISCVState *env)
+{
+    memset(env->pwc, 0, sizeof(env->pwc));
+    memset(env->gtc, 0, sizeof(env->gtc));
+}
+
+static RISCVPWCEntry *riscv_pwc_entry(CPURISCVState *env, hwaddr root,
+                                      target_ulong vpn, int level)
+{
+    unsigned h = vpn ^ (root >> PGSHIFT) ^ (level * 0x11);
+
+    return &env->pwc[h & (RISCV_PWC_SIZE - 1)];
+}
+
+/*
+ * Find the deepest cached page table on the walk of @addr from @root.
+ * Returns its level and stores its address in @base, or returns 0 if
+ * the walk has to start from the root.
+ */
+static int riscv_pwc_lookup(CPURISCVState *env, hwaddr root, int vm,
+                            int stage, vaddr addr, int levels,
+                            int ptidxbits, hwaddr *base)
+{
+    int level;
+
+    for (level = levels - 1; level > 0; level--) {
+        target_ulong vpn = addr >> (PGSHIFT + (levels - level) * ptidxbits);
+        RISCVPWCEntry *e = riscv_pwc_entry(env, root, vpn, level);
+
+        if (e->level == level && e->vpn == vpn && e->root == root &&
+            e->vm == vm && e->stage == stage) {
+            *base = e->base;
+            return level;
+        }
+    }
+    return 0;
+}
+
+static void riscv_pwc_insert(CPURISCVState *env, hwaddr root, int vm,
+                             int stage, target_ulong vpn, int level,
+                             hwaddr base)
+{
+    RISCVPWCEntry *e = riscv_pwc_entry(env, root, vpn, level);
+
+    e->root = root;
+    e->base = base;
+    e->vpn = vpn;
+    e->level = level;
+    e->vm = vm;
+    e->stage = stage;
+}
+
+/* MXR bit that applies to G-stage translations, see the leaf checks below */
+static bool riscv_gtc_mxr(CPURISCVState *env)
+{
+    return get_field(env->virt_enabled ? env->mstatus_hs : env->mstatus,
+                     MSTATUS_MXR);
+}
+
+/* Look up the G-stage translation of the VS-stage page table at @gpa */
+static bool riscv_gtc_lookup(CPURISCVState *env, hwaddr gpa, hwaddr *hpa)
+{
+    RISCVGTCEntry *e = &env->gtc[(gpa >> PGSHIFT) & (RISCV_GTC_SIZE - 1)];
+
+    if (e->valid && e->gpa == gpa && e->hgatp == env->hgatp &&
+        e->mxr == riscv_gtc_mxr(env)) {
+        *hpa = e->hpa;
+        return true;
+    }
+    return false;
+}
+
+static void riscv_gtc_insert(CPURISCVState *env, hwaddr gpa, hwaddr hpa)
+{
+    RISCVGTCEntry *e = &env->gtc[(gpa >> PGSHIFT) & (RISCV_GTC_SIZE - 1)];
+
+    e->hgatp = env->hgatp;
+    e->gpa = gpa;
+    e->hpa = hpa;
+    e->mxr = riscv_gtc_mxr(env);
+    e->valid = true;
+}
+
 static int get_physical_address(CPURISCVState *env, hwaddr *physical,
-                                int *ret_prot, vaddr addr,
+                                int *ret_prot, int *ret_lg_size, vaddr addr,
                                 target_ulong *fault_pte_addr,
                                 int access_type, int mmu_idx,
                                 bool first_stage, bool two_stage,
@@ -1295,7 +1554,7 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
     MemTxResult res;
     MemTxAttrs attrs = MEMTXATTRS_UNSPECIFIED;
     int mode = mmuidx_priv(mmu_idx);
-    bool virt = mmuidx_2stage(mmu_idx);
+    bool virt = mmuidx_2stage(mmuidx_strip_sec_domain(env, mmu_idx));
     bool use_background = false;
     hwaddr ppn;
     int napot_bits = 0;
@@ -1414,10 +1673,21 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
     int ptshift = (levels - 1) * ptidxbits;
     target_ulong pte;
     hwaddr pte_addr;
-    int i;
+    hwaddr root = base;
+    int stage = !first_stage ? RISCV_PWC_STAGE_G :
+                two_stage ? RISCV_PWC_STAGE_VS : RISCV_PWC_STAGE_S;
+    bool use_pwc = riscv_cpu_cfg(env)->page_walk_cache && !is_debug;
+    int i = 0;
+
+    /* Skip the levels whose non-leaf PTEs are already cached. */
+    if (use_pwc) {
+        i = riscv_pwc_lookup(env, root, vm, stage, addr, levels, ptidxbits,
+                             &base);
+        ptshift -= i * ptidxbits;
+    }
 
  restart:
-    for (i = 0; i < levels; i++, ptshift -= ptidxbits) {
+    for (; i < levels; i++, ptshift -= ptidxbits) {
         target_ulong idx;
         if (i == 0) {
             idx = (addr >> (PGSHIFT + ptshift)) &
@@ -1433,17 +1703,24 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
             int vbase_prot;
             hwaddr vbase;
 
-            /* Do the second stage translation on the base PTE address. */
-            int vbase_ret = get_physical_address(env, &vbase, &vbase_prot,
-                                                 base, NULL, MMU_DATA_LOAD,
-                                                 MMUIdx_U, false, true,
-                                                 is_debug, false);
+            if (!use_pwc || !riscv_gtc_lookup(env, base, &vbase)) {
+                /* Do the second stage translation on the base PTE address. */
+                int vbase_ret = get_physical_address(env, &vbase, &vbase_prot,
+                                                     NULL, base, NULL,
+                                                     MMU_DATA_LOAD, MMUIdx_U,
+                                                     false, true, is_debug,
+                                                     false);
+
+                if (vbase_ret != TRANSLATE_SUCCESS) {
+                    if (fault_pte_addr) {
+                        *fault_pte_addr = (base + idx * ptesize) >> 2;
+                    }
+                    return TRANSLATE_G_STAGE_FAIL;
+                }
 
-            if (vbase_ret != TRANSLATE_SUCCESS) {
-                if (fault_pte_addr) {
-                    *fault_pte_addr = (base + idx * ptesize) >> 2;
+                if (use_pwc) {
+                    riscv_gtc_insert(env, base, vbase);
                 }
-                return TRANSLATE_G_STAGE_FAIL;
             }
 
             pte_addr = vbase + idx * ptesize;
@@ -1518,6 +1795,10 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
         }
         /* Inner PTE, continue walking */
         base = ppn << PGSHIFT;
+        if (use_pwc && i + 1 < levels) {
+            riscv_pwc_insert(env, root, vm, stage, addr >> (PGSHIFT + ptshift),
+                             i + 1, base);
+        }
     }
 
     /* No leaf pte at any translation level. */
@@ -1693,6 +1974,9 @@ static int get_physical_address(CPURISCVState *env, hwaddr *physical,
     *physical = (((ppn & ~napot_mask) | (vpn & napot_mask) |
                   (vpn & (((target_ulong)1 << ptshift) - 1))
                  ) << PGSHIFT) | (addr & ~TARGET_PAGE_MASK);
+    if (ret_lg_size) {
+        *ret_lg_size = PGSHIFT + ptshift + napot_bits;
+    }
 
     /*
      * Remove write permission unless this is a store, or the page is
@@ -1750,27 +2034,52 @@ static void raise_mmu_exception(CPURISCVState *env, target_ulong address,
     env->two_stage_indirect_lookup = two_stage_indirect;
 }
 
-hwaddr riscv_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
+hwaddr riscv_cpu_get_phys_range_debug(CPUState *cs, vaddr addr, vaddr *len,
+                                      MemTxAttrs *attrs)
 {
     RISCVCPU *cpu = RISCV_CPU(cs);
     CPURISCVState *env = &cpu->env;
     hwaddr phys_addr;
     int prot;
     int mmu_idx = riscv_env_mmu_index(&cpu->env, false);
+    /* Without translation, the mapping is the identity within the page */
+    int lg_size = TARGET_PAGE_BITS;
+    vaddr size;
+
+    *attrs = MEMTXATTRS_UNSPECIFIED;
 
-    if (get_physical_address(env, &phys_addr, &prot, addr, NULL, 0, mmu_idx,
-                             true, env->virt_enabled, true, false)) {
+    if (get_physical_address(env, &phys_addr, &prot, &lg_size, addr, NULL, 0,
+                             mmu_idx, true, env->virt_enabled, true, false)) {
         return -1;
     }
+    size = BIT_ULL(lg_size);
+    *len = size - (addr & (size - 1));
 
     if (env->virt_enabled) {
-        if (get_physical_address(env, &phys_addr, &prot, phys_addr, NULL,
-                                 0, MMUIdx_U, false, true, true, false)) {
+        hwaddr gpa = phys_addr;
+
+        lg_size = TARGET_PAGE_BITS;
+        if (get_physical_address(env, &phys_addr, &prot, &lg_size, gpa,
+                                 NULL, 0, MMUIdx_U, false, true, true,
+                                 false)) {
             return -1;
         }
+        /* The G-stage mapping may be smaller than the VS-stage one */
+        size = BIT_ULL(lg_size);
+        *len = MIN(*len, size - (gpa & (size - 1)));
     }
 
-    return phys_addr & TARGET_PAGE_MASK;
+    return phys_addr;
+}
+
+hwaddr riscv_cpu_get_phys_page_debug(CPUState *cs, vaddr addr)
+{
+    MemTxAttrs attrs;
+    vaddr len;
+    hwaddr phys_addr;
+
+    phys_addr = riscv_cpu_get_phys_range_debug(cs, addr, &len, &attrs);
+    return phys_addr == -1 ? -1 : phys_addr & TARGET_PAGE_MASK;
 }
 
 void riscv_cpu_do_transaction_failed(CPUState *cs, hwaddr physaddr,
@@ -1791,7 +2100,8 @@ void riscv_cpu_do_transaction_failed(CPUState *cs, hwaddr physaddr,
     }
 
     env->badaddr = addr;
-    env->two_stage_lookup = mmuidx_2stage(mmu_idx);
+    env->two_stage_lookup = mmuidx_2stage(mmuidx_strip_sec_domain(env,
+                                                                  mmu_idx));
     env->two_stage_indirect_lookup = false;
     cpu_loop_exit_restore(cs, retaddr);
 }
@@ -1824,7 +2134,8 @@ void riscv_cpu_do_unaligned_access(CPUState *cs, vaddr addr,
         g_assert_not_reached();
     }
     env->badaddr = addr;
-    env->two_stage_lookup = mmuidx_2stage(mmu_idx);
+    env->two_stage_lookup = mmuidx_2stage(mmuidx_strip_sec_domain(env,
+                                                                  mmu_idx));
     env->two_stage_indirect_lookup = false;
     cpu_loop_exit_restore(cs, retaddr);
 }
@@ -1862,12 +2173,15 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     int prot, prot2, prot_pmp;
     bool pmp_violation = false;
     bool first_stage_error = true;
-    bool two_stage_lookup = mmuidx_2stage(mmu_idx);
+    bool two_stage_lookup =
+        mmuidx_2stage(mmuidx_strip_sec_domain(env, mmu_idx));
     bool two_stage_indirect_error = false;
     int ret = TRANSLATE_FAIL;
     int mode = mmuidx_priv(mmu_idx);
     /* default TLB page size */
     hwaddr tlb_size = TARGET_PAGE_SIZE;
+    /* size of the leaf page, or of the smaller one for two stages */
+    int lg_size = TARGET_PAGE_BITS, lg_size2 = TARGET_PAGE_BITS;
 
     env->guest_phys_fault_addr = 0;
 
@@ -1877,7 +2191,7 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
     pmu_tlb_fill_incr_ctr(cpu, access_type);
     if (two_stage_lookup) {
         /* Two stage lookup */
-        ret = get_physical_address(env, &pa, &prot, address,
+        ret = get_physical_address(env, &pa, &prot, &lg_size, address,
                                    &env->guest_phys_fault_addr, access_type,
                                    mmu_idx, true, true, false, probe);
 
@@ -1900,9 +2214,10 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
             /* Second stage lookup */
             im_address = pa;
 
-            ret = get_physical_address(env, &pa, &prot2, im_address, NULL,
-                                       access_type, MMUIdx_U, false, true,
-                                       false, probe);
+            ret = get_physical_address(env, &pa, &prot2, &lg_size2,
+                                       im_address, NULL, access_type,
+                                       MMUIdx_U, false, true, false, probe);
+            lg_size = MIN(lg_size, lg_size2);
 
             qemu_log_mask(CPU_LOG_MMU,
                           "%s 2nd-stage address=%" VADDR_PRIx
@@ -1938,7 +2253,7 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         }
     } else {
         /* Single stage lookup */
-        ret = get_physical_address(env, &pa, &prot, address, NULL,
+        ret = get_physical_address(env, &pa, &prot, &lg_size, address, NULL,
                                    access_type, mmu_idx, true, false, false,
                                    probe);
 
@@ -1961,11 +2276,43 @@ bool riscv_cpu_tlb_fill(CPUState *cs, vaddr address, int size,
         }
     }
 
+    if (ret == TRANSLATE_SUCCESS &&
+        !riscv_domain_check(env, address, pa, access_type, mode)) {
+        ret = TRANSLATE_PMP_FAIL;
+    }
+
     if (ret == TRANSLATE_PMP_FAIL) {
         pmp_violation = true;
     }
 
     if (ret == TRANSLATE_SUCCESS) {
+        if (tlb_size < TARGET_PAGE_SIZE) {
+            /*
+             * The entry will not be cached, so every access to the page
+             * comes back here through the slow path.
+             */
+            env->pmp_subpage_fills++;
+            trace_riscv_pmp_subpage_fill(env->mhartid, address, pa, mmu_idx);
+        } else if (lg_size > TARGET_PAGE_BITS &&
+                   pmp_is_range_uniform(env, pa & -((hwaddr)1 << lg_size),
+                                        (hwaddr)1 << lg_size) &&
+                   riscv_domain_range_uniform(pa & -((hwaddr)1 << lg_size),
+                                              (hwaddr)1 << lg_size)) {
+            /*
+             * A superpage with the same PMP permissions throughout: let
+             * cputlb refill its other pages without another walk.
+             */
+            CPUTLBEntryFull full = {
+                .phys_addr = pa & TARGET_PAGE_MASK,
+                .attrs = MEMTXATTRS_UNSPECIFIED,
+                .prot = prot,
+                .lg_page_size = lg_size,
+                .lg_page_uniform = true,
+            };
+
+            tlb_set_page_full(cs, mmu_idx, address & TARGET_PAGE_MASK, &full);
+            return true;
+        }
         tlb_set_page(cs, address & ~(tlb_size - 1), pa & ~(tlb_size - 1),
                      prot, mmu_idx, tlb_size);
         return true;
@@ -2370,6 +2717,10 @@ void riscv_cpu_do_interrupt(CPUState *cs)
     trace_riscv_trap(env->mhartid, async, cause, env->pc, tval,
                      riscv_cpu_get_trap_name(cause, async));
 
+    /* Counted against the privilege mode the trap is taken from */
+    riscv_pmu_incr_ctr(cpu, async ? RISCV_PMU_EVENT_QEMU_INTERRUPTS :
+                                    RISCV_PMU_EVENT_QEMU_EXCEPTIONS);
+
     qemu_log_mask(CPU_LOG_INT,
                   "%s: hart:"TARGET_FMT_ld", async:%d, cause:"TARGET_FMT_lx", "
                   "epc:0x"TARGET_FMT_lx", tval:0x"TARGET_FMT_lx", desc=%s\n",
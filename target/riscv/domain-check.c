@@ -0,0 +1,269 @@
+/*
+ * RISC-V cross-domain access checker
+ *
+ * Guest physical pages can be tagged with the security domain that owns
+ * them, the one selected with msecdomain (see riscv_cpu_set_sec_domain()).
+ * With checking enabled, each TLB fill of a hart below M-mode verifies
+ * that the running domain owns the page, or that the page is untagged.
+ * The page then stays mapped in the TLB like a page that passed the PMP
+ * check, so accesses within mapped pages run at full speed and the cost
+ * is only paid on TLB misses.  Changing the tags or the action flushes
+ * the TLBs of all harts.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/lockable.h"
+#include "qemu/log.h"
+#include "qemu/rcu.h"
+#include "exec/cputlb.h"
+#include "hw/core/cpu.h"
+#include "domain-check.h"
+#include "trace.h"
+
+typedef struct RISCVDomainTag {
+    hwaddr start;
+    hwaddr last;
+    uint8_t domain;
+} RISCVDomainTag;
+
+typedef struct RISCVDomainTags {
+    struct rcu_head rcu;
+    unsigned int num;
+    /* Sorted and non-overlapping */
+    RISCVDomainTag tag[];
+} RISCVDomainTags;
+
+typedef struct RISCVDomainViolation {
+    uint64_t hartid;
+    target_ulong pc;
+    vaddr addr;
+    hwaddr pa;
+    MMUAccessType access_type;
+    int mode;
+    uint8_t domain;
+    uint8_t owner;
+} RISCVDomainViolation;
+
+/* Number of violations kept for x-query-riscv-domain-violations */
+#define RISCV_DOMAIN_VIOLATION_LOG 64
+
+static RiscvDomainCheckAction riscv_domain_action;
+static RISCVDomainTags *riscv_domain_tags;
+
+static struct {
+    /* Protects the rest, against the vCPU threads */
+    QemuMutex lock;
+    uint64_t count;
+    RISCVDomainViolation log[RISCV_DOMAIN_VIOLATION_LOG];
+} riscv_domain_violations;
+
+static const char *const access_names[] = {
+    [MMU_DATA_LOAD] = "load",
+    [MMU_DATA_STORE] = "store",
+    [MMU_INST_FETCH] = "fetch",
+};
+
+static void riscv_domain_flush_all(void)
+{
+    CPUState *cs;
+
+    CPU_FOREACH(cs) {
+        tlb_flush(cs);
+    }
+}
+
+/* Return the first tag that ends at or after @pa, NULL if there is none. */
+static const RISCVDomainTag *riscv_domain_find(const RISCVDomainTags *tags,
+                                               hwaddr pa)
+{
+    unsigned int lo = 0, hi = tags->num;
+
+    while (lo < hi) {
+        unsigned int mid = lo + (hi - lo) / 2;
+
+        if (tags->tag[mid].last < pa) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo < tags->num ? &tags->tag[lo] : NULL;
+}
+
+static gint riscv_domain_tag_compare(gconstpointer a, gconstpointer b)
+{
+    const RISCVDomainTag *x = a, *y = b;
+
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+
+void riscv_domain_tag(hwaddr start, hwaddr size, bool has_domain,
+                      uint8_t domain)
+{
+    RISCVDomainTags *old = riscv_domain_tags, *new;
+    g_autoptr(GArray) tags = g_array_new(false, false, sizeof(RISCVDomainTag));
+    hwaddr last = start + size - 1;
+    unsigned int i, num = 0;
+
+    /* Cut the new range out of the old tags */
+    for (i = 0; old && i < old->num; i++) {
+        RISCVDomainTag t = old->tag[i];
+
+        if (t.last < start || t.start > last) {
+            g_array_append_val(tags, t);
+            continue;
+        }
+        if (t.start < start) {
+            RISCVDomainTag head = { t.start, start - 1, t.domain };
+
+            g_array_append_val(tags, head);
+        }
+        if (t.last > last) {
+            RISCVDomainTag tail = { last + 1, t.last, t.domain };
+
+            g_array_append_val(tags, tail);
+        }
+    }
+    if (has_domain) {
+        RISCVDomainTag t = { start, last, domain };
+
+        g_array_append_val(tags, t);
+    }
+    g_array_sort(tags, riscv_domain_tag_compare);
+
+    new = g_malloc(sizeof(*new) + tags->len * sizeof(new->tag[0]));
+    for (i = 0; i < tags->len; i++) {
+        RISCVDomainTag *t = &g_array_index(tags, RISCVDomainTag, i);
+
+        /* Merge neighbours of the same domain */
+        if (num && new->tag[num - 1].last + 1 == t->start &&
+            new->tag[num - 1].domain == t->domain) {
+            new->tag[num - 1].last = t->last;
+        } else {
+            new->tag[num++] = *t;
+        }
+    }
+    new->num = num;
+
+    qatomic_rcu_set(&riscv_domain_tags, new);
+    if (old) {
+        g_free_rcu(old, rcu);
+    }
+    riscv_domain_flush_all();
+}
+
+void riscv_domain_set_action(RiscvDomainCheckAction action)
+{
+    static bool initialized;
+
+    if (!initialized) {
+        qemu_mutex_init(&riscv_domain_violations.lock);
+        initialized = true;
+    }
+
+    qatomic_set(&riscv_domain_action, action);
+    riscv_domain_flush_all();
+}
+
+static void riscv_domain_record(CPURISCVState *env, vaddr addr, hwaddr pa,
+                                MMUAccessType access_type, int mode,
+                                uint8_t owner)
+{
+    RISCVDomainViolation *v;
+
+    trace_riscv_domain_violation(env->mhartid, env->sec_domain, addr, pa,
+                                 access_type, owner);
+    qemu_log_mask(LOG_GUEST_ERROR,
+                  "hart %" PRIu64 " in domain %u: %s of 0x%" VADDR_PRIx
+                  " maps 0x%" HWADDR_PRIx ", owned by domain %u\n",
+                  (uint64_t)env->mhartid, env->sec_domain,
+                  access_names[access_type], addr, pa, owner);
+
+    QEMU_LOCK_GUARD(&riscv_domain_violations.lock);
+    v = &riscv_domain_violations.log[riscv_domain_violations.count++ %
+                                     RISCV_DOMAIN_VIOLATION_LOG];
+    *v = (RISCVDomainViolation) {
+        .hartid = env->mhartid,
+        .pc = env->pc,
+        .addr = addr,
+        .pa = pa,
+        .access_type = access_type,
+        .mode = mode,
+        .domain = env->sec_domain,
+        .owner = owner,
+    };
+}
+
+bool riscv_domain_check(CPURISCVState *env, vaddr addr, hwaddr pa,
+                        MMUAccessType access_type, int mode)
+{
+    RiscvDomainCheckAction action = qatomic_read(&riscv_domain_action);
+    const RISCVDomainTags *tags;
+    const RISCVDomainTag *tag;
+
+    /* M-mode is the monitor that owns everything */
+    if (action == RISCV_DOMAIN_CHECK_ACTION_OFF || mode == PRV_M) {
+        return true;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    tags = qatomic_rcu_read(&riscv_domain_tags);
+    tag = tags ? riscv_domain_find(tags, pa) : NULL;
+    if (!tag || tag->start > pa || tag->domain == env->sec_domain) {
+        return true;
+    }
+
+    riscv_domain_record(env, addr, pa, access_type, mode, tag->domain);
+    return action != RISCV_DOMAIN_CHECK_ACTION_DENY;
+}
+
+bool riscv_domain_range_uniform(hwaddr start, hwaddr size)
+{
+    const RISCVDomainTags *tags;
+    const RISCVDomainTag *tag;
+    hwaddr last = start + size - 1;
+
+    if (qatomic_read(&riscv_domain_action) == RISCV_DOMAIN_CHECK_ACTION_OFF) {
+        return true;
+    }
+
+    RCU_READ_LOCK_GUARD();
+    tags = qatomic_rcu_read(&riscv_domain_tags);
+    tag = tags ? riscv_domain_find(tags, start) : NULL;
+    if (!tag || tag->start > last) {
+        return true;
+    }
+    return tag->start <= start && tag->last >= last;
+}
+
+void riscv_domain_dump_violations(GString *buf)
+{
+    static const char mode_names[] = "US?M";
+    uint64_t i, first;
+
+    if (riscv_domain_action == RISCV_DOMAIN_CHECK_ACTION_OFF &&
+        !riscv_domain_violations.count) {
+        return;
+    }
+
+    QEMU_LOCK_GUARD(&riscv_domain_violations.lock);
+    g_string_append_printf(buf, "%" PRIu64 " cross-domain accesses\n",
+                           riscv_domain_violations.count);
+
+    first = riscv_domain_violations.count > RISCV_DOMAIN_VIOLATION_LOG ?
+            riscv_domain_violations.count - RISCV_DOMAIN_VIOLATION_LOG : 0;
+    for (i = first; i < riscv_domain_violations.count; i++) {
+        RISCVDomainViolation *v =
+            &riscv_domain_violations.log[i % RISCV_DOMAIN_VIOLATION_LOG];
+
+        g_string_append_printf(buf,
+                               "hart %" PRIu64 " domain %u %c-mode pc 0x"
+                               TARGET_FMT_lx ": %s 0x%" VADDR_PRIx
+                               " -> 0x%" HWADDR_PRIx " owned by domain %u\n",
+                               v->hartid, v->domain, mode_names[v->mode],
+                               v->pc, access_names[v->access_type], v->addr,
+                               v->pa, v->owner);
+    }
+}
@@ -0,0 +1,38 @@
+/*
+ * RISC-V cross-domain access checker
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef RISCV_DOMAIN_CHECK_H
+#define RISCV_DOMAIN_CHECK_H
+
+#include "cpu.h"
+#include "qapi/qapi-types-machine-target.h"
+
+/*
+ * Tag the guest physical pages [@start, @start + @size) as owned by
+ * security domain @domain, or as shared by all domains if @has_domain
+ * is false.  Must be called with the BQL held.
+ */
+void riscv_domain_tag(hwaddr start, hwaddr size, bool has_domain,
+                      uint8_t domain);
+
+/* Select what happens on cross-domain accesses.  Needs the BQL. */
+void riscv_domain_set_action(RiscvDomainCheckAction action);
+
+/*
+ * Called on TLB fills: return false if the access of the hart in
+ * privilege @mode to @pa must fail because the running domain does not
+ * own the page.
+ */
+bool riscv_domain_check(CPURISCVState *env, vaddr addr, hwaddr pa,
+                        MMUAccessType access_type, int mode);
+
+/* Return true if no domain tag starts or ends inside [@start, +@size). */
+bool riscv_domain_range_uniform(hwaddr start, hwaddr size);
+
+/* Append the number and the most recent of the violations to @buf. */
+void riscv_domain_dump_violations(GString *buf);
+
+#endif /* RISCV_DOMAIN_CHECK_H */
@@ -344,20 +344,26 @@ void riscv_cpu_register_gdb_regs_for_features(CPUState *cs)
     RISCVCPUClass *mcc = RISCV_CPU_GET_CLASS(cs);
     RISCVCPU *cpu = RISCV_CPU(cs);
     CPURISCVState *env = &cpu->env;
+
+    /*
+     * The FP and vector registers directly follow the core registers,
+     * so include them in the 'g' packet: gdb then fetches all of them in
+     * one round trip instead of with one 'p' packet per register.
+     */
     if (env->misa_ext & RVD) {
         gdb_register_coprocessor(cs, riscv_gdb_get_fpu, riscv_gdb_set_fpu,
                                  gdb_find_static_feature("riscv-64bit-fpu.xml"),
-                                 0);
+                                 cs->gdb_num_regs);
     } else if (env->misa_ext & RVF) {
         gdb_register_coprocessor(cs, riscv_gdb_get_fpu, riscv_gdb_set_fpu,
                                  gdb_find_static_feature("riscv-32bit-fpu.xml"),
-                                 0);
+                                 cs->gdb_num_regs);
     }
     if (cpu->cfg.ext_zve32x) {
         gdb_register_coprocessor(cs, riscv_gdb_get_vector,
                                  riscv_gdb_set_vector,
                                  ricsv_gen_dynamic_vector_feature(cs, cs->gdb_num_regs),
-                                 0);
+                                 cs->gdb_num_regs);
     }
     switch (mcc->misa_mxl_max) {
     case MXL_RV32:
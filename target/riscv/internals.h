@@ -43,6 +43,12 @@
 #define MMU_2STAGE_BIT      (1 << 2)
 #define MMU_IDX_SS_WRITE    (1 << 3)
 
+/*
+ * Harts without the H extension never use the 2-stage MMU indexes, so
+ * with "x-sec-domain-tlb" they hold the TLB entries of security domain 1.
+ */
+#define MMU_SEC_DOMAIN_BIT  MMU_2STAGE_BIT
+
 static inline int mmuidx_priv(int mmu_idx)
 {
     int ret = mmu_idx & 3;
@@ -62,6 +68,17 @@ static inline bool mmuidx_2stage(int mmu_idx)
     return mmu_idx & MMU_2STAGE_BIT;
 }
 
+#ifndef CONFIG_USER_ONLY
+/* Drop the security domain tag so that the MMU index can be decoded */
+static inline int mmuidx_strip_sec_domain(CPURISCVState *env, int mmu_idx)
+{
+    if (env_archcpu(env)->cfg.sec_domain_tlb) {
+        return mmu_idx & ~MMU_SEC_DOMAIN_BIT;
+    }
+    return mmu_idx;
+}
+#endif
+
 /* share data between vector helpers and decode code */
 FIELD(VDATA, VM, 0, 1)
 FIELD(VDATA, LMUL, 1, 3)
@@ -563,6 +563,95 @@ static void kvm_riscv_add_cpu_user_properties(Object *cpu_obj)
     }
 }
 
+/*
+ * Copy of the registers as read by kvm_arch_get_registers().  Between a
+ * get and the next put the vCPU does not run, so KVM still holds these
+ * values and kvm_arch_put_registers() only has to write back the groups
+ * that QEMU modified in the meantime.
+ */
+#define KVM_RISCV_NR_SHADOW_CSRS 11
+
+typedef struct KVMRISCVRegShadow {
+    bool valid;
+    target_ulong pc;
+    target_ulong gpr[32];
+    uint64_t csr[KVM_RISCV_NR_SHADOW_CSRS];
+    uint64_t fpr[32];
+    target_ulong vstart;
+    target_ulong vl;
+    target_ulong vtype;
+    uint16_t vlenb;
+    uint64_t vreg[32 * RV_VLEN_MAX / 64];
+} KVMRISCVRegShadow;
+
+/* The CSRs handled by kvm_riscv_{get,put}_regs_csr() */
+static void kvm_riscv_csr_values(CPURISCVState *env, uint64_t *csr)
+{
+    csr[0] = env->mstatus;
+    csr[1] = env->mie;
+    csr[2] = env->stvec;
+    csr[3] = env->sscratch;
+    csr[4] = env->sepc;
+    csr[5] = env->scause;
+    csr[6] = env->stval;
+    csr[7] = env->mip;
+    csr[8] = env->satp;
+    csr[9] = env->scounteren;
+    csr[10] = env->senvcfg;
+}
+
+static void kvm_riscv_shadow_save(RISCVCPU *cpu)
+{
+    CPURISCVState *env = &cpu->env;
+    KVMRISCVRegShadow *shadow = env->kvm_shadow;
+
+    shadow->pc = env->pc;
+    memcpy(shadow->gpr, env->gpr, sizeof(shadow->gpr));
+    kvm_riscv_csr_values(env, shadow->csr);
+    memcpy(shadow->fpr, env->fpr, sizeof(shadow->fpr));
+    shadow->vstart = env->vstart;
+    shadow->vl = env->vl;
+    shadow->vtype = env->vtype;
+    shadow->vlenb = cpu->cfg.vlenb;
+    memcpy(shadow->vreg, env->vreg, sizeof(shadow->vreg));
+    shadow->valid = true;
+}
+
+static bool kvm_riscv_core_dirty(CPURISCVState *env)
+{
+    KVMRISCVRegShadow *shadow = env->kvm_shadow;
+
+    return !shadow->valid || shadow->pc != env->pc ||
+           memcmp(shadow->gpr, env->gpr, sizeof(shadow->gpr));
+}
+
+static bool kvm_riscv_csr_dirty(CPURISCVState *env)
+{
+    KVMRISCVRegShadow *shadow = env->kvm_shadow;
+    uint64_t csr[KVM_RISCV_NR_SHADOW_CSRS];
+
+    kvm_riscv_csr_values(env, csr);
+    return !shadow->valid || memcmp(shadow->csr, csr, sizeof(csr));
+}
+
+static bool kvm_riscv_fp_dirty(CPURISCVState *env)
+{
+    KVMRISCVRegShadow *shadow = env->kvm_shadow;
+
+    return !shadow->valid || memcmp(shadow->fpr, env->fpr, sizeof(shadow->fpr));
+}
+
+static bool kvm_riscv_vector_dirty(RISCVCPU *cpu)
+{
+    CPURISCVState *env = &cpu->env;
+    KVMRISCVRegShadow *shadow = env->kvm_shadow;
+
+    return !shadow->valid || shadow->vstart != env->vstart ||
+           shadow->vl != env->vl || shadow->vtype != env->vtype ||
+           shadow->vlenb != cpu->cfg.vlenb ||
+           memcmp(shadow->vreg, env->vreg, sizeof(shadow->vreg));
+}
+
 static int kvm_riscv_get_regs_core(CPUState *cs)
 {
     int ret = 0;
@@ -1228,8 +1317,11 @@ const KVMCapabilityInfo kvm_arch_required_capabilities[] = {
 
 int kvm_arch_get_registers(CPUState *cs, Error **errp)
 {
+    RISCVCPU *cpu = RISCV_CPU(cs);
     int ret = 0;
 
+    cpu->env.kvm_shadow->valid = false;
+
     ret = kvm_riscv_get_regs_core(cs);
     if (ret) {
         return ret;
@@ -1250,6 +1342,8 @@ int kvm_arch_get_registers(CPUState *cs, Error **errp)
         return ret;
     }
 
+    kvm_riscv_shadow_save(cpu);
+
     return ret;
 }
 
@@ -1273,30 +1367,42 @@ int kvm_riscv_sync_mpstate_to_kvm(RISCVCPU *cpu, int state)
 
 int kvm_arch_put_registers(CPUState *cs, int level, Error **errp)
 {
+    RISCVCPU *cpu = RISCV_CPU(cs);
+    CPURISCVState *env = &cpu->env;
     int ret = 0;
 
-    ret = kvm_riscv_put_regs_core(cs);
-    if (ret) {
-        return ret;
+    if (kvm_riscv_core_dirty(env)) {
+        ret = kvm_riscv_put_regs_core(cs);
+        if (ret) {
+            return ret;
+        }
     }
 
-    ret = kvm_riscv_put_regs_csr(cs);
-    if (ret) {
-        return ret;
+    if (kvm_riscv_csr_dirty(env)) {
+        ret = kvm_riscv_put_regs_csr(cs);
+        if (ret) {
+            return ret;
+        }
     }
 
-    ret = kvm_riscv_put_regs_fp(cs);
-    if (ret) {
-        return ret;
+    if (kvm_riscv_fp_dirty(env)) {
+        ret = kvm_riscv_put_regs_fp(cs);
+        if (ret) {
+            return ret;
+        }
     }
 
-    ret = kvm_riscv_put_regs_vector(cs);
-    if (ret) {
-        return ret;
+    if (kvm_riscv_vector_dirty(cpu)) {
+        ret = kvm_riscv_put_regs_vector(cs);
+        if (ret) {
+            return ret;
+        }
     }
 
+    /* The vCPU may run from now on, KVM's copy is the only valid one */
+    env->kvm_shadow->valid = false;
+
     if (KVM_PUT_RESET_STATE == level) {
-        RISCVCPU *cpu = RISCV_CPU(cs);
         if (cs->cpu_index == 0) {
             ret = kvm_riscv_sync_mpstate_to_kvm(cpu, KVM_MP_STATE_RUNNABLE);
         } else {
@@ -1323,6 +1429,11 @@ int kvm_arch_fixup_msi_route(struct kvm_irq_routing_entry *route,
 
 int kvm_arch_destroy_vcpu(CPUState *cs)
 {
+    RISCVCPU *cpu = RISCV_CPU(cs);
+
+    g_free(cpu->env.kvm_shadow);
+    cpu->env.kvm_shadow = NULL;
+
     return 0;
 }
 
@@ -1396,6 +1507,8 @@ int kvm_arch_init_vcpu(CPUState *cs)
 
     qemu_add_vm_change_state_handler(kvm_riscv_vm_state_change, cs);
 
+    cpu->env.kvm_shadow = g_new0(KVMRISCVRegShadow, 1);
+
     if (!object_dynamic_cast(OBJECT(cpu), TYPE_RISCV_CPU_HOST)) {
         ret = kvm_vcpu_set_machine_ids(cpu, cs);
         if (ret != 0) {
@@ -1864,7 +1977,8 @@ void kvm_riscv_aia_create(MachineState *machine, uint64_t group_shift,
         exit(1);
     }
 
-    kvm_msi_via_irqfd_allowed = true;
+    /* irqfd MSIs need a routing table entry for each vector */
+    kvm_msi_via_irqfd_allowed = kvm_gsi_routing_allowed;
 }
 
 static void kvm_cpu_instance_init(CPUState *cs)
@@ -37,10 +37,11 @@ static int pmp_post_load(void *opaque, int version_id)
     CPURISCVState *env = &cpu->env;
     int i;
 
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+    for (i = 0; i < cpu->cfg.pmp_regions; i++) {
         pmp_update_rule_addr(env, i);
     }
     pmp_update_rule_nums(env);
+    pmp_update_region_table(env);
 
     return 0;
 }
@@ -56,6 +57,27 @@ static const VMStateDescription vmstate_pmp_entry = {
     }
 };
 
+static bool pmp_ext_needed(void *opaque)
+{
+    RISCVCPU *cpu = opaque;
+
+    return cpu->cfg.pmp_regions > OLD_MAX_RISCV_PMPS;
+}
+
+static const VMStateDescription vmstate_pmp_ext = {
+    .name = "cpu/pmp/ext",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = pmp_ext_needed,
+    .fields = (const VMStateField[]) {
+        VMSTATE_STRUCT_SUB_ARRAY(env.pmp_state.pmp, RISCVCPU,
+                                 OLD_MAX_RISCV_PMPS,
+                                 MAX_RISCV_PMPS - OLD_MAX_RISCV_PMPS,
+                                 0, vmstate_pmp_entry, pmp_entry_t),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_pmp = {
     .name = "cpu/pmp",
     .version_id = 1,
@@ -63,9 +85,14 @@ static const VMStateDescription vmstate_pmp = {
     .needed = pmp_needed,
     .post_load = pmp_post_load,
     .fields = (const VMStateField[]) {
-        VMSTATE_STRUCT_ARRAY(env.pmp_state.pmp, RISCVCPU, MAX_RISCV_PMPS,
-                             0, vmstate_pmp_entry, pmp_entry_t),
+        VMSTATE_STRUCT_SUB_ARRAY(env.pmp_state.pmp, RISCVCPU, 0,
+                                 OLD_MAX_RISCV_PMPS,
+                                 0, vmstate_pmp_entry, pmp_entry_t),
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (const VMStateDescription * const []) {
+        &vmstate_pmp_ext,
+        NULL
     }
 };
 
@@ -256,6 +283,8 @@ static int riscv_cpu_post_load(void *opaque, int version_id)
     CPURISCVState *env = &cpu->env;
 
     env->xl = cpu_recompute_xl(env);
+    riscv_pwc_flush(env);
+    riscv_cpu_iprio_changed(env);
     return 0;
 }
 
@@ -399,8 +428,41 @@ static const VMStateDescription vmstate_ssp = {
     }
 };
 
+static bool sec_domain_needed(void *opaque)
+{
+    RISCVCPU *cpu = opaque;
+
+    return cpu->cfg.sec_domain_tlb;
+}
+
+static const VMStateDescription vmstate_sec_domain_bank = {
+    .name = "cpu/sec_domain/bank",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINTTL(satp, RISCVSecDomainState),
+        VMSTATE_STRUCT_ARRAY(pmp, RISCVSecDomainState, MAX_RISCV_PMPS, 0,
+                             vmstate_pmp_entry, pmp_entry_t),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static const VMStateDescription vmstate_sec_domain = {
+    .name = "cpu/sec_domain",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .needed = sec_domain_needed,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT8(env.sec_domain, RISCVCPU),
+        VMSTATE_STRUCT_ARRAY(env.sec_domain_bank, RISCVCPU, RISCV_SEC_DOMAINS,
+                             0, vmstate_sec_domain_bank, RISCVSecDomainState),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 const VMStateDescription vmstate_riscv_cpu = {
     .name = "cpu",
+    .parallel_save = true,
     .version_id = 10,
     .minimum_version_id = 10,
     .post_load = riscv_cpu_post_load,
@@ -475,6 +537,7 @@ const VMStateDescription vmstate_riscv_cpu = {
         &vmstate_elp,
         &vmstate_ssp,
         &vmstate_ctr,
+        &vmstate_sec_domain,
         NULL
     }
 };
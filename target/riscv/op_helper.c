@@ -25,7 +25,12 @@
 #include "exec/cputlb.h"
 #include "exec/cpu_ldst.h"
 #include "exec/helper-proto.h"
+#include "exec/replay-core.h"
+#include "qemu/main-loop.h"
 #include "trace.h"
+#ifndef CONFIG_USER_ONLY
+#include "pmu.h"
+#endif
 
 /* Exceptions processing helpers */
 G_NORETURN void riscv_raise_exception(CPURISCVState *env,
@@ -47,6 +52,13 @@ void helper_raise_exception(CPURISCVState *env, uint32_t exception)
     riscv_raise_exception(env, exception, 0);
 }
 
+static void pmu_csr_access(CPURISCVState *env)
+{
+#ifndef CONFIG_USER_ONLY
+    riscv_pmu_incr_ctr(env_archcpu(env), RISCV_PMU_EVENT_QEMU_CSR_ACCESSES);
+#endif
+}
+
 target_ulong helper_csrr(CPURISCVState *env, int csr)
 {
     /*
@@ -58,6 +70,8 @@ target_ulong helper_csrr(CPURISCVState *env, int csr)
         riscv_raise_exception(env, RISCV_EXCP_ILLEGAL_INST, GETPC());
     }
 
+    pmu_csr_access(env);
+
     target_ulong val = 0;
     RISCVException ret = riscv_csrr(env, csr, &val);
 
@@ -70,7 +84,10 @@ target_ulong helper_csrr(CPURISCVState *env, int csr)
 void helper_csrw(CPURISCVState *env, int csr, target_ulong src)
 {
     target_ulong mask = env->xl == MXL_RV32 ? UINT32_MAX : (target_ulong)-1;
-    RISCVException ret = riscv_csrrw(env, csr, NULL, src, mask);
+    RISCVException ret;
+
+    pmu_csr_access(env);
+    ret = riscv_csrrw(env, csr, NULL, src, mask);
 
     if (ret != RISCV_EXCP_NONE) {
         riscv_raise_exception(env, ret, GETPC());
@@ -81,7 +98,10 @@ target_ulong helper_csrrw(CPURISCVState *env, int csr,
                           target_ulong src, target_ulong write_mask)
 {
     target_ulong val = 0;
-    RISCVException ret = riscv_csrrw(env, csr, &val, src, write_mask);
+    RISCVException ret;
+
+    pmu_csr_access(env);
+    ret = riscv_csrrw(env, csr, &val, src, write_mask);
 
     if (ret != RISCV_EXCP_NONE) {
         riscv_raise_exception(env, ret, GETPC());
@@ -190,9 +210,17 @@ void helper_cbo_zero(CPURISCVState *env, target_ulong address)
          * cacheable."
          *
          * Write zeros in address + cbozlen regardless of not being
-         * a RAM page.
+         * a RAM page.  Use doubleword stores when the block allows it,
+         * the memory core still splits them as the device requires.
          */
-        for (int i = 0; i < cbozlen; i++) {
+        int i = 0;
+
+        if (!(address & 7)) {
+            for (; i + 8 <= cbozlen; i += 8) {
+                cpu_stq_mmuidx_ra(env, address + i, 0, mmu_idx, ra);
+            }
+        }
+        for (; i < cbozlen; i++) {
             cpu_stb_mmuidx_ra(env, address + i, 0, mmu_idx, ra);
         }
     }
@@ -267,6 +295,50 @@ void helper_cbo_inval(CPURISCVState *env, target_ulong address)
 
 #ifndef CONFIG_USER_ONLY
 
+/*
+ * ecall and the xRET instructions chain to the next TB instead of going
+ * back to the main loop, which is where interrupts are taken.  An
+ * interrupt that is pending may have been masked before the privilege
+ * change and be enabled now, so leave the TB loop at @pc in that case.
+ * Interrupts that are raised later kick the vCPU out of the TB loop.
+ */
+static void riscv_exit_if_interrupt_pending(CPURISCVState *env,
+                                            target_ulong pc)
+{
+    CPUState *cs = env_cpu(env);
+
+    if (qatomic_read(&cs->interrupt_request)) {
+        env->pc = pc;
+        cpu_loop_exit(cs);
+    }
+}
+
+/*
+ * Take the environment call trap from the ecall at env->pc and return the
+ * address of the trap handler.  This avoids unwinding to the main loop
+ * and back for each of them, which dominates the cost of an SBI call or
+ * of a system call.  Record/replay and single-stepping need the exception
+ * to go through the main loop.
+ */
+target_ulong helper_ecall(CPURISCVState *env)
+{
+    CPUState *cs = env_cpu(env);
+
+    if (replay_mode != REPLAY_MODE_NONE || cs->singlestep_enabled) {
+        riscv_raise_exception(env, RISCV_EXCP_U_ECALL, 0);
+    }
+
+    /* The same as cpu_handle_exception() does.  */
+    cs->exception_index = RISCV_EXCP_U_ECALL;
+    bql_lock();
+    riscv_cpu_do_interrupt(cs);
+    bql_unlock();
+    cs->exception_index = -1;
+
+    riscv_exit_if_interrupt_pending(env, env->pc);
+    return env->pc;
+}
+
 target_ulong helper_sret(CPURISCVState *env)
 {
     uint64_t mstatus;
@@ -349,6 +421,7 @@ target_ulong helper_sret(CPURISCVState *env)
                             src_priv, src_virt);
     }
 
+    riscv_exit_if_interrupt_pending(env, retpc);
     return retpc;
 }
 
@@ -433,6 +506,7 @@ target_ulong helper_mret(CPURISCVState *env)
                             PRV_M, false);
     }
 
+    riscv_exit_if_interrupt_pending(env, retpc);
     return retpc;
 }
 
@@ -552,7 +626,6 @@ void helper_wrs_nto(CPURISCVState *env)
 
 void helper_tlb_flush(CPURISCVState *env)
 {
-    CPUState *cs = env_cpu(env);
     if (!env->virt_enabled &&
         (env->priv == PRV_U ||
          (env->priv == PRV_S && get_field(env->mstatus, MSTATUS_TVM)))) {
@@ -561,13 +634,26 @@ void helper_tlb_flush(CPURISCVState *env)
                (env->priv == PRV_U || get_field(env->hstatus, HSTATUS_VTVM))) {
         riscv_raise_exception(env, RISCV_EXCP_VIRT_INSTRUCTION_FAULT, GETPC());
     } else {
-        tlb_flush(cs);
+        riscv_sec_domain_tlb_flush(env);
     }
 }
 
+static void do_pwc_flush(CPUState *cs, run_on_cpu_data data)
+{
+    riscv_pwc_flush(cpu_env(cs));
+}
+
 void helper_tlb_flush_all(CPURISCVState *env)
 {
     CPUState *cs = env_cpu(env);
+    CPUState *other;
+
+    CPU_FOREACH(other) {
+        if (other != cs) {
+            async_run_on_cpu(other, do_pwc_flush, RUN_ON_CPU_NULL);
+        }
+    }
+    riscv_pwc_flush(env);
     tlb_flush_all_cpus_synced(cs);
 }
 
@@ -581,6 +667,7 @@ void helper_hyp_tlb_flush(CPURISCVState *env)
 
     if (env->priv == PRV_M ||
         (env->priv == PRV_S && !env->virt_enabled)) {
+        riscv_pwc_flush(env);
         tlb_flush(cs);
         return;
     }
@@ -23,6 +23,7 @@
 #include "qemu/log.h"
 #include "qapi/error.h"
 #include "cpu.h"
+#include "internals.h"
 #include "trace.h"
 #include "exec/cputlb.h"
 #include "exec/page-protection.h"
@@ -31,6 +32,12 @@ static bool pmp_write_cfg(CPURISCVState *env, uint32_t addr_index,
                           uint8_t val);
 static uint8_t pmp_read_cfg(CPURISCVState *env, uint32_t addr_index);
 
+/*
+ * Upper bound on the number of pages invalidated one by one after a PMP
+ * update; past this a full TLB flush is cheaper than walking the ranges.
+ */
+#define PMP_RANGE_FLUSH_MAX_PAGES 256
+
 /*
  * Accessor method to extract address matching type 'a field' from cfg reg
  */
@@ -55,7 +62,7 @@ static inline int pmp_is_locked(CPURISCVState *env, uint32_t pmp_index)
     }
 
     /* Top PMP has no 'next' to check */
-    if ((pmp_index + 1u) >= MAX_RISCV_PMPS) {
+    if ((pmp_index + 1u) >= riscv_cpu_cfg(env)->pmp_regions) {
         return 0;
     }
 
@@ -75,7 +82,7 @@ uint32_t pmp_get_num_rules(CPURISCVState *env)
  */
 static inline uint8_t pmp_read_cfg(CPURISCVState *env, uint32_t pmp_index)
 {
-    if (pmp_index < MAX_RISCV_PMPS) {
+    if (pmp_index < riscv_cpu_cfg(env)->pmp_regions) {
         return env->pmp_state.pmp[pmp_index].cfg_reg;
     }
 
@@ -89,7 +96,7 @@ static inline uint8_t pmp_read_cfg(CPURISCVState *env, uint32_t pmp_index)
  */
 static bool pmp_write_cfg(CPURISCVState *env, uint32_t pmp_index, uint8_t val)
 {
-    if (pmp_index < MAX_RISCV_PMPS) {
+    if (pmp_index < riscv_cpu_cfg(env)->pmp_regions) {
         bool locked = true;
 
         if (riscv_cpu_cfg(env)->ext_smepmp) {
@@ -149,6 +156,12 @@ void pmp_unlock_entries(CPURISCVState *env)
     for (i = 0; i < pmp_num; i++) {
         env->pmp_state.pmp[i].cfg_reg &= ~(PMP_LOCK | PMP_AMATCH);
     }
+
+    for (i = 0; i < riscv_cpu_cfg(env)->pmp_regions; i++) {
+        pmp_update_rule_addr(env, i);
+    }
+    pmp_update_rule_nums(env);
+    pmp_update_region_table(env);
 }
 
 static void pmp_decode_napot(hwaddr a, hwaddr *sa, hwaddr *ea)
@@ -218,7 +231,7 @@ void pmp_update_rule_nums(CPURISCVState *env)
     int i;
 
     env->pmp_state.num_rules = 0;
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
+    for (i = 0; i < riscv_cpu_cfg(env)->pmp_regions; i++) {
         const uint8_t a_field =
             pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
         if (PMP_AMATCH_OFF != a_field) {
@@ -241,6 +254,333 @@ static int pmp_is_in_range(CPURISCVState *env, int pmp_index, hwaddr addr)
     return result;
 }
 
+/*
+ * Return the set of MMU indexes whose TLB entries map guest addresses
+ * 1:1 onto physical addresses, so that a physical PMP range can be
+ * invalidated in them by address.
+ */
+static uint16_t pmp_bare_mmuidx_map(CPURISCVState *env)
+{
+    bool mmu = riscv_cpu_cfg(env)->mmu;
+    bool s_bare = true;
+    bool vs_bare = true;
+    uint16_t idxmap = 0;
+    int idx;
+
+    if (mmu) {
+        if (riscv_cpu_mxl(env) == MXL_RV32) {
+            s_bare = get_field(env->satp, SATP32_MODE) == VM_1_10_MBARE;
+            vs_bare = get_field(env->vsatp, SATP32_MODE) == VM_1_10_MBARE &&
+                      get_field(env->hgatp, SATP32_MODE) == VM_1_10_MBARE;
+        } else {
+            s_bare = get_field(env->satp, SATP64_MODE) == VM_1_10_MBARE;
+            vs_bare = get_field(env->vsatp, SATP64_MODE) == VM_1_10_MBARE &&
+                      get_field(env->hgatp, SATP64_MODE) == VM_1_10_MBARE;
+        }
+    }
+
+    /* Security domain 1 uses the 2-stage MMU indexes with satp */
+    if (riscv_cpu_cfg(env)->sec_domain_tlb) {
+        vs_bare = s_bare;
+    }
+
+    for (idx = 0; idx < NB_MMU_MODES; idx++) {
+        if (mmuidx_priv(idx) == PRV_M ||
+            (mmuidx_2stage(idx) ? vs_bare : s_bare)) {
+            idxmap |= 1 << idx;
+        }
+    }
+
+    return idxmap;
+}
+
+/*
+ * Add the address range covered by an active PMP entry to @ranges.
+ * Return false if the range is too large to be worth flushing by pages.
+ */
+static bool pmp_add_flush_range(pmp_addr_t *ranges, int *nr_ranges,
+                                hwaddr *nr_pages, uint8_t cfg,
+                                const pmp_addr_t *addr)
+{
+    if (pmp_get_a_field(cfg) == PMP_AMATCH_OFF) {
+        return true;
+    }
+
+    if (addr->ea - addr->sa >=
+        (hwaddr)PMP_RANGE_FLUSH_MAX_PAGES * TARGET_PAGE_SIZE) {
+        return false;
+    }
+
+    *nr_pages += (addr->ea >> TARGET_PAGE_BITS) -
+                 (addr->sa >> TARGET_PAGE_BITS) + 1;
+    if (*nr_pages > PMP_RANGE_FLUSH_MAX_PAGES) {
+        return false;
+    }
+
+    ranges[(*nr_ranges)++] = *addr;
+    return true;
+}
+
+/*
+ * Invalidate the TLB after the PMP entries changed from @old to the
+ * current env->pmp_state.
+ *
+ * Only the old and new address ranges of the modified entries can change
+ * permissions, so for the MMU indexes that are not translated by paging
+ * those ranges are flushed page by page. The remaining MMU indexes cache
+ * virtual addresses and have to be flushed entirely.
+ */
+static void pmp_flush_changed(CPURISCVState *env, const pmp_table_t *old)
+{
+    CPUState *cs = env_cpu(env);
+    pmp_addr_t ranges[2 * MAX_RISCV_PMPS];
+    hwaddr nr_pages = 0;
+    int nr_ranges = 0;
+    uint16_t domain_idxmap;
+    uint16_t idxmap;
+    int i;
+
+    if (!riscv_cpu_cfg(env)->pmp_range_flush) {
+        riscv_sec_domain_tlb_flush(env);
+        return;
+    }
+
+    for (i = 0; i < riscv_cpu_cfg(env)->pmp_regions; i++) {
+        const pmp_entry_t *new_pmp = &env->pmp_state.pmp[i];
+        const pmp_addr_t *new_addr = &env->pmp_state.addr[i];
+
+        if (old->pmp[i].cfg_reg == new_pmp->cfg_reg &&
+            old->addr[i].sa == new_addr->sa &&
+            old->addr[i].ea == new_addr->ea) {
+            continue;
+        }
+
+        if (!pmp_add_flush_range(ranges, &nr_ranges, &nr_pages,
+                                 old->pmp[i].cfg_reg, &old->addr[i]) ||
+            !pmp_add_flush_range(ranges, &nr_ranges, &nr_pages,
+                                 new_pmp->cfg_reg, new_addr)) {
+            riscv_sec_domain_tlb_flush(env);
+            return;
+        }
+    }
+
+    domain_idxmap = riscv_sec_domain_idxmap(env);
+    idxmap = pmp_bare_mmuidx_map(env) & domain_idxmap;
+    if (idxmap != domain_idxmap) {
+        tlb_flush_by_mmuidx(cs, domain_idxmap & ~idxmap);
+    }
+
+    for (i = 0; i < nr_ranges; i++) {
+        hwaddr sa = ranges[i].sa & TARGET_PAGE_MASK;
+        hwaddr ea = ranges[i].ea | ~TARGET_PAGE_MASK;
+
+        trace_pmp_flush_range(env->mhartid, sa, ea - sa + 1);
+        tlb_flush_range_by_mmuidx(cs, sa, ea - sa + 1, idxmap,
+                                  TARGET_LONG_BITS);
+    }
+}
+
+/*
+ * Compute the privileges an entry grants to an access from @mode that
+ * is fully inside it.
+ */
+static pmp_priv_t pmp_get_entry_privs(CPURISCVState *env, int i,
+                                      target_ulong mode)
+{
+    uint8_t cfg = env->pmp_state.pmp[i].cfg_reg;
+    pmp_priv_t allowed_privs;
+
+    /*
+     * Convert the PMP permissions to match the truth table in the
+     * Smepmp spec.
+     */
+    const uint8_t smepmp_operation =
+        ((cfg & PMP_LOCK) >> 4) | ((cfg & PMP_READ) << 2) |
+        (cfg & PMP_WRITE) | ((cfg & PMP_EXEC) >> 2);
+
+    if (!MSECCFG_MML_ISSET(env)) {
+        /*
+         * If mseccfg.MML Bit is not set, do pmp priv check
+         * This will always apply to regular PMP.
+         */
+        allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
+        if ((mode != PRV_M) || pmp_is_locked(env, i)) {
+            allowed_privs &= cfg;
+        }
+        return allowed_privs;
+    }
+
+    /*
+     * If mseccfg.MML Bit set, do the enhanced pmp priv check
+     */
+    if (mode == PRV_M) {
+        switch (smepmp_operation) {
+        case 0:
+        case 1:
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+        case 8:
+            return 0;
+        case 2:
+        case 3:
+        case 14:
+            return PMP_READ | PMP_WRITE;
+        case 9:
+        case 10:
+            return PMP_EXEC;
+        case 11:
+        case 13:
+            return PMP_READ | PMP_EXEC;
+        case 12:
+        case 15:
+            return PMP_READ;
+        default:
+            g_assert_not_reached();
+        }
+    } else {
+        switch (smepmp_operation) {
+        case 0:
+        case 8:
+        case 9:
+        case 12:
+        case 13:
+        case 14:
+            return 0;
+        case 1:
+        case 10:
+        case 11:
+            return PMP_EXEC;
+        case 2:
+        case 4:
+        case 15:
+            return PMP_READ;
+        case 3:
+        case 6:
+            return PMP_READ | PMP_WRITE;
+        case 5:
+            return PMP_READ | PMP_EXEC;
+        case 7:
+            return PMP_READ | PMP_WRITE | PMP_EXEC;
+        default:
+            g_assert_not_reached();
+        }
+    }
+}
+
+static int pmp_cmp_hwaddr(const void *a, const void *b)
+{
+    hwaddr x = *(const hwaddr *)a;
+    hwaddr y = *(const hwaddr *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Rebuild the region table from the PMP entries and mseccfg.
+ *
+ * The matching entry can only change at the start or one past the end of
+ * an active entry, so those boundaries split the address space into
+ * regions with a single highest-priority entry. Neighbouring regions
+ * matched by the same entry are merged, which lets pmp_get_tlb_size()
+ * tell from one lookup whether a page has uniform permissions.
+ */
+void pmp_update_region_table(CPURISCVState *env)
+{
+    pmp_table_t *pmp = &env->pmp_state;
+    hwaddr bounds[MAX_RISCV_PMP_REGIONS];
+    int nr_bounds = 0;
+    int n = 0;
+    int i, j;
+
+    /* Cached page table walks were checked against the old PMP rules */
+    riscv_pwc_flush(env);
+
+    bounds[nr_bounds++] = 0;
+    for (i = 0; i < riscv_cpu_cfg(env)->pmp_regions; i++) {
+        if (pmp_get_a_field(pmp->pmp[i].cfg_reg) == PMP_AMATCH_OFF) {
+            continue;
+        }
+        bounds[nr_bounds++] = pmp->addr[i].sa;
+        if (pmp->addr[i].ea != (hwaddr)-1) {
+            bounds[nr_bounds++] = pmp->addr[i].ea + 1;
+        }
+    }
+    qsort(bounds, nr_bounds, sizeof(hwaddr), pmp_cmp_hwaddr);
+
+    for (j = 0; j < nr_bounds; j++) {
+        hwaddr sa = bounds[j];
+        int index = -1;
+
+        if (j > 0 && sa == bounds[j - 1]) {
+            continue;
+        }
+
+        for (i = 0; i < riscv_cpu_cfg(env)->pmp_regions; i++) {
+            if (pmp_get_a_field(pmp->pmp[i].cfg_reg) != PMP_AMATCH_OFF &&
+                pmp_is_in_range(env, i, sa)) {
+                index = i;
+                break;
+            }
+        }
+
+        if (n > 0 && pmp->region[n - 1].index == index) {
+            continue;
+        }
+        if (n > 0) {
+            pmp->region[n - 1].ea = sa - 1;
+        }
+
+        pmp->region[n].sa = sa;
+        pmp->region[n].index = index;
+        if (index >= 0) {
+            pmp->region[n].privs[0] = pmp_get_entry_privs(env, index, PRV_S);
+            pmp->region[n].privs[1] = pmp_get_entry_privs(env, index, PRV_M);
+        } else {
+            pmp->region[n].privs[0] = 0;
+            pmp->region[n].privs[1] = 0;
+        }
+        n++;
+    }
+
+    pmp->region[n - 1].ea = (hwaddr)-1;
+    pmp->num_regions = n;
+    pmp->last_region = 0;
+}
+
+/*
+ * Find the region containing @addr. Repeated accesses to the same small
+ * region (e.g. one that only covers part of a page, and is therefore
+ * never cached in the TLB) hit the region found last time, otherwise the
+ * region table is binary searched.
+ */
+static const pmp_region_t *pmp_find_region(CPURISCVState *env, hwaddr addr)
+{
+    const pmp_region_t *region = env->pmp_state.region;
+    const pmp_region_t *last = &region[env->pmp_state.last_region];
+    int lo = 0;
+    int hi = env->pmp_state.num_regions - 1;
+
+    if (addr >= last->sa && addr <= last->ea) {
+        env->pmp_region_cache_hits++;
+        return last;
+    }
+
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+
+        if (region[mid].sa <= addr) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    env->pmp_state.last_region = lo;
+    return &region[lo];
+}
+
 /*
  * Check if the address has required RWX privs when no PMP entry is matched.
  */
@@ -308,10 +648,10 @@ bool pmp_hart_has_privs(CPURISCVState *env, hwaddr addr,
                         target_ulong size, pmp_priv_t privs,
                         pmp_priv_t *allowed_privs, target_ulong mode)
 {
-    int i = 0;
     int pmp_size = 0;
-    hwaddr s = 0;
-    hwaddr e = 0;
+    const pmp_region_t *start;
+    const pmp_region_t *end;
+    hwaddr end_addr;
 
     /* Short cut if no rules */
     if (0 == pmp_get_num_rules(env)) {
@@ -332,128 +672,34 @@ bool pmp_hart_has_privs(CPURISCVState *env, hwaddr addr,
         pmp_size = size;
     }
 
+    start = pmp_find_region(env, addr);
+    end_addr = addr + pmp_size - 1;
+    if (end_addr >= start->sa && end_addr <= start->ea) {
+        end = start;
+    } else {
+        end = pmp_find_region(env, end_addr);
+    }
+
     /*
-     * 1.10 draft priv spec states there is an implicit order
-     * from low to high
+     * The first entry (in priority order) matching either end of the access
+     * decides. If both ends are not matched by the same one, the access is
+     * only partially inside it.
      */
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        s = pmp_is_in_range(env, i, addr);
-        e = pmp_is_in_range(env, i, addr + pmp_size - 1);
-
-        /* partially inside */
-        if ((s + e) == 1) {
-            qemu_log_mask(LOG_GUEST_ERROR,
-                          "pmp violation - access is partially inside\n");
-            *allowed_privs = 0;
-            return false;
-        }
-
-        /* fully inside */
-        const uint8_t a_field =
-            pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg);
+    if (start->index != end->index) {
+        qemu_log_mask(LOG_GUEST_ERROR,
+                      "pmp violation - access is partially inside\n");
+        *allowed_privs = 0;
+        return false;
+    }
 
+    if (start->index >= 0) {
         /*
-         * Convert the PMP permissions to match the truth table in the
-         * Smepmp spec.
+         * If matching address range was found, the protection bits
+         * defined with PMP must be used. We shouldn't fallback on
+         * finding default privileges.
          */
-        const uint8_t smepmp_operation =
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_LOCK) >> 4) |
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_READ) << 2) |
-            (env->pmp_state.pmp[i].cfg_reg & PMP_WRITE) |
-            ((env->pmp_state.pmp[i].cfg_reg & PMP_EXEC) >> 2);
-
-        if (((s + e) == 2) && (PMP_AMATCH_OFF != a_field)) {
-            /*
-             * If the PMP entry is not off and the address is in range,
-             * do the priv check
-             */
-            if (!MSECCFG_MML_ISSET(env)) {
-                /*
-                 * If mseccfg.MML Bit is not set, do pmp priv check
-                 * This will always apply to regular PMP.
-                 */
-                *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-                if ((mode != PRV_M) || pmp_is_locked(env, i)) {
-                    *allowed_privs &= env->pmp_state.pmp[i].cfg_reg;
-                }
-            } else {
-                /*
-                 * If mseccfg.MML Bit set, do the enhanced pmp priv check
-                 */
-                if (mode == PRV_M) {
-                    switch (smepmp_operation) {
-                    case 0:
-                    case 1:
-                    case 4:
-                    case 5:
-                    case 6:
-                    case 7:
-                    case 8:
-                        *allowed_privs = 0;
-                        break;
-                    case 2:
-                    case 3:
-                    case 14:
-                        *allowed_privs = PMP_READ | PMP_WRITE;
-                        break;
-                    case 9:
-                    case 10:
-                        *allowed_privs = PMP_EXEC;
-                        break;
-                    case 11:
-                    case 13:
-                        *allowed_privs = PMP_READ | PMP_EXEC;
-                        break;
-                    case 12:
-                    case 15:
-                        *allowed_privs = PMP_READ;
-                        break;
-                    default:
-                        g_assert_not_reached();
-                    }
-                } else {
-                    switch (smepmp_operation) {
-                    case 0:
-                    case 8:
-                    case 9:
-                    case 12:
-                    case 13:
-                    case 14:
-                        *allowed_privs = 0;
-                        break;
-                    case 1:
-                    case 10:
-                    case 11:
-                        *allowed_privs = PMP_EXEC;
-                        break;
-                    case 2:
-                    case 4:
-                    case 15:
-                        *allowed_privs = PMP_READ;
-                        break;
-                    case 3:
-                    case 6:
-                        *allowed_privs = PMP_READ | PMP_WRITE;
-                        break;
-                    case 5:
-                        *allowed_privs = PMP_READ | PMP_EXEC;
-                        break;
-                    case 7:
-                        *allowed_privs = PMP_READ | PMP_WRITE | PMP_EXEC;
-                        break;
-                    default:
-                        g_assert_not_reached();
-                    }
-                }
-            }
-
-            /*
-             * If matching address range was found, the protection bits
-             * defined with PMP must be used. We shouldn't fallback on
-             * finding default privileges.
-             */
-            return (privs & *allowed_privs) == privs;
-        }
+        *allowed_privs = start->privs[mode == PRV_M];
+        return (privs & *allowed_privs) == privs;
     }
 
     /* No rule matched */
@@ -470,6 +716,7 @@ void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
     uint8_t cfg_val;
     int pmpcfg_nums = 2 << riscv_cpu_mxl(env);
     bool modified = false;
+    pmp_table_t old = env->pmp_state;
 
     trace_pmpcfg_csr_write(env->mhartid, reg_index, val);
 
@@ -481,7 +728,8 @@ void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
     /* If PMP permission of any addr has been changed, flush TLB pages. */
     if (modified) {
         pmp_update_rule_nums(env);
-        tlb_flush(env_cpu(env));
+        pmp_update_region_table(env);
+        pmp_flush_changed(env, &old);
     }
 }
 
@@ -515,12 +763,12 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
     trace_pmpaddr_csr_write(env->mhartid, addr_index, val);
     bool is_next_cfg_tor = false;
 
-    if (addr_index < MAX_RISCV_PMPS) {
+    if (addr_index < riscv_cpu_cfg(env)->pmp_regions) {
         /*
          * In TOR mode, need to check the lock bit of the next pmp
          * (if there is a next).
          */
-        if (addr_index + 1 < MAX_RISCV_PMPS) {
+        if (addr_index + 1 < riscv_cpu_cfg(env)->pmp_regions) {
             uint8_t pmp_cfg = env->pmp_state.pmp[addr_index + 1].cfg_reg;
             is_next_cfg_tor = PMP_AMATCH_TOR == pmp_get_a_field(pmp_cfg);
 
@@ -533,12 +781,15 @@ void pmpaddr_csr_write(CPURISCVState *env, uint32_t addr_index,
 
         if (!pmp_is_locked(env, addr_index)) {
             if (env->pmp_state.pmp[addr_index].addr_reg != val) {
+                pmp_table_t old = env->pmp_state;
+
                 env->pmp_state.pmp[addr_index].addr_reg = val;
                 pmp_update_rule_addr(env, addr_index);
                 if (is_next_cfg_tor) {
                     pmp_update_rule_addr(env, addr_index + 1);
                 }
-                tlb_flush(env_cpu(env));
+                pmp_update_region_table(env);
+                pmp_flush_changed(env, &old);
             }
         } else {
             qemu_log_mask(LOG_GUEST_ERROR,
@@ -558,7 +809,7 @@ target_ulong pmpaddr_csr_read(CPURISCVState *env, uint32_t addr_index)
 {
     target_ulong val = 0;
 
-    if (addr_index < MAX_RISCV_PMPS) {
+    if (addr_index < riscv_cpu_cfg(env)->pmp_regions) {
         val = env->pmp_state.pmp[addr_index].addr_reg;
         trace_pmpaddr_csr_read(env->mhartid, addr_index, val);
     } else {
@@ -587,7 +838,7 @@ void mseccfg_csr_write(CPURISCVState *env, target_ulong val)
 
     /* RLB cannot be enabled if it's already 0 and if any regions are locked */
     if (!MSECCFG_RLB_ISSET(env)) {
-        for (i = 0; i < MAX_RISCV_PMPS; i++) {
+        for (i = 0; i < riscv_cpu_cfg(env)->pmp_regions; i++) {
             if (pmp_is_locked(env, i)) {
                 val &= ~MSECCFG_RLB;
                 break;
@@ -598,6 +849,11 @@ void mseccfg_csr_write(CPURISCVState *env, target_ulong val)
     if (riscv_cpu_cfg(env)->ext_smepmp) {
         /* Sticky bits */
         val |= (env->mseccfg & mask);
+        /*
+         * MML and MMWP change the default rule which applies to every
+         * address, and are shared by all security domains, so there is
+         * nothing narrower to invalidate.
+         */
         if ((val ^ env->mseccfg) & mask) {
             tlb_flush(env_cpu(env));
         }
@@ -612,6 +868,9 @@ void mseccfg_csr_write(CPURISCVState *env, target_ulong val)
     }
 
     env->mseccfg = val;
+
+    /* MML and RLB change the privileges granted by the entries */
+    pmp_update_region_table(env);
 }
 
 /*
@@ -638,53 +897,40 @@ target_ulong mseccfg_csr_read(CPURISCVState *env)
  */
 target_ulong pmp_get_tlb_size(CPURISCVState *env, hwaddr addr)
 {
-    hwaddr pmp_sa;
-    hwaddr pmp_ea;
-    hwaddr tlb_sa = addr & ~(TARGET_PAGE_SIZE - 1);
-    hwaddr tlb_ea = tlb_sa + TARGET_PAGE_SIZE - 1;
-    int i;
-
     /*
-     * If PMP is not supported or there are no PMP rules, the TLB page will not
-     * be split into regions with different permissions by PMP so we set the
-     * size to TARGET_PAGE_SIZE.
+     * Set the size to 1 if the allowed permissions of part of the page may
+     * be different from the rest of it.
      */
-    if (!riscv_cpu_cfg(env)->pmp || !pmp_get_num_rules(env)) {
+    if (pmp_is_range_uniform(env, addr & ~(TARGET_PAGE_SIZE - 1),
+                             TARGET_PAGE_SIZE)) {
         return TARGET_PAGE_SIZE;
     }
 
-    for (i = 0; i < MAX_RISCV_PMPS; i++) {
-        if (pmp_get_a_field(env->pmp_state.pmp[i].cfg_reg) == PMP_AMATCH_OFF) {
-            continue;
-        }
-
-        pmp_sa = env->pmp_state.addr[i].sa;
-        pmp_ea = env->pmp_state.addr[i].ea;
+    return 1;
+}
 
-        /*
-         * Only the first PMP entry that covers (whole or partial of) the TLB
-         * page really matters:
-         * If it covers the whole TLB page, set the size to TARGET_PAGE_SIZE,
-         * since the following PMP entries have lower priority and will not
-         * affect the permissions of the page.
-         * If it only covers partial of the TLB page, set the size to 1 since
-         * the allowed permissions of the region may be different from other
-         * region of the page.
-         */
-        if (pmp_sa <= tlb_sa && pmp_ea >= tlb_ea) {
-            return TARGET_PAGE_SIZE;
-        } else if ((pmp_sa >= tlb_sa && pmp_sa <= tlb_ea) ||
-                   (pmp_ea >= tlb_sa && pmp_ea <= tlb_ea)) {
-            return 1;
-        }
+/*
+ * Return true if PMP grants the same permissions to every byte of the
+ * @size bytes at @addr, e.g. a TLB page or a superpage.
+ */
+bool pmp_is_range_uniform(CPURISCVState *env, hwaddr addr, hwaddr size)
+{
+    /*
+     * If PMP is not supported or there are no PMP rules, the range will not
+     * be split into regions with different permissions by PMP.
+     */
+    if (!riscv_cpu_cfg(env)->pmp || !pmp_get_num_rules(env)) {
+        return true;
     }
 
     /*
-     * If no PMP entry matches the TLB page, the TLB page will also not be
-     * split into regions with different permissions by PMP so we set the size
-     * to TARGET_PAGE_SIZE.
+     * Only the first PMP entry that covers (whole or partial of) the range
+     * really matters. Regions matched by the same entry are merged, so if
+     * the range is within a single region that entry (or no entry at all)
+     * covers it entirely, and the following PMP entries have lower priority
+     * and will not affect its permissions.
      */
-    return TARGET_PAGE_SIZE;
+    return addr + size - 1 <= pmp_find_region(env, addr)->ea;
 }
 
 /*
@@ -59,10 +59,26 @@ typedef struct {
     hwaddr ea;
 } pmp_addr_t;
 
+/*
+ * A flattened view of the PMP entries: the address space is split into
+ * contiguous regions, each matched by a single highest-priority entry.
+ */
+typedef struct {
+    hwaddr sa;
+    hwaddr ea;
+    int8_t index;       /* matching PMP entry, or -1 if none */
+    uint8_t privs[2];   /* allowed privs for [0] S/U-mode, [1] M-mode */
+} pmp_region_t;
+
+#define MAX_RISCV_PMP_REGIONS (2 * MAX_RISCV_PMPS + 1)
+
 typedef struct {
     pmp_entry_t pmp[MAX_RISCV_PMPS];
     pmp_addr_t  addr[MAX_RISCV_PMPS];
     uint32_t num_rules;
+    pmp_region_t region[MAX_RISCV_PMP_REGIONS];
+    uint32_t num_regions;
+    uint32_t last_region;   /* last region found, checked first */
 } pmp_table_t;
 
 void pmpcfg_csr_write(CPURISCVState *env, uint32_t reg_index,
@@ -80,8 +96,10 @@ bool pmp_hart_has_privs(CPURISCVState *env, hwaddr addr,
                         pmp_priv_t *allowed_privs,
                         target_ulong mode);
 target_ulong pmp_get_tlb_size(CPURISCVState *env, hwaddr addr);
+bool pmp_is_range_uniform(CPURISCVState *env, hwaddr addr, hwaddr size);
 void pmp_update_rule_addr(CPURISCVState *env, uint32_t pmp_index);
 void pmp_update_rule_nums(CPURISCVState *env);
+void pmp_update_region_table(CPURISCVState *env);
 uint32_t pmp_get_num_rules(CPURISCVState *env);
 int pmp_priv_to_page_prot(pmp_priv_t pmp_priv);
 void pmp_unlock_entries(CPURISCVState *env);
@@ -37,6 +37,7 @@
 void riscv_pmu_generate_fdt_node(void *fdt, uint32_t cmask, char *pmu_name)
 {
     uint32_t fdt_event_ctr_map[15] = {};
+    uint32_t fdt_raw_event_ctr_map[5] = {};
 
    /*
     * The event encoding is specified in the SBI specification
@@ -77,6 +78,19 @@ void riscv_pmu_generate_fdt_node(void *fdt, uint32_t cmask, char *pmu_name)
    /* This a OpenSBI specific DT property documented in OpenSBI docs */
    qemu_fdt_setprop(fdt, pmu_name, "riscv,event-to-mhpmcounters",
                     fdt_event_ctr_map, sizeof(fdt_event_ctr_map));
+
+   /*
+    * QEMU raw events (RISCV_PMU_EVENT_QEMU_*): select 0x1000000X, any
+    * programmable counter.
+    */
+   fdt_raw_event_ctr_map[0] = cpu_to_be32(0x00000000);
+   fdt_raw_event_ctr_map[1] = cpu_to_be32(0x10000000);
+   fdt_raw_event_ctr_map[2] = cpu_to_be32(0xffffffff);
+   fdt_raw_event_ctr_map[3] = cpu_to_be32(0xfffffff0);
+   fdt_raw_event_ctr_map[4] = cpu_to_be32(cmask);
+
+   qemu_fdt_setprop(fdt, pmu_name, "riscv,raw-event-to-mhpmcounters",
+                    fdt_raw_event_ctr_map, sizeof(fdt_raw_event_ctr_map));
 }
 
 static bool riscv_pmu_counter_valid(RISCVCPU *cpu, uint32_t ctr_idx)
@@ -177,6 +191,21 @@ static int riscv_pmu_incr_ctr_rv64(RISCVCPU *cpu, uint32_t ctr_idx)
     return 0;
 }
 
+/*
+ * Source of the minstret count: icount when enabled, then the per-TB
+ * instruction count emitted by the translator, then host ticks.
+ */
+uint64_t riscv_pmu_get_insn_count(CPURISCVState *env)
+{
+    if (icount_enabled()) {
+        return icount_get_raw();
+    }
+    if (env_archcpu(env)->cfg.pmu_insn_count) {
+        return env->pmu_insn_count;
+    }
+    return cpu_get_host_ticks();
+}
+
 /*
  * Information needed to update counters:
  *  new_priv, new_virt: To correctly save starting snapshot for the newly
@@ -197,11 +226,7 @@ static void riscv_pmu_icount_update_priv(CPURISCVState *env,
     uint64_t *counter_arr;
     uint64_t delta;
 
-    if (icount_enabled()) {
-        current_icount = icount_get_raw();
-    } else {
-        current_icount = cpu_get_host_ticks();
-    }
+    current_icount = riscv_pmu_get_insn_count(env);
 
     if (env->virt_enabled) {
         g_assert(env->priv <= PRV_S);
@@ -409,9 +434,13 @@ int riscv_pmu_update_event_map(CPURISCVState *env, uint64_t value,
     case RISCV_PMU_EVENT_CACHE_DTLB_READ_MISS:
     case RISCV_PMU_EVENT_CACHE_DTLB_WRITE_MISS:
     case RISCV_PMU_EVENT_CACHE_ITLB_PREFETCH_MISS:
+    case RISCV_PMU_EVENT_QEMU_EXCEPTIONS:
+    case RISCV_PMU_EVENT_QEMU_INTERRUPTS:
+    case RISCV_PMU_EVENT_QEMU_TB_TRANSLATIONS:
+    case RISCV_PMU_EVENT_QEMU_CSR_ACCESSES:
         break;
     default:
-        /* We don't support any raw events right now */
+        /* Only the QEMU specific raw events are supported */
         return -1;
     }
     g_hash_table_insert(cpu->pmu_event_ctr_map, GUINT_TO_POINTER(event_idx),
@@ -24,17 +24,30 @@
 
 #include "qemu/osdep.h"
 
+#include "exec/address-spaces.h"
+#include "exec/cputlb.h"
+#include "exec/memory.h"
+#include "io/channel-buffer.h"
+#include "migration/qemu-file.h"
+#include "migration/vmstate.h"
 #include "qapi/error.h"
 #include "qapi/qapi-commands-machine-target.h"
+#include "qapi/qapi-types-stats.h"
 #include "qobject/qbool.h"
 #include "qobject/qdict.h"
 #include "qapi/qobject-input-visitor.h"
+#include "qapi/type-helpers.h"
 #include "qapi/visitor.h"
 #include "qom/qom-qobject.h"
+#include "system/hw_accel.h"
 #include "system/kvm.h"
+#include "system/runstate.h"
+#include "system/stats.h"
 #include "system/tcg.h"
 #include "cpu-qom.h"
 #include "cpu.h"
+#include "internals.h"
+#include "domain-check.h"
 
 static void riscv_cpu_add_definition(gpointer data, gpointer user_data)
 {
@@ -240,3 +253,444 @@ CpuModelExpansionInfo *qmp_query_cpu_model_expansion(CpuModelExpansionType type,
 
     return expansion_info;
 }
+
+#define RISCV_STAT_PMP_SUBPAGE_FILLS     "pmp-subpage-fills"
+#define RISCV_STAT_PMP_REGION_CACHE_HITS "pmp-region-cache-hits"
+
+static StatsList *riscv_cpu_stats_add(StatsList *list, strList *names,
+                                      const char *name, uint64_t val)
+{
+    Stats *stats;
+
+    if (!apply_str_list_filter(name, names)) {
+        return list;
+    }
+
+    stats = g_new0(Stats, 1);
+    stats->name = g_strdup(name);
+    stats->value = g_new0(StatsValue, 1);
+    stats->value->type = QTYPE_QNUM;
+    stats->value->u.scalar = val;
+
+    QAPI_LIST_PREPEND(list, stats);
+    return list;
+}
+
+static void riscv_cpu_stats_cb(StatsResultList **result, StatsTarget target,
+                               strList *names, strList *targets, Error **errp)
+{
+    CPUState *cs;
+
+    if (target != STATS_TARGET_VCPU) {
+        return;
+    }
+
+    CPU_FOREACH(cs) {
+        CPURISCVState *env = cpu_env(cs);
+        StatsList *list = NULL;
+
+        if (!apply_str_list_filter(cs->parent_obj.canonical_path, targets)) {
+            continue;
+        }
+
+        list = riscv_cpu_stats_add(list, names, RISCV_STAT_PMP_SUBPAGE_FILLS,
+                                   env->pmp_subpage_fills);
+        list = riscv_cpu_stats_add(list, names,
+                                   RISCV_STAT_PMP_REGION_CACHE_HITS,
+                                   env->pmp_region_cache_hits);
+        if (list) {
+            add_stats_entry(result, STATS_PROVIDER_RISCV,
+                            cs->parent_obj.canonical_path, list);
+        }
+    }
+}
+
+static StatsSchemaValueList *riscv_cpu_schemas_add(const char *name,
+                                                   StatsSchemaValueList *list)
+{
+    StatsSchemaValueList *schema_entry = g_new0(StatsSchemaValueList, 1);
+
+    schema_entry->value = g_new0(StatsSchemaValue, 1);
+    schema_entry->value->type = STATS_TYPE_CUMULATIVE;
+    schema_entry->value->name = g_strdup(name);
+    schema_entry->next = list;
+
+    return schema_entry;
+}
+
+static void riscv_cpu_schemas_cb(StatsSchemaList **result, Error **errp)
+{
+    StatsSchemaValueList *list = NULL;
+
+    list = riscv_cpu_schemas_add(RISCV_STAT_PMP_SUBPAGE_FILLS, list);
+    list = riscv_cpu_schemas_add(RISCV_STAT_PMP_REGION_CACHE_HITS, list);
+
+    add_stats_schema(result, STATS_PROVIDER_RISCV, STATS_TARGET_VCPU, list);
+}
+
+void riscv_cpu_register_stats(void)
+{
+    static bool registered;
+
+    if (!registered) {
+        add_stats_callbacks(STATS_PROVIDER_RISCV, riscv_cpu_stats_cb,
+                            riscv_cpu_schemas_cb);
+        registered = true;
+    }
+}
+
+/*
+ * In-memory vCPU + RAM snapshots, used to reset an enclave to a known
+ * state without going through a full savevm/loadvm.  The vCPU state is
+ * serialised with vmstate_riscv_cpu so that everything that migrates
+ * (CSRs, PMP, mseccfg, ...) is covered and the post_load hooks rebuild
+ * the derived state; device state is not part of the snapshot.  The RAM
+ * range is kept in anonymous memory, or in a shared file mapping if the
+ * user gave a file, so that the image can be reused or inspected.
+ */
+typedef struct RISCVCPUSnapshot {
+    int cpu_index;
+    uint8_t *cpu_state;
+    size_t cpu_state_size;
+    hwaddr ram_addr;
+    uint64_t ram_size;
+    uint8_t *ram;
+    /* @ram is a mapping of the user's file, rather than g_malloc()ed */
+    bool ram_mapped;
+} RISCVCPUSnapshot;
+
+static GHashTable *riscv_cpu_snapshots;
+
+static void riscv_cpu_snapshot_free(gpointer data)
+{
+    RISCVCPUSnapshot *snap = data;
+
+    g_free(snap->cpu_state);
+    if (snap->ram_mapped) {
+        munmap(snap->ram, snap->ram_size);
+    } else {
+        g_free(snap->ram);
+    }
+    g_free(snap);
+}
+
+static RISCVCPU *riscv_cpu_snapshot_get_cpu(int cpu_index, Error **errp)
+{
+    CPUState *cs = qemu_get_cpu(cpu_index);
+
+    if (!cs || !object_dynamic_cast(OBJECT(cs), TYPE_RISCV_CPU)) {
+        error_setg(errp, "No RISC-V CPU with index %d", cpu_index);
+        return NULL;
+    }
+
+    return RISCV_CPU(cs);
+}
+
+/*
+ * Only RAM may be part of a snapshot: reading or writing an MMIO region
+ * would dispatch into its device instead.
+ */
+static bool riscv_cpu_snapshot_check_ram(hwaddr addr, uint64_t size,
+                                         Error **errp)
+{
+    while (size) {
+        MemoryRegionSection section = memory_region_find(get_system_memory(),
+                                                         addr, size);
+        bool is_ram = section.mr && memory_region_is_ram(section.mr) &&
+                      !memory_region_is_ram_device(section.mr) &&
+                      section.offset_within_address_space == addr;
+        uint64_t len = int128_get64(section.size);
+
+        if (section.mr) {
+            memory_region_unref(section.mr);
+        }
+        if (!is_ram) {
+            error_setg(errp, "Guest address 0x%" HWADDR_PRIx " is not RAM",
+                       addr);
+            return false;
+        }
+        addr += len;
+        size -= len;
+    }
+    return true;
+}
+
+static uint8_t *riscv_cpu_snapshot_map_file(const char *file, uint64_t size,
+                                            Error **errp)
+{
+    void *ptr;
+    int fd;
+
+    fd = qemu_create(file, O_RDWR | O_TRUNC, 0600, errp);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (ftruncate(fd, size) < 0) {
+        error_setg_errno(errp, errno, "Cannot resize '%s'", file);
+        close(fd);
+        return NULL;
+    }
+    ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+        error_setg_errno(errp, errno, "Cannot map '%s'", file);
+        return NULL;
+    }
+    return ptr;
+}
+
+static bool riscv_cpu_snapshot_fill(RISCVCPUSnapshot *snap, RISCVCPU *cpu,
+                                    const char *file, Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    MemTxResult res;
+    int ret;
+
+    cpu_synchronize_state(CPU(cpu));
+
+    bioc = qio_channel_buffer_new(4096);
+    qio_channel_set_name(QIO_CHANNEL(bioc), "riscv-cpu-snapshot");
+    f = qemu_file_new_output(QIO_CHANNEL(bioc));
+    ret = vmstate_save_state(f, &vmstate_riscv_cpu, cpu, NULL);
+    if (!ret) {
+        ret = qemu_fflush(f);
+    }
+    if (!ret) {
+        /* Closing the file frees the buffer, so take it first */
+        snap->cpu_state = g_steal_pointer(&bioc->data);
+        snap->cpu_state_size = bioc->usage;
+        bioc->capacity = bioc->usage = bioc->offset = 0;
+    }
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    if (ret) {
+        error_setg_errno(errp, -ret, "Failed to save the state of CPU %d",
+                         snap->cpu_index);
+        return false;
+    }
+
+    if (!snap->ram_size) {
+        return true;
+    }
+    if (!riscv_cpu_snapshot_check_ram(snap->ram_addr, snap->ram_size, errp)) {
+        return false;
+    }
+
+    if (file) {
+        snap->ram = riscv_cpu_snapshot_map_file(file, snap->ram_size, errp);
+        if (!snap->ram) {
+            return false;
+        }
+        snap->ram_mapped = true;
+    } else {
+        snap->ram = g_try_malloc(snap->ram_size);
+        if (!snap->ram) {
+            error_setg(errp, "Cannot allocate %" PRIu64
+                       " bytes for the snapshot", snap->ram_size);
+            return false;
+        }
+    }
+
+    res = address_space_read(&address_space_memory, snap->ram_addr,
+                             MEMTXATTRS_UNSPECIFIED, snap->ram,
+                             snap->ram_size);
+    if (res != MEMTX_OK) {
+        error_setg(errp, "Cannot read guest memory at 0x%" HWADDR_PRIx,
+                   snap->ram_addr);
+        return false;
+    }
+
+    return true;
+}
+
+RiscvCpuSnapshotInfo *qmp_x_riscv_cpu_snapshot_save(const char *name,
+                                                    int64_t cpu_index,
+                                                    uint64_t addr,
+                                                    uint64_t size,
+                                                    const char *file,
+                                                    Error **errp)
+{
+    RiscvCpuSnapshotInfo *info;
+    RISCVCPUSnapshot *snap;
+    RISCVCPU *cpu;
+    bool running;
+    bool ok;
+
+    if (cpu_index < 0 || cpu_index > INT_MAX) {
+        error_setg(errp, "Invalid CPU index %" PRId64, cpu_index);
+        return NULL;
+    }
+
+    cpu = riscv_cpu_snapshot_get_cpu(cpu_index, errp);
+    if (!cpu) {
+        return NULL;
+    }
+
+    if (size && addr + size - 1 < addr) {
+        error_setg(errp, "RAM range wraps around the address space");
+        return NULL;
+    }
+
+    snap = g_new0(RISCVCPUSnapshot, 1);
+    snap->cpu_index = cpu_index;
+    snap->ram_addr = addr;
+    snap->ram_size = size;
+
+    running = runstate_is_running();
+    if (running) {
+        vm_stop(RUN_STATE_SAVE_VM);
+    }
+
+    ok = riscv_cpu_snapshot_fill(snap, cpu, file, errp);
+
+    if (running) {
+        vm_start();
+    }
+
+    if (!ok) {
+        riscv_cpu_snapshot_free(snap);
+        return NULL;
+    }
+
+    info = g_new0(RiscvCpuSnapshotInfo, 1);
+    info->cpu_state_size = snap->cpu_state_size;
+    info->ram_size = snap->ram_size;
+
+    if (!riscv_cpu_snapshots) {
+        riscv_cpu_snapshots = g_hash_table_new_full(g_str_hash, g_str_equal,
+                                                    g_free,
+                                                    riscv_cpu_snapshot_free);
+    }
+    g_hash_table_replace(riscv_cpu_snapshots, g_strdup(name), snap);
+    return info;
+}
+
+static bool riscv_cpu_snapshot_restore(RISCVCPUSnapshot *snap, RISCVCPU *cpu,
+                                       Error **errp)
+{
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    MemTxResult res;
+    int ret;
+
+    if (snap->ram_size) {
+        if (!riscv_cpu_snapshot_check_ram(snap->ram_addr, snap->ram_size,
+                                          errp)) {
+            return false;
+        }
+        res = address_space_write(&address_space_memory, snap->ram_addr,
+                                  MEMTXATTRS_UNSPECIFIED, snap->ram,
+                                  snap->ram_size);
+        if (res != MEMTX_OK) {
+            error_setg(errp, "Cannot write guest memory at 0x%" HWADDR_PRIx,
+                       snap->ram_addr);
+            return false;
+        }
+    }
+
+    cpu_synchronize_state(CPU(cpu));
+
+    /* The snapshot keeps its copy, the channel frees its own on close */
+    bioc = qio_channel_buffer_new(snap->cpu_state_size);
+    memcpy(bioc->data, snap->cpu_state, snap->cpu_state_size);
+    bioc->usage = snap->cpu_state_size;
+    f = qemu_file_new_input(QIO_CHANNEL(bioc));
+    ret = vmstate_load_state(f, &vmstate_riscv_cpu, cpu,
+                             vmstate_riscv_cpu.version_id);
+    qemu_fclose(f);
+    object_unref(OBJECT(bioc));
+    if (ret) {
+        error_setg_errno(errp, -ret, "Failed to restore the state of CPU %d",
+                         snap->cpu_index);
+        return false;
+    }
+
+    if (tcg_enabled()) {
+        tlb_flush(CPU(cpu));
+    }
+
+    return true;
+}
+
+void qmp_x_riscv_cpu_snapshot_load(const char *name, Error **errp)
+{
+    RISCVCPUSnapshot *snap = NULL;
+    RISCVCPU *cpu;
+    bool running;
+
+    if (riscv_cpu_snapshots) {
+        snap = g_hash_table_lookup(riscv_cpu_snapshots, name);
+    }
+    if (!snap) {
+        error_setg(errp, "No RISC-V CPU snapshot named '%s'", name);
+        return;
+    }
+
+    cpu = riscv_cpu_snapshot_get_cpu(snap->cpu_index, errp);
+    if (!cpu) {
+        return;
+    }
+
+    running = runstate_is_running();
+    if (running) {
+        vm_stop(RUN_STATE_RESTORE_VM);
+    }
+
+    riscv_cpu_snapshot_restore(snap, cpu, errp);
+
+    if (running) {
+        vm_start();
+    }
+}
+
+void qmp_x_riscv_cpu_snapshot_delete(const char *name, Error **errp)
+{
+    if (!riscv_cpu_snapshots ||
+        !g_hash_table_remove(riscv_cpu_snapshots, name)) {
+        error_setg(errp, "No RISC-V CPU snapshot named '%s'", name);
+    }
+}
+
+void qmp_x_riscv_domain_tag(uint64_t addr, uint64_t size, bool has_domain,
+                            uint8_t domain, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "Domain checking requires TCG");
+        return;
+    }
+    if (!size || addr + size - 1 < addr) {
+        error_setg(errp, "Invalid range of 0x%" PRIx64 " bytes at 0x%" PRIx64,
+                   size, addr);
+        return;
+    }
+    if (!QEMU_IS_ALIGNED(addr | size, TARGET_PAGE_SIZE)) {
+        error_setg(errp, "'addr' and 'size' must be multiples of the page "
+                   "size (0x%x)", TARGET_PAGE_SIZE);
+        return;
+    }
+    if (has_domain && domain >= RISCV_SEC_DOMAINS) {
+        error_setg(errp, "'domain' must be less than %d", RISCV_SEC_DOMAINS);
+        return;
+    }
+
+    riscv_domain_tag(addr, size, has_domain, domain);
+}
+
+void qmp_x_riscv_domain_check(RiscvDomainCheckAction action, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_setg(errp, "Domain checking requires TCG");
+        return;
+    }
+
+    riscv_domain_set_action(action);
+}
+
+HumanReadableText *qmp_x_query_riscv_domain_violations(Error **errp)
+{
+    g_autoptr(GString) buf = g_string_new("");
+
+    riscv_domain_dump_violations(buf);
+    return human_readable_text_from_str(buf);
+}
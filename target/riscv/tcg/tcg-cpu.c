@@ -983,6 +983,20 @@ void riscv_tcg_cpu_finalize_features(RISCVCPU *cpu, Error **errp)
         return;
     }
 
+    if (cpu->cfg.pmp_regions > OLD_MAX_RISCV_PMPS &&
+        env->priv_ver < PRIV_VERSION_1_12_0) {
+        error_setg(errp, "More than %d PMP regions require priv spec 1.12.0",
+                   OLD_MAX_RISCV_PMPS);
+        return;
+    }
+
+    if (cpu->cfg.sec_domain_tlb && riscv_has_ext(env, RVH)) {
+        /* Security domains reuse the MMU indexes of the H extension */
+        error_setg(errp, "x-sec-domain-tlb is not supported with the "
+                   "H extension");
+        return;
+    }
+
     riscv_cpu_validate_set_extensions(cpu, &local_err);
     if (local_err != NULL) {
         error_propagate(errp, local_err);
@@ -1069,6 +1083,8 @@ static bool riscv_tcg_cpu_realize(CPUState *cs, Error **errp)
     if (riscv_has_ext(env, RVH)) {
         env->mideleg = MIP_VSSIP | MIP_VSTIP | MIP_VSEIP | MIP_SGEIP;
     }
+
+    riscv_cpu_register_stats();
 #endif
 
     return true;
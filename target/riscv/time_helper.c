@@ -55,19 +55,28 @@ void riscv_timer_write_timecmp(CPURISCVState *env, QEMUTimer *timer,
          * immediately raise the timer interrupt
          */
         if (timer_irq == MIP_VSTIP) {
-            env->vstime_irq = 1;
-            riscv_cpu_update_mip(env, 0, BOOL_TO_MASK(1));
-        } else {
+            if (!env->vstime_irq) {
+                env->vstime_irq = 1;
+                riscv_cpu_update_mip(env, 0, BOOL_TO_MASK(1));
+            }
+        } else if (!(env->mip & MIP_STIP)) {
             riscv_cpu_update_mip(env, MIP_STIP, BOOL_TO_MASK(1));
         }
+        timer_del(timer);
         return;
     }
 
-    /* Clear the [VS|S]TIP bit in mip */
+    /*
+     * Clear the [VS|S]TIP bit in mip.  Supervisors typically reprogram
+     * the timer long before it fires, so only take the BQL and recompute
+     * the pending interrupts when the bit was actually set.
+     */
     if (timer_irq == MIP_VSTIP) {
-        env->vstime_irq = 0;
-        riscv_cpu_update_mip(env, 0, BOOL_TO_MASK(0));
-    } else {
+        if (env->vstime_irq) {
+            env->vstime_irq = 0;
+            riscv_cpu_update_mip(env, 0, BOOL_TO_MASK(0));
+        }
+    } else if (env->mip & timer_irq) {
         riscv_cpu_update_mip(env, timer_irq, BOOL_TO_MASK(0));
     }
 
@@ -122,7 +131,10 @@ void riscv_timer_write_timecmp(CPURISCVState *env, QEMUTimer *timer,
         next = MIN(next, INT64_MAX);
     }
 
-    timer_mod(timer, next);
+    /* Rewriting the same deadline must not requeue the timer. */
+    if (timer_expire_time_ns(timer) != next) {
+        timer_mod(timer, next);
+    }
 }
 
 void riscv_timer_init(RISCVCPU *cpu)
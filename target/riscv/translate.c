@@ -36,6 +36,9 @@
 #undef  HELPER_H
 
 #include "tcg/tcg-cpu.h"
+#ifndef CONFIG_USER_ONLY
+#include "pmu.h"
+#endif
 
 /* global register indices */
 static TCGv cpu_gpr[32], cpu_gprh[32], cpu_pc, cpu_vl, cpu_vstart;
@@ -119,6 +122,11 @@ typedef struct DisasContext {
     bool fcfi_lp_expected;
     /* zicfiss extension, if shadow stack was enabled during TB gen */
     bool bcfi_enabled;
+    /* Smctr/Ssctr transfer types recorded in the current mode */
+    uint16_t ctr_types;
+    /* Count retired instructions for the PMU without icount */
+    bool pmu_insn_count;
+    TCGOp *first_insn_start;
 } DisasContext;
 
 static inline bool has_ext(DisasContext *ctx, uint32_t ext)
@@ -562,6 +570,16 @@ static void gen_set_fpr_d(DisasContext *ctx, int reg_num, TCGv_i64 t)
 }
 
 #ifndef CONFIG_USER_ONLY
+/*
+ * Whether a control transfer of @type within the current mode is recorded
+ * by Smctr/Ssctr. The filters are part of the TB flags, so transfers that
+ * would be dropped do not call the helper at all.
+ */
+static bool ctr_records(DisasContext *ctx, enum CTRType type)
+{
+    return ctx->ctr_types & BIT(type);
+}
+
 /*
  * Direct calls
  * - jal x1;
@@ -579,25 +597,30 @@ static void gen_set_fpr_d(DisasContext *ctx, int reg_num, TCGv_i64 t)
  */
 static void gen_ctr_jal(DisasContext *ctx, int rd, target_ulong imm)
 {
-    TCGv dest = tcg_temp_new();
-    TCGv src = tcg_temp_new();
-    TCGv type;
+    TCGv dest, src;
+    enum CTRType type;
 
     /*
      * If rd is x1 or x5 link registers, treat this as direct call otherwise
      * its a direct jump.
      */
     if (rd == 1 || rd == 5) {
-        type = tcg_constant_tl(CTRDATA_TYPE_DIRECT_CALL);
+        type = CTRDATA_TYPE_DIRECT_CALL;
     } else if (rd == 0) {
-        type = tcg_constant_tl(CTRDATA_TYPE_DIRECT_JUMP);
+        type = CTRDATA_TYPE_DIRECT_JUMP;
     } else {
-        type = tcg_constant_tl(CTRDATA_TYPE_OTHER_DIRECT_JUMP);
+        type = CTRDATA_TYPE_OTHER_DIRECT_JUMP;
     }
 
+    if (!ctr_records(ctx, type)) {
+        return;
+    }
+
+    dest = tcg_temp_new();
+    src = tcg_temp_new();
     gen_pc_plus_diff(dest, ctx, imm);
     gen_pc_plus_diff(src, ctx, 0);
-    gen_helper_ctr_add_entry(tcg_env, src, dest, type);
+    gen_helper_ctr_add_entry(tcg_env, src, dest, tcg_constant_tl(type));
 }
 #endif
 
@@ -618,9 +641,7 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     }
 
 #ifndef CONFIG_USER_ONLY
-    if (ctx->cfg_ptr->ext_smctr || ctx->cfg_ptr->ext_ssctr) {
-        gen_ctr_jal(ctx, rd, imm);
-    }
+    gen_ctr_jal(ctx, rd, imm);
 #endif
 
     gen_pc_plus_diff(succ_pc, ctx, ctx->cur_insn_len);
@@ -630,18 +651,29 @@ static void gen_jal(DisasContext *ctx, int rd, target_ulong imm)
     ctx->base.is_jmp = DISAS_NORETURN;
 }
 
-/* Compute a canonical address from a register plus offset. */
-static TCGv get_address(DisasContext *ctx, int rs1, int imm)
+/* Apply pointer masking and the effective address width to addr. */
+static void gen_canonical_address(DisasContext *ctx, TCGv addr)
 {
-    TCGv addr = tcg_temp_new();
-    TCGv src1 = get_gpr(ctx, rs1, EXT_NONE);
+    /* Full-width addresses without pointer masking are used as is. */
+    if (ctx->addr_xl == TARGET_LONG_BITS) {
+        return;
+    }
 
-    tcg_gen_addi_tl(addr, src1, imm);
     if (ctx->addr_signed) {
         tcg_gen_sextract_tl(addr, addr, 0, ctx->addr_xl);
     } else {
         tcg_gen_extract_tl(addr, addr, 0, ctx->addr_xl);
     }
+}
+
+/* Compute a canonical address from a register plus offset. */
+static TCGv get_address(DisasContext *ctx, int rs1, int imm)
+{
+    TCGv addr = tcg_temp_new();
+    TCGv src1 = get_gpr(ctx, rs1, EXT_NONE);
+
+    tcg_gen_addi_tl(addr, src1, imm);
+    gen_canonical_address(ctx, addr);
 
     return addr;
 }
@@ -653,11 +685,7 @@ static TCGv get_address_indexed(DisasContext *ctx, int rs1, TCGv offs)
     TCGv src1 = get_gpr(ctx, rs1, EXT_NONE);
 
     tcg_gen_add_tl(addr, src1, offs);
-    if (ctx->addr_signed) {
-        tcg_gen_sextract_tl(addr, addr, 0, ctx->addr_xl);
-    } else {
-        tcg_gen_extract_tl(addr, addr, 0, ctx->addr_xl);
-    }
+    gen_canonical_address(ctx, addr);
 
     return addr;
 }
@@ -1299,9 +1327,13 @@ static void riscv_tr_init_disas_context(DisasContextBase *dcbase, CPUState *cs)
     ctx->bcfi_enabled = FIELD_EX32(tb_flags, TB_FLAGS, BCFI_ENABLED);
     ctx->fcfi_lp_expected = FIELD_EX32(tb_flags, TB_FLAGS, FCFI_LP_EXPECTED);
     ctx->fcfi_enabled = FIELD_EX32(tb_flags, TB_FLAGS, FCFI_ENABLED);
+    ctx->ctr_types = FIELD_EX64(ctx->base.tb->cs_base, TB_FLAGS2, CTR_TYPES);
     ctx->zero = tcg_constant_tl(0);
     ctx->virt_inst_excp = false;
     ctx->decoders = cpu->decoders;
+    ctx->pmu_insn_count = cpu->cfg.pmu_insn_count &&
+                          !(tb_cflags(ctx->base.tb) & CF_USE_ICOUNT);
+    ctx->first_insn_start = NULL;
 }
 
 static void riscv_tr_tb_start(DisasContextBase *db, CPUState *cpu)
@@ -1319,6 +1351,9 @@ static void riscv_tr_insn_start(DisasContextBase *dcbase, CPUState *cpu)
 
     tcg_gen_insn_start(pc_next, 0, 0);
     ctx->insn_start_updated = false;
+    if (!ctx->first_insn_start) {
+        ctx->first_insn_start = tcg_last_op();
+    }
 }
 
 static void riscv_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
@@ -1369,10 +1404,32 @@ static void riscv_tr_translate_insn(DisasContextBase *dcbase, CPUState *cpu)
     }
 }
 
+/*
+ * Add the number of instructions in the TB to env->pmu_insn_count ahead
+ * of the first instruction, now that the number is known.  A TB that
+ * takes a synchronous exception part way through is still counted in
+ * full; this is the price of not tracking the count per instruction.
+ */
+static void gen_pmu_insn_count(DisasContext *ctx)
+{
+    TCGv_i64 cnt;
+
+    tcg_ctx->emit_before_op = ctx->first_insn_start;
+    cnt = tcg_temp_new_i64();
+    tcg_gen_ld_i64(cnt, tcg_env, offsetof(CPURISCVState, pmu_insn_count));
+    tcg_gen_addi_i64(cnt, cnt, ctx->base.num_insns);
+    tcg_gen_st_i64(cnt, tcg_env, offsetof(CPURISCVState, pmu_insn_count));
+    tcg_ctx->emit_before_op = NULL;
+}
+
 static void riscv_tr_tb_stop(DisasContextBase *dcbase, CPUState *cpu)
 {
     DisasContext *ctx = container_of(dcbase, DisasContext, base);
 
+    if (ctx->pmu_insn_count) {
+        gen_pmu_insn_count(ctx);
+    }
+
     switch (ctx->base.is_jmp) {
     case DISAS_TOO_MANY:
         gen_goto_tb(ctx, 0, 0);
@@ -1397,6 +1454,9 @@ void riscv_translate_code(CPUState *cs, TranslationBlock *tb,
 {
     DisasContext ctx;
 
+#ifndef CONFIG_USER_ONLY
+    riscv_pmu_incr_ctr(RISCV_CPU(cs), RISCV_PMU_EVENT_QEMU_TB_TRANSLATIONS);
+#endif
     translator_loop(cs, tb, max_insns, pc, host_pc, &riscv_tr_ops, &ctx.base);
 }
 
@@ -220,10 +220,38 @@ vext_continuous_ldst_host(CPURISCVState *env, vext_ldst_elem_fn_host *ldst_host,
         } else {
             memcpy(host, vd + byte_offset, size);
         }
-    } else {
-        for (; reg_start < evl; reg_start++, host += esz) {
+        return;
+    }
+
+    /*
+     * Elements are in the same byte order in the vector register and in
+     * memory, so naturally aligned elements can be copied as whole 8-byte
+     * words.  An aligned element never straddles two words, so it is still
+     * accessed with a single host access.
+     */
+    if (QEMU_IS_ALIGNED((uintptr_t)host, esz)) {
+        void *reg;
+        uint32_t words;
+
+        for (; reg_start < evl && !QEMU_IS_ALIGNED((uintptr_t)host, 8);
+             reg_start++, host += esz) {
             ldst_host(vd, reg_start, host);
         }
+
+        reg = vd + reg_start * esz;
+        words = ((evl - reg_start) * esz) / 8;
+        reg_start += words * (8 / esz);
+        for (; words; words--, reg += 8, host += 8) {
+            if (is_load) {
+                stq_he_p(reg, ldq_he_p(host));
+            } else {
+                stq_he_p(host, ldq_he_p(reg));
+            }
+        }
+    }
+
+    for (; reg_start < evl; reg_start++, host += esz) {
+        ldst_host(vd, reg_start, host);
     }
 #endif
 }
@@ -245,23 +273,75 @@ static void vext_set_tail_elems_1s(target_ulong vl, void *vd,
     }
 }
 
+/*
+ * Strided and indexed accesses translate every element on its own.  Keep
+ * the host address of the last page that could be accessed directly, so
+ * that the following elements on the same page skip the TLB lookup.
+ */
+typedef struct {
+    target_ulong page;
+    void *host;
+} VextHostPage;
+
+static inline void vext_host_page_init(VextHostPage *hp)
+{
+    hp->page = -1;
+    hp->host = NULL;
+}
+
+static inline QEMU_ALWAYS_INLINE void *
+vext_elem_host(CPURISCVState *env, VextHostPage *hp, target_ulong addr,
+               uint32_t esz, MMUAccessType access_type, int mmu_index,
+               uintptr_t ra)
+{
+    target_ulong page = addr & TARGET_PAGE_MASK;
+    void *host;
+    int flags;
+
+    /* Elements crossing a page boundary take the slow path. */
+    if (unlikely(-(addr | TARGET_PAGE_MASK) < esz)) {
+        return NULL;
+    }
+
+    if (page != hp->page) {
+        /*
+         * Probe the whole page without faulting.  If any part of it is not
+         * plain RAM accessible with @access_type (MMIO, watchpoints, PMP
+         * regions smaller than the page, ...), the elements on it keep
+         * going through the TLB and raise their own faults.
+         */
+        flags = probe_access_flags(env, page, TARGET_PAGE_SIZE, access_type,
+                                   mmu_index, true, &host, ra);
+        hp->page = page;
+        hp->host = flags == 0 ? host : NULL;
+    }
+
+    return hp->host ? hp->host + (addr - page) : NULL;
+}
+
 /*
  * stride: access vector element from strided memory
  */
-static void
+static inline QEMU_ALWAYS_INLINE void
 vext_ldst_stride(void *vd, void *v0, target_ulong base, target_ulong stride,
                  CPURISCVState *env, uint32_t desc, uint32_t vm,
-                 vext_ldst_elem_fn_tlb *ldst_elem, uint32_t log2_esz,
-                 uintptr_t ra)
+                 vext_ldst_elem_fn_tlb *ldst_elem,
+                 vext_ldst_elem_fn_host *ldst_host, uint32_t log2_esz,
+                 uintptr_t ra, bool is_load)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
     uint32_t max_elems = vext_max_elems(desc, log2_esz);
     uint32_t esz = 1 << log2_esz;
     uint32_t vma = vext_vma(desc);
+    MMUAccessType access_type = is_load ? MMU_DATA_LOAD : MMU_DATA_STORE;
+    int mmu_index = riscv_env_mmu_index(env, false);
+    VextHostPage hp;
 
     VSTART_CHECK_EARLY_EXIT(env, env->vl);
 
+    vext_host_page_init(&hp);
+
     for (i = env->vstart; i < env->vl; env->vstart = ++i) {
         k = 0;
         while (k < nf) {
@@ -272,8 +352,15 @@ vext_ldst_stride(void *vd, void *v0, target_ulong base, target_ulong stride,
                 k++;
                 continue;
             }
-            target_ulong addr = base + stride * i + (k << log2_esz);
-            ldst_elem(env, adjust_addr(env, addr), i + k * max_elems, vd, ra);
+            target_ulong addr = adjust_addr(env, base + stride * i +
+                                                 (k << log2_esz));
+            void *host = vext_elem_host(env, &hp, addr, esz, access_type,
+                                        mmu_index, ra);
+            if (host) {
+                ldst_host(vd, i + k * max_elems, host);
+            } else {
+                ldst_elem(env, addr, i + k * max_elems, vd, ra);
+            }
             k++;
         }
     }
@@ -282,35 +369,36 @@ vext_ldst_stride(void *vd, void *v0, target_ulong base, target_ulong stride,
     vext_set_tail_elems_1s(env->vl, vd, desc, nf, esz, max_elems);
 }
 
-#define GEN_VEXT_LD_STRIDE(NAME, ETYPE, LOAD_FN)                        \
+#define GEN_VEXT_LD_STRIDE(NAME, ETYPE, LOAD_FN_TLB, LOAD_FN_HOST)      \
 void HELPER(NAME)(void *vd, void * v0, target_ulong base,               \
                   target_ulong stride, CPURISCVState *env,              \
                   uint32_t desc)                                        \
 {                                                                       \
     uint32_t vm = vext_vm(desc);                                        \
-    vext_ldst_stride(vd, v0, base, stride, env, desc, vm, LOAD_FN,      \
-                     ctzl(sizeof(ETYPE)), GETPC());                     \
+    vext_ldst_stride(vd, v0, base, stride, env, desc, vm, LOAD_FN_TLB,  \
+                     LOAD_FN_HOST, ctzl(sizeof(ETYPE)), GETPC(), true); \
 }
 
-GEN_VEXT_LD_STRIDE(vlse8_v,  int8_t,  lde_b_tlb)
-GEN_VEXT_LD_STRIDE(vlse16_v, int16_t, lde_h_tlb)
-GEN_VEXT_LD_STRIDE(vlse32_v, int32_t, lde_w_tlb)
-GEN_VEXT_LD_STRIDE(vlse64_v, int64_t, lde_d_tlb)
+GEN_VEXT_LD_STRIDE(vlse8_v,  int8_t,  lde_b_tlb, lde_b_host)
+GEN_VEXT_LD_STRIDE(vlse16_v, int16_t, lde_h_tlb, lde_h_host)
+GEN_VEXT_LD_STRIDE(vlse32_v, int32_t, lde_w_tlb, lde_w_host)
+GEN_VEXT_LD_STRIDE(vlse64_v, int64_t, lde_d_tlb, lde_d_host)
 
-#define GEN_VEXT_ST_STRIDE(NAME, ETYPE, STORE_FN)                       \
+#define GEN_VEXT_ST_STRIDE(NAME, ETYPE, STORE_FN_TLB, STORE_FN_HOST)    \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,                \
                   target_ulong stride, CPURISCVState *env,              \
                   uint32_t desc)                                        \
 {                                                                       \
     uint32_t vm = vext_vm(desc);                                        \
-    vext_ldst_stride(vd, v0, base, stride, env, desc, vm, STORE_FN,     \
-                     ctzl(sizeof(ETYPE)), GETPC());                     \
+    vext_ldst_stride(vd, v0, base, stride, env, desc, vm, STORE_FN_TLB, \
+                     STORE_FN_HOST, ctzl(sizeof(ETYPE)), GETPC(),       \
+                     false);                                            \
 }
 
-GEN_VEXT_ST_STRIDE(vsse8_v,  int8_t,  ste_b_tlb)
-GEN_VEXT_ST_STRIDE(vsse16_v, int16_t, ste_h_tlb)
-GEN_VEXT_ST_STRIDE(vsse32_v, int32_t, ste_w_tlb)
-GEN_VEXT_ST_STRIDE(vsse64_v, int64_t, ste_d_tlb)
+GEN_VEXT_ST_STRIDE(vsse8_v,  int8_t,  ste_b_tlb, ste_b_host)
+GEN_VEXT_ST_STRIDE(vsse16_v, int16_t, ste_h_tlb, ste_h_host)
+GEN_VEXT_ST_STRIDE(vsse32_v, int32_t, ste_w_tlb, ste_w_host)
+GEN_VEXT_ST_STRIDE(vsse64_v, int64_t, ste_d_tlb, ste_d_host)
 
 /*
  * unit-stride: access elements stored contiguously in memory
@@ -452,7 +540,8 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,     \
 {                                                                   \
     uint32_t stride = vext_nf(desc) << ctzl(sizeof(ETYPE));         \
     vext_ldst_stride(vd, v0, base, stride, env, desc, false,        \
-                     LOAD_FN_TLB, ctzl(sizeof(ETYPE)), GETPC());    \
+                     LOAD_FN_TLB, LOAD_FN_HOST, ctzl(sizeof(ETYPE)), \
+                     GETPC(), true);                                \
 }                                                                   \
                                                                     \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,            \
@@ -473,7 +562,8 @@ void HELPER(NAME##_mask)(void *vd, void *v0, target_ulong base,          \
 {                                                                        \
     uint32_t stride = vext_nf(desc) << ctzl(sizeof(ETYPE));              \
     vext_ldst_stride(vd, v0, base, stride, env, desc, false,             \
-                     STORE_FN_TLB, ctzl(sizeof(ETYPE)), GETPC());        \
+                     STORE_FN_TLB, STORE_FN_HOST, ctzl(sizeof(ETYPE)),   \
+                     GETPC(), false);                                    \
 }                                                                        \
                                                                          \
 void HELPER(NAME)(void *vd, void *v0, target_ulong base,                 \
@@ -527,12 +617,13 @@ GEN_VEXT_GET_INDEX_ADDR(idx_h, uint16_t, H2)
 GEN_VEXT_GET_INDEX_ADDR(idx_w, uint32_t, H4)
 GEN_VEXT_GET_INDEX_ADDR(idx_d, uint64_t, H8)
 
-static inline void
+static inline QEMU_ALWAYS_INLINE void
 vext_ldst_index(void *vd, void *v0, target_ulong base,
                 void *vs2, CPURISCVState *env, uint32_t desc,
                 vext_get_index_addr get_index_addr,
                 vext_ldst_elem_fn_tlb *ldst_elem,
-                uint32_t log2_esz, uintptr_t ra)
+                vext_ldst_elem_fn_host *ldst_host,
+                uint32_t log2_esz, uintptr_t ra, bool is_load)
 {
     uint32_t i, k;
     uint32_t nf = vext_nf(desc);
@@ -540,9 +631,14 @@ vext_ldst_index(void *vd, void *v0, target_ulong base,
     uint32_t max_elems = vext_max_elems(desc, log2_esz);
     uint32_t esz = 1 << log2_esz;
     uint32_t vma = vext_vma(desc);
+    MMUAccessType access_type = is_load ? MMU_DATA_LOAD : MMU_DATA_STORE;
+    int mmu_index = riscv_env_mmu_index(env, false);
+    VextHostPage hp;
 
     VSTART_CHECK_EARLY_EXIT(env, env->vl);
 
+    vext_host_page_init(&hp);
+
     /* load bytes from guest memory */
     for (i = env->vstart; i < env->vl; env->vstart = ++i) {
         k = 0;
@@ -554,8 +650,15 @@ vext_ldst_index(void *vd, void *v0, target_ulong base,
                 k++;
                 continue;
             }
-            abi_ptr addr = get_index_addr(base, i, vs2) + (k << log2_esz);
-            ldst_elem(env, adjust_addr(env, addr), i + k * max_elems, vd, ra);
+            abi_ptr addr = adjust_addr(env, get_index_addr(base, i, vs2) +
+                                            (k << log2_esz));
+            void *host = vext_elem_host(env, &hp, addr, esz, access_type,
+                                        mmu_index, ra);
+            if (host) {
+                ldst_host(vd, i + k * max_elems, host);
+            } else {
+                ldst_elem(env, addr, i + k * max_elems, vd, ra);
+            }
             k++;
         }
     }
@@ -569,51 +672,52 @@ void HELPER(NAME)(void *vd, void *v0, target_ulong base,                   \
                   void *vs2, CPURISCVState *env, uint32_t desc)            \
 {                                                                          \
     vext_ldst_index(vd, v0, base, vs2, env, desc, INDEX_FN,                \
-                    LOAD_FN, ctzl(sizeof(ETYPE)), GETPC());                \
-}
-
-GEN_VEXT_LD_INDEX(vlxei8_8_v,   int8_t,  idx_b, lde_b_tlb)
-GEN_VEXT_LD_INDEX(vlxei8_16_v,  int16_t, idx_b, lde_h_tlb)
-GEN_VEXT_LD_INDEX(vlxei8_32_v,  int32_t, idx_b, lde_w_tlb)
-GEN_VEXT_LD_INDEX(vlxei8_64_v,  int64_t, idx_b, lde_d_tlb)
-GEN_VEXT_LD_INDEX(vlxei16_8_v,  int8_t,  idx_h, lde_b_tlb)
-GEN_VEXT_LD_INDEX(vlxei16_16_v, int16_t, idx_h, lde_h_tlb)
-GEN_VEXT_LD_INDEX(vlxei16_32_v, int32_t, idx_h, lde_w_tlb)
-GEN_VEXT_LD_INDEX(vlxei16_64_v, int64_t, idx_h, lde_d_tlb)
-GEN_VEXT_LD_INDEX(vlxei32_8_v,  int8_t,  idx_w, lde_b_tlb)
-GEN_VEXT_LD_INDEX(vlxei32_16_v, int16_t, idx_w, lde_h_tlb)
-GEN_VEXT_LD_INDEX(vlxei32_32_v, int32_t, idx_w, lde_w_tlb)
-GEN_VEXT_LD_INDEX(vlxei32_64_v, int64_t, idx_w, lde_d_tlb)
-GEN_VEXT_LD_INDEX(vlxei64_8_v,  int8_t,  idx_d, lde_b_tlb)
-GEN_VEXT_LD_INDEX(vlxei64_16_v, int16_t, idx_d, lde_h_tlb)
-GEN_VEXT_LD_INDEX(vlxei64_32_v, int32_t, idx_d, lde_w_tlb)
-GEN_VEXT_LD_INDEX(vlxei64_64_v, int64_t, idx_d, lde_d_tlb)
-
-#define GEN_VEXT_ST_INDEX(NAME, ETYPE, INDEX_FN, STORE_FN)       \
-void HELPER(NAME)(void *vd, void *v0, target_ulong base,         \
-                  void *vs2, CPURISCVState *env, uint32_t desc)  \
-{                                                                \
-    vext_ldst_index(vd, v0, base, vs2, env, desc, INDEX_FN,      \
-                    STORE_FN, ctzl(sizeof(ETYPE)),               \
-                    GETPC());                                    \
-}
-
-GEN_VEXT_ST_INDEX(vsxei8_8_v,   int8_t,  idx_b, ste_b_tlb)
-GEN_VEXT_ST_INDEX(vsxei8_16_v,  int16_t, idx_b, ste_h_tlb)
-GEN_VEXT_ST_INDEX(vsxei8_32_v,  int32_t, idx_b, ste_w_tlb)
-GEN_VEXT_ST_INDEX(vsxei8_64_v,  int64_t, idx_b, ste_d_tlb)
-GEN_VEXT_ST_INDEX(vsxei16_8_v,  int8_t,  idx_h, ste_b_tlb)
-GEN_VEXT_ST_INDEX(vsxei16_16_v, int16_t, idx_h, ste_h_tlb)
-GEN_VEXT_ST_INDEX(vsxei16_32_v, int32_t, idx_h, ste_w_tlb)
-GEN_VEXT_ST_INDEX(vsxei16_64_v, int64_t, idx_h, ste_d_tlb)
-GEN_VEXT_ST_INDEX(vsxei32_8_v,  int8_t,  idx_w, ste_b_tlb)
-GEN_VEXT_ST_INDEX(vsxei32_16_v, int16_t, idx_w, ste_h_tlb)
-GEN_VEXT_ST_INDEX(vsxei32_32_v, int32_t, idx_w, ste_w_tlb)
-GEN_VEXT_ST_INDEX(vsxei32_64_v, int64_t, idx_w, ste_d_tlb)
-GEN_VEXT_ST_INDEX(vsxei64_8_v,  int8_t,  idx_d, ste_b_tlb)
-GEN_VEXT_ST_INDEX(vsxei64_16_v, int16_t, idx_d, ste_h_tlb)
-GEN_VEXT_ST_INDEX(vsxei64_32_v, int32_t, idx_d, ste_w_tlb)
-GEN_VEXT_ST_INDEX(vsxei64_64_v, int64_t, idx_d, ste_d_tlb)
+                    LOAD_FN##_tlb, LOAD_FN##_host, ctzl(sizeof(ETYPE)),    \
+                    GETPC(), true);                                        \
+}
+
+GEN_VEXT_LD_INDEX(vlxei8_8_v,   int8_t,  idx_b, lde_b)
+GEN_VEXT_LD_INDEX(vlxei8_16_v,  int16_t, idx_b, lde_h)
+GEN_VEXT_LD_INDEX(vlxei8_32_v,  int32_t, idx_b, lde_w)
+GEN_VEXT_LD_INDEX(vlxei8_64_v,  int64_t, idx_b, lde_d)
+GEN_VEXT_LD_INDEX(vlxei16_8_v,  int8_t,  idx_h, lde_b)
+GEN_VEXT_LD_INDEX(vlxei16_16_v, int16_t, idx_h, lde_h)
+GEN_VEXT_LD_INDEX(vlxei16_32_v, int32_t, idx_h, lde_w)
+GEN_VEXT_LD_INDEX(vlxei16_64_v, int64_t, idx_h, lde_d)
+GEN_VEXT_LD_INDEX(vlxei32_8_v,  int8_t,  idx_w, lde_b)
+GEN_VEXT_LD_INDEX(vlxei32_16_v, int16_t, idx_w, lde_h)
+GEN_VEXT_LD_INDEX(vlxei32_32_v, int32_t, idx_w, lde_w)
+GEN_VEXT_LD_INDEX(vlxei32_64_v, int64_t, idx_w, lde_d)
+GEN_VEXT_LD_INDEX(vlxei64_8_v,  int8_t,  idx_d, lde_b)
+GEN_VEXT_LD_INDEX(vlxei64_16_v, int16_t, idx_d, lde_h)
+GEN_VEXT_LD_INDEX(vlxei64_32_v, int32_t, idx_d, lde_w)
+GEN_VEXT_LD_INDEX(vlxei64_64_v, int64_t, idx_d, lde_d)
+
+#define GEN_VEXT_ST_INDEX(NAME, ETYPE, INDEX_FN, STORE_FN)                 \
+void HELPER(NAME)(void *vd, void *v0, target_ulong base,                   \
+                  void *vs2, CPURISCVState *env, uint32_t desc)            \
+{                                                                          \
+    vext_ldst_index(vd, v0, base, vs2, env, desc, INDEX_FN,                \
+                    STORE_FN##_tlb, STORE_FN##_host, ctzl(sizeof(ETYPE)),  \
+                    GETPC(), false);                                       \
+}
+
+GEN_VEXT_ST_INDEX(vsxei8_8_v,   int8_t,  idx_b, ste_b)
+GEN_VEXT_ST_INDEX(vsxei8_16_v,  int16_t, idx_b, ste_h)
+GEN_VEXT_ST_INDEX(vsxei8_32_v,  int32_t, idx_b, ste_w)
+GEN_VEXT_ST_INDEX(vsxei8_64_v,  int64_t, idx_b, ste_d)
+GEN_VEXT_ST_INDEX(vsxei16_8_v,  int8_t,  idx_h, ste_b)
+GEN_VEXT_ST_INDEX(vsxei16_16_v, int16_t, idx_h, ste_h)
+GEN_VEXT_ST_INDEX(vsxei16_32_v, int32_t, idx_h, ste_w)
+GEN_VEXT_ST_INDEX(vsxei16_64_v, int64_t, idx_h, ste_d)
+GEN_VEXT_ST_INDEX(vsxei32_8_v,  int8_t,  idx_w, ste_b)
+GEN_VEXT_ST_INDEX(vsxei32_16_v, int16_t, idx_w, ste_h)
+GEN_VEXT_ST_INDEX(vsxei32_32_v, int32_t, idx_w, ste_w)
+GEN_VEXT_ST_INDEX(vsxei32_64_v, int64_t, idx_w, ste_d)
+GEN_VEXT_ST_INDEX(vsxei64_8_v,  int8_t,  idx_d, ste_b)
+GEN_VEXT_ST_INDEX(vsxei64_16_v, int16_t, idx_d, ste_h)
+GEN_VEXT_ST_INDEX(vsxei64_32_v, int32_t, idx_d, ste_w)
+GEN_VEXT_ST_INDEX(vsxei64_64_v, int64_t, idx_d, ste_d)
 
 /*
  * unit-stride fault-only-fisrt load instructions
@@ -1635,6 +1739,37 @@ GEN_VEXT_VX(vmax_vx_h, 2)
 GEN_VEXT_VX(vmax_vx_w, 4)
 GEN_VEXT_VX(vmax_vx_d, 8)
 
+/* Out-of-line fallbacks for the gvec expansion of the .vx forms */
+#define GEN_VEC_MINMAX_S(NAME, ETYPE, OP)                       \
+void HELPER(NAME)(void *d, void *a, uint64_t b, uint32_t desc)  \
+{                                                               \
+    intptr_t oprsz = simd_oprsz(desc);                          \
+    ETYPE s1 = b;                                               \
+    intptr_t i;                                                 \
+                                                                \
+    for (i = 0; i < oprsz; i += sizeof(ETYPE)) {                \
+        ETYPE s2 = *(ETYPE *)(a + i);                           \
+        *(ETYPE *)(d + i) = OP(s2, s1);                         \
+    }                                                           \
+}
+
+GEN_VEC_MINMAX_S(vec_umins8,  uint8_t,  DO_MIN)
+GEN_VEC_MINMAX_S(vec_umins16, uint16_t, DO_MIN)
+GEN_VEC_MINMAX_S(vec_umins32, uint32_t, DO_MIN)
+GEN_VEC_MINMAX_S(vec_umins64, uint64_t, DO_MIN)
+GEN_VEC_MINMAX_S(vec_smins8,  int8_t,   DO_MIN)
+GEN_VEC_MINMAX_S(vec_smins16, int16_t,  DO_MIN)
+GEN_VEC_MINMAX_S(vec_smins32, int32_t,  DO_MIN)
+GEN_VEC_MINMAX_S(vec_smins64, int64_t,  DO_MIN)
+GEN_VEC_MINMAX_S(vec_umaxs8,  uint8_t,  DO_MAX)
+GEN_VEC_MINMAX_S(vec_umaxs16, uint16_t, DO_MAX)
+GEN_VEC_MINMAX_S(vec_umaxs32, uint32_t, DO_MAX)
+GEN_VEC_MINMAX_S(vec_umaxs64, uint64_t, DO_MAX)
+GEN_VEC_MINMAX_S(vec_smaxs8,  int8_t,   DO_MAX)
+GEN_VEC_MINMAX_S(vec_smaxs16, int16_t,  DO_MAX)
+GEN_VEC_MINMAX_S(vec_smaxs32, int32_t,  DO_MAX)
+GEN_VEC_MINMAX_S(vec_smaxs64, int64_t,  DO_MAX)
+
 /* Vector Single-Width Integer Multiply Instructions */
 #define DO_MUL(N, M) (N * M)
 RVVCALL(OPIVV2, vmul_vv_b, OP_SSS_B, H1, H1, H1, DO_MUL)
@@ -4664,12 +4799,19 @@ void HELPER(NAME)(void *vd, void *v0, void *vs1,          \
                                                           \
     VSTART_CHECK_EARLY_EXIT(env, vl);                     \
                                                           \
-    for (i = env->vstart; i < vl; i++) {                  \
-        TS2 s2 = *((TS2 *)vs2 + HS2(i));                  \
-        if (!vm && !vext_elem_mask(v0, i)) {              \
-            continue;                                     \
+    if (vm) {                                             \
+        /* keep the unmasked loop simple to vectorize */  \
+        for (i = env->vstart; i < vl; i++) {              \
+            s1 = OP(s1, (TD)*((TS2 *)vs2 + HS2(i)));      \
+        }                                                 \
+    } else {                                              \
+        for (i = env->vstart; i < vl; i++) {              \
+            TS2 s2 = *((TS2 *)vs2 + HS2(i));              \
+            if (!vext_elem_mask(v0, i)) {                 \
+                continue;                                 \
+            }                                             \
+            s1 = OP(s1, (TD)s2);                          \
         }                                                 \
-        s1 = OP(s1, (TD)s2);                              \
     }                                                     \
     if (vl > 0) {                                         \
         *((TD *)vd + HD(0)) = s1;                         \
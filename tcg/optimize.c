@@ -56,6 +56,19 @@ typedef struct TempOptInfo {
     uint64_t s_mask;  /* mask bit is 1 if value bit matches msb */
 } TempOptInfo;
 
+/*
+ * Stores to env whose value has not been observed yet.  A later store
+ * covering the same bytes makes them dead.  Anything which may read env,
+ * or expose it through an exception, observes them all.
+ */
+#define MAX_ENV_STORES 8
+
+typedef struct EnvStoreInfo {
+    TCGOp *op;
+    intptr_t start;
+    intptr_t last;
+} EnvStoreInfo;
+
 typedef struct OptContext {
     TCGContext *tcg;
     TCGOp *prev_mb;
@@ -64,6 +77,9 @@ typedef struct OptContext {
     IntervalTreeRoot mem_copy;
     QSIMPLEQ_HEAD(, MemCopyInfo) mem_free;
 
+    EnvStoreInfo env_st[MAX_ENV_STORES];
+    unsigned nb_env_st;
+
     /* In flight values from optimization. */
     TCGType type;
 } OptContext;
@@ -194,6 +210,59 @@ static void remove_mem_copy_all(OptContext *ctx)
     tcg_debug_assert(interval_tree_is_empty(&ctx->mem_copy));
 }
 
+static void remove_env_st(OptContext *ctx, unsigned i)
+{
+    ctx->nb_env_st--;
+    memmove(&ctx->env_st[i], &ctx->env_st[i + 1],
+            (ctx->nb_env_st - i) * sizeof(EnvStoreInfo));
+}
+
+/* The bytes [s, l] of env are read: the stores to them are live. */
+static void remove_env_st_in(OptContext *ctx, intptr_t s, intptr_t l)
+{
+    unsigned i = 0;
+
+    while (i < ctx->nb_env_st) {
+        EnvStoreInfo *st = &ctx->env_st[i];
+
+        if (st->start <= l && s <= st->last) {
+            remove_env_st(ctx, i);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void remove_env_st_all(OptContext *ctx)
+{
+    ctx->nb_env_st = 0;
+}
+
+/* Record store @op to the bytes [s, l] of env, removing those it kills. */
+static void record_env_st(OptContext *ctx, TCGOp *op, intptr_t s, intptr_t l)
+{
+    unsigned i = 0;
+
+    while (i < ctx->nb_env_st) {
+        EnvStoreInfo *st = &ctx->env_st[i];
+
+        if (s <= st->start && st->last <= l) {
+            tcg_op_remove(ctx->tcg, st->op);
+            remove_env_st(ctx, i);
+        } else if (st->start <= l && s <= st->last) {
+            /* A partial overwrite leaves the other bytes to be stored. */
+            remove_env_st(ctx, i);
+        } else {
+            i++;
+        }
+    }
+
+    if (ctx->nb_env_st == MAX_ENV_STORES) {
+        remove_env_st(ctx, 0);
+    }
+    ctx->env_st[ctx->nb_env_st++] = (EnvStoreInfo){ op, s, l };
+}
+
 static TCGTemp *find_better_copy(TCGTemp *ts)
 {
     TCGTemp *i, *ret;
@@ -944,6 +1013,8 @@ static void finish_bb(OptContext *ctx)
 {
     /* We only optimize memory barriers across basic blocks. */
     ctx->prev_mb = NULL;
+    /* A store is live on the taken path of a branch. */
+    remove_env_st_all(ctx);
 }
 
 static void finish_ebb(OptContext *ctx)
@@ -1613,6 +1684,9 @@ static bool fold_call(OptContext *ctx, TCGOp *op)
         remove_mem_copy_all(ctx);
     }
 
+    /* Any function may read env. */
+    remove_env_st_all(ctx);
+
     /* Reset temp data for outputs. */
     for (i = 0; i < nb_oargs; i++) {
         reset_temp(ctx, op->args[i]);
@@ -2704,30 +2778,44 @@ static bool fold_sub2(OptContext *ctx, TCGOp *op)
 static bool fold_tcg_ld(OptContext *ctx, TCGOp *op)
 {
     uint64_t z_mask = -1, s_mask = 0;
+    intptr_t ofs = op->args[2];
+    intptr_t lm1;
 
     /* We can't do any folding with a load, but we can record bits. */
     switch (op->opc) {
     CASE_OP_32_64(ld8s):
         s_mask = INT8_MIN;
+        lm1 = 0;
         break;
     CASE_OP_32_64(ld8u):
         z_mask = MAKE_64BIT_MASK(0, 8);
+        lm1 = 0;
         break;
     CASE_OP_32_64(ld16s):
         s_mask = INT16_MIN;
+        lm1 = 1;
         break;
     CASE_OP_32_64(ld16u):
         z_mask = MAKE_64BIT_MASK(0, 16);
+        lm1 = 1;
         break;
     case INDEX_op_ld32s_i64:
         s_mask = INT32_MIN;
+        lm1 = 3;
         break;
     case INDEX_op_ld32u_i64:
         z_mask = MAKE_64BIT_MASK(0, 32);
+        lm1 = 3;
         break;
     default:
         g_assert_not_reached();
     }
+
+    if (op->args[1] == tcgv_ptr_arg(tcg_env)) {
+        remove_env_st_in(ctx, ofs, ofs + lm1);
+    } else {
+        remove_env_st_all(ctx);
+    }
     return fold_masks_zs(ctx, op, z_mask, s_mask);
 }
 
@@ -2738,11 +2826,13 @@ static bool fold_tcg_ld_memcopy(OptContext *ctx, TCGOp *op)
     TCGType type;
 
     if (op->args[1] != tcgv_ptr_arg(tcg_env)) {
+        remove_env_st_all(ctx);
         return finish_folding(ctx, op);
     }
 
     type = ctx->type;
     ofs = op->args[2];
+    remove_env_st_in(ctx, ofs, ofs + tcg_type_size(type) - 1);
     dst = arg_temp(op->args[0]);
     src = find_mem_copy_for(ctx, type, ofs);
     if (src && src->base_type == type) {
@@ -2761,6 +2851,7 @@ static bool fold_tcg_st(OptContext *ctx, TCGOp *op)
 
     if (op->args[1] != tcgv_ptr_arg(tcg_env)) {
         remove_mem_copy_all(ctx);
+        remove_env_st_all(ctx);
         return true;
     }
 
@@ -2785,6 +2876,7 @@ static bool fold_tcg_st(OptContext *ctx, TCGOp *op)
         g_assert_not_reached();
     }
     remove_mem_copy_in(ctx, ofs, ofs + lm1);
+    record_env_st(ctx, op, ofs, ofs + lm1);
     return true;
 }
 
@@ -2817,6 +2909,7 @@ static bool fold_tcg_st_memcopy(OptContext *ctx, TCGOp *op)
     last = ofs + tcg_type_size(type) - 1;
     remove_mem_copy_in(ctx, ofs, last);
     record_mem_copy(ctx, type, src, ofs, last);
+    record_env_st(ctx, op, ofs, last);
     return true;
 }
 
@@ -2873,6 +2966,16 @@ void tcg_optimize(TCGContext *s)
         init_arguments(&ctx, op, def->nb_oargs + def->nb_iargs);
         copy_propagate(&ctx, op, def->nb_oargs, def->nb_iargs);
 
+        /*
+         * Guest memory accesses may fault and branches may skip a store;
+         * plugin callbacks may read registers and dupm loads from memory.
+         */
+        if ((def->flags & (TCG_OPF_BB_END | TCG_OPF_SIDE_EFFECTS)) ||
+            opc == INDEX_op_plugin_cb || opc == INDEX_op_plugin_mem_cb ||
+            opc == INDEX_op_dupm_vec) {
+            remove_env_st_all(&ctx);
+        }
+
         /* Pre-compute the type of the operation. */
         ctx.type = TCGOP_TYPE(op);
 
@@ -12,7 +12,10 @@
 #include "elf.h"
 #include "exec/target_page.h"
 #include "exec/translation-block.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
 #include "qemu/timer.h"
+#include "qemu/units.h"
 #include "tcg/debuginfo.h"
 #include "tcg/perf.h"
 #include "tcg/tcg.h"
@@ -44,6 +47,17 @@ static FILE *safe_fopen_w(const char *path)
     return f;
 }
 
+/*
+ * Use large stdio buffers: a busy guest produces a steady stream of small
+ * records, and perf only needs them once it post-processes the profile.
+ */
+#define PERF_BUF_SIZE (1 * MiB)
+
+static void perf_setvbuf(FILE *f)
+{
+    setvbuf(f, NULL, _IOFBF, PERF_BUF_SIZE);
+}
+
 static FILE *perfmap;
 
 void perf_enable_perfmap(void)
@@ -55,20 +69,40 @@ void perf_enable_perfmap(void)
     if (perfmap == NULL) {
         warn_report("Could not open %s: %s, proceeding without perfmap",
                     map_file, strerror(errno));
+        return;
     }
+    perf_setvbuf(perfmap);
 }
 
+/*
+ * Everything needed to describe the code of one TB, copied out of tcg_ctx
+ * at translation time.  This lets the symbol lookups and file writes
+ * happen later, possibly on the writer thread.
+ */
+typedef struct PerfRecord {
+    QSIMPLEQ_ENTRY(PerfRecord) next;
+    uintptr_t start;
+    uint64_t timestamp;
+    uint32_t tid;
+    size_t icount;
+    uint64_t *guest_pc;         /* [icount] */
+    uint16_t *end_off;          /* [icount] */
+    uint8_t *code;              /* [end_off[icount - 1]], jitdump only */
+} PerfRecord;
+
+typedef QSIMPLEQ_HEAD(, PerfRecord) PerfRecordQueue;
+
 /* Get PC and size of code JITed for guest instruction #INSN. */
 static void get_host_pc_size(uintptr_t *host_pc, uint16_t *host_size,
-                             const void *start, size_t insn)
+                             const PerfRecord *r, size_t insn)
 {
-    uint16_t start_off = insn ? tcg_ctx->gen_insn_end_off[insn - 1] : 0;
+    uint16_t start_off = insn ? r->end_off[insn - 1] : 0;
 
     if (host_pc) {
-        *host_pc = (uintptr_t)start + start_off;
+        *host_pc = r->start + start_off;
     }
     if (host_size) {
-        *host_size = tcg_ctx->gen_insn_end_off[insn] - start_off;
+        *host_size = r->end_off[insn] - start_off;
     }
 }
 
@@ -99,13 +133,13 @@ static const char *pretty_symbol(const struct debuginfo_query *q, size_t *len)
     return buf;
 }
 
-static void write_perfmap_entry(const void *start, size_t insn,
+static void write_perfmap_entry(const PerfRecord *r, size_t insn,
                                 const struct debuginfo_query *q)
 {
     uint16_t host_size;
     uintptr_t host_pc;
 
-    get_host_pc_size(&host_pc, &host_size, start, insn);
+    get_host_pc_size(&host_pc, &host_size, r, insn);
     fprintf(perfmap, "%"PRIxPTR" %"PRIx16" %s\n",
             host_pc, host_size, pretty_symbol(q, NULL));
 }
@@ -221,6 +255,7 @@ void perf_enable_jitdump(void)
         jitdump = NULL;
         return;
     }
+    perf_setvbuf(jitdump);
 
     header.magic = JITHEADER_MAGIC;
     header.version = JITHEADER_VERSION;
@@ -242,10 +277,10 @@ void perf_report_prologue(const void *start, size_t size)
 }
 
 /* Write a JIT_CODE_DEBUG_INFO jitdump entry. */
-static void write_jr_code_debug_info(const void *start,
-                                     const struct debuginfo_query *q,
-                                     size_t icount)
+static void write_jr_code_debug_info(const PerfRecord *r,
+                                     const struct debuginfo_query *q)
 {
+    size_t icount = r->icount;
     struct jr_code_debug_info rec;
     struct debug_entry ent;
     uintptr_t host_pc;
@@ -254,8 +289,8 @@ static void write_jr_code_debug_info(const void *start,
     /* Write the header. */
     rec.p.id = JIT_CODE_DEBUG_INFO;
     rec.p.total_size = sizeof(rec) + sizeof(ent) + 1;
-    rec.p.timestamp = get_clock();
-    rec.code_addr = (uintptr_t)start;
+    rec.p.timestamp = r->timestamp;
+    rec.code_addr = r->start;
     rec.nr_entry = 1;
     for (insn = 0; insn < icount; insn++) {
         if (q[insn].file) {
@@ -268,7 +303,7 @@ static void write_jr_code_debug_info(const void *start,
     /* Write the main debug entries. */
     for (insn = 0; insn < icount; insn++) {
         if (q[insn].file) {
-            get_host_pc_size(&host_pc, NULL, start, insn);
+            get_host_pc_size(&host_pc, NULL, r, insn);
             ent.addr = host_pc;
             ent.lineno = q[insn].line;
             ent.discrim = 0;
@@ -278,7 +313,7 @@ static void write_jr_code_debug_info(const void *start,
     }
 
     /* Write the trailing debug_entry. */
-    ent.addr = (uintptr_t)start + tcg_ctx->gen_insn_end_off[icount - 1];
+    ent.addr = r->start + r->end_off[icount - 1];
     ent.lineno = 0;
     ent.discrim = 0;
     fwrite(&ent, sizeof(ent), 1, jitdump);
@@ -286,10 +321,11 @@ static void write_jr_code_debug_info(const void *start,
 }
 
 /* Write a JIT_CODE_LOAD jitdump entry. */
-static void write_jr_code_load(const void *start, uint16_t host_size,
+static void write_jr_code_load(const PerfRecord *r,
                                const struct debuginfo_query *q)
 {
     static uint64_t code_index;
+    uint16_t host_size = r->end_off[r->icount - 1];
     struct jr_code_load rec;
     const char *symbol;
     size_t symbol_size;
@@ -297,30 +333,25 @@ static void write_jr_code_load(const void *start, uint16_t host_size,
     symbol = pretty_symbol(q, &symbol_size);
     rec.p.id = JIT_CODE_LOAD;
     rec.p.total_size = sizeof(rec) + symbol_size + host_size;
-    rec.p.timestamp = get_clock();
+    rec.p.timestamp = r->timestamp;
     rec.pid = getpid();
-    rec.tid = qemu_get_thread_id();
-    rec.vma = (uintptr_t)start;
-    rec.code_addr = (uintptr_t)start;
+    rec.tid = r->tid;
+    rec.vma = r->start;
+    rec.code_addr = r->start;
     rec.code_size = host_size;
     rec.code_index = code_index++;
     fwrite(&rec, sizeof(rec), 1, jitdump);
     fwrite(symbol, symbol_size, 1, jitdump);
-    fwrite(start, host_size, 1, jitdump);
+    fwrite(r->code, host_size, 1, jitdump);
 }
 
-void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
-                      const void *start)
+/* Resolve guest symbols for R and emit its perfmap and jitdump entries. */
+static void perf_write_record(const PerfRecord *r)
 {
     struct debuginfo_query *q;
-    size_t insn, start_words;
-    uint64_t *gen_insn_data;
+    size_t insn;
 
-    if (!perfmap && !jitdump) {
-        return;
-    }
-
-    q = g_try_malloc0_n(tb->icount, sizeof(*q));
+    q = g_try_malloc0_n(r->icount, sizeof(*q));
     if (!q) {
         return;
     }
@@ -328,24 +359,17 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     debuginfo_lock();
 
     /* Query debuginfo for each guest instruction. */
-    gen_insn_data = tcg_ctx->gen_insn_data;
-    start_words = tcg_ctx->insn_start_words;
-
-    for (insn = 0; insn < tb->icount; insn++) {
-        /* FIXME: This replicates the restore_state_to_opc() logic. */
-        q[insn].address = gen_insn_data[insn * start_words + 0];
-        if (tb_cflags(tb) & CF_PCREL) {
-            q[insn].address |= (guest_pc & qemu_target_page_mask());
-        }
+    for (insn = 0; insn < r->icount; insn++) {
+        q[insn].address = r->guest_pc[insn];
         q[insn].flags = DEBUGINFO_SYMBOL | (jitdump ? DEBUGINFO_LINE : 0);
     }
-    debuginfo_query(q, tb->icount);
+    debuginfo_query(q, r->icount);
 
     /* Emit perfmap entries if needed. */
     if (perfmap) {
         flockfile(perfmap);
-        for (insn = 0; insn < tb->icount; insn++) {
-            write_perfmap_entry(start, insn, &q[insn]);
+        for (insn = 0; insn < r->icount; insn++) {
+            write_perfmap_entry(r, insn, &q[insn]);
         }
         funlockfile(perfmap);
     }
@@ -353,9 +377,8 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     /* Emit jitdump entries if needed. */
     if (jitdump) {
         flockfile(jitdump);
-        write_jr_code_debug_info(start, q, tb->icount);
-        write_jr_code_load(start, tcg_ctx->gen_insn_end_off[tb->icount - 1],
-                           q);
+        write_jr_code_debug_info(r, q);
+        write_jr_code_load(r, q);
         funlockfile(jitdump);
     }
 
@@ -363,8 +386,164 @@ void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
     g_free(q);
 }
 
+static void perf_write_records(PerfRecordQueue *queue)
+{
+    PerfRecord *r, *next;
+
+    QSIMPLEQ_FOREACH_SAFE(r, queue, next, next) {
+        perf_write_record(r);
+        g_free(r);
+    }
+    QSIMPLEQ_INIT(queue);
+}
+
+/*
+ * The writer thread takes the symbol lookups and the file writes off the
+ * translation path.  If it falls behind by more than PERF_QUEUE_MAX
+ * records, the translating thread writes the backlog itself.
+ */
+#define PERF_QUEUE_MAX 4096
+
+static QemuThread perf_writer;
+static QemuMutex perf_queue_lock;
+static QemuCond perf_queue_cond;
+static PerfRecordQueue perf_queue = QSIMPLEQ_HEAD_INITIALIZER(perf_queue);
+static size_t perf_queue_len;
+static bool perf_writer_running;
+static bool perf_writer_stop;
+
+static void *perf_writer_thread(void *arg)
+{
+    PerfRecordQueue batch = QSIMPLEQ_HEAD_INITIALIZER(batch);
+
+    qemu_mutex_lock(&perf_queue_lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&perf_queue) && !perf_writer_stop) {
+            qemu_cond_wait(&perf_queue_cond, &perf_queue_lock);
+        }
+        if (QSIMPLEQ_EMPTY(&perf_queue)) {
+            break;
+        }
+        QSIMPLEQ_CONCAT(&batch, &perf_queue);
+        perf_queue_len = 0;
+        qemu_mutex_unlock(&perf_queue_lock);
+
+        perf_write_records(&batch);
+
+        qemu_mutex_lock(&perf_queue_lock);
+    }
+    qemu_mutex_unlock(&perf_queue_lock);
+    return NULL;
+}
+
+static void perf_stop_writer(void)
+{
+    if (!perf_writer_running) {
+        return;
+    }
+
+    qemu_mutex_lock(&perf_queue_lock);
+    perf_writer_stop = true;
+    qemu_cond_signal(&perf_queue_cond);
+    qemu_mutex_unlock(&perf_queue_lock);
+
+    qemu_thread_join(&perf_writer);
+    perf_writer_running = false;
+}
+
+void perf_start_writer(void)
+{
+    if (perf_writer_running || (!perfmap && !jitdump)) {
+        return;
+    }
+
+    qemu_mutex_init(&perf_queue_lock);
+    qemu_cond_init(&perf_queue_cond);
+    perf_writer_stop = false;
+    qemu_thread_create(&perf_writer, "perf-writer", perf_writer_thread,
+                       NULL, QEMU_THREAD_JOINABLE);
+    /* vCPUs may already be translating; they write directly until now. */
+    qatomic_store_release(&perf_writer_running, true);
+
+    /* Write out whatever is still queued when QEMU exits. */
+    atexit(perf_stop_writer);
+}
+
+static void perf_queue_record(PerfRecord *r)
+{
+    PerfRecordQueue batch = QSIMPLEQ_HEAD_INITIALIZER(batch);
+
+    qemu_mutex_lock(&perf_queue_lock);
+    QSIMPLEQ_INSERT_TAIL(&perf_queue, r, next);
+    if (++perf_queue_len < PERF_QUEUE_MAX && !perf_writer_stop) {
+        qemu_cond_signal(&perf_queue_cond);
+        qemu_mutex_unlock(&perf_queue_lock);
+        return;
+    }
+    QSIMPLEQ_CONCAT(&batch, &perf_queue);
+    perf_queue_len = 0;
+    qemu_mutex_unlock(&perf_queue_lock);
+
+    perf_write_records(&batch);
+}
+
+void perf_report_code(uint64_t guest_pc, TranslationBlock *tb,
+                      const void *start)
+{
+    size_t insn, start_words, icount, code_size;
+    uint64_t *gen_insn_data;
+    PerfRecord *r;
+    char *p;
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+
+    icount = tb->icount;
+    code_size = jitdump ? tcg_ctx->gen_insn_end_off[icount - 1] : 0;
+    p = g_try_malloc(sizeof(*r) + icount * sizeof(*r->guest_pc) +
+                     icount * sizeof(*r->end_off) + code_size);
+    if (!p) {
+        return;
+    }
+
+    r = (PerfRecord *)p;
+    r->start = (uintptr_t)start;
+    r->timestamp = get_clock();
+    r->tid = qemu_get_thread_id();
+    r->icount = icount;
+    r->guest_pc = (uint64_t *)(p + sizeof(*r));
+    r->end_off = (uint16_t *)(r->guest_pc + icount);
+    r->code = (uint8_t *)(r->end_off + icount);
+
+    gen_insn_data = tcg_ctx->gen_insn_data;
+    start_words = tcg_ctx->insn_start_words;
+
+    for (insn = 0; insn < icount; insn++) {
+        /* FIXME: This replicates the restore_state_to_opc() logic. */
+        r->guest_pc[insn] = gen_insn_data[insn * start_words + 0];
+        if (tb_cflags(tb) & CF_PCREL) {
+            r->guest_pc[insn] |= (guest_pc & qemu_target_page_mask());
+        }
+    }
+    memcpy(r->end_off, tcg_ctx->gen_insn_end_off,
+           icount * sizeof(*r->end_off));
+
+    /* The code may be gone by the time the record is written. */
+    memcpy(r->code, start, code_size);
+
+    if (qatomic_load_acquire(&perf_writer_running)) {
+        perf_queue_record(r);
+    } else {
+        perf_write_record(r);
+        g_free(r);
+    }
+}
+
 void perf_exit(void)
 {
+    perf_stop_writer();
+
     if (perfmap) {
         fclose(perfmap);
         perfmap = NULL;
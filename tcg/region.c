@@ -72,6 +72,20 @@ struct tcg_region_state {
     /* fields protected by the lock */
     size_t current; /* current region index */
     size_t agg_size_full; /* aggregate size of full regions */
+    /*
+     * Regions below .current are in use, unless they have been reclaimed
+     * and are now on the .free stack.  .seq orders the regions in use by
+     * allocation, and is 0 for a free region.
+     */
+    uint64_t alloc_seq;
+    uint64_t *seq;
+    size_t *free;
+    size_t n_free;
+    /*
+     * Host NUMA node of the thread which first allocated from each region,
+     * and thus faulted in its pages, or -1 if unknown.
+     */
+    int *node;
 };
 
 static struct tcg_region_state region;
@@ -357,13 +371,47 @@ static void tcg_region_assign(TCGContext *s, size_t curr_region)
     s->code_gen_highwater = end - TCG_HIGHWATER;
 }
 
-static bool tcg_region_alloc__locked(TCGContext *s)
+/* Return the host NUMA node the calling thread runs on, or -1. */
+static int tcg_region_host_node(void)
+{
+#if defined(CONFIG_LINUX) && defined(CONFIG_GETCPU)
+    unsigned cpu, node;
+
+    if (getcpu(&cpu, &node) == 0) {
+        return node;
+    }
+#endif
+    return -1;
+}
+
+/*
+ * Prefer a reclaimed region whose memory is local to @node, then a region
+ * which has never been used, whose memory the caller will fault in itself.
+ */
+static bool tcg_region_alloc__locked(TCGContext *s, int node)
 {
-    if (region.current == region.n) {
+    size_t i, curr_region;
+
+    for (i = 0; i < region.n_free; i++) {
+        if (node >= 0 && region.node[region.free[i]] == node) {
+            break;
+        }
+    }
+    if (i < region.n_free) {
+        curr_region = region.free[i];
+        region.free[i] = region.free[--region.n_free];
+    } else if (region.current < region.n) {
+        curr_region = region.current++;
+    } else if (region.n_free) {
+        curr_region = region.free[--region.n_free];
+    } else {
         return true;
     }
-    tcg_region_assign(s, region.current);
-    region.current++;
+    tcg_region_assign(s, curr_region);
+    region.seq[curr_region] = ++region.alloc_seq;
+    if (region.node[curr_region] < 0) {
+        region.node[curr_region] = node;
+    }
     return false;
 }
 
@@ -378,7 +426,7 @@ bool tcg_region_alloc(TCGContext *s)
     size_t size_full = s->code_gen_buffer_size;
 
     qemu_mutex_lock(&region.lock);
-    err = tcg_region_alloc__locked(s);
+    err = tcg_region_alloc__locked(s, tcg_region_host_node());
     if (!err) {
         region.agg_size_full += size_full - TCG_HIGHWATER;
     }
@@ -390,16 +438,16 @@ bool tcg_region_alloc(TCGContext *s)
  * Perform a context's first region allocation.
  * This function does _not_ increment region.agg_size_full.
  */
-static void tcg_region_initial_alloc__locked(TCGContext *s)
+static void tcg_region_initial_alloc__locked(TCGContext *s, int node)
 {
-    bool err = tcg_region_alloc__locked(s);
+    bool err = tcg_region_alloc__locked(s, node);
     g_assert(!err);
 }
 
 void tcg_region_initial_alloc(TCGContext *s)
 {
     qemu_mutex_lock(&region.lock);
-    tcg_region_initial_alloc__locked(s);
+    tcg_region_initial_alloc__locked(s, tcg_region_host_node());
     qemu_mutex_unlock(&region.lock);
 }
 
@@ -412,16 +460,92 @@ void tcg_region_reset_all(void)
     qemu_mutex_lock(&region.lock);
     region.current = 0;
     region.agg_size_full = 0;
+    region.n_free = 0;
+    memset(region.seq, 0, region.n * sizeof(*region.seq));
 
     for (i = 0; i < n_ctxs; i++) {
         TCGContext *s = qatomic_read(&tcg_ctxs[i]);
-        tcg_region_initial_alloc__locked(s);
+        tcg_region_initial_alloc__locked(s, -1);
     }
     qemu_mutex_unlock(&region.lock);
 
     tcg_region_tree_reset_all();
 }
 
+/* Return true if a context is currently allocating from @curr_region. */
+static bool tcg_region_in_use__locked(size_t curr_region)
+{
+    unsigned int n_ctxs = qatomic_read(&tcg_cur_ctxs);
+    void *start, *end;
+    unsigned int i;
+
+    tcg_region_bounds(curr_region, &start, &end);
+    for (i = 0; i < n_ctxs; i++) {
+        const TCGContext *s = qatomic_read(&tcg_ctxs[i]);
+
+        if (s->code_gen_buffer == start) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Call from a safe-work context, once no region is left to allocate.
+ *
+ * Reclaim the oldest quarter of the full regions, so that the code
+ * translated most recently stays in the cache.  @func is called for
+ * each TB of a reclaimed region, which must then no longer be reachable.
+ * Returns false if there is no full region to reclaim, in which case the
+ * whole buffer must be flushed.
+ */
+bool tcg_region_reclaim(GTraverseFunc func, gpointer user_data)
+{
+    size_t i, n_reclaim, n_free;
+
+    qemu_mutex_lock(&region.lock);
+    if (region.n_free || region.current < region.n) {
+        /* Another vCPU has already made room. */
+        qemu_mutex_unlock(&region.lock);
+        return true;
+    }
+
+    n_reclaim = MAX(region.n / 4, 1);
+    while (region.n_free < n_reclaim) {
+        struct tcg_region_tree *rt;
+        size_t oldest = region.n;
+        void *start, *end;
+
+        for (i = 0; i < region.n; i++) {
+            if (region.seq[i] &&
+                (oldest == region.n || region.seq[i] < region.seq[oldest]) &&
+                !tcg_region_in_use__locked(i)) {
+                oldest = i;
+            }
+        }
+        if (oldest == region.n) {
+            break;
+        }
+
+        rt = region_trees + oldest * tree_size;
+        qemu_mutex_lock(&rt->lock);
+        q_tree_foreach(rt->tree, func, user_data);
+        /* Increment the refcount first so that destroy acts as a reset */
+        q_tree_ref(rt->tree);
+        q_tree_destroy(rt->tree);
+        qemu_mutex_unlock(&rt->lock);
+
+        tcg_region_bounds(oldest, &start, &end);
+        region.agg_size_full -= (end - start) - TCG_HIGHWATER;
+        region.seq[oldest] = 0;
+        region.free[region.n_free++] = oldest;
+    }
+    n_free = region.n_free;
+    qemu_mutex_unlock(&region.lock);
+
+    return n_free != 0;
+}
+
 static size_t tcg_n_regions(size_t tb_size, unsigned max_cpus)
 {
 #ifdef CONFIG_USER_ONLY
@@ -551,12 +675,47 @@ static int alloc_code_gen_buffer(size_t size, int splitwx, Error **errp)
     return PROT_READ | PROT_WRITE | PROT_EXEC;
 }
 #else
+/*
+ * Like mmap, but align the mapping to QEMU_VMALLOC_ALIGN, so that
+ * transparent huge pages can back all of it rather than just the
+ * huge pages which happen to lie entirely within it.
+ */
+static void *mmap_code_gen_buffer(size_t size, int prot, int flags, int fd)
+{
+    size_t align = QEMU_VMALLOC_ALIGN;
+    void *guard, *buf;
+    size_t offset;
+
+    if (align <= qemu_real_host_page_size() || size < align) {
+        return mmap(NULL, size, prot, flags, fd, 0);
+    }
+
+    guard = mmap(NULL, size + align, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (guard == MAP_FAILED) {
+        return MAP_FAILED;
+    }
+
+    buf = QEMU_ALIGN_PTR_UP(guard, align);
+    if (mmap(buf, size, prot, flags | MAP_FIXED, fd, 0) == MAP_FAILED) {
+        munmap(guard, size + align);
+        return MAP_FAILED;
+    }
+
+    offset = buf - guard;
+    if (offset) {
+        munmap(guard, offset);
+    }
+    munmap(buf + size, align - offset);
+    return buf;
+}
+
 static int alloc_code_gen_buffer_anon(size_t size, int prot,
                                       int flags, Error **errp)
 {
     void *buf;
 
-    buf = mmap(NULL, size, prot, flags, -1, 0);
+    buf = mmap_code_gen_buffer(size, prot, flags, -1);
     if (buf == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "allocate %zu bytes for jit buffer", size);
@@ -582,7 +741,7 @@ static int alloc_code_gen_buffer_splitwx_memfd(size_t size, Error **errp)
         goto fail;
     }
 
-    buf_rx = mmap(NULL, size, host_prot_read_exec(), MAP_SHARED, fd, 0);
+    buf_rx = mmap_code_gen_buffer(size, host_prot_read_exec(), MAP_SHARED, fd);
     if (buf_rx == MAP_FAILED) {
         error_setg_errno(errp, errno,
                          "failed to map shared memory for execute");
@@ -789,7 +948,21 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      */
     region.n = tcg_n_regions(tb_size, max_cpus);
     region_size = tb_size / region.n;
-    region_size = QEMU_ALIGN_DOWN(region_size, page_size);
+    /*
+     * When regions span several huge pages, keep their boundaries on huge
+     * pages, so that only the last one of each is split by its guard page.
+     */
+    if (region_size >= 4 * QEMU_VMALLOC_ALIGN) {
+        region_size = QEMU_ALIGN_DOWN(region_size, QEMU_VMALLOC_ALIGN);
+    } else {
+        region_size = QEMU_ALIGN_DOWN(region_size, page_size);
+    }
+    region.seq = g_new0(uint64_t, region.n);
+    region.free = g_new(size_t, region.n);
+    region.node = g_new(int, region.n);
+    for (size_t i = 0; i < region.n; i++) {
+        region.node[i] = -1;
+    }
 
     /* A region must have at least 2 pages; one code, one guard */
     g_assert(region_size >= 2 * page_size);
@@ -857,7 +1030,7 @@ void tcg_region_init(size_t tb_size, int splitwx, unsigned max_cpus)
      * This will be the context into which we generate the prologue.
      * It is also the only context for CONFIG_USER_ONLY.
      */
-    tcg_region_initial_alloc__locked(&tcg_init_ctx);
+    tcg_region_initial_alloc__locked(&tcg_init_ctx, -1);
 }
 
 void tcg_region_prologue_set(TCGContext *s)
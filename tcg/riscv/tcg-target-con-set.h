@@ -29,4 +29,5 @@ C_O1_I2(v, v, v)
 C_O1_I2(v, vK, v)
 C_O1_I2(v, v, vK)
 C_O1_I2(v, v, vL)
+C_O1_I3(v, v, v, v)
 C_O1_I4(v, v, vL, vK, vK)
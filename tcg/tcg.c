@@ -6348,7 +6348,10 @@ int tcg_gen_code(TCGContext *s, TranslationBlock *tb, uint64_t pc_start)
     /* Do not reuse any EBB that may be allocated within the TB. */
     tcg_temp_ebb_reset_freed(s);
 
-    tcg_optimize(s);
+    /* The first tier of tiered translation skips the optimizer */
+    if (!tb->tier_up_budget) {
+        tcg_optimize(s);
+    }
 
     reachable_code_pass(s);
     liveness_pass_0(s);
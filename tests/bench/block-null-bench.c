@@ -0,0 +1,265 @@
+/*
+ * Per-request overhead of the block layer, measured with null-co
+ *
+ * Each layer of a block graph is measured by stacking it on top of
+ * null-co, or on top of a file for the image formats, and comparing with
+ * the bare null-co numbers.  The image files are created in $TMPDIR,
+ * which should be a tmpfs (e.g. TMPDIR=/dev/shm) so that the host page
+ * cache is all that is below the file driver.
+ *
+ * For every stack and queue depth the benchmark prints the IOPS, the
+ * median and tail latencies of the requests, and the host CPU time and
+ * cycles spent per request.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "block/block.h"
+#include "block/throttle-groups.h"
+#include "crypto/secret.h"
+#include "system/block-backend.h"
+#include "qapi/error.h"
+#include "qobject/qdict.h"
+#include "qemu/main-loop.h"
+#include "qemu/module.h"
+#include "qemu/timer.h"
+#include "qom/object.h"
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+#define REQUEST_SIZE 4096
+#define IMAGE_SIZE (64 * MiB)
+
+typedef struct BenchStack {
+    const char *name;
+    /* Driver of the top node, on null-co or on an image file */
+    const char *driver;
+    /* Format of the image file, NULL to stack on null-co */
+    const char *format;
+    /* Extra options for qemu-img create style image creation */
+    const char *create_options;
+} BenchStack;
+
+static const BenchStack stacks[] = {
+    { .name = "null-co" },
+    { .name = "raw", .driver = "raw" },
+    { .name = "copy-on-read", .driver = "copy-on-read" },
+    { .name = "throttle", .driver = "throttle" },
+    { .name = "file", .driver = "file", .format = "raw" },
+    { .name = "qcow2", .driver = "qcow2", .format = "qcow2" },
+    { .name = "luks", .driver = "luks", .format = "luks",
+      .create_options = "key-secret=bench-secret,iter-time=10" },
+};
+
+static const unsigned int queue_depths[] = { 1, 128 };
+
+typedef struct BenchCase {
+    const BenchStack *stack;
+    unsigned int queue_depth;
+} BenchCase;
+
+typedef struct BenchState BenchState;
+
+typedef struct BenchReq {
+    BenchState *b;
+    int64_t start_ns;
+} BenchReq;
+
+struct BenchState {
+    BlockBackend *blk;
+    QEMUIOVector qiov;
+    unsigned int in_flight;
+    uint64_t completed;
+    /* Latency of every completed request, in ns */
+    GArray *latencies;
+    bool stop;
+};
+
+static void bench_submit(BenchReq *req);
+
+static void bench_cb(void *opaque, int ret)
+{
+    BenchReq *req = opaque;
+    BenchState *b = req->b;
+    int64_t latency = get_clock() - req->start_ns;
+
+    g_assert(ret == 0);
+    g_array_append_val(b->latencies, latency);
+    b->in_flight--;
+    b->completed++;
+    if (!b->stop) {
+        bench_submit(req);
+    }
+}
+
+static void bench_submit(BenchReq *req)
+{
+    BenchState *b = req->b;
+
+    b->in_flight++;
+    req->start_ns = get_clock();
+    blk_aio_preadv(b->blk, 0, &b->qiov, 0, bench_cb, req);
+}
+
+static int64_t cpu_time_ns(void)
+{
+#ifdef _WIN32
+    return get_clock();
+#else
+    struct rusage ru;
+
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * NANOSECONDS_PER_SECOND +
+           (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * SCALE_US;
+#endif
+}
+
+static gint compare_latency(gconstpointer a, gconstpointer b)
+{
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static int64_t percentile(GArray *sorted, unsigned int per_mille)
+{
+    return g_array_index(sorted, int64_t,
+                         (uint64_t)(sorted->len - 1) * per_mille / 1000);
+}
+
+static BlockBackend *bench_open(const BenchStack *stack, char **filename)
+{
+    QDict *options = qdict_new();
+    QDict *file = options;
+
+    *filename = NULL;
+    if (stack->format) {
+        int fd = g_file_open_tmp("block-null-bench-XXXXXX", filename, NULL);
+
+        g_assert(fd >= 0);
+        close(fd);
+        bdrv_img_create(*filename, stack->format, NULL, NULL,
+                        (char *)stack->create_options, IMAGE_SIZE,
+                        BDRV_O_RDWR, true, &error_abort);
+    }
+
+    if (stack->driver && strcmp(stack->driver, "file")) {
+        qdict_put_str(options, "driver", stack->driver);
+        if (!strcmp(stack->driver, "throttle")) {
+            qdict_put_str(options, "throttle-group", "bench-throttle");
+        } else if (!strcmp(stack->driver, "luks")) {
+            qdict_put_str(options, "key-secret", "bench-secret");
+        }
+        file = qdict_new();
+        qdict_put(options, "file", file);
+    }
+    if (stack->format) {
+        qdict_put_str(file, "driver", "file");
+        qdict_put_str(file, "filename", *filename);
+    } else {
+        qdict_put_str(file, "driver", "null-co");
+        qdict_put_str(file, "read-zeroes", "off");
+    }
+
+    return blk_new_open(NULL, NULL, options, BDRV_O_RDWR, &error_abort);
+}
+
+static void test(const void *opaque)
+{
+    const BenchCase *c = opaque;
+    BenchState b = {};
+    BenchReq *reqs = g_new0(BenchReq, c->queue_depth);
+    void *buf = g_malloc0(REQUEST_SIZE);
+    char *filename;
+    int64_t cpu_ns, ticks;
+    double cpu_share;
+    unsigned int i;
+
+    b.blk = bench_open(c->stack, &filename);
+    b.latencies = g_array_new(false, false, sizeof(int64_t));
+    qemu_iovec_init_buf(&b.qiov, buf, REQUEST_SIZE);
+
+    /* Make the requests of the image formats reach the file */
+    g_assert(blk_pwrite(b.blk, 0, REQUEST_SIZE, buf, 0) == 0);
+
+    cpu_ns = cpu_time_ns();
+    ticks = cpu_get_host_ticks();
+    g_test_timer_start();
+    for (i = 0; i < c->queue_depth; i++) {
+        reqs[i].b = &b;
+        bench_submit(&reqs[i]);
+    }
+    while (g_test_timer_elapsed() < 1.0) {
+        main_loop_wait(false);
+    }
+    b.stop = true;
+    while (b.in_flight) {
+        main_loop_wait(false);
+    }
+    g_test_timer_elapsed();
+    ticks = cpu_get_host_ticks() - ticks;
+    cpu_ns = cpu_time_ns() - cpu_ns;
+
+    /*
+     * The host ticks count wall clock cycles, scale them by the share of
+     * the time that the process spent on a CPU.
+     */
+    cpu_share = MIN(1.0, cpu_ns / (g_test_timer_last() * 1e9));
+    g_array_sort(b.latencies, compare_latency);
+
+    g_test_message("%-12s QD%-3u %8.0f IOPS  lat p50 %6" PRId64 " ns"
+                   " p99 %7" PRId64 " ns p99.9 %7" PRId64 " ns"
+                   "  %6.0f CPU ns/req %7.0f cycles/req",
+                   c->stack->name, c->queue_depth,
+                   b.completed / g_test_timer_last(),
+                   percentile(b.latencies, 500),
+                   percentile(b.latencies, 990),
+                   percentile(b.latencies, 999),
+                   (double)cpu_ns / b.completed,
+                   ticks * cpu_share / b.completed);
+
+    blk_unref(b.blk);
+    if (filename) {
+        unlink(filename);
+        g_free(filename);
+    }
+    g_array_free(b.latencies, true);
+    g_free(reqs);
+    g_free(buf);
+}
+
+int main(int argc, char **argv)
+{
+    int i, j;
+
+    module_call_init(MODULE_INIT_QOM);
+    bdrv_init();
+    qemu_init_main_loop(&error_abort);
+
+    /* High enough limits to measure the cost of throttling, not its effect */
+    object_new_with_props(TYPE_THROTTLE_GROUP, object_get_objects_root(),
+                          "bench-throttle", &error_abort,
+                          "x-iops-total", "100000000",
+                          "x-bps-total", "1000000000000", NULL);
+    object_new_with_props(TYPE_QCRYPTO_SECRET, object_get_objects_root(),
+                          "bench-secret", &error_abort,
+                          "data", "block-null-bench", NULL);
+
+    g_test_init(&argc, &argv, NULL);
+    for (i = 0; i < ARRAY_SIZE(stacks); i++) {
+        for (j = 0; j < ARRAY_SIZE(queue_depths); j++) {
+            BenchCase *c = g_new(BenchCase, 1);
+            g_autofree char *path = g_strdup_printf("/block/%s/qd%u",
+                                                    stacks[i].name,
+                                                    queue_depths[j]);
+
+            c->stack = &stacks[i];
+            c->queue_depth = queue_depths[j];
+            g_test_add_data_func_full(path, c, test, g_free);
+        }
+    }
+    return g_test_run();
+}
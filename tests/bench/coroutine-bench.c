@@ -0,0 +1,160 @@
+/*
+ * Coroutine create/enter/terminate throughput
+ *
+ * Each thread repeatedly creates a burst of coroutines, enters them so that
+ * they yield, and enters them again so that they terminate.  This exercises
+ * the coroutine pool the way bursty I/O does.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+#include "qemu/osdep.h"
+#include "qemu/coroutine.h"
+#include "qemu/thread.h"
+#include "qemu/processor.h"
+
+struct thread_info {
+    uint64_t ops;
+} QEMU_ALIGNED(64);
+
+static QemuThread *threads;
+static struct thread_info *th_info;
+static unsigned int n_threads = 1;
+static unsigned int n_ready_threads;
+static unsigned int duration = 1;
+static unsigned int burst = 64;
+static bool test_start;
+static bool test_stop;
+
+static const char commands_string[] =
+    " -d = duration in seconds\n"
+    " -n = number of threads\n"
+    " -b = number of coroutines alive at the same time in each thread";
+
+static void usage_complete(char *argv[])
+{
+    fprintf(stderr, "Usage: %s [options]\n", argv[0]);
+    fprintf(stderr, "options:\n%s\n", commands_string);
+}
+
+static void coroutine_fn yield_once(void *opaque)
+{
+    qemu_coroutine_yield();
+}
+
+static void *thread_func(void *arg)
+{
+    struct thread_info *info = arg;
+    Coroutine **cos = g_new(Coroutine *, burst);
+    unsigned int i;
+
+    qatomic_inc(&n_ready_threads);
+    while (!qatomic_read(&test_start)) {
+        cpu_relax();
+    }
+
+    while (!qatomic_read(&test_stop)) {
+        for (i = 0; i < burst; i++) {
+            cos[i] = qemu_coroutine_create(yield_once, NULL);
+            qemu_coroutine_enter(cos[i]);
+        }
+        for (i = 0; i < burst; i++) {
+            qemu_coroutine_enter(cos[i]);
+        }
+        info->ops += burst;
+    }
+
+    g_free(cos);
+    return NULL;
+}
+
+static void run_test(void)
+{
+    unsigned int i;
+
+    while (qatomic_read(&n_ready_threads) != n_threads) {
+        cpu_relax();
+    }
+
+    qatomic_set(&test_start, true);
+    g_usleep(duration * G_USEC_PER_SEC);
+    qatomic_set(&test_stop, true);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_join(&threads[i]);
+    }
+}
+
+static void create_threads(void)
+{
+    unsigned int i;
+
+    threads = g_new(QemuThread, n_threads);
+    th_info = g_new0(struct thread_info, n_threads);
+
+    for (i = 0; i < n_threads; i++) {
+        qemu_thread_create(&threads[i], NULL, thread_func, &th_info[i],
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+static void pr_params(void)
+{
+    printf("Parameters:\n");
+    printf(" # of threads:      %u\n", n_threads);
+    printf(" duration:          %u\n", duration);
+    printf(" burst size:        %u\n", burst);
+}
+
+static void pr_stats(void)
+{
+    unsigned long long val = 0;
+    double tx;
+    int i;
+
+    for (i = 0; i < n_threads; i++) {
+        val += th_info[i].ops;
+    }
+    tx = val / duration / 1e6;
+
+    printf("Results:\n");
+    printf("Duration:            %u s\n", duration);
+    printf(" Throughput:         %.2f Mcoroutines/s\n", tx);
+    printf(" Throughput/thread:  %.2f Mcoroutines/s/thread\n",
+           tx / n_threads);
+}
+
+static void parse_args(int argc, char *argv[])
+{
+    int c;
+
+    for (;;) {
+        c = getopt(argc, argv, "hd:n:b:");
+        if (c < 0) {
+            break;
+        }
+        switch (c) {
+        case 'h':
+            usage_complete(argv);
+            exit(0);
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'n':
+            n_threads = atoi(optarg);
+            break;
+        case 'b':
+            burst = MAX(atoi(optarg), 1);
+            break;
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    parse_args(argc, argv);
+    pr_params();
+    create_threads();
+    run_test();
+    pr_stats();
+    return 0;
+}
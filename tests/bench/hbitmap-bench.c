@@ -0,0 +1,128 @@
+/*
+ * HBitmap scan and count speed benchmark
+ *
+ * The bitmaps have the size and granularity of a dirty bitmap for a
+ * 4 TiB disk with 64 KiB clusters.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or
+ * (at your option) any later version.  See the COPYING file in the
+ * top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qemu/hbitmap.h"
+#include "qemu/units.h"
+
+#define BITMAP_SIZE (4 * TiB)
+#define BITMAP_GRANULARITY 16
+
+/* Set one cluster out of every @stride, or all of them if @stride is 1. */
+static HBitmap *bench_alloc(uint64_t stride)
+{
+    HBitmap *hb = hbitmap_alloc(BITMAP_SIZE, BITMAP_GRANULARITY);
+    uint64_t cluster = 1ULL << BITMAP_GRANULARITY;
+    uint64_t i;
+
+    if (stride == 1) {
+        hbitmap_set(hb, 0, BITMAP_SIZE);
+    } else {
+        for (i = 0; i < BITMAP_SIZE; i += stride * cluster) {
+            hbitmap_set(hb, i, cluster);
+        }
+    }
+    return hb;
+}
+
+/*
+ * hbitmap_deserialize_finish() rebuilds the upper levels and counts the
+ * whole bitmap, as at the end of block-dirty-bitmap migration.
+ */
+static void test_count(const void *opaque)
+{
+    uint64_t stride = GPOINTER_TO_UINT(opaque);
+    HBitmap *hb = bench_alloc(stride);
+    uint64_t count = hbitmap_count(hb);
+    unsigned int n = 0;
+
+    g_test_timer_start();
+    do {
+        hbitmap_deserialize_finish(hb);
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+
+    g_test_message("deserialize_finish 1/%-5" PRIu64 " %8.3f ms/bitmap",
+                   stride, g_test_timer_last() * 1e3 / n);
+    g_assert_cmpuint(hbitmap_count(hb), ==, count);
+    hbitmap_free(hb);
+}
+
+/* This is how block-copy looks for work to do when a backup job starts. */
+static void test_dirty_area(const void *opaque)
+{
+    uint64_t stride = GPOINTER_TO_UINT(opaque);
+    HBitmap *hb = bench_alloc(stride);
+    int64_t offset, bytes, total = 0;
+    unsigned int n = 0;
+
+    g_test_timer_start();
+    do {
+        offset = 0;
+        total = 0;
+        while (hbitmap_next_dirty_area(hb, offset, BITMAP_SIZE, 1 * TiB,
+                                       &offset, &bytes)) {
+            offset += bytes;
+            total += bytes;
+        }
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+
+    g_test_message("next_dirty_area 1/%-5" PRIu64 " %8.3f ms/scan",
+                   stride, g_test_timer_last() * 1e3 / n);
+    g_assert_cmpint(total, ==, hbitmap_count(hb));
+    hbitmap_free(hb);
+}
+
+static void test_iter(const void *opaque)
+{
+    uint64_t stride = GPOINTER_TO_UINT(opaque);
+    HBitmap *hb = bench_alloc(stride);
+    HBitmapIter hbi;
+    uint64_t found = 0;
+    unsigned int n = 0;
+
+    g_test_timer_start();
+    do {
+        found = 0;
+        hbitmap_iter_init(&hbi, hb, 0);
+        while (hbitmap_iter_next(&hbi) >= 0) {
+            found++;
+        }
+        n++;
+    } while (g_test_timer_elapsed() < 0.5);
+
+    g_test_message("iter 1/%-5" PRIu64 " %8.3f ms/scan",
+                   stride, g_test_timer_last() * 1e3 / n);
+    g_assert_cmpuint(found << BITMAP_GRANULARITY, ==, hbitmap_count(hb));
+    hbitmap_free(hb);
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned int strides[] = { 1, 2, 1024 };
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+    for (i = 0; i < ARRAY_SIZE(strides); i++) {
+        gpointer data = GUINT_TO_POINTER(strides[i]);
+        g_autofree char *count = g_strdup_printf("/hbitmap/count/1-%u",
+                                                 strides[i]);
+        g_autofree char *area = g_strdup_printf("/hbitmap/dirty-area/1-%u",
+                                                strides[i]);
+        g_autofree char *iter = g_strdup_printf("/hbitmap/iter/1-%u",
+                                                strides[i]);
+
+        g_test_add_data_func(count, data, test_count);
+        g_test_add_data_func(area, data, test_dirty_area);
+        g_test_add_data_func(iter, data, test_iter);
+    }
+    return g_test_run();
+}
@@ -0,0 +1,127 @@
+/*
+ * Cost of serializing a large QAPI response to JSON, through a QObject
+ * tree or directly
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/json-output-visitor.h"
+#include "qapi/qobject-output-visitor.h"
+#include "qobject/qjson.h"
+
+#define ENTRIES 4096
+
+static uint64_t allocs;
+
+#ifdef __GLIBC__
+/*
+ * Count heap allocations by interposing the C library allocator.
+ * g_mem_set_vtable() has been a no-op since GLib 2.46, and GLib allocates
+ * with malloc() and realloc(), so these catch g_malloc() and GString too.
+ * Other C libraries have no such hook; the count just stays zero there.
+ */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size)
+{
+    allocs++;
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    allocs++;
+    return __libc_realloc(ptr, size);
+}
+#endif
+
+/* Visit a list of ENTRIES stats-like structs, as generated code would */
+static void visit_response(Visitor *v)
+{
+    char *name = (char *)"block-node-name";
+    int64_t i;
+
+    visit_start_list(v, NULL, NULL, 0, &error_abort);
+    for (i = 0; i < ENTRIES; i++) {
+        uint64_t bytes = i * 4096;
+        bool ro = i & 1;
+
+        visit_start_struct(v, NULL, NULL, 0, &error_abort);
+        visit_type_str(v, "node-name", &name, &error_abort);
+        visit_type_int(v, "index", &i, &error_abort);
+        visit_type_uint64(v, "rd-bytes", &bytes, &error_abort);
+        visit_type_uint64(v, "wr-bytes", &bytes, &error_abort);
+        visit_type_bool(v, "read-only", &ro, &error_abort);
+        visit_check_struct(v, &error_abort);
+        visit_end_struct(v, NULL);
+    }
+    visit_check_list(v, &error_abort);
+    visit_end_list(v, NULL);
+}
+
+static size_t serialize_qobject(void)
+{
+    QObject *obj;
+    Visitor *v = qobject_output_visitor_new(&obj);
+    GString *json;
+    size_t len;
+
+    visit_response(v);
+    visit_complete(v, &obj);
+    visit_free(v);
+    json = qobject_to_json(obj);
+    qobject_unref(obj);
+    len = json->len;
+    g_string_free(json, true);
+    return len;
+}
+
+static size_t serialize_json(void)
+{
+    char *json;
+    Visitor *v = json_output_visitor_new(false, &json);
+    size_t len;
+
+    visit_response(v);
+    visit_complete(v, &json);
+    visit_free(v);
+    len = strlen(json);
+    g_free(json);
+    return len;
+}
+
+static void test(const void *opaque)
+{
+    size_t (*serialize)(void) = opaque;
+    uint64_t count = 0, start_allocs;
+    size_t len = 0;
+
+    g_test_timer_start();
+    start_allocs = allocs;
+    while (g_test_timer_elapsed() < 1.0) {
+        len = serialize();
+        count++;
+    }
+    g_test_message("%zu bytes: %8.1f us/response, %8.1f allocations/response",
+                   len, g_test_timer_last() * 1e6 / count,
+                   (double)(allocs - start_allocs) / count);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_data_func("/visitor/qobject-then-json", serialize_qobject,
+                         test);
+    g_test_add_data_func("/visitor/json", serialize_json, test);
+    return g_test_run();
+}
@@ -390,6 +390,8 @@ static void add_stats(struct thread_stats *s, struct thread_info *info, int n)
 static void pr_stats(void)
 {
     struct thread_stats s = {};
+    struct qht_stats hst;
+    size_t expected;
     double tx;
 
     add_stats(&s, rw_info, n_rw_threads);
@@ -418,6 +420,21 @@ static void pr_stats(void)
     tx = (s.rd + s.not_rd + s.in + s.not_in + s.rm + s.not_rm) / 1e6 / duration;
     printf(" Throughput:        %.2f MT/s\n", tx);
     printf(" Throughput/thread: %.2f MT/s/thread\n", tx / n_rw_threads);
+
+    qht_statistics_init(&ht, &hst);
+    printf(" Lookup retries:    %zu\n", hst.lookup_retries);
+    printf(" Contended locks:   %zu (in %lu head buckets)\n",
+           hst.lock_contended, qdist_sample_count(&hst.contention));
+    printf(" Pending resize:    %zu head buckets\n", hst.resize_pending);
+
+    /* all updates are serialized per key, so the count must be exact */
+    expected = init_size + s.in - s.rm;
+    if (hst.entries != expected) {
+        fprintf(stderr, "error: %zu entries in the hash table, expected %zu\n",
+                hst.entries, expected);
+        exit(EXIT_FAILURE);
+    }
+    qht_statistics_destroy(&hst);
 }
 
 static void run_test(void)
@@ -49,9 +49,11 @@ static const char * const op_names[] = {
 };
 
 enum precision {
+    PREC_HALF,
     PREC_SINGLE,
     PREC_DOUBLE,
     PREC_QUAD,
+    PREC_FLOAT16,
     PREC_FLOAT32,
     PREC_FLOAT64,
     PREC_FLOAT128,
@@ -90,6 +92,7 @@ static const char * const tester_names[] = {
 union fp {
     float f;
     double d;
+    float16 f16;
     float32 f32;
     float64 f64;
     float128 f128;
@@ -122,7 +125,7 @@ static float128 random_quad_ops[MAX_OPERANDS] = {
     {SEED_A, SEED_B}, {SEED_B, SEED_C}, {SEED_C, SEED_A},
 };
 static float_status soft_status;
-static enum precision precision;
+static enum precision precision = PREC_SINGLE;
 static enum op operation;
 static enum tester tester;
 static uint64_t n_completed_ops;
@@ -151,6 +154,16 @@ static void update_random_ops(int n_ops, enum precision prec)
     for (i = 0; i < n_ops; i++) {
 
         switch (prec) {
+        case PREC_HALF:
+        case PREC_FLOAT16:
+        {
+            uint64_t r = random_ops[i];
+            do {
+                r = xorshift64star(r);
+            } while (!float16_is_normal(make_float16(r)));
+            random_ops[i] = r;
+            break;
+        }
         case PREC_SINGLE:
         case PREC_FLOAT32:
         {
@@ -198,6 +211,13 @@ static void fill_random(union fp *ops, int n_ops, enum precision prec,
 
     for (i = 0; i < n_ops; i++) {
         switch (prec) {
+        case PREC_HALF:
+        case PREC_FLOAT16:
+            ops[i].f16 = make_float16(random_ops[i]);
+            if (no_neg && float16_is_neg(ops[i].f16)) {
+                ops[i].f16 = float16_chs(ops[i].f16);
+            }
+            break;
         case PREC_SINGLE:
         case PREC_FLOAT32:
             ops[i].f32 = make_float32(random_ops[i]);
@@ -310,6 +330,41 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
                 }
             }
             break;
+        case PREC_FLOAT16:
+            fill_random(ops, n_ops, prec, no_neg);
+            t0 = get_clock();
+            for (i = 0; i < OPS_PER_ITER; i++) {
+                float16 a = ops[0].f16;
+                float16 b = ops[1].f16;
+                float16 c = ops[2].f16;
+
+                switch (op) {
+                case OP_ADD:
+                    res.f16 = float16_add(a, b, &soft_status);
+                    break;
+                case OP_SUB:
+                    res.f16 = float16_sub(a, b, &soft_status);
+                    break;
+                case OP_MUL:
+                    res.f16 = float16_mul(a, b, &soft_status);
+                    break;
+                case OP_DIV:
+                    res.f16 = float16_div(a, b, &soft_status);
+                    break;
+                case OP_FMA:
+                    res.f16 = float16_muladd(a, b, c, 0, &soft_status);
+                    break;
+                case OP_SQRT:
+                    res.f16 = float16_sqrt(a, &soft_status);
+                    break;
+                case OP_CMP:
+                    res.u64 = float16_compare_quiet(a, b, &soft_status);
+                    break;
+                default:
+                    g_assert_not_reached();
+                }
+            }
+            break;
         case PREC_FLOAT32:
             fill_random(ops, n_ops, prec, no_neg);
             t0 = get_clock();
@@ -438,6 +493,7 @@ static void bench(enum precision prec, enum op op, int n_ops, bool no_neg)
 #define GEN_BENCH_ALL_TYPES(opname, op, n_ops)                          \
     GEN_BENCH(bench_ ## opname ## _float, float, PREC_SINGLE, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _double, double, PREC_DOUBLE, op, n_ops) \
+    GEN_BENCH(bench_ ## opname ## _float16, float16, PREC_FLOAT16, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float32, float32, PREC_FLOAT32, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float64, float64, PREC_FLOAT64, op, n_ops) \
     GEN_BENCH(bench_ ## opname ## _float128, float128, PREC_FLOAT128, op, n_ops)
@@ -453,6 +509,7 @@ GEN_BENCH_ALL_TYPES(cmp, OP_CMP, 2)
 #define GEN_BENCH_ALL_TYPES_NO_NEG(name, op, n)                         \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float, float, PREC_SINGLE, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _double, double, PREC_DOUBLE, op, n) \
+    GEN_BENCH_NO_NEG(bench_ ## name ## _float16, float16, PREC_FLOAT16, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float32, float32, PREC_FLOAT32, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float64, float64, PREC_FLOAT64, op, n) \
     GEN_BENCH_NO_NEG(bench_ ## name ## _float128, float128, PREC_FLOAT128, op, n)
@@ -467,6 +524,7 @@ GEN_BENCH_ALL_TYPES_NO_NEG(sqrt, OP_SQRT, 1)
     [op] = {                                                    \
         [PREC_SINGLE]    = bench_ ## opname ## _float,          \
         [PREC_DOUBLE]    = bench_ ## opname ## _double,         \
+        [PREC_FLOAT16]   = bench_ ## opname ## _float16,        \
         [PREC_FLOAT32]   = bench_ ## opname ## _float32,        \
         [PREC_FLOAT64]   = bench_ ## opname ## _float64,        \
         [PREC_FLOAT128]   = bench_ ## opname ## _float128,      \
@@ -528,7 +586,7 @@ static void usage_complete(int argc, char *argv[])
     fprintf(stderr, " -h = show this help message.\n");
     fprintf(stderr, " -o = floating point operation (%s). Default: %s\n",
             op_list, op_names[0]);
-    fprintf(stderr, " -p = floating point precision (single, double, quad[soft only]). "
+    fprintf(stderr, " -p = floating point precision (half[soft only], single, double, quad[soft only]). "
             "Default: single\n");
     fprintf(stderr, " -r = rounding mode (even, zero, down, up, tieaway). "
             "Default: even\n");
@@ -645,7 +703,9 @@ static void parse_args(int argc, char *argv[])
             operation = val;
             break;
         case 'p':
-            if (!strcmp(optarg, "single")) {
+            if (!strcmp(optarg, "half")) {
+                precision = PREC_HALF;
+            } else if (!strcmp(optarg, "single")) {
                 precision = PREC_SINGLE;
             } else if (!strcmp(optarg, "double")) {
                 precision = PREC_DOUBLE;
@@ -688,6 +748,9 @@ static void parse_args(int argc, char *argv[])
     case TESTER_SOFT:
         set_soft_precision(rounding);
         switch (precision) {
+        case PREC_HALF:
+            precision = PREC_FLOAT16;
+            break;
         case PREC_SINGLE:
             precision = PREC_FLOAT32;
             break;
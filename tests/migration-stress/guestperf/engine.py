@@ -37,13 +37,15 @@
 class Engine(object):
 
     def __init__(self, binary, dst_host, kernel, initrd, transport="tcp",
-                 sleep=15, verbose=False, debug=False):
+                 sleep=15, verbose=False, debug=False, dirtier=None):
 
         self._binary = binary # Path to QEMU binary
         self._dst_host = dst_host # Hostname of target host
         self._kernel = kernel # Path to kernel image
         self._initrd = initrd # Path to stress initrd
         self._transport = transport # 'unix' or 'tcp' or 'rdma'
+        # x-migration-dirtier properties, instead of the kernel and initrd
+        self._dirtier = dirtier
         self._sleep = sleep
         self._verbose = verbose
         self._debug = debug
@@ -78,6 +80,13 @@ def _cpu_timing(self, pid):
             utime = int(fields[14])
             return TimingRecord(pid, now, 1000 * (stime + utime) / jiffies_per_sec)
 
+    @staticmethod
+    def _migration_cpu(qemu_start, qemu_end, vcpu_start, vcpu_end):
+        # CPU time of the source during migration, minus that of the vCPUs
+        vcpu = sum(end._value - start._value
+                   for start, end in zip(vcpu_start, vcpu_end))
+        return qemu_end._value - qemu_start._value - vcpu
+
     def _migrate_progress(self, vm):
         info = vm.cmd("query-migrate")
 
@@ -237,6 +246,8 @@ def _migrate(self, hardware, scenario, src,
 
         if defer_migrate:
             resp = dst.cmd("migrate-incoming", uri=connect_uri)
+        qemu_start = self._cpu_timing(src_pid)
+        vcpu_start = self._vcpu_timing(src_pid, src_threads)
         resp = src.cmd("migrate", uri=connect_uri)
 
         post_copy = False
@@ -261,6 +272,9 @@ def _migrate(self, hardware, scenario, src,
                 progress_history.append(progress)
 
             if progress._status in ("completed", "failed", "cancelled"):
+                migration_cpu = self._migration_cpu(
+                    qemu_start, self._cpu_timing(src_pid), vcpu_start,
+                    self._vcpu_timing(src_pid, src_threads))
                 if progress._status == "completed" and paused:
                     dst.cmd("cont")
                 if progress_history[-1] != progress:
@@ -280,7 +294,8 @@ def _migrate(self, hardware, scenario, src,
                 if progress._status == "completed" and not paused:
                     result = ReportResult(True)
 
-                return [progress_history, src_qemu_time, src_vcpu_time, result]
+                return [progress_history, src_qemu_time, src_vcpu_time, result,
+                        migration_cpu]
 
             if self._verbose and (loop % 20) == 0:
                 print("Iter %d: remain %5dMB of %5dMB (total %5dMB @ %5dMb/sec)" % (
@@ -362,14 +377,18 @@ def _get_common_args(self, hardware, tunnelled=False):
         if tunnelled:
             cmdline = "'" + cmdline + "'"
 
-        argv = [
-            "-cpu", "host",
-            "-kernel", self._kernel,
-            "-initrd", self._initrd,
-            "-append", cmdline,
-            "-m", str((hardware._mem * 1024) + 512),
-            "-smp", str(hardware._cpus),
-        ]
+        if self._dirtier is not None:
+            argv = self._get_dirtier_args(hardware)
+        else:
+            argv = [
+                "-cpu", "host",
+                "-kernel", self._kernel,
+                "-initrd", self._initrd,
+                "-append", cmdline,
+                "-m", str((hardware._mem * 1024) + 512),
+                "-smp", str(hardware._cpus),
+            ]
+        argv.extend(["-trace", "vmstate_downtime_*"])
         if hardware._dirty_ring_size:
             argv.extend(["-accel", "kvm,dirty-ring-size=%s" %
                          hardware._dirty_ring_size])
@@ -391,6 +410,20 @@ def _get_common_args(self, hardware, tunnelled=False):
 
         return argv
 
+    def _get_dirtier_args(self, hardware):
+        # No guest OS, the dirtier writes to guest RAM while the VM runs
+        dirtier = ",".join("%s=%s" % (key, value)
+                           for key, value in self._dirtier.items())
+        return [
+            "-cpu", "host",
+            "-m", "%dG" % hardware._mem,
+            "-smp", str(hardware._cpus),
+            "-object", "memory-backend-ram,id=ram0,size=%dG" % hardware._mem,
+            "-machine", "memory-backend=ram0",
+            "-object", "x-migration-dirtier,id=dirtier0,memdev=ram0," +
+            dirtier,
+        ]
+
     def _get_src_args(self, hardware):
         return self._get_common_args(hardware)
 
@@ -446,6 +479,24 @@ def _get_timings(self, vm):
                                             int(match.group(3))))
         return records
 
+    def _get_downtime(self, vm):
+        log = vm.get_log()
+        if not log:
+            return []
+
+        regex = (r"vmstate_downtime_(save|load) type=(\S+) idstr=(\S+) "
+                 r"instance_id=(\d+) downtime=(\d+)")
+        records = []
+        for match in re.finditer(regex, log):
+            records.append({
+                "stage": match.group(1),
+                "type": match.group(2),
+                "idstr": match.group(3),
+                "instance_id": int(match.group(4)),
+                "downtime_us": int(match.group(5)),
+            })
+        return records
+
     def run(self, hardware, scenario, result_dir=os.getcwd()):
         abs_result_dir = os.path.join(result_dir, scenario._name)
         defer_migrate = False
@@ -495,6 +546,7 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
             qemu_timings = ret[1]
             vcpu_timings = ret[2]
             result = ret[3]
+            migration_cpu = ret[4]
             if uri[0:5] == "unix:" and os.path.exists(uri[5:]):
                 os.remove(uri[5:])
 
@@ -516,7 +568,10 @@ def run(self, hardware, scenario, result_dir=os.getcwd()):
                           Timings(vcpu_timings),
                           result,
                           self._binary, self._dst_host, self._kernel,
-                          self._initrd, self._transport, self._sleep)
+                          self._initrd, self._transport, self._sleep,
+                          self._dirtier,
+                          self._get_downtime(src) + self._get_downtime(dst),
+                          migration_cpu)
         except Exception as e:
             if self._debug:
                 print("Failed: %s" % str(e))
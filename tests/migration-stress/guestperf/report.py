@@ -55,7 +55,10 @@ def __init__(self,
                  kernel,
                  initrd,
                  transport,
-                 sleep):
+                 sleep,
+                 dirtier=None,
+                 downtime=None,
+                 migration_cpu=0):
 
         self._hardware = hardware
         self._scenario = scenario
@@ -70,6 +73,9 @@ def __init__(self,
         self._initrd = initrd
         self._transport = transport
         self._sleep = sleep
+        self._dirtier = dirtier
+        self._downtime = downtime or [] # vmstate_downtime_* trace records
+        self._migration_cpu = migration_cpu # ms, without vCPU threads
 
     def serialize(self):
         return {
@@ -86,6 +92,9 @@ def serialize(self):
             "initrd": self._initrd,
             "transport": self._transport,
             "sleep": self._sleep,
+            "dirtier": self._dirtier,
+            "downtime": self._downtime,
+            "migration_cpu": self._migration_cpu,
         }
 
     @classmethod
@@ -103,7 +112,40 @@ def deserialize(cls, data):
             data["kernel"],
             data["initrd"],
             data["transport"],
-            data["sleep"])
+            data["sleep"],
+            data.get("dirtier"),
+            data.get("downtime", []),
+            data.get("migration_cpu", 0))
+
+    def to_text(self):
+        last = self._progress_history[-1]
+        ram = last._ram
+        lines = [
+            "Status: %s" % last._status,
+            "Total time: %d ms" % last._duration,
+            "Iterations: %d" % ram._iterations,
+            "Transferred: %d MB" % (ram._transferred_bytes / (1024 * 1024)),
+        ]
+        if last._duration:
+            lines.append("Throughput: %d MB/s" %
+                         (ram._transferred_bytes / (1024 * 1024) /
+                          (last._duration / 1000)))
+        if ram._transferred_bytes:
+            lines.append("CPU per GB: %d ms" %
+                         (self._migration_cpu /
+                          (ram._transferred_bytes / (1024 ** 3))))
+        lines.append("Downtime: %d ms" % last._downtime)
+
+        for stage in ("save", "load"):
+            records = [r for r in self._downtime if r["stage"] == stage]
+            records.sort(key=lambda r: r["downtime_us"], reverse=True)
+            if records:
+                lines.append("Downtime by device (%s):" % stage)
+            for r in records:
+                lines.append("  %8d us  %s %s/%d" % (r["downtime_us"],
+                                                     r["type"], r["idstr"],
+                                                     r["instance_id"]))
+        return "\n".join(lines)
 
     def to_json(self):
         return json.dumps(self.serialize(), indent=4)
@@ -49,6 +49,16 @@ def __init__(self):
         parser.add_argument("--initrd", dest="initrd",
                             default="tests/migration-stress/initrd-stress.img")
         parser.add_argument("--transport", dest="transport", default="unix")
+        parser.add_argument("--dirtier-rate", dest="dirtier_rate",
+                            default=None, type=int,
+                            help="dirty guest RAM at this rate in MB/s "
+                            "(0 for no limit) instead of booting the kernel")
+        parser.add_argument("--dirtier-pattern", dest="dirtier_pattern",
+                            default="sequential",
+                            choices=["sequential", "random"])
+        parser.add_argument("--dirtier-working-set",
+                            dest="dirtier_working_set", default=0, type=int,
+                            help="size of the dirtied RAM in MB")
 
 
         # Hardware args
@@ -67,6 +77,15 @@ def __init__(self):
         self._parser = parser
 
     def get_engine(self, args):
+        dirtier = None
+        if args.dirtier_rate is not None:
+            dirtier = {
+                "dirty-rate": args.dirtier_rate,
+                "pattern": args.dirtier_pattern,
+            }
+            if args.dirtier_working_set:
+                dirtier["working-set"] = "%dM" % args.dirtier_working_set
+
         return Engine(binary=args.binary,
                       dst_host=args.dst_host,
                       kernel=args.kernel,
@@ -74,7 +93,8 @@ def get_engine(self, args):
                       transport=args.transport,
                       sleep=args.sleep,
                       debug=args.debug,
-                      verbose=args.verbose)
+                      verbose=args.verbose,
+                      dirtier=dirtier)
 
     def get_hardware(self, args):
         def split_map(value):
@@ -105,6 +125,9 @@ def __init__(self):
         parser = self._parser
 
         parser.add_argument("--output", dest="output", default=None)
+        parser.add_argument("--text", dest="text", default=False,
+                            action="store_true",
+                            help="print a summary instead of JSON")
 
         # Scenario args
         parser.add_argument("--max-iters", dest="max_iters", default=30, type=int)
@@ -189,8 +212,11 @@ def run(self, argv):
 
         try:
             report = engine.run(hardware, scenario)
+            if args.text:
+                print(report.to_text())
             if args.output is None:
-                print(report.to_json())
+                if not args.text:
+                    print(report.to_json())
             else:
                 with open(args.output, "w") as fh:
                     print(report.to_json(), file=fh)
@@ -45,6 +45,28 @@ static void test_postcopy_preempt(void)
     test_postcopy_common(&args);
 }
 
+static void *migrate_hook_start_postcopy_multifd(QTestState *from,
+                                                 QTestState *to)
+{
+    migrate_set_parameter_int(from, "multifd-channels", 4);
+    migrate_set_parameter_int(to, "multifd-channels", 4);
+
+    migrate_set_capability(from, "multifd", true);
+    migrate_set_capability(to, "multifd", true);
+
+    return NULL;
+}
+
+static void test_postcopy_preempt_multifd(void)
+{
+    MigrateCommon args = {
+        .start_hook = migrate_hook_start_postcopy_multifd,
+        .postcopy_preempt = true,
+    };
+
+    test_postcopy_common(&args);
+}
+
 static void test_postcopy_recovery(void)
 {
     MigrateCommon args = { };
@@ -101,6 +123,8 @@ void migration_test_add_postcopy(MigrationTestEnv *env)
     if (env->has_uffd) {
         migration_test_add("/migration/postcopy/preempt/recovery/plain",
                            test_postcopy_preempt_recovery);
+        migration_test_add("/migration/postcopy/preempt/multifd",
+                           test_postcopy_preempt_multifd);
 
         migration_test_add(
             "/migration/postcopy/recovery/double-failures/handshake",
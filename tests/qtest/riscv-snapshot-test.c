@@ -0,0 +1,81 @@
+/*
+ * QTest testcase for the in-memory RISC-V vCPU snapshots
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "libqtest.h"
+#include "qobject/qdict.h"
+
+#define RAM_BASE    0x80000000ULL
+#define RANGE_SIZE  0x2000
+#define MMIO_BASE   0x10000000ULL
+
+static void test_snapshot(void)
+{
+    g_autofree char *file = NULL;
+    g_autofree uint8_t *pattern = g_malloc(RANGE_SIZE);
+    g_autofree uint8_t *buf = g_malloc(RANGE_SIZE);
+    g_autofree gchar *contents = NULL;
+    gsize len;
+    QTestState *qts;
+    QDict *rsp, *ret;
+    int fd, i;
+
+    fd = g_file_open_tmp("riscv-snapshot-XXXXXX", &file, NULL);
+    g_assert(fd >= 0);
+    close(fd);
+
+    for (i = 0; i < RANGE_SIZE; i++) {
+        pattern[i] = i * 7 + 3;
+    }
+
+    qts = qtest_init("-machine virt");
+    qtest_memwrite(qts, RAM_BASE, pattern, RANGE_SIZE);
+
+    rsp = qtest_qmp(qts, "{ 'execute': 'x-riscv-cpu-snapshot-save',"
+                    "  'arguments': { 'name': 'template', 'cpu-index': 0,"
+                    "                 'addr': %" PRIu64 ", 'size': %d,"
+                    "                 'file': %s } }",
+                    (uint64_t)RAM_BASE, RANGE_SIZE, file);
+    ret = qdict_get_qdict(rsp, "return");
+    g_assert(ret);
+    g_assert_cmpint(qdict_get_int(ret, "ram-size"), ==, RANGE_SIZE);
+    g_assert_cmpint(qdict_get_int(ret, "cpu-state-size"), >, 0);
+    qobject_unref(rsp);
+
+    /* The file holds a raw image of the range */
+    g_assert(g_file_get_contents(file, &contents, &len, NULL));
+    g_assert_cmpint(len, ==, RANGE_SIZE);
+    g_assert(memcmp(contents, pattern, RANGE_SIZE) == 0);
+
+    memset(buf, 0, RANGE_SIZE);
+    qtest_memwrite(qts, RAM_BASE, buf, RANGE_SIZE);
+    qtest_qmp_assert_success(qts, "{ 'execute': 'x-riscv-cpu-snapshot-load',"
+                             "  'arguments': { 'name': 'template' } }");
+    qtest_memread(qts, RAM_BASE, buf, RANGE_SIZE);
+    g_assert(memcmp(buf, pattern, RANGE_SIZE) == 0);
+
+    /* Device memory cannot be part of a snapshot */
+    rsp = qtest_qmp(qts, "{ 'execute': 'x-riscv-cpu-snapshot-save',"
+                    "  'arguments': { 'name': 'mmio', 'cpu-index': 0,"
+                    "                 'addr': %" PRIu64 ", 'size': 16 } }",
+                    (uint64_t)MMIO_BASE);
+    g_assert(qdict_haskey(rsp, "error"));
+    qobject_unref(rsp);
+
+    qtest_qmp_assert_success(qts, "{ 'execute': 'x-riscv-cpu-snapshot-delete',"
+                             "  'arguments': { 'name': 'template' } }");
+    qtest_quit(qts);
+    unlink(file);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/riscv/cpu-snapshot", test_snapshot);
+
+    return g_test_run();
+}
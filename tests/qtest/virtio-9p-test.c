@@ -737,6 +737,44 @@ static void fs_use_after_unlink(void *obj, void *data,
     g_assert_cmpint(count, ==, write_count);
 }
 
+static void fs_create_file_nested(void *obj, void *data,
+                                  QGuestAllocator *t_alloc)
+{
+    QVirtio9P *v9p = obj;
+    v9fs_set_allocator(t_alloc);
+    struct stat st;
+    g_autofree char *new_file = virtio_9p_test_path("10/a/b/nested_file");
+    struct v9fs_attr attr;
+    uint32_t fid_file;
+
+    tattach({ .client = v9p });
+    tmkdir({ .client = v9p, .atPath = "/", .name = "10" });
+    tmkdir({ .client = v9p, .atPath = "10", .name = "a" });
+    tmkdir({ .client = v9p, .atPath = "10/a", .name = "b" });
+
+    /*
+     * The server resolves "10/a" with a single openat2() call here, if the
+     * host supports it, and opens "b" below it.
+     */
+    tlcreate({ .client = v9p, .atPath = "10/a/b", .name = "nested_file" });
+
+    /* check if created file exists now ... */
+    g_assert(stat(new_file, &st) == 0);
+    /* ... and is a regular file */
+    g_assert((st.st_mode & S_IFMT) == S_IFREG);
+
+    /* looking it up resolves "10/a/b" the same way */
+    fid_file = twalk({
+        .client = v9p, .fid = 0, .path = "10/a/b/nested_file"
+    }).newfid;
+    g_assert(fid_file != 0);
+    tgetattr({
+        .client = v9p, .fid = fid_file, .request_mask = P9_GETATTR_BASIC,
+        .rgetattr.attr = &attr
+    });
+    g_assert((attr.mode & S_IFMT) == S_IFREG);
+}
+
 static void cleanup_9p_local_driver(void *data)
 {
     /* remove previously created test dir when test is completed */
@@ -795,6 +833,8 @@ static void register_virtio_9p_test(void)
     qos_add_test("local/create_dir", "virtio-9p", fs_create_dir, &opts);
     qos_add_test("local/unlinkat_dir", "virtio-9p", fs_unlinkat_dir, &opts);
     qos_add_test("local/create_file", "virtio-9p", fs_create_file, &opts);
+    qos_add_test("local/create_file_nested", "virtio-9p",
+                 fs_create_file_nested, &opts);
     qos_add_test("local/unlinkat_file", "virtio-9p", fs_unlinkat_file, &opts);
     qos_add_test("local/symlink_file", "virtio-9p", fs_symlink_file, &opts);
     qos_add_test("local/unlinkat_symlink", "virtio-9p", fs_unlinkat_symlink,
@@ -318,11 +318,50 @@ static void test_map_unmap(void *obj, void *data, QGuestAllocator *t_alloc)
     g_assert_cmpint(ret, ==, VIRTIO_IOMMU_S_INVAL); /* 10-14 still is mapped */
 }
 
+/*
+ * Unmapping one of two adjacent mappings must leave the other one alone,
+ * and the same range can then be mapped again.
+ */
+static void test_map_unmap_remap(void *obj, void *data,
+                                 QGuestAllocator *t_alloc)
+{
+    QVirtioIOMMU *v_iommu = obj;
+    QTestState *qts = global_qtest;
+    int ret;
+
+    alloc = t_alloc;
+
+    ret = send_attach_detach(qts, v_iommu, VIRTIO_IOMMU_T_ATTACH, 1, 0);
+    g_assert_cmpint(ret, ==, 0);
+
+    /* A and B are contiguous in both address spaces */
+    ret = send_map(qts, v_iommu, 1, 0x0, 0xFFF, 0xa1000,
+                   VIRTIO_IOMMU_MAP_F_READ);
+    g_assert_cmpint(ret, ==, 0);
+    ret = send_map(qts, v_iommu, 1, 0x1000, 0x1FFF, 0xa2000,
+                   VIRTIO_IOMMU_MAP_F_READ);
+    g_assert_cmpint(ret, ==, 0);
+
+    ret = send_unmap(qts, v_iommu, 1, 0x0, 0xFFF);
+    g_assert_cmpint(ret, ==, 0);
+    ret = send_map(qts, v_iommu, 1, 0x0, 0xFFF, 0xa1000,
+                   VIRTIO_IOMMU_MAP_F_READ);
+    g_assert_cmpint(ret, ==, 0);
+
+    /* B is still mapped on its own */
+    ret = send_map(qts, v_iommu, 1, 0x1000, 0x1FFF, 0xa2000,
+                   VIRTIO_IOMMU_MAP_F_READ);
+    g_assert_cmpint(ret, ==, VIRTIO_IOMMU_S_INVAL);
+    ret = send_unmap(qts, v_iommu, 1, 0x0, 0x1FFF);
+    g_assert_cmpint(ret, ==, 0);
+}
+
 static void register_virtio_iommu_test(void)
 {
     qos_add_test("config", "virtio-iommu", pci_config, NULL);
     qos_add_test("attach_detach", "virtio-iommu", test_attach_detach, NULL);
     qos_add_test("map_unmap", "virtio-iommu", test_map_unmap, NULL);
+    qos_add_test("map_unmap_remap", "virtio-iommu", test_map_unmap_remap, NULL);
 }
 
 libqos_init(register_virtio_iommu_test);
@@ -20,6 +20,7 @@ typedef struct {
     uint64_t count_insn_inline;
     uint64_t count_mem;
     uint64_t count_mem_inline;
+    uint64_t count_mem_trace;
     uint64_t tb_cond_num_trigger;
     uint64_t tb_cond_track_count;
     uint64_t insn_cond_num_trigger;
@@ -27,6 +28,7 @@ typedef struct {
 } CPUCount;
 
 static const uint64_t cond_trigger_limit = 100;
+static const size_t mem_trace_entries = 16;
 
 typedef struct {
     uint64_t data_insn;
@@ -41,6 +43,7 @@ static qemu_plugin_u64 count_insn;
 static qemu_plugin_u64 count_insn_inline;
 static qemu_plugin_u64 count_mem;
 static qemu_plugin_u64 count_mem_inline;
+static qemu_plugin_u64 count_mem_trace;
 static qemu_plugin_u64 tb_cond_num_trigger;
 static qemu_plugin_u64 tb_cond_track_count;
 static qemu_plugin_u64 insn_cond_num_trigger;
@@ -49,6 +52,7 @@ static struct qemu_plugin_scoreboard *data;
 static qemu_plugin_u64 data_insn;
 static qemu_plugin_u64 data_tb;
 static qemu_plugin_u64 data_mem;
+static struct qemu_plugin_mem_trace *mem_trace;
 
 static uint64_t global_count_tb;
 static uint64_t global_count_insn;
@@ -111,14 +115,17 @@ static void stats_mem(void)
     const uint64_t per_vcpu = qemu_plugin_u64_sum(count_mem);
     const uint64_t inl_per_vcpu =
         qemu_plugin_u64_sum(count_mem_inline);
+    const uint64_t trace_per_vcpu = qemu_plugin_u64_sum(count_mem_trace);
     g_autoptr(GString) stats = g_string_new("");
     g_string_append_printf(stats, "mem: %" PRIu64 "\n", expected);
     g_string_append_printf(stats, "mem: %" PRIu64 " (per vcpu)\n", per_vcpu);
     g_string_append_printf(stats, "mem: %" PRIu64 " (per vcpu inline)\n", inl_per_vcpu);
+    g_string_append_printf(stats, "mem: %" PRIu64 " (trace)\n", trace_per_vcpu);
     qemu_plugin_outs(stats->str);
     g_assert(expected > 0);
     g_assert(per_vcpu == expected);
     g_assert(inl_per_vcpu == expected);
+    g_assert(trace_per_vcpu == expected);
 }
 
 static void plugin_exit(qemu_plugin_id_t id, void *udata)
@@ -127,6 +134,10 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
     g_autoptr(GString) stats = g_string_new("");
     g_assert(num_cpus == max_cpu_index + 1);
 
+    for (int i = 0; i < num_cpus ; ++i) {
+        qemu_plugin_mem_trace_flush(mem_trace, i);
+    }
+
     for (int i = 0; i < num_cpus ; ++i) {
         const uint64_t tb = qemu_plugin_u64_get(count_tb, i);
         const uint64_t tb_inline = qemu_plugin_u64_get(count_tb_inline, i);
@@ -134,6 +145,7 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
         const uint64_t insn_inline = qemu_plugin_u64_get(count_insn_inline, i);
         const uint64_t mem = qemu_plugin_u64_get(count_mem, i);
         const uint64_t mem_inline = qemu_plugin_u64_get(count_mem_inline, i);
+        const uint64_t mem_trace = qemu_plugin_u64_get(count_mem_trace, i);
         const uint64_t tb_cond_trigger =
             qemu_plugin_u64_get(tb_cond_num_trigger, i);
         const uint64_t tb_cond_left =
@@ -148,18 +160,19 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
                         "insn (%" PRIu64 ", %" PRIu64
                         ", %" PRIu64 " * %" PRIu64 " + %" PRIu64
                         ") | "
-                        "mem (%" PRIu64 ", %" PRIu64 ")"
+                        "mem (%" PRIu64 ", %" PRIu64 ", %" PRIu64 ")"
                         "\n",
                         i,
                         tb, tb_inline,
                         tb_cond_trigger, cond_trigger_limit, tb_cond_left,
                         insn, insn_inline,
                         insn_cond_trigger, cond_trigger_limit, insn_cond_left,
-                        mem, mem_inline);
+                        mem, mem_inline, mem_trace);
         qemu_plugin_outs(stats->str);
         g_assert(tb == tb_inline);
         g_assert(insn == insn_inline);
         g_assert(mem == mem_inline);
+        g_assert(mem == mem_trace);
         g_assert(tb_cond_trigger == tb / cond_trigger_limit);
         g_assert(tb_cond_left == tb % cond_trigger_limit);
         g_assert(insn_cond_trigger == insn / cond_trigger_limit);
@@ -170,6 +183,7 @@ static void plugin_exit(qemu_plugin_id_t id, void *udata)
     stats_insn();
     stats_mem();
 
+    qemu_plugin_mem_trace_free(mem_trace);
     qemu_plugin_scoreboard_free(counts);
     qemu_plugin_scoreboard_free(data);
 }
@@ -223,6 +237,14 @@ static void vcpu_mem_access(unsigned int cpu_index,
     g_mutex_unlock(&mem_lock);
 }
 
+static void vcpu_mem_trace(unsigned int cpu_index,
+                           const qemu_plugin_mem_trace_entry *entries,
+                           size_t n, void *udata)
+{
+    g_assert(n > 0 && n <= mem_trace_entries);
+    qemu_plugin_u64_add(count_mem_trace, cpu_index, n);
+}
+
 static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
 {
     void *tb_store = tb;
@@ -270,6 +292,8 @@ static void vcpu_tb_trans(qemu_plugin_id_t id, struct qemu_plugin_tb *tb)
             insn, QEMU_PLUGIN_MEM_RW,
             QEMU_PLUGIN_INLINE_ADD_U64,
             count_mem_inline, 1);
+        qemu_plugin_register_vcpu_mem_trace(insn, QEMU_PLUGIN_MEM_RW,
+                                            mem_trace);
     }
 }
 
@@ -290,6 +314,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
         counts, CPUCount, count_insn_inline);
     count_mem_inline = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, count_mem_inline);
+    count_mem_trace = qemu_plugin_scoreboard_u64_in_struct(
+        counts, CPUCount, count_mem_trace);
     tb_cond_num_trigger = qemu_plugin_scoreboard_u64_in_struct(
         counts, CPUCount, tb_cond_num_trigger);
     tb_cond_track_count = qemu_plugin_scoreboard_u64_in_struct(
@@ -302,6 +328,8 @@ int qemu_plugin_install(qemu_plugin_id_t id, const qemu_info_t *info,
     data_insn = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_insn);
     data_tb = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_tb);
     data_mem = qemu_plugin_scoreboard_u64_in_struct(data, CPUData, data_mem);
+    mem_trace = qemu_plugin_mem_trace_new(mem_trace_entries, vcpu_mem_trace,
+                                          NULL);
 
     qemu_plugin_register_vcpu_tb_trans_cb(id, vcpu_tb_trans);
     qemu_plugin_register_atexit_cb(id, plugin_exit, NULL);
@@ -0,0 +1,68 @@
+/*
+ * Common definitions of the RISC-V TCG benchmark workloads
+ *
+ * The workloads are bare-metal programs for the virt machine that run a
+ * loop for a number of iterations and exit through semihosting, with
+ * exit code 0 on success.  By default they run few iterations, so that
+ * they are quick enough for check-tcg; scripts/simplebench/bench_tcg_riscv.py
+ * runs them with larger counts stored at BENCH_ITERS_ADDR.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+/*
+ * The iteration count, and the number of harts for SMP workloads, are
+ * read from these addresses, e.g. as set with
+ * "-device loader,addr=0x80100000,data=1000000,data-len=8".
+ */
+#define BENCH_ITERS_ADDR    0x80100000
+#define BENCH_HARTS_ADDR    0x80100008
+
+/* Memory that the workloads use as scratch space */
+#define BENCH_SCRATCH       0x81000000
+
+#define MSTATUS_VS          0x600
+#define MSTATUS_MPP         0x1800
+#define MSTATUS_MPP_S       0x800
+#define MSTATUS_FS          0x6000
+
+/* Load the value at \addr into \reg, or \default if it is zero */
+.macro bench_param reg, addr, default
+	li	\reg, \addr
+	ld	\reg, 0(\reg)
+	bnez	\reg, .Lbench_param\@
+	li	\reg, \default
+.Lbench_param\@:
+.endm
+
+/* Park all harts but hart 0 */
+.macro bench_park_secondary
+	csrr	t0, mhartid
+	beqz	t0, .Lbench_primary\@
+.Lbench_park\@:
+	wfi
+	j	.Lbench_park\@
+.Lbench_primary\@:
+.endm
+
+/* Exit with the code in a0 through semihosting, from M-mode */
+.macro bench_exit
+	lla	a1, .Lbench_semiargs\@
+	li	t0, 0x20026	# ADP_Stopped_ApplicationExit
+	sd	t0, 0(a1)
+	sd	a0, 8(a1)
+	li	a0, 0x20	# TARGET_SYS_EXIT_EXTENDED
+
+	# Semihosting call sequence
+	.balign	16
+	slli	zero, zero, 0x1f
+	ebreak
+	srai	zero, zero, 0x7
+	j	.
+
+	.pushsection .data
+	.balign	16
+.Lbench_semiargs\@:
+	.space	16
+	.popsection
+.endm
@@ -6,20 +6,33 @@
  */
 #include "qemu/osdep.h"
 
-#define TEST_QHT_STRING "tests/qht-bench 1>/dev/null 2>&1 -R -S0.1 -D10000 -N1 "
+#define TEST_QHT_STRING "tests/qht-bench 1>/dev/null 2>&1 -R -N1 "
 
-static void test_qht(int n_threads, int update_rate, int duration)
+static void test_qht_resize(int n_threads, int update_rate, int duration,
+                            const char *resize_rate, int resize_delay)
 {
     char *str;
     int rc;
 
-    str = g_strdup_printf(TEST_QHT_STRING "-n %d -u %d -d %d",
+    str = g_strdup_printf(TEST_QHT_STRING "-S%s -D%d -n %d -u %d -d %d",
+                          resize_rate, resize_delay,
                           n_threads, update_rate, duration);
     rc = system(str);
     g_free(str);
     g_assert_cmpint(rc, ==, 0);
 }
 
+static void test_qht(int n_threads, int update_rate, int duration)
+{
+    test_qht_resize(n_threads, update_rate, duration, "0.1", 10000);
+}
+
+/* resize every 100us, so that lookups and updates race with moving buckets */
+static void test_2th20u1s_resize(void)
+{
+    test_qht_resize(2, 20, 1, "100", 100);
+}
+
 static void test_2th0u1s(void)
 {
     test_qht(2, 0, 1);
@@ -47,6 +60,8 @@ int main(int argc, char *argv[])
     if (g_test_quick()) {
         g_test_add_func("/qht/parallel/2threads-0%updates-1s", test_2th0u1s);
         g_test_add_func("/qht/parallel/2threads-20%updates-1s", test_2th20u1s);
+        g_test_add_func("/qht/parallel/2threads-20%updates-resize-1s",
+                        test_2th20u1s_resize);
     } else {
         g_test_add_func("/qht/parallel/2threads-0%updates-5s", test_2th0u5s);
         g_test_add_func("/qht/parallel/2threads-20%updates-5s", test_2th20u5s);
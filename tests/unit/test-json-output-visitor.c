@@ -0,0 +1,174 @@
+/*
+ * JSON Output Visitor unit-tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+
+#include "qapi/error.h"
+#include "qapi/json-output-visitor.h"
+#include "test-qapi-visit.h"
+#include "qobject/qdict.h"
+#include "qobject/qjson.h"
+#include "qobject/qlist.h"
+#include "qobject/qnum.h"
+#include "qobject/qstring.h"
+
+static char *visit_to_json(bool pretty,
+                           void (*fn)(Visitor *v, void *opaque), void *opaque)
+{
+    char *json;
+    Visitor *v = json_output_visitor_new(pretty, &json);
+
+    fn(v, opaque);
+    visit_complete(v, &json);
+    visit_free(v);
+    g_assert(json);
+    return json;
+}
+
+static void visit_int(Visitor *v, void *opaque)
+{
+    visit_type_int(v, NULL, opaque, &error_abort);
+}
+
+static void test_visitor_out_int(void)
+{
+    int64_t value = -42;
+    g_autofree char *json = visit_to_json(false, visit_int, &value);
+
+    g_assert_cmpstr(json, ==, "-42");
+}
+
+static void visit_str(Visitor *v, void *opaque)
+{
+    visit_type_str(v, NULL, opaque, &error_abort);
+}
+
+static void test_visitor_out_string(void)
+{
+    char *value = (char *) "Q E M U \"\\\n";
+    char *null = NULL;
+    g_autofree char *json = visit_to_json(false, visit_str, &value);
+    g_autofree char *empty = visit_to_json(false, visit_str, &null);
+
+    g_assert_cmpstr(json, ==, "\"Q E M U \\\"\\\\\\n\"");
+    g_assert_cmpstr(empty, ==, "\"\"");
+}
+
+static void visit_struct(Visitor *v, void *opaque)
+{
+    visit_type_TestStruct(v, NULL, opaque, &error_abort);
+}
+
+static void test_visitor_out_struct(void)
+{
+    TestStruct test_struct = { .integer = 42,
+                               .boolean = false,
+                               .string = (char *) "foo"};
+    TestStruct *p = &test_struct;
+    g_autofree char *json = visit_to_json(false, visit_struct, &p);
+    g_autofree char *pretty = visit_to_json(true, visit_struct, &p);
+
+    g_assert_cmpstr(json, ==,
+                    "{\"integer\": 42, \"boolean\": false, "
+                    "\"string\": \"foo\"}");
+    g_assert_cmpstr(pretty, ==,
+                    "{\n"
+                    "    \"integer\": 42,\n"
+                    "    \"boolean\": false,\n"
+                    "    \"string\": \"foo\"\n"
+                    "}");
+}
+
+static void visit_struct_nested(Visitor *v, void *opaque)
+{
+    visit_type_UserDefTwo(v, "unused", opaque, &error_abort);
+}
+
+static void test_visitor_out_struct_nested(void)
+{
+    UserDefOne userdef = { .integer = 42, .string = (char *) "user def" };
+    UserDefTwoDictDict dict2 = { .userdef = &userdef,
+                                 .string = (char *) "forty two" };
+    UserDefTwoDict dict1 = { .string1 = (char *) "forty three",
+                             .dict2 = &dict2 };
+    UserDefTwo ud2 = { .string0 = (char *) "forty four", .dict1 = &dict1 };
+    UserDefTwo *p = &ud2;
+    g_autofree char *json = visit_to_json(false, visit_struct_nested, &p);
+    QObject *obj = qobject_from_json(json, &error_abort);
+    QDict *qdict = qobject_to(QDict, obj);
+
+    g_assert(qdict);
+    g_assert_cmpstr(qdict_get_str(qdict, "string0"), ==, "forty four");
+    qdict = qdict_get_qdict(qdict, "dict1");
+    g_assert_cmpstr(qdict_get_str(qdict, "string1"), ==, "forty three");
+    g_assert(!qdict_haskey(qdict, "dict3"));
+    qdict = qdict_get_qdict(qdict, "dict2");
+    g_assert_cmpstr(qdict_get_str(qdict, "string"), ==, "forty two");
+    qdict = qdict_get_qdict(qdict, "userdef");
+    g_assert_cmpint(qdict_get_int(qdict, "integer"), ==, 42);
+    g_assert_cmpstr(qdict_get_str(qdict, "string"), ==, "user def");
+    g_assert(!qdict_haskey(qdict, "enum1"));
+    qobject_unref(obj);
+}
+
+static void visit_list(Visitor *v, void *opaque)
+{
+    visit_type_TestStructList(v, NULL, opaque, &error_abort);
+}
+
+static void test_visitor_out_list(void)
+{
+    TestStruct values[] = {
+        { .integer = 1, .boolean = true, .string = (char *) "one" },
+        { .integer = 2, .boolean = false, .string = (char *) "two" },
+    };
+    TestStructList list[] = {
+        { .next = &list[1], .value = &values[0] },
+        { .next = NULL, .value = &values[1] },
+    };
+    TestStructList *head = list;
+    TestStructList *empty = NULL;
+    g_autofree char *json = visit_to_json(false, visit_list, &head);
+    g_autofree char *json_empty = visit_to_json(false, visit_list, &empty);
+
+    g_assert_cmpstr(json, ==,
+                    "[{\"integer\": 1, \"boolean\": true, "
+                    "\"string\": \"one\"}, "
+                    "{\"integer\": 2, \"boolean\": false, "
+                    "\"string\": \"two\"}]");
+    g_assert_cmpstr(json_empty, ==, "[]");
+}
+
+static void visit_any(Visitor *v, void *opaque)
+{
+    visit_type_any(v, NULL, opaque, &error_abort);
+}
+
+static void test_visitor_out_any(void)
+{
+    QObject *qobj = qobject_from_json("{\"a\": [1, \"b\", null]}",
+                                      &error_abort);
+    g_autofree char *json = visit_to_json(false, visit_any, &qobj);
+
+    g_assert_cmpstr(json, ==, "{\"a\": [1, \"b\", null]}");
+    qobject_unref(qobj);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    g_test_add_func("/visitor/json-output/int", test_visitor_out_int);
+    g_test_add_func("/visitor/json-output/string", test_visitor_out_string);
+    g_test_add_func("/visitor/json-output/struct", test_visitor_out_struct);
+    g_test_add_func("/visitor/json-output/struct-nested",
+                    test_visitor_out_struct_nested);
+    g_test_add_func("/visitor/json-output/list", test_visitor_out_list);
+    g_test_add_func("/visitor/json-output/any", test_visitor_out_any);
+
+    return g_test_run();
+}
@@ -310,8 +310,13 @@ static void rcu_qtest(const char *test, int duration, int nreaders)
         synchronize_rcu();
     }
     if (g_test_in_charge) {
+        RCUCallStats stats;
+
         g_assert_cmpint(qatomic_read_i64(&n_nodes_removed), ==,
                         qatomic_read_i64(&n_reclaims));
+        rcu_call_stats(&stats);
+        g_assert_cmpuint(stats.callbacks, >=, qatomic_read_i64(&n_reclaims));
+        g_assert_cmpuint(stats.max_batch, >, 0);
     } else {
         printf("%s: %d readers; 1 updater; nodes read: "  \
                "%lld, nodes removed: %"PRIi64"; nodes reclaimed: %"PRIi64"\n",
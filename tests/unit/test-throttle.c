@@ -663,6 +663,49 @@ static bool do_test_accounting(bool is_ops, /* are we testing bps or ops */
     return true;
 }
 
+static void test_reserve(void)
+{
+    LeakyBucket *bkt = &ts.cfg.buckets[THROTTLE_BPS_READ];
+    intptr_t bytes, ops;
+
+    throttle_config_init(&cfg);
+    cfg.buckets[THROTTLE_BPS_READ].avg = 1000;
+
+    throttle_init(&ts);
+    throttle_timers_init(tt, ctx, QEMU_CLOCK_VIRTUAL,
+                         read_timer_cb, write_timer_cb, &ts);
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+
+    /* 10 ms worth of I/O, and no limit on the number of operations */
+    g_assert(throttle_reserve(&ts, QEMU_CLOCK_VIRTUAL, THROTTLE_READ,
+                              10 * SCALE_MS, &bytes, &ops));
+    g_assert_cmpint(bytes, ==, 10);
+    g_assert_cmpint(ops, ==, INTPTR_MAX);
+    g_assert(bkt->level <= 10);
+
+    /* the unused part goes back to the bucket */
+    throttle_unreserve(&ts, THROTTLE_READ, 4, ops);
+    g_assert(bkt->level <= 6);
+
+    /* nothing is reserved if it would exceed the burst */
+    g_assert(!throttle_reserve(&ts, QEMU_CLOCK_VIRTUAL, THROTTLE_READ,
+                               NANOSECONDS_PER_SECOND, &bytes, &ops));
+    g_assert(bkt->level <= 6);
+
+    /* writes are not limited at all */
+    g_assert(throttle_reserve(&ts, QEMU_CLOCK_VIRTUAL, THROTTLE_WRITE,
+                              10 * SCALE_MS, &bytes, &ops));
+    g_assert_cmpint(bytes, ==, INTPTR_MAX);
+
+    /* op_size makes each request's cost depend on its size */
+    cfg.op_size = 4096;
+    throttle_config(&ts, QEMU_CLOCK_VIRTUAL, &cfg);
+    g_assert(!throttle_reserve(&ts, QEMU_CLOCK_VIRTUAL, THROTTLE_READ,
+                               10 * SCALE_MS, &bytes, &ops));
+
+    throttle_timers_destroy(tt);
+}
+
 static void test_accounting(void)
 {
     /* tests for bps */
@@ -829,6 +872,7 @@ int main(int argc, char **argv)
                     test_iops_size_is_missing_limit);
     g_test_add_func("/throttle/config_functions",   test_config_functions);
     g_test_add_func("/throttle/accounting",         test_accounting);
+    g_test_add_func("/throttle/reserve",            test_reserve);
     g_test_add_func("/throttle/groups",             test_groups);
     return g_test_run();
 }
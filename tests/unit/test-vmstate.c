@@ -330,6 +330,55 @@ static void test_simple_array(void)
                          sizeof(wire_simple_arr)));
 }
 
+/* Large enough to be byte-swapped in several chunks */
+#define LARGE_ARRAY_LEN 100
+
+typedef struct TestLargeArray {
+    uint64_t u64[LARGE_ARRAY_LEN];
+    int32_t i32[LARGE_ARRAY_LEN];
+} TestLargeArray;
+
+static const VMStateDescription vmstate_large_arr = {
+    .name = "large/array",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .fields = (const VMStateField[]) {
+        VMSTATE_UINT64_ARRAY(u64, TestLargeArray, LARGE_ARRAY_LEN),
+        VMSTATE_INT32_ARRAY(i32, TestLargeArray, LARGE_ARRAY_LEN),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
+static void obj_large_arr_copy(void *target, void *source)
+{
+    memcpy(target, source, sizeof(TestLargeArray));
+}
+
+static void test_large_array(void)
+{
+    TestLargeArray obj_large_arr, obj, obj_clone;
+    size_t wire_size = LARGE_ARRAY_LEN * 12 + 1;
+    g_autofree uint8_t *wire = g_malloc(wire_size);
+    int i;
+
+    for (i = 0; i < LARGE_ARRAY_LEN; i++) {
+        obj_large_arr.u64[i] = 0x0102030405060708ULL * (i + 1);
+        obj_large_arr.i32[i] = -i;
+        stq_be_p(wire + i * 8, obj_large_arr.u64[i]);
+        stl_be_p(wire + LARGE_ARRAY_LEN * 8 + i * 4, obj_large_arr.i32[i]);
+    }
+    wire[wire_size - 1] = QEMU_VM_EOF;
+
+    memset(&obj, 0, sizeof(obj));
+    save_vmstate(&vmstate_large_arr, &obj_large_arr);
+
+    compare_vmstate(wire, wire_size);
+
+    SUCCESS(load_vmstate(&vmstate_large_arr, &obj, &obj_clone,
+                         obj_large_arr_copy, 1, wire, wire_size));
+    SUCCESS(memcmp(&obj, &obj_large_arr, sizeof(obj)));
+}
+
 typedef struct TestStruct {
     uint32_t a, b, c, e;
     uint64_t d, f;
@@ -1492,6 +1541,7 @@ int main(int argc, char **argv)
     g_test_init(&argc, &argv, NULL);
     g_test_add_func("/vmstate/simple/primitive", test_simple_primitive);
     g_test_add_func("/vmstate/simple/array", test_simple_array);
+    g_test_add_func("/vmstate/large/array", test_large_array);
     g_test_add_func("/vmstate/versioned/load/v1", test_load_v1);
     g_test_add_func("/vmstate/versioned/load/v2", test_load_v2);
     g_test_add_func("/vmstate/field_exists/load/noskip", test_load_noskip);
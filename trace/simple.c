@@ -25,17 +25,18 @@
 #define HEADER_MAGIC 0xf2b177cb0aa429b4ULL
 
 /** Trace file version number, bump if format changes */
-#define HEADER_VERSION 4
+#define HEADER_VERSION 5
 
 /** Records were dropped event ID */
 #define DROPPED_EVENT_ID (~(uint64_t)0 - 1)
 
-/** Trace record is valid */
-#define TRACE_RECORD_VALID ((uint64_t)1 << 63)
-
 /*
- * Trace records are written out by a dedicated thread.  The thread waits for
- * records to become available, writes them out, and then waits again.
+ * Every thread that emits trace events gets its own ring buffer, so that
+ * threads never contend for buffer space.  Rings have a single producer,
+ * the owning thread, and a single consumer, the writeout thread.  The
+ * writeout thread waits for records to become available, merges the
+ * records of all rings in timestamp order, writes them out, and then
+ * waits again.
  */
 static GMutex trace_lock;
 static GCond trace_available_cond;
@@ -49,10 +50,25 @@ enum {
     TRACE_BUF_FLUSH_THRESHOLD = TRACE_BUF_LEN / 4,
 };
 
-uint8_t trace_buf[TRACE_BUF_LEN];
-static volatile gint trace_idx;
-static unsigned int writeout_idx;
-static volatile gint dropped_events;
+typedef struct TraceThreadBuf {
+    /* Protected by trace_lock */
+    struct TraceThreadBuf *next;
+    /* Written by the owner thread only */
+    unsigned int head;
+    unsigned int dropped;
+    bool busy;
+    bool exited;
+    /* Written by the writeout thread only */
+    unsigned int tail;
+    unsigned int dropped_reported;
+    uint64_t tid;
+    uint8_t data[TRACE_BUF_LEN];
+} TraceThreadBuf;
+
+static void trace_thread_buf_exit(gpointer opaque);
+
+static GPrivate trace_thread_buf = G_PRIVATE_INIT(trace_thread_buf_exit);
+static TraceThreadBuf *trace_thread_bufs;
 static uint32_t trace_pid;
 static FILE *trace_fp;
 static char *trace_file_name;
@@ -66,6 +82,7 @@ typedef struct {
     uint64_t timestamp_ns;
     uint32_t length;   /*    in bytes */
     uint32_t pid;
+    uint64_t tid;
     uint64_t arguments[];
 } TraceRecord;
 
@@ -75,54 +92,60 @@ typedef struct {
     uint64_t header_version;  /* HEADER_VERSION  */
 } TraceLogHeader;
 
+static void read_from_buffer(TraceThreadBuf *buf, unsigned int idx,
+                             void *dataptr, size_t size)
+{
+    uint8_t *data_ptr = dataptr;
+    size_t x;
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size);
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size);
+    for (x = 0; x < size; x++, idx++) {
+        data_ptr[x] = buf->data[idx % TRACE_BUF_LEN];
+    }
+}
 
-static void clear_buffer_range(unsigned int idx, size_t len)
+static unsigned int write_to_buffer(TraceThreadBuf *buf, unsigned int idx,
+                                    const void *dataptr, size_t size)
 {
-    uint32_t num = 0;
-    while (num < len) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = 0;
-        num++;
+    const uint8_t *data_ptr = dataptr;
+    size_t x;
+
+    for (x = 0; x < size; x++, idx++) {
+        buf->data[idx % TRACE_BUF_LEN] = data_ptr[x];
     }
+    return idx; /* most callers wants to know where to write next */
 }
-/**
- * Read a trace record from the trace buffer
- *
- * @idx         Trace buffer index
- * @record      Trace record to fill
- *
- * Returns false if the record is not valid.
- */
-static bool get_trace_record(unsigned int idx, TraceRecord **recordptr)
+
+/* Called by GLib when a thread that emitted trace events exits */
+static void trace_thread_buf_exit(gpointer opaque)
 {
-    uint64_t event_flag = 0;
-    TraceRecord record;
-    /* read the event flag to see if its a valid record */
-    read_from_buffer(idx, &record, sizeof(event_flag));
+    TraceThreadBuf *buf = opaque;
 
-    if (!(record.event & TRACE_RECORD_VALID)) {
-        return false;
+    /* The writeout thread frees the ring once it has been drained */
+    qatomic_store_release(&buf->exited, true);
+}
+
+static TraceThreadBuf *get_trace_thread_buf(void)
+{
+    TraceThreadBuf *buf = g_private_get(&trace_thread_buf);
+
+    if (likely(buf)) {
+        return buf;
     }
 
-    smp_rmb(); /* read memory barrier before accessing record */
-    /* read the record header to know record length */
-    read_from_buffer(idx, &record, sizeof(TraceRecord));
-    *recordptr = malloc(record.length); /* don't use g_malloc, can deadlock when traced */
-    /* make a copy of record to avoid being overwritten */
-    read_from_buffer(idx, *recordptr, record.length);
-    smp_rmb(); /* memory barrier before clearing valid flag */
-    (*recordptr)->event &= ~TRACE_RECORD_VALID;
-    /* clear the trace buffer range for consumed record otherwise any byte
-     * with its MSB set may be considered as a valid event id when the writer
-     * thread crosses this range of buffer again.
-     */
-    clear_buffer_range(idx, record.length);
-    return true;
+    /* don't use g_malloc, can deadlock when traced */
+    buf = calloc(1, sizeof(*buf));
+    if (!buf) {
+        return NULL;
+    }
+    buf->tid = qemu_get_thread_id();
+
+    g_mutex_lock(&trace_lock);
+    buf->next = trace_thread_bufs;
+    qatomic_store_release(&trace_thread_bufs, buf);
+    g_mutex_unlock(&trace_lock);
+
+    g_private_set(&trace_thread_buf, buf);
+    return buf;
 }
 
 /**
@@ -154,42 +177,148 @@ static void wait_for_trace_records_available(void)
     g_mutex_unlock(&trace_lock);
 }
 
-static gpointer writeout_thread(gpointer opaque)
+typedef struct {
+    TraceThreadBuf *buf;
+    unsigned int idx;   /* next record */
+    unsigned int end;   /* head of the ring when the writeout started */
+} TraceCursor;
+
+static uint64_t cursor_timestamp(TraceCursor *c)
+{
+    TraceRecord record;
+
+    read_from_buffer(c->buf, c->idx, &record, sizeof(TraceRecord));
+    return record.timestamp_ns;
+}
+
+static void write_dropped_record(void)
 {
-    TraceRecord *recordptr;
     union {
         TraceRecord rec;
         uint8_t bytes[sizeof(TraceRecord) + sizeof(uint64_t)];
     } dropped;
-    unsigned int idx = 0;
-    int dropped_count;
     size_t unused __attribute__ ((unused));
     uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    uint64_t dropped_count = 0;
+    TraceThreadBuf *buf;
 
-    for (;;) {
-        wait_for_trace_records_available();
+    for (buf = qatomic_load_acquire(&trace_thread_bufs); buf;
+         buf = buf->next) {
+        unsigned int n = qatomic_read(&buf->dropped);
 
-        if (g_atomic_int_get(&dropped_events)) {
-            dropped.rec.event = DROPPED_EVENT_ID;
-            dropped.rec.timestamp_ns = get_clock();
-            dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
-            dropped.rec.pid = trace_pid;
-            do {
-                dropped_count = g_atomic_int_get(&dropped_events);
-            } while (!g_atomic_int_compare_and_exchange(&dropped_events,
-                                                        dropped_count, 0));
-            dropped.rec.arguments[0] = dropped_count;
-            unused = fwrite(&type, sizeof(type), 1, trace_fp);
-            unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+        dropped_count += n - buf->dropped_reported;
+        buf->dropped_reported = n;
+    }
+    if (!dropped_count) {
+        return;
+    }
+
+    dropped.rec.event = DROPPED_EVENT_ID;
+    dropped.rec.timestamp_ns = get_clock();
+    dropped.rec.length = sizeof(TraceRecord) + sizeof(uint64_t);
+    dropped.rec.pid = trace_pid;
+    dropped.rec.tid = 0;
+    dropped.rec.arguments[0] = dropped_count;
+    unused = fwrite(&type, sizeof(type), 1, trace_fp);
+    unused = fwrite(&dropped.rec, dropped.rec.length, 1, trace_fp);
+}
+
+/* Free the rings of threads that exited, once they have been drained */
+static void free_exited_thread_bufs(void)
+{
+    TraceThreadBuf **pbuf, *buf;
+
+    g_mutex_lock(&trace_lock);
+    pbuf = &trace_thread_bufs;
+    while ((buf = *pbuf) != NULL) {
+        if (qatomic_load_acquire(&buf->exited) &&
+            buf->tail == qatomic_read(&buf->head) &&
+            buf->dropped_reported == qatomic_read(&buf->dropped)) {
+            *pbuf = buf->next;
+            free(buf); /* don't use g_free, can deadlock when traced */
+        } else {
+            pbuf = &buf->next;
         }
+    }
+    g_mutex_unlock(&trace_lock);
+}
+
+static void write_trace_records(void)
+{
+    size_t unused __attribute__ ((unused));
+    uint64_t type = TRACE_RECORD_TYPE_EVENT;
+    TraceThreadBuf *bufs, *buf;
+    TraceCursor *cursors;
+    size_t n = 0, i;
 
-        while (get_trace_record(idx, &recordptr)) {
+    /*
+     * Only this thread removes rings from the list, and new rings are
+     * added at its head, so the list can be walked without trace_lock.
+     */
+    bufs = qatomic_load_acquire(&trace_thread_bufs);
+    for (buf = bufs; buf; buf = buf->next) {
+        n++;
+    }
+    cursors = calloc(n, sizeof(*cursors)); /* don't use g_malloc */
+    if (!cursors) {
+        return;
+    }
+    n = 0;
+    for (buf = bufs; buf; buf = buf->next) {
+        cursors[n].buf = buf;
+        cursors[n].idx = buf->tail;
+        cursors[n].end = qatomic_load_acquire(&buf->head);
+        n++;
+    }
+
+    for (;;) {
+        TraceCursor *next = NULL;
+        uint64_t next_ts = 0;
+        TraceRecord *recordptr;
+        TraceRecord record;
+
+        for (i = 0; i < n; i++) {
+            TraceCursor *c = &cursors[i];
+            uint64_t ts;
+
+            if (c->idx == c->end) {
+                continue;
+            }
+            ts = cursor_timestamp(c);
+            if (!next || ts < next_ts) {
+                next = c;
+                next_ts = ts;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        read_from_buffer(next->buf, next->idx, &record, sizeof(TraceRecord));
+        /* don't use g_malloc, can deadlock when traced */
+        recordptr = malloc(record.length);
+        if (recordptr) {
+            read_from_buffer(next->buf, next->idx, recordptr, record.length);
             unused = fwrite(&type, sizeof(type), 1, trace_fp);
             unused = fwrite(recordptr, recordptr->length, 1, trace_fp);
-            writeout_idx += recordptr->length;
             free(recordptr); /* don't use g_free, can deadlock when traced */
-            idx = writeout_idx % TRACE_BUF_LEN;
         }
+        next->idx += record.length;
+        /* Release the space to the producer */
+        qatomic_store_release(&next->buf->tail, next->idx);
+    }
+
+    free(cursors);
+}
+
+static gpointer writeout_thread(gpointer opaque)
+{
+    for (;;) {
+        wait_for_trace_records_available();
+
+        write_dropped_record();
+        write_trace_records();
+        free_exited_thread_bufs();
 
         fflush(trace_fp);
     }
@@ -198,84 +327,68 @@ static gpointer writeout_thread(gpointer opaque)
 
 void trace_record_write_u64(TraceBufferRecord *rec, uint64_t val)
 {
-    rec->rec_off = write_to_buffer(rec->rec_off, &val, sizeof(uint64_t));
+    rec->rec_off = write_to_buffer(rec->buf, rec->rec_off, &val,
+                                   sizeof(uint64_t));
 }
 
 void trace_record_write_str(TraceBufferRecord *rec, const char *s, uint32_t slen)
 {
     /* Write string length first */
-    rec->rec_off = write_to_buffer(rec->rec_off, &slen, sizeof(slen));
+    rec->rec_off = write_to_buffer(rec->buf, rec->rec_off, &slen,
+                                   sizeof(slen));
     /* Write actual string now */
-    rec->rec_off = write_to_buffer(rec->rec_off, (void*)s, slen);
+    rec->rec_off = write_to_buffer(rec->buf, rec->rec_off, s, slen);
 }
 
 int trace_record_start(TraceBufferRecord *rec, uint32_t event, size_t datasize)
 {
-    unsigned int idx, rec_off, old_idx, new_idx;
+    TraceThreadBuf *buf = get_trace_thread_buf();
     uint32_t rec_len = sizeof(TraceRecord) + datasize;
-    uint64_t event_u64 = event;
-    uint64_t timestamp_ns = get_clock();
-
-    do {
-        old_idx = g_atomic_int_get(&trace_idx);
-        smp_rmb();
-        new_idx = old_idx + rec_len;
-
-        if (new_idx - writeout_idx > TRACE_BUF_LEN) {
-            /* Trace Buffer Full, Event dropped ! */
-            g_atomic_int_inc(&dropped_events);
-            return -ENOSPC;
-        }
-    } while (!g_atomic_int_compare_and_exchange(&trace_idx, old_idx, new_idx));
-
-    idx = old_idx % TRACE_BUF_LEN;
-
-    rec_off = idx;
-    rec_off = write_to_buffer(rec_off, &event_u64, sizeof(event_u64));
-    rec_off = write_to_buffer(rec_off, &timestamp_ns, sizeof(timestamp_ns));
-    rec_off = write_to_buffer(rec_off, &rec_len, sizeof(rec_len));
-    rec_off = write_to_buffer(rec_off, &trace_pid, sizeof(trace_pid));
+    TraceRecord record;
+    unsigned int head;
 
-    rec->tbuf_idx = idx;
-    rec->rec_off  = (idx + sizeof(TraceRecord)) % TRACE_BUF_LEN;
-    return 0;
-}
+    if (!buf) {
+        return -ENOMEM;
+    }
 
-static void read_from_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        data_ptr[x++] = trace_buf[idx++];
+    /* An event from a signal handler that interrupted another event */
+    if (buf->busy) {
+        qatomic_set(&buf->dropped, buf->dropped + 1);
+        return -EBUSY;
     }
-}
 
-static unsigned int write_to_buffer(unsigned int idx, void *dataptr, size_t size)
-{
-    uint8_t *data_ptr = dataptr;
-    uint32_t x = 0;
-    while (x < size) {
-        if (idx >= TRACE_BUF_LEN) {
-            idx = idx % TRACE_BUF_LEN;
-        }
-        trace_buf[idx++] = data_ptr[x++];
+    head = buf->head;
+    if (head + rec_len - qatomic_load_acquire(&buf->tail) > TRACE_BUF_LEN) {
+        /* Trace Buffer Full, Event dropped ! */
+        qatomic_set(&buf->dropped, buf->dropped + 1);
+        return -ENOSPC;
     }
-    return idx; /* most callers wants to know where to write next */
+    buf->busy = true;
+    signal_barrier();
+
+    record.event = event;
+    record.timestamp_ns = get_clock();
+    record.length = rec_len;
+    record.pid = trace_pid;
+    record.tid = buf->tid;
+    write_to_buffer(buf, head, &record, sizeof(TraceRecord));
+
+    rec->buf = buf;
+    rec->tbuf_idx = head;
+    rec->rec_off = head + sizeof(TraceRecord);
+    return 0;
 }
 
 void trace_record_finish(TraceBufferRecord *rec)
 {
-    TraceRecord record;
-    read_from_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
-    smp_wmb(); /* write barrier before marking as valid */
-    record.event |= TRACE_RECORD_VALID;
-    write_to_buffer(rec->tbuf_idx, &record, sizeof(TraceRecord));
+    TraceThreadBuf *buf = rec->buf;
+
+    /* Publish the record to the writeout thread */
+    qatomic_store_release(&buf->head, rec->rec_off);
+    signal_barrier();
+    buf->busy = false;
 
-    if (((unsigned int)g_atomic_int_get(&trace_idx) - writeout_idx)
-        > TRACE_BUF_FLUSH_THRESHOLD) {
+    if (rec->rec_off - qatomic_read(&buf->tail) > TRACE_BUF_FLUSH_THRESHOLD) {
         flush_trace_file(false);
     }
 }
@@ -19,6 +19,7 @@ void st_init_group(size_t group);
 void st_flush_trace_buffer(void);
 
 typedef struct {
+    struct TraceThreadBuf *buf;
     unsigned int tbuf_idx;
     unsigned int rec_off;
 } TraceBufferRecord;
@@ -85,6 +85,13 @@ struct _DBusDisplayListener {
 #endif
 #else /* !WIN32 */
     QemuDBusDisplay1ListenerUnixMap *map_proxy;
+    /*
+     * Shareable copy of a surface that has no share handle of its own,
+     * mapped once by the peer; updates only copy the damaged area.
+     */
+    pixman_image_t *shadow;
+    qemu_pixman_shareable shadow_handle;
+    bool ds_shadowed;
 #endif
 
     guint dbus_filter;
@@ -444,22 +451,84 @@ dbus_scanout_share_d3d_texture(
 }
 #endif /* CONFIG_OPENGL */
 #else /* !WIN32 */
+static void ddl_shadow_copy(DBusDisplayListener *ddl,
+                            int x, int y, int w, int h)
+{
+    uint8_t *src = surface_data(ddl->ds);
+    uint8_t *dst = (uint8_t *)pixman_image_get_data(ddl->shadow);
+    int src_stride = surface_stride(ddl->ds);
+    int dst_stride = pixman_image_get_stride(ddl->shadow);
+    int bpp = surface_bytes_per_pixel(ddl->ds);
+    int i;
+
+    for (i = y; i < y + h; i++) {
+        memcpy(dst + i * dst_stride + x * bpp,
+               src + i * src_stride + x * bpp, w * bpp);
+    }
+}
+
+static bool ddl_shadow_setup(DBusDisplayListener *ddl)
+{
+    int width = surface_width(ddl->ds);
+    int height = surface_height(ddl->ds);
+    pixman_format_code_t format = surface_format(ddl->ds);
+
+    if (!ddl->shadow ||
+        pixman_image_get_width(ddl->shadow) != width ||
+        pixman_image_get_height(ddl->shadow) != height ||
+        pixman_image_get_format(ddl->shadow) != format) {
+        Error *local_err = NULL;
+
+        g_clear_pointer(&ddl->shadow, qemu_pixman_image_unref);
+        if (!qemu_pixman_image_new_shareable(&ddl->shadow,
+                                             &ddl->shadow_handle,
+                                             "dbus-listener-shadow",
+                                             format, width, height,
+                                             surface_stride(ddl->ds),
+                                             &local_err)) {
+            g_debug("Failed to allocate shadow surface: %s",
+                    error_get_pretty(local_err));
+            error_free(local_err);
+            ddl->shadow = NULL;
+            return false;
+        }
+    }
+
+    ddl_shadow_copy(ddl, 0, 0, width, height);
+    return true;
+}
+
 static bool dbus_scanout_map(DBusDisplayListener *ddl)
 {
     g_autoptr(GError) err = NULL;
     g_autoptr(GUnixFDList) fd_list = NULL;
+    qemu_pixman_shareable handle;
+    uint32_t offset, stride;
 
     if (ddl->ds_share == SHARE_KIND_MAPPED) {
         return true;
     }
 
-    if (!ddl->can_share_map || ddl->ds->share_handle == SHAREABLE_NONE) {
+    if (!ddl->can_share_map) {
+        return false;
+    }
+
+    ddl->ds_shadowed = ddl->ds->share_handle == SHAREABLE_NONE;
+    if (!ddl->ds_shadowed) {
+        handle = ddl->ds->share_handle;
+        offset = ddl->ds->share_handle_offset;
+        stride = surface_stride(ddl->ds);
+    } else if (ddl_shadow_setup(ddl)) {
+        handle = ddl->shadow_handle;
+        offset = 0;
+        stride = pixman_image_get_stride(ddl->shadow);
+    } else {
         return false;
     }
 
     ddl_discard_display_messages(ddl);
     fd_list = g_unix_fd_list_new();
-    if (g_unix_fd_list_append(fd_list, ddl->ds->share_handle, &err) != 0) {
+    if (g_unix_fd_list_append(fd_list, handle, &err) != 0) {
         g_debug("Failed to setup scanout map fdlist: %s", err->message);
         ddl->can_share_map = false;
         return false;
@@ -468,10 +537,10 @@ static bool dbus_scanout_map(DBusDisplayListener *ddl)
     if (!qemu_dbus_display1_listener_unix_map_call_scanout_map_sync(
             ddl->map_proxy,
             g_variant_new_handle(0),
-            ddl->ds->share_handle_offset,
+            offset,
             surface_width(ddl->ds),
             surface_height(ddl->ds),
-            surface_stride(ddl->ds),
+            stride,
             surface_format(ddl->ds),
             G_DBUS_CALL_FLAGS_NONE,
             DBUS_DEFAULT_TIMEOUT,
@@ -748,6 +817,9 @@ static void dbus_gfx_update(DisplayChangeListener *dcl,
             G_DBUS_CALL_FLAGS_NONE,
             DBUS_DEFAULT_TIMEOUT, NULL, NULL, NULL);
 #else
+        if (ddl->ds_shadowed) {
+            ddl_shadow_copy(ddl, x, y, w, h);
+        }
         qemu_dbus_display1_listener_unix_map_call_update_map(
             ddl->map_proxy,
             x, y, w, h,
@@ -883,6 +955,8 @@ dbus_display_listener_dispose(GObject *object)
 #ifdef CONFIG_OPENGL
     egl_fb_destroy(&ddl->fb);
 #endif
+#else
+    g_clear_pointer(&ddl->shadow, qemu_pixman_image_unref);
 #endif
 
     G_OBJECT_CLASS(dbus_display_listener_parent_class)->dispose(object);
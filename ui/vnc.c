@@ -3109,7 +3109,7 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
     int has_dirty = 0;
     pixman_image_t *tmpbuf = NULL;
     unsigned long offset;
-    int x;
+    int x, run_end;
     uint8_t *guest_ptr, *server_ptr;
 
     struct timeval tv = { 0, 0 };
@@ -3162,13 +3162,37 @@ static int vnc_refresh_server_surface(VncDisplay *vd)
             guest_ptr = guest_row0 + y * guest_stride;
         }
         guest_ptr += x * cmp_bytes;
+        run_end = 0;
 
         for (; x < DIV_ROUND_UP(width, VNC_DIRTY_PIXELS_PER_BIT);
              x++, guest_ptr += cmp_bytes, server_ptr += cmp_bytes) {
             int _cmp_bytes = cmp_bytes;
-            if (!test_and_clear_bit(x, vd->guest.dirty[y])) {
+            if (!test_bit(x, vd->guest.dirty[y])) {
                 continue;
             }
+            if (x >= run_end) {
+                /*
+                 * Guests often report whole lines as dirty when little or
+                 * nothing changed.  Compare each run of dirty chunks in one
+                 * go first, and skip it if it is unchanged.
+                 */
+                int run_bytes;
+
+                run_end = find_next_zero_bit(vd->guest.dirty[y],
+                                             DIV_ROUND_UP(width,
+                                             VNC_DIRTY_PIXELS_PER_BIT), x);
+                run_bytes = MIN(run_end * cmp_bytes, line_bytes) -
+                            x * cmp_bytes;
+                if (run_end - x > 1 && run_bytes > 0 &&
+                    memcmp(server_ptr, guest_ptr, run_bytes) == 0) {
+                    bitmap_clear(vd->guest.dirty[y], x, run_end - x);
+                    guest_ptr += (run_end - x - 1) * cmp_bytes;
+                    server_ptr += (run_end - x - 1) * cmp_bytes;
+                    x = run_end - 1;
+                    continue;
+                }
+            }
+            clear_bit(x, vd->guest.dirty[y]);
             if ((x + 1) * cmp_bytes > line_bytes) {
                 _cmp_bytes = line_bytes - x * cmp_bytes;
             }
@@ -248,6 +248,8 @@ struct VncRectEntry
 struct VncJob
 {
     VncState *vs;
+    /* Being encoded by a worker thread, protected by the queue lock */
+    bool running;
 
     QLIST_HEAD(, VncRectEntry) rectangles;
     QTAILQ_ENTRY(VncJob) next;
@@ -333,6 +333,11 @@ static bool aio_dispatch_handler(AioContext *ctx, AioHandler *node)
     poll_ready = node->poll_ready;
     node->poll_ready = false;
 
+    /* An event on a polled handler that polling did not see in time */
+    if (revents && !poll_ready && QLIST_IS_INSERTED(node, node_poll)) {
+        node->poll.misses++;
+    }
+
     /*
      * Start polling AioHandlers when they become ready because activity is
      * likely to continue.  Note that starvation is theoretically possible when
@@ -441,9 +446,16 @@ void aio_dispatch(AioContext *ctx)
     timerlistgroup_run_timers(&ctx->tlg);
 }
 
+/*
+ * Each handler is only polled for its own polling time, so that a busy
+ * handler with a long polling time does not make the loop spin on handlers
+ * that polling does not pay off for.  @elapsed is the time spent polling so
+ * far; all handlers are polled at least once.
+ */
 static bool run_poll_handlers_once(AioContext *ctx,
                                    AioHandlerList *ready_list,
                                    int64_t now,
+                                   int64_t elapsed,
                                    int64_t *timeout)
 {
     bool progress = false;
@@ -451,8 +463,15 @@ static bool run_poll_handlers_once(AioContext *ctx,
     AioHandler *tmp;
 
     QLIST_FOREACH_SAFE(node, &ctx->poll_aio_handlers, node_poll, tmp) {
+        /* Always poll aio_notify(), bottom halves rely on it */
+        if (elapsed && elapsed >= node->poll.ns &&
+            node->opaque != &ctx->notifier) {
+            continue;
+        }
+
         if (node->io_poll(node->opaque)) {
             aio_add_poll_ready_handler(ready_list, node);
+            node->poll.hits++;
 
             node->poll_idle_timeout = now + POLL_IDLE_INTERVAL_NS;
 
@@ -553,9 +572,10 @@ static bool run_poll_handlers(AioContext *ctx, AioHandlerList *ready_list,
     RCU_READ_LOCK_GUARD();
 
     start_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    elapsed_time = 0;
     do {
         progress = run_poll_handlers_once(ctx, ready_list,
-                                          start_time, timeout);
+                                          start_time, elapsed_time, timeout);
         elapsed_time = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) - start_time;
         max_ns = qemu_soonest_timeout(*timeout, max_ns);
         assert(!(max_ns && progress));
@@ -621,6 +641,9 @@ static bool try_poll_mode(AioContext *ctx, AioHandlerList *ready_list,
 static void adjust_polling_time(AioContext *ctx, AioPolledEvent *poll,
                                 int64_t block_ns)
 {
+    poll->event_ns = poll->event_ns ? (poll->event_ns * 7 + block_ns) / 8
+                                    : block_ns;
+
     if (block_ns <= poll->ns) {
         /* This is the sweet spot, no adjustment needed */
     } else if (block_ns > ctx->poll_max_ns) {
@@ -808,6 +831,23 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     aio_notify(ctx);
 }
 
+void aio_context_foreach_poll_handler(AioContext *ctx, AioPollStatsFn *fn,
+                                      void *opaque)
+{
+    AioHandler *node;
+
+    /* Keeps deleted handlers from being freed, see aio_poll() */
+    qemu_lockcnt_inc(&ctx->list_lock);
+    WITH_RCU_READ_LOCK_GUARD() {
+        QLIST_FOREACH_RCU(node, &ctx->aio_handlers, node) {
+            if (node->io_poll && !QLIST_IS_INSERTED(node, node_deleted)) {
+                fn(node->pfd.fd, &node->poll, opaque);
+            }
+        }
+    }
+    qemu_lockcnt_dec(&ctx->list_lock);
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
     /*
@@ -439,6 +439,11 @@ void aio_context_set_poll_params(AioContext *ctx, int64_t max_ns,
     }
 }
 
+void aio_context_foreach_poll_handler(AioContext *ctx, AioPollStatsFn *fn,
+                                      void *opaque)
+{
+}
+
 void aio_context_set_aio_params(AioContext *ctx, int64_t max_batch)
 {
 }
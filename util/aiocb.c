@@ -23,14 +23,100 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/coroutine-tls.h"
+#include "qemu/notify.h"
+#include "qemu/queue.h"
+#include "qemu/thread.h"
 #include "block/aio.h"
 
+enum {
+    AIOCB_POOL_SIZES = 4,       /* distinct AIOCB sizes cached per thread */
+    AIOCB_POOL_MAX_SIZE = 64,   /* AIOCBs cached per size */
+};
+
+/*
+ * AIOCBs are allocated and freed once per request, so each thread keeps
+ * freed AIOCBs around for reuse instead of going through malloc every time.
+ * Most threads only ever see a couple of AIOCB types (e.g. BlkAioEmAIOCB),
+ * so a few lists sorted out by size are enough.
+ */
+typedef struct AIOCBPoolEntry {
+    QSLIST_ENTRY(AIOCBPoolEntry) next;
+} AIOCBPoolEntry;
+
+typedef struct AIOCBPool {
+    size_t aiocb_size;          /* 0 if unused */
+    unsigned int count;
+    QSLIST_HEAD(, AIOCBPoolEntry) list;
+} AIOCBPool;
+
+typedef struct AIOCBPools {
+    AIOCBPool pools[AIOCB_POOL_SIZES];
+    Notifier cleanup_notifier;
+} AIOCBPools;
+
+QEMU_DEFINE_STATIC_CO_TLS(AIOCBPools, local_pools);
+
+static void local_pools_cleanup(Notifier *n, void *value)
+{
+    AIOCBPools *local_pools = get_ptr_local_pools();
+    AIOCBPoolEntry *entry, *tmp;
+    int i;
+
+    for (i = 0; i < AIOCB_POOL_SIZES; i++) {
+        AIOCBPool *pool = &local_pools->pools[i];
+
+        QSLIST_FOREACH_SAFE(entry, &pool->list, next, tmp) {
+            QSLIST_REMOVE_HEAD(&pool->list, next);
+            g_free(entry);
+        }
+        pool->count = 0;
+    }
+}
+
+/*
+ * Return the pool of this thread for AIOCBs of @aiocb_size bytes, assigning
+ * an unused one if @create is true.  Return NULL if there is none.
+ */
+static AIOCBPool *local_pool_find(size_t aiocb_size, bool create)
+{
+    AIOCBPools *local_pools = get_ptr_local_pools();
+    int i;
+
+    for (i = 0; i < AIOCB_POOL_SIZES; i++) {
+        AIOCBPool *pool = &local_pools->pools[i];
+
+        if (pool->aiocb_size == aiocb_size) {
+            return pool;
+        }
+        if (pool->aiocb_size == 0) {
+            if (!create) {
+                return NULL;
+            }
+            if (!local_pools->cleanup_notifier.notify) {
+                local_pools->cleanup_notifier.notify = local_pools_cleanup;
+                qemu_thread_atexit_add(&local_pools->cleanup_notifier);
+            }
+            pool->aiocb_size = aiocb_size;
+            return pool;
+        }
+    }
+    return NULL;
+}
+
 void *qemu_aio_get(const AIOCBInfo *aiocb_info, BlockDriverState *bs,
                    BlockCompletionFunc *cb, void *opaque)
 {
+    AIOCBPool *pool = local_pool_find(aiocb_info->aiocb_size, false);
     BlockAIOCB *acb;
 
-    acb = g_malloc(aiocb_info->aiocb_size);
+    if (pool && pool->count) {
+        acb = (BlockAIOCB *)QSLIST_FIRST(&pool->list);
+        QSLIST_REMOVE_HEAD(&pool->list, next);
+        pool->count--;
+    } else {
+        acb = g_malloc(aiocb_info->aiocb_size);
+    }
     acb->aiocb_info = aiocb_info;
     acb->bs = bs;
     acb->cb = cb;
@@ -50,6 +136,15 @@ void qemu_aio_unref(void *p)
     BlockAIOCB *acb = p;
     assert(acb->refcnt > 0);
     if (--acb->refcnt == 0) {
-        g_free(acb);
+        AIOCBPool *pool = local_pool_find(acb->aiocb_info->aiocb_size, true);
+
+        if (pool && pool->count < AIOCB_POOL_MAX_SIZE) {
+            AIOCBPoolEntry *entry = (AIOCBPoolEntry *)acb;
+
+            QSLIST_INSERT_HEAD(&pool->list, entry, next);
+            pool->count++;
+        } else {
+            g_free(acb);
+        }
     }
 }
@@ -385,6 +385,11 @@ aio_ctx_finalize(GSource     *source)
         luring_cleanup(ctx->linux_io_uring);
         ctx->linux_io_uring = NULL;
     }
+    if (ctx->linux_io_uring_cmd) {
+        luring_detach_aio_context(ctx->linux_io_uring_cmd, ctx);
+        luring_cleanup(ctx->linux_io_uring_cmd);
+        ctx->linux_io_uring_cmd = NULL;
+    }
 #endif
 
     assert(QSLIST_EMPTY(&ctx->scheduled_coroutines));
@@ -463,19 +468,25 @@ LinuxAioState *aio_get_linux_aio(AioContext *ctx)
 #endif
 
 #ifdef CONFIG_LINUX_IO_URING
-LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
+static LuringState *aio_setup_luring(AioContext *ctx, LuringState **ring,
+                                     bool uring_cmd, Error **errp)
 {
-    if (ctx->linux_io_uring) {
-        return ctx->linux_io_uring;
+    if (*ring) {
+        return *ring;
     }
 
-    ctx->linux_io_uring = luring_init(errp);
-    if (!ctx->linux_io_uring) {
+    *ring = luring_init(uring_cmd, errp);
+    if (!*ring) {
         return NULL;
     }
 
-    luring_attach_aio_context(ctx->linux_io_uring, ctx);
-    return ctx->linux_io_uring;
+    luring_attach_aio_context(*ring, ctx);
+    return *ring;
+}
+
+LuringState *aio_setup_linux_io_uring(AioContext *ctx, Error **errp)
+{
+    return aio_setup_luring(ctx, &ctx->linux_io_uring, false, errp);
 }
 
 LuringState *aio_get_linux_io_uring(AioContext *ctx)
@@ -483,6 +494,17 @@ LuringState *aio_get_linux_io_uring(AioContext *ctx)
     assert(ctx->linux_io_uring);
     return ctx->linux_io_uring;
 }
+
+LuringState *aio_setup_linux_io_uring_cmd(AioContext *ctx, Error **errp)
+{
+    return aio_setup_luring(ctx, &ctx->linux_io_uring_cmd, true, errp);
+}
+
+LuringState *aio_get_linux_io_uring_cmd(AioContext *ctx)
+{
+    assert(ctx->linux_io_uring_cmd);
+    return ctx->linux_io_uring_cmd;
+}
 #endif
 
 void aio_notify(AioContext *ctx)
@@ -603,6 +625,7 @@ AioContext *aio_context_new(Error **errp)
 
 #ifdef CONFIG_LINUX_IO_URING
     ctx->linux_io_uring = NULL;
+    ctx->linux_io_uring_cmd = NULL;
 #endif
 
     ctx->thread_pool = NULL;
@@ -27,6 +27,8 @@
 
 #include "qemu/osdep.h"
 #include "qemu/crc32c.h"
+#include "qemu/bswap.h"
+#include "host/cpuinfo.h"
 
 /*
  * This is the CRC-32C table
@@ -104,13 +106,29 @@ static const uint32_t crc32c_table[256] = {
     0xBE2DA0A5L, 0x4C4623A6L, 0x5F16D052L, 0xAD7D5351L
 };
 
+typedef uint32_t (*crc32c_accel_fn)(uint32_t, const uint8_t *, unsigned int);
 
-uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+static uint32_t crc32c_int(uint32_t crc, const uint8_t *data,
+                           unsigned int length)
 {
     while (length--) {
         crc = crc32c_table[(crc ^ *data++) & 0xFFL] ^ (crc >> 8);
     }
-    return crc^0xffffffff;
+    return crc;
+}
+
+#include "host/crc32c.c.inc"
+
+static crc32c_accel_fn crc32c_accel = crc32c_int;
+
+uint32_t crc32c(uint32_t crc, const uint8_t *data, unsigned int length)
+{
+    return crc32c_accel(crc, data, length) ^ 0xffffffff;
+}
+
+static void __attribute__((constructor)) init_crc32c_accel(void)
+{
+    crc32c_accel = crc32c_best_accel();
 }
 
 uint32_t iov_crc32c(uint32_t crc, const struct iovec *iov, size_t iov_cnt)
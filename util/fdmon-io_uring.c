@@ -25,7 +25,12 @@
  *
  * File descriptor monitoring is implemented using the following operations:
  *
- * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.
+ * 1. IORING_OP_POLL_ADD - adds a file descriptor to be monitored.  If the
+ *    kernel supports it, the poll is multishot and stays armed after each
+ *    event, so that ready file descriptors don't need one sqe per event to
+ *    be re-armed.  Multishot polls are level-triggered like one-shot ones,
+ *    because handlers may return before draining their file descriptor
+ *    (e.g. when they run out of budget) and expect to be called again.
  * 2. IORING_OP_POLL_REMOVE - removes a file descriptor being monitored.  When
  *    the poll mask changes for a file descriptor it is first removed and then
  *    re-added with the new poll mask, so this operation is also used as part
@@ -48,6 +53,19 @@
 #include "qemu/rcu_queue.h"
 #include "aio-posix.h"
 
+#ifndef IORING_CQE_F_MORE
+#define IORING_CQE_F_MORE 0 /* liburing without multishot poll support */
+#endif
+
+/*
+ * Multishot polls are edge-triggered without IORING_POLL_ADD_LEVEL, so
+ * only use them together.
+ */
+#if defined(HAVE_IO_URING_PREP_POLL_MULTISHOT) && \
+    defined(IORING_POLL_ADD_LEVEL)
+#define FDMON_IO_URING_MULTISHOT
+#endif
+
 enum {
     FDMON_IO_URING_ENTRIES  = 128, /* sq/cq ring size */
 
@@ -171,7 +189,15 @@ static void add_poll_add_sqe(AioContext *ctx, AioHandler *node)
     struct io_uring_sqe *sqe = get_sqe(ctx);
     int events = poll_events_from_pfd(node->pfd.events);
 
-    io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+#ifdef FDMON_IO_URING_MULTISHOT
+    if (ctx->fdmon_io_uring_multishot) {
+        io_uring_prep_poll_multishot(sqe, node->pfd.fd, events);
+        sqe->len |= IORING_POLL_ADD_LEVEL;
+    } else
+#endif
+    {
+        io_uring_prep_poll_add(sqe, node->pfd.fd, events);
+    }
     io_uring_sqe_set_data(sqe, node);
 }
 
@@ -227,6 +253,7 @@ static bool process_cqe(AioContext *ctx,
                         struct io_uring_cqe *cqe)
 {
     AioHandler *node = io_uring_cqe_get_data(cqe);
+    bool more = cqe->flags & IORING_CQE_F_MORE;
     unsigned flags;
 
     /* poll_timeout and poll_remove have a zero user_data field */
@@ -234,21 +261,48 @@ static bool process_cqe(AioContext *ctx,
         return false;
     }
 
-    /*
-     * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we race
-     * with enqueue() here then we can safely clear the FDMON_IO_URING_REMOVE
-     * bit before IORING_OP_POLL_REMOVE is submitted.
-     */
-    flags = qatomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
-    if (flags & FDMON_IO_URING_REMOVE) {
-        QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node, node_deleted);
+    if (more) {
+        /*
+         * A multishot IORING_OP_POLL_ADD that is still armed.  If the handler
+         * is being deleted, wait for the final cqe that IORING_OP_POLL_REMOVE
+         * generates before freeing it.
+         */
+        if (qatomic_read(&node->flags) & FDMON_IO_URING_REMOVE) {
+            return false;
+        }
+    } else {
+        /*
+         * Deletion can only happen when IORING_OP_POLL_ADD completes.  If we
+         * race with enqueue() here then we can safely clear the
+         * FDMON_IO_URING_REMOVE bit before IORING_OP_POLL_REMOVE is submitted.
+         */
+        flags = qatomic_fetch_and(&node->flags, ~FDMON_IO_URING_REMOVE);
+        if (flags & FDMON_IO_URING_REMOVE) {
+            QLIST_INSERT_HEAD_RCU(&ctx->deleted_aio_handlers, node,
+                                  node_deleted);
+            return false;
+        }
+    }
+
+    if (unlikely(cqe->res == -EINVAL) && ctx->fdmon_io_uring_multishot) {
+        /*
+         * The kernel does not support multishot or level-triggered poll
+         * (Linux < 5.19), use one-shot polls.
+         */
+        ctx->fdmon_io_uring_multishot = false;
+        add_poll_add_sqe(ctx, node);
         return false;
     }
 
     aio_add_ready_handler(ready_list, node, pfd_events_from_poll(cqe->res));
 
-    /* IORING_OP_POLL_ADD is one-shot so we must re-arm it */
-    add_poll_add_sqe(ctx, node);
+    /*
+     * One-shot IORING_OP_POLL_ADD must be re-armed, and so must multishot
+     * ones that the kernel terminated, e.g. on cq ring overflow.
+     */
+    if (!more) {
+        add_poll_add_sqe(ctx, node);
+    }
     return true;
 }
 
@@ -331,6 +385,9 @@ bool fdmon_io_uring_setup(AioContext *ctx)
     }
 
     QSLIST_INIT(&ctx->submit_list);
+#ifdef FDMON_IO_URING_MULTISHOT
+    ctx->fdmon_io_uring_multishot = true;
+#endif
     ctx->fdmon_ops = &fdmon_io_uring_ops;
     return true;
 }
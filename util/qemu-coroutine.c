@@ -23,6 +23,10 @@
 
 enum {
     COROUTINE_POOL_BATCH_MAX_SIZE = 128,
+
+    /* Batches a thread keeps before returning them to the global pool */
+    COROUTINE_LOCAL_POOL_MIN_BATCHES = 2,
+    COROUTINE_LOCAL_POOL_MAX_BATCHES = 16,
 };
 
 /*
@@ -64,9 +68,23 @@ static CoroutinePool global_pool = QSLIST_HEAD_INITIALIZER(global_pool);
 static unsigned int global_pool_size;
 static unsigned int global_pool_max_size = COROUTINE_POOL_BATCH_MAX_SIZE;
 
+/*
+ * Batches that local pools may hold beyond COROUTINE_LOCAL_POOL_MIN_BATCHES,
+ * summed over all threads.  Bounded by global_pool_hard_max_size.
+ */
+static unsigned int local_pool_extra_batches;
+
 QEMU_DEFINE_STATIC_CO_TLS(CoroutinePool, local_pool);
+QEMU_DEFINE_STATIC_CO_TLS(unsigned int, local_pool_batches);
+/* 0 means COROUTINE_LOCAL_POOL_MIN_BATCHES, see local_pool_max_batches() */
+QEMU_DEFINE_STATIC_CO_TLS(unsigned int, local_pool_extra);
 QEMU_DEFINE_STATIC_CO_TLS(Notifier, local_pool_cleanup_notifier);
 
+static unsigned int local_pool_max_batches(void)
+{
+    return COROUTINE_LOCAL_POOL_MIN_BATCHES + get_local_pool_extra();
+}
+
 static CoroutinePoolBatch *coroutine_pool_batch_new(void)
 {
     CoroutinePoolBatch *batch = g_new(CoroutinePoolBatch, 1);
@@ -98,6 +116,10 @@ static void local_pool_cleanup(Notifier *n, void *value)
         QSLIST_REMOVE_HEAD(local_pool, next);
         coroutine_pool_batch_delete(batch);
     }
+    set_local_pool_batches(0);
+
+    qatomic_sub(&local_pool_extra_batches, get_local_pool_extra());
+    set_local_pool_extra(0);
 }
 
 /* Ensure the atexit notifier is registered */
@@ -128,6 +150,7 @@ static Coroutine *coroutine_pool_get_local(void)
     if (batch->size == 0) {
         QSLIST_REMOVE_HEAD(local_pool, next);
         coroutine_pool_batch_delete(batch);
+        set_local_pool_batches(get_local_pool_batches() - 1);
     }
     return co;
 }
@@ -149,10 +172,38 @@ static void coroutine_pool_refill_local(void)
 
     if (batch) {
         QSLIST_INSERT_HEAD(local_pool, batch, next);
+        set_local_pool_batches(get_local_pool_batches() + 1);
         local_pool_cleanup_init_once();
     }
 }
 
+/*
+ * Called when a coroutine had to be allocated because both the local and
+ * the global pool were empty.  Under bursty load, let the thread keep more
+ * coroutines in its local pool, so that the next burst reuses them instead
+ * of going through the global pool lock or mapping new stacks.
+ */
+static void coroutine_pool_grow_local(void)
+{
+    unsigned int extra = get_local_pool_extra();
+    unsigned int total;
+
+    if (COROUTINE_LOCAL_POOL_MIN_BATCHES + extra >=
+        COROUTINE_LOCAL_POOL_MAX_BATCHES) {
+        return;
+    }
+
+    /* Pooled coroutines count against the VMA limit, like the global pool */
+    total = qatomic_fetch_inc(&local_pool_extra_batches) + 1;
+    if (total > global_pool_hard_max_size / 2 / COROUTINE_POOL_BATCH_MAX_SIZE) {
+        qatomic_dec(&local_pool_extra_batches);
+        return;
+    }
+
+    set_local_pool_extra(extra + 1);
+    local_pool_cleanup_init_once();
+}
+
 /* Add a batch of coroutines to the global pool */
 static void coroutine_pool_put_global(CoroutinePoolBatch *batch)
 {
@@ -194,16 +245,17 @@ static void coroutine_pool_put(Coroutine *co)
     if (unlikely(!batch)) {
         batch = coroutine_pool_batch_new();
         QSLIST_INSERT_HEAD(local_pool, batch, next);
+        set_local_pool_batches(1);
         local_pool_cleanup_init_once();
     }
 
     if (unlikely(batch->size >= COROUTINE_POOL_BATCH_MAX_SIZE)) {
-        CoroutinePoolBatch *next = QSLIST_NEXT(batch, next);
-
         /* Is the local pool full? */
-        if (next) {
+        if (get_local_pool_batches() >= local_pool_max_batches()) {
             QSLIST_REMOVE_HEAD(local_pool, next);
             coroutine_pool_put_global(batch);
+        } else {
+            set_local_pool_batches(get_local_pool_batches() + 1);
         }
 
         batch = coroutine_pool_batch_new();
@@ -223,6 +275,9 @@ Coroutine *qemu_coroutine_create(CoroutineEntry *entry, void *opaque)
     }
 
     if (!co) {
+        if (IS_ENABLED(CONFIG_COROUTINE_POOL)) {
+            coroutine_pool_grow_local();
+        }
         co = qemu_coroutine_new();
     }
 
@@ -22,8 +22,8 @@
  * - Writes (i.e. insertions/removals) can be concurrent with writes to
  *   different buckets; writes to the same bucket are serialized through a lock.
  * - Optional auto-resizing: the hash table resizes up if the load surpasses
- *   a certain threshold. Resizing is done concurrently with readers; writes
- *   are serialized with the resize operation.
+ *   a certain threshold. Resizing is done concurrently with both readers and
+ *   writers; entries are moved into the new map one head bucket at a time.
  *
  * The key structure is the bucket, which is cacheline-sized. Buckets
  * contain a few hash values and pointers; the u32 hash values are stored in
@@ -43,15 +43,27 @@
  * just-removed entry. This makes lookups slightly faster, since the moment an
  * invalid entry is found, the (failed) lookup is over.
  *
- * Resizing is done by taking all bucket spinlocks (so that no other writers can
- * race with us) and then copying all entries into a new hash map. Then, the
- * ht->map pointer is set, and the old map is freed once no RCU readers can see
- * it anymore.
+ * Resizing sets ht->map to an empty map whose @old field points to the
+ * previous map. Head buckets of the old map are then moved lazily: a writer
+ * first moves the old head bucket that its hash maps to, and every update
+ * moves a few more buckets so that the resize eventually completes. While
+ * the resize is in progress, lookups check the old head bucket (unless it was
+ * already moved) before the new one. Once all buckets are moved, the old map
+ * is freed when no RCU readers can see it anymore.
+ *
+ * A head bucket is moved with its lock held: its entries are inserted into
+ * the new map, the bucket is marked as moved, and only then it is emptied,
+ * so that each entry is visible to lookups in at least one of the two maps.
+ * Writers of the new map never take a lock of the old map while holding one
+ * of the new map, so old map locks are always taken first.
  *
  * Writers check for concurrent resizes by comparing ht->map before and after
  * acquiring their bucket lock. If they don't match, a resize has occurred
  * while the bucket spinlock was being acquired.
  *
+ * Resets (qht_reset, qht_reset_size) and iterators first complete any
+ * resize in progress, and then take all bucket locks of the map.
+ *
  * Related Work:
  * - Idea of cacheline-sized buckets with full hashes taken from:
  *   David, Guerraoui & Trigonakis, "Asynchronized Concurrency:
@@ -70,6 +82,7 @@
 #include "qemu/atomic.h"
 #include "qemu/rcu.h"
 #include "qemu/memalign.h"
+#include "qemu/bitmap.h"
 
 //#define QHT_DEBUG
 
@@ -167,6 +180,15 @@ struct qht_tsan_lock {
     QemuSpin lock;
 } QEMU_ALIGNED(QHT_BUCKET_ALIGN);
 
+/*
+ * Contention counters of a head bucket. They do not fit in struct qht_bucket,
+ * so they are kept in a separate array; they are only updated in slow paths.
+ */
+struct qht_bucket_stats {
+    unsigned int lookup_retries;
+    unsigned int lock_contended;
+};
+
 /**
  * struct qht_map - structure to track an array of buckets
  * @rcu: used by RCU. Keep it as the top field in the struct to help valgrind
@@ -176,6 +198,14 @@ struct qht_tsan_lock {
  * @n_added_buckets: number of added (i.e. "non-head") buckets
  * @n_added_buckets_threshold: threshold to trigger an upward resize once the
  *                             number of added buckets surpasses it.
+ * @bucket_stats: per head bucket contention counters.
+ * @old: map being resized into this one, or NULL. Set to NULL (under
+ *       ht->lock) once all of its head buckets have been moved.
+ * @moved: for a map being resized from, bitmap of the head buckets that have
+ *         been moved to the new map.
+ * @n_moved: for a map being resized from, number of bits set in @moved.
+ * @move_next: for a map being resized from, next head bucket to be moved
+ *             by qht_map_move_some().
  * @tsan_bucket_locks: Array of striped locks to be used only under TSAN.
  *
  * Buckets are tracked in what we call a "map", i.e. this structure.
@@ -186,6 +216,11 @@ struct qht_map {
     size_t n_buckets;
     size_t n_added_buckets;
     size_t n_added_buckets_threshold;
+    struct qht_bucket_stats *bucket_stats;
+    struct qht_map *old;
+    unsigned long *moved;
+    size_t n_moved;
+    size_t move_next;
 #ifdef CONFIG_TSAN
     struct qht_tsan_lock tsan_bucket_locks[QHT_TSAN_BUCKET_LOCKS];
 #endif
@@ -194,9 +229,17 @@ struct qht_map {
 /* trigger a resize when n_added_buckets > n_buckets / div */
 #define QHT_NR_ADDED_BUCKETS_THRESHOLD_DIV 8
 
+/* number of old head buckets that each update moves during a resize */
+#define QHT_MOVE_BATCH 4
+
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new,
                                 bool reset);
 static void qht_grow_maybe(struct qht *ht);
+static void qht_map_destroy(struct qht_map *map);
+static void *qht_insert__locked(const struct qht *ht, struct qht_map *map,
+                                struct qht_bucket *head, void *p, uint32_t hash,
+                                bool *needs_resize);
+static void qht_bucket_reset__locked(struct qht_bucket *head);
 
 #ifdef QHT_DEBUG
 
@@ -270,29 +313,33 @@ static inline void qht_do_if_first_in_stripe(struct qht_map *map,
 #endif
 }
 
-static inline void qht_bucket_lock_do(struct qht_map *map,
-                                      struct qht_bucket *b,
-                                      void (*func)(QemuSpin *lock))
+static inline QemuSpin *qht_bucket_to_lock(struct qht_map *map,
+                                           struct qht_bucket *b)
 {
 #ifdef CONFIG_TSAN
     unsigned long bucket_idx = b - map->buckets;
     unsigned long lock_idx = bucket_idx & (QHT_TSAN_BUCKET_LOCKS - 1);
-    func(&map->tsan_bucket_locks[lock_idx].lock);
+    return &map->tsan_bucket_locks[lock_idx].lock;
 #else
-    func(&b->lock);
+    return &b->lock;
 #endif
 }
 
 static inline void qht_bucket_lock(struct qht_map *map,
                                    struct qht_bucket *b)
 {
-    qht_bucket_lock_do(map, b, qemu_spin_lock);
+    QemuSpin *lock = qht_bucket_to_lock(map, b);
+
+    if (unlikely(qemu_spin_trylock(lock))) {
+        qatomic_inc(&map->bucket_stats[b - map->buckets].lock_contended);
+        qemu_spin_lock(lock);
+    }
 }
 
 static inline void qht_bucket_unlock(struct qht_map *map,
                                      struct qht_bucket *b)
 {
-    qht_bucket_lock_do(map, b, qemu_spin_unlock);
+    qemu_spin_unlock(qht_bucket_to_lock(map, b));
 }
 
 static inline void qht_head_init(struct qht_map *map, struct qht_bucket *b)
@@ -341,6 +388,150 @@ static inline bool qht_map_is_stale__locked(const struct qht *ht,
     return map != ht->map;
 }
 
+static inline bool qht_map_bucket_moved(const struct qht_map *old, size_t idx)
+{
+    unsigned long word = qatomic_load_acquire(&old->moved[BIT_WORD(idx)]);
+
+    return word & BIT_MASK(idx);
+}
+
+/*
+ * Move head bucket @idx of @old, the map that @map is being resized from,
+ * into @map.
+ *
+ * Note: callers cannot hold any bucket lock.
+ */
+static void qht_map_move_bucket(const struct qht *ht, struct qht_map *map,
+                                struct qht_map *old, size_t idx)
+{
+    struct qht_bucket *head = &old->buckets[idx];
+    struct qht_bucket *b = head;
+    int i;
+
+    qht_bucket_lock(old, head);
+    if (qht_map_bucket_moved(old, idx)) {
+        /* another thread beat us to it */
+        qht_bucket_unlock(old, head);
+        return;
+    }
+
+    do {
+        for (i = 0; i < QHT_BUCKET_ENTRIES; i++) {
+            struct qht_bucket *to;
+
+            if (b->pointers[i] == NULL) {
+                goto done;
+            }
+            to = qht_map_to_bucket(map, b->hashes[i]);
+            qht_bucket_lock(map, to);
+            qht_insert__locked(ht, map, to, b->pointers[i], b->hashes[i],
+                               NULL);
+            qht_bucket_unlock(map, to);
+        }
+        b = b->next;
+    } while (b);
+ done:
+    /*
+     * The entries are now in @map; publish that before removing them from
+     * here. Count the bucket first, so that qht_map_finish_resize__locked()
+     * can rely on @n_moved once it sees all bits set.
+     */
+    qatomic_inc(&old->n_moved);
+    set_bit_atomic(idx, old->moved);
+    qht_bucket_reset__locked(head);
+    qht_bucket_unlock(old, head);
+}
+
+/*
+ * Make sure that the old head bucket for @hash, if any, has been moved into
+ * @map, so that @map's head bucket for @hash can be updated.
+ *
+ * Note: callers cannot hold any bucket lock.
+ */
+static inline
+void qht_map_move_hash(const struct qht *ht, struct qht_map *map, uint32_t hash)
+{
+    struct qht_map *old = qatomic_rcu_read(&map->old);
+    size_t idx;
+
+    if (likely(old == NULL)) {
+        return;
+    }
+    idx = hash & (old->n_buckets - 1);
+    if (!qht_map_bucket_moved(old, idx)) {
+        qht_map_move_bucket(ht, map, old, idx);
+    }
+}
+
+/*
+ * Free @map->old if all of its buckets have been moved.
+ * Call with ht->lock held.
+ */
+static void qht_map_end_resize__locked(struct qht_map *map)
+{
+    struct qht_map *old = map->old;
+
+    if (old && qatomic_read(&old->n_moved) == old->n_buckets) {
+        qatomic_rcu_set(&map->old, NULL);
+        call_rcu(old, qht_map_destroy, rcu);
+    }
+}
+
+/*
+ * Move all remaining head buckets of the map that @map is being resized from.
+ * Call with ht->lock held, which guarantees that the resize completes.
+ */
+static void qht_map_finish_resize__locked(struct qht *ht, struct qht_map *map)
+{
+    struct qht_map *old = map->old;
+    size_t i;
+
+    if (old == NULL) {
+        return;
+    }
+    for (i = 0; i < old->n_buckets; i++) {
+        if (!qht_map_bucket_moved(old, i)) {
+            qht_map_move_bucket(ht, map, old, i);
+        }
+    }
+    g_assert(qatomic_read(&old->n_moved) == old->n_buckets);
+    qht_map_end_resize__locked(map);
+}
+
+/*
+ * Make progress on a resize in progress, so that it completes even if some
+ * head buckets are never written to.
+ *
+ * Note: callers cannot hold any bucket lock, nor ht->lock.
+ */
+static __attribute__((noinline))
+void qht_map_move_some(struct qht *ht, struct qht_map *map)
+{
+    struct qht_map *old = qatomic_rcu_read(&map->old);
+    int i;
+
+    if (old == NULL) {
+        return;
+    }
+    for (i = 0; i < QHT_MOVE_BATCH; i++) {
+        size_t idx = qatomic_fetch_inc(&old->move_next);
+
+        if (idx >= old->n_buckets) {
+            break;
+        }
+        if (!qht_map_bucket_moved(old, idx)) {
+            qht_map_move_bucket(ht, map, old, idx);
+        }
+    }
+    /* if the lock is taken, whoever holds it will end the resize */
+    if (qatomic_read(&old->n_moved) == old->n_buckets && !qht_trylock(ht)) {
+        if (ht->map == map) {
+            qht_map_end_resize__locked(map);
+        }
+        qht_unlock(ht);
+    }
+}
+
 /*
  * Grab all bucket locks, and set @pmap after making sure the map isn't stale.
  *
@@ -354,16 +545,23 @@ void qht_map_lock_buckets__no_stale(struct qht *ht, struct qht_map **pmap)
     struct qht_map *map;
 
     map = qatomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
-    if (likely(!qht_map_is_stale__locked(ht, map))) {
-        *pmap = map;
-        return;
+    if (likely(qatomic_read(&map->old) == NULL)) {
+        qht_map_lock_buckets(map);
+        if (likely(!qht_map_is_stale__locked(ht, map))) {
+            *pmap = map;
+            return;
+        }
+        qht_map_unlock_buckets(map);
     }
-    qht_map_unlock_buckets(map);
 
-    /* we raced with a resize; acquire ht->lock to see the updated ht->map */
+    /*
+     * We raced with a resize, or one is in progress; acquire ht->lock to see
+     * the updated ht->map and to complete the resize. A resize that starts
+     * after we release ht->lock cannot move any bucket until we are done.
+     */
     qht_lock(ht);
     map = ht->map;
+    qht_map_finish_resize__locked(ht, map);
     qht_map_lock_buckets(map);
     qht_unlock(ht);
     *pmap = map;
@@ -386,6 +584,7 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     struct qht_map *map;
 
     map = qatomic_rcu_read(&ht->map);
+    qht_map_move_hash(ht, map, hash);
     b = qht_map_to_bucket(map, hash);
 
     qht_bucket_lock(map, b);
@@ -398,6 +597,7 @@ struct qht_bucket *qht_bucket_lock__no_stale(struct qht *ht, uint32_t hash,
     /* we raced with a resize; acquire ht->lock to see the updated ht->map */
     qht_lock(ht);
     map = ht->map;
+    qht_map_move_hash(ht, map, hash);
     b = qht_map_to_bucket(map, hash);
     qht_bucket_lock(map, b);
     qht_unlock(ht);
@@ -430,10 +630,16 @@ static void qht_map_destroy(struct qht_map *map)
 {
     size_t i;
 
+    /* only qht_destroy() can get here with a resize in progress */
+    if (map->old) {
+        qht_map_destroy(map->old);
+    }
     for (i = 0; i < map->n_buckets; i++) {
         qht_chain_destroy(map, &map->buckets[i]);
     }
     qemu_vfree(map->buckets);
+    g_free(map->bucket_stats);
+    g_free(map->moved);
     g_free(map);
 }
 
@@ -442,8 +648,9 @@ static struct qht_map *qht_map_create(size_t n_buckets)
     struct qht_map *map;
     size_t i;
 
-    map = g_malloc(sizeof(*map));
+    map = g_malloc0(sizeof(*map));
     map->n_buckets = n_buckets;
+    map->bucket_stats = g_new0(struct qht_bucket_stats, n_buckets);
 
     map->n_added_buckets = 0;
     map->n_added_buckets_threshold = n_buckets /
@@ -580,19 +787,50 @@ void *qht_do_lookup(const struct qht_bucket *head, qht_lookup_func_t func,
 }
 
 static __attribute__((noinline))
-void *qht_lookup__slowpath(const struct qht_bucket *b, qht_lookup_func_t func,
+void *qht_lookup__slowpath(const struct qht_map *map,
+                           const struct qht_bucket *b, qht_lookup_func_t func,
                            const void *userp, uint32_t hash)
 {
+    unsigned int *retries = &map->bucket_stats[b - map->buckets].lookup_retries;
     unsigned int version;
     void *ret;
 
     do {
+        qatomic_inc(retries);
         version = seqlock_read_begin(&b->sequence);
         ret = qht_do_lookup(b, func, userp, hash);
     } while (seqlock_read_retry(&b->sequence, version));
     return ret;
 }
 
+/* look up @hash in the map that @map is being resized from, if any */
+static __attribute__((noinline))
+void *qht_lookup__old(const struct qht_map *map, qht_lookup_func_t func,
+                      const void *userp, uint32_t hash)
+{
+    const struct qht_map *old = qatomic_rcu_read(&map->old);
+    const struct qht_bucket *b;
+    unsigned int version;
+    size_t idx;
+    void *ret;
+
+    if (old == NULL) {
+        return NULL;
+    }
+    idx = hash & (old->n_buckets - 1);
+    if (qht_map_bucket_moved(old, idx)) {
+        return NULL;
+    }
+    b = &old->buckets[idx];
+
+    version = seqlock_read_begin(&b->sequence);
+    ret = qht_do_lookup(b, func, userp, hash);
+    if (likely(!seqlock_read_retry(&b->sequence, version))) {
+        return ret;
+    }
+    return qht_lookup__slowpath(old, b, func, userp, hash);
+}
+
 void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
                         qht_lookup_func_t func)
 {
@@ -602,6 +840,12 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
     void *ret;
 
     map = qatomic_rcu_read(&ht->map);
+    if (unlikely(qatomic_read(&map->old))) {
+        ret = qht_lookup__old(map, func, userp, hash);
+        if (ret) {
+            return ret;
+        }
+    }
     b = qht_map_to_bucket(map, hash);
 
     version = seqlock_read_begin(&b->sequence);
@@ -613,7 +857,7 @@ void *qht_lookup_custom(const struct qht *ht, const void *userp, uint32_t hash,
      * Removing the do/while from the fastpath gives a 4% perf. increase when
      * running a 100%-lookup microbenchmark.
      */
-    return qht_lookup__slowpath(b, func, userp, hash);
+    return qht_lookup__slowpath(map, b, func, userp, hash);
 }
 
 void *qht_lookup(const struct qht *ht, const void *userp, uint32_t hash)
@@ -707,6 +951,10 @@ bool qht_insert(struct qht *ht, void *p, uint32_t hash, void **existing)
     qht_bucket_debug__locked(b);
     qht_bucket_unlock(map, b);
 
+    if (unlikely(qatomic_read(&map->old))) {
+        qht_map_move_some(ht, map);
+    }
+
     if (unlikely(needs_resize) && ht->mode & QHT_MODE_AUTO_RESIZE) {
         qht_grow_maybe(ht);
     }
@@ -817,6 +1065,10 @@ bool qht_remove(struct qht *ht, const void *p, uint32_t hash)
     ret = qht_remove__locked(b, p, hash);
     qht_bucket_debug__locked(b);
     qht_bucket_unlock(map, b);
+
+    if (unlikely(qatomic_read(&map->old))) {
+        qht_map_move_some(ht, map);
+    }
     return ret;
 }
 
@@ -872,8 +1124,7 @@ do_qht_iter(struct qht *ht, const struct qht_iter *iter, void *userp)
 {
     struct qht_map *map;
 
-    map = qatomic_rcu_read(&ht->map);
-    qht_map_lock_buckets(map);
+    qht_map_lock_buckets__no_stale(ht, &map);
     qht_map_iter__all_locked(map, iter, userp);
     qht_map_unlock_buckets(map);
 }
@@ -898,36 +1149,27 @@ void qht_iter_remove(struct qht *ht, qht_iter_bool_func_t func, void *userp)
     do_qht_iter(ht, &iter, userp);
 }
 
-struct qht_map_copy_data {
-    struct qht *ht;
-    struct qht_map *new;
-};
-
-static void qht_map_copy(void *p, uint32_t hash, void *userp)
-{
-    struct qht_map_copy_data *data = userp;
-    struct qht *ht = data->ht;
-    struct qht_map *new = data->new;
-    struct qht_bucket *b = qht_map_to_bucket(new, hash);
-
-    /* no need to acquire b->lock because no thread has seen this map yet */
-    qht_insert__locked(ht, new, b, p, hash, NULL);
-}
-
 /*
- * Atomically perform a resize and/or reset.
+ * Perform a resize and/or reset. A reset is atomic; a resize without reset
+ * only starts here, and its entries are moved lazily into @new.
  * Call with ht->lock held.
  */
 static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
 {
     struct qht_map *old;
-    const struct qht_iter iter = {
-        .f.retvoid = qht_map_copy,
-        .type = QHT_ITER_VOID,
-    };
-    struct qht_map_copy_data data;
 
     old = ht->map;
+    /* there can only be one resize in progress */
+    qht_map_finish_resize__locked(ht, old);
+
+    if (new && !reset) {
+        g_assert(new->n_buckets != old->n_buckets);
+        old->moved = bitmap_new(old->n_buckets);
+        new->old = old;
+        qatomic_rcu_set(&ht->map, new);
+        return;
+    }
+
     qht_map_lock_buckets(old);
 
     if (reset) {
@@ -939,12 +1181,8 @@ static void qht_do_resize_reset(struct qht *ht, struct qht_map *new, bool reset)
         return;
     }
 
+    /* @old is empty now, so there is nothing to move into @new */
     g_assert(new->n_buckets != old->n_buckets);
-    data.ht = ht;
-    data.new = new;
-    qht_map_iter__all_locked(old, &iter, &data);
-    qht_map_debug__all_locked(new);
-
     qatomic_rcu_set(&ht->map, new);
     qht_map_unlock_buckets(old);
     call_rcu(old, qht_map_destroy, rcu);
@@ -968,18 +1206,53 @@ bool qht_resize(struct qht *ht, size_t n_elems)
     return ret;
 }
 
+static void qht_chain_count(const struct qht_bucket *head, size_t *pbuckets,
+                            size_t *pentries)
+{
+    const struct qht_bucket *b;
+    unsigned int version;
+    size_t buckets;
+    size_t entries;
+    int j;
+
+    do {
+        version = seqlock_read_begin(&head->sequence);
+        buckets = 0;
+        entries = 0;
+        b = head;
+        do {
+            for (j = 0; j < QHT_BUCKET_ENTRIES; j++) {
+                if (qatomic_read(&b->pointers[j]) == NULL) {
+                    break;
+                }
+                entries++;
+            }
+            buckets++;
+            b = qatomic_rcu_read(&b->next);
+        } while (b);
+    } while (seqlock_read_retry(&head->sequence, version));
+
+    *pbuckets = buckets;
+    *pentries = entries;
+}
+
 /* pass @stats to qht_statistics_destroy() when done */
 void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
 {
     const struct qht_map *map;
+    const struct qht_map *old;
     int i;
 
     map = qatomic_rcu_read(&ht->map);
 
     stats->used_head_buckets = 0;
     stats->entries = 0;
+    stats->resize_pending = 0;
+    stats->lookup_retries = 0;
+    stats->lock_contended = 0;
     qdist_init(&stats->chain);
     qdist_init(&stats->occupancy);
+    qdist_init(&stats->contention);
     /* bail out if the qht has not yet been initialized */
     if (unlikely(map == NULL)) {
         stats->head_buckets = 0;
@@ -989,29 +1262,19 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
 
     for (i = 0; i < map->n_buckets; i++) {
         const struct qht_bucket *head = &map->buckets[i];
-        const struct qht_bucket *b;
-        unsigned int version;
+        const struct qht_bucket_stats *bs = &map->bucket_stats[i];
+        unsigned int retries = qatomic_read(&bs->lookup_retries);
+        unsigned int contended = qatomic_read(&bs->lock_contended);
         size_t buckets;
         size_t entries;
-        int j;
 
-        do {
-            version = seqlock_read_begin(&head->sequence);
-            buckets = 0;
-            entries = 0;
-            b = head;
-            do {
-                for (j = 0; j < QHT_BUCKET_ENTRIES; j++) {
-                    if (qatomic_read(&b->pointers[j]) == NULL) {
-                        break;
-                    }
-                    entries++;
-                }
-                buckets++;
-                b = qatomic_rcu_read(&b->next);
-            } while (b);
-        } while (seqlock_read_retry(&head->sequence, version));
+        stats->lookup_retries += retries;
+        stats->lock_contended += contended;
+        if (retries + contended) {
+            qdist_inc(&stats->contention, retries + contended);
+        }
 
+        qht_chain_count(head, &buckets, &entries);
         if (entries) {
             qdist_inc(&stats->chain, buckets);
             qdist_inc(&stats->occupancy,
@@ -1022,10 +1285,27 @@ void qht_statistics_init(const struct qht *ht, struct qht_stats *stats)
             qdist_inc(&stats->occupancy, 0);
         }
     }
+
+    /* entries not yet moved by a resize in progress are still entries */
+    old = qatomic_rcu_read(&map->old);
+    if (old) {
+        for (i = 0; i < old->n_buckets; i++) {
+            size_t buckets;
+            size_t entries;
+
+            if (qht_map_bucket_moved(old, i)) {
+                continue;
+            }
+            qht_chain_count(&old->buckets[i], &buckets, &entries);
+            stats->entries += entries;
+            stats->resize_pending++;
+        }
+    }
 }
 
 void qht_statistics_destroy(struct qht_stats *stats)
 {
+    qdist_destroy(&stats->contention);
     qdist_destroy(&stats->occupancy);
     qdist_destroy(&stats->chain);
 }
@@ -32,6 +32,9 @@
 #include "qemu/thread.h"
 #include "qemu/main-loop.h"
 #include "qemu/lockable.h"
+#include "qemu/timer.h"
+#include "qemu/stats64.h"
+#include "trace.h"
 #if defined(CONFIG_MALLOC_TRIM)
 #include <malloc.h>
 #endif
@@ -47,6 +50,7 @@ unsigned long rcu_gp_ctr = RCU_GP_LOCKED;
 
 QemuEvent rcu_gp_event;
 static int in_drain_call_rcu;
+static int rcu_call_expedite;
 static QemuMutex rcu_registry_lock;
 static QemuMutex rcu_sync_lock;
 
@@ -106,7 +110,8 @@ static void wait_for_readers(void)
                  * get some extra futex wakeups.
                  */
                 qatomic_set(&index->waiting, false);
-            } else if (qatomic_read(&in_drain_call_rcu)) {
+            } else if (qatomic_read(&in_drain_call_rcu) ||
+                       qatomic_read(&rcu_call_expedite)) {
                 notifier_list_notify(&index->force_rcu, NULL);
             }
         }
@@ -176,14 +181,37 @@ void synchronize_rcu(void)
 
 #define RCU_CALL_MIN_SIZE        30
 
-/* Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
+/*
+ * A backlog this large runs without waiting for more callbacks, and forces
+ * readers out of their critical sections like drain_call_rcu() does.
+ */
+#define RCU_CALL_EXPEDITE_SIZE   1000
+
+/*
+ * Callbacks from registered threads go to a per-thread stack in their
+ * rcu_reader_data, so that call_rcu1() does not bounce a global cache line
+ * between threads.  Unregistered threads, and threads that unregister with
+ * callbacks still queued, use the global queue below.
+ *
+ * Multi-producer, single-consumer queue based on urcu/static/wfqueue.h
  * from liburcu.  Note that head is only used by the consumer.
  */
 static struct rcu_head dummy;
 static struct rcu_head *head = &dummy, **tail = &dummy.next;
-static int rcu_call_count;
+static unsigned long rcu_call_count;
+static int64_t rcu_call_since;
 static QemuEvent rcu_call_ready_event;
 
+/* Updated by the call_rcu thread only */
+static struct {
+    Stat64 batches;
+    Stat64 expedited_batches;
+    Stat64 callbacks;
+    Stat64 max_batch;
+    Stat64 last_latency_ns;
+    Stat64 max_latency_ns;
+} rcu_stats;
+
 static void enqueue(struct rcu_head *node)
 {
     struct rcu_head **old_tail;
@@ -252,25 +280,128 @@ retry:
     return node;
 }
 
-static void *call_rcu_thread(void *opaque)
+/*
+ * Take the callbacks queued by @reader, oldest first.  Call with
+ * rcu_registry_lock held, unless @reader is the current thread's.
+ */
+static unsigned long rcu_reader_take_callbacks(struct rcu_reader_data *reader,
+                                               struct rcu_head **pfirst,
+                                               struct rcu_head **plast)
+{
+    struct rcu_head *node, *next, *list = NULL;
+    unsigned long n = 0;
+
+    /*
+     * Reset the count before taking the stack.  call_rcu1() pushes before
+     * counting, so a callback can be counted twice but never lost.
+     */
+    if (!qatomic_xchg(&reader->cb_count, 0)) {
+        return 0;
+    }
+
+    node = qatomic_xchg(&reader->cb_top, NULL);
+    *plast = node;
+    while (node) {
+        next = node->next;
+        node->next = list;
+        list = node;
+        node = next;
+        n++;
+    }
+    *pfirst = list;
+    return n;
+}
+
+/* Number of callbacks waiting for the call_rcu thread */
+static unsigned long rcu_call_pending(void)
 {
+    struct rcu_reader_data *index;
+    unsigned long n = qatomic_read(&rcu_call_count);
+
+    QEMU_LOCK_GUARD(&rcu_registry_lock);
+    QLIST_FOREACH(index, &registry, node) {
+        n += qatomic_read(&index->cb_count);
+    }
+    return n;
+}
+
+/*
+ * Collect the callbacks queued so far into a list, which is also the order
+ * in which they will run.  Only these must wait for the next grace period.
+ */
+static unsigned long rcu_call_collect(struct rcu_head **plist, int64_t *since)
+{
+    struct rcu_reader_data *index;
+    struct rcu_head **ptail = plist;
     struct rcu_head *node;
+    unsigned long n = 0;
+
+    *since = INT64_MAX;
+    while ((node = try_dequeue())) {
+        *ptail = node;
+        ptail = &node->next;
+        n++;
+    }
+    if (n) {
+        *since = qatomic_read_i64(&rcu_call_since);
+        qatomic_sub(&rcu_call_count, n);
+    }
+
+    /*
+     * synchronize_rcu() takes registry entries out of the list while it
+     * waits, so take rcu_sync_lock as well to see all of them.
+     */
+    QEMU_LOCK_GUARD(&rcu_sync_lock);
+    QEMU_LOCK_GUARD(&rcu_registry_lock);
+    QLIST_FOREACH(index, &registry, node) {
+        struct rcu_head *first, *last;
+        unsigned long m;
+
+        m = rcu_reader_take_callbacks(index, &first, &last);
+        if (m) {
+            *ptail = first;
+            ptail = &last->next;
+            *since = MIN(*since, qatomic_read_i64(&index->cb_since));
+            n += m;
+        }
+    }
+    *ptail = NULL;
+    return n;
+}
+
+static void rcu_call_account(unsigned long n, bool expedited, int64_t since)
+{
+    int64_t latency_ns = MAX(get_clock() - since, 0);
+
+    stat64_add(&rcu_stats.batches, 1);
+    stat64_add(&rcu_stats.callbacks, n);
+    if (expedited) {
+        stat64_add(&rcu_stats.expedited_batches, 1);
+    }
+    stat64_max(&rcu_stats.max_batch, n);
+    stat64_set(&rcu_stats.last_latency_ns, latency_ns);
+    stat64_max(&rcu_stats.max_latency_ns, latency_ns);
+    trace_call_rcu_batch(n, expedited, latency_ns);
+}
+
+static void *call_rcu_thread(void *opaque)
+{
+    struct rcu_head *node, *next;
 
     rcu_register_thread();
 
     for (;;) {
         int tries = 0;
-        int n = qatomic_read(&rcu_call_count);
+        unsigned long n = rcu_call_pending();
+        bool expedited;
+        int64_t since;
 
-        /* Heuristically wait for a decent number of callbacks to pile up.
-         * Fetch rcu_call_count now, we only must process elements that were
-         * added before synchronize_rcu() starts.
-         */
+        /* Heuristically wait for a decent number of callbacks to pile up.  */
         while (n == 0 || (n < RCU_CALL_MIN_SIZE && ++tries <= 5)) {
             g_usleep(10000);
             if (n == 0) {
                 qemu_event_reset(&rcu_call_ready_event);
-                n = qatomic_read(&rcu_call_count);
+                n = rcu_call_pending();
                 if (n == 0) {
 #if defined(CONFIG_MALLOC_TRIM)
                     malloc_trim(4 * 1024 * 1024);
@@ -278,39 +409,91 @@ static void *call_rcu_thread(void *opaque)
                     qemu_event_wait(&rcu_call_ready_event);
                 }
             }
-            n = qatomic_read(&rcu_call_count);
+            n = rcu_call_pending();
         }
 
-        qatomic_sub(&rcu_call_count, n);
+        n = rcu_call_collect(&node, &since);
+        if (n == 0) {
+            /* all of them were counted twice, see rcu_reader_take_callbacks */
+            continue;
+        }
+
+        expedited = n >= RCU_CALL_EXPEDITE_SIZE;
+        if (expedited) {
+            qatomic_inc(&rcu_call_expedite);
+        }
         synchronize_rcu();
-        bql_lock();
-        while (n > 0) {
-            node = try_dequeue();
-            while (!node) {
-                bql_unlock();
-                qemu_event_reset(&rcu_call_ready_event);
-                node = try_dequeue();
-                if (!node) {
-                    qemu_event_wait(&rcu_call_ready_event);
-                    node = try_dequeue();
-                }
-                bql_lock();
-            }
+        if (expedited) {
+            qatomic_dec(&rcu_call_expedite);
+        }
 
-            n--;
+        bql_lock();
+        while (node) {
+            next = node->next;
             node->func(node);
+            node = next;
         }
         bql_unlock();
+        rcu_call_account(n, expedited, since);
     }
     abort();
 }
 
+static void call_rcu_enqueue_global(struct rcu_head *first,
+                                    struct rcu_head *last, unsigned long n)
+{
+    struct rcu_head **old_tail;
+
+    /* Same as enqueue(), for a whole chain */
+    last->next = NULL;
+    old_tail = qatomic_xchg(&tail, &last->next);
+    qatomic_store_release(old_tail, first);
+
+    if (qatomic_fetch_add(&rcu_call_count, n) == 0) {
+        qatomic_set_i64(&rcu_call_since, get_clock());
+    }
+    qemu_event_set(&rcu_call_ready_event);
+}
+
 void call_rcu1(struct rcu_head *node, void (*func)(struct rcu_head *node))
 {
+    struct rcu_reader_data *p_rcu_reader = get_ptr_rcu_reader();
+    struct rcu_head *old, *cur;
+
     node->func = func;
-    enqueue(node);
-    qatomic_inc(&rcu_call_count);
-    qemu_event_set(&rcu_call_ready_event);
+    if (!p_rcu_reader->registered) {
+        call_rcu_enqueue_global(node, node, 1);
+        return;
+    }
+
+    /* Only the call_rcu thread takes from the stack, and all of it at once */
+    old = qatomic_read(&p_rcu_reader->cb_top);
+    for (;;) {
+        node->next = old;
+        cur = qatomic_cmpxchg(&p_rcu_reader->cb_top, old, node);
+        if (cur == old) {
+            break;
+        }
+        old = cur;
+    }
+
+    if (old == NULL) {
+        qatomic_set_i64(&p_rcu_reader->cb_since, get_clock());
+    }
+    if (qatomic_fetch_inc(&p_rcu_reader->cb_count) == 0) {
+        qemu_event_set(&rcu_call_ready_event);
+    }
+}
+
+void rcu_call_stats(RCUCallStats *stats)
+{
+    stats->batches = stat64_get(&rcu_stats.batches);
+    stats->expedited_batches = stat64_get(&rcu_stats.expedited_batches);
+    stats->callbacks = stat64_get(&rcu_stats.callbacks);
+    stats->pending = rcu_call_pending();
+    stats->max_batch = stat64_get(&rcu_stats.max_batch);
+    stats->last_latency_ns = stat64_get(&rcu_stats.last_latency_ns);
+    stats->max_latency_ns = stat64_get(&rcu_stats.max_latency_ns);
 }
 
 
@@ -353,10 +536,10 @@ void drain_call_rcu(void)
      * is called, all RCU callbacks that were registered on this thread
      * prior to calling this function are completed.
      *
-     * Note that since we have only one global queue of the RCU callbacks,
-     * we also end up waiting for most of RCU callbacks that were registered
-     * on the other threads, but this is a side effect that shouldn't be
-     * assumed.
+     * Note that the call_rcu thread collects the callbacks of all threads
+     * before each grace period, so we also end up waiting for most of RCU
+     * callbacks that were registered on the other threads, but this is a
+     * side effect that shouldn't be assumed.
      */
 
     qatomic_inc(&in_drain_call_rcu);
@@ -376,13 +559,25 @@ void rcu_register_thread(void)
     qemu_mutex_lock(&rcu_registry_lock);
     QLIST_INSERT_HEAD(&registry, get_ptr_rcu_reader(), node);
     qemu_mutex_unlock(&rcu_registry_lock);
+    get_ptr_rcu_reader()->registered = true;
 }
 
 void rcu_unregister_thread(void)
 {
+    struct rcu_reader_data *p_rcu_reader = get_ptr_rcu_reader();
+    struct rcu_head *first, *last;
+    unsigned long n;
+
+    p_rcu_reader->registered = false;
     qemu_mutex_lock(&rcu_registry_lock);
-    QLIST_REMOVE(get_ptr_rcu_reader(), node);
+    QLIST_REMOVE(p_rcu_reader, node);
     qemu_mutex_unlock(&rcu_registry_lock);
+
+    /* The call_rcu thread cannot see our callbacks anymore, hand them over */
+    n = rcu_reader_take_callbacks(p_rcu_reader, &first, &last);
+    if (n) {
+        call_rcu_enqueue_global(first, last, n);
+    }
 }
 
 void rcu_add_force_rcu_notifier(Notifier *n)
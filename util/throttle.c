@@ -462,6 +462,38 @@ bool throttle_schedule_timer(ThrottleState *ts,
     return true;
 }
 
+static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
+    { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
+};
+static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
+    { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
+};
+
+/* Add @size bytes and @units operations to the buckets of @direction */
+static void throttle_do_account(ThrottleState *ts, ThrottleDirection direction,
+                                double size, double units)
+{
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
+        LeakyBucket *bkt;
+
+        bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
+        bkt->level += size;
+        if (bkt->burst_length > 1) {
+            bkt->burst_level += size;
+        }
+
+        bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
+        bkt->level += units;
+        if (bkt->burst_length > 1) {
+            bkt->burst_level += units;
+        }
+    }
+}
+
 /* do the accounting for this operation
  *
  * @direction: throttle direction
@@ -470,16 +502,7 @@ bool throttle_schedule_timer(ThrottleState *ts,
 void throttle_account(ThrottleState *ts, ThrottleDirection direction,
                       uint64_t size)
 {
-    static const BucketType bucket_types_size[THROTTLE_MAX][2] = {
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_READ },
-        { THROTTLE_BPS_TOTAL, THROTTLE_BPS_WRITE }
-    };
-    static const BucketType bucket_types_units[THROTTLE_MAX][2] = {
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_READ },
-        { THROTTLE_OPS_TOTAL, THROTTLE_OPS_WRITE }
-    };
     double units = 1.0;
-    unsigned i;
 
     assert(direction < THROTTLE_MAX);
     /* if cfg.op_size is defined and smaller than size we compute unit count */
@@ -487,19 +510,108 @@ void throttle_account(ThrottleState *ts, ThrottleDirection direction,
         units = (double) size / ts->cfg.op_size;
     }
 
+    throttle_do_account(ts, direction, size, units);
+}
+
+/* The amount of I/O that @bkt lets through in @ns nanoseconds */
+static intptr_t throttle_amount_in(LeakyBucket *bkt, int64_t ns)
+{
+    double amount = (double) bkt->avg * ns / NANOSECONDS_PER_SECOND;
+
+    return MIN(amount, INTPTR_MAX / 2);
+}
+
+/* Reserve the I/O that the limits of a direction allow for some time, and
+ * account it as if it had already been done.  The caller can then hand it
+ * out to requests without going through throttle_schedule_timer() for each.
+ * Limits that are not set allow an unlimited amount (INTPTR_MAX).
+ *
+ * Nothing is reserved if the limits use op_size, or if the reservation
+ * would make the next request wait.
+ *
+ * @clock_type: the clock that @ts uses
+ * @direction:  throttle direction
+ * @ns:         the time to reserve I/O for
+ * @bytes:      the number of bytes reserved
+ * @ops:        the number of operations reserved
+ * @ret:        whether anything was reserved
+ */
+bool throttle_reserve(ThrottleState *ts, QEMUClockType clock_type,
+                      ThrottleDirection direction, int64_t ns,
+                      intptr_t *bytes, intptr_t *ops)
+{
+    intptr_t res_bytes = INTPTR_MAX, res_ops = INTPTR_MAX;
+    int64_t next_timestamp;
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+    if (ts->cfg.op_size) {
+        return false;
+    }
+
     for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
         LeakyBucket *bkt;
 
         bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
-        bkt->level += size;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += size;
+        if (bkt->avg) {
+            res_bytes = MIN(res_bytes, throttle_amount_in(bkt, ns));
         }
 
         bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
-        bkt->level += units;
-        if (bkt->burst_length > 1) {
-            bkt->burst_level += units;
+        if (bkt->avg) {
+            res_ops = MIN(res_ops, throttle_amount_in(bkt, ns));
+        }
+    }
+
+    if (res_bytes == 0 || res_ops == 0) {
+        return false;
+    }
+
+    throttle_do_account(ts, direction,
+                        res_bytes == INTPTR_MAX ? 0 : res_bytes,
+                        res_ops == INTPTR_MAX ? 0 : res_ops);
+
+    if (throttle_compute_timer(ts, direction, qemu_clock_get_ns(clock_type),
+                               &next_timestamp)) {
+        throttle_unreserve(ts, direction, res_bytes, res_ops);
+        return false;
+    }
+
+    *bytes = res_bytes;
+    *ops = res_ops;
+    return true;
+}
+
+/* Give back what is left of a throttle_reserve() reservation
+ *
+ * @direction:  throttle direction
+ * @bytes:      the number of bytes left
+ * @ops:        the number of operations left
+ */
+void throttle_unreserve(ThrottleState *ts, ThrottleDirection direction,
+                        intptr_t bytes, intptr_t ops)
+{
+    unsigned i;
+
+    assert(direction < THROTTLE_MAX);
+    for (i = 0; i < ARRAY_SIZE(bucket_types_size[THROTTLE_READ]); i++) {
+        LeakyBucket *bkt;
+
+        /* Unlimited reservations only leave their mark in unset buckets */
+        bkt = &ts->cfg.buckets[bucket_types_size[direction][i]];
+        if (bkt->avg) {
+            bkt->level = MAX(bkt->level - bytes, 0);
+            if (bkt->burst_length > 1) {
+                bkt->burst_level = MAX(bkt->burst_level - bytes, 0);
+            }
+        }
+
+        bkt = &ts->cfg.buckets[bucket_types_units[direction][i]];
+        if (bkt->avg) {
+            bkt->level = MAX(bkt->level - ops, 0);
+            if (bkt->burst_length > 1) {
+                bkt->burst_level = MAX(bkt->burst_level - ops, 0);
+            }
         }
     }
 }
@@ -52,6 +52,14 @@
  * possible by QIOChannel's support for spurious coroutine re-entry in
  * qio_channel_yield(). The coroutine will restart I/O when re-entered from the
  * new AioContext.
+ *
+ * The virtqueues can also be spread over several AioContexts with
+ * vhost_user_server_set_queue_aio_contexts(). Their kick fds are then
+ * monitored, and the requests processed, in these AioContexts. libvhost-user
+ * is not thread-safe however, so vu_client_trip() pauses all virtqueues
+ * while it handles a vhost-user message: it stops monitoring the kick fds,
+ * waits for the kick handlers that may still be running and for in-flight
+ * requests, and only resumes the virtqueues after vu_dispatch() returns.
  */
 
 static void vmsg_close_fds(VhostUserMsg *vmsg)
@@ -96,6 +104,12 @@ void vhost_user_server_inc_in_flight(VuServer *server)
 void vhost_user_server_dec_in_flight(VuServer *server)
 {
     if (qatomic_fetch_dec(&server->in_flight) == 1) {
+        Coroutine *co = qatomic_read(&server->idle_waiter);
+
+        /* Pairs with vu_server_pause_queues() */
+        if (co && qatomic_xchg(&server->idle_waiter, NULL)) {
+            aio_co_wake(co);
+        }
         if (server->wait_idle) {
             aio_co_wake(server->co_trip);
         }
@@ -107,6 +121,99 @@ bool vhost_user_server_has_in_flight(VuServer *server)
     return qatomic_load_acquire(&server->in_flight) > 0;
 }
 
+static AioContext *vu_fd_watch_get_aio_context(VuServer *server,
+                                               VuFdWatch *vu_fd_watch)
+{
+    if (server->nr_queue_ctxs) {
+        /* libvhost-user passes the virtqueue index as the kick fd's pvt */
+        intptr_t idx = (intptr_t)vu_fd_watch->pvt;
+
+        return server->queue_ctxs[idx % server->nr_queue_ctxs];
+    }
+    return server->ctx;
+}
+
+static void kick_handler(void *opaque);
+static bool kick_poll(void *opaque);
+static void kick_poll_ready(void *opaque);
+
+static void vu_fd_watch_attach(VuServer *server, VuFdWatch *vu_fd_watch)
+{
+    aio_set_fd_handler(vu_fd_watch_get_aio_context(server, vu_fd_watch),
+                       vu_fd_watch->fd, kick_handler, NULL,
+                       kick_poll, kick_poll_ready, vu_fd_watch);
+}
+
+static void vu_fd_watch_detach(VuServer *server, VuFdWatch *vu_fd_watch)
+{
+    aio_set_fd_handler(vu_fd_watch_get_aio_context(server, vu_fd_watch),
+                       vu_fd_watch->fd, NULL, NULL, NULL, NULL, NULL);
+}
+
+static void vu_server_pause_bh(void *opaque)
+{
+    VuServer *server = opaque;
+
+    if (qatomic_fetch_dec(&server->pause_bhs) == 1) {
+        aio_co_wake(server->co_trip);
+    }
+}
+
+/*
+ * Stop processing the virtqueues that run in other AioContexts, so that
+ * libvhost-user can safely update its state.  Does nothing if the
+ * virtqueues run in server->ctx, because vu_client_trip() never runs
+ * concurrently with them then.
+ */
+static void coroutine_fn vu_server_pause_queues(VuServer *server)
+{
+    VuFdWatch *vu_fd_watch;
+    unsigned int i;
+
+    if (!server->nr_queue_ctxs || server->queues_paused) {
+        return;
+    }
+    server->queues_paused = true;
+
+    QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
+        vu_fd_watch_detach(server, vu_fd_watch);
+    }
+
+    /* Wait for the kick handlers that may still be running */
+    qatomic_set(&server->pause_bhs, server->nr_queue_ctxs);
+    for (i = 0; i < server->nr_queue_ctxs; i++) {
+        aio_bh_schedule_oneshot(server->queue_ctxs[i], vu_server_pause_bh,
+                                server);
+    }
+    qemu_coroutine_yield();
+
+    /* Then for the requests that they started */
+    qatomic_set(&server->idle_waiter, qemu_coroutine_self());
+    smp_mb();
+    if (vhost_user_server_has_in_flight(server) ||
+        !qatomic_xchg(&server->idle_waiter, NULL)) {
+        /* vhost_user_server_dec_in_flight() wakes us up */
+        qemu_coroutine_yield();
+    }
+}
+
+static void vu_server_resume_queues(VuServer *server)
+{
+    VuFdWatch *vu_fd_watch;
+
+    if (!server->queues_paused) {
+        return;
+    }
+    server->queues_paused = false;
+
+    /* vhost_user_server_attach_aio_context() resumes them otherwise */
+    if (server->ctx) {
+        QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
+            vu_fd_watch_attach(server, vu_fd_watch);
+        }
+    }
+}
+
 static bool coroutine_fn
 vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
 {
@@ -199,6 +306,8 @@ vu_message_read(VuDev *vu_dev, int conn_fd, VhostUserMsg *vmsg)
         }
     }
 
+    /* Resumed by vu_client_trip() once the message has been handled */
+    vu_server_pause_queues(server);
     return true;
 
 fail:
@@ -222,8 +331,13 @@ static coroutine_fn void vu_client_trip(void *opaque)
         if (!vu_dispatch(vu_dev) && server->ctx) {
             break;
         }
+        vu_server_resume_queues(server);
     }
 
+    /* Kick handlers in other threads must be done before vu_deinit() */
+    vu_server_pause_queues(server);
+    server->queues_paused = false;
+
     if (vhost_user_server_has_in_flight(server)) {
         /* Wait for requests to complete before we can unmap the memory */
         server->wait_idle = true;
@@ -272,6 +386,29 @@ static void kick_handler(void *opaque)
     }
 }
 
+/* Process the virtqueue of a kick fd as soon as it has requests */
+static bool kick_poll(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+    VuDev *vu_dev = vu_fd_watch->vu_dev;
+    intptr_t idx = (intptr_t)vu_fd_watch->pvt;
+
+    return !vu_queue_empty(vu_dev, vu_get_queue(vu_dev, idx));
+}
+
+static void kick_poll_ready(void *opaque)
+{
+    VuFdWatch *vu_fd_watch = opaque;
+    VuDev *vu_dev = vu_fd_watch->vu_dev;
+    intptr_t idx = (intptr_t)vu_fd_watch->pvt;
+    VuVirtq *vq = vu_get_queue(vu_dev, idx);
+
+    /* The kick fd was not necessarily written, so don't use vu_kick_cb */
+    if (vq->handler) {
+        vq->handler(vu_dev, idx);
+    }
+}
+
 static VuFdWatch *find_vu_fd_watch(VuServer *server, int fd)
 {
 
@@ -303,11 +440,12 @@ set_watch(VuDev *vu_dev, int fd, int vu_evt,
 
         vu_fd_watch->fd = fd;
         vu_fd_watch->cb = cb;
-        qemu_socket_set_nonblock(fd);
-        aio_set_fd_handler(server->ctx, fd, kick_handler,
-                           NULL, NULL, NULL, vu_fd_watch);
         vu_fd_watch->vu_dev = vu_dev;
         vu_fd_watch->pvt = pvt;
+        qemu_socket_set_nonblock(fd);
+        if (!server->queues_paused) {
+            vu_fd_watch_attach(server, vu_fd_watch);
+        }
     }
 }
 
@@ -325,7 +463,7 @@ static void remove_watch(VuDev *vu_dev, int fd)
     if (!vu_fd_watch) {
         return;
     }
-    aio_set_fd_handler(server->ctx, fd, NULL, NULL, NULL, NULL, NULL);
+    vu_fd_watch_detach(server, vu_fd_watch);
 
     QTAILQ_REMOVE(&server->vu_fd_watches, vu_fd_watch, next);
     g_free(vu_fd_watch);
@@ -385,8 +523,7 @@ void vhost_user_server_stop(VuServer *server)
         VuFdWatch *vu_fd_watch;
 
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
-                               NULL, NULL, NULL, NULL, vu_fd_watch);
+            vu_fd_watch_detach(server, vu_fd_watch);
         }
 
         qio_channel_shutdown(server->ioc, QIO_CHANNEL_SHUTDOWN_BOTH, NULL);
@@ -423,9 +560,10 @@ void vhost_user_server_attach_aio_context(VuServer *server, AioContext *ctx)
         return;
     }
 
-    QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-        aio_set_fd_handler(ctx, vu_fd_watch->fd, kick_handler, NULL,
-                           NULL, NULL, vu_fd_watch);
+    if (!server->queues_paused) {
+        QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
+            vu_fd_watch_attach(server, vu_fd_watch);
+        }
     }
 
     if (server->co_trip) {
@@ -456,8 +594,7 @@ void vhost_user_server_detach_aio_context(VuServer *server)
         VuFdWatch *vu_fd_watch;
 
         QTAILQ_FOREACH(vu_fd_watch, &server->vu_fd_watches, next) {
-            aio_set_fd_handler(server->ctx, vu_fd_watch->fd,
-                               NULL, NULL, NULL, NULL, vu_fd_watch);
+            vu_fd_watch_detach(server, vu_fd_watch);
         }
     }
 
@@ -471,6 +608,21 @@ void vhost_user_server_detach_aio_context(VuServer *server)
     }
 }
 
+/*
+ * Process virtqueue i in @ctxs[i % @nr_ctxs] instead of the server's
+ * AioContext.  @ctxs must stay valid until the server is stopped.  Must be
+ * called before a client connects.
+ */
+void vhost_user_server_set_queue_aio_contexts(VuServer *server,
+                                              AioContext **ctxs,
+                                              unsigned int nr_ctxs)
+{
+    assert(!server->sioc);
+
+    server->queue_ctxs = ctxs;
+    server->nr_queue_ctxs = nr_ctxs;
+}
+
 bool vhost_user_server_start(VuServer *server,
                              SocketAddress *socket_addr,
                              AioContext *ctx,